@@ -142,7 +142,7 @@ void VarSliceStmt::evaluate() {
 
 // evaluate a for loop
 void LoopStmt::evaluate() {
-	double i, a, stmt_size, s, e, inval;
+	double i, s, e, inval;
 	multi_array<double> *s_, *e_, *in, *val;
 	// val holds the value for the variable used by the for loop (i=...)
 	val = new multi_array<double>(1); 
@@ -165,22 +165,17 @@ void LoopStmt::evaluate() {
 		delete (*vars)[name];
 	}
 
-	stmt_size = body->size();
 	if (inval > 0) { // if "end" is bigger than "start"
 		for (i = s; i <= e; i += inval) {
 			*val = i;
 			(*vars)[name] = val; // update variable used by for loop
-			for (a = 0; a < stmt_size; ++a) {
-				body->evaluate(); // execute statements
-			}
+			body->evaluate(); // execute statements
 		}
 	} else if (inval < 0) { // if "start" is bigger than "end"
 		for (i = s; i >= e; i += inval) {
 			*val = i;
 			(*vars)[name] = val; // update variable used by for loop
-			for (a = 0; a < stmt_size; ++a) {
-				body->evaluate(); // execute statements
-			}
+			body->evaluate(); // execute statements
 		}
 	} else { // if interval is 0
 		cout << "Error: Can not use 0 as interval in for loop!\n";
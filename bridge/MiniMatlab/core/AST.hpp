@@ -21,6 +21,9 @@ public:
 	Exp() { }
 
 	virtual multi_array<double>* evaluate() = 0; // all sub-classes need this method
+
+	// true if evaluate() always returns the same value, e.g. "end-1", which can then be cached
+	virtual bool is_constant() { return false; }
 };
 
 /**
@@ -38,6 +41,8 @@ public:
 	PlusExp(Exp *a, Exp *b) : l(a), r(b) { }
 
 	multi_array<double>* evaluate();
+
+	bool is_constant() { return l->is_constant() && r->is_constant(); }
 };
 
 /**
@@ -55,6 +60,8 @@ public:
 	MinusExp(Exp *a, Exp *b) : l(a), r(b) { }
 
 	multi_array<double>* evaluate();
+
+	bool is_constant() { return l->is_constant() && r->is_constant(); }
 };
 
 /**
@@ -72,6 +79,8 @@ public:
 	MultExp(Exp *a, Exp *b) : l(a), r(b) { }
 
 	multi_array<double>* evaluate();
+
+	bool is_constant() { return l->is_constant() && r->is_constant(); }
 };
 
 /**
@@ -89,6 +98,8 @@ public:
 	DivExp(Exp *a, Exp *b) : l(a), r(b) { }
 
 	multi_array<double>* evaluate();
+
+	bool is_constant() { return l->is_constant() && r->is_constant(); }
 };
 
 /**
@@ -105,6 +116,8 @@ public:
 	UnaryMinusExp(Exp *e) : exp(e) { }
 
 	multi_array<double>* evaluate();
+
+	bool is_constant() { return exp->is_constant(); }
 };
 
 /**
@@ -120,6 +133,8 @@ public:
 	Number(double n) : num(n) { }
 
 	multi_array<double>* evaluate();
+
+	bool is_constant() { return true; }
 };
 
 /**
@@ -151,8 +166,34 @@ private:
 	Exp *it;
 	Exp *end;
 
+	// the values of constant bounds, which are evaluated at first use only since reading a
+	// value makes Bohrium execute everything queued, e.g. in every iteration of a for loop
+	double c_start, c_it, c_end;
+	bool is_constant, is_cached;
+
+	// returns the single value of 'e'
+	static double value(Exp *e) {
+		multi_array<double> *out = e->evaluate();
+		double v = *out->begin();
+		// we remember to de-allocate out if need be
+		if (out->getTemp()) delete out;
+
+		return v;
+	}
+
+	// evaluates the constant bounds once
+	void cache() {
+		if (!is_cached) {
+			c_start = value(start);
+			c_it = value(it);
+			c_end = value(end);
+			is_cached = true;
+		}
+	}
+
 public:
-	Slice(Exp *s, Exp *i, Exp *e) : start(s), it(i), end(e) { }
+	Slice(Exp *s, Exp *i, Exp *e) : start(s), it(i), end(e),
+		is_constant(s->is_constant() && i->is_constant() && e->is_constant()), is_cached(false) { }
 
 	/**
  	* Getter method
@@ -160,12 +201,9 @@ public:
  	* returns start as a double
  	*/
 	double get_start() {
-		multi_array<double> *out = start->evaluate();
-		double s = *out->begin();
-		// we remember to de-allocate out if need be
-		if (out->getTemp()) delete out; 
-
-		return s - 1;
+		if (!is_constant) return value(start) - 1;
+		cache();
+		return c_start - 1;
 	}
 
 	/**
@@ -174,12 +212,9 @@ public:
  	* returns it as a double
  	*/
 	double get_it() {
-		multi_array<double> *out = it->evaluate();
-		double i = *out->begin();
-		// we remember to de-allocate out if need be
-		if (out->getTemp()) delete out;
-
-		return i;
+		if (!is_constant) return value(it);
+		cache();
+		return c_it;
 	}
 
 	/**
@@ -188,12 +223,9 @@ public:
  	* returns end as a double
  	*/
 	double get_end() {
-		multi_array<double> *out = end->evaluate();
-		double e = *out->begin();
-		// we remember to de-allocate out if need be
-		if (out->getTemp()) delete out;
-
-		return e;
+		if (!is_constant) return value(end);
+		cache();
+		return c_end;
 	}
 };
 
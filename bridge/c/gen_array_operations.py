@@ -22,6 +22,9 @@ def main(args):
 
     # Let's generate the header and implementation of all array operations
     head = ""; impl = ""
+    # The batched variants: the inline functions of the header, the dispatchers of the implementation, and
+    # the table of dispatchers, which the signature index of a batched operation selects
+    batch_head = ""; batch_impl = ""; batch_table = []
     for op in opcodes:
         if op['opcode'] in ["BH_REPEAT", "BH_RANDOM", "BH_NONE", "BH_TALLY"]:#We handle random separately and ignore None
             continue
@@ -72,11 +75,40 @@ def main(args):
                         if t.startswith("BH_COMPLEX"):
                             impl += "\ti%(i)d.real(in%(i)d.real);\n"%{'i':i+1}
                             impl += "\ti%(i)d.imag(in%(i)d.imag);\n"%{'i':i+1}
+                        elif t in ["BH_FLOAT16", "BH_BFLOAT16"]:
+                            impl += "\ti%(i)d.bits = in%(i)d.bits;\n"%{'i':i+1}
                         else:
                             impl += "\ti%(i)d = in%(i)d;\n"%{'i':i+1}
                         bxx_args += ", i%d"%(i+1);
                 impl += "\tbhxx::%s(%s);\n"%(op['opcode'][3:].lower(), bxx_args)
                 impl += "}\n"
+
+                # The batched variant writes the operands to the batch and its dispatcher calls the above
+                name = decl[len("void bhc_"):decl.index("(")]
+                batch_head += "static inline void bhc_batch_%s(bhc_batch *batch, %s\n" % (name, decl[decl.index("(")+1:])
+                batch_head += "{\n"
+                batch_head += "\tbhc_batch_instr *instr;\n"
+                batch_head += "\tif (batch->count == BHC_BATCH_SIZE) {\n"
+                batch_head += "\t\tbhc_flush_batch(batch);\n"
+                batch_head += "\t}\n"
+                batch_head += "\tinstr = &batch->instr[batch->count++];\n"
+                batch_head += "\tinstr->sig = %d;\n" % len(batch_table)
+                batch_head += "\tinstr->operand[0] = out;\n"
+                batch_impl += "static void bhc_batch_op_%s(const bhc_batch_instr *instr)\n" % name
+                batch_impl += "{\n"
+                call_args = ["(%s) instr->operand[0]" % type_map[type_sig[0]]['bhc_ary']]
+                for i, (symbol, t) in enumerate(zip(layout[1:], type_sig[1:])):
+                    if symbol == "A":
+                        batch_head += "\tinstr->operand[%d] = in%d;\n" % (i+1, i+1)
+                        call_args.append("(%s) instr->operand[%d]" % (type_map[t]['bhc_ary'], i+1))
+                    else:
+                        batch_head += "\tinstr->operand[%d] = NULL;\n" % (i+1)
+                        batch_head += "\tinstr->constant.%s = in%d;\n" % (type_map[t]['name'], i+1)
+                        call_args.append("instr->constant.%s" % type_map[t]['name'])
+                batch_head += "}\n"
+                batch_impl += "\tbhc_%s(%s);\n" % (name, ", ".join(call_args))
+                batch_impl += "}\n"
+                batch_table.append("bhc_batch_op_%s" % name)
         impl += "\n\n"; head += "\n\n"
 
     #Let's handle random
@@ -100,6 +132,45 @@ def main(args):
 {
     bhxx::random(*((bhxx::BhArray<uint64_t>*) out), seed, key);
 }
+"""
+
+    #Let's handle the batches
+    doc = """
+/* Batched array operations for many small calls.
+   The bhc_batch_<op> functions are inline and only write the operation to the user's 'batch'. They take the
+   arguments of the corresponding bhc_<op> function, which bhc_flush_batch() calls for each batched operation
+   in order (a full batch is flushed first). NB: the arrays of a batched operation must stay alive until the
+   batch is flushed and bhc_flush() doesn't flush the batches. */
+"""
+    head += doc
+    head += "#define BHC_BATCH_SIZE 1024\n\n"
+    head += "typedef struct {\n"
+    head += "\tuint32_t sig; // The index of the signature\n"
+    head += "\tconst void *operand[%d]; // The arrays, NULL for the constant\n" % \
+            max(len(layout) for op in opcodes for layout in op['layout'])
+    head += "\tunion {\n"
+    for t in types[:-1]:
+        head += "\t\t%s %s;\n" % (type_map[t['enum']]['bhc'], type_map[t['enum']]['name'])
+    head += "\t} constant;\n"
+    head += "} bhc_batch_instr;\n\n"
+    head += "typedef struct {\n"
+    head += "\tuint32_t count; // Must be zero initially\n"
+    head += "\tbhc_batch_instr instr[BHC_BATCH_SIZE];\n"
+    head += "} bhc_batch;\n\n"
+    head += "// Calls the batched operations of 'batch' and empties it\n"
+    head += "DLLEXPORT void bhc_flush_batch(bhc_batch *batch);\n\n"
+    head += batch_head
+    impl += "\n\n%s\n" % batch_impl
+    impl += "static void (*const bhc_batch_ops[])(const bhc_batch_instr *instr) = {\n\t%s\n};\n\n" % \
+            ",\n\t".join(batch_table)
+    impl += """void bhc_flush_batch(bhc_batch *batch)
+{
+    const uint32_t count = batch->count;
+    batch->count = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        bhc_batch_ops[batch->instr[i].sig](&batch->instr[i]);
+    }
+}
 """
 
     #Let's add header and footer
@@ -108,6 +179,8 @@ def main(args):
 #ifndef __BHC_ARRAY_OPERATIONS_H
 #define __BHC_ARRAY_OPERATIONS_H
 
+#include <stddef.h>
+
 #ifdef _WIN32
 #define DLLEXPORT __declspec( dllexport )
 #else
@@ -57,6 +57,30 @@ def main(args):
     bhxx::BhArray<%(cpp)s> *ret = new bhxx::BhArray<%(cpp)s>({size});
     return (%(bhc_ary)s) ret;
 }
+"""%t
+
+    doc = "\n//Create new flat array of the 'size' elements of 'data' without copying them. Bohrium reads and writes\n"
+    doc += "//'data' in place and calls 'release(data, arg)' (if not NULL) when it frees the array, i.e. at the flush\n"
+    doc += "//after the array and its views are destroyed. Returns NULL when 'data' is NULL or not aligned to its type.\n"
+    impl += doc; head += doc
+    for key, t in type_map.items():
+        decl = "%(bhc_ary)s bhc_new_external_A%(name)s(uint64_t size, %(bhc)s *data, " % t
+        decl += "void (*release)(void *data, void *arg), void *arg)"
+        head += "DLLEXPORT %s;\n"%decl
+        impl += "%s"%decl
+        impl += """
+{
+    std::function<void(%(cpp)s*)> fn;
+    if (release != NULL) {
+        fn = [release, arg](%(cpp)s *d) { release(d, arg); };
+    }
+    try {
+        bhxx::BhArray<%(cpp)s> ary = bhxx::external_array(reinterpret_cast<%(cpp)s*>(data), {size}, fn);
+        return (%(bhc_ary)s) new bhxx::BhArray<%(cpp)s>(std::move(ary));
+    } catch (const std::invalid_argument&) {
+        return NULL;
+    }
+}
 """%t
 
     doc = "\n//Destroy array\n"
@@ -125,28 +149,79 @@ def main(args):
 {
     ((bhxx::BhArray<%(cpp)s>*)ary)->base->data = data;
 }
+"""%t
+
+    doc = "\n//Use the data at 'offset' in the file 'path' as the data of the unallocated base of 'ary',\n"
+    doc += "//which is mapped copy-on-write. Returns whether the file was mapped\n"
+    impl += doc; head += doc
+    for key, t in type_map.items():
+        decl = "bhc_bool bhc_data_map_file_A%(name)s(const %(bhc_ary)s ary, const char *path, int64_t offset)"%t
+        head += "DLLEXPORT %s;\n"%decl
+        impl += "%s"%decl
+        impl += """\
+{
+    return bh_data_map_file(((bhxx::BhArray<%(cpp)s>*)ary)->base.get(), path, offset);
+}
+"""%t
+
+    doc = "\n//Write the memory of the base of 'ary' to 'buffer' as its address (a device buffer or the host data),\n"
+    doc += "//its DLPack device type, and its device id, which other frameworks use without copies\n"
+    impl += doc; head += doc
+    for key, t in type_map.items():
+        decl = "void bhc_device_export_A%(name)s(const %(bhc_ary)s ary, uint64_t buffer[3])"%t
+        head += "DLLEXPORT %s;\n"%decl
+        impl += "%s"%decl
+        impl += """\
+{
+    const bhxx::DeviceBuffer ret = bhxx::device_export(*((bhxx::BhArray<%(cpp)s>*)ary)->base);
+    buffer[0] = ret.address;
+    buffer[1] = ret.device_type;
+    buffer[2] = ret.device_id;
+}
+"""%t
+
+    doc = "\n//Use the device memory 'address' of another framework as the data of the base of 'ary' without copying it.\n"
+    doc += "//Returns whether an engine imported the memory\n"
+    impl += doc; head += doc
+    for key, t in type_map.items():
+        decl = "bhc_bool bhc_device_import_A%(name)s(const %(bhc_ary)s ary, uint64_t address)"%t
+        head += "DLLEXPORT %s;\n"%decl
+        impl += "%s"%decl
+        impl += """\
+{
+    return bhxx::device_import(*((bhxx::BhArray<%(cpp)s>*)ary)->base, address);
+}
 """%t
 
     doc = "\n//Extension Method, returns 0 when the extension exist\n"
     impl += doc; head += doc
+    # The operands have the same type, except for the int64 indexes of e.g. argsort (out) and partition (in2)
+    signatures = []
     for key, t in type_map.items():
+        signatures.append((t, t, t))
+    for key, t in type_map.items():
+        if key != "BH_INT64":
+            signatures.append((type_map["BH_INT64"], t, t))
+            signatures.append((t, t, type_map["BH_INT64"]))
+    for o, i1, i2 in signatures:
         decl = "int bhc_extmethod"
-        decl += "_A%(name)s_A%(name)s_A%(name)s"%t
-        decl += "(const char *name, %(bhc_ary)s out, const %(bhc_ary)s in1, const %(bhc_ary)s in2)"%t
+        decl += "_A%s_A%s_A%s" % (o['name'], i1['name'], i2['name'])
+        decl += "(const char *name, %s out, const %s in1, const %s in2)" % (o['bhc_ary'], i1['bhc_ary'],
+                                                                         i2['bhc_ary'])
         head += "DLLEXPORT %s;\n"%decl
         impl += "%s"%decl
         impl += """
 {
     try{
-        bhxx::Runtime::instance().enqueue_extmethod(name, *((bhxx::BhArray<%(cpp)s>*) out),
-                                                          *((bhxx::BhArray<%(cpp)s>*) in1),
-                                                          *((bhxx::BhArray<%(cpp)s>*) in2));
+        bhxx::Runtime::instance().enqueue_extmethod(name, *((bhxx::BhArray<%s>*) out),
+                                                          *((bhxx::BhArray<%s>*) in1),
+                                                          *((bhxx::BhArray<%s>*) in2));
     }catch (... ){
         return -1;
     }
     return 0;
 }
-"""%t
+""" % (o['cpp'], i1['cpp'], i2['cpp'])
 
     #Let's add header and footer
     head = """/* Bohrium C Bridge: special functions. Auto generated! */
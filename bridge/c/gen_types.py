@@ -52,6 +52,8 @@ typedef double        bhc_float64;
 typedef struct { bhc_float32 real, imag; } bhc_complex64;
 typedef struct { bhc_float64 real, imag; } bhc_complex128;
 typedef struct { bhc_uint64 start, key; } bhc_r123;
+typedef struct { uint16_t bits; } bhc_float16;
+typedef struct { uint16_t bits; } bhc_bfloat16;
 
 #ifdef _WIN32
 #define DLLEXPORT __declspec( dllexport )
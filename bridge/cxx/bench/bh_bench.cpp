@@ -0,0 +1,421 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* A repeatable benchmark suite of the component stack through bhxx.
+ *
+ * Every benchmark is swept over the sizes (the number of elements of its arrays) and timed a number of times
+ * after a cold run. The cold run includes the fusion, code generation, and compilation of the kernels, which
+ * the warm runs get from the caches, thus the difference of the cold run and the median is the overhead.
+ * The results are written as JSON and can be compared against a stored baseline to catch regressions, e.g.
+ *
+ *     bh_bench --output baseline.json
+ *     bh_bench --baseline baseline.json --threshold 0.1
+ *
+ * which exits with status 1 if any benchmark got more than 10% slower than the baseline.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <bhxx/bhxx.hpp>
+
+using namespace std;
+using bhxx::BhArray;
+using bhxx::Runtime;
+
+namespace {
+
+// One run of a benchmark, which enqueues the instructions of one iteration
+typedef function<void()> Run;
+
+struct Benchmark {
+    string name;
+    // Allocates the arrays of size 'n', sets the bytes and FLOPs of one run, and returns the run
+    function<Run(size_t n, uint64_t &bytes, uint64_t &flops)> make;
+};
+
+struct Result {
+    string name;
+    size_t size;
+    int repeats;
+    double cold, min, median;
+    uint64_t bytes, flops;
+
+    double gbps() const {
+        return median <= 0 ? 0 : bytes / median / 1e9;
+    }
+    double gflops() const {
+        return median <= 0 ? 0 : flops / median / 1e9;
+    }
+    double overhead() const {
+        return max(0.0, cold - median);
+    }
+};
+
+// The side of a square matrix of 'n' elements
+size_t side(size_t n) {
+    return max<size_t>(3, static_cast<size_t>(sqrt(static_cast<double>(n))));
+}
+
+// An array of 'n' uniform random doubles in [0, 1)
+BhArray<double> uniform(bhxx::Shape shape, uint64_t seed) {
+    BhArray<uint64_t> r(shape);
+    bhxx::random(r, seed, 0);
+    BhArray<double> ret(shape);
+    bhxx::identity(ret, r);
+    bhxx::divide(ret, ret, 18446744073709551616.0);
+    return ret;
+}
+
+vector<Benchmark> benchmarks() {
+    vector<Benchmark> ret;
+    ret.push_back({"elementwise_chain", [](size_t n, uint64_t &bytes, uint64_t &flops) -> Run {
+        BhArray<double> a = uniform({n}, 1), b({n});
+        bytes = 2 * n * sizeof(double);
+        flops = 6 * n;
+        return [=]() mutable {
+            BhArray<double> t({n});
+            bhxx::multiply(t, a, a);
+            bhxx::add(t, t, a);
+            bhxx::multiply(t, t, 0.5);
+            bhxx::subtract(t, t, a);
+            bhxx::add(b, a, 1.0);
+            bhxx::divide(b, t, b);
+            bhxx::free(t);
+        };
+    }});
+    for (int64_t axis = 0; axis < 2; ++axis) {
+        ret.push_back({"reduce_axis" + to_string(axis), [axis](size_t n, uint64_t &bytes, uint64_t &flops) -> Run {
+            const size_t s = side(n);
+            BhArray<double> a = uniform({s, s}, 2), r({s});
+            bytes = (s * s + s) * sizeof(double);
+            flops = s * s;
+            return [=]() mutable { bhxx::add_reduce(r, a, axis); };
+        }});
+    }
+    ret.push_back({"stencil_5pt", [](size_t n, uint64_t &bytes, uint64_t &flops) -> Run {
+        const size_t s = side(n);
+        BhArray<double> a = uniform({s, s}, 3), b({s, s});
+        bhxx::identity(b, 0.0);
+        bytes = 2 * s * s * sizeof(double);
+        flops = 5 * (s - 2) * (s - 2);
+        // The interior and its four neighbours
+        auto view = [s](const BhArray<double> &ary, int64_t row, int64_t col) {
+            return BhArray<double>(ary.base, {s - 2, s - 2}, {static_cast<int64_t>(s), 1}, (1 + row) * s + 1 + col);
+        };
+        return [=]() mutable {
+            BhArray<double> out = view(b, 0, 0);
+            bhxx::add(out, view(a, 0, 0), view(a, -1, 0));
+            bhxx::add(out, out, view(a, 1, 0));
+            bhxx::add(out, out, view(a, 0, -1));
+            bhxx::add(out, out, view(a, 0, 1));
+            bhxx::multiply(out, out, 0.2);
+        };
+    }});
+    // The indices of the gather and scatter are random thus they access the memory randomly
+    auto indices = [](size_t n) {
+        BhArray<uint64_t> ret({n});
+        bhxx::random(ret, 4, 0);
+        bhxx::mod(ret, ret, static_cast<uint64_t>(n));
+        return ret;
+    };
+    ret.push_back({"gather", [indices](size_t n, uint64_t &bytes, uint64_t &flops) -> Run {
+        BhArray<double> a = uniform({n}, 5), b({n});
+        BhArray<uint64_t> idx = indices(n);
+        bytes = n * (2 * sizeof(double) + sizeof(uint64_t));
+        flops = 0;
+        return [=]() mutable { bhxx::gather(b, a, idx); };
+    }});
+    ret.push_back({"scatter", [indices](size_t n, uint64_t &bytes, uint64_t &flops) -> Run {
+        BhArray<double> a = uniform({n}, 6), b({n});
+        BhArray<uint64_t> idx = indices(n);
+        bytes = n * (2 * sizeof(double) + sizeof(uint64_t));
+        flops = 0;
+        return [=]() mutable { bhxx::scatter(b, a, idx); };
+    }});
+    ret.push_back({"histogram", [indices](size_t n, uint64_t &bytes, uint64_t &flops) -> Run {
+        constexpr uint64_t nbins = 256;
+        BhArray<uint64_t> idx = indices(n);
+        bhxx::mod(idx, idx, nbins);
+        BhArray<double> bins({nbins});
+        bhxx::identity(bins, 0.0);
+        bytes = n * sizeof(uint64_t);
+        flops = n;
+        return [=]() mutable { bhxx::add_scatter(bins, 1.0, idx); };
+    }});
+    ret.push_back({"spmv", [](size_t n, uint64_t &bytes, uint64_t &flops) -> Run {
+        // Five nonzeros per row in random columns
+        constexpr uint64_t per_row = 5;
+        BhArray<uint64_t> indptr({n + 1}), columns({n * per_row});
+        bhxx::range(indptr);
+        bhxx::multiply(indptr, indptr, per_row);
+        bhxx::random(columns, 15, 0);
+        bhxx::mod(columns, columns, static_cast<uint64_t>(n));
+        const bhxx::CsrMatrix<double> a(n, n, uniform({n * per_row}, 16), columns, indptr);
+        BhArray<double> x = uniform({n}, 17);
+        bytes = n * per_row * (2 * sizeof(double) + 2 * sizeof(uint64_t)) + 2 * n * sizeof(double);
+        flops = 2 * n * per_row;
+        return [=]() mutable { bhxx::spmv(a, x); };
+    }});
+    ret.push_back({"window_max", [](size_t n, uint64_t &bytes, uint64_t &flops) -> Run {
+        constexpr int64_t window = 64;
+        BhArray<double> a = uniform({n}, 12);
+        bytes = 2 * n * sizeof(double);
+        flops = 2 * n;
+        return [=]() mutable { bhxx::window_reduce(a, "max", window); };
+    }});
+    ret.push_back({"packbits", [](size_t n, uint64_t &bytes, uint64_t &flops) -> Run {
+        BhArray<bool> mask({n});
+        bhxx::less(mask, uniform({n}, 13), 0.5);
+        bytes = n * sizeof(bool) + (n + 7) / 8;
+        flops = n;
+        return [=]() mutable { bhxx::packbits(mask); };
+    }});
+    ret.push_back({"random", [](size_t n, uint64_t &bytes, uint64_t &flops) -> Run {
+        BhArray<uint64_t> a({n});
+        bytes = n * sizeof(uint64_t);
+        flops = 0;
+        uint64_t key = 0;
+        return [=]() mutable { bhxx::random(a, 7, key++); };
+    }});
+    ret.push_back({"blas_gemm", [](size_t n, uint64_t &bytes, uint64_t &flops) -> Run {
+        const size_t s = side(n);
+        BhArray<double> a = uniform({s, s}, 8), b = uniform({s, s}, 9), c({s, s});
+        bytes = 3 * s * s * sizeof(double);
+        flops = 2 * s * s * s;
+        return [=]() mutable { Runtime::instance().enqueue_extmethod("blas_gemm", c, a, b); };
+    }});
+    // A long expression with many temporaries, which the fusion should turn into a single kernel
+    ret.push_back({"fusion_heavy", [](size_t n, uint64_t &bytes, uint64_t &flops) -> Run {
+        BhArray<double> x = uniform({n}, 10), y = uniform({n}, 11), out({n});
+        bytes = 3 * n * sizeof(double);
+        flops = 16 * n;
+        return [=]() mutable {
+            BhArray<double> t1({n}), t2({n}), t3({n});
+            bhxx::multiply(t1, x, y);
+            bhxx::add(t2, x, y);
+            bhxx::divide(t3, t1, t2);
+            bhxx::sqrt(t1, t2);
+            bhxx::multiply(t2, t3, t1);
+            bhxx::exp(t3, x);
+            bhxx::subtract(t1, t3, t2);
+            bhxx::multiply(t2, t1, 0.25);
+            bhxx::add(t3, t2, y);
+            bhxx::multiply(t1, t3, t3);
+            bhxx::subtract(t2, t1, x);
+            bhxx::divide(t3, t2, 3.0);
+            bhxx::add(t1, t3, t1);
+            bhxx::multiply(t2, t1, y);
+            bhxx::add(t3, t2, 1.0);
+            bhxx::sqrt(out, t3);
+            bhxx::free(t1);
+            bhxx::free(t2);
+            bhxx::free(t3);
+        };
+    }});
+    return ret;
+}
+
+// Time 'repeats' warm runs of 'bench' of size 'n' after a cold run
+Result measure(const Benchmark &bench, size_t n, int repeats) {
+    Result ret;
+    ret.name = bench.name;
+    ret.size = n;
+    ret.repeats = repeats;
+    Run run = bench.make(n, ret.bytes, ret.flops);
+    Runtime::instance().flush();
+
+    auto timed = [&run]() {
+        const auto begin = chrono::steady_clock::now();
+        run();
+        Runtime::instance().flush();
+        return chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+    };
+    ret.cold = timed();
+    vector<double> times;
+    for (int i = 0; i < repeats; ++i) {
+        times.push_back(timed());
+    }
+    sort(times.begin(), times.end());
+    ret.min = times.front();
+    ret.median = times[times.size() / 2];
+    return ret;
+}
+
+void write_json(const vector<Result> &results, ostream &out) {
+    out << setprecision(9) << "{\n  \"benchmarks\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result &r = results[i];
+        out << "    {\"name\": \"" << r.name << "\", \"size\": " << r.size << ", \"repeats\": " << r.repeats
+            << ", \"cold\": " << r.cold << ", \"min\": " << r.min << ", \"median\": " << r.median
+            << ", \"overhead\": " << r.overhead() << ", \"bytes\": " << r.bytes << ", \"gbps\": " << r.gbps()
+            << ", \"flops\": " << r.flops << ", \"gflops\": " << r.gflops() << "}"
+            << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+}
+
+// Returns the value of 'key' in the JSON object on 'line' as written by write_json()
+string json_value(const string &line, const string &key) {
+    const string pattern = "\"" + key + "\": ";
+    size_t begin = line.find(pattern);
+    if (begin == string::npos) {
+        return "";
+    }
+    begin += pattern.size();
+    if (line[begin] == '"') {
+        ++begin;
+        return line.substr(begin, line.find('"', begin) - begin);
+    }
+    return line.substr(begin, line.find_first_of(",}", begin) - begin);
+}
+
+// Reads the median of each (name, size) of a JSON file written by write_json()
+map<pair<string, size_t>, double> read_baseline(const string &filename) {
+    ifstream in(filename);
+    if (not in) {
+        throw runtime_error("cannot open the baseline '" + filename + "'");
+    }
+    map<pair<string, size_t>, double> ret;
+    string line;
+    while (getline(in, line)) {
+        const string name = json_value(line, "name");
+        if (not name.empty()) {
+            ret[make_pair(name, stoul(json_value(line, "size")))] = stod(json_value(line, "median"));
+        }
+    }
+    return ret;
+}
+
+// Print the change of each result against the baseline and returns the number of regressions
+int compare(const vector<Result> &results, const map<pair<string, size_t>, double> &baseline, double threshold,
+            ostream &out) {
+    int regressions = 0;
+    for (const Result &r: results) {
+        const auto it = baseline.find(make_pair(r.name, r.size));
+        if (it == baseline.end() or it->second <= 0) {
+            out << r.name << " (" << r.size << "): not in the baseline\n";
+            continue;
+        }
+        const double ratio = r.median / it->second;
+        const bool regression = ratio > 1 + threshold;
+        regressions += regression;
+        stringstream change;
+        change << fixed << setprecision(1) << showpos << (ratio - 1) * 100 << "%";
+        out << r.name << " (" << r.size << "): " << it->second << "s -> " << r.median << "s (" << change.str()
+            << ")" << (regression ? " REGRESSION" : "") << "\n";
+    }
+    return regressions;
+}
+
+void usage(const char *prog) {
+    cerr << "Usage: " << prog << " [options]\n"
+         << "  --sizes N,N,...      the number of elements of the arrays (default 10000,100000,1000000)\n"
+         << "  --repeats N          the warm runs of each benchmark and size (default 5)\n"
+         << "  --filter NAME        only run the benchmarks whose name contains NAME\n"
+         << "  --output FILE        write the JSON results to FILE instead of stdout\n"
+         << "  --baseline FILE      compare the medians against the JSON results in FILE\n"
+         << "  --threshold R        the slowdown ratio that is a regression (default 0.1)\n"
+         << "  --list               list the benchmarks\n";
+}
+
+vector<size_t> parse_sizes(const string &arg) {
+    vector<size_t> ret;
+    stringstream ss(arg);
+    string item;
+    while (getline(ss, item, ',')) {
+        ret.push_back(static_cast<size_t>(stod(item)));
+    }
+    return ret;
+}
+
+} // Unnamed namespace
+
+int main(int argc, char *argv[]) {
+    vector<size_t> sizes = {10000, 100000, 1000000};
+    int repeats = 5;
+    string filter, output, baseline_file;
+    double threshold = 0.1;
+    const vector<Benchmark> all = benchmarks();
+
+    for (int i = 1; i < argc; ++i) {
+        const string arg = argv[i];
+        if (arg == "--list") {
+            for (const Benchmark &b: all) {
+                cout << b.name << "\n";
+            }
+            return 0;
+        } else if (i + 1 < argc and arg == "--sizes") {
+            sizes = parse_sizes(argv[++i]);
+        } else if (i + 1 < argc and arg == "--repeats") {
+            repeats = max(1, atoi(argv[++i]));
+        } else if (i + 1 < argc and arg == "--filter") {
+            filter = argv[++i];
+        } else if (i + 1 < argc and arg == "--output") {
+            output = argv[++i];
+        } else if (i + 1 < argc and arg == "--baseline") {
+            baseline_file = argv[++i];
+        } else if (i + 1 < argc and arg == "--threshold") {
+            threshold = atof(argv[++i]);
+        } else {
+            usage(argv[0]);
+            return arg == "--help" ? 0 : 2;
+        }
+    }
+
+    vector<Result> results;
+    for (const Benchmark &bench: all) {
+        if (bench.name.find(filter) == string::npos) {
+            continue;
+        }
+        for (size_t n: sizes) {
+            try {
+                results.push_back(measure(bench, n, repeats));
+                const Result &r = results.back();
+                cerr << bench.name << " (" << n << "): " << r.median << "s, " << r.gbps() << " GB/s, overhead "
+                     << r.overhead() << "s\n";
+            } catch (const exception &e) {
+                // E.g. the extension method isn't available in the component stack
+                cerr << bench.name << " (" << n << "): skipped, " << e.what() << "\n";
+            }
+        }
+    }
+
+    if (output.empty()) {
+        write_json(results, cout);
+    } else {
+        ofstream out(output);
+        write_json(results, out);
+    }
+    if (not baseline_file.empty()) {
+        return compare(results, read_baseline(baseline_file), threshold, cerr) > 0 ? 1 : 0;
+    }
+    return 0;
+}
@@ -0,0 +1,217 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* A benchmark of the fixed costs of the component stack, which dominate the small-array workloads:
+ *
+ *   - enqueue:      an instruction through bhxx::Runtime::enqueue()
+ *   - empty_flush:  a flush without instructions through the whole component stack
+ *   - cached_flush: a flush of one instruction whose kernel every cache of the stack has already
+ *   - fuse_cache:   a hit of jitk::FuseCache::get() as a function of the length of the instruction list
+ *   - get_function: a hit of EngineOpenMP::getFunction() (only when the OpenMP engine is built)
+ *
+ * The latencies are reported as percentiles in JSON, e.g. `bh_bench_overhead --samples 1000`.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <bhxx/bhxx.hpp>
+#include <bh_config_parser.hpp>
+#include <jitk/apply_fusion.hpp>
+#include <jitk/fuser_cache.hpp>
+#include <jitk/statistics.hpp>
+
+#ifdef BH_BENCH_OPENMP
+#include <engine_openmp.hpp>
+#endif
+
+using namespace std;
+using namespace bohrium;
+using bhxx::BhArray;
+using bhxx::Runtime;
+
+namespace {
+
+struct Result {
+    string name;
+    // E.g. the length of the instruction list of the fuse cache (zero when it doesn't apply)
+    size_t size;
+    // The latency of each sample in seconds in increasing order
+    vector<double> samples;
+
+    double percentile(double p) const {
+        return samples[min(samples.size() - 1, static_cast<size_t>(p / 100 * samples.size()))];
+    }
+};
+
+// Call 'func' 'samples' times and returns the latencies divided by 'ops', i.e. the operations of each call
+Result measure(const string &name, size_t size, int samples, size_t ops, const function<void()> &func,
+               const function<void()> &after = nullptr) {
+    Result ret{name, size, {}};
+    for (int i = 0; i < samples; ++i) {
+        const auto begin = chrono::steady_clock::now();
+        func();
+        ret.samples.push_back(chrono::duration<double>(chrono::steady_clock::now() - begin).count() / ops);
+        if (after) {
+            after();
+        }
+    }
+    sort(ret.samples.begin(), ret.samples.end());
+    return ret;
+}
+
+// The stack level of 'name' in the component stack or -1 if it isn't in the stack
+int stack_level(const string &name) {
+    try {
+        for (int level = 0;; ++level) {
+            if (ConfigParser(level).getName() == name) {
+                return level;
+            }
+        }
+    } catch (const ConfigError &) {
+        return -1;
+    }
+}
+
+// The bases and instructions of a chain of 'length' additions, i.e. the i'th instruction reads the result of
+// the previous instruction
+struct InstrChain {
+    vector<bh_base> bases;
+    vector<bh_instruction> instrs;
+    vector<bh_instruction *> instr_list;
+
+    explicit InstrChain(size_t length) : bases(length + 1) {
+        for (bh_base &base: bases) {
+            base.data = nullptr;
+            base.type = bh_type::FLOAT64;
+            base.nelem = 1000;
+        }
+        auto view = [this](size_t i) {
+            bh_view ret;
+            ret.base = &bases[i];
+            ret.start = 0;
+            ret.ndim = 1;
+            ret.shape[0] = bases[i].nelem;
+            ret.stride[0] = 1;
+            return ret;
+        };
+        for (size_t i = 0; i < length; ++i) {
+            instrs.emplace_back(BH_ADD, vector<bh_view>{view(i + 1), view(i), view(i)});
+            instrs.back().constructor = false;
+        }
+        for (bh_instruction &instr: instrs) {
+            instr_list.push_back(&instr);
+        }
+    }
+};
+
+vector<Result> run(int samples) {
+    vector<Result> ret;
+    Runtime &runtime = Runtime::instance();
+    BhArray<double> a({1}), b({1});
+    bhxx::identity(a, 1.0);
+    bhxx::identity(b, 0.0);
+    runtime.flush();
+
+    // The instructions are enqueued in batches since a single enqueue is close to the clock resolution
+    const size_t batch = 100;
+    ret.push_back(measure("enqueue", 0, samples, batch, [&]() {
+        for (size_t i = 0; i < batch; ++i) {
+            bhxx::add(b, b, a);
+        }
+    }, [&]() { runtime.flush(); }));
+    ret.push_back(measure("empty_flush", 0, samples, 1, [&]() { runtime.flush(); }));
+    ret.push_back(measure("cached_flush", 0, samples, 1, [&]() { runtime.flush(); },
+                          [&]() { bhxx::add(b, b, a); }));
+
+    const int level = stack_level("openmp");
+    if (level < 0) {
+        cerr << "fuse_cache and get_function: skipped, the OpenMP engine isn't in the stack\n";
+        return ret;
+    }
+    const ConfigParser config(level);
+    jitk::Statistics stat(false, false);
+    jitk::FuseCache fcache(config, stat);
+    for (size_t length: {1, 10, 100, 1000}) {
+        InstrChain chain(length);
+        // The first call fuses the instructions and inserts the block list into the cache
+        jitk::get_block_list(chain.instr_list, config, fcache, stat, false);
+        ret.push_back(measure("fuse_cache", length, samples, 1, [&]() { fcache.get(chain.instr_list); }));
+    }
+
+#ifdef BH_BENCH_OPENMP
+    EngineOpenMP engine(config, stat);
+    const string source = "#include <stdint.h>\n"
+                          "void launcher(void* data_list[], uint64_t offset_strides[], void* constants) {}\n";
+    engine.warmup({source});
+    ret.push_back(measure("get_function", 0, samples, 1, [&]() { engine.getFunction(source); }));
+#endif
+    return ret;
+}
+
+void write_json(const vector<Result> &results, ostream &out) {
+    out << setprecision(6) << "{\n  \"overheads\": [\n";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const Result &r = results[i];
+        out << "    {\"name\": \"" << r.name << "\", \"size\": " << r.size << ", \"samples\": " << r.samples.size()
+            << ", \"p50_us\": " << r.percentile(50) * 1e6 << ", \"p90_us\": " << r.percentile(90) * 1e6
+            << ", \"p99_us\": " << r.percentile(99) * 1e6 << ", \"max_us\": " << r.samples.back() * 1e6
+            << ", \"per_second\": " << 1 / r.percentile(50) << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+}
+
+} // Unnamed namespace
+
+int main(int argc, char *argv[]) {
+    int samples = 1000;
+    string output;
+    for (int i = 1; i < argc; ++i) {
+        const string arg = argv[i];
+        if (i + 1 < argc and arg == "--samples") {
+            samples = max(1, atoi(argv[++i]));
+        } else if (i + 1 < argc and arg == "--output") {
+            output = argv[++i];
+        } else {
+            cerr << "Usage: " << argv[0] << " [--samples N (default 1000)] [--output FILE (default stdout)]\n";
+            return arg == "--help" ? 0 : 2;
+        }
+    }
+
+    const vector<Result> results = run(samples);
+    for (const Result &r: results) {
+        cerr << r.name << (r.size > 0 ? " (" + to_string(r.size) + ")" : "") << ": p50 " << r.percentile(50) * 1e6
+             << "us, p99 " << r.percentile(99) * 1e6 << "us\n";
+    }
+    if (output.empty()) {
+        write_json(results, cout);
+    } else {
+        ofstream out(output);
+        write_json(results, out);
+    }
+    return 0;
+}
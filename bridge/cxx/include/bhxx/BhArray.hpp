@@ -22,6 +22,7 @@ If not, see <http://www.gnu.org/licenses/>.
 
 #include "BhBase.hpp"
 #include "SVector.hpp"
+#include <future>
 #include <ostream>
 #include <vector>
 
@@ -47,6 +48,11 @@ std::shared_ptr<BhBase> make_base_ptr(Args... args) {
                                    RuntimeDeleter{});
 }
 
+namespace expr {
+template <typename Derived>
+struct Expr;
+}
+
 template <typename T>
 class BhArray {
   public:
@@ -105,6 +111,10 @@ class BhArray {
         assert(static_cast<size_t>(base->nelem) == shape.prod());
     }
 
+    /** Evaluate the expression `e` into this view (see expression.hpp) */
+    template <typename E>
+    BhArray& operator=(const expr::Expr<E>& e);
+
     //
     // Information
     //
@@ -142,6 +152,12 @@ class BhArray {
     T*       data() { return static_cast<T*>(base->data); }
     //@}
 
+    /** Get a future that is ready when the data of the base array is synced
+     *
+     *  Use after `sync()`, which the runtime then flushes asynchronously (see Runtime::data_future)
+     */
+    std::shared_future<void> data_future() const;
+
     //
     // Routines
     //
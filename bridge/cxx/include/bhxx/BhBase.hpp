@@ -19,6 +19,7 @@ If not, see <http://www.gnu.org/licenses/>.
 */
 #pragma once
 #include <bh_view.hpp>
+#include <functional>
 #include <memory>
 
 namespace bhxx {
@@ -43,7 +44,22 @@ class BhBase : public bh_base {
      * incorporate nelem_ elements.
      * */
     template <typename T>
-    BhBase(size_t nelem_, T* memory) : m_own_memory(false) {
+    BhBase(size_t nelem_, T* memory) : BhBase(nelem_, memory, nullptr) {}
+
+    /** Construct a base array with nelem elements using externally
+     * managed storage, which Bohrium reads and writes in place.
+     *
+     * When Bohrium frees the base array (i.e. at the flush after the
+     * BH_FREE of the base) it calls `release(memory)`, after which
+     * the storage is the caller's again. Until then the storage must
+     * stay alive.
+     *
+     * Throws std::invalid_argument if memory is null or not aligned to T.
+     * */
+    template <typename T>
+    BhBase(size_t nelem_, T* memory, std::function<void(T*)> release) : m_own_memory(false) {
+        adopt(memory, alignof(T), release ? [release](void* d) { release(static_cast<T*>(d)); }
+                                          : std::function<void(void*)>());
         data  = memory;
         nelem = static_cast<int64_t>(nelem_);
         set_type<T>();
@@ -121,6 +137,10 @@ class BhBase : public bh_base {
     template <typename T>
     void set_type();
 
+    /** Check the alignment of external memory and hand it over to bh_memory_free(),
+     *  which calls `release` instead of freeing it */
+    static void adopt(void* memory, size_t alignment, std::function<void(void*)> release);
+
     // Is the memory in here owned by Bohrium or is it provided
     // by external means. If it is owned by Bohrium, we assume
     // that Bohrium has also allocated it, which means that if
@@ -26,7 +26,11 @@ namespace bhxx {
 /** Helper class to build instructions */
 class BhInstruction : public bh_instruction {
   public:
-    BhInstruction(bh_opcode code) : bh_instruction{} { opcode = code; }
+    // NB: room for three operands thus appending the operands of an instruction allocates once
+    BhInstruction(bh_opcode code) : bh_instruction{} {
+        opcode = code;
+        operand.reserve(3);
+    }
 
     /** Append a single array to the list of operands */
     template <typename T>
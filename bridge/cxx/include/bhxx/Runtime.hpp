@@ -18,7 +18,10 @@ GNU Lesser General Public License along with Bohrium.
 If not, see <http://www.gnu.org/licenses/>.
 */
 #pragma once
+#include <chrono>
+#include <future>
 #include <iostream>
+#include <map>
 #include <sstream>
 
 #include "BhInstruction.hpp"
@@ -28,17 +31,21 @@ namespace bhxx {
 
 /**
  *  Encapsulation of communication with Bohrium runtime.
- *  Implemented as a Singleton.
  *
- *  \note  Not thread-safe.
+ *  Every thread has its own Runtime, i.e. its own queue of lazy evaluated instructions,
+ *  which it flushes to the component stack that all threads share. The component stack
+ *  (and thus the kernel cache of the engine) executes one flush at a time.
+ *
+ *  \note  An array must only be used by one thread at a time and the thread must flush
+ *         before handing the array over to another thread.
  */
 class Runtime {
   public:
     Runtime();
 
-    // Get the singleton instance of the Runtime class
+    // Get the Runtime instance of the calling thread
     static Runtime& instance() {
-        static Runtime instance;
+        static thread_local Runtime instance;
         return instance;
     }
 
@@ -53,10 +60,14 @@ class Runtime {
     // We have to handle random specially because of the `BH_R123` scalar type
     void enqueue_random(BhArray<uint64_t>& out, uint64_t seed, uint64_t key);
 
-    // Enqueue an extension method
-    template <typename T>
-    void enqueue_extmethod(const std::string& name, BhArray<T>& out, BhArray<T>& in1,
-                           BhArray<T>& in2);
+    // Enqueue an extension method, the operand types may differ (e.g. the int64 output of argsort)
+    template <typename OutType, typename InType1, typename InType2>
+    void enqueue_extmethod(const std::string& name, BhArray<OutType>& out, BhArray<InType1>& in1,
+                           BhArray<InType2>& in2);
+
+    // Enqueue an extension method of the entire bases `out` and `in`, which may differ in type.
+    // Returns false when no component knows the extension method.
+    bool enqueue_extmethod(const std::string& name, BhBase& out, BhBase& in);
 
     /** Schedule a base object for deletion
      *
@@ -67,13 +78,38 @@ class Runtime {
     // Send enqueued instructions to Bohrium for execution
     void flush();
 
+    /** Mark the end of a loop iteration
+     *
+     *  Once marked, the runtime only flushes at iteration boundaries (unless the queue
+     *  exceeds `flush_max_instructions`), thus every iteration becomes the same flush.
+     *  See the [bridge] section of config.ini for the flush policy.
+     */
+    void iteration();
+
+    /** Send enqueued instructions to Bohrium for execution on the executor thread of this runtime
+     *
+     *  The returned future is ready when the instructions (and all earlier flushes) are executed,
+     *  thus host-side work can overlap with the execution. A synchronous flush() waits for all
+     *  asynchronous flushes first.
+     *
+     *  \note The arrays of the flush must not be read or written before the future is ready.
+     */
+    std::shared_future<void> flush_async();
+
+    /** Get the future of the data of `base`, which is ready when the latest BH_SYNC of `base` is executed
+     *
+     *  An enqueued BH_SYNC of `base` that is not flushed yet starts an asynchronous flush.
+     *  The future is ready already when `base` is not synced by a pending flush.
+     */
+    std::shared_future<void> data_future(const bh_base& base);
+
     // Send and receive a message through the component stack
     std::string message(const std::string &msg);
 
-    ~Runtime() { flush(); }
+    ~Runtime();
 
-    Runtime(Runtime&&) = default;
-    Runtime& operator=(Runtime&&) = default;
+    Runtime(Runtime&&);
+    Runtime& operator=(Runtime&&);
     Runtime(const Runtime&)       = delete;
     Runtime& operator=(const Runtime&) = delete;
 
@@ -98,17 +134,40 @@ class Runtime {
     // purged after the next flush
     std::vector<std::unique_ptr<BhBase>> bases_for_deletion;
 
-    // Bohrium Configuration
-    bohrium::ConfigParser config;
+    // The number of bytes of the bases in `bases_for_deletion`
+    uint64_t bytes_for_deletion = 0;
+
+    // When the first instruction of `instr_list` was enqueued
+    std::chrono::steady_clock::time_point first_enqueue;
+
+    // Whether the user marks loop iterations, where in `instr_list` the current iteration starts,
+    // the number of instructions of the previous iteration, and the iterations since the last flush
+    bool marks_iterations    = false;
+    size_t iteration_start   = 0;
+    size_t iteration_size    = 0;
+    uint64_t iteration_count = 0;
+
+    // Whether the flush policy calls for a flush now, either after an instruction or at an iteration boundary
+    bool flush_due(bool boundary) const;
 
-    // The Bohrium Runtime i.e. the child of this component
-    bohrium::component::ComponentFace runtime;
+    // Execute `instr` in the calling thread instead of enqueuing it when its operands are tiny, host-resident,
+    // and not accessed by the pending instructions (see `eager_max_elements` in config.ini). Returns false when
+    // `instr` must be enqueued.
+    bool execute_eagerly(const bh_instruction& instr);
 
-    // Mapping an extension method name to an opcode id
-    std::map<std::string, bh_opcode> extmethods;
+    // The component stack, which all runtimes share
+    class Stack;
+    Stack *stack;
 
-    // The opcode id for the next new extension method
-    bh_opcode extmethod_next_opcode_id;
+    // The thread that executes the asynchronous flushes, which is started by the first one
+    class Executor;
+    std::unique_ptr<Executor> executor;
+
+    // The future of the latest asynchronous flush that syncs a base
+    std::map<const bh_base*, std::shared_future<void>> synced;
+
+    // Returns the opcode of the extension method `name`, which is registered on first use
+    bh_opcode extmethod_opcode(const std::string& name);
 };
 
 //
@@ -128,21 +187,10 @@ void Runtime::enqueue(bh_opcode opcode, T& op, Ts&... ops) {
     }
 }
 
-template <typename T>
-void Runtime::enqueue_extmethod(const std::string& name, BhArray<T>& out, BhArray<T>& in1,
-                                BhArray<T>& in2) {
-    bh_opcode opcode;
-
-    // Look for the extension opcode
-    auto it = extmethods.find(name);
-    if (it != extmethods.end()) {
-        opcode = it->second;
-    } else {
-        // Add it and tell rest of Bohrium about this new extmethod
-        opcode = extmethod_next_opcode_id++;
-        runtime.extmethod(name.c_str(), opcode);
-        extmethods.insert(std::pair<std::string, bh_opcode>(name, opcode));
-    }
+template <typename OutType, typename InType1, typename InType2>
+void Runtime::enqueue_extmethod(const std::string& name, BhArray<OutType>& out, BhArray<InType1>& in1,
+                                BhArray<InType2>& in2) {
+    const bh_opcode opcode = extmethod_opcode(name);
 
     // Now that we have an opcode, let's enqueue the instruction
     enqueue(opcode, out, in1, in2);
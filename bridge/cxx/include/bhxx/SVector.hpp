@@ -24,26 +24,163 @@ If not, see <http://www.gnu.org/licenses/>.
 #pragma once
 
 #include <bh_view.hpp>
+#include <algorithm>
 #include <functional>
+#include <initializer_list>
+#include <iterator>
 #include <numeric>
 #include <ostream>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
 #include <vector>
 
 namespace bhxx {
 
+/** Vector of at most `MaxLength` elements, which are stored inline thus it
+ *  never allocates on the heap. The interface is the subset of `std::vector`
+ *  that shapes and strides need. */
 template <typename T, std::size_t MaxLength>
-struct SVector : public std::vector<T> {
+class SVector {
   public:
-    using std::vector<T>::vector;
-    SVector(const std::vector<T>& other) : SVector(other.begin(), other.end()) {}
+    typedef T                                     value_type;
+    typedef std::size_t                           size_type;
+    typedef std::ptrdiff_t                        difference_type;
+    typedef T&                                    reference;
+    typedef const T&                              const_reference;
+    typedef T*                                    pointer;
+    typedef const T*                              const_pointer;
+    typedef T*                                    iterator;
+    typedef const T*                              const_iterator;
+    typedef std::reverse_iterator<iterator>       reverse_iterator;
+    typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+
     SVector() = default;
+    explicit SVector(size_type count, const T& value = T()) { assign(count, value); }
+    SVector(std::initializer_list<T> init) { assign(init.begin(), init.end()); }
+    SVector(const std::vector<T>& other) { assign(other.begin(), other.end()); }
+    template <typename InputIt,
+              typename = typename std::enable_if<!std::is_integral<InputIt>::value>::type>
+    SVector(InputIt first, InputIt last) {
+        assign(first, last);
+    }
+
+    SVector& operator=(std::initializer_list<T> init) {
+        assign(init.begin(), init.end());
+        return *this;
+    }
+
+    void assign(size_type count, const T& value) {
+        check_length(count);
+        std::fill(_data, _data + count, value);
+        _size = count;
+    }
+    template <typename InputIt,
+              typename = typename std::enable_if<!std::is_integral<InputIt>::value>::type>
+    void assign(InputIt first, InputIt last) {
+        clear();
+        for (; first != last; ++first) push_back(*first);
+    }
+
+    // Element access
+    reference       operator[](size_type pos) { return _data[pos]; }
+    const_reference operator[](size_type pos) const { return _data[pos]; }
+    reference       at(size_type pos) { return _data[check_index(pos)]; }
+    const_reference at(size_type pos) const { return _data[check_index(pos)]; }
+    reference       front() { return _data[0]; }
+    const_reference front() const { return _data[0]; }
+    reference       back() { return _data[_size - 1]; }
+    const_reference back() const { return _data[_size - 1]; }
+    pointer         data() { return _data; }
+    const_pointer   data() const { return _data; }
+
+    // Iterators
+    iterator               begin() { return _data; }
+    const_iterator         begin() const { return _data; }
+    const_iterator         cbegin() const { return _data; }
+    iterator               end() { return _data + _size; }
+    const_iterator         end() const { return _data + _size; }
+    const_iterator         cend() const { return _data + _size; }
+    reverse_iterator       rbegin() { return reverse_iterator(end()); }
+    const_reverse_iterator rbegin() const { return const_reverse_iterator(end()); }
+    reverse_iterator       rend() { return reverse_iterator(begin()); }
+    const_reverse_iterator rend() const { return const_reverse_iterator(begin()); }
+
+    // Capacity
+    bool                empty() const { return _size == 0; }
+    size_type           size() const { return _size; }
+    static constexpr size_type max_size() { return MaxLength; }
+    static constexpr size_type capacity() { return MaxLength; }
+
+    // Modifiers
+    void clear() { _size = 0; }
+    void push_back(const T& value) {
+        check_length(_size + 1);
+        _data[_size++] = value;
+    }
+    template <typename... Args>
+    reference emplace_back(Args&&... args) {
+        push_back(T(std::forward<Args>(args)...));
+        return back();
+    }
+    void pop_back() { --_size; }
+    void resize(size_type count, const T& value = T()) {
+        check_length(count);
+        if (count > _size) std::fill(_data + _size, _data + count, value);
+        _size = count;
+    }
+    iterator insert(const_iterator pos, const T& value) {
+        check_length(_size + 1);
+        iterator it = begin() + (pos - cbegin());
+        std::copy_backward(it, end(), end() + 1);
+        *it = value;
+        ++_size;
+        return it;
+    }
+    iterator erase(const_iterator pos) { return erase(pos, pos + 1); }
+    iterator erase(const_iterator first, const_iterator last) {
+        iterator it = begin() + (first - cbegin());
+        std::copy(it + (last - first), end(), it);
+        _size -= last - first;
+        return it;
+    }
 
     T sum() const { return std::accumulate(this->begin(), this->end(), T{0}); }
     T prod() const {
         return std::accumulate(this->begin(), this->end(), T{1}, std::multiplies<T>());
     }
+
+  private:
+    T         _data[MaxLength];
+    size_type _size = 0;
+
+    static void check_length(size_type count) {
+        if (count > MaxLength) {
+            throw std::length_error("SVector: cannot hold more than " + std::to_string(MaxLength) +
+                                    " elements");
+        }
+    }
+    size_type check_index(size_type pos) const {
+        if (pos >= _size) throw std::out_of_range("SVector: index out of range");
+        return pos;
+    }
 };
 
+template <typename T, std::size_t MaxLength>
+bool operator==(const SVector<T, MaxLength>& a, const SVector<T, MaxLength>& b) {
+    return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin());
+}
+
+template <typename T, std::size_t MaxLength>
+bool operator!=(const SVector<T, MaxLength>& a, const SVector<T, MaxLength>& b) {
+    return !(a == b);
+}
+
+template <typename T, std::size_t MaxLength>
+bool operator<(const SVector<T, MaxLength>& a, const SVector<T, MaxLength>& b) {
+    return std::lexicographical_compare(a.begin(), a.end(), b.begin(), b.end());
+}
+
 // Some common SVectors
 typedef SVector<int64_t, BH_MAXDIM> Stride;
 typedef SVector<size_t, BH_MAXDIM>  Shape;
@@ -51,6 +188,10 @@ typedef SVector<size_t, BH_MAXDIM>  Shape;
 // Return a contiguous stride (row-major) based on `shape`
 Stride contiguous_stride(const Shape& shape);
 
+// Return a row-major stride based on `shape` where a row of `elem_size`-byte elements that is a multiple of
+// eight cache lines is padded by a cache line, thus the rows don't map to the same cache sets
+Stride padded_stride(const Shape& shape, size_t elem_size);
+
 template <typename T, std::size_t MaxLength>
 std::ostream& operator<<(std::ostream& o, const SVector<T, MaxLength>& vec) {
     o << '(';
@@ -27,6 +27,10 @@ If not, see <http://www.gnu.org/licenses/>.
 #include <bhxx/BhArray.hpp>
 #include <bhxx/Runtime.hpp>
 #include <bhxx/array_operations.hpp>
+#include <bhxx/checkpoint.hpp>
+#include <bhxx/interop.hpp>
+#include <bhxx/expression.hpp>
 #include <bhxx/util.hpp>
+#include <bhxx/sparse.hpp>
 
 #endif
@@ -0,0 +1,62 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include <bhxx/BhBase.hpp>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace bhxx {
+
+/** The options of checkpoint_save() */
+struct CheckpointOptions {
+    /** The codec of the chunks: "none", "zlib", "shuffle_zlib", and when bhxx is build with Zstandard,
+     *  "zstd" and "shuffle_zstd". The shuffle groups the bytes of the elements by their significance,
+     *  which makes similar floats compressible. */
+    std::string codec = "shuffle_zlib";
+    /** The compression level (zero means the default of the codec) */
+    int level = 0;
+    /** The chunks of the bases, which are compressed independently */
+    size_t chunk_bytes = 4 * 1024 * 1024;
+    /** The threads that compress and decompress the chunks (zero means one per hardware thread) */
+    int threads = 0;
+};
+
+/** Write the data of `bases` to the checkpoint file `path`
+ *
+ *  The bases are synced and the file holds their types, sizes, and data as chunks that `threads`
+ *  threads compress in parallel. A base that was never computed has no data in the file.
+ *  Throws std::runtime_error when the file cannot be written.
+ */
+void checkpoint_save(const std::string& path, const std::vector<std::shared_ptr<BhBase>>& bases,
+                     const CheckpointOptions& options = CheckpointOptions());
+
+/** Read the data of the checkpoint file `path` into `bases`, which must match the bases of the
+ *  checkpoint in order, type, and number of elements
+ *
+ *  The chunks are decompressed in parallel into new Bohrium memory, which the engine copies
+ *  into `bases` (thus also into device memory) at the flush at the end of the restore.
+ *  Throws std::runtime_error when the file cannot be read or doesn't match `bases`.
+ */
+void checkpoint_restore(const std::string& path, const std::vector<std::shared_ptr<BhBase>>& bases,
+                        int threads = 0);
+
+}  // namespace bhxx
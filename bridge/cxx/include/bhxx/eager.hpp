@@ -0,0 +1,41 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include <bh_instruction.hpp>
+
+namespace bhxx {
+namespace eager {
+
+/** Whether `execute()` implements `instr`, i.e. an element-wise instruction of bool, integer, or float arrays
+ *  (the arithmetic, comparisons, minimum, maximum, absolute, sqrt, and identity) where the array operands
+ *  have the same shape. */
+bool supported(const bh_instruction& instr);
+
+/** Execute the supported instruction `instr` in the calling thread, which allocates the host memory
+ *  of its bases when needed.
+ *
+ *  \note  The operands must be host-resident and not accessed by pending instructions, see the
+ *         `eager_max_elements` option of the [bridge] section of config.ini.
+ */
+void execute(const bh_instruction& instr);
+
+}  // namespace eager
+}  // namespace bhxx
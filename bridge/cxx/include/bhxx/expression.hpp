@@ -0,0 +1,274 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium team:
+http://bohrium.bitbucket.org
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+#pragma once
+#include "Runtime.hpp"
+#include <deque>
+#include <type_traits>
+#include <vector>
+
+/** Expression templates, which lower a whole element-wise expression into a minimal sequence of instructions.
+ *
+ *  E.g. `c = a * b + d` enqueues `BH_MULTIPLY c a b` and `BH_ADD c c d`. The output view holds intermediate
+ *  results when no other operand reads it, otherwise they go into scratch arrays that the expression reuses
+ *  and frees when the assignment is done. Scalars become constant operands.
+ *
+ *  \note An expression refers to its arrays thus it must be assigned before they go out of scope,
+ *        which holds for the usual `out = <expression>;` statement.
+ */
+namespace bhxx {
+namespace expr {
+
+/** The base of every expression node (curiously recurring template) */
+template <typename Derived>
+struct Expr {
+    const Derived& self() const { return static_cast<const Derived&>(*this); }
+};
+
+/** A leaf that reads an array */
+template <typename T>
+struct Terminal : Expr<Terminal<T>> {
+    typedef T scalar_type;
+    const BhArray<T>& ary;
+    explicit Terminal(const BhArray<T>& ary_) : ary(ary_) {}
+};
+
+/** A leaf that is a constant */
+template <typename T>
+struct Constant : Expr<Constant<T>> {
+    typedef T scalar_type;
+    T value;
+    explicit Constant(T value_) : value(value_) {}
+};
+
+/** The instruction `Opcode` of the results of two expressions */
+template <bh_opcode Opcode, typename L, typename R>
+struct Binary : Expr<Binary<Opcode, L, R>> {
+    typedef typename L::scalar_type scalar_type;
+    static_assert(std::is_same<scalar_type, typename R::scalar_type>::value,
+                  "The operands of an expression must have the same type");
+    L lhs;
+    R rhs;
+    Binary(L lhs_, R rhs_) : lhs(std::move(lhs_)), rhs(std::move(rhs_)) {}
+};
+
+/** The expression node of an operator argument, which is an array or an expression */
+template <typename X, typename Enable = void>
+struct node_of {};
+
+template <typename T>
+struct node_of<BhArray<T>> {
+    typedef Terminal<T> type;
+    static type make(const BhArray<T>& ary) { return type(ary); }
+};
+
+template <typename X>
+struct node_of<X, typename std::enable_if<std::is_base_of<Expr<X>, X>::value>::type> {
+    typedef X type;
+    static const X& make(const X& x) { return x; }
+};
+
+//
+// Lowering
+//
+
+/** An input of an instruction, which is an array or a constant */
+template <typename T>
+struct Argument {
+    const BhArray<T>* ary;
+    T value;
+    // Whether `ary` is a scratch array, which the lowering releases after the instruction
+    bool scratch;
+};
+
+/** The scratch arrays of a lowering, which all have the shape of the output */
+template <typename T>
+class Lowering {
+  public:
+    explicit Lowering(Shape shape) : _shape(std::move(shape)) {}
+
+    BhArray<T>& acquire() {
+        if (_free.empty()) {
+            _arrays.emplace_back(_shape);
+            return _arrays.back();
+        }
+        BhArray<T>* ret = _free.back();
+        _free.pop_back();
+        return *ret;
+    }
+
+    void release(const Argument<T>& arg) {
+        if (arg.scratch) {
+            _free.push_back(const_cast<BhArray<T>*>(arg.ary));
+        }
+    }
+
+  private:
+    Shape _shape;
+    // NB: a deque, since acquired references must stay valid when it grows
+    std::deque<BhArray<T>> _arrays;
+    std::vector<BhArray<T>*> _free;
+};
+
+template <typename T>
+bool same_view(const BhArray<T>& a, const BhArray<T>& b) {
+    return a.base == b.base && a.offset == b.offset && a.shape == b.shape && a.stride == b.stride;
+}
+
+/** Whether the expression reads from `base` */
+template <typename T>
+bool reads_base(const Terminal<T>& node, const BhBase* base) {
+    return node.ary.base.get() == base;
+}
+template <typename T>
+bool reads_base(const Constant<T>&, const BhBase*) {
+    return false;
+}
+template <bh_opcode Opcode, typename L, typename R>
+bool reads_base(const Binary<Opcode, L, R>& node, const BhBase* base) {
+    return reads_base(node.lhs, base) || reads_base(node.rhs, base);
+}
+
+/** Whether the expression reads another view of the base of `view` than `view` itself */
+template <typename T>
+bool reads_overlap(const Terminal<T>& node, const BhArray<T>& view) {
+    return node.ary.base == view.base && !same_view(node.ary, view);
+}
+template <typename T>
+bool reads_overlap(const Constant<T>&, const BhArray<T>&) {
+    return false;
+}
+template <bh_opcode Opcode, typename L, typename R, typename T>
+bool reads_overlap(const Binary<Opcode, L, R>& node, const BhArray<T>& view) {
+    return reads_overlap(node.lhs, view) || reads_overlap(node.rhs, view);
+}
+
+template <typename T>
+void append(BhInstruction& instr, const Argument<T>& arg) {
+    if (arg.ary != nullptr) {
+        instr.append_operand(*arg.ary);
+    } else {
+        instr.append_operand(arg.value);
+    }
+}
+
+template <typename T>
+void evaluate(BhArray<T>& dest, const Terminal<T>& node, Lowering<T>&, bool) {
+    if (!same_view(dest, node.ary)) {
+        Runtime::instance().enqueue(BH_IDENTITY, dest, node.ary);
+    }
+}
+
+template <typename T>
+void evaluate(BhArray<T>& dest, const Constant<T>& node, Lowering<T>&, bool) {
+    T value = node.value;
+    Runtime::instance().enqueue(BH_IDENTITY, dest, value);
+}
+
+template <typename T>
+Argument<T> argument(const Terminal<T>& node, BhArray<T>&, bool, Lowering<T>&) {
+    return Argument<T>{&node.ary, T(0), false};
+}
+
+template <typename T>
+Argument<T> argument(const Constant<T>& node, BhArray<T>&, bool, Lowering<T>&) {
+    return Argument<T>{nullptr, node.value, false};
+}
+
+template <bh_opcode Opcode, typename L, typename R, typename T>
+void evaluate(BhArray<T>& dest, const Binary<Opcode, L, R>& node, Lowering<T>& lowering, bool scratch);
+
+/** The argument of an inner node, which is computed into `dest` when `in_dest` and otherwise into a scratch array */
+template <bh_opcode Opcode, typename L, typename R, typename T>
+Argument<T> argument(const Binary<Opcode, L, R>& node, BhArray<T>& dest, bool in_dest, Lowering<T>& lowering) {
+    if (in_dest) {
+        evaluate(dest, node, lowering, false);
+        return Argument<T>{&dest, T(0), false};
+    }
+    BhArray<T>& tmp = lowering.acquire();
+    evaluate(tmp, node, lowering, true);
+    return Argument<T>{&tmp, T(0), true};
+}
+
+/** Evaluate `node` into `dest`, which no leaf reads when `scratch` is true */
+template <bh_opcode Opcode, typename L, typename R, typename T>
+void evaluate(BhArray<T>& dest, const Binary<Opcode, L, R>& node, Lowering<T>& lowering, bool scratch) {
+    // The left operand may be computed in `dest` when the right operand never reads it and the left
+    // operand only reads `dest` itself, which is element-wise safe
+    const bool in_dest = scratch ||
+                         (!reads_base(node.rhs, dest.base.get()) && !reads_overlap(node.lhs, dest));
+    const Argument<T> lhs = argument(node.lhs, dest, in_dest, lowering);
+    const Argument<T> rhs = argument(node.rhs, dest, false, lowering);
+    BhInstruction instr(Opcode);
+    instr.append_operand(dest);
+    append(instr, lhs);
+    append(instr, rhs);
+    Runtime::instance().enqueue(std::move(instr));
+    lowering.release(lhs);
+    lowering.release(rhs);
+}
+
+/** Evaluate the expression `e` into `out` */
+template <typename T, typename E>
+void assign(BhArray<T>& out, const Expr<E>& e) {
+    static_assert(std::is_same<T, typename E::scalar_type>::value,
+                  "The output of an expression must have the type of its operands");
+    // NB: the scratch arrays are freed when `lowering` goes out of scope, after the last instruction
+    Lowering<T> lowering(out.shape);
+    evaluate(out, e.self(), lowering, false);
+}
+
+}  // namespace expr
+
+#define BHXX_EXPR_OPERATOR(OPERATOR, OPCODE)                                                          \
+    template <typename L, typename R>                                                                 \
+    expr::Binary<OPCODE, typename expr::node_of<L>::type, typename expr::node_of<R>::type> operator   \
+    OPERATOR(const L& lhs, const R& rhs) {                                                            \
+        return {expr::node_of<L>::make(lhs), expr::node_of<R>::make(rhs)};                            \
+    }                                                                                                 \
+    template <typename L>                                                                             \
+    expr::Binary<OPCODE, typename expr::node_of<L>::type,                                             \
+                 expr::Constant<typename expr::node_of<L>::type::scalar_type>>                        \
+    operator OPERATOR(const L& lhs, typename expr::node_of<L>::type::scalar_type rhs) {              \
+        typedef expr::Constant<typename expr::node_of<L>::type::scalar_type> C;                      \
+        return {expr::node_of<L>::make(lhs), C(rhs)};                                                 \
+    }                                                                                                 \
+    template <typename R>                                                                             \
+    expr::Binary<OPCODE, expr::Constant<typename expr::node_of<R>::type::scalar_type>,                \
+                 typename expr::node_of<R>::type>                                                     \
+    operator OPERATOR(typename expr::node_of<R>::type::scalar_type lhs, const R& rhs) {              \
+        typedef expr::Constant<typename expr::node_of<R>::type::scalar_type> C;                      \
+        return {C(lhs), expr::node_of<R>::make(rhs)};                                                 \
+    }
+
+BHXX_EXPR_OPERATOR(+, BH_ADD)
+BHXX_EXPR_OPERATOR(-, BH_SUBTRACT)
+BHXX_EXPR_OPERATOR(*, BH_MULTIPLY)
+BHXX_EXPR_OPERATOR(/, BH_DIVIDE)
+
+#undef BHXX_EXPR_OPERATOR
+
+template <typename T>
+template <typename E>
+BhArray<T>& BhArray<T>::operator=(const expr::Expr<E>& e) {
+    expr::assign(*this, e);
+    return *this;
+}
+
+}  // namespace bhxx
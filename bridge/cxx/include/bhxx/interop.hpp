@@ -0,0 +1,51 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#include <bhxx/BhBase.hpp>
+#include <cstdint>
+
+namespace bhxx {
+
+/** The memory of an array, which other frameworks (e.g. through DLPack) use without copies */
+struct DeviceBuffer {
+    /** The device buffer (a CUdeviceptr or a cl_mem) or the host data */
+    uint64_t address;
+    /** The DLPack device type: 1 is the host, 2 is CUDA, and 4 is OpenCL */
+    uint64_t device_type;
+    /** The number of the device */
+    uint64_t device_id;
+};
+
+/** Returns the memory of `base` once Bohrium has computed it
+ *
+ *  The device buffer stays valid until the next flush frees or writes `base`, and the other framework may write it.
+ *  When no engine of the stack has `base` on a device, the result is the synced host data.
+ */
+DeviceBuffer device_export(BhBase& base);
+
+/** Use the device memory `address` of another framework as the data of `base` without copying it
+ *
+ *  The other framework must have finished writing the memory and must keep it alive while `base` uses it.
+ *  Returns false when no engine of the stack can import device memory.
+ */
+bool device_import(BhBase& base, uint64_t address);
+
+}  // namespace bhxx
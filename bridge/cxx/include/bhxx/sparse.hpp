@@ -0,0 +1,75 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <bhxx/BhArray.hpp>
+
+namespace bhxx {
+
+/** A sparse matrix of `rows` x `cols` in the compressed sparse row (CSR) format
+ *
+ *  The structure is three Bohrium arrays: the `values` and the column `indices` of the nonzeros and
+ *  the `indptr` of the rows, where row i holds the nonzeros [indptr[i], indptr[i+1]). The matrix
+ *  also keeps the row of each nonzero (the COO format), which lets spmv() and spmm() add the
+ *  products of the nonzeros into their rows with one add-scatter thus the products, and the
+ *  elementwise operations on the result, are fused JIT kernels on every backend.
+ */
+template <typename T>
+class CsrMatrix {
+  public:
+    uint64_t rows, cols;
+    BhArray<T> values;
+    BhArray<uint64_t> indices;
+    BhArray<uint64_t> indptr;
+
+    /** The matrix of the CSR arrays, where `indptr` has `rows + 1` elements and `values` and
+     *  `indices` have `indptr[rows]` elements */
+    CsrMatrix(uint64_t rows, uint64_t cols, BhArray<T> values, BhArray<uint64_t> indices,
+              BhArray<uint64_t> indptr);
+
+    /** The matrix of the COO arrays `row`, `col`, and `values` of the nonzeros sorted by row
+     *
+     *  NB: spmv() and spmm() don't depend on the order of the nonzeros, only `indptr` does.
+     */
+    static CsrMatrix from_coo(uint64_t rows, uint64_t cols, BhArray<uint64_t> row,
+                              BhArray<uint64_t> col, BhArray<T> values);
+
+    /** The number of nonzeros */
+    uint64_t nnz() const { return values.n_elem(); }
+
+    /** The row of each nonzero */
+    const BhArray<uint64_t>& row_indices() const { return _row; }
+
+  private:
+    BhArray<uint64_t> _row;
+    CsrMatrix(uint64_t rows, uint64_t cols, BhArray<T> values, BhArray<uint64_t> indices,
+              BhArray<uint64_t> indptr, BhArray<uint64_t> row);
+};
+
+/** The sparse matrix-vector product `a * x`, where `x` has `a.cols` elements */
+template <typename T>
+BhArray<T> spmv(const CsrMatrix<T>& a, const BhArray<T>& x);
+
+/** The sparse matrix-matrix product `a * x`, where `x` is a dense `a.cols` x k matrix */
+template <typename T>
+BhArray<T> spmm(const CsrMatrix<T>& a, const BhArray<T>& x);
+
+}  // namespace bhxx
@@ -21,6 +21,7 @@ If not, see <http://www.gnu.org/licenses/>.
 #pragma once
 #include "BhArray.hpp"
 #include <bhxx/functor.hpp>
+#include <string>
 
 namespace bhxx {
 
@@ -29,6 +30,30 @@ namespace bhxx {
 template <typename T>
 T as_scalar(BhArray<T> ary);
 
+/** Wrap the external buffer `data` of `shape.prod()` elements in an array without copying it
+ *
+ *  Bohrium reads and writes `data` in place and calls `release(data)` (if given) when it frees the
+ *  base array, i.e. at the flush after the last view of the array is gone. The buffer must stay
+ *  alive until then. Throws std::invalid_argument if `data` is null or not aligned to T.
+ */
+template <typename T>
+BhArray<T> external_array(T* data, Shape shape,
+                          std::function<void(typename BhArray<T>::scalar_type*)> release = nullptr) {
+    const size_t nelem = shape.prod();
+    return BhArray<T>(make_base_ptr(nelem, data, std::move(release)), std::move(shape));
+}
+
+/** Create a new array of `shape` whose rows are padded by a cache line when their size is a multiple of
+ *  eight cache lines (see padded_stride()), which avoids the cache-set conflicts of power-of-two rows.
+ *  The array is not contiguous, thus it is a view of a base of `shape[0] * stride[0]` elements.
+ */
+template <typename T>
+BhArray<T> padded_array(Shape shape) {
+    Stride stride = padded_stride(shape, sizeof(T));
+    const size_t nelem = shape.size() < 2 ? shape.prod() : shape[0] * static_cast<size_t>(stride[0]);
+    return BhArray<T>(make_base_ptr(T(0), nelem), std::move(shape), std::move(stride));
+}
+
 /** Convert an array to a contiguous representation if it is not yet
  *  contiguous. */
 template <typename T>
@@ -65,6 +90,38 @@ BhArray<T> reshape(BhArray<T> ary, Shape shape);
 template <typename T>
 BhArray<T> matmul(BhArray<T> lhs, BhArray<T> rhs);
 
+/** Reduce each window of `window` consecutive elements along `axis`
+ *
+ * The result has the shape of `ary` except for `ary.shape[axis] - window + 1` elements
+ * along `axis`, where element i is the reduction of the elements [i, i + window).
+ * The "window_sum", "window_min", "window_max", and "window_mean" extension methods
+ * compute it with a running sum or a monotonic deque, i.e. O(1) per element, and
+ * the sum of the shifted views is the fallback without them.
+ *
+ * \param method  "sum", "min", "max", or "mean" (floating-point types only)
+ * \param window  The number of elements of a window, 1 <= window <= ary.shape[axis]
+ * \param axis    The axis to slide along, negative counts from the last axis
+ */
+template <typename T>
+BhArray<T> window_reduce(BhArray<T> ary, const std::string& method, int64_t window,
+                         int64_t axis = -1);
+
+/** Pack the booleans of the last axis into bits, i.e. `ceil(n / 8)` bytes of `n` booleans
+ *
+ * The first boolean of a byte is its most significant bit and the missing bits of the last
+ * byte are zero (like numpy.packbits()). The bitwise operations of the packed bytes are the
+ * logical operations of eight booleans at a time. The "packbits" extension method packs
+ * eight booleans with a multiplication and the shifted views are the fallback without it.
+ */
+BhArray<uint8_t> packbits(BhArray<bool> ary);
+
+/** Unpack the bytes of the last axis of `ary` into `count` booleans, the inverse of packbits()
+ *
+ * \param count  The number of booleans of the last axis, whose bytes `ceil(count / 8)` must be
+ *               `ary.shape[-1]`
+ */
+BhArray<bool> unpackbits(BhArray<uint8_t> ary, size_t count);
+
 /** Performs a full reduction of the array along all axis using the
  *  add_reduce operation.
  *
@@ -58,6 +58,11 @@ bool BhArray<T>::is_contiguous() const {
     return offset == 0;
 }
 
+template <typename T>
+std::shared_future<void> BhArray<T>::data_future() const {
+    return Runtime::instance().data_future(*base);
+}
+
 //
 // Routines
 //
@@ -108,6 +113,8 @@ INSTANTIATE(float);
 INSTANTIATE(double);
 INSTANTIATE(std::complex<float>);
 INSTANTIATE(std::complex<double>);
+INSTANTIATE(bh_float16);
+INSTANTIATE(bh_bfloat16);
 
 #undef INSTANTIATE
 
@@ -18,10 +18,36 @@ GNU Lesser General Public License along with Bohrium.
 If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <bh_memory.h>
 #include <bhxx/BhBase.hpp>
+#include <complex>
+#include <sstream>
+#include <stdexcept>
 
 namespace bhxx {
 
+namespace {
+// Called by bh_memory_free() with the release function of external memory
+void release_external(void* data, void* arg) {
+    std::unique_ptr<std::function<void(void*)>> release(static_cast<std::function<void(void*)>*>(arg));
+    if (*release) {
+        (*release)(data);
+    }
+}
+}  // namespace
+
+void BhBase::adopt(void* memory, size_t alignment, std::function<void(void*)> release) {
+    if (memory == nullptr) {
+        throw std::invalid_argument("The external memory of a BhBase cannot be null");
+    }
+    if (reinterpret_cast<uintptr_t>(memory) % alignment != 0) {
+        std::stringstream ss;
+        ss << "The external memory " << memory << " of a BhBase is not aligned to " << alignment << " bytes";
+        throw std::invalid_argument(ss.str());
+    }
+    bh_memory_adopt(memory, &release_external, new std::function<void(void*)>(std::move(release)));
+}
+
 template <typename T>
 void BhBase::set_type() {
     type = bh_type_from_template<T>();
@@ -43,6 +69,8 @@ INSTANTIATE(float);
 INSTANTIATE(double);
 INSTANTIATE(std::complex<float>);
 INSTANTIATE(std::complex<double>);
+INSTANTIATE(bh_float16);
+INSTANTIATE(bh_bfloat16);
 
 #undef INSTANTIATE
 }
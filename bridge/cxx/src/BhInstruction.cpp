@@ -30,9 +30,9 @@ void BhInstruction::append_operand(bh_constant cnt) {
 }
 
 void BhInstruction::append_operand(BhBase& base) {
-    if (opcode != BH_FREE) {
+    if (opcode != BH_FREE and opcode != BH_SYNC) {
         throw std::runtime_error(
-              "BhBase objects can only be freed. Use a full BhArray if you want to "
+              "BhBase objects can only be synced or freed. Use a full BhArray if you want to "
               "berform any other operation on it.");
     }
 
@@ -103,6 +103,8 @@ INSTANTIATE(float);
 INSTANTIATE(double);
 INSTANTIATE(std::complex<float>);
 INSTANTIATE(std::complex<double>);
+INSTANTIATE(bh_float16);
+INSTANTIATE(bh_bfloat16);
 
 #undef INSTANTIATE
 
@@ -19,28 +19,350 @@ If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include <bhxx/Runtime.hpp>
+#include <bhxx/eager.hpp>
+#include <bh_memory.h>
+#include <bh_trace.hpp>
+#include <condition_variable>
+#include <deque>
 #include <iterator>
+#include <mutex>
+#include <thread>
 
 using namespace std;
 
 namespace bhxx {
 
-Runtime::Runtime()
-      : config(-1),                                // stack level -1 is the bridge
-        runtime(config.getChildLibraryPath(), 0),  // and child is stack level 0
-        extmethod_next_opcode_id(BH_MAX_OPCODE_ID + 1) {}
+namespace {
+// When a runtime flushes its queue, which is read from the [bridge] section of the config
+struct FlushPolicy {
+    // Flush when the queue reaches this many instructions
+    uint64_t instructions;
+    // Flush when the queue reaches this many instructions, even in the middle of a marked loop iteration
+    uint64_t max_instructions;
+    // Flush every this many marked loop iterations (zero means no limit)
+    uint64_t iterations;
+    // Flush when the freed arrays in the queue hold this many bytes (zero means no limit)
+    uint64_t bytes;
+    // Flush when the live host arrays hold this many bytes and the queue frees some (zero means no limit)
+    uint64_t memory_limit;
+    // Flush when the oldest instruction in the queue is this old (zero means no limit)
+    std::chrono::duration<double> time_budget;
+
+    explicit FlushPolicy(const bohrium::ConfigParser& config)
+          : instructions(config.defaultGet<uint64_t>("flush_instructions", 1000)),
+            max_instructions(config.defaultGet<uint64_t>("flush_max_instructions", 10000)),
+            iterations(config.defaultGet<uint64_t>("flush_iterations", 0)),
+            bytes(config.defaultGet<uint64_t>("flush_memory_mb", 0) * 1024 * 1024),
+            memory_limit(config.defaultGet<uint64_t>("memory_limit_mb", 0) * 1024 * 1024),
+            time_budget(config.defaultGet<double>("flush_time_budget_ms", 0) / 1000) {}
+
+    std::string info() const {
+        std::stringstream ss;
+        ss << "[bhxx] Flush policy: " << instructions << " instructions (at loop iterations when marked, at most "
+           << max_instructions << ")";
+        if (iterations > 0) {
+            ss << ", every " << iterations << " loop iterations";
+        }
+        if (bytes > 0) {
+            ss << ", " << bytes / (1024 * 1024) << " MB of freed arrays";
+        }
+        if (memory_limit > 0) {
+            ss << ", " << memory_limit / (1024 * 1024) << " MB of live host arrays";
+        }
+        if (time_budget.count() > 0) {
+            ss << ", " << time_budget.count() * 1000 << " ms";
+        }
+        ss << "\n";
+        return ss.str();
+    }
+};
+}  // namespace
+
+// The component stack of all runtimes, which executes one request at a time
+class Runtime::Stack {
+  public:
+    Stack()
+          : config(-1),                                // stack level -1 is the bridge
+            runtime(config.getChildLibraryPath(), 0),  // and child is stack level 0
+            extmethod_next_opcode_id(BH_MAX_OPCODE_ID + 1),
+            flush_policy(config),
+            eager_max_elements(config.defaultGet<uint64_t>("eager_max_elements", 0)) {}
+
+    // Get the stack, which is created by the first runtime thus it outlives the runtimes of all threads
+    static Stack& instance() {
+        static Stack instance;
+        return instance;
+    }
+
+    // Serializes the use of the members below
+    std::mutex mutex;
+
+    // Bohrium Configuration
+    bohrium::ConfigParser config;
+
+    // The Bohrium Runtime i.e. the child of this component
+    bohrium::component::ComponentFace runtime;
+
+    // Mapping an extension method name to an opcode id
+    std::map<std::string, bh_opcode> extmethods;
+
+    // The opcode id for the next new extension method
+    bh_opcode extmethod_next_opcode_id;
+
+    // The flush policy of all runtimes
+    const FlushPolicy flush_policy;
+
+    // The instructions of at most this many elements per operand execute eagerly (zero disables)
+    const uint64_t eager_max_elements;
+};
+
+// The thread that executes the asynchronous flushes of a runtime in the order they are submitted
+class Runtime::Executor {
+  public:
+    explicit Executor(Stack& stack_) : stack(stack_), thread(&Executor::run, this) {}
+
+    // Executes the remaining flushes before returning
+    ~Executor() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        cond.notify_one();
+        thread.join();
+    }
+
+    // Submit `bhir` for execution, after which `bases` are deleted
+    std::shared_future<void> submit(bh_ir bhir, std::vector<std::unique_ptr<BhBase>> bases) {
+        Job job;
+        job.bhir  = std::move(bhir);
+        job.bases = std::move(bases);
+        std::shared_future<void> ret = job.done.get_future().share();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(std::move(job));
+            last = ret;
+        }
+        cond.notify_one();
+        return ret;
+    }
+
+    // Wait for all submitted flushes
+    void wait() {
+        std::shared_future<void> ret;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            ret = last;
+        }
+        if (ret.valid()) {
+            ret.wait();
+        }
+    }
+
+    // Whether some of the submitted flushes are not executed yet
+    bool busy() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return last.valid() and last.wait_for(std::chrono::seconds(0)) != std::future_status::ready;
+    }
+
+  private:
+    struct Job {
+        bh_ir bhir;
+        std::vector<std::unique_ptr<BhBase>> bases;
+        std::promise<void> done;
+    };
+
+    void run() {
+        while (true) {
+            Job job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cond.wait(lock, [this] { return stop or not jobs.empty(); });
+                if (jobs.empty()) {
+                    return;
+                }
+                job = std::move(jobs.front());
+                jobs.pop_front();
+            }
+            try {
+                bohrium::trace::Scope scope("bridge", "flush_async");
+                scope.arg("instructions", job.bhir.instr_list.size());
+                std::lock_guard<std::mutex> lock(stack.mutex);
+                stack.runtime.execute(&job.bhir);
+                job.done.set_value();
+            } catch (...) {
+                job.done.set_exception(std::current_exception());
+            }
+        }
+    }
+
+    Stack& stack;
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::deque<Job> jobs;
+    std::shared_future<void> last;
+    bool stop = false;
+    // NB: the thread is the last member since it starts running in the constructor
+    std::thread thread;
+};
+
+namespace {
+std::shared_future<void> ready_future() {
+    std::promise<void> ret;
+    ret.set_value();
+    return ret.get_future().share();
+}
+}  // namespace
+
+Runtime::Runtime() : stack(&Stack::instance()) {}
+
+Runtime::~Runtime() {
+    flush();
+    // The last flush comes after the trace is written at exit
+    bohrium::trace::write();
+}
+
+Runtime::Runtime(Runtime&&) = default;
+Runtime& Runtime::operator=(Runtime&&) = default;
+
+bh_opcode Runtime::extmethod_opcode(const std::string& name) {
+    std::lock_guard<std::mutex> lock(stack->mutex);
+
+    // Look for the extension opcode
+    auto it = stack->extmethods.find(name);
+    if (it != stack->extmethods.end()) {
+        return it->second;
+    }
+
+    // Add it and tell rest of Bohrium about this new extmethod
+    const bh_opcode opcode = stack->extmethod_next_opcode_id++;
+    stack->runtime.extmethod(name.c_str(), opcode);
+    stack->extmethods.insert(std::pair<std::string, bh_opcode>(name, opcode));
+    return opcode;
+}
+
+bool Runtime::flush_due(bool boundary) const {
+    const FlushPolicy& policy = stack->flush_policy;
+    const size_t size         = instr_list.size();
+    if (size >= policy.max_instructions) {
+        return true;
+    }
+    // When the user marks loop iterations, we only flush at their boundaries
+    if (marks_iterations) {
+        if (!boundary) {
+            return false;
+        }
+        // Flush when the next iteration, which we expect to be as large as the previous, doesn't fit in the queue
+        if (size + iteration_size > policy.instructions) {
+            return true;
+        }
+        if (policy.iterations > 0 and iteration_count >= policy.iterations) {
+            return true;
+        }
+    } else if (size >= policy.instructions) {
+        return true;
+    }
+    if (policy.bytes > 0 and bytes_for_deletion >= policy.bytes) {
+        return true;
+    }
+    if (policy.memory_limit > 0 and bytes_for_deletion > 0) {
+        uint64_t current, peak;
+        bh_memory_usage(BH_MEMORY_HOST, &current, &peak);
+        if (current >= policy.memory_limit) {
+            return true;
+        }
+    }
+    if (policy.time_budget.count() > 0 and std::chrono::steady_clock::now() - first_enqueue >= policy.time_budget) {
+        return true;
+    }
+    return false;
+}
+
+bool Runtime::execute_eagerly(const bh_instruction& instr) {
+    if (not eager::supported(instr)) {
+        return false;
+    }
+    // The operands must be tiny and host-resident, i.e. without a device buffer that may hold newer data,
+    // and the inputs must hold data already
+    for (size_t i = 0; i < instr.operand.size(); ++i) {
+        const bh_view& view = instr.operand[i];
+        if (bh_is_constant(&view)) {
+            continue;
+        }
+        if (static_cast<uint64_t>(bh_nelements(view)) > stack->eager_max_elements or
+            (i > 0 and view.base->data == nullptr) or bh_memory_is_tracked(BH_MEMORY_CUDA, view.base) or
+            bh_memory_is_tracked(BH_MEMORY_OPENCL, view.base)) {
+            return false;
+        }
+    }
+    // The operands of pending instructions get the instruction queued after them instead, which keeps the order
+    // of the reads and writes of the bases without a flush
+    if (executor and executor->busy()) {
+        return false;
+    }
+    for (const bh_instruction& pending : instr_list) {
+        for (const bh_view& view : pending.operand) {
+            if (bh_is_constant(&view)) {
+                continue;
+            }
+            for (const bh_view& op : instr.operand) {
+                if (op.base == view.base) {
+                    return false;
+                }
+            }
+        }
+    }
+    bohrium::trace::Scope scope("bridge", "eager");
+    eager::execute(instr);
+    return true;
+}
 
 void Runtime::enqueue(BhInstruction instr) {
+    if (stack->eager_max_elements > 0 and execute_eagerly(instr)) {
+        return;
+    }
     instr_list.push_back(std::move(instr));
+    if (instr_list.size() == 1 and stack->flush_policy.time_budget.count() > 0) {
+        first_enqueue = std::chrono::steady_clock::now();
+    }
 
-    // We hard-code a kernel size threshold here.
     // NB: we HAVE to include the just enqueued instruction since it might be a BH_FREE,
     // which clears `bases_for_deletion`.
-    if (instr_list.size() >= 1000) {
+    if (flush_due(false)) {
         flush();
     }
 }
 
+void Runtime::iteration() {
+    marks_iterations = true;
+    iteration_size   = instr_list.size() - iteration_start;
+    ++iteration_count;
+    if (flush_due(true)) {
+        flush();
+    }
+    iteration_start = instr_list.size();
+}
+
+bool Runtime::enqueue_extmethod(const std::string& name, BhBase& out, BhBase& in) {
+    bh_opcode opcode;
+    try {
+        opcode = extmethod_opcode(name);
+    } catch (const std::exception&) {
+        return false;
+    }
+    BhInstruction instr(opcode);
+    for (BhBase* base : {&out, &in}) {
+        bh_view view;
+        view.base      = base;
+        view.start     = 0;
+        view.ndim      = 1;
+        view.shape[0]  = base->nelem;
+        view.stride[0] = 1;
+        instr.operand.push_back(view);
+    }
+    enqueue(std::move(instr));
+    return true;
+}
+
 void Runtime::enqueue_random(BhArray<uint64_t>& out, uint64_t seed, uint64_t key) {
     BhInstruction instr(BH_RANDOM);
     instr.append_operand(out);  // Append output array
@@ -56,33 +378,105 @@ void Runtime::enqueue_random(BhArray<uint64_t>& out, uint64_t seed, uint64_t key
 }
 
 void Runtime::enqueue_deletion(std::unique_ptr<BhBase> base_ptr) {
-    // Check whether we are responsible for the memory or not.
+    // Externally managed memory is adopted by Bohrium, which calls its release function instead of
+    // freeing it. We sync it first thus it holds the final values (e.g. of a device backend).
     if (!base_ptr->own_memory()) {
-        // Externally managed
-        // => set it to null to avoid deletion by Bohrium
-        base_ptr->data = nullptr;
+        BhInstruction sync(BH_SYNC);
+        sync.append_operand(*base_ptr);
+        enqueue(std::move(sync));
     }
 
     BhInstruction instr(BH_FREE);
     instr.append_operand(*base_ptr);
+    bytes_for_deletion += static_cast<uint64_t>(base_ptr->nelem) * bh_type_size(base_ptr->type);
     bases_for_deletion.push_back(std::move(base_ptr));
     enqueue(std::move(instr));
 }
 
 void Runtime::flush() {
+    // The asynchronous flushes come first
+    if (executor) {
+        executor->wait();
+    }
+
     // Construct Bohrium Internal Representation
     // and fill it with our instructions and execute.
     bh_ir bhir;
+    bhir.instr_list.reserve(instr_list.size());
     std::move(instr_list.begin(), instr_list.end(), std::back_inserter(bhir.instr_list));
-    runtime.execute(&bhir);
+    {
+        bohrium::trace::Scope scope("bridge", "flush");
+        scope.arg("instructions", bhir.instr_list.size());
+        std::lock_guard<std::mutex> lock(stack->mutex);
+        stack->runtime.execute(&bhir);
+    }
     instr_list.clear();
+    iteration_start = 0;
+    iteration_count = 0;
 
     // Purge the bases we have scheduled for deletion:
     bases_for_deletion.clear();
+    bytes_for_deletion = 0;
+}
+
+std::shared_future<void> Runtime::flush_async() {
+    if (instr_list.empty()) {
+        return ready_future();
+    }
+    if (not executor) {
+        executor.reset(new Executor(*stack));
+    }
+
+    // Forget the synced bases of the executed flushes
+    for (auto it = synced.begin(); it != synced.end();) {
+        if (it->second.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+            it = synced.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    bh_ir bhir;
+    bhir.instr_list.reserve(instr_list.size());
+    std::move(instr_list.begin(), instr_list.end(), std::back_inserter(bhir.instr_list));
+    std::vector<const bh_base*> syncs;
+    for (const bh_instruction& instr : bhir.instr_list) {
+        if (instr.opcode == BH_SYNC) {
+            syncs.push_back(instr.operand[0].base);
+        }
+    }
+    std::shared_future<void> ret = executor->submit(std::move(bhir), std::move(bases_for_deletion));
+    for (const bh_base* base : syncs) {
+        synced[base] = ret;
+    }
+
+    instr_list.clear();
+    iteration_start = 0;
+    iteration_count = 0;
+    bases_for_deletion.clear();
+    bytes_for_deletion = 0;
+    return ret;
+}
+
+std::shared_future<void> Runtime::data_future(const bh_base& base) {
+    for (const bh_instruction& instr : instr_list) {
+        if (instr.opcode == BH_SYNC and instr.operand[0].base == &base) {
+            return flush_async();
+        }
+    }
+    auto it = synced.find(&base);
+    if (it != synced.end()) {
+        return it->second;
+    }
+    return ready_future();
 }
 
 std::string Runtime::message(const std::string &msg) {
-    return runtime.message(msg);
+    std::lock_guard<std::mutex> lock(stack->mutex);
+    if (msg == "info") {
+        return stack->flush_policy.info() + stack->runtime.message(msg);
+    }
+    return stack->runtime.message(msg);
 }
 
 }  // namespace bhxx
@@ -18,6 +18,8 @@ GNU Lesser General Public License along with Bohrium.
 If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
+
 #include <bhxx/SVector.hpp>
 
 using namespace std;
@@ -35,4 +37,24 @@ Stride contiguous_stride(const Shape& shape) {
     return ret;
 }
 
+// Return a row-major stride based on `shape` with padded rows (see the header)
+Stride padded_stride(const Shape& shape, size_t elem_size) {
+    constexpr size_t cache_line = 64;
+    if (shape.size() < 2) {
+        return contiguous_stride(shape);
+    }
+    Stride  ret(shape.size());
+    int64_t row = static_cast<int64_t>(shape.back());
+    if (row * elem_size % (8 * cache_line) == 0) {
+        row += static_cast<int64_t>(std::max(cache_line / elem_size, size_t(1)));
+    }
+    ret[shape.size() - 1] = 1;
+    int64_t stride = row;
+    for (int64_t i = shape.size() - 2; i >= 0; --i) {
+        ret[i] = stride;
+        stride *= static_cast<int64_t>(shape[i]);
+    }
+    return ret;
+}
+
 }  // namespace bhxx
@@ -0,0 +1,358 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+#include <bhxx/Runtime.hpp>
+#include <bhxx/BhInstruction.hpp>
+#include <bhxx/checkpoint.hpp>
+
+#ifdef BHXX_ZLIB
+#include <zlib.h>
+#endif
+#ifdef BHXX_ZSTD
+#include <zstd.h>
+#endif
+
+using namespace std;
+
+namespace bhxx {
+namespace {
+
+/* The checkpoint file starts with the magic and the number of bases followed by each base:
+ *   <type><nelem><has data><codec><elem size><nbytes><chunk bytes><nchunks>[<chunk size>...][<chunk>...]
+ * where every field is an uint64_t. The chunks of the codec NONE is the raw data.
+ * NB: the chunks are encoded like the array data of the proxy VEM.
+ */
+const char MAGIC[8] = {'B', 'H', 'C', 'K', 'P', 'T', '\0', '\1'};
+
+enum Codec { NONE = 0, ZLIB = 1, ZSTD = 3, SHUFFLE_ZSTD = 4, SHUFFLE_ZLIB = 5 };
+
+Codec parse_codec(const string& name) {
+    if (name == "none") {
+        return NONE;
+    }
+#ifdef BHXX_ZLIB
+    if (name == "zlib") {
+        return ZLIB;
+    } else if (name == "shuffle_zlib") {
+        return SHUFFLE_ZLIB;
+    }
+#endif
+#ifdef BHXX_ZSTD
+    if (name == "zstd") {
+        return ZSTD;
+    } else if (name == "shuffle_zstd") {
+        return SHUFFLE_ZSTD;
+    }
+#endif
+    throw runtime_error("checkpoint: the codec '" + name + "' is unknown or bhxx is build without it");
+}
+
+bool is_shuffled(Codec codec) { return codec == SHUFFLE_ZLIB or codec == SHUFFLE_ZSTD; }
+
+// Groups the bytes of the elements in 'src' by their significance
+void shuffle(const char* src, size_t nbytes, size_t elem_size, char* dst) {
+    const size_t nelem = nbytes / elem_size;
+    for (size_t i = 0; i < nelem; ++i) {
+        for (size_t b = 0; b < elem_size; ++b) {
+            dst[b * nelem + i] = src[i * elem_size + b];
+        }
+    }
+    memcpy(dst + nelem * elem_size, src + nelem * elem_size, nbytes - nelem * elem_size);
+}
+
+// The inverse of shuffle()
+void unshuffle(const char* src, size_t nbytes, size_t elem_size, char* dst) {
+    const size_t nelem = nbytes / elem_size;
+    for (size_t i = 0; i < nelem; ++i) {
+        for (size_t b = 0; b < elem_size; ++b) {
+            dst[i * elem_size + b] = src[b * nelem + i];
+        }
+    }
+    memcpy(dst + nelem * elem_size, src + nelem * elem_size, nbytes - nelem * elem_size);
+}
+
+// Compress the chunk 'src' of 'nbytes' bytes into 'dst' and returns the compressed size
+size_t compress(Codec codec, int level, const char* src, size_t nbytes, size_t elem_size, vector<char>& shuffled,
+                vector<char>& dst) {
+    if (is_shuffled(codec)) {
+        shuffled.resize(nbytes);
+        shuffle(src, nbytes, elem_size, shuffled.data());
+        src = shuffled.data();
+    }
+    switch (codec) {
+#ifdef BHXX_ZLIB
+        case ZLIB:
+        case SHUFFLE_ZLIB: {
+            uLongf size = compressBound(nbytes);
+            dst.resize(size);
+            if (compress2(reinterpret_cast<Bytef*>(dst.data()), &size, reinterpret_cast<const Bytef*>(src), nbytes,
+                          level == 0 ? Z_DEFAULT_COMPRESSION : level) != Z_OK) {
+                throw runtime_error("checkpoint: zlib compression failed");
+            }
+            return size;
+        }
+#endif
+#ifdef BHXX_ZSTD
+        case ZSTD:
+        case SHUFFLE_ZSTD: {
+            dst.resize(ZSTD_compressBound(nbytes));
+            const size_t size = ZSTD_compress(dst.data(), dst.size(), src, nbytes, level);
+            if (ZSTD_isError(size)) {
+                throw runtime_error(string("checkpoint: zstd compression failed: ") + ZSTD_getErrorName(size));
+            }
+            return size;
+        }
+#endif
+        default:
+            throw runtime_error("checkpoint: cannot compress using an unknown codec");
+    }
+}
+
+// Decompress 'src' of 'nbytes' bytes into the 'dst_bytes' bytes of 'dst'
+void decompress(Codec codec, const char* src, size_t nbytes, size_t elem_size, vector<char>& shuffled, char* dst,
+                size_t dst_bytes) {
+    char* out = dst;
+    if (is_shuffled(codec)) {
+        shuffled.resize(dst_bytes);
+        out = shuffled.data();
+    }
+    switch (codec) {
+#ifdef BHXX_ZLIB
+        case ZLIB:
+        case SHUFFLE_ZLIB: {
+            uLongf size = dst_bytes;
+            if (uncompress(reinterpret_cast<Bytef*>(out), &size, reinterpret_cast<const Bytef*>(src), nbytes) !=
+                      Z_OK or
+                size != dst_bytes) {
+                throw runtime_error("checkpoint: zlib decompression failed");
+            }
+            break;
+        }
+#endif
+#ifdef BHXX_ZSTD
+        case ZSTD:
+        case SHUFFLE_ZSTD: {
+            if (ZSTD_decompress(out, dst_bytes, src, nbytes) != dst_bytes) {
+                throw runtime_error("checkpoint: zstd decompression failed");
+            }
+            break;
+        }
+#endif
+        default:
+            throw runtime_error("checkpoint: the file uses a codec that bhxx is build without");
+    }
+    if (is_shuffled(codec)) {
+        unshuffle(shuffled.data(), dst_bytes, elem_size, dst);
+    }
+}
+
+// Calls 'func(i, scratch)' for each 'i' in [0, n) using at most 'threads' threads, which each has its own 'scratch'
+void parallel_for(size_t n, int threads, const function<void(size_t, vector<char>&)>& func) {
+    const size_t max_threads = threads > 0 ? threads : std::max(1u, thread::hardware_concurrency());
+    const size_t nthreads    = std::max<size_t>(1, std::min(n, max_threads));
+    vector<vector<char>> scratch(nthreads);
+    if (nthreads == 1) {
+        for (size_t i = 0; i < n; ++i) {
+            func(i, scratch[0]);
+        }
+        return;
+    }
+    atomic<size_t> next(0);
+    exception_ptr error;
+    mutex error_mutex;
+    vector<thread> workers;
+    for (size_t t = 0; t < nthreads; ++t) {
+        workers.emplace_back([&, t]() {
+            try {
+                for (size_t i = next++; i < n; i = next++) {
+                    func(i, scratch[t]);
+                }
+            } catch (...) {
+                lock_guard<mutex> lock(error_mutex);
+                error = current_exception();
+            }
+        });
+    }
+    for (thread& worker : workers) {
+        worker.join();
+    }
+    if (error != nullptr) {
+        rethrow_exception(error);
+    }
+}
+
+void write_u64(ofstream& out, uint64_t value) { out.write(reinterpret_cast<const char*>(&value), sizeof(value)); }
+
+uint64_t read_u64(ifstream& in) {
+    uint64_t ret;
+    if (not in.read(reinterpret_cast<char*>(&ret), sizeof(ret))) {
+        throw runtime_error("checkpoint: the file is truncated");
+    }
+    return ret;
+}
+}  // namespace
+
+void checkpoint_save(const string& path, const vector<shared_ptr<BhBase>>& bases, const CheckpointOptions& options) {
+    const Codec type = parse_codec(options.codec);
+    Runtime& runtime = Runtime::instance();
+    for (const shared_ptr<BhBase>& base : bases) {
+        BhInstruction instr(BH_SYNC);
+        instr.append_operand(*base);
+        runtime.enqueue(std::move(instr));
+    }
+    runtime.flush();
+
+    ofstream out(path, ios::binary | ios::trunc);
+    if (not out) {
+        throw runtime_error("checkpoint: cannot open '" + path + "' for writing");
+    }
+    out.write(MAGIC, sizeof(MAGIC));
+    write_u64(out, bases.size());
+
+    vector<vector<char>> chunks;
+    for (const shared_ptr<BhBase>& base : bases) {
+        const size_t nbytes    = base->data == nullptr ? 0 : static_cast<size_t>(bh_base_size(base.get()));
+        const size_t elem_size = bh_type_size(base->type);
+        const Codec codec      = nbytes == 0 ? NONE : type;
+        // The chunks hold whole elements thus they are shuffled independently
+        const size_t chunk   = std::max<size_t>(1, options.chunk_bytes / elem_size) * elem_size;
+        const size_t nchunks = codec == NONE ? 0 : (nbytes + chunk - 1) / chunk;
+        write_u64(out, static_cast<uint64_t>(base->type));
+        write_u64(out, base->nelem);
+        write_u64(out, base->data != nullptr);
+        write_u64(out, codec);
+        write_u64(out, elem_size);
+        write_u64(out, nbytes);
+        write_u64(out, codec == NONE ? 0 : chunk);
+        write_u64(out, nchunks);
+        const char* src = static_cast<const char*>(base->data);
+        if (codec == NONE) {
+            out.write(src, nbytes);  // The raw data is written directly from the base
+            continue;
+        }
+        chunks.resize(std::max(chunks.size(), nchunks));
+        vector<uint64_t> sizes(nchunks);
+        parallel_for(nchunks, options.threads, [&](size_t i, vector<char>& shuffled) {
+            const size_t offset = i * chunk;
+            sizes[i] = compress(codec, options.level, src + offset, std::min(chunk, nbytes - offset), elem_size,
+                                shuffled, chunks[i]);
+        });
+        out.write(reinterpret_cast<const char*>(sizes.data()), sizes.size() * sizeof(uint64_t));
+        for (size_t i = 0; i < nchunks; ++i) {
+            out.write(chunks[i].data(), sizes[i]);
+        }
+    }
+    if (not out.flush()) {
+        throw runtime_error("checkpoint: cannot write '" + path + "'");
+    }
+}
+
+void checkpoint_restore(const string& path, const vector<shared_ptr<BhBase>>& bases, int threads) {
+    ifstream in(path, ios::binary);
+    if (not in) {
+        throw runtime_error("checkpoint: cannot open '" + path + "' for reading");
+    }
+    char magic[sizeof(MAGIC)];
+    if (not in.read(magic, sizeof(magic)) or memcmp(magic, MAGIC, sizeof(MAGIC)) != 0) {
+        throw runtime_error("checkpoint: '" + path + "' isn't a checkpoint file");
+    }
+    if (read_u64(in) != bases.size()) {
+        throw runtime_error("checkpoint: '" + path + "' holds a different number of bases");
+    }
+
+    Runtime& runtime = Runtime::instance();
+    vector<char> received;
+    for (const shared_ptr<BhBase>& base : bases) {
+        const uint64_t type  = read_u64(in);
+        const uint64_t nelem = read_u64(in);
+        if (type != static_cast<uint64_t>(base->type) or nelem != static_cast<uint64_t>(base->nelem)) {
+            throw runtime_error("checkpoint: a base of '" + path + "' has another type or size");
+        }
+        const bool has_data    = read_u64(in) != 0;
+        const Codec codec      = static_cast<Codec>(read_u64(in));
+        const size_t elem_size = read_u64(in);
+        const size_t nbytes    = read_u64(in);
+        const size_t chunk     = read_u64(in);
+        const size_t nchunks   = read_u64(in);
+        if (not has_data) {
+            continue;
+        }
+        if (nbytes != static_cast<size_t>(bh_base_size(base.get())) or (codec != NONE and chunk == 0)) {
+            throw runtime_error("checkpoint: a base of '" + path + "' is malformed");
+        }
+
+        // The data goes into a new base, which the engine copies into 'base'
+        unique_ptr<BhBase> tmp(new BhBase(uint8_t(0), 0));
+        tmp->type  = base->type;
+        tmp->nelem = base->nelem;
+        bh_data_malloc(tmp.get());
+        char* dst = static_cast<char*>(tmp->data);
+        if (codec == NONE) {
+            in.read(dst, nbytes);
+        } else {
+            vector<uint64_t> sizes(nchunks);
+            in.read(reinterpret_cast<char*>(sizes.data()), sizes.size() * sizeof(uint64_t));
+            vector<size_t> offsets(nchunks + 1, 0);
+            for (size_t i = 0; i < nchunks; ++i) {
+                offsets[i + 1] = offsets[i] + sizes[i];
+            }
+            received.resize(offsets.back());
+            in.read(received.data(), received.size());
+            if (in) {
+                parallel_for(nchunks, threads, [&](size_t i, vector<char>& shuffled) {
+                    const size_t offset = i * chunk;
+                    decompress(codec, received.data() + offsets[i], sizes[i], elem_size, shuffled, dst + offset,
+                               std::min(chunk, nbytes - offset));
+                });
+            }
+        }
+        if (not in) {
+            bh_data_free(tmp.get());
+            throw runtime_error("checkpoint: the file is truncated");
+        }
+
+        BhInstruction instr(BH_IDENTITY);
+        bh_view view;
+        view.base      = base.get();
+        view.start     = 0;
+        view.ndim      = 1;
+        view.shape[0]  = base->nelem;
+        view.stride[0] = 1;
+        instr.operand.push_back(view);
+        view.base = tmp.get();
+        instr.operand.push_back(view);
+        runtime.enqueue(std::move(instr));
+        runtime.enqueue_deletion(std::move(tmp));
+    }
+    runtime.flush();
+}
+
+}  // namespace bhxx
@@ -0,0 +1,288 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <bhxx/eager.hpp>
+#include <bh_base.hpp>
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <type_traits>
+
+using namespace std;
+
+namespace bhxx {
+namespace eager {
+
+namespace {
+
+// The element-wise opcodes of the eager kernels by their kind
+bool is_arithmetic(bh_opcode opcode) {
+    return opcode == BH_ADD or opcode == BH_SUBTRACT or opcode == BH_MULTIPLY or opcode == BH_DIVIDE or
+           opcode == BH_MAXIMUM or opcode == BH_MINIMUM;
+}
+bool is_comparison(bh_opcode opcode) {
+    return opcode == BH_GREATER or opcode == BH_GREATER_EQUAL or opcode == BH_LESS or opcode == BH_LESS_EQUAL or
+           opcode == BH_EQUAL or opcode == BH_NOT_EQUAL;
+}
+bool is_unary(bh_opcode opcode) { return opcode == BH_ABSOLUTE or opcode == BH_SQRT; }
+
+// The types of the eager kernels
+bool is_eager_type(bh_type type) {
+    return type == bh_type::BOOL or bh_type_is_integer(type) or type == bh_type::FLOAT32 or
+           type == bh_type::FLOAT64;
+}
+
+// Calls `f.template run<T>()` where T is the C++ type of `type` (one of `is_eager_type()`)
+template <typename F>
+void with_type(bh_type type, F& f) {
+    switch (type) {
+        case bh_type::BOOL: f.template run<bh_bool>(); break;
+        case bh_type::INT8: f.template run<bh_int8>(); break;
+        case bh_type::INT16: f.template run<bh_int16>(); break;
+        case bh_type::INT32: f.template run<bh_int32>(); break;
+        case bh_type::INT64: f.template run<bh_int64>(); break;
+        case bh_type::UINT8: f.template run<bh_uint8>(); break;
+        case bh_type::UINT16: f.template run<bh_uint16>(); break;
+        case bh_type::UINT32: f.template run<bh_uint32>(); break;
+        case bh_type::UINT64: f.template run<bh_uint64>(); break;
+        case bh_type::FLOAT32: f.template run<bh_float32>(); break;
+        case bh_type::FLOAT64: f.template run<bh_float64>(); break;
+        default: throw runtime_error("eager: unsupported type");
+    }
+}
+
+// The value of the constant `c` as a T
+template <typename T>
+T constant_as(const bh_constant& c) {
+    switch (c.type) {
+        case bh_type::BOOL: return static_cast<T>(c.value.bool8);
+        case bh_type::INT8: return static_cast<T>(c.value.int8);
+        case bh_type::INT16: return static_cast<T>(c.value.int16);
+        case bh_type::INT32: return static_cast<T>(c.value.int32);
+        case bh_type::INT64: return static_cast<T>(c.value.int64);
+        case bh_type::UINT8: return static_cast<T>(c.value.uint8);
+        case bh_type::UINT16: return static_cast<T>(c.value.uint16);
+        case bh_type::UINT32: return static_cast<T>(c.value.uint32);
+        case bh_type::UINT64: return static_cast<T>(c.value.uint64);
+        case bh_type::FLOAT32: return static_cast<T>(c.value.float32);
+        case bh_type::FLOAT64: return static_cast<T>(c.value.float64);
+        default: throw runtime_error("eager: unsupported constant type");
+    }
+}
+
+/* The data of the operands of an instruction as T0, T1, and T2, which iterates the elements of the
+ * operands in the row-major order of the shape of the output. A constant is an operand of stride zero. */
+template <typename T0, typename T1, typename T2 = T1>
+class Operands {
+  public:
+    explicit Operands(const bh_instruction& instr) : view(instr.operand[0]) {
+        nops = instr.operand.size();
+        data[0] = pointer<T0>(instr, 0, nullptr);
+        if (nops > 1) {
+            data[1] = pointer<T1>(instr, 1, &c1);
+        }
+        if (nops > 2) {
+            data[2] = pointer<T2>(instr, 2, &c2);
+        }
+        for (size_t i = 0; i < nops; ++i) {
+            const bh_view& v = instr.operand[i];
+            offset[i]        = bh_is_constant(&v) ? 0 : v.start;
+            for (int64_t d = 0; d < view.ndim; ++d) {
+                stride[i][d] = bh_is_constant(&v) ? 0 : v.stride[d];
+            }
+        }
+    }
+
+    // Calls `f(out, in1, in2)` with a reference to each element of the output and the inputs
+    template <typename F>
+    void for_each(F f) {
+        const int64_t nelem = bh_nelements(view);
+        int64_t index[BH_MAXDIM] = {};
+        for (int64_t e = 0; e < nelem; ++e) {
+            T2& in2 = nops > 2 ? static_cast<T2*>(data[2])[offset[2]] : c2;
+            f(static_cast<T0*>(data[0])[offset[0]], static_cast<T1*>(data[1])[offset[1]], in2);
+            for (int64_t d = view.ndim - 1; d >= 0; --d) {
+                for (size_t i = 0; i < nops; ++i) {
+                    offset[i] += stride[i][d];
+                }
+                if (++index[d] < view.shape[d]) {
+                    break;
+                }
+                for (size_t i = 0; i < nops; ++i) {
+                    offset[i] -= stride[i][d] * view.shape[d];
+                }
+                index[d] = 0;
+            }
+        }
+    }
+
+  private:
+    // The data of the operand `i` (or `constant` from the constant of the instruction)
+    template <typename T>
+    void* pointer(const bh_instruction& instr, size_t i, T* constant) {
+        const bh_view& v = instr.operand[i];
+        if (bh_is_constant(&v)) {
+            *constant = constant_as<T>(instr.constant);
+            return constant;
+        }
+        bh_data_malloc(v.base);
+        return v.base->data;
+    }
+
+    const bh_view& view;
+    size_t nops;
+    // The constant operand or the dummy second input of the unary instructions
+    T1 c1{};
+    T2 c2{};
+    void* data[3]         = {};
+    int64_t offset[3]     = {};
+    int64_t stride[3][BH_MAXDIM];
+};
+
+// Division like the kernels of the engines, where signed integers round towards minus infinity like NumPy
+template <typename T>
+typename enable_if<is_signed<T>::value and is_integral<T>::value, T>::type divide(T a, T b) {
+    return ((a > 0) != (b > 0) and a % b != 0) ? static_cast<T>(a / b - 1) : static_cast<T>(a / b);
+}
+template <typename T>
+typename enable_if<not(is_signed<T>::value and is_integral<T>::value), T>::type divide(T a, T b) {
+    return a / b;
+}
+
+// The absolute value, which is a no-op for the unsigned types
+template <typename T>
+typename enable_if<is_signed<T>::value, T>::type absolute(T a) {
+    return a < 0 ? static_cast<T>(-a) : a;
+}
+template <typename T>
+typename enable_if<not is_signed<T>::value, T>::type absolute(T a) {
+    return a;
+}
+
+// The arithmetic, comparisons, and unary functions of inputs of type T
+struct Compute {
+    const bh_instruction& instr;
+
+    template <typename T>
+    void run() {
+        if (is_comparison(instr.opcode)) {
+            Operands<bh_bool, T> ops(instr);
+            switch (instr.opcode) {
+                case BH_GREATER: ops.for_each([](bh_bool& o, T a, T b) { o = a > b; }); break;
+                case BH_GREATER_EQUAL: ops.for_each([](bh_bool& o, T a, T b) { o = a >= b; }); break;
+                case BH_LESS: ops.for_each([](bh_bool& o, T a, T b) { o = a < b; }); break;
+                case BH_LESS_EQUAL: ops.for_each([](bh_bool& o, T a, T b) { o = a <= b; }); break;
+                case BH_EQUAL: ops.for_each([](bh_bool& o, T a, T b) { o = a == b; }); break;
+                default: ops.for_each([](bh_bool& o, T a, T b) { o = a != b; }); break;
+            }
+            return;
+        }
+        Operands<T, T> ops(instr);
+        switch (instr.opcode) {
+            case BH_ADD: ops.for_each([](T& o, T a, T b) { o = a + b; }); break;
+            case BH_SUBTRACT: ops.for_each([](T& o, T a, T b) { o = a - b; }); break;
+            case BH_MULTIPLY: ops.for_each([](T& o, T a, T b) { o = a * b; }); break;
+            case BH_DIVIDE: ops.for_each([](T& o, T a, T b) { o = divide(a, b); }); break;
+            case BH_MAXIMUM: ops.for_each([](T& o, T a, T b) { o = a > b ? a : b; }); break;
+            case BH_MINIMUM: ops.for_each([](T& o, T a, T b) { o = a < b ? a : b; }); break;
+            case BH_ABSOLUTE: ops.for_each([](T& o, T a, T) { o = absolute(a); }); break;
+            default: ops.for_each([](T& o, T a, T) { o = static_cast<T>(std::sqrt(a)); }); break;
+        }
+    }
+};
+
+// The identity (i.e. the type conversion) of an input of type T1 to an output of type T0
+template <typename T1>
+struct Convert {
+    const bh_instruction& instr;
+
+    template <typename T0>
+    void run() {
+        Operands<T0, T1> ops(instr);
+        if (instr.operand[0].base->type == bh_type::BOOL) {
+            ops.for_each([](T0& o, T1 a, T1) { o = static_cast<T0>(a != 0); });
+        } else {
+            ops.for_each([](T0& o, T1 a, T1) { o = static_cast<T0>(a); });
+        }
+    }
+};
+struct Identity {
+    const bh_instruction& instr;
+
+    template <typename T1>
+    void run() {
+        Convert<T1> convert{instr};
+        with_type(instr.operand[0].base->type, convert);
+    }
+};
+}  // namespace
+
+bool supported(const bh_instruction& instr) {
+    const size_t nops = instr.operand.size();
+    const bh_opcode opcode = instr.opcode;
+    if (nops != ((opcode == BH_IDENTITY or is_unary(opcode)) ? 2u : 3u)) {
+        return false;
+    }
+    if (not(opcode == BH_IDENTITY or is_unary(opcode) or is_arithmetic(opcode) or is_comparison(opcode))) {
+        return false;
+    }
+    const bh_view& out = instr.operand[0];
+    if (bh_is_constant(&out)) {
+        return false;
+    }
+    for (size_t i = 0; i < nops; ++i) {
+        const bh_view& v = instr.operand[i];
+        if (not is_eager_type(instr.operand_type(static_cast<int>(i)))) {
+            return false;
+        }
+        if (not bh_is_constant(&v) and
+            (v.ndim != out.ndim or not std::equal(v.shape, v.shape + v.ndim, out.shape))) {
+            return false;
+        }
+    }
+    const bh_type t0 = instr.operand_type(0), t1 = instr.operand_type(1);
+    if (opcode == BH_IDENTITY) {
+        return true;
+    }
+    // The inputs have the same type (the bhxx scalars have the type of the array)
+    if (nops == 3 and instr.operand_type(2) != t1) {
+        return false;
+    }
+    if (is_comparison(opcode)) {
+        return t0 == bh_type::BOOL;
+    }
+    if (t0 != t1 or t0 == bh_type::BOOL) {
+        return false;
+    }
+    return opcode != BH_SQRT or bh_type_is_float(t0);
+}
+
+void execute(const bh_instruction& instr) {
+    if (instr.opcode == BH_IDENTITY) {
+        Identity identity{instr};
+        with_type(instr.operand_type(1), identity);
+    } else {
+        Compute compute{instr};
+        with_type(instr.operand_type(1), compute);
+    }
+}
+
+}  // namespace eager
+}  // namespace bhxx
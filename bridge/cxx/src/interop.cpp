@@ -0,0 +1,65 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <memory>
+
+#include <bhxx/BhInstruction.hpp>
+#include <bhxx/Runtime.hpp>
+#include <bhxx/interop.hpp>
+
+namespace bhxx {
+
+DeviceBuffer device_export(BhBase& base) {
+    Runtime& runtime = Runtime::instance();
+    std::unique_ptr<BhBase> result(new BhBase(uint64_t(0), 3));
+    if (runtime.enqueue_extmethod("device_export", *result, base)) {
+        BhInstruction sync(BH_SYNC);
+        sync.append_operand(*result);
+        runtime.enqueue(std::move(sync));
+        runtime.flush();
+        const uint64_t* data = static_cast<const uint64_t*>(result->data);
+        const DeviceBuffer ret = {data[0], data[1], data[2]};
+        runtime.enqueue_deletion(std::move(result));
+        return ret;
+    }
+    // No engine knows the extension method thus the data is on the host
+    BhInstruction sync(BH_SYNC);
+    sync.append_operand(base);
+    runtime.enqueue(std::move(sync));
+    runtime.flush();
+    bh_data_malloc(&base);
+    return DeviceBuffer{reinterpret_cast<uint64_t>(base.data), 1, 0};
+}
+
+bool device_import(BhBase& base, uint64_t address) {
+    Runtime& runtime = Runtime::instance();
+    std::unique_ptr<BhBase> arg(new BhBase(uint64_t(0), 1));
+    bh_data_malloc(arg.get());
+    *static_cast<uint64_t*>(arg->data) = address;
+    if (not runtime.enqueue_extmethod("device_import", base, *arg)) {
+        bh_data_free(arg.get());
+        return false;
+    }
+    runtime.enqueue_deletion(std::move(arg));
+    runtime.flush();
+    return true;
+}
+
+}  // namespace bhxx
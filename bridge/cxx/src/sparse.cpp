@@ -0,0 +1,157 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <bhxx/Runtime.hpp>
+#include <bhxx/array_operations.hpp>
+#include <bhxx/sparse.hpp>
+#include <bhxx/util.hpp>
+#include <stdexcept>
+
+namespace bhxx {
+
+namespace {
+// The nonzeros [indptr[i], indptr[i+1]) get row i: a one is added at the start of each row but the first
+// thus the running sum is the row, which also skips empty rows since their starts coincide
+BhArray<uint64_t> rows_of_indptr(uint64_t rows, uint64_t nnz, const BhArray<uint64_t>& indptr) {
+    BhArray<uint64_t> starts({nnz + 1});
+    identity(starts, uint64_t{0});
+    if (rows > 1) {
+        add_scatter(starts, uint64_t{1}, BhArray<uint64_t>(indptr.base, {rows - 1}, indptr.stride,
+                                                              indptr.offset + indptr.stride[0]));
+    }
+    BhArray<uint64_t> row({nnz});
+    add_accumulate(row, BhArray<uint64_t>(starts.base, {nnz}, {1}, 0), 0);
+    return row;
+}
+
+// The number of nonzeros of the CSR arrays
+template <typename T>
+uint64_t checked_nnz(uint64_t rows, const BhArray<T>& values, const BhArray<uint64_t>& indices,
+                     const BhArray<uint64_t>& indptr) {
+    if (values.rank() != 1 || indices.rank() != 1 || indptr.rank() != 1 ||
+        values.n_elem() != indices.n_elem() || indptr.n_elem() != rows + 1) {
+        throw std::invalid_argument("CsrMatrix: 'values' and 'indices' must have the same length "
+                                    "and 'indptr' must have 'rows + 1' elements");
+    }
+    return values.n_elem();
+}
+
+// The start of row i is the number of nonzeros in the rows before it
+BhArray<uint64_t> indptr_of_rows(uint64_t rows, const BhArray<uint64_t>& row) {
+    BhArray<uint64_t> counts({rows + 1});
+    identity(counts, uint64_t{0});
+    BhArray<uint64_t> after(counts.base, {rows}, {1}, 1);
+    add_scatter(after, uint64_t{1}, row);
+    BhArray<uint64_t> indptr({rows + 1});
+    add_accumulate(indptr, counts, 0);
+    return indptr;
+}
+}  // namespace
+
+template <typename T>
+CsrMatrix<T>::CsrMatrix(uint64_t rows, uint64_t cols, BhArray<T> values, BhArray<uint64_t> indices,
+                        BhArray<uint64_t> indptr, BhArray<uint64_t> row)
+    : rows(rows), cols(cols), values(std::move(values)), indices(std::move(indices)),
+      indptr(std::move(indptr)), _row(std::move(row)) {}
+
+template <typename T>
+CsrMatrix<T>::CsrMatrix(uint64_t rows, uint64_t cols, BhArray<T> values, BhArray<uint64_t> indices,
+                        BhArray<uint64_t> indptr)
+    : CsrMatrix(rows, cols, values, indices, indptr,
+                rows_of_indptr(rows, checked_nnz(rows, values, indices, indptr), indptr)) {}
+
+template <typename T>
+CsrMatrix<T> CsrMatrix<T>::from_coo(uint64_t rows, uint64_t cols, BhArray<uint64_t> row,
+                                    BhArray<uint64_t> col, BhArray<T> values) {
+    if (values.rank() != 1 || row.rank() != 1 || col.rank() != 1 ||
+        values.n_elem() != row.n_elem() || values.n_elem() != col.n_elem()) {
+        throw std::invalid_argument("CsrMatrix: 'row', 'col', and 'values' must have the same length");
+    }
+    BhArray<uint64_t> indptr = indptr_of_rows(rows, row);
+    return CsrMatrix(rows, cols, std::move(values), std::move(col), std::move(indptr), std::move(row));
+}
+
+template <typename T>
+BhArray<T> spmv(const CsrMatrix<T>& a, const BhArray<T>& x) {
+    if (x.rank() != 1 || x.n_elem() != a.cols) {
+        throw std::invalid_argument("spmv: 'x' must be a vector of 'a.cols' elements");
+    }
+    BhArray<T> y({a.rows});
+    identity(y, T{0});
+    if (a.nnz() == 0) {
+        return y;
+    }
+    // y[row[k]] += values[k] * x[indices[k]]
+    BhArray<T> prod({a.nnz()});
+    gather(prod, as_contiguous(x), a.indices);
+    multiply(prod, prod, a.values);
+    add_scatter(y, prod, a.row_indices());
+    return y;
+}
+
+template <typename T>
+BhArray<T> spmm(const CsrMatrix<T>& a, const BhArray<T>& x) {
+    if (x.rank() != 2 || x.shape[0] != a.cols) {
+        throw std::invalid_argument("spmm: 'x' must be a matrix of 'a.cols' rows");
+    }
+    const uint64_t k = x.shape[1];
+    BhArray<T> y({a.rows, k});
+    identity(y, T{0});
+    if (a.nnz() == 0 || k == 0) {
+        return y;
+    }
+    // The flat indexes of the k columns of the rows `indices` of `x` and `row_indices()` of `y`
+    BhArray<uint64_t> column({k});
+    range(column);
+    const BhArray<uint64_t> columns = broadcast(column, 0, a.nnz());
+    BhArray<uint64_t> src({a.nnz(), k}), dst({a.nnz(), k});
+    multiply(src, broadcast(a.indices, 1, k), k);
+    add(src, src, columns);
+    multiply(dst, broadcast(a.row_indices(), 1, k), k);
+    add(dst, dst, columns);
+
+    // y[row[nz], j] += values[nz] * x[indices[nz], j]
+    BhArray<T> prod({a.nnz(), k});
+    gather(prod, as_contiguous(x), src);
+    multiply(prod, prod, broadcast(a.values, 1, k));
+    add_scatter(y, prod, dst);
+    return y;
+}
+
+// Instantiate the types of the add-scatter
+#define INSTANTIATE(T)                                                  \
+    template class CsrMatrix<T>;                                        \
+    template BhArray<T> spmv(const CsrMatrix<T>&, const BhArray<T>&); \
+    template BhArray<T> spmm(const CsrMatrix<T>&, const BhArray<T>&)
+
+INSTANTIATE(int8_t);
+INSTANTIATE(int16_t);
+INSTANTIATE(int32_t);
+INSTANTIATE(int64_t);
+INSTANTIATE(uint8_t);
+INSTANTIATE(uint16_t);
+INSTANTIATE(uint32_t);
+INSTANTIATE(uint64_t);
+INSTANTIATE(float);
+INSTANTIATE(double);
+
+#undef INSTANTIATE
+
+}  // namespace bhxx
@@ -22,6 +22,8 @@ If not, see <http://www.gnu.org/licenses/>.
 #include <bhxx/array_operations.hpp>
 #include <bhxx/util.hpp>
 #include <complex>
+#include <stdexcept>
+#include <type_traits>
 
 namespace bhxx {
 
@@ -151,6 +153,138 @@ BhArray<T> matmul(BhArray<T> lhs, BhArray<T> rhs) {
     return reshape(std::move(result), result_shape);
 }
 
+template <typename T>
+BhArray<T> window_reduce(BhArray<T> ary, const std::string& method, int64_t window,
+                         int64_t axis) {
+    const int64_t rank = static_cast<int64_t>(ary.rank());
+    if (axis < 0) axis += rank;
+    if (axis < 0 || axis >= rank) {
+        throw std::invalid_argument("window_reduce: axis is out of bounds");
+    }
+    const int64_t n = static_cast<int64_t>(ary.shape[axis]);
+    if (window < 1 || window > n) {
+        throw std::invalid_argument("window_reduce: the window size is out of bounds");
+    }
+    if (method != "sum" && method != "min" && method != "max" && method != "mean") {
+        throw std::invalid_argument("window_reduce: unknown method '" + method + "'");
+    }
+    if (method == "mean" && !std::is_floating_point<T>::value) {
+        throw std::invalid_argument("window_reduce: the mean requires a floating-point type");
+    }
+
+    // The extension method slides along the rows of a 2-D array thus `axis` is swapped with the last axis
+    Shape  shape  = ary.shape;
+    Stride stride = ary.stride;
+    std::swap(shape[axis], shape[rank - 1]);
+    std::swap(stride[axis], stride[rank - 1]);
+    BhArray<T> moved = as_contiguous(BhArray<T>(ary.base, shape, stride, ary.offset));
+    const size_t nrows = moved.n_elem() / n;
+    BhArray<T> rows = reshape(std::move(moved), {nrows, static_cast<size_t>(n)});
+    BhArray<T> result({nrows, static_cast<size_t>(n - window + 1)});
+
+    try {
+        BhArray<int64_t> size({1});
+        identity(size, window);
+        Runtime::instance().enqueue_extmethod("window_" + method, result, rows, size);
+    } catch (const std::exception&) {
+        // No extension method, the sum of the shifted views
+        const Shape part{nrows, static_cast<size_t>(n - window + 1)};
+        identity(result, BhArray<T>(rows.base, part, rows.stride, rows.offset));
+        for (int64_t i = 1; i < window; ++i) {
+            BhArray<T> shifted(rows.base, part, rows.stride, rows.offset + i);
+            if (method == "min") {
+                minimum(result, result, shifted);
+            } else if (method == "max") {
+                maximum(result, result, shifted);
+            } else {
+                add(result, result, shifted);
+            }
+        }
+        if (method == "mean") {
+            divide(result, result, static_cast<T>(window));
+        }
+    }
+
+    // Back to the shape and the axis order of `ary`
+    shape[rank - 1] = static_cast<size_t>(n - window + 1);
+    result = reshape(std::move(result), shape);
+    std::swap(result.shape[axis], result.shape[rank - 1]);
+    std::swap(result.stride[axis], result.stride[rank - 1]);
+    return result;
+}
+
+namespace {
+// The rows of the last axis of `ary` as a contiguous 2-D array
+template <typename T>
+BhArray<T> as_rows(BhArray<T> ary) {
+    const size_t n = ary.shape[ary.rank() - 1];
+    const size_t nrows = ary.n_elem() / n;
+    return reshape(as_contiguous(std::move(ary)), {nrows, n});
+}
+}  // namespace
+
+BhArray<uint8_t> packbits(BhArray<bool> ary) {
+    if (ary.rank() == 0 || ary.shape[ary.rank() - 1] == 0) {
+        throw std::invalid_argument("packbits: the array must have a non-empty last axis");
+    }
+    Shape shape = ary.shape;
+    const size_t n = shape[shape.size() - 1];
+    const size_t nbytes = (n + 7) / 8;
+    BhArray<bool> rows = as_rows(std::move(ary));
+    const size_t nrows = rows.shape[0];
+    BhArray<uint8_t> result({nrows, nbytes});
+
+    try {
+        Runtime::instance().enqueue_extmethod("packbits", result, rows, rows);
+    } catch (const std::exception&) {
+        // No extension method, the sum of the eight shifted views of the zero-padded bytes
+        BhArray<uint8_t> padded({nrows, nbytes * 8});
+        identity(padded, uint8_t(0));
+        BhArray<uint8_t> part(padded.base, rows.shape, padded.stride, padded.offset);
+        identity(part, rows);
+        BhArray<uint8_t> bits({nrows, nbytes});
+        identity(result, uint8_t(0));
+        for (size_t b = 0; b < 8; ++b) {
+            BhArray<uint8_t> column(padded.base, {nrows, nbytes}, {padded.stride[0], 8}, padded.offset + b);
+            left_shift(bits, column, static_cast<uint8_t>(7 - b));
+            bitwise_or(result, result, bits);
+        }
+    }
+    shape[shape.size() - 1] = nbytes;
+    return reshape(std::move(result), shape);
+}
+
+BhArray<bool> unpackbits(BhArray<uint8_t> ary, size_t count) {
+    if (ary.rank() == 0 || count == 0) {
+        throw std::invalid_argument("unpackbits: the array must have a non-empty last axis");
+    }
+    Shape shape = ary.shape;
+    const size_t nbytes = shape[shape.size() - 1];
+    if ((count + 7) / 8 != nbytes) {
+        throw std::invalid_argument("unpackbits: the last axis must have 'ceil(count / 8)' bytes");
+    }
+    BhArray<uint8_t> rows = as_rows(std::move(ary));
+    const size_t nrows = rows.shape[0];
+    BhArray<bool> result({nrows, count});
+
+    try {
+        Runtime::instance().enqueue_extmethod("unpackbits", result, rows, rows);
+    } catch (const std::exception&) {
+        // No extension method, each bit of the bytes into the booleans of a shifted view
+        BhArray<bool> padded({nrows, nbytes * 8});
+        BhArray<uint8_t> bits({nrows, nbytes});
+        for (size_t b = 0; b < 8; ++b) {
+            BhArray<bool> column(padded.base, {nrows, nbytes}, {padded.stride[0], 8}, padded.offset + b);
+            right_shift(bits, rows, static_cast<uint8_t>(7 - b));
+            bitwise_and(bits, bits, uint8_t(1));
+            identity(column, bits);
+        }
+        identity(result, BhArray<bool>(padded.base, result.shape, padded.stride, padded.offset));
+    }
+    shape[shape.size() - 1] = count;
+    return reshape(std::move(result), shape);
+}
+
 // Instantiate all possible types of `BhArray`
 #define INSTANTIATE(T)                         \
     template T          as_scalar(BhArray<T>); \
@@ -161,21 +295,28 @@ BhArray<T> matmul(BhArray<T> lhs, BhArray<T> rhs) {
     INSTANTIATE(T);           \
     template BhArray<T> matmul(BhArray<T>, BhArray<T>)
 
+#define INSTANTIATE_REAL(T) \
+    INSTANTIATE_NOBOOL(T);  \
+    template BhArray<T> window_reduce(BhArray<T>, const std::string&, int64_t, int64_t)
+
 INSTANTIATE(bool);
-INSTANTIATE_NOBOOL(int8_t);
-INSTANTIATE_NOBOOL(int16_t);
-INSTANTIATE_NOBOOL(int32_t);
-INSTANTIATE_NOBOOL(int64_t);
-INSTANTIATE_NOBOOL(uint8_t);
-INSTANTIATE_NOBOOL(uint16_t);
-INSTANTIATE_NOBOOL(uint32_t);
-INSTANTIATE_NOBOOL(uint64_t);
-INSTANTIATE_NOBOOL(float);
-INSTANTIATE_NOBOOL(double);
+INSTANTIATE_REAL(int8_t);
+INSTANTIATE_REAL(int16_t);
+INSTANTIATE_REAL(int32_t);
+INSTANTIATE_REAL(int64_t);
+INSTANTIATE_REAL(uint8_t);
+INSTANTIATE_REAL(uint16_t);
+INSTANTIATE_REAL(uint32_t);
+INSTANTIATE_REAL(uint64_t);
+INSTANTIATE_REAL(float);
+INSTANTIATE_REAL(double);
 INSTANTIATE_NOBOOL(std::complex<float>);
 INSTANTIATE_NOBOOL(std::complex<double>);
+INSTANTIATE(bh_float16);
+INSTANTIATE(bh_bfloat16);
 
 #undef INSTANTIATE
 #undef INSTANTIATE_NOBOOL
+#undef INSTANTIATE_REAL
 
 }  // namespace bhxx
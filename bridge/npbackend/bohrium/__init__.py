@@ -29,8 +29,11 @@ from .disk_io import *
 from . import contexts
 from . import bh_info
 from . import backend_messaging
+from . import interop
+from . import sparse
 from .signal import convolve1d as convolve
 from .signal import correlate1d as correlate
+from .jit import jit
 from numpy_force import dtype
 
 asarray = array
@@ -68,14 +68,26 @@ def dtype_is_float(dtype):
 
     return dtype_in(dtype, [np.float32, np.float64, np.complex64, np.complex128])
 
+# The Bohrium names of the data types seen so far
+_dtype_names = {}
+
 def dtype_name(obj):
     """Returns the Bohrium name of the data type of the object 'obj'."""
 
     dtype = dtype_of(obj)
+    try:
+        return _dtype_names[dtype]
+    except KeyError:
+        pass
     if dtype_in(dtype, [np.bool_, np.bool, bool]):
-        return 'bool8'
+        name = 'bool8'
     else:
-        return dtype.name
+        name = dtype.name
+    _dtype_names[dtype] = name
+    return name
+
+# The type signatures of the operations on arrays seen so far, e.g. ('add', float64, float64)
+_type_sigs = {}
 
 def type_sig(op_name, inputs):
     """
@@ -84,13 +96,25 @@ def type_sig(op_name, inputs):
         be identical
     """
 
+    # NB: the result type of scalars depends on their value thus we only cache signatures of arrays
+    key = None
+    if all(isinstance(t, np.ndarray) for t in inputs):
+        key = (op_name,) + tuple(t.dtype for t in inputs)
+        try:
+            return _type_sigs[key]
+        except KeyError:
+            pass
+
     func = _info.op[op_name]
     #Note that we first use the dtype before the array as inputs to result_type()
     inputs = [getattr(t, 'dtype', t) for t in inputs]
     dtype = np.result_type(*inputs).name
     for sig in func['type_sig']:
         if dtype == sig[1]:
-            return (np.dtype(sig[0]), np.dtype(sig[1]))
+            ret = (np.dtype(sig[0]), np.dtype(sig[1]))
+            if key is not None:
+                _type_sigs[key] = ret
+            return ret
 
     raise TypeError("The ufunc bohrium.%s() does not support input data type: %s." % (op_name, dtype))
 
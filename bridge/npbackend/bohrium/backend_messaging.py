@@ -26,6 +26,21 @@ def gpu_enable():
     return _backend_msg("GPU: enable")
 
 
+def fast_math_on():
+    """Let the kernels of the following flushes relax the floating-point semantic for speed"""
+    return _backend_msg("fast_math: on")
+
+
+def fast_math_off():
+    """Let the kernels of the following flushes keep the strict floating-point semantic"""
+    return _backend_msg("fast_math: off")
+
+
+def warmup(filename):
+    """Compile the kernels of the kernel trace 'filename' ahead of time (see the 'kernel_trace' config option)"""
+    return _backend_msg("warmup:%s" % filename)
+
+
 def runtime_info():
     """Return a YAML string describing the current Bohrium runtime"""
     return _backend_msg("info")
@@ -20,15 +20,10 @@ def __blas(name, a, b, alpha=1.0, c=None, beta=0.0, shape_matters=True):
                 "[ext] Wrong shape of matrices: first argument has shape {} and second has shape {}.\n".format(a.shape,
                                                                                                                b.shape))
             return None
-
-        if not b.flags['C_CONTIGUOUS']:
-            b = b.copy()
     else:
         b = np.empty(shape=(a.shape[0], a.shape[1]), dtype=a.dtype)
 
-    if not a.flags['C_CONTIGUOUS']:
-        a = a.copy()
-
+    # NB: the extension method handles strided and transposed inputs through the leading dimensions of BLAS
     if c is None:
         c = np.empty(shape=(a.shape[0], b.shape[1]), dtype=a.dtype)
     elif not c.flags['C_CONTIGUOUS']:
@@ -99,3 +99,29 @@ class DisableGPU:
 
     def __exit__(self, *args):
         messaging.gpu_enable()
+
+
+class FastMath:
+    """Let the kernels of the computations within the context relax the floating-point semantic for speed,
+    e.g. reassociate sums and assume no NaN or infinity, which the backends compile using their fast-math options.
+    The computations before the context and the ones within it are flushed separately. Contexts can be nested."""
+
+    # The number of active contexts
+    _depth = 0
+
+    def __init__(self):
+        pass
+
+    def __enter__(self):
+        from ._util import flush
+        flush()
+        if FastMath._depth == 0:
+            messaging.fast_math_on()
+        FastMath._depth += 1
+
+    def __exit__(self, *args):
+        from ._util import flush
+        flush()
+        FastMath._depth -= 1
+        if FastMath._depth == 0:
+            messaging.fast_math_off()
@@ -9,6 +9,38 @@ from . import array_create
 from .bhary import fix_biclass_wrapper
 
 
+def _map_npy(path):
+    """
+    Returns a Bohrium array whose data is the payload of the ``.npy`` file 'path' mapped copy-on-write,
+    or None when the file cannot be mapped, e.g. object arrays or non-native byte order, or isn't a ``.npy`` file
+    """
+    # We import locally in order to keep them out of the namespace of ``from .disk_io import *``
+    from . import bhary, target
+    from ._util import dtype_support
+
+    with open(path, 'rb') as fp:
+        try:
+            version = numpy.lib.format.read_magic(fp)
+        except ValueError:
+            return None
+        if version == (1, 0):
+            shape, fortran_order, dtype = numpy.lib.format.read_array_header_1_0(fp)
+        elif version == (2, 0):
+            shape, fortran_order, dtype = numpy.lib.format.read_array_header_2_0(fp)
+        else:
+            return None
+        offset = fp.tell()
+
+    if dtype.hasobject or not dtype.isnative or not dtype_support(dtype) or 0 in shape:
+        return None
+
+    # A Fortran-ordered payload is the transposed C-ordered array
+    ret = array_create.empty(shape[::-1] if fortran_order else shape, dtype=dtype)
+    if not target.map_file(bhary.get_bhc(ret), path, offset):
+        return None
+    return ret.T if fortran_order else ret
+
+
 @fix_biclass_wrapper
 def load(file, mmap_mode=None, allow_pickle=True, fix_imports=True, encoding='ASCII', bohrium=True):
     """
@@ -111,6 +143,12 @@ def load(file, mmap_mode=None, allow_pickle=True, fix_imports=True, encoding='AS
 
     """
 
+    # The payload of a ``.npy`` file is mapped directly into Bohrium memory, which pages it in lazily
+    if bohrium and mmap_mode is None and isinstance(file, str) and file.endswith('.npy'):
+        ret = _map_npy(file)
+        if ret is not None:
+            return ret
+
     f = numpy.load(file, mmap_mode, allow_pickle, fix_imports, encoding)
 
     if mmap_mode is not None:
@@ -0,0 +1,246 @@
+"""
+Interoperability
+================
+
+Share the memory of Bohrium arrays with other frameworks without copying it, through DLPack
+and the ``__cuda_array_interface__`` protocol.
+
+NB: Bohrium runs its kernels on the legacy default stream of CUDA (and its own queue on OpenCL):
+* an export waits for the kernels that write the array, thus the consumer can use the memory right away.
+* an import requires that the producer has finished writing the memory, which ``from_dlpack()`` asks
+  for by passing ``stream=1`` (the legacy default stream) to ``__dlpack__()``.
+"""
+import ctypes
+import weakref
+import numpy_force as numpy
+from . import array_create
+from . import bhary
+from . import target
+
+# The DLPack device types
+DL_CPU = 1
+DL_CUDA = 2
+DL_OPENCL = 4
+
+
+class _DLDevice(ctypes.Structure):
+    _fields_ = [("device_type", ctypes.c_int),
+                ("device_id", ctypes.c_int)]
+
+
+class _DLDataType(ctypes.Structure):
+    _fields_ = [("code", ctypes.c_uint8),
+                ("bits", ctypes.c_uint8),
+                ("lanes", ctypes.c_uint16)]
+
+
+class _DLTensor(ctypes.Structure):
+    _fields_ = [("data", ctypes.c_void_p),
+                ("device", _DLDevice),
+                ("ndim", ctypes.c_int),
+                ("dtype", _DLDataType),
+                ("shape", ctypes.POINTER(ctypes.c_int64)),
+                ("strides", ctypes.POINTER(ctypes.c_int64)),
+                ("byte_offset", ctypes.c_uint64)]
+
+
+class _DLManagedTensor(ctypes.Structure):
+    pass
+
+
+_DLDeleter = ctypes.CFUNCTYPE(None, ctypes.POINTER(_DLManagedTensor))
+_DLManagedTensor._fields_ = [("dl_tensor", _DLTensor),
+                             ("manager_ctx", ctypes.c_void_p),
+                             ("deleter", _DLDeleter)]
+
+_CapsuleDestructor = ctypes.CFUNCTYPE(None, ctypes.c_void_p)
+
+_pythonapi = ctypes.pythonapi
+_pythonapi.PyCapsule_New.restype = ctypes.py_object
+_pythonapi.PyCapsule_New.argtypes = [ctypes.c_void_p, ctypes.c_char_p, _CapsuleDestructor]
+_pythonapi.PyCapsule_IsValid.restype = ctypes.c_int
+_pythonapi.PyCapsule_IsValid.argtypes = [ctypes.c_void_p, ctypes.c_char_p]
+_pythonapi.PyCapsule_GetPointer.restype = ctypes.c_void_p
+_pythonapi.PyCapsule_GetPointer.argtypes = [ctypes.py_object, ctypes.c_char_p]
+# PyCapsule_GetPointer() of the borrowed capsule that a destructor gets
+_capsule_pointer = ctypes.PYFUNCTYPE(ctypes.c_void_p, ctypes.c_void_p, ctypes.c_char_p)(
+    ("PyCapsule_GetPointer", _pythonapi))
+_pythonapi.PyCapsule_SetName.restype = ctypes.c_int
+_pythonapi.PyCapsule_SetName.argtypes = [ctypes.py_object, ctypes.c_char_p]
+
+# The capsule names of the DLPack protocol, which must outlive the capsules
+_DLTENSOR = b"dltensor"
+_USED_DLTENSOR = b"used_dltensor"
+
+# The exported tensors (and the arrays that own their memory) by the address of the managed tensor
+_exported = {}
+
+
+def _dtype_code(dtype):
+    """ Returns the DLPack type code of 'dtype' """
+    if dtype == numpy.bool_:
+        return 6
+    return {'i': 0, 'u': 1, 'f': 2, 'c': 5}[dtype.kind]
+
+
+def _dtype_from_code(dl_dtype):
+    """ Returns the NumPy dtype of the DLPack type 'dl_dtype' """
+    if dl_dtype.lanes != 1:
+        raise TypeError("vectorized DLPack types are not supported")
+    if dl_dtype.code == 6:
+        return numpy.dtype(numpy.bool_)
+    return numpy.dtype("%s%d" % ({0: 'i', 1: 'u', 2: 'f', 5: 'c'}[dl_dtype.code], dl_dtype.bits // 8))
+
+
+def _view_layout(ary):
+    """ Returns the offset and strides of 'ary' in elements of its base """
+    base = bhary.get_base(ary)
+    offset = (bhary.get_cdata(ary) - bhary.get_cdata(base)) // ary.itemsize
+    return offset, [s // ary.itemsize for s in ary.strides]
+
+
+@_DLDeleter
+def _dl_deleter(managed):
+    _exported.pop(ctypes.addressof(managed.contents), None)
+
+
+@_CapsuleDestructor
+def _capsule_destructor(capsule):
+    # A capsule that no consumer renamed to "used_dltensor" still owns the tensor
+    if _pythonapi.PyCapsule_IsValid(capsule, _DLTENSOR):
+        _exported.pop(_capsule_pointer(capsule, _DLTENSOR), None)
+
+
+def to_dlpack(ary):
+    """
+    Returns a DLPack capsule of the memory of the Bohrium array 'ary', which shares the memory without copying it.
+    The capsule keeps the base of 'ary' alive until the consumer deletes the tensor.
+
+    Parameters
+    ----------
+    ary : array_like
+        The Bohrium array to export.
+
+    Returns
+    -------
+    out : PyCapsule
+        The "dltensor" capsule.
+    """
+    if not bhary.check(ary):
+        raise TypeError("must be a Bohrium array")
+    base = bhary.get_base(ary)
+    address, device_type, device_id = target.device_export(bhary.get_bhc(base))
+    offset, strides = _view_layout(ary)
+
+    managed = _DLManagedTensor()
+    shape = (ctypes.c_int64 * max(ary.ndim, 1))(*ary.shape)
+    dl_strides = (ctypes.c_int64 * max(ary.ndim, 1))(*strides)
+    managed.dl_tensor.data = address
+    managed.dl_tensor.device = _DLDevice(device_type, device_id)
+    managed.dl_tensor.ndim = ary.ndim
+    managed.dl_tensor.dtype = _DLDataType(_dtype_code(ary.dtype), ary.itemsize * 8, 1)
+    managed.dl_tensor.shape = shape
+    managed.dl_tensor.strides = dl_strides
+    managed.dl_tensor.byte_offset = offset * ary.itemsize
+    managed.deleter = _dl_deleter
+
+    ptr = ctypes.addressof(managed)
+    _exported[ptr] = (managed, shape, dl_strides, base)
+    return _pythonapi.PyCapsule_New(ptr, _DLTENSOR, _capsule_destructor)
+
+
+def from_dlpack(obj):
+    """
+    Returns a Bohrium array that uses the memory of 'obj' without copying it, when an engine of Bohrium runs
+    on the device of 'obj' and 'obj' is C-contiguous. Otherwise, the data is copied into a new Bohrium array.
+
+    Parameters
+    ----------
+    obj : object
+        An object that implements ``__dlpack__()`` or a "dltensor" capsule.
+
+    Returns
+    -------
+    out : ndarray
+        The Bohrium array, which keeps 'obj' alive.
+    """
+    if hasattr(obj, "__dlpack__"):
+        device_type = obj.__dlpack_device__()[0] if hasattr(obj, "__dlpack_device__") else DL_CPU
+        capsule = obj.__dlpack__(stream=1) if device_type == DL_CUDA else obj.__dlpack__()
+    else:
+        capsule = obj
+    ptr = _pythonapi.PyCapsule_GetPointer(capsule, _DLTENSOR)
+    _pythonapi.PyCapsule_SetName(capsule, _USED_DLTENSOR)
+    managed = ctypes.cast(ptr, ctypes.POINTER(_DLManagedTensor))
+    tensor = managed.contents.dl_tensor
+
+    def delete():
+        if managed.contents.deleter:
+            managed.contents.deleter(managed)
+
+    dtype = _dtype_from_code(tensor.dtype)
+    shape = tuple(tensor.shape[i] for i in range(tensor.ndim))
+    size = int(numpy.prod(shape))
+    strides = None if not tensor.strides else tuple(tensor.strides[i] for i in range(tensor.ndim))
+    contiguous = strides is None or \
+                 all(s == e for s, e, n in zip(strides, numpy.empty(shape, dtype=numpy.int8).strides, shape) if n > 1)
+
+    if tensor.device.device_type == DL_CPU:
+        # Host memory is simply copied, since Bohrium owns the host data of its bases
+        if strides is None:
+            extent, byte_strides = size, None
+        else:
+            extent = 0 if size == 0 else 1 + sum((n - 1) * s for n, s in zip(shape, strides))
+            byte_strides = tuple(s * dtype.itemsize for s in strides)
+        buffer = (ctypes.c_char * (max(extent, 1) * dtype.itemsize)).from_address(tensor.data + tensor.byte_offset)
+        src = numpy.ndarray(shape, dtype=dtype, buffer=buffer, strides=byte_strides)
+        ret = array_create.array(src)
+        delete()
+        return ret
+
+    if not contiguous or size == 0:
+        raise ValueError("only C-contiguous device tensors can be imported")
+    if tensor.device.device_type == DL_CUDA:
+        address = tensor.data + tensor.byte_offset
+    elif tensor.byte_offset == 0:
+        address = tensor.data
+    else:
+        raise ValueError("OpenCL tensors with a byte offset cannot be imported")
+
+    ret = array_create.empty(shape, dtype=dtype)
+    if not target.device_import(bhary.get_bhc(ret), address):
+        delete()
+        raise ValueError("no engine of Bohrium runs on the device of the tensor")
+    # The producer owns the memory, thus it must outlive the base
+    weakref.finalize(bhary.get_base(ret), delete)
+    return ret
+
+
+def cuda_array_interface(ary):
+    """
+    Returns the ``__cuda_array_interface__`` (version 2) of the Bohrium array 'ary', which e.g. CuPy and Numba use
+    in order to share the device memory without copying it.
+
+    Parameters
+    ----------
+    ary : array_like
+        The Bohrium array, which must run on the CUDA engine.
+
+    Returns
+    -------
+    out : dict
+        The interface, whose memory stays valid as long as the base of 'ary' is alive.
+    """
+    if not bhary.check(ary):
+        raise TypeError("must be a Bohrium array")
+    address, device_type, _ = target.device_export(bhary.get_bhc(bhary.get_base(ary)))
+    if device_type != DL_CUDA:
+        raise ValueError("the array isn't on a CUDA device")
+    offset, _ = _view_layout(ary)
+    return {
+        'shape': ary.shape,
+        'typestr': ary.dtype.str,
+        'data': (address + offset * ary.itemsize, False),
+        'strides': None if ary.flags['C_CONTIGUOUS'] else ary.strides,
+        'version': 2
+    }
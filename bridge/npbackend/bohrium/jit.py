@@ -0,0 +1,179 @@
+"""
+Function Tracing
+================
+
+The `jit` decorator traces a function once for each signature of its arguments, i.e. the shapes, strides, and
+data types of the arrays and the values of the other arguments. The trace records the Bohrium arrays the
+function creates and the operations it applies as a template, and the following calls with the same signature
+replay the template on the new arrays without running the Python code of the function again::
+
+    @bohrium.jit
+    def step(a, b):
+        return a * 2 + b[1:] - b[:-1]
+
+A function that reads the array data (e.g. `print(a)`, `if a.sum() > 0:`, or a NumPy fallback) or draws random
+numbers is called normally every time. The Python side effects of a traced function happen in the trace only,
+and the captured globals and closures are the values at the time of the trace like in other tracing JITs.
+"""
+import functools
+
+from . import bhary
+from . import target
+from ._util import is_scalar
+
+
+class _Template(object):
+    """The trace of a function and how to rebuild its return value"""
+
+    def __init__(self, tracer, outputs, structure):
+        self.tracer = tracer
+        # The slot of the Base of each returned array, or ("input", idx) when the array is an argument
+        self.outputs = outputs
+        # The shapes and data types of the returned arrays and whether the function returned a tuple
+        self.structure = structure
+
+
+def _signature(args, kwargs):
+    """
+    Returns the cache key of the arguments and the array arguments, or None when an argument is neither
+    a Bohrium array nor hashable
+    """
+    key = []
+    arrays = []
+    for arg in list(args) + [kwargs[k] for k in sorted(kwargs)]:
+        if bhary.check(arg):
+            # Aliasing between the arguments is part of the signature
+            same = next((i for i, a in enumerate(arrays) if a is arg), None)
+            base = bhary.get_base(arg)
+            shared = next((i for i, a in enumerate(arrays) if bhary.get_base(a) is base), None)
+            view = bhary.get_bhc(arg)
+            key.append(("A", arg.shape, arg.dtype.str, tuple(view.strides), view.start, view.base.size, same, shared))
+            arrays.append(arg)
+        elif is_scalar(arg) or arg is None or isinstance(arg, (str, tuple)):
+            key.append(("K", type(arg), arg))
+        else:
+            return None, None
+    key.append(tuple(sorted(kwargs)))
+    try:
+        hash(tuple(key))
+    except TypeError:
+        return None, None
+    return tuple(key), arrays
+
+
+def _bind(arrays):
+    """Returns the input objects of the arrays: the View and the Base of each array without duplicates"""
+    objs = []
+    seen = set()
+    for ary in arrays:
+        view = bhary.get_bhc(ary)
+        for obj in (view, view.base):
+            if id(obj) not in seen:
+                seen.add(id(obj))
+                objs.append(obj)
+    return objs
+
+
+def _trace(func, args, kwargs, arrays):
+    """Calls 'func' while tracing it and returns its return value and the template (None when untraceable)"""
+    tracer = target.Tracer()
+    inputs = _bind(arrays)
+    for obj in inputs:
+        tracer.bind(obj)
+
+    target.trace_begin(tracer)
+    try:
+        ret = func(*args, **kwargs)
+    finally:
+        target.trace_end()
+
+    if tracer.untraceable is not None:
+        return ret, None
+
+    is_tuple = isinstance(ret, tuple)
+    outputs = []
+    structure = []
+    for out in (ret if is_tuple else (ret,)):
+        if out is None:
+            outputs.append(None)
+            structure.append(None)
+            continue
+        if not bhary.check(out) or not bhary.is_base(out) or out.bhc_ary is None:
+            # Only new base arrays, the arguments, and None can be rebuilt
+            return ret, None
+        idx = next((i for i, a in enumerate(arrays) if a is out), None)
+        if idx is not None:
+            outputs.append(("input", idx))
+        else:
+            slot = tracer.slot(out.bhc_ary)
+            if slot is None or slot < tracer.ninputs:
+                return ret, None
+            outputs.append(slot)
+        structure.append((out.shape, out.dtype))
+
+    # The trace holds on to its objects by slot, the template only needs the steps
+    tracer.slots = None
+    tracer.objs = None
+    return ret, _Template(tracer, outputs, (is_tuple, structure))
+
+
+def _replay(template, arrays):
+    """Replays 'template' on 'arrays' and returns the rebuilt return value"""
+    objs = template.tracer.replay(_bind(arrays))
+    is_tuple, structure = template.structure
+    ret = []
+    for out, struct in zip(template.outputs, structure):
+        if out is None:
+            ret.append(None)
+        elif isinstance(out, tuple):
+            ret.append(arrays[out[1]])
+        else:
+            ret.append(bhary.new(struct[0], struct[1], objs[out]))
+    return tuple(ret) if is_tuple else ret[0]
+
+
+def jit(func=None, flush=False):
+    """
+    Decorator that traces `func` once per signature of its arguments and replays the trace on later calls,
+    which skips the Python dispatch of the operations in `func`.
+
+    Parameters
+    ----------
+    func : callable
+        The function to trace. Use `@jit(flush=True)` to give the options.
+    flush : bool
+        Flush the runtime at the end of each call, which makes every call the same flush and thus lets the
+        runtime reuse the fused blocks and the compiled kernels of the previous calls
+
+    Notes
+    -----
+    The traced function should only depend on its arguments; it is called normally when the trace
+    reads array data, draws random numbers, or returns anything else than new arrays, its arguments, or None.
+    """
+    if func is None:
+        return functools.partial(jit, flush=flush)
+
+    # The template of each signature, or None when the function is untraceable with the signature
+    templates = {}
+
+    @functools.wraps(func)
+    def inner(*args, **kwargs):
+        # Calls inside a trace are recorded in the outer trace, and other targets than bhc cannot trace
+        if not hasattr(target, "Tracer") or target.tracing():
+            return func(*args, **kwargs)
+
+        key, arrays = _signature(args, kwargs)
+        if key is None:
+            return func(*args, **kwargs)
+
+        if key in templates:
+            template = templates[key]
+            ret = func(*args, **kwargs) if template is None else _replay(template, arrays)
+        else:
+            ret, templates[key] = _trace(func, args, kwargs, arrays)
+
+        if flush:
+            target.runtime_flush()
+        return ret
+
+    return inner
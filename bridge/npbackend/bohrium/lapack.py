@@ -15,7 +15,8 @@ def __lapack(name, a, b):
 
 
 def gesv(a, b):
-    return __lapack("lapack_gesv", a.T.copy(order='C'), b)
+    # A 3-D 'a' is a stack of matrices, which LAPACK reads column-major one by one
+    return __lapack("lapack_gesv", a.swapaxes(-1, -2).copy(order='C'), b)
 
 
 def gbsv(a, b):
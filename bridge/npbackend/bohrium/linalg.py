@@ -135,10 +135,34 @@ def jacobi(a, b, tol=0.0005):
     return x
 
 
+# Matrix products of fewer multiply-adds than this are computed by the JIT-compiled contraction of `_contract()`
+# rather than by the BLAS extension method, which is a flush boundary to its neighbouring operations
+BLAS_MIN_WORK = 128 ** 3
+
+
+def _use_blas(a, b):
+    """Returns True when the product of the matrices `a` and `b` should be computed by BLAS"""
+    if a.ndim != 2 or b.ndim != 2:
+        return False
+    if a.dtype.kind not in np.typecodes["AllFloat"] or b.dtype.kind not in np.typecodes["AllFloat"]:
+        return False
+    return a.shape[0] * a.shape[1] * b.shape[1] >= BLAS_MIN_WORK
+
+
+def _contract(a, b):
+    """
+    Returns the matrix product of the (stacks of) matrices `a` and `b` as a multiplication and a sum over
+    the second-to-last axis. The sum is then the middle loop of the kernel and the inner loop runs along
+    the rows of `b` and of the result, which makes the kernel vectorizable and lets neighbouring elementwise
+    operations fuse with it.
+    """
+    return ufuncs.add.reduce(a[..., :, :, numpy.newaxis] * b[..., numpy.newaxis, :, :], -2)
+
+
 @fix_biclass_wrapper
 def matmul(a, b, no_blas=False):
     """
-    Matrix multiplication of two 2-D arrays.
+    Matrix multiplication of two 2-D arrays or of two stacks of matrices, which are broadcast together.
 
     Parameters
     ----------
@@ -171,22 +195,23 @@ def matmul(a, b, no_blas=False):
     if not dtype_equal(a, b):
         raise ValueError("Input must be of same type")
 
-    if a.ndim != 2 and b.ndim != 2:
-        raise ValueError("Input must be 2-D.")
+    if a.ndim < 2 or b.ndim < 2:
+        raise ValueError("Input must be at least 2-D.")
 
     if bhary.check(a) or bhary.check(b):
         a = array_create.array(a)
         b = array_create.array(b)
 
-    # If the dtypes are both float, we can use BLAS to calculate
-    # the dot-product, if BLAS is present.
-    if not no_blas and a.dtype.kind in np.typecodes["AllFloat"] and b.dtype.kind in np.typecodes["AllFloat"]:
+    if a.shape[-1] != b.shape[-2]:
+        raise ValueError("matmul: shape mismatch %s and %s" % (a.shape, b.shape))
+
+    if not no_blas and _use_blas(a, b):
         try:
             return blas.gemm(a, b)
         except:
             pass
 
-    return ufuncs.add.reduce(a[:, numpy.newaxis] * numpy.transpose(b), -1)
+    return _contract(a, b)
 
 
 @fix_biclass_wrapper
@@ -263,14 +288,13 @@ def dot(a, b, no_blas=False):
     if a.ndim == 1:
         return ufuncs.add.reduce(a * numpy.transpose(b), -1)
 
-    if not no_blas and a.ndim == 2 and b.ndim == 2:
-        # If the dtypes are both float, we can use BLAS to calculate
-        # the dot-product, if BLAS is present.
-        if a.dtype.kind in np.typecodes["AllFloat"] and b.dtype.kind in np.typecodes["AllFloat"]:
+    if a.ndim == 2 and b.ndim == 2:
+        if not no_blas and _use_blas(a, b):
             try:
                 return blas.gemm(a, b)
             except:
                 pass
+        return _contract(a, b)
 
     return ufuncs.add.reduce(a[:, numpy.newaxis] * numpy.transpose(b), -1)
 
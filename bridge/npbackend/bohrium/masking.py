@@ -129,14 +129,28 @@ def where(condition, x=None, y=None):
         else:
             return res.astype(out_type)
 
-    # General case: use fancy indexing
+    # General case: a conditional scatter of 'x' into a copy of 'y' through the indexes of a range, which
+    # never materializes the indexes of 'condition.nonzero()' and the JIT-backends fuse into a single kernel
     (condition, x, y), newshape = array_manipulation.broadcast_arrays(condition, x, y)
-    ret = array_create.zeros(newshape, dtype=out_type)
-    ret[condition] = x if numpy.isscalar(x) else x[condition]
-    ret[~condition] = y if numpy.isscalar(y) else y[~condition]
+    ret = array_create.empty(newshape, dtype=out_type)
+    if ret.size == 0:
+        return ret
+    ret[...] = y
+    reorganization.cond_scatter(ret, array_create.simply_range(ret.size), _broadcast_to(x, newshape, out_type),
+                                _broadcast_to(condition, newshape, numpy.bool))
     return ret
 
 
+def _broadcast_to(ary, shape, dtype):
+    """Return 'ary' as an array of 'shape', which is a new array when 'ary' is a scalar"""
+
+    if numpy.isscalar(ary):
+        ret = array_create.empty(shape, dtype=dtype)
+        ret[...] = ary
+        return ret
+    return ary
+
+
 def masked_get(ary, bool_mask):
     """
     Get the elements of 'ary' specified by 'bool_mask'.
@@ -153,5 +167,9 @@ def masked_set(ary, bool_mask, value):
     if numpy.isscalar(value) and ufuncs.isfinite(value):
         ary *= ~bool_mask
         ary += bool_mask * value
+    elif numpy.isscalar(value) and ary.size > 0:
+        # A conditional scatter through the indexes of a range, like `where()`, which also handles NaN and infinity
+        reorganization.cond_scatter(ary, array_create.simply_range(ary.size),
+                                    _broadcast_to(value, ary.shape, ary.dtype), bool_mask)
     else:
         ary[reorganization.nonzero(bool_mask)] = value
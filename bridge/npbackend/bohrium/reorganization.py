@@ -423,6 +423,41 @@ def cond_scatter(ary, indexes, values, mask):
     ary[...] = flat.reshape(ary.shape)
 
 
+@fix_biclass_wrapper
+def add_scatter(ary, indexes, values):
+    """
+    add_scatter(ary, indexes, values)
+
+    Add 'values' to the elements of 'ary' selected by 'indexes', where repeated indexes accumulate.
+    The values of 'indexes' are absolute indexed into a flatten 'ary'
+    The shape of 'indexes' and 'value' must be equal, or 'value' is a scalar.
+
+    Parameters
+    ----------
+    ary  : array_like
+        The target array to add the values to.
+    indexes : array_like, interpreted as integers
+        Array or list of indexes of the elements in 'ary' to add to
+    values : array_like or scalar
+        Values to add to 'ary'
+    """
+
+    ary = array_create.array(ary)
+    indexes = array_manipulation.flatten(array_create.array(indexes, dtype=numpy.uint64), always_copy=False)
+    if is_scalar(values):
+        values = ary.dtype.type(values)
+    else:
+        values = array_manipulation.flatten(array_create.array(values, dtype=ary.dtype), always_copy=False)
+        assert indexes.shape == values.shape
+    if ary.size == 0 or indexes.size == 0:
+        return
+
+    # In order to ensure a contiguous array, we do the add-scatter on a flatten copy
+    flat = array_manipulation.flatten(ary, always_copy=True)
+    target.add_scatter(get_bhc(flat), values if is_scalar(values) else get_bhc(values), get_bhc(indexes))
+    ary[...] = flat.reshape(ary.shape)
+
+
 @fix_biclass_wrapper
 def pack(ary, mask):
     """
@@ -571,3 +606,298 @@ def nonzero(a):
         ret.append(tmp)
         nz -= tmp * stride
     return ret
+
+
+def _sort_extmethod(name, a, axis, dtype, kth=None):
+    """
+    Applies the sort extension method 'name' ("sort", "argsort", or "partition") along 'axis' of 'a'
+    (the flattened 'a' when None) and returns the result of 'dtype'. Returns None when Bohrium cannot handle it,
+    in which case the caller falls back to NumPy.
+    """
+    if not bhary.check(a) or numpy.iscomplexobj(a) or a.dtype.kind not in "biuf" or a.dtype.itemsize == 2 and \
+            a.dtype.kind == "f":
+        return None
+    if axis is None:
+        a = array_manipulation.flatten(a, always_copy=False)
+        axis = 0
+    elif axis < 0:
+        axis += a.ndim
+    if a.ndim == 0:
+        return None
+
+    # The extension method sorts the rows of a 2-D array thus the axis is moved last
+    moved = a if axis == a.ndim - 1 else a.swapaxes(axis, -1)
+    rows = array_manipulation.reshape(moved, (-1, moved.shape[-1]))
+    out = array_create.empty(rows.shape, dtype=dtype)
+    if out.size == 0:
+        return out.reshape(moved.shape)
+    if kth is None:
+        extra = rows
+    else:
+        extra = array_create.array([kth], dtype=numpy.int64)
+    try:
+        ufuncs.extmethod(name, out, rows, extra)
+    except NotImplementedError:
+        return None
+    out = out.reshape(moved.shape)
+    return out if axis == a.ndim - 1 else out.swapaxes(axis, -1)
+
+
+@fix_biclass_wrapper
+def sort(a, axis=-1, kind=None, order=None):
+    """
+    Return a sorted copy of an array.
+
+    Bohrium sorts the arrays of booleans, integers, float32, and float64 without copying them to NumPy,
+    using a parallel radix sort of the elements along `axis`. NaN goes last like in NumPy.
+
+    Parameters
+    ----------
+    a : array_like
+        Array to be sorted.
+    axis : int or None, optional
+        Axis along which to sort. If None, the array is flattened before
+        sorting. The default is -1, which sorts along the last axis.
+    kind : {'quicksort', 'mergesort', 'heapsort', 'stable'}, optional
+        Ignored by Bohrium, which always sorts stable.
+    order : str or list of str, optional
+        Not supported by Bohrium, which falls back to NumPy.
+
+    Returns
+    -------
+    sorted_array : ndarray
+        Array of the same type and shape as `a`.
+
+    See Also
+    --------
+    argsort : Indirect sort.
+    partition : Partial sort.
+
+    Examples
+    --------
+    >>> a = np.array([[1,4],[3,1]])
+    >>> np.sort(a)                # sort along the last axis
+    array([[1, 4],
+           [1, 3]])
+    >>> np.sort(a, axis=None)     # sort the flattened array
+    array([1, 1, 3, 4])
+    """
+    ret = None if order is not None else _sort_extmethod("sort", a, axis, a.dtype)
+    if ret is None:
+        if bhary.check(a):
+            a = a.copy2numpy()
+        return numpy.sort(a, axis=axis, kind=kind, order=order)
+    return ret
+
+
+@fix_biclass_wrapper
+def argsort(a, axis=-1, kind=None, order=None):
+    """
+    Returns the indices that would sort an array.
+
+    Bohrium sorts the arrays of booleans, integers, float32, and float64 without copying them to NumPy,
+    using a parallel radix sort of the elements along `axis`. The sort is stable thus equal elements
+    keep their order, and NaN goes last like in NumPy.
+
+    Parameters
+    ----------
+    a : array_like
+        Array to sort.
+    axis : int or None, optional
+        Axis along which to sort.  The default is -1 (the last axis). If None,
+        the flattened array is used.
+    kind : {'quicksort', 'mergesort', 'heapsort', 'stable'}, optional
+        Ignored by Bohrium, which always sorts stable.
+    order : str or list of str, optional
+        Not supported by Bohrium, which falls back to NumPy.
+
+    Returns
+    -------
+    index_array : ndarray, int64
+        Array of indices that sort `a` along the specified axis.
+
+    See Also
+    --------
+    sort : Describes sorting algorithms used.
+
+    Examples
+    --------
+    >>> x = np.array([3, 1, 2])
+    >>> np.argsort(x)
+    array([1, 2, 0])
+    """
+    ret = None if order is not None else _sort_extmethod("argsort", a, axis, numpy.int64)
+    if ret is None:
+        if bhary.check(a):
+            a = a.copy2numpy()
+        return numpy.argsort(a, axis=axis, kind=kind, order=order)
+    return ret
+
+
+@fix_biclass_wrapper
+def partition(a, kth, axis=-1, kind='introselect', order=None):
+    """
+    Return a partitioned copy of an array.
+
+    Creates a copy of the array with its elements rearranged in such a way that
+    the value of the element in k-th position is in the position it would be in
+    a sorted array. All elements smaller than the k-th element are moved before
+    this element and all equal or greater are moved behind it. The ordering of
+    the elements in the two partitions is undefined.
+
+    Bohrium partitions the arrays of booleans, integers, float32, and float64 along `axis` without
+    copying them to NumPy, where the rows are partitioned in parallel.
+
+    Parameters
+    ----------
+    a : array_like
+        Array to be sorted.
+    kth : int
+        Element index to partition by. A sequence of k-th elements is not supported by Bohrium,
+        which falls back to NumPy.
+    axis : int or None, optional
+        Axis along which to sort. If None, the array is flattened before
+        sorting. The default is -1, which sorts along the last axis.
+    kind : {'introselect'}, optional
+        Selection algorithm. Default is 'introselect'.
+    order : str or list of str, optional
+        Not supported by Bohrium, which falls back to NumPy.
+
+    Returns
+    -------
+    partitioned_array : ndarray
+        Array of the same type and shape as `a`.
+
+    Examples
+    --------
+    >>> a = np.array([3, 4, 2, 1])
+    >>> np.partition(a, 3)
+    array([2, 1, 3, 4])
+    """
+    ret = None
+    if order is None and isinstance(kth, (int, numpy.integer)) and bhary.check(a):
+        size = a.size if axis is None else a.shape[axis]
+        if kth < 0:
+            kth += size
+        if not 0 <= kth < size:
+            raise ValueError("kth(=%d) out of bounds (%d)" % (kth, size))
+        ret = _sort_extmethod("partition", a, axis, a.dtype, kth)
+    if ret is None:
+        if bhary.check(a):
+            a = a.copy2numpy()
+        return numpy.partition(a, kth, axis=axis, kind=kind, order=order)
+    return ret
+
+
+def _bitpack_extmethod(name, a, axis, n, dtype):
+    """
+    Applies the bit-packing extension method 'name' ("packbits" or "unpackbits") along 'axis' of 'a'
+    (the flattened 'a' when None), where the result has 'n' elements along the axis and is of 'dtype'.
+    Returns None when Bohrium cannot handle it, in which case the caller falls back to NumPy.
+    """
+    if axis is None:
+        a = array_manipulation.flatten(a, always_copy=False)
+        axis = 0
+    elif axis < 0:
+        axis += a.ndim
+    if a.ndim == 0 or not 0 <= axis < a.ndim:
+        return None
+
+    # The extension method packs the rows of a 2-D array thus the axis is moved last
+    moved = a if axis == a.ndim - 1 else a.swapaxes(axis, -1)
+    rows = array_manipulation.reshape(moved, (-1, moved.shape[-1]))
+    out = array_create.empty((rows.shape[0], n), dtype=dtype)
+    if out.size > 0 and rows.size > 0:
+        try:
+            ufuncs.extmethod(name, out, rows, rows)
+        except NotImplementedError:
+            return None
+    out = out.reshape(moved.shape[:-1] + (n,))
+    return out if axis == a.ndim - 1 else out.swapaxes(axis, -1)
+
+
+@fix_biclass_wrapper
+def packbits(a, axis=None, bitorder='big'):
+    """
+    Packs the elements of a binary-valued array into bits in a uint8 array.
+
+    Bohrium packs the array without copying it to NumPy, eight booleans into each byte. The bitwise
+    ufuncs of the packed bytes (e.g. `bitwise_and`) are the logical ufuncs of eight booleans at a time,
+    thus a large mask can be kept packed in an eighth of the memory.
+
+    Parameters
+    ----------
+    a : array_like
+        An array of booleans or integers whose nonzero elements are True.
+    axis : int, optional
+        The dimension over which bit-packing is done. ``None`` implies packing the flattened array.
+    bitorder : {'big', 'little'}, optional
+        The order of the bits of a byte, Bohrium packs 'big' and falls back to NumPy with 'little'.
+
+    Returns
+    -------
+    packed : ndarray
+        Array of type uint8 whose elements represent bits corresponding to the logical (0 or nonzero)
+        value of the input elements, where the missing bits of the last byte are zero.
+
+    Examples
+    --------
+    >>> np.packbits(np.array([1, 0, 1, 1, 0, 0, 0, 1, 1], dtype=bool))
+    array([177, 128], dtype=uint8)
+    """
+    ret = None
+    if bitorder == 'big' and bhary.check(a):
+        if a.dtype != numpy.bool_:
+            a = a != 0
+        n = a.size if axis is None else a.shape[axis]
+        ret = _bitpack_extmethod("packbits", a, axis, (n + 7) // 8, numpy.uint8)
+    if ret is None:
+        if bhary.check(a):
+            a = a.copy2numpy()
+        return numpy.packbits(a, axis=axis, bitorder=bitorder)
+    return ret
+
+
+@fix_biclass_wrapper
+def unpackbits(a, axis=None, count=None, bitorder='big'):
+    """
+    Unpacks the elements of a uint8 array into a binary-valued output array, the inverse of `packbits`.
+
+    Bohrium unpacks the array without copying it to NumPy. The result is uint8 like in NumPy, thus use
+    ``astype(bool)`` to get the mask back.
+
+    Parameters
+    ----------
+    a : ndarray, uint8 type
+       Input array.
+    axis : int, optional
+        The dimension over which bit-unpacking is done. ``None`` implies unpacking the flattened array.
+    count : int or None, optional
+        The number of elements to unpack along `axis` (all of them by default). Bohrium falls back to
+        NumPy with a negative `count` or more elements than the bits of the input.
+    bitorder : {'big', 'little'}, optional
+        The order of the bits of a byte, Bohrium unpacks 'big' and falls back to NumPy with 'little'.
+
+    Returns
+    -------
+    unpacked : ndarray, uint8 type
+        The elements are either 0 or 1.
+
+    Examples
+    --------
+    >>> np.unpackbits(np.array([177, 128], dtype=np.uint8), count=9)
+    array([1, 0, 1, 1, 0, 0, 0, 1, 1], dtype=uint8)
+    """
+    ret = None
+    if bitorder == 'big' and bhary.check(a) and a.dtype == numpy.uint8:
+        nbytes = a.size if axis is None else a.shape[axis]
+        n = 8 * nbytes if count is None else count
+        if 0 < n and (n + 7) // 8 == nbytes:
+            ret = _bitpack_extmethod("unpackbits", a, axis, n, numpy.bool_)
+            if ret is not None:
+                ret = ret.astype(numpy.uint8)
+    if ret is None:
+        if bhary.check(a):
+            a = a.copy2numpy()
+        return numpy.unpackbits(a, axis=axis, count=count, bitorder=bitorder)
+    return ret
@@ -86,3 +86,25 @@ def convolve1d(a, v, mode='full'):
         filter = v[::-1]
     d = int((filter.size - 1) / 2)
     return _correlate_and_convolve_body(vector, filter, d, mode)
+
+
+def correlate2d(a, w):
+    """The 'valid' correlation of the 2-D `a` with the weights `w`, which is expanded into instructions that the
+    engines fuse into one loop nest with the element-wise operations around it"""
+    assert a.ndim == 2
+    assert w.ndim == 2
+
+    dtype = numpy.result_type(a, w)
+    a = array_create.array(a, dtype=dtype)
+    w = array_create.array(w, dtype=dtype)
+    if a.shape[0] < w.shape[0] or a.shape[1] < w.shape[1]:
+        raise ValueError("correlate2d: the weights are larger than the input")
+
+    out = array_create.empty((a.shape[0] - w.shape[0] + 1, a.shape[1] - w.shape[1] + 1), dtype=dtype)
+    ufuncs.extmethod("stencil_correlate", out, a, w)
+    return out
+
+
+def convolve2d(a, w):
+    """The 'valid' convolution of the 2-D `a` with the weights `w`, see correlate2d()"""
+    return correlate2d(a, w[::-1, ::-1])
@@ -0,0 +1,135 @@
+"""
+Sparse Matrices
+~~~~~~~~~~~~~~~
+
+Sparse matrices whose structure is Bohrium arrays, thus the products stay within Bohrium.
+The matrix-vector product gathers `x` at the columns of the nonzeros, multiplies by the values, and
+adds the products into their rows with one add-scatter, which is a fused JIT kernel on every backend
+like the elementwise operations on the result.
+"""
+import numpy_force as numpy
+from . import array_create
+from . import bhary
+from . import reorganization
+from . import ufuncs
+
+
+class csr_matrix(object):
+    """
+    csr_matrix((data, indices, indptr), shape)
+
+    A sparse matrix in the compressed sparse row (CSR) format, where row `i` holds the nonzeros
+    `data[indptr[i]:indptr[i+1]]` in the columns `indices[indptr[i]:indptr[i+1]]`.
+
+    Parameters
+    ----------
+    arg : tuple of array_like
+        The CSR arrays `(data, indices, indptr)`.
+    shape : tuple of two ints
+        The shape of the matrix.
+    dtype : data-type, optional
+        The type of the values, the type of `data` by default.
+    """
+
+    def __init__(self, arg, shape, dtype=None):
+        (data, indices, indptr) = arg
+        self.shape = (int(shape[0]), int(shape[1]))
+        self.data = array_create.array(data, dtype=dtype, bohrium=True).flatten()
+        self.indices = array_create.array(indices, dtype=numpy.uint64, bohrium=True).flatten()
+        self.indptr = array_create.array(indptr, dtype=numpy.uint64, bohrium=True).flatten()
+        if self.data.shape != self.indices.shape or self.indptr.size != self.shape[0] + 1:
+            raise ValueError("'data' and 'indices' must have the same length and 'indptr' must have "
+                             "'shape[0] + 1' elements")
+        self._row = None
+
+    @property
+    def dtype(self):
+        return self.data.dtype
+
+    @property
+    def nnz(self):
+        return self.data.size
+
+    def row_indices(self):
+        """The row of each nonzero, i.e. the rows of the COO format"""
+
+        if self._row is None:
+            # A one at the start of each row but the first, thus the running sum is the row
+            starts = array_create.zeros(self.nnz + 1, dtype=numpy.uint64, bohrium=True)
+            if self.shape[0] > 1 and self.nnz > 0:
+                reorganization.add_scatter(starts, self.indptr[1:-1], 1)
+            self._row = ufuncs.add.accumulate(starts[:-1])
+        return self._row
+
+    def tocoo(self):
+        """The COO arrays `(data, (row, col))` of the nonzeros"""
+
+        return (self.data, (self.row_indices(), self.indices))
+
+    def dot(self, other):
+        """
+        The product of the matrix and the dense vector or matrix `other`,
+        which has `shape[1]` elements or rows.
+        """
+
+        x = array_create.array(other, bohrium=True)
+        if x.ndim not in (1, 2) or x.shape[0] != self.shape[1]:
+            raise ValueError("shapes %s and %s not aligned" % (self.shape, x.shape))
+        dtype = numpy.result_type(self.dtype, x.dtype)
+        out_shape = (self.shape[0],) + x.shape[1:]
+        ret = array_create.zeros(out_shape, dtype=dtype, bohrium=True)
+        if self.nnz == 0 or x.size == 0:
+            return ret
+
+        rows = self.row_indices()
+        if x.ndim == 1:
+            # ret[row[k]] += data[k] * x[indices[k]]
+            prod = reorganization.gather(x, self.indices) * self.data
+            reorganization.add_scatter(ret, rows, prod)
+        else:
+            # The flat indexes of the columns of the rows `indices` of `x` and `rows` of `ret`
+            k = x.shape[1]
+            columns = array_create.arange(k, dtype=numpy.uint64, bohrium=True)
+            src = self.indices[:, None] * numpy.uint64(k) + columns
+            dst = rows[:, None] * numpy.uint64(k) + columns
+            prod = reorganization.gather(x, src) * self.data[:, None]
+            reorganization.add_scatter(ret, dst, prod)
+        return ret
+
+    def __matmul__(self, other):
+        return self.dot(other)
+
+    def __mul__(self, other):
+        return self.dot(other)
+
+    def toarray(self):
+        """The dense matrix"""
+
+        ret = array_create.zeros(self.shape, dtype=self.dtype, bohrium=True)
+        if self.nnz > 0:
+            reorganization.add_scatter(ret, self.row_indices() * numpy.uint64(self.shape[1]) + self.indices,
+                                       self.data)
+        return ret
+
+
+def coo_matrix(arg, shape, dtype=None):
+    """
+    coo_matrix((data, (row, col)), shape)
+
+    The CSR matrix of the nonzeros `data` at `(row, col)`, which must be sorted by row.
+    """
+
+    (data, (row, col)) = arg
+    row = array_create.array(row, dtype=numpy.uint64, bohrium=True).flatten()
+    counts = array_create.zeros(int(shape[0]) + 1, dtype=numpy.uint64, bohrium=True)
+    if row.size > 0:
+        reorganization.add_scatter(counts[1:], row, 1)
+    ret = csr_matrix((data, col, ufuncs.add.accumulate(counts)), shape, dtype=dtype)
+    ret._row = row
+    return ret
+
+
+def issparse(x):
+    """Returns True when `x` is a Bohrium sparse matrix"""
+
+    return isinstance(x, csr_matrix)
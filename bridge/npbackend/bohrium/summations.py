@@ -345,6 +345,40 @@ def all(a, axis=None, out=None, keepdims=None):
         return ufuncs.logical_and.reduce(a.astype(bool), axis=axis, out=out)
 
 
+def _arg_reduce(a, axis, extreme):
+    """
+    Return the indices of the first occurrences of the 'extreme' (the maximum or minimum ufunc) values of 'a'
+    along 'axis' (the flattened 'a' when None).
+
+    The indices are two parallel reductions instead of a serial scan: the extreme values and then the minimum of
+    a key per element, which is the index of the element offset by 'size' times its rank. The rank is 0 for NaN
+    (like NumPy, the first NaN wins), 1 for the extreme values, and 2 for the rest. Thus, ties go to the
+    first occurrence no matter how the reductions are split between the threads.
+    """
+    if axis is None:
+        a = array_manipulation.flatten(a, always_copy=False)
+        axis = 0
+    elif axis < 0:
+        axis += a.ndim
+    size = a.shape[axis]
+    if size == 0:
+        raise ValueError("attempt to get argmax or argmin of an empty sequence")
+
+    # The extreme values and the indices along 'axis', which both broadcast against 'a'
+    values = extreme.reduce(a, axis=axis)
+    if a.ndim > 1:
+        values = array_manipulation.reshape(values, a.shape[:axis] + (1,) + a.shape[axis + 1:])
+    indices = array_create.arange(size, dtype=numpy.int64)
+    if axis + 1 < a.ndim:
+        indices = array_manipulation.reshape(indices, (size,) + (1,) * (a.ndim - axis - 1))
+
+    if numpy.issubdtype(a.dtype, numpy.floating):
+        rank = ufuncs.logical_not(ufuncs.isnan(a)) * (1 + (a != values))
+        return ufuncs.minimum.reduce(indices + size * rank, axis=axis) % size
+    else:
+        return ufuncs.minimum.reduce(indices + size * (a != values), axis=axis)
+
+
 @bhary.fix_biclass_wrapper
 def argmax(a, axis=None, out=None):
     """
@@ -396,11 +430,13 @@ def argmax(a, axis=None, out=None):
     if not bhary.check(a):
         return numpy.argmax(a, axis=axis, out=out)
 
-    if axis is None or (a.ndim == 1 and axis == 0):
+    if not numpy.iscomplexobj(a):
+        ret = _arg_reduce(a, axis, ufuncs.maximum)
+    elif axis is None or (a.ndim == 1 and axis == 0):
         a = array_manipulation.flatten(a, always_copy=False)
         ret = reorganization.flatnonzero(a == max(a))[0]
     else:
-        warnings.warn("Bohrium does not support the 'axis' argument, "
+        warnings.warn("Bohrium does not support the 'axis' argument of complex arrays, "
                       "it will be handled by the original NumPy.", UserWarning, 2)
         return numpy.argmax(a.copy2numpy(), axis=axis)
 
@@ -462,11 +498,13 @@ def argmin(a, axis=None, out=None):
     if not bhary.check(a):
         return numpy.argmin(a, axis=axis, out=out)
 
-    if axis is None or (a.ndim == 1 and axis == 0):
+    if not numpy.iscomplexobj(a):
+        ret = _arg_reduce(a, axis, ufuncs.minimum)
+    elif axis is None or (a.ndim == 1 and axis == 0):
         a = array_manipulation.flatten(a, always_copy=False)
         ret = reorganization.flatnonzero(a == min(a))[0]
     else:
-        warnings.warn("Bohrium does not support the 'axis' argument, "
+        warnings.warn("Bohrium does not support the 'axis' argument of complex arrays, "
                       "it will be handled by the original NumPy.", UserWarning, 2)
         return numpy.argmin(a.copy2numpy(), axis=axis)
 
@@ -475,3 +513,227 @@ def argmin(a, axis=None, out=None):
     else:
         out[...] = ret
         return out
+
+
+@bhary.fix_biclass_wrapper
+def bincount(x, weights=None, minlength=0):
+    """
+    Count number of occurrences of each value in array of non-negative ints.
+
+    The counts are one add-scatter into the bins, which fuses with the computation of `x`
+    and which each thread accumulates into its own copy of the bins.
+
+    Parameters
+    ----------
+    x : array_like, 1 dimension, nonnegative ints
+        Input array.
+    weights : array_like, optional
+        Weights, array of the same shape as `x`.
+    minlength : int, optional
+        A minimum number of bins for the output array.
+
+    Returns
+    -------
+    out : ndarray of ints
+        The result of binning the input array.
+        The length of `out` is equal to ``np.amax(x)+1``.
+
+    See Also
+    --------
+    histogram
+
+    Examples
+    --------
+    >>> np.bincount(np.arange(5))
+    array([1, 1, 1, 1, 1])
+    >>> np.bincount(np.array([0, 1, 1, 3, 2, 1, 7]))
+    array([1, 3, 1, 1, 0, 0, 0, 1])
+    """
+
+    if not bhary.check(x) and not bhary.check(weights):
+        return numpy.bincount(x, weights=weights, minlength=minlength)
+
+    x = array_manipulation.flatten(array_create.array(x), always_copy=False)
+    if x.dtype.kind not in "biu":
+        raise TypeError("Cannot cast array data from %s to int64" % x.dtype)
+
+    size = minlength
+    if x.size > 0:
+        if int(ufuncs.minimum.reduce(x)) < 0:
+            raise ValueError("The first argument of bincount must be non-negative")
+        largest = int(ufuncs.maximum.reduce(x)) + 1
+        if largest > size:
+            size = largest
+
+    if weights is None:
+        ret = array_create.zeros(size, dtype=numpy.int64)
+        reorganization.add_scatter(ret, x, 1)
+    else:
+        weights = array_manipulation.flatten(array_create.array(weights, dtype=numpy.float64), always_copy=False)
+        if weights.shape != x.shape:
+            raise ValueError("The weights and list don't have the same length.")
+        ret = array_create.zeros(size, dtype=numpy.float64)
+        reorganization.add_scatter(ret, x, weights)
+    return ret
+
+
+@bhary.fix_biclass_wrapper
+def histogram(a, bins=10, range=None, weights=None, density=None):
+    """
+    Compute the histogram of a set of data.
+
+    Bohrium computes the histogram of equal-width bins, which is the bin index of each element
+    and an add-scatter into the bins in one kernel. Explicit bin edges are handled by the original NumPy.
+
+    Parameters
+    ----------
+    a : array_like
+        Input data. The histogram is computed over the flattened array.
+    bins : int, optional
+        The number of equal-width bins in the given range (10, by default).
+    range : (float, float), optional
+        The lower and upper range of the bins. If not provided, range
+        is simply ``(a.min(), a.max())``. Values outside the range are
+        ignored.
+    weights : array_like, optional
+        An array of weights, of the same shape as `a`.
+    density : bool, optional
+        If True, the result is the value of the probability density function at the bin.
+
+    Returns
+    -------
+    hist : array
+        The values of the histogram.
+    bin_edges : array of dtype float
+        Return the bin edges ``(length(hist)+1)``.
+
+    See Also
+    --------
+    bincount
+
+    Examples
+    --------
+    >>> np.histogram(np.array([1, 2, 1]), bins=3, range=(0, 3))
+    (array([0, 2, 1]), array([ 0.,  1.,  2.,  3.]))
+    """
+
+    if not bhary.check(a) or not isinstance(bins, int):
+        if bhary.check(a):
+            warnings.warn("Bohrium only supports an integer 'bins' argument, "
+                          "it will be handled by the original NumPy.", UserWarning, 2)
+            a = a.copy2numpy()
+        if bhary.check(weights):
+            weights = weights.copy2numpy()
+        return numpy.histogram(a, bins=bins, range=range, weights=weights, density=density)
+    if bins < 1:
+        raise ValueError("`bins` must be positive, when an integer")
+
+    a = array_manipulation.flatten(a, always_copy=False)
+    if range is not None:
+        first, last = float(range[0]), float(range[1])
+    elif a.size > 0:
+        first, last = float(ufuncs.minimum.reduce(a)), float(ufuncs.maximum.reduce(a))
+    else:
+        first, last = 0.0, 1.0
+    if first > last:
+        raise ValueError("max must be larger than min in range parameter.")
+    if first == last:
+        first, last = first - 0.5, last + 0.5
+    bin_edges = array_create.linspace(first, last, bins + 1)
+
+    # The bin of each element where the elements outside of the range (and NaN) go to the extra bin 'bins'.
+    # NB: the integer bin of an outside element is undefined, which is why it is multiplied by zero
+    inside = ufuncs.logical_and(a >= first, a <= last)
+    idx = ufuncs.floor((a - first) * (bins / (last - first))).astype(numpy.int64)
+    idx = ufuncs.minimum(idx, bins - 1) * inside + bins * ufuncs.logical_not(inside)
+
+    if weights is None:
+        hist = array_create.zeros(bins + 1, dtype=numpy.int64)
+        reorganization.add_scatter(hist, idx, 1)
+    else:
+        weights = array_manipulation.flatten(array_create.array(weights), always_copy=False)
+        if weights.shape != a.shape:
+            raise ValueError("weights should have the same shape as a.")
+        hist = array_create.zeros(bins + 1, dtype=numpy.int64 if weights.dtype.kind == "b" else weights.dtype)
+        reorganization.add_scatter(hist, idx, weights)
+    hist = hist[:bins]
+
+    if density:
+        hist = hist / (float(ufuncs.add.reduce(hist)) * ((last - first) / bins))
+    return hist, bin_edges
+
+
+_window_ufuncs = {"sum": ufuncs.add, "min": ufuncs.minimum, "max": ufuncs.maximum, "mean": ufuncs.add}
+
+
+@bhary.fix_biclass_wrapper
+def window_reduce(a, window, method="sum", axis=-1):
+    """
+    Reduce each window of `window` consecutive elements along an axis.
+
+    Bohrium computes the windows of the integer, float32, and float64 arrays with a running sum
+    or a monotonic deque thus each element costs O(1) rather than the O(`window`) of the sum of
+    the shifted views, which is the fallback of other arrays.
+
+    Parameters
+    ----------
+    a : array_like
+        Input data.
+    window : int
+        The number of elements of each window, ``1 <= window <= a.shape[axis]``.
+    method : {'sum', 'min', 'max', 'mean'}, optional
+        The reduction of each window ('sum', by default). A window that contains NaN is NaN.
+    axis : int, optional
+        The axis to slide along (the last axis, by default).
+
+    Returns
+    -------
+    out : ndarray
+        The shape of `a` except for ``a.shape[axis] - window + 1`` elements along `axis`, where
+        element ``i`` is the reduction of the elements ``[i, i + window)``. The mean of an integer
+        array is float64.
+
+    Examples
+    --------
+    >>> np.window_reduce(np.arange(6), 3)
+    array([ 3,  6,  9, 12])
+    >>> np.window_reduce(np.array([3, 1, 4, 1, 5]), 2, method="max")
+    array([3, 4, 4, 5])
+    """
+
+    if method not in _window_ufuncs:
+        raise ValueError("Unknown window method '%s'" % method)
+    a = array_create.array(a)
+    if a.ndim == 0:
+        raise ValueError("window_reduce requires an array of at least one dimension")
+    if axis < 0:
+        axis += a.ndim
+    if not 0 <= axis < a.ndim:
+        raise ValueError("axis(=%d) out of bounds" % axis)
+    n = a.shape[axis]
+    if not 1 <= window <= n:
+        raise ValueError("window(=%d) out of bounds (%d)" % (window, n))
+    if a.dtype.kind == "b" and method in ("sum", "mean") or a.dtype.kind in "iu" and method == "mean":
+        a = a.astype(numpy.float64 if method == "mean" else numpy.int64)
+
+    # The extension method slides along the rows of a 2-D array thus the axis is moved last
+    moved = a if axis == a.ndim - 1 else a.swapaxes(axis, -1)
+    rows = array_manipulation.reshape(moved, (-1, n))
+    out = None
+    if a.dtype.kind in "iu" or a.dtype.kind == "f" and a.dtype.itemsize in (4, 8):
+        out = array_create.empty((rows.shape[0], n - window + 1), dtype=a.dtype)
+        if out.size > 0:
+            try:
+                ufuncs.extmethod("window_%s" % method, out, rows, array_create.array([window], dtype=numpy.int64))
+            except NotImplementedError:
+                out = None
+    if out is None:
+        # The reduction of the shifted views
+        func = _window_ufuncs[method]
+        out = array_create.array(rows[:, :n - window + 1])
+        for i in range(1, window):
+            func(out, rows[:, i:n - window + 1 + i], out=out)
+        if method == "mean":
+            out /= window
+    out = out.reshape(moved.shape[:-1] + (n - window + 1,))
+    return out if axis == a.ndim - 1 else out.swapaxes(axis, -1)
@@ -102,6 +102,46 @@ def set_bhc_data_from_ary(self, ary):
     raise NotImplementedError()
 
 
+def map_file(ary, path, offset):
+    """
+    Use the data at 'offset' in the file 'path' as the data of the unallocated array 'ary'
+
+    .. note:: The file is mapped copy-on-write, thus writes to the array never reach the file.
+
+    :param Mixed ary: The array to map the file into.
+    :param str path: The file that holds the data.
+    :param int offset: The offset in bytes of the data in the file.
+    :returns: Whether the file was mapped, otherwise the data must be copied into the array
+    :rtype: bool
+    """
+    return False
+
+
+def device_export(ary):
+    """
+    Export the memory of the base of 'ary' to other frameworks without copying it
+
+    .. note:: The data stays owned by Bohrium, thus the base must outlive the users of the memory.
+
+    :param Mixed ary: The array to export.
+    :returns: The address (a device buffer or the host data), the DLPack device type, and the device id
+    :rtype: tuple
+    """
+    raise NotImplementedError()
+
+
+def device_import(ary, address):
+    """
+    Use the device memory 'address' of another framework as the data of the unallocated base of 'ary'
+
+    :param Mixed ary: The array that adopts the memory.
+    :param int address: The device buffer, which must stay alive as long as the base.
+    :returns: Whether the memory was imported, otherwise the data must be copied into the array
+    :rtype: bool
+    """
+    return False
+
+
 def ufunc(op, *args):
     """
     Perform the ufunc 'op' on the 'args' arrays
@@ -211,6 +251,19 @@ def cond_scatter(out, ary, indexes, mask):
     raise NotImplementedError()
 
 
+def add_scatter(out, ary, indexes):
+    """
+    Add elements from 'ary' to the elements of 'out' at locations specified by 'indexes',
+    where repeated indexes accumulate.
+    ary.shape == indexes.shape.
+
+    :param Mixed out: The array to add the results to.
+    :param Mixed ary: Input array or scalar.
+    :param Mixed indexes: Array of absolute indexes (uint64).
+    """
+    raise NotImplementedError()
+
+
 def message(msg):
     """ Send and receive a message through the component stack """
     raise NotImplementedError()
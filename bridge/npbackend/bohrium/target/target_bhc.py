@@ -52,6 +52,9 @@ class BhcAPI:
 
 bhc = BhcAPI()
 
+# The `Tracer` of the function that `bohrium.jit` is tracing, if any
+_tracer = None
+
 
 class Base(interface.Base):
     """ Base array handle """
@@ -61,6 +64,9 @@ class Base(interface.Base):
         if size == 0:
             return
 
+        if _tracer is not None:
+            _tracer.new_base(self, bhc_obj is not None)
+
         if bhc_obj is None:
             bhc_obj = bhc.call_single_dtype("new", self.dtype_name, size)
 
@@ -79,6 +85,9 @@ class View(interface.View):
         super(View, self).__init__(ndim, start, shape, strides, base)
         self.size = functools.reduce(operator.mul, shape, 1)
 
+        if _tracer is not None:
+            _tracer.new_view(self, ndim, start, shape, strides, base)
+
         if self.size == 0:
             return
         self.bhc_obj = bhc.call_single_dtype("view", self.dtype_name, base.bhc_obj, ndim, start, shape, strides)
@@ -92,6 +101,9 @@ class View(interface.View):
 def _bhc_exec(func, *args):
     """ Execute the 'func' with the bhc objects in 'args' """
 
+    if _tracer is not None:
+        _tracer.call(func, args)
+
     args = list(args)
     for i in range(len(args)):
         if isinstance(args[i], View):
@@ -102,6 +114,117 @@ def _bhc_exec(func, *args):
     return func(*args)
 
 
+class Tracer(object):
+    """
+    Records the Bases, Views, and bhc calls of a function traced by `bohrium.jit` as a template that `replay()`
+    executes again with other input arrays of the same shapes and data types. The objects are numbered slots:
+    the inputs, which `bind()` assigns before the trace, and the Bases and Views created while tracing.
+    Objects from outside the trace (e.g. a global array) are captured as they are.
+    """
+
+    def __init__(self):
+        # The slot of each object by id() and the objects themselves, which keeps the ids unique while tracing
+        self.slots = {}
+        self.objs = []
+        self.ninputs = 0
+        # The recorded steps: ("base", size, dtype), ("view", ndim, start, shape, strides, base), and
+        # ("call", func, args) where the objects are ("slot", idx) or ("const", obj) and the scalars ("value", val)
+        self.steps = []
+        # The reason why the function cannot be replayed, if any
+        self.untraceable = None
+
+    def _add(self, obj):
+        self.slots[id(obj)] = len(self.objs)
+        self.objs.append(obj)
+
+    def _ref(self, obj):
+        idx = self.slots.get(id(obj))
+        return ("const", obj) if idx is None else ("slot", idx)
+
+    def bind(self, obj):
+        """Assigns the next input slot to the Base or View 'obj'"""
+        assert not self.steps
+        if id(obj) not in self.slots:
+            self._add(obj)
+        self.ninputs = len(self.objs)
+        return self.slots[id(obj)]
+
+    def slot(self, obj):
+        """Returns the slot of 'obj' or None when 'obj' is from outside the trace"""
+        return self.slots.get(id(obj))
+
+    def fail(self, reason):
+        """Marks the trace unreplayable, e.g. because it reads array data or draws random numbers"""
+        if self.untraceable is None:
+            self.untraceable = reason
+
+    def new_base(self, base, adopted):
+        if adopted:
+            self.fail("adopts an existing bhc array")
+        self.steps.append(("base", base.size, base.dtype))
+        self._add(base)
+
+    def new_view(self, view, ndim, start, shape, strides, base):
+        self.steps.append(("view", ndim, start, tuple(shape), tuple(strides), self._ref(base)))
+        self._add(view)
+
+    def call(self, func, args):
+        refs = [self._ref(arg) if isinstance(arg, View) else ("value", arg) for arg in args]
+        self.steps.append(("call", func, refs))
+
+    def replay(self, inputs):
+        """
+        Executes the recorded steps with 'inputs' in the input slots and returns all the objects by slot.
+        The Bases and Views created by the replay are destroyed when the returned list is.
+        """
+        objs = list(inputs)
+        assert len(objs) == self.ninputs
+
+        def deref(ref):
+            return objs[ref[1]] if ref[0] == "slot" else ref[1]
+
+        for step in self.steps:
+            kind = step[0]
+            if kind == "call":
+                args = []
+                for ref in step[2]:
+                    if ref[0] == "value":
+                        args.append(ref[1])
+                    else:
+                        obj = deref(ref)
+                        if not hasattr(obj, "bhc_obj"):
+                            # Ignore zero-sized views like _bhc_exec()
+                            break
+                        args.append(obj.bhc_obj)
+                else:
+                    step[1](*args)
+            elif kind == "view":
+                objs.append(View(step[1], step[2], step[3], step[4], deref(step[5])))
+            else:
+                objs.append(Base(step[1], step[2]))
+        return objs
+
+
+def trace_begin(tracer):
+    """Makes 'tracer' record the following bhc calls"""
+    global _tracer
+    assert _tracer is None
+    _tracer = tracer
+
+
+def trace_end():
+    """Stops the recording and returns the tracer"""
+    global _tracer
+    ret = _tracer
+    _tracer = None
+    return ret
+
+
+def tracing():
+    """Returns True when a function is being traced"""
+    return _tracer is not None
+
+
 def runtime_flush():
     """ Flush the runtime system """
     bhc.flush()
@@ -113,6 +236,9 @@ def tally():
 
 def get_data_pointer(ary, allocate=False, nullify=False):
     """ Retrieves the data pointer from Bohrium Runtime. """
+    if _tracer is not None:
+        _tracer.fail("accesses the array data")
+
     if ary.size == 0 or ary.base.size == 0:
         return 0
 
@@ -140,6 +266,37 @@ def set_bhc_data_from_ary(self, ary):
     ctypes.memmove(ptr, ary.ctypes.data, ary.dtype.itemsize * ary.size)
 
 
+def map_file(ary, path, offset):
+    """ Maps the file copy-on-write as the data of the unallocated base of 'ary' """
+
+    if _tracer is not None:
+        _tracer.fail("accesses the array data")
+
+    return bool(bhc.call_single_dtype("data_map_file", dtype_name(ary), ary.bhc_obj, path, offset))
+
+
+def device_export(ary):
+    """ Exports the memory of the base of 'ary' as (address, DLPack device type, device id) """
+
+    if _tracer is not None:
+        _tracer.fail("accesses the array data")
+
+    return bhc.call_single_dtype("device_export", dtype_name(ary), ary.bhc_obj)
+
+
+def device_import(ary, address):
+    """ Adopts the device memory 'address' as the data of the unallocated base of 'ary' """
+
+    if _tracer is not None:
+        _tracer.fail("accesses the array data")
+
+    return bool(bhc.call_single_dtype("device_import", dtype_name(ary), ary.bhc_obj, address))
+
+
+# The bhc function of each signature of ufunc() seen so far
+_ufunc_funcs = {}
+
+
 def ufunc(op, *args, **kwd):
     """
     Apply the 'op' on args, which is the output followed by one or two inputs
@@ -156,34 +313,42 @@ def ufunc(op, *args, **kwd):
     if hasattr(op, "info"):
         op = op.info['name']
 
-    # The dtype of the scalar argument (if any) is the same as the array input
-    scalar_type = None
-    for arg in args[1:]:
-        if not numpy.isscalar(arg):
-            scalar_type = dtype_name(arg)
-            break
-
-    # All inputs are scalars
-    if scalar_type is None:
-        if len(args) == 1:
-            scalar_type = dtype_name(args[0])
-        else:
-            scalar_type = dtype_name(args[1])
-
-    fname = "%s" % op
+    # The data type of each argument and the type of each scalar, which together with 'op' selects the bhc function
+    key = [op]
     for arg, dtype in zip(args, dtypes):
         if numpy.isscalar(arg):
-            if dtype is None:
-                fname += "_K%s" % scalar_type
-            else:
-                fname += "_K%s" % dtype_name(dtype)
+            key.append((type(arg), None if dtype is None else dtype_name(dtype)))
         else:
-            if dtype is None:
-                fname += "_A%s" % dtype_name(arg)
+            key.append((None, dtype_name(arg if dtype is None else dtype)))
+    key = tuple(key)
+
+    try:
+        func = _ufunc_funcs[key]
+    except KeyError:
+        # The dtype of the scalar argument (if any) is the same as the array input
+        scalar_type = None
+        for arg in args[1:]:
+            if not numpy.isscalar(arg):
+                scalar_type = dtype_name(arg)
+                break
+
+        # All inputs are scalars
+        if scalar_type is None:
+            if len(args) == 1:
+                scalar_type = dtype_name(args[0])
             else:
-                fname += "_A%s" % dtype_name(dtype)
+                scalar_type = dtype_name(args[1])
 
-    _bhc_exec(getattr(bhc, fname), *args)
+        fname = "%s" % op
+        for scalar_cls, dtype in key[1:]:
+            if scalar_cls is not None:
+                fname += "_K%s" % (scalar_type if dtype is None else dtype)
+            else:
+                fname += "_A%s" % dtype
+        func = getattr(bhc, fname)
+        _ufunc_funcs[key] = func
+
+    _bhc_exec(func, *args)
 
 
 def reduce(op, out, ary, axis):
@@ -265,6 +430,10 @@ def random123(size, start_index, key):
     The dtype is uint64 always.
     """
 
+    if _tracer is not None:
+        # A replay would draw the same numbers again
+        _tracer.fail("draws random numbers")
+
     dtype = numpy.dtype("uint64")
 
     # Create new array
@@ -317,6 +486,20 @@ def cond_scatter(out, ary, indexes, mask):
     ufunc("cond_scatter", out, ary, indexes, mask)
 
 
+def add_scatter(out, ary, indexes):
+    """
+    Add elements from 'ary' to the elements of 'out' at locations specified by 'indexes',
+    where repeated indexes accumulate.
+    ary.shape == indexes.shape.
+
+    :param Mixed out: The array to add the results to.
+    :param Mixed ary: Input array or scalar.
+    :param Mixed indexes: Array of absolute indexes (uint64).
+    """
+
+    ufunc("add_scatter", out, ary, indexes, dtypes=[None, out.dtype, None])
+
+
 def message(msg):
     """ Send and receive a message through the component stack """
     return "%s" % (bhc.message(msg))
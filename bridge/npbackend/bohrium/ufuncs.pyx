@@ -20,8 +20,9 @@ from .array_manipulation import broadcast_arrays, flatten
 
 @fix_biclass_wrapper
 def extmethod(name, out, in1, in2):
-    # We need this, or else we need every combination of types in the opcodes.json
-    assert in1.dtype == in2.dtype
+    # We need this, or else we need every combination of types in the opcodes.json.
+    # Only int64 index operands (e.g. argsort and partition) may differ from the input type.
+    assert in1.dtype == in2.dtype or np.int64 in (out.dtype, in2.dtype)
     target.extmethod(name, get_bhc(out), get_bhc(in1), get_bhc(in2))
 
 def setitem(ary, loc, value):
@@ -127,10 +128,36 @@ class Ufunc(object):
     def __str__(self):
         return "<bohrium Ufunc '%s'>" % self.info['name']
 
+    def _fast_call(self, args):
+        """
+        Apply the ufunc on Bohrium arrays of the same shape and data type without an output argument,
+        which is the common case. Returns None when the arguments need the general path of __call__().
+        """
+
+        first = args[0]
+        if not bhary.check(first) or first.size == 0:
+            return None
+        for arg in args[1:]:
+            if not bhary.check(arg) or arg.shape != first.shape or arg.dtype is not first.dtype:
+                return None
+
+        (out_dtype, in_dtype) = _util.type_sig(self.info['name'], args)
+        if in_dtype is not first.dtype:
+            return None
+
+        out = array_create.empty(first.shape, out_dtype)
+        target.ufunc(self, get_bhc(out), *[get_bhc(arg) for arg in args])
+        return out
+
     @fix_biclass_wrapper
     def __call__(self, *args, **kwargs):
         args = list(args)
 
+        if not kwargs and 0 < len(args) <= 2 and len(args) == self.info['nop'] - 1:
+            ret = self._fast_call(args)
+            if ret is not None:
+                return ret
+
         # Check number of array arguments
         if len(args) != self.info['nop'] and len(args) != self.info['nop'] - 1:
             raise ValueError("invalid number of array arguments")
@@ -180,7 +207,7 @@ class Ufunc(object):
                                           "array when the input arrays are")
         elif not bhary.check(out):
             # All operands are regular NumPy arrays
-            func = eval("np.%s" % self.info['name'])
+            func = getattr(np, self.info['name'])
             if out is not None:
                 args.append(out)
             return func(*args)
@@ -114,6 +114,10 @@ with open(buildpath("_info.py"), 'w') as o:
     nops = {}
     type_sig = {}
 
+    # The Bohrium types that NumPy doesn't have
+    with open(srcpath('..', '..', 'core', 'codegen', 'types.json'), 'r') as f:
+        no_numpy_types = set(t['enum'] for t in json.loads(f.read()) if t['numpy'] == "unknown")
+
     ufunc = {}
     with open(srcpath('..', '..', 'core', 'codegen', 'opcodes.json'), 'r') as f:
         opcodes = json.loads(f.read())
@@ -122,6 +126,8 @@ with open(buildpath("_info.py"), 'w') as o:
                 # Convert the type signature to bhc names
                 type_sig = []
                 for sig in op['types']:
+                    if any(s in no_numpy_types for s in sig):
+                        continue  # E.g. the 16-bit floating-point storage types
                     type_sig.append([dtype_bh2np(s) for s in sig])
 
                 name = op['opcode'].lower()[3:]  # Removing BH_ and we have the NumPy and bohrium name
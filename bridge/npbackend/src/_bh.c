@@ -304,8 +304,45 @@ static int _protected_malloc(BhArray *ary) {
     return 0;
 }
 
+// The mmap'ed data of deallocated arrays, which we detach and unmap in batches.
+// NB: the data stays mapped (and attached) until the batch is released thus its address is never reused before.
+#define RELEASE_BATCH_SIZE 64
+#define RELEASE_BATCH_MAX_NBYTES (1024*1024) // Larger data is released at once
+static const void *release_batch_addr[RELEASE_BATCH_SIZE];
+static npy_intp release_batch_nbytes[RELEASE_BATCH_SIZE];
+static uint64_t release_batch_count = 0;
+
+// Detach and unmap the data in the release batch
+static void _release_batch(void) {
+    bh_mem_signal_detach_batch(release_batch_count, release_batch_addr);
+    uint64_t i;
+    for(i = 0; i < release_batch_count; ++i) {
+        if(_munmap((void*) release_batch_addr[i], release_batch_nbytes[i]) == -1) {
+            PyErr_Print();
+        }
+    }
+    release_batch_count = 0;
+}
+
+// Detach and unmap the data of a deallocated array, which small arrays do in batches
+static void _release_data(void *addr, npy_intp nbytes) {
+    if(nbytes > RELEASE_BATCH_MAX_NBYTES) {
+        if(_munmap(addr, nbytes) == -1) {
+            PyErr_Print();
+        }
+        bh_mem_signal_detach(addr);
+        return;
+    }
+    release_batch_addr[release_batch_count] = addr;
+    release_batch_nbytes[release_batch_count] = nbytes;
+    if(++release_batch_count == RELEASE_BATCH_SIZE) {
+        _release_batch();
+    }
+}
+
 // Called when module exits
 static void module_exit(void) {
+    _release_batch();
     bh_mem_signal_shutdown();
 }
 
@@ -449,11 +486,7 @@ static void BhArray_dealloc(BhArray* self) {
     assert(!PyDataType_FLAGCHK(PyArray_DESCR((PyArrayObject*) self), NPY_ITEM_REFCOUNT));
 
     if (self->mmap_allocated) {
-        if(_munmap(PyArray_DATA((PyArrayObject*) self), ary_nbytes(self)) == -1) {
-            PyErr_Print();
-        }
-
-        bh_mem_signal_detach(PyArray_DATA((PyArrayObject*) self));
+        _release_data(PyArray_DATA((PyArrayObject*) self), ary_nbytes(self));
         self->base.data = NULL;
     }
 
@@ -0,0 +1,14 @@
+# - Find ibverbs, the InfiniBand/RoCE verbs library
+#
+#  IBVERBS_INCLUDE_DIR - where to find infiniband/verbs.h
+#  IBVERBS_LIBRARIES   - List of libraries when using ibverbs.
+#  IBVERBS_FOUND       - True if ibverbs found.
+
+include(FindPackageHandleStandardArgs)
+
+find_path(IBVERBS_INCLUDE_DIR infiniband/verbs.h)
+find_library(IBVERBS_LIBRARIES NAMES ibverbs)
+
+find_package_handle_standard_args(IBVerbs DEFAULT_MSG IBVERBS_LIBRARIES IBVERBS_INCLUDE_DIR)
+
+mark_as_advanced(IBVERBS_LIBRARIES IBVERBS_INCLUDE_DIR)
@@ -0,0 +1,14 @@
+# - Find lz4, the fast compression library
+#
+#  LZ4_INCLUDE_DIR - where to find lz4.h
+#  LZ4_LIBRARIES   - List of libraries when using lz4.
+#  LZ4_FOUND       - True if lz4 found.
+
+include(FindPackageHandleStandardArgs)
+
+find_path(LZ4_INCLUDE_DIR lz4.h)
+find_library(LZ4_LIBRARIES NAMES lz4)
+
+find_package_handle_standard_args(LZ4 DEFAULT_MSG LZ4_LIBRARIES LZ4_INCLUDE_DIR)
+
+mark_as_advanced(LZ4_LIBRARIES LZ4_INCLUDE_DIR)
@@ -0,0 +1,14 @@
+# - Find libtcc, the library of the Tiny C Compiler
+#
+#  LIBTCC_INCLUDE_DIR - where to find libtcc.h
+#  LIBTCC_LIBRARIES   - List of libraries when using libtcc.
+#  LIBTCC_FOUND       - True if libtcc found.
+
+include(FindPackageHandleStandardArgs)
+
+find_path(LIBTCC_INCLUDE_DIR libtcc.h)
+find_library(LIBTCC_LIBRARIES NAMES tcc)
+
+find_package_handle_standard_args(LibTCC DEFAULT_MSG LIBTCC_LIBRARIES LIBTCC_INCLUDE_DIR)
+
+mark_as_advanced(LIBTCC_LIBRARIES LIBTCC_INCLUDE_DIR)
@@ -0,0 +1,14 @@
+# - Find zstd, the Zstandard compression library
+#
+#  ZSTD_INCLUDE_DIR - where to find zstd.h
+#  ZSTD_LIBRARIES   - List of libraries when using zstd.
+#  ZSTD_FOUND       - True if zstd found.
+
+include(FindPackageHandleStandardArgs)
+
+find_path(ZSTD_INCLUDE_DIR zstd.h)
+find_library(ZSTD_LIBRARIES NAMES zstd)
+
+find_package_handle_standard_args(ZSTD DEFAULT_MSG ZSTD_LIBRARIES ZSTD_INCLUDE_DIR)
+
+mark_as_advanced(ZSTD_LIBRARIES ZSTD_INCLUDE_DIR)
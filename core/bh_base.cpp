@@ -116,6 +116,30 @@ void bh_data_malloc(bh_base* base)
            << "Returned error code: " << strerror(errno);
         throw runtime_error(ss.str());
     }
+    // NB: the data is the key since the engines might move the data between bases
+    bh_memory_track_alloc(BH_MEMORY_HOST, base->data, bytes);
+}
+
+/* Use the data at 'offset' in the file 'path' as the data of the given base,
+ * which must not be allocated.
+ *
+ * @base    The base in question
+ * @path    The file that holds the data
+ * @offset  The offset in bytes of the data in the file
+ * @return  Whether the file was mapped
+ */
+bool bh_data_map_file(bh_base* base, const char *path, int64_t offset)
+{
+    if(base == NULL or base->data != NULL) return false;
+
+    const int64_t bytes = bh_base_size(base);
+    if(bytes <= 0) return false;
+
+    base->data = bh_memory_map_file(path, offset, bytes);
+    if(base->data == NULL) return false;
+
+    bh_memory_track_alloc(BH_MEMORY_HOST, base->data, bytes);
+    return true;
 }
 
 /* Frees data memory for the given view.
@@ -132,6 +156,7 @@ void bh_data_free(bh_base* base)
 
     bytes = bh_base_size(base);
 
+    bh_memory_track_free(BH_MEMORY_HOST, base->data);
     if(bh_memory_free(base->data, bytes) != 0) {
         stringstream ss;
         ss << "bh_data_free() could not free a data region. " \
@@ -0,0 +1,258 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cstring>
+#include <stdexcept>
+
+#include <bh_bytecode.hpp>
+
+using namespace std;
+
+namespace bohrium {
+namespace bytecode {
+
+namespace {
+
+template<typename Out>
+void put_varint(uint64_t value, Out &out) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+template<typename Out>
+void put_svarint(int64_t value, Out &out) {
+    put_varint((static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63), out);
+}
+
+// Reads the encoding and throws when it is truncated
+class Reader {
+    const char *_pos;
+    const char *_end;
+public:
+    Reader(const char *data, size_t size) : _pos(data), _end(data + size) {}
+
+    uint8_t byte() {
+        if (_pos == _end) {
+            throw runtime_error("bytecode: truncated encoding");
+        }
+        return static_cast<uint8_t>(*_pos++);
+    }
+
+    uint64_t varint() {
+        uint64_t ret = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            const uint8_t b = byte();
+            ret |= static_cast<uint64_t>(b & 0x7F) << shift;
+            if ((b & 0x80) == 0) {
+                return ret;
+            }
+        }
+        throw runtime_error("bytecode: malformed varint");
+    }
+
+    int64_t svarint() {
+        const uint64_t v = varint();
+        return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1);
+    }
+
+    void bytes(void *dst, size_t nbytes) {
+        if (static_cast<size_t>(_end - _pos) < nbytes) {
+            throw runtime_error("bytecode: truncated encoding");
+        }
+        memcpy(dst, _pos, nbytes);
+        _pos += nbytes;
+    }
+};
+
+// Returns the number of bytes of the value of 'constant'
+size_t constant_size(const bh_constant &constant) {
+    const size_t ret = bh_type_size(constant.type);
+    if (ret > sizeof(constant.value)) {
+        throw runtime_error("bytecode: constant of unknown type");
+    }
+    return ret;
+}
+
+} // Anon namespace
+
+void Encoder::encode(const bh_ir &bhir, vector<char> &out) {
+    out.push_back(static_cast<char>(VERSION));
+    put_varint(bhir.instr_list.size(), out);
+    for (const bh_instruction &instr: bhir.instr_list) {
+        // The template is everything but the base arrays and the constant value
+        _template.clear();
+        put_varint(static_cast<uint64_t>(instr.opcode), _template);
+        put_varint(instr.operand.size(), _template);
+        for (const bh_view &view: instr.operand) {
+            if (bh_is_constant(&view)) {
+                _template.push_back(0);
+                continue;
+            }
+            _template.push_back(1);
+            put_svarint(view.start, _template);
+            put_varint(static_cast<uint64_t>(view.ndim), _template);
+            for (int64_t i = 0; i < view.ndim; ++i) {
+                put_varint(static_cast<uint64_t>(view.shape[i]), _template);
+            }
+            for (int64_t i = 0; i < view.ndim; ++i) {
+                put_svarint(view.stride[i], _template);
+            }
+        }
+        const bool has_constant = instr.has_constant();
+        if (has_constant) {
+            _template.push_back(static_cast<char>(instr.constant.type));
+        }
+
+        // A known template is encoded as its id plus one and a new template as zero followed by the template
+        auto tmpl = _templates.find(_template);
+        if (tmpl != _templates.end()) {
+            put_varint(tmpl->second + 1, out);
+        } else {
+            put_varint(0, out);
+            out.insert(out.end(), _template.begin(), _template.end());
+            if (_templates.size() < max_templates) {
+                const uint64_t id = _templates.size();
+                _templates.emplace(_template, id);
+            }
+        }
+
+        // A known base array is encoded as its id times two and a new base array as one followed by its description
+        for (const bh_view &view: instr.operand) {
+            if (bh_is_constant(&view)) {
+                continue;
+            }
+            auto id = _base_ids.find(view.base);
+            if (id != _base_ids.end()) {
+                put_varint(id->second << 1, out);
+            } else {
+                put_varint(1, out);
+                put_varint(reinterpret_cast<uint64_t>(view.base), out);
+                put_varint(reinterpret_cast<uint64_t>(view.base->data), out);
+                out.push_back(static_cast<char>(view.base->type));
+                put_varint(static_cast<uint64_t>(view.base->nelem), out);
+                _base_ids[view.base] = _next_base_id++;
+            }
+        }
+        if (has_constant) {
+            const char *value = reinterpret_cast<const char *>(&instr.constant.value);
+            out.insert(out.end(), value, value + constant_size(instr.constant));
+        }
+    }
+    out.push_back(static_cast<char>(bhir.tally ? 1 : 0));
+
+    // The ids of the freed base arrays are forgotten after the BhIR
+    for (const bh_instruction &instr: bhir.instr_list) {
+        if (instr.opcode == BH_FREE) {
+            _base_ids.erase(instr.operand[0].base);
+        }
+    }
+}
+
+void Decoder::decode(const char *data, size_t size, bh_ir &bhir, vector<bh_base> &new_bases) {
+    Reader in(data, size);
+    if (in.byte() != VERSION) {
+        throw runtime_error("bytecode: unsupported version");
+    }
+    new_bases.clear();
+    _freed.clear();
+    bhir.instr_list.resize(in.varint());
+    for (bh_instruction &instr: bhir.instr_list) {
+        const uint64_t tag = in.varint();
+        if (tag == 0) {
+            instr.opcode = static_cast<bh_opcode>(in.varint());
+            instr.operand.resize(in.varint());
+            for (bh_view &view: instr.operand) {
+                if (in.byte() == 0) {
+                    view.base = NULL;
+                    continue;
+                }
+                view.base = &_placeholder;
+                view.start = in.svarint();
+                view.ndim = static_cast<int64_t>(in.varint());
+                if (view.ndim > BH_MAXDIM) {
+                    throw runtime_error("bytecode: view has too many dimensions");
+                }
+                for (int64_t i = 0; i < view.ndim; ++i) {
+                    view.shape[i] = static_cast<int64_t>(in.varint());
+                }
+                for (int64_t i = 0; i < view.ndim; ++i) {
+                    view.stride[i] = in.svarint();
+                }
+            }
+            if (instr.has_constant()) {
+                instr.constant.type = static_cast<bh_type>(in.byte());
+            }
+        } else {
+            if (tag > _templates.size()) {
+                throw runtime_error("bytecode: unknown instruction template");
+            }
+            const bh_instruction &tmpl = _templates[tag - 1];
+            instr.opcode = tmpl.opcode;
+            instr.operand = tmpl.operand;
+            instr.constant.type = tmpl.constant.type;
+        }
+        instr.constructor = false;
+        instr.origin_id = -1;
+
+        for (bh_view &view: instr.operand) {
+            if (bh_is_constant(&view)) {
+                continue;
+            }
+            const uint64_t ref = in.varint();
+            uint64_t id;
+            if (ref & 1) {
+                id = _next_base_id++;
+                view.base = reinterpret_cast<bh_base *>(in.varint());
+                bh_base base;
+                base.data = reinterpret_cast<void *>(in.varint());
+                base.type = static_cast<bh_type>(in.byte());
+                base.nelem = static_cast<int64_t>(in.varint());
+                new_bases.push_back(base);
+                _bases[id] = view.base;
+            } else {
+                id = ref >> 1;
+                auto it = _bases.find(id);
+                if (it == _bases.end()) {
+                    throw runtime_error("bytecode: unknown base array");
+                }
+                view.base = it->second;
+            }
+            if (instr.opcode == BH_FREE) {
+                _freed.push_back(id);
+            }
+        }
+        if (instr.has_constant()) {
+            in.bytes(&instr.constant.value, constant_size(instr.constant));
+        }
+        if (tag == 0 and _templates.size() < max_templates) {
+            _templates.push_back(instr);
+        }
+    }
+    bhir.tally = in.byte() != 0;
+
+    for (uint64_t id: _freed) {
+        _bases.erase(id);
+    }
+}
+
+}}
@@ -19,6 +19,8 @@ If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include <dlfcn.h>
+#include <sstream>
+#include <iomanip>
 
 #include <bh_component.hpp>
 
@@ -69,4 +71,17 @@ ComponentFace::~ComponentFace() {
 }
 
 
+string ComponentImplWithChild::timing_statistic() const {
+    const ExecuteTiming &child_timing = child.timing();
+    stringstream ss;
+    ss << fixed << "[" << config.getName() << "] Timing: " << timing.calls << " executions, " << timing.instrs
+       << " instructions in, " << child_timing.instrs << " out";
+    if (timing.instrs > 0) {
+        ss << " (" << setprecision(1) << 100.0 * child_timing.instrs / timing.instrs << "%)";
+    }
+    ss << ", " << setprecision(6) << (timing.time - child_timing.time).count() << "s self, "
+       << child_timing.time.count() << "s child\n";
+    return ss.str();
+}
+
 }} //namespace bohrium::component
@@ -38,12 +38,15 @@ If not, see <http://www.gnu.org/licenses/>.
 //Nasty function renaming
 #define snprintf _snprintf
 #define strcasecmp _stricmp
+#define environ _environ
 
 #else
 
 #include <dlfcn.h>
 #include <limits.h>
 
+extern char **environ;
+
 #define HOME_INI_PATH "~/.bohrium/config.ini"
 #define SYSTEM_INI_PATH_1 "/usr/local/etc/bohrium/config.ini"
 #define SYSTEM_INI_PATH_2 "/usr/etc/bohrium/config.ini"
@@ -170,37 +173,80 @@ string get_config_path() {
     return string(env);
 }
 
-// Return section/option as an environment variable
-// or the empty string if the environment variable wasn't found
-string lookup_env(const string &section, const string &option) {
-    string s = "BH_" + section + "_" + option;
-    to_upper(s);
-    const char *env = getenv(s.c_str());
-
-    if (env == NULL) {
-        return string();
+// Removes the quotes "" or '' around 'value'
+string unquote(const string &value) {
+    if (value.find_first_of("\"'") == 0 and value.find_last_of("\"'") == value.size()-1) {
+        return value.substr(1, value.size()-2);
     } else {
-        return string(env);
+        return value;
     }
 }
 
 }// namespace unnamed
 
-string ConfigParser::lookup(const string &section, const string &option) const {
-    //Check environment variable
-    string ret = lookup_env(section, option);
-    if (not ret.empty())
-        return ret;
+void ConfigParser::snapshot() {
+    _values.clear();
+    for (const auto &section: _config) {
+        auto &options = _values[section.first];
+        for (const auto &option: section.second) {
+            options[option.first] = unquote(option.second.data());
+        }
+    }
+    // The environment variable BH_<SECTION>_<OPTION> overrides the ini file. The option of a variable is the rest
+    // after the longest matching section, which means that only the sections of the ini file can be overridden.
+    for (char **env = environ; *env != NULL; ++env) {
+        const string var(*env);
+        const size_t eq = var.find('=');
+        if (var.compare(0, 3, "BH_") != 0 or eq == string::npos or eq + 1 == var.size()) {
+            continue; // NB: an empty variable doesn't override
+        }
+        const string name = var.substr(3, eq - 3);
+        const string *match = NULL;
+        for (const auto &section: _values) {
+            const string prefix = to_upper_copy(section.first) + "_";
+            if (name.size() > prefix.size() and name.compare(0, prefix.size(), prefix) == 0 and
+                (match == NULL or section.first.size() > match->size())) {
+                match = &section.first;
+            }
+        }
+        if (match != NULL) {
+            _values[*match][to_lower_copy(name.substr(match->size() + 1))] = var.substr(eq + 1);
+        }
+    }
+    // The values set at runtime overrides everything
+    for (const auto &section: _overrides) {
+        for (const auto &option: section.second) {
+            _values[section.first][option.first] = option.second;
+        }
+    }
+}
 
-    //Check config file
-    ret = _config.get<string>(section + "." + option);
+void ConfigParser::set(const string &section, const string &option, const string &value) {
+    _overrides[section][option] = value;
+    _values[section][option] = value;
+}
 
-    //Remove quotes "" or '' and return
-    if (ret.find_first_of("\"'") == 0 and ret.find_last_of("\"'") == ret.size()-1) {
-        return ret.substr(1, ret.size()-2);
-    } else {
-        return ret;
+pair<string, string> ConfigParser::set(const string &assignment) {
+    const size_t eq = assignment.find('=');
+    string key = trim_copy(assignment.substr(0, eq));
+    if (eq == string::npos or key.empty()) {
+        throw ConfigError("ConfigParser: the assignment '" + assignment + "' isn't of the form [section.]option=value");
     }
+    string section = _default_section;
+    const size_t dot = key.find('.');
+    if (dot != string::npos) {
+        section = key.substr(0, dot);
+        key = key.substr(dot + 1);
+    }
+    const string value = unquote(trim_copy(assignment.substr(eq + 1)));
+    set(section, key, value);
+    return make_pair(section + "." + key, value);
+}
+
+void ConfigParser::reload() {
+    _config.clear();
+    property_tree::ini_parser::read_ini(file_path, _config);
+    snapshot();
 }
 
 ConfigParser::ConfigParser(int stack_level) : file_path(get_config_path()),
@@ -208,6 +254,7 @@ ConfigParser::ConfigParser(int stack_level) : file_path(get_config_path()),
 
     // Load the bohrium configuration file
     property_tree::ini_parser::read_ini(file_path, _config);
+    snapshot();
 
     // Find the stack name specified by 'BH_STACK'
     const char *env = getenv("BH_STACK");
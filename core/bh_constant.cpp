@@ -96,6 +96,10 @@ double bh_constant::get_double() const
             return static_cast<double>(value.uint64);
         case bh_type::FLOAT32:
             return static_cast<double>(value.float32);
+        case bh_type::FLOAT16:
+            return static_cast<double>(static_cast<float>(value.float16));
+        case bh_type::BFLOAT16:
+            return static_cast<double>(static_cast<float>(value.bfloat16));
         case bh_type::FLOAT64:
             return value.float64;
         case bh_type::COMPLEX64:
@@ -150,6 +154,12 @@ void bh_constant::set_double(double value)
         case bh_type::FLOAT32:
             this->value.float32 = static_cast<float>(value);
             return;
+        case bh_type::FLOAT16:
+            this->value.float16 = bh_float16(static_cast<float>(value));
+            return;
+        case bh_type::BFLOAT16:
+            this->value.bfloat16 = bh_bfloat16(static_cast<float>(value));
+            return;
         case bh_type::FLOAT64:
             this->value.float64 = value;
             return;
@@ -193,6 +203,10 @@ bool bh_constant::operator==(const bh_constant& other) const
             return other.value.uint64 == value.uint64;
         case bh_type::FLOAT32:
             return other.value.float32 == value.float32;
+        case bh_type::FLOAT16:
+            return other.value.float16.bits == value.float16.bits;
+        case bh_type::BFLOAT16:
+            return other.value.bfloat16.bits == value.bfloat16.bits;
         case bh_type::FLOAT64:
             return other.value.float64 == value.float64;
         case bh_type::COMPLEX64:
@@ -243,6 +257,12 @@ void bh_constant::pprint(ostream& out, bool opencl) const
             case bh_type::FLOAT32:
                 ppfloat(value.float32, out);
                 break;
+            case bh_type::FLOAT16:
+                ppfloat(static_cast<float>(value.float16), out);
+                break;
+            case bh_type::BFLOAT16:
+                ppfloat(static_cast<float>(value.bfloat16), out);
+                break;
             case bh_type::FLOAT64:
                 ppfloat(value.float64, out);
                 break;
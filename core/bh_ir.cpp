@@ -18,19 +18,13 @@ GNU Lesser General Public License along with Bohrium.
 If not, see <http://www.gnu.org/licenses/>.
 */
 
-#include <boost/archive/binary_oarchive.hpp>
-#include <boost/archive/binary_iarchive.hpp>
-#include <boost/iostreams/stream_buffer.hpp>
-#include <boost/iostreams/stream.hpp>
-#include <boost/iostreams/device/back_inserter.hpp>
-#include <boost/serialization/vector.hpp>
 #include <boost/foreach.hpp>
 
 #include <bh_ir.hpp>
+#include <bh_bytecode.hpp>
 
 using namespace std;
 using namespace boost;
-namespace io = boost::iostreams;
 
 /* Creates a Bohrium Internal Representation (BhIR) from a instruction list.
 *
@@ -49,6 +43,36 @@ bh_ir::bh_ir(const bh_instruction& instr)
     instr_list.push_back(instr);
 }
 
+void bh_ir::remove_none() {
+    // The BH_REPEATs that encloses the current instruction, which is the (new) index of each BH_REPEAT and the number
+    // of (old) instructions left in its body
+    vector<pair<size_t, uint64_t> > repeats;
+    size_t count = 0;
+    for (size_t i = 0; i < instr_list.size(); ++i) {
+        while (not repeats.empty() and repeats.back().second == 0) {
+            repeats.pop_back();
+        }
+        const bool none = instr_list[i].opcode == BH_NONE;
+        for (pair<size_t, uint64_t> &repeat: repeats) {
+            --repeat.second;
+            if (none) {
+                --instr_list[repeat.first].constant.value.r123.start;
+            }
+        }
+        if (none) {
+            continue;
+        }
+        if (count != i) {
+            instr_list[count] = std::move(instr_list[i]);
+        }
+        if (instr_list[count].opcode == BH_REPEAT) {
+            repeats.emplace_back(count, instr_list[count].constant.value.r123.start);
+        }
+        ++count;
+    }
+    instr_list.resize(count);
+}
+
 /* Creates a BhIR from a serialized BhIR.
 *
 * @bhir The BhIr serialized as a char array or vector
@@ -56,10 +80,8 @@ bh_ir::bh_ir(const bh_instruction& instr)
 bh_ir::bh_ir(const char bhir[], int64_t size)
     : tally(false)
 {
-    io::basic_array_source<char> source(bhir,size);
-    io::stream<io::basic_array_source <char> > input_stream(source);
-    archive::binary_iarchive ia(input_stream);
-    ia >> *this;
+    vector<bh_base> new_bases;
+    bohrium::bytecode::Decoder().decode(bhir, size, *this, new_bases);
 }
 
 /* Serialize the BhIR object into a char buffer
@@ -69,8 +91,5 @@ bh_ir::bh_ir(const char bhir[], int64_t size)
 */
 void bh_ir::serialize(vector<char> &buffer) const
 {
-    io::stream<io::back_insert_device<vector<char> > > output_stream(buffer);
-    archive::binary_oarchive oa(output_stream);
-    oa << *this;
-    output_stream.flush();
+    bohrium::bytecode::Encoder().encode(*this, buffer);
 }
@@ -21,14 +21,13 @@ If not, see <http://www.gnu.org/licenses/>.
 #include <pthread.h>
 #include <unistd.h>
 #include <stdint.h>
-#include <stdint.h>
 #include <sys/mman.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <cassert>
 #include <stdexcept>
-#include <set>
+#include <map>
 #include <iostream>
 
 #include <bh_mem_signal.h>
@@ -50,30 +49,6 @@ struct Segment
     //The callback function to call
     void (*callback)(void*, void*);
 
-    //Some constructors
-    Segment(){};
-    Segment(const void *addr) : addr(addr),size(1),idx(NULL),callback(NULL){};
-    Segment(const void *addr, uint64_t size) : addr(addr),size(size),idx(NULL),callback(NULL){};
-    Segment(const void *addr, uint64_t size, const void *idx, void (*callback)(void*, void*))
-            : addr(addr),size(size),idx(idx),callback(callback){};
-
-    bool operator<(const Segment& other) const
-    {
-        const uint64_t a_begin = (uint64_t) addr;
-        const uint64_t b_begin = (uint64_t) other.addr;
-        const uint64_t a_end = a_begin + size - 1;
-        const uint64_t b_end = b_begin + other.size - 1;
-
-        //When the two segments overlaps we return false such that
-        //overlapping segments are identical in a set
-        if((a_begin <= b_end) and (a_end >= b_begin))
-        {
-            return false;
-        }
-        else//Else we simple compare the begin address
-            return a_begin < b_begin;
-    }
-
     //Read begin and end memory address
     const void *addr_begin() const
     {
@@ -91,19 +66,80 @@ ostream& operator<<(ostream& out, const Segment& segment)
         << segment.addr_end() << "}";
     return out;
 }
-ostream& operator<<(ostream& out, const set<Segment>& segments)
+
+// All registered memory segments indexed by their start address, which is an interval index since
+// the segments never overlap. The signal handlers of concurrent faults only take the read lock.
+// NB: never insert overlapping memory segments into this map
+typedef map<uintptr_t, Segment> SegmentMap;
+static SegmentMap segments;
+static pthread_rwlock_t segments_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+ostream& operator<<(ostream& out, const SegmentMap& segments)
 {
     out << "bh_mem_signal contains: " << endl;
-    for(const Segment &seg: segments)
+    for(const auto &seg: segments)
     {
-        out << seg << endl;
+        out << seg.second << endl;
     }
     return out;
 }
 
-// All registered memory segments
-// NB: never insert overlapping memory segments into this set
-static set<Segment> segments;
+// Returns the segment that contains 'addr' or segments.end()
+static SegmentMap::const_iterator find_segment(uintptr_t addr)
+{
+    auto it = segments.upper_bound(addr);
+    if(it == segments.begin())
+        return segments.end();
+    --it;
+    if(addr < it->first + it->second.size)
+        return it;
+    return segments.end();
+}
+
+// Returns a segment that overlaps 'size' bytes at 'addr' or segments.end()
+static SegmentMap::const_iterator find_overlap(uintptr_t addr, uint64_t size)
+{
+    // The last segment that starts before the end of 'addr'
+    auto it = segments.lower_bound(addr + (size > 0 ? size : 1));
+    if(it == segments.begin())
+        return segments.end();
+    --it;
+    if(it->first == addr or it->first + it->second.size > addr)
+        return it;
+    return segments.end();
+}
+
+// Attach a segment, which requires the write lock
+static void attach(const void *idx, const void *addr, uint64_t size, void (*callback)(void*, void*))
+{
+    // Let's check for double attachments
+    auto conflict = find_overlap((uintptr_t) addr, size);
+    if(conflict != segments.end())
+    {
+        const Segment segment{addr, size, idx, callback};
+        stringstream ss;
+        ss << "mem_signal: Could not attach signal, memory segment (" \
+           << segment.addr_begin() << " to " << segment.addr_end() \
+           << ") is in conflict with already attached memory segment (" \
+           << conflict->second.addr_begin() << " to " << conflict->second.addr_end() << ")" << endl;
+        throw runtime_error(ss.str());
+    }
+    segments.insert(make_pair((uintptr_t) addr, Segment{addr, size, idx, callback}));
+}
+
+// Detach the segment that starts at or contains 'addr', which requires the write lock
+static void detach(const void *addr)
+{
+    auto it = segments.find((uintptr_t) addr);
+    if(it == segments.end())
+    {
+        auto contains = find_segment((uintptr_t) addr);
+        if(contains == segments.end())
+            return;
+        it = segments.find(contains->first);
+    }
+    segments.erase(it);
+}
 
 /** Signal handler.
  *  Executes appropriate callback function associated with memory segment.
@@ -114,16 +150,24 @@ static set<Segment> segments;
  */
 static void sighandler(int signal_number, siginfo_t *info, void *context)
 {
-    pthread_mutex_lock(&signal_mutex);
-    set<Segment>::const_iterator s = segments.find(Segment(info->si_addr));
-    pthread_mutex_unlock(&signal_mutex);
-    if(s == segments.end())//Address not found in 'segments'
+    // NB: we copy the segment since the callback (or another thread) might detach it
+    bool found = false;
+    Segment segment;
+    pthread_rwlock_rdlock(&segments_lock);
+    auto s = find_segment((uintptr_t) info->si_addr);
+    if(s != segments.end())
+    {
+        segment = s->second;
+        found = true;
+    }
+    pthread_rwlock_unlock(&segments_lock);
+    if(not found)//Address not found in 'segments'
     {
         signal(signal_number, SIG_DFL);
     }
     else
     {
-        s->callback((void*)s->idx, info->si_addr);
+        segment.callback((void*)segment.idx, info->si_addr);
     }
 }
 
@@ -147,59 +191,74 @@ void bh_mem_signal_init(void)
 
 void bh_mem_signal_shutdown(void)
 {
-    pthread_mutex_lock(&signal_mutex);
+    pthread_rwlock_rdlock(&segments_lock);
     if(segments.size() > 0) {
         if (mem_warn) {
             cout << "MEM_WARN: bh_mem_signal_shutdown() - not all attached memory segments are detached!" << endl;
-            bh_mem_signal_pprint_db();
+            cout << segments << endl;
         }
     }
-    pthread_mutex_unlock(&signal_mutex);
+    pthread_rwlock_unlock(&segments_lock);
 }
 
 void bh_mem_signal_attach(const void *idx, const void *addr, uint64_t size,
                           void (*callback)(void*, void*))
 {
-    pthread_mutex_lock(&signal_mutex);
-
-    // Create new memory segment that we will attach
-    Segment segment(addr, size, idx, callback);
-
-    // Let's check for double attachments
-    if(segments.find(segment) != segments.end())
-    {
-        auto conflict = segments.find(Segment(addr, size));
-        stringstream ss;
-        ss << "mem_signal: Could not attach signal, memory segment (" \
-           << segment.addr_begin() << " to " << segment.addr_end() \
-           << ") is in conflict with already attached memory segment (" \
-           << conflict->addr_begin() << " to " << conflict->addr_end() << ")" << endl;
-        pthread_mutex_unlock(&signal_mutex);
-        throw runtime_error(ss.str());
+    pthread_rwlock_wrlock(&segments_lock);
+    try {
+        attach(idx, addr, size, callback);
+    } catch (...) {
+        pthread_rwlock_unlock(&segments_lock);
+        throw;
     }
+    pthread_rwlock_unlock(&segments_lock);
+}
 
-    // Finally, let's insert the new segment
-    segments.insert(segment);
-    pthread_mutex_unlock(&signal_mutex);
+void bh_mem_signal_attach_batch(uint64_t count, const void *const idx[], const void *const addr[],
+                                const uint64_t size[], void (*callback)(void*, void*))
+{
+    pthread_rwlock_wrlock(&segments_lock);
+    uint64_t i = 0;
+    try {
+        for(; i < count; ++i)
+            attach(idx[i], addr[i], size[i], callback);
+    } catch (...) {
+        // Attach all or nothing
+        while(i > 0)
+            detach(addr[--i]);
+        pthread_rwlock_unlock(&segments_lock);
+        throw;
+    }
+    pthread_rwlock_unlock(&segments_lock);
 }
 
 void bh_mem_signal_detach(const void *addr)
 {
-    pthread_mutex_lock(&signal_mutex);
-    segments.erase(addr);
-    pthread_mutex_unlock(&signal_mutex);
+    pthread_rwlock_wrlock(&segments_lock);
+    detach(addr);
+    pthread_rwlock_unlock(&segments_lock);
+}
+
+void bh_mem_signal_detach_batch(uint64_t count, const void *const addr[])
+{
+    pthread_rwlock_wrlock(&segments_lock);
+    for(uint64_t i = 0; i < count; ++i)
+        detach(addr[i]);
+    pthread_rwlock_unlock(&segments_lock);
 }
 
 int bh_mem_signal_exist(const void *addr)
 {
     int ret;
-    pthread_mutex_lock(&signal_mutex);
-    ret = segments.find(addr) != segments.end();
-    pthread_mutex_unlock(&signal_mutex);
+    pthread_rwlock_rdlock(&segments_lock);
+    ret = find_segment((uintptr_t) addr) != segments.end();
+    pthread_rwlock_unlock(&segments_lock);
     return ret;
 }
 
 void bh_mem_signal_pprint_db(void)
 {
+    pthread_rwlock_rdlock(&segments_lock);
     cout << segments << endl;
-}
\ No newline at end of file
+    pthread_rwlock_unlock(&segments_lock);
+}
@@ -1,67 +1,468 @@
-/*
-This file is part of Bohrium and copyright (c) 2012 the Bohrium
-team <http://www.bh107.org>.
-
-Bohrium is free software: you can redistribute it and/or modify
-it under the terms of the GNU Lesser General Public License as
-published by the Free Software Foundation, either version 3
-of the License, or (at your option) any later version.
-
-Bohrium is distributed in the hope that it will be useful,
-but WITHOUT ANY WARRANTY; without even the implied warranty of
-MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
-GNU General Public License for more details.
-
-You should have received a copy of the
-GNU Lesser General Public License along with Bohrium.
-
-If not, see <http://www.gnu.org/licenses/>.
-*/
-
-#ifdef _WIN32
-#include <malloc.h>
-#else
-#include <sys/mman.h>
-#endif
-#include <cstddef>
-
-#include <bh_memory.h>
-#include <bh_win.h>
-
-/* Allocate an alligned contigous block of memory,
- * does not apply any initialization
- *
- * @size  The size of the allocated block
- * @return A pointer to data, and NULL on error
- */
-void* bh_memory_malloc(int64_t size)
-{
-#ifdef _WIN32
-    return _aligned_malloc(size, 16);
-#else
-    //Allocate page-size aligned memory.
-    //The MAP_PRIVATE and MAP_ANONYMOUS flags is not 100% portable. See:
-    //<http://stackoverflow.com/questions/4779188/how-to-use-mmap-to-allocate-a-memory-in-heap>
-    void* data = mmap(0, size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
-    if(data == MAP_FAILED)
-        return NULL;
-    else
-        return data;
-#endif
-}
-
-/* Frees a previously allocated data block
- *
- * @data  The pointer returned from a call to bh_memory_malloc
- * @size  The size of the allocated block
- * @return A pointer to data, and NULL on error
- */
-int64_t bh_memory_free(void* data, int64_t size)
-{
-#ifdef _WIN32
-	_aligned_free(data);
-	return 0;
-#else
-	return munmap(data, size);
-#endif
-}
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifdef _WIN32
+#include <malloc.h>
+#else
+#include <sys/mman.h>
+#endif
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <atomic>
+#include <mutex>
+#include <map>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include <bh_memory.h>
+#include <bh_win.h>
+
+namespace {
+// The size of a cache line, which the staggered blocks stay aligned to
+constexpr long long CACHE_LINE = 64;
+
+// The memory options, which are read from the environment on first use:
+//   BH_HUGEPAGE_THRESHOLD: minimum size in bytes of the blocks backed by huge pages (unset or zero disables)
+//   BH_HUGEPAGE_MODE:      'madvise' (default) use transparent huge pages, 'hugetlb' use the reserved huge pages
+//                          and fall back to transparent huge pages when none are available
+//   BH_MEMORY_POOL_BYTES:  maximum number of bytes of freed blocks kept for reuse (unset or zero disables)
+//   BH_MEMORY_STAGGER_BYTES: the blocks start at successive multiples of this many bytes (rounded up to a cache
+//                          line) into their first page, which keeps same-sized blocks from mapping to the same
+//                          cache sets and from 4K aliasing (unset or zero disables)
+struct MemoryConfig {
+    int64_t threshold = 0;
+    bool hugetlb = false;
+    int64_t pool_bytes = 0;
+    int64_t stagger = 0;
+    MemoryConfig() {
+        const char *threshold_env = getenv("BH_HUGEPAGE_THRESHOLD");
+        if (threshold_env != NULL) {
+            threshold = strtoll(threshold_env, NULL, 10);
+        }
+        const char *mode_env = getenv("BH_HUGEPAGE_MODE");
+        hugetlb = mode_env != NULL and strcmp(mode_env, "hugetlb") == 0;
+        const char *pool_env = getenv("BH_MEMORY_POOL_BYTES");
+        if (pool_env != NULL) {
+            pool_bytes = strtoll(pool_env, NULL, 10);
+        }
+        const char *stagger_env = getenv("BH_MEMORY_STAGGER_BYTES");
+        if (stagger_env != NULL) {
+            const int64_t page_size = sysconf(_SC_PAGESIZE);
+            stagger = (std::max(strtoll(stagger_env, NULL, 10), 0LL) + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+            stagger %= page_size;
+        }
+    }
+    // Returns whether blocks of 'size' bytes are backed by huge pages
+    bool use_hugepages(int64_t size) const {
+        return threshold > 0 and size >= threshold;
+    }
+    // Returns whether freed blocks of 'size' bytes are kept for reuse
+    // NB: the blocks backed by huge pages are never pooled
+    bool use_pool(int64_t size) const {
+        return pool_bytes > 0 and size <= pool_bytes and not use_hugepages(size);
+    }
+    // Returns whether blocks of 'size' bytes are staggered, which maps an extra page
+    // NB: the blocks backed by huge pages are never staggered
+    bool use_stagger(int64_t size) const {
+        return stagger > 0 and not use_hugepages(size);
+    }
+};
+
+const MemoryConfig &memory_config() {
+    static const MemoryConfig ret;
+    return ret;
+}
+
+// The size of the huge pages of MAP_HUGETLB
+constexpr int64_t HUGETLB_SIZE = 2 * 1024 * 1024;
+
+// The blocks backed by huge pages mapped to whether they use MAP_HUGETLB, in which case
+// they are unmapped with their size rounded up to whole huge pages
+std::map<void *, bool> hugepage_blocks;
+std::mutex hugepage_mutex;
+
+// The number of bytes currently backed by huge pages
+std::atomic<uint64_t> hugepage_bytes(0);
+
+// The freed blocks kept for reuse by their size rounded up to whole pages (the size class),
+// their total size, and the number of allocations looked up in and served by the pool
+std::map<int64_t, std::vector<void *> > pool_blocks;
+int64_t pool_retained = 0;
+uint64_t pool_lookups = 0;
+uint64_t pool_hits = 0;
+std::mutex pool_mutex;
+
+// The blocks handed over by bh_memory_adopt() mapped to their free function and its argument
+std::map<void *, std::pair<void (*)(void *, void *), void *> > adopted_blocks;
+std::atomic<uint64_t> num_adopted(0);
+std::mutex adopted_mutex;
+
+// The live arrays of a device of the memory tracker, their total and peak size, and the allocations per size class
+struct DeviceMemory {
+    std::mutex mutex;
+    std::unordered_map<const void *, uint64_t> live;
+    std::atomic<uint64_t> current{0};
+    std::atomic<uint64_t> peak{0};
+    uint64_t size_classes[BH_MEMORY_SIZE_CLASSES] = {};
+};
+DeviceMemory device_memory[BH_MEMORY_NUM_DEVICES];
+
+// The smallest 'i' where 'bytes' is at most 2^i
+int power_class(uint64_t bytes) {
+    int ret = 0;
+    while (ret + 1 < BH_MEMORY_SIZE_CLASSES and (uint64_t(1) << ret) < bytes) {
+        ++ret;
+    }
+    return ret;
+}
+
+int64_t size_class(int64_t size) {
+    static const int64_t page_size = sysconf(_SC_PAGESIZE);
+    return (size + page_size - 1) / page_size * page_size;
+}
+
+// The number of staggered blocks allocated so far, which selects the offset of the next one
+std::atomic<uint64_t> stagger_count(0);
+
+#ifndef _WIN32
+/* A staggered block is the size class of the block plus a page, thus any offset within the first page fits and
+ * a pooled block fits every block of its size class. The start of the mapping is the page of the block. */
+int64_t stagger_length(int64_t size) {
+    static const int64_t page_size = sysconf(_SC_PAGESIZE);
+    return size_class(size) + page_size;
+}
+
+void *stagger_mapping(void *data) {
+    static const uintptr_t page_size = sysconf(_SC_PAGESIZE);
+    return reinterpret_cast<void *>(reinterpret_cast<uintptr_t>(data) / page_size * page_size);
+}
+#endif
+}
+
+/* Allocate an alligned contigous block of memory,
+ * does not apply any initialization
+ *
+ * @size  The size of the allocated block
+ * @return A pointer to data, and NULL on error
+ */
+void* bh_memory_malloc(int64_t size)
+{
+#ifdef _WIN32
+    return _aligned_malloc(size, 16);
+#else
+    const MemoryConfig &config = memory_config();
+    const bool use_hugepages = config.use_hugepages(size);
+    // Let's reuse a freed block of the same size class
+    // NB: like a new block, a reused block isn't initialized
+    if (config.use_pool(size)) {
+        std::lock_guard<std::mutex> lock(pool_mutex);
+        ++pool_lookups;
+        auto it = pool_blocks.find(size_class(size));
+        if (it != pool_blocks.end() and not it->second.empty()) {
+            void* data = it->second.back();
+            it->second.pop_back();
+            pool_retained -= it->first;
+            ++pool_hits;
+            return data;
+        }
+    }
+#ifdef MAP_HUGETLB
+    if (use_hugepages and config.hugetlb) {
+        const int64_t rounded = (size + HUGETLB_SIZE - 1) / HUGETLB_SIZE * HUGETLB_SIZE;
+        void* data = mmap(0, rounded, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_HUGETLB, -1, 0);
+        if(data != MAP_FAILED) {
+            std::lock_guard<std::mutex> lock(hugepage_mutex);
+            hugepage_blocks[data] = true;
+            hugepage_bytes += size;
+            return data;
+        }
+    }
+#endif
+    // Let's start the block at the next offset into its first page
+    if (config.use_stagger(size)) {
+        static const int64_t page_size = sysconf(_SC_PAGESIZE);
+        void* data = mmap(0, stagger_length(size), PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+        if(data == MAP_FAILED)
+            return NULL;
+        const int64_t offset = static_cast<int64_t>(stagger_count++ % (page_size / CACHE_LINE)) * config.stagger
+                               % page_size;
+        return static_cast<char *>(data) + offset;
+    }
+    //Allocate page-size aligned memory.
+    //The MAP_PRIVATE and MAP_ANONYMOUS flags is not 100% portable. See:
+    //<http://stackoverflow.com/questions/4779188/how-to-use-mmap-to-allocate-a-memory-in-heap>
+    void* data = mmap(0, size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    if(data == MAP_FAILED)
+        return NULL;
+#ifdef MADV_HUGEPAGE
+    // NB: the advice fails when transparent huge pages are disabled, which is fine
+    if (use_hugepages and madvise(data, size, MADV_HUGEPAGE) == 0) {
+        std::lock_guard<std::mutex> lock(hugepage_mutex);
+        hugepage_blocks[data] = false;
+        hugepage_bytes += size;
+    }
+#endif
+    return data;
+#endif
+}
+
+/* Frees a previously allocated data block
+ *
+ * @data  The pointer returned from a call to bh_memory_malloc
+ * @size  The size of the allocated block
+ * @return A pointer to data, and NULL on error
+ */
+int64_t bh_memory_free(void* data, int64_t size)
+{
+    // The adopted blocks are freed by their owner
+    if (num_adopted > 0) {
+        std::unique_lock<std::mutex> lock(adopted_mutex);
+        auto it = adopted_blocks.find(data);
+        if (it != adopted_blocks.end()) {
+            const auto free_fn = it->second;
+            adopted_blocks.erase(it);
+            --num_adopted;
+            lock.unlock();
+            free_fn.first(data, free_fn.second);
+            return 0;
+        }
+    }
+#ifdef _WIN32
+	_aligned_free(data);
+	return 0;
+#else
+    const MemoryConfig &config = memory_config();
+    // Let's keep the block for reuse unless the pool is full
+    if (config.use_pool(size)) {
+        std::lock_guard<std::mutex> lock(pool_mutex);
+        const int64_t bytes = size_class(size);
+        if (pool_retained + bytes <= config.pool_bytes) {
+            pool_blocks[bytes].push_back(data);
+            pool_retained += bytes;
+            return 0;
+        }
+    }
+    if (config.use_hugepages(size)) {
+        std::lock_guard<std::mutex> lock(hugepage_mutex);
+        auto it = hugepage_blocks.find(data);
+        if (it != hugepage_blocks.end()) {
+            const bool hugetlb = it->second;
+            hugepage_blocks.erase(it);
+            hugepage_bytes -= size;
+            if (hugetlb) {
+                return munmap(data, (size + HUGETLB_SIZE - 1) / HUGETLB_SIZE * HUGETLB_SIZE);
+            }
+        }
+    }
+    if (config.use_stagger(size)) {
+        return munmap(stagger_mapping(data), stagger_length(size));
+    }
+	return munmap(data, size);
+#endif
+}
+
+/* Hands the block 'data', which wasn't allocated by bh_memory_malloc(), over to bh_memory_free(),
+ * which then frees it by calling 'free_fn(data, arg)'
+ */
+void bh_memory_adopt(void *data, void (*free_fn)(void *data, void *arg), void *arg)
+{
+    std::lock_guard<std::mutex> lock(adopted_mutex);
+    if (adopted_blocks.insert(std::make_pair(data, std::make_pair(free_fn, arg))).second) {
+        ++num_adopted;
+    }
+}
+
+/* Takes a block handed over by bh_memory_adopt() back, which bh_memory_free() must no longer free
+ */
+void bh_memory_disown(void *data)
+{
+    std::lock_guard<std::mutex> lock(adopted_mutex);
+    if (adopted_blocks.erase(data) > 0) {
+        --num_adopted;
+    }
+}
+
+/* Returns whether the block 'data' was handed over by bh_memory_adopt()
+ */
+bool bh_memory_is_adopted(const void *data)
+{
+    if (num_adopted == 0) {
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(adopted_mutex);
+    return adopted_blocks.find(const_cast<void *>(data)) != adopted_blocks.end();
+}
+
+#ifndef _WIN32
+namespace {
+// The pages of a block of bh_memory_map_file(), which starts at a page boundary before the block
+struct FileMapping {
+    void *addr;
+    size_t length;
+};
+
+void unmap_file(void *data, void *arg) {
+    FileMapping *mapping = static_cast<FileMapping *>(arg);
+    munmap(mapping->addr, mapping->length);
+    delete mapping;
+}
+}
+#endif
+
+/* Maps the 'size' bytes at 'offset' of the file 'path' copy-on-write, which bh_memory_free() unmaps
+ */
+void* bh_memory_map_file(const char *path, int64_t offset, int64_t size)
+{
+#ifdef _WIN32
+    return NULL;
+#else
+    static const int64_t page_size = sysconf(_SC_PAGESIZE);
+    if (offset < 0 or size <= 0) {
+        return NULL;
+    }
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    // The file must hold the whole block since accessing pages beyond the end of the file raises SIGBUS
+    const off_t file_size = lseek(fd, 0, SEEK_END);
+    if (file_size < 0 or offset + size > file_size) {
+        close(fd);
+        return NULL;
+    }
+    // mmap() requires a page-aligned offset, thus we map from the page that contains 'offset'
+    const int64_t delta = offset % page_size;
+    const size_t length = static_cast<size_t>(size + delta);
+    void *addr = mmap(0, length, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, offset - delta);
+    close(fd); // NB: the mapping keeps the file open
+    if (addr == MAP_FAILED) {
+        return NULL;
+    }
+    void *data = static_cast<char *>(addr) + delta;
+    bh_memory_adopt(data, &unmap_file, new FileMapping{addr, length});
+    return data;
+#endif
+}
+
+/* Returns the number of bytes currently allocated by bh_memory_malloc() that are backed by huge pages
+ */
+uint64_t bh_memory_hugepage_bytes(void)
+{
+    return hugepage_bytes;
+}
+
+/* Returns the number of allocations looked up in the pool of freed blocks
+ * and the number of them that reused a block, see BH_MEMORY_POOL_BYTES
+ *
+ * @lookups  The number of lookups
+ * @hits     The number of hits
+ */
+void bh_memory_pool_stats(uint64_t *lookups, uint64_t *hits)
+{
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    *lookups = pool_lookups;
+    *hits = pool_hits;
+}
+
+/* Records that the array 'key' has 'bytes' allocated on 'device', which replaces an earlier record of 'key'
+ */
+void bh_memory_track_alloc(int device, const void *key, uint64_t bytes)
+{
+    DeviceMemory &mem = device_memory[device];
+    std::lock_guard<std::mutex> lock(mem.mutex);
+    auto it = mem.live.emplace(key, bytes);
+    if (not it.second) {
+        mem.current -= it.first->second;
+        it.first->second = bytes;
+    }
+    const uint64_t current = mem.current += bytes;
+    if (current > mem.peak) {
+        mem.peak = current;
+    }
+    ++mem.size_classes[power_class(bytes)];
+}
+
+/* Records that the array 'key' on 'device' is freed (unknown arrays are ignored)
+ */
+void bh_memory_track_free(int device, const void *key)
+{
+    DeviceMemory &mem = device_memory[device];
+    std::lock_guard<std::mutex> lock(mem.mutex);
+    auto it = mem.live.find(key);
+    if (it != mem.live.end()) {
+        mem.current -= it->second;
+        mem.live.erase(it);
+    }
+}
+
+/* Returns whether the array 'key' is live on 'device'
+ */
+bool bh_memory_is_tracked(int device, const void *key)
+{
+    DeviceMemory &mem = device_memory[device];
+    std::lock_guard<std::mutex> lock(mem.mutex);
+    return mem.live.find(key) != mem.live.end();
+}
+
+/* Returns the bytes of the live arrays on 'device' now and at most so far
+ */
+void bh_memory_usage(int device, uint64_t *current, uint64_t *peak)
+{
+    *current = device_memory[device].current;
+    *peak = device_memory[device].peak;
+}
+
+/* Returns the number of allocations on 'device' of each of the BH_MEMORY_SIZE_CLASSES size classes
+ */
+void bh_memory_size_classes(int device, uint64_t *counts)
+{
+    DeviceMemory &mem = device_memory[device];
+    std::lock_guard<std::mutex> lock(mem.mutex);
+    std::copy(mem.size_classes, mem.size_classes + BH_MEMORY_SIZE_CLASSES, counts);
+}
+
+/* Returns the 'num' largest live arrays on 'device' in decreasing size
+ */
+uint64_t bh_memory_largest(int device, uint64_t num, const void **keys, uint64_t *bytes)
+{
+    DeviceMemory &mem = device_memory[device];
+    std::vector<std::pair<uint64_t, const void *> > arrays;
+    {
+        std::lock_guard<std::mutex> lock(mem.mutex);
+        arrays.reserve(mem.live.size());
+        for (const auto &array: mem.live) {
+            arrays.push_back(std::make_pair(array.second, array.first));
+        }
+    }
+    num = std::min<uint64_t>(num, arrays.size());
+    std::partial_sort(arrays.begin(), arrays.begin() + num, arrays.end(),
+                      [](const std::pair<uint64_t, const void *> &a, const std::pair<uint64_t, const void *> &b) {
+                          return a.first > b.first;
+                      });
+    for (uint64_t i = 0; i < num; ++i) {
+        bytes[i] = arrays[i].first;
+        keys[i] = arrays[i].second;
+    }
+    return num;
+}
@@ -84,15 +84,10 @@ void Init::serialize(std::vector<char> &buffer)
 
 void ExecuteFrontend::serialize(const bh_ir &bhir, vector<char> &buffer, vector<bh_base*> &data_send, vector<bh_base*> &data_recv)
 {
-    //Wrap 'buffer' in an io stream
-    iostreams::stream<iostreams::back_insert_device<vector<char> > > output_stream(buffer);
-    archive::binary_oarchive oa(output_stream);
-
-    //Serialize the BhIR
-    oa << bhir;
+    //Serialize the BhIR, which includes the new base arrays
+    encoder.encode(bhir, buffer);
 
-    //Serialize the new base arrays in 'bhir' and find base arrays that have data we must send
-    vector<bh_base> new_bases;//New base arrays in the order they appear in the instruction list
+    //Find base arrays that have data we must send
     for(const bh_instruction &instr: bhir.instr_list)
     {
         for(const bh_view &v: instr.operand) {
@@ -100,7 +95,6 @@ void ExecuteFrontend::serialize(const bh_ir &bhir, vector<char> &buffer, vector<
                 continue;
             if(known_base_arrays.find(v.base) == known_base_arrays.end())
             {
-                new_bases.push_back(*v.base);
                 known_base_arrays.insert(v.base);
                 if(v.base->data != NULL)
                     data_send.push_back(v.base);
@@ -108,9 +102,6 @@ void ExecuteFrontend::serialize(const bh_ir &bhir, vector<char> &buffer, vector<
         }
     }
 
-    //Serialize the new base arrays in the 'bhir'
-    oa << new_bases;
-
     //Update 'known_base_arrays' and 'data_recv'
     for(const bh_instruction &instr: bhir.instr_list)
     {
@@ -151,14 +142,10 @@ void ExecuteFrontend::cleanup(bh_ir &bhir)
 
 bh_ir ExecuteBackend::deserialize(vector<char> &buffer, vector<bh_base*> &data_send, vector<bh_base*> &data_recv)
 {
-    //Wrap 'buffer' in an io stream
-    iostreams::basic_array_source<char> source(&buffer[0], buffer.size());
-    iostreams::stream<iostreams::basic_array_source <char> > input_stream(source);
-    archive::binary_iarchive ia(input_stream);
-
-    //deserialize the BhIR
+    //Deserialize the BhIR and the new base arrays in the order they appear in the instruction list
     bh_ir bhir;
-    ia >> bhir;
+    vector<bh_base> new_bases;
+    decoder.decode(buffer.data(), buffer.size(), bhir, new_bases);
 
     //Find all freed base arrays (remote base pointers)
     for(const bh_instruction &instr: bhir.instr_list)
@@ -169,9 +156,6 @@ bh_ir ExecuteBackend::deserialize(vector<char> &buffer, vector<bh_base*> &data_s
         }
     }
 
-    vector<bh_base> new_bases;//New base arrays in the order they appear in the instruction list
-    ia >> new_bases;
-
     //Add the new base array to 'remote2local' and to 'data_recv'
     size_t new_base_count = 0;
     for(const bh_instruction &instr: bhir.instr_list)
@@ -228,4 +212,12 @@ void ExecuteBackend::cleanup(const bh_ir &bhir)
     remote_frees.clear();
 }
 
+bh_base *ExecuteBackend::local(const bh_base *remote)
+{
+    auto it = remote2local.find(remote);
+    if (it == remote2local.end())
+        return NULL;
+    return &it->second;
+}
+
 }}
@@ -0,0 +1,155 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <algorithm>
+#include <unistd.h>
+
+#include <bh_trace.hpp>
+#include <bh_config_parser.hpp>
+
+using namespace std;
+
+namespace bohrium {
+namespace trace {
+
+namespace {
+
+// The ring buffer of a thread, which only the thread writes
+struct Buffer {
+    const uint64_t tid;
+    vector<Event> events;
+    // The number of recorded events of which the last 'events.size()' are kept
+    atomic<uint64_t> count{0};
+
+    Buffer(uint64_t tid, size_t capacity) : tid(tid), events(capacity) {}
+};
+
+class Recorder {
+  public:
+    const string filename;
+    const size_t capacity;
+
+    explicit Recorder(const ConfigParser &config) :
+            filename(config.defaultGet<string>("trace_filename", "")),
+            capacity(max<size_t>(1, config.defaultGet<size_t>("trace_buffer_events", 65536))) {}
+
+    // The buffer of the calling thread, which is registered at the first event of the thread
+    Buffer &local() {
+        thread_local shared_ptr<Buffer> buffer;
+        if (not buffer) {
+            lock_guard<mutex> lock(_mutex);
+            buffer = make_shared<Buffer>(_buffers.size(), capacity);
+            _buffers.push_back(buffer);
+        }
+        return *buffer;
+    }
+
+    void write() {
+        lock_guard<mutex> lock(_mutex);
+        vector<pair<uint64_t, const Event *> > events;
+        uint64_t start = UINT64_MAX;
+        for (const shared_ptr<Buffer> &buffer: _buffers) {
+            const uint64_t count = buffer->count.load(memory_order_acquire);
+            const uint64_t first = count > buffer->events.size() ? count - buffer->events.size() : 0;
+            for (uint64_t i = first; i < count; ++i) {
+                const Event *e = &buffer->events[i % buffer->events.size()];
+                events.push_back(make_pair(buffer->tid, e));
+                start = std::min(start, e->begin);
+            }
+        }
+
+        ofstream file(filename);
+        if (not file) {
+            cerr << "[trace] cannot write '" << filename << "'" << endl;
+            return;
+        }
+        const int pid = static_cast<int>(getpid());
+        file << fixed;
+        file.precision(3);
+        file << "{\"traceEvents\": [\n";
+        for (size_t n = 0; n < events.size(); ++n) {
+            const Event &e = *events[n].second;
+            file << (n > 0 ? ",\n" : "") << "{\"name\": \"" << e.name << "\", \"cat\": \"" << e.category
+                 << "\", \"ph\": \"X\", \"ts\": " << (e.begin - start) / 1e3 << ", \"dur\": " << e.duration / 1e3
+                 << ", \"pid\": " << pid << ", \"tid\": " << events[n].first << ", \"args\": {";
+            for (int a = 0; a < 2 and e.arg_names[a][0] != '\0'; ++a) {
+                file << (a > 0 ? ", " : "") << "\"" << e.arg_names[a] << "\": ";
+                // The hashes are written as the hexadecimal strings of the source files of the kernels
+                if (strcmp(e.arg_names[a], "hash") == 0) {
+                    file << "\"" << hex << e.args[a] << dec << "\"";
+                } else {
+                    file << e.args[a];
+                }
+            }
+            file << "}}";
+        }
+        file << "\n]}\n";
+    }
+
+  private:
+    mutex _mutex;
+    vector<shared_ptr<Buffer> > _buffers;
+};
+
+// The recorder of the process (NULL when the timeline isn't recorded), which is never destroyed thus
+// the components can record events while the process exits
+Recorder *recorder() {
+    static Recorder *ret = []() -> Recorder * {
+        Recorder *r = new Recorder(ConfigParser(-1));
+        if (r->filename.empty()) {
+            delete r;
+            return NULL;
+        }
+        atexit([]() { trace::write(); });
+        return r;
+    }();
+    return ret;
+}
+
+} // Unnamed namespace
+
+bool enabled() {
+    return recorder() != NULL;
+}
+
+void record(const Event &event) {
+    Recorder *r = recorder();
+    if (r != NULL) {
+        Buffer &buffer = r->local();
+        const uint64_t count = buffer.count.load(memory_order_relaxed);
+        buffer.events[count % buffer.events.size()] = event;
+        buffer.count.store(count + 1, memory_order_release);
+    }
+}
+
+void write() {
+    Recorder *r = recorder();
+    if (r != NULL) {
+        r->write();
+    }
+}
+
+}} // namespace bohrium::trace
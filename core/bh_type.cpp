@@ -26,6 +26,8 @@ If not, see <http://www.gnu.org/licenses/>.
 #include <cassert>
 #include <sstream>
 #include <limits>
+#include <cstring>
+#include <ostream>
 
 int bh_type_size(bh_type type)
 {
@@ -45,6 +47,8 @@ int bh_type_size(bh_type type)
         case bh_type::COMPLEX64:  return  8;
         case bh_type::COMPLEX128: return 16;
         case bh_type::R123:       return 16;
+        case bh_type::FLOAT16:    return  2;
+        case bh_type::BFLOAT16:   return  2;
 	}
     return -1;
 }
@@ -67,6 +71,8 @@ const char* bh_type_text(bh_type type)
         case bh_type::COMPLEX64:  return "BH_COMPLEX64";
         case bh_type::COMPLEX128: return "BH_COMPLEX128";
         case bh_type::R123:       return "BH_R123";
+        case bh_type::FLOAT16:    return "BH_FLOAT16";
+        case bh_type::BFLOAT16:   return "BH_BFLOAT16";
     }
     return "UNKNOWN";
 }
@@ -120,6 +126,8 @@ int bh_type_is_signed_integer(bh_type type)
 int bh_type_is_float(bh_type type)
 {
     switch (type) {
+        case bh_type::FLOAT16:
+        case bh_type::BFLOAT16:
         case bh_type::FLOAT32:
         case bh_type::FLOAT64:
         case bh_type::COMPLEX64:
@@ -142,6 +150,18 @@ int bh_type_is_complex(bh_type type)
     }
 }
 
+bh_type bh_type_compute(bh_type type)
+{
+    switch(type)
+    {
+        case bh_type::FLOAT16:
+        case bh_type::BFLOAT16:
+            return bh_type::FLOAT32;
+        default:
+            return type;
+    }
+}
+
 uint64_t bh_type_limit_max_integer(bh_type type)
 {
     switch(type)
@@ -184,6 +204,8 @@ double bh_type_limit_max_float(bh_type type)
 {
     switch(type)
     {
+        case bh_type::FLOAT16: return 16;
+        case bh_type::BFLOAT16:
         case bh_type::FLOAT32: return FLT_MAX_EXP;
         case bh_type::FLOAT64: return DBL_MAX_EXP;
         default:
@@ -196,6 +218,8 @@ double bh_type_limit_min_float(bh_type type)
 {
     switch(type)
     {
+        case bh_type::FLOAT16: return -13;
+        case bh_type::BFLOAT16:
         case bh_type::FLOAT32: return FLT_MIN_EXP;
         case bh_type::FLOAT64: return DBL_MIN_EXP;
         default:
@@ -203,3 +227,74 @@ double bh_type_limit_min_float(bh_type type)
             return 0;
     }
 }
+
+namespace {
+uint32_t float_bits(float value) {
+    uint32_t ret;
+    memcpy(&ret, &value, sizeof(ret));
+    return ret;
+}
+
+float bits_float(uint32_t bits) {
+    float ret;
+    memcpy(&ret, &bits, sizeof(ret));
+    return ret;
+}
+}
+
+// Round to nearest even, which saturates to infinity and keeps NaN a (quiet) NaN
+bh_float16::bh_float16(float value)
+{
+    const uint32_t f = float_bits(value);
+    const uint16_t sign = static_cast<uint16_t>((f >> 16) & 0x8000u);
+    const uint32_t abs = f & 0x7fffffffu;
+    if (abs >= 0x7f800000u) { // Inf or NaN
+        bits = sign | 0x7c00u | (abs > 0x7f800000u ? 0x200u : 0u);
+    } else if (abs >= 0x477ff000u) { // Rounds to a value larger than the largest half
+        bits = sign | 0x7c00u;
+    } else if (abs < 0x38800000u) { // A subnormal half, which the float addition rounds for us
+        bits = sign | static_cast<uint16_t>(float_bits(bits_float(abs) + 0.5f) - 0x3f000000u);
+    } else {
+        const uint32_t mant_odd = (abs >> 13) & 1u;
+        bits = sign | static_cast<uint16_t>((abs + 0xc8000fffu + mant_odd) >> 13);
+    }
+}
+
+bh_float16::operator float() const
+{
+    const uint32_t sign = static_cast<uint32_t>(bits & 0x8000u) << 16;
+    const uint32_t exp = (bits >> 10) & 0x1fu;
+    const uint32_t mant = bits & 0x3ffu;
+    if (exp == 0x1fu) { // Inf or NaN
+        return bits_float(sign | 0x7f800000u | (mant << 13));
+    } else if (exp == 0) { // Zero or subnormal
+        const float value = static_cast<float>(mant) * (1.0f / 16777216.0f);
+        return sign ? -value : value;
+    }
+    return bits_float(sign | ((exp + 112) << 23) | (mant << 13));
+}
+
+bh_bfloat16::bh_bfloat16(float value)
+{
+    const uint32_t f = float_bits(value);
+    if ((f & 0x7fffffffu) > 0x7f800000u) { // NaN
+        bits = static_cast<uint16_t>((f >> 16) | 0x40u);
+    } else {
+        bits = static_cast<uint16_t>((f + 0x7fffu + ((f >> 16) & 1u)) >> 16);
+    }
+}
+
+bh_bfloat16::operator float() const
+{
+    return bits_float(static_cast<uint32_t>(bits) << 16);
+}
+
+std::ostream &operator<<(std::ostream &out, bh_float16 value)
+{
+    return out << static_cast<float>(value);
+}
+
+std::ostream &operator<<(std::ostream &out, bh_bfloat16 value)
+{
+    return out << static_cast<float>(value);
+}
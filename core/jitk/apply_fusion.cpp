@@ -19,6 +19,11 @@ If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include <cassert>
+#include <fstream>
+#include <memory>
+#include <algorithm>
+
+#include <bh_trace.hpp>
 
 #include <jitk/apply_fusion.hpp>
 #include <jitk/graph.hpp>
@@ -41,16 +46,29 @@ vector<Block> apply_pre_fusion(const vector<bh_instruction*> &instr_list,
     }
 }
 
+namespace {
+// Returns the price model of the greedy and beam fusers, which is the config option "fuse_model"
+graph::FuseModel fuse_model(const ConfigParser &config) {
+    return graph::fuse_model_from_string(config.defaultGet<string>("fuse_model", "bytes"));
+}
+} // Anon namespace
+
 void apply_transformers(vector<Block> &block_list, const vector<string> &transformer_names,
-                        bool avoid_rank0_sweep) {
+                        bool avoid_rank0_sweep, const ConfigParser &config) {
 
     for(auto it = transformer_names.begin(); it != transformer_names.end(); ++it) {
         if (*it == "push_reductions_inwards") {
             push_reductions_inwards(block_list);
+        } else if (*it == "push_unit_stride_inwards") {
+            push_unit_stride_inwards(block_list);
         } else if (*it == "split_for_threading") {
             split_for_threading(block_list);
         } else if (*it == "collapse_redundant_axes") {
             collapse_redundant_axes(block_list);
+        } else if (*it == "block_column_reductions") {
+            block_column_reductions(block_list, config.defaultGet<int64_t>("column_block_bytes", 4096));
+        } else if (*it == "tile_loops") {
+            tile_loops(block_list, config.defaultGet<int64_t>("tile_size", 32));
         } else if (*it == "serial") {
             fuser_serial(block_list, avoid_rank0_sweep);
         } else if (*it == "breadth_first") {
@@ -58,7 +76,15 @@ void apply_transformers(vector<Block> &block_list, const vector<string> &transfo
         } else if (*it == "reshapable_first") {
             fuser_reshapable_first(block_list, avoid_rank0_sweep);
         } else if (*it == "greedy") {
-            fuser_greedy(block_list, avoid_rank0_sweep);
+            fuser_greedy(block_list, avoid_rank0_sweep, fuse_model(config));
+        } else if (*it == "cost_model") {
+            fuser_cost_model(block_list, avoid_rank0_sweep, CostModel(config), fuse_model(config));
+        } else if (*it == "beam") {
+            const size_t width = config.defaultGet<size_t>("beam_width", 4);
+            const double budget = config.defaultGet<double>("beam_time_budget", 0.1);
+            const auto deadline = chrono::steady_clock::now() + chrono::duration_cast<chrono::steady_clock::duration>(
+                    chrono::duration<double>(budget));
+            fuser_beam(block_list, avoid_rank0_sweep, width, deadline, fuse_model(config));
         } else {
             cout << "Unknown transformer: \"" << *it << "\"" << endl;
             throw runtime_error("Unknown transformer!");
@@ -77,21 +103,46 @@ vector<Block> get_block_list(const vector<bh_instruction*> &instr_list, const Co
         instr->origin_id = count++;
     }
 
-    bool hit;
-    tie(block_list, hit) = fcache.get(instr_list);
-    if (not hit) {
-        const auto tpre_fusion = chrono::steady_clock::now();
-        stat.num_instrs_into_fuser += instr_list.size();
-        // Let's fuse the 'instr_list' into blocks
-        // We start with the pre_fuser
-        block_list = apply_pre_fusion(instr_list, config.defaultGet("pre_fuser", string("pre_fuser_lossy")));
-        stat.num_blocks_out_of_fuser += block_list.size();
-        const auto tfusion = chrono::steady_clock::now();
-        stat.time_pre_fusion += tfusion - tpre_fusion;
-        // Then we fuse fully
-        apply_transformers(block_list, config.defaultGetList("fuser_list", {"greedy"}), avoid_rank0_sweep);
-        stat.time_fusion += chrono::steady_clock::now() - tfusion;
-        fcache.insert(instr_list, block_list);
+    // The cache might cover a prefix of 'instr_list' in which case we only have to fuse the rest
+    size_t covered;
+    tie(block_list, covered) = fcache.get(instr_list);
+    if (covered < instr_list.size()) {
+        // We fuse in two stages: up until the last segment and the last segment. Thus, a later flush that only
+        // differs in its last segment (e.g. in its trailing BH_SYNC and BH_FREE) hits the first stage.
+        vector<size_t> stages;
+        const vector<size_t> ends = FuseCache::segment_ends(instr_list);
+        if (ends.size() > 1 and ends[ends.size()-2] > covered) {
+            stages.push_back(ends[ends.size()-2]);
+        }
+        stages.push_back(instr_list.size());
+
+        for (size_t end: stages) {
+            const auto tpre_fusion = chrono::steady_clock::now();
+            const vector<bh_instruction*> segment(instr_list.begin() + covered, instr_list.begin() + end);
+            stat.num_instrs_into_fuser += segment.size();
+            // Let's fuse the 'segment' into blocks, which we append to the already fused blocks
+            // We start with the pre_fuser
+            vector<Block> new_blocks;
+            {
+                trace::Scope pre_fusion_scope("jitk", "pre-fusion");
+                pre_fusion_scope.arg("instructions", segment.size());
+                new_blocks = apply_pre_fusion(segment, config.defaultGet("pre_fuser", string("pre_fuser_lossy")));
+            }
+            stat.num_blocks_out_of_fuser += new_blocks.size();
+            block_list.insert(block_list.end(), new_blocks.begin(), new_blocks.end());
+            const auto tfusion = chrono::steady_clock::now();
+            stat.time_pre_fusion += tfusion - tpre_fusion;
+            // Then we fuse fully, which also fuses the new blocks with the already fused blocks
+            {
+                trace::Scope fusion_scope("jitk", "fusion");
+                fusion_scope.arg("blocks", block_list.size());
+                apply_transformers(block_list, config.defaultGetList("fuser_list", {"greedy"}), avoid_rank0_sweep,
+                                   config);
+            }
+            stat.time_fusion += chrono::steady_clock::now() - tfusion;
+            fcache.insert(instr_list, end, block_list);
+            covered = end;
+        }
     }
 
     // Pretty printing the block
@@ -99,6 +150,20 @@ vector<Block> get_block_list(const vector<bh_instruction*> &instr_list, const Co
         graph::DAG dag = graph::from_block_list(block_list);
         graph::pprint(dag, "dag", avoid_rank0_sweep);
     }
+    if (config.defaultGet<bool>("fusion_report", false)) {
+        const vector<string> fuser_list = config.defaultGetList("fuser_list", {"greedy"});
+        unique_ptr<CostModel> cost_model;
+        if (find(fuser_list.begin(), fuser_list.end(), "cost_model") != fuser_list.end()) {
+            cost_model.reset(new CostModel(config));
+        }
+        graph::DAG dag = graph::from_block_list(block_list);
+        static int count = 0;
+        stringstream ss;
+        ss << "fusion_report-" << count++ << ".txt";
+        cout << ss.str() << endl;
+        ofstream file(ss.str());
+        file << graph::fusion_report(dag, avoid_rank0_sweep, cost_model.get());
+    }
 
     return block_list;
 }
@@ -19,6 +19,7 @@ If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include <sstream>
+#include <algorithm>
 #include <cassert>
 
 #include <bh_util.hpp>
@@ -31,9 +32,75 @@ namespace bohrium {
 namespace jitk {
 
 namespace {
+/* A per-thread free list of memory nodes of 'SIZE' bytes, which keeps at most 'MAX_NODES' nodes.
+ * NB: the pool is trivially destructible thus a thread that exits leaks its free nodes, which in return makes it
+ *     safe to free instructions during the static destruction
+ */
+template <size_t SIZE>
+struct NodePool {
+    static constexpr size_t MAX_NODES = 4096;
+    struct Node {
+        Node *next;
+    };
+    static thread_local Node *head;
+    static thread_local size_t count;
+
+    static void *allocate() {
+        if (head == NULL) {
+            return ::operator new(std::max(SIZE, sizeof(Node)));
+        }
+        Node *ret = head;
+        head = head->next;
+        --count;
+        return ret;
+    }
+    static void deallocate(void *p) {
+        if (count >= MAX_NODES) {
+            ::operator delete(p);
+            return;
+        }
+        Node *node = static_cast<Node *>(p);
+        node->next = head;
+        head = node;
+        ++count;
+    }
+};
+template <size_t SIZE> thread_local typename NodePool<SIZE>::Node *NodePool<SIZE>::head = NULL;
+template <size_t SIZE> thread_local size_t NodePool<SIZE>::count = 0;
+
+// The allocator of make_instr(), which std::allocate_shared() rebinds to the node of an instruction and its counts
+template <typename T>
+struct PoolAllocator {
+    typedef T value_type;
+    PoolAllocator() = default;
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U> &) {}
+
+    T *allocate(size_t n) {
+        if (n == 1) {
+            return static_cast<T *>(NodePool<sizeof(T)>::allocate());
+        }
+        return static_cast<T *>(::operator new(n * sizeof(T)));
+    }
+    void deallocate(T *p, size_t n) {
+        if (n == 1) {
+            NodePool<sizeof(T)>::deallocate(p);
+        } else {
+            ::operator delete(p);
+        }
+    }
+};
+template <typename T, typename U>
+bool operator==(const PoolAllocator<T> &, const PoolAllocator<U> &) { return true; }
+template <typename T, typename U>
+bool operator!=(const PoolAllocator<T> &, const PoolAllocator<U> &) { return false; }
+
 void spaces(stringstream &out, int num) {
-    for (int i = 0; i < num; ++i) {
-        out << " ";
+    static const string blanks(128, ' ');
+    while (num > 0) {
+        const int n = std::min(num, static_cast<int>(blanks.size()));
+        out.write(blanks.data(), n);
+        num -= n;
     }
 }
 
@@ -333,6 +400,9 @@ string LoopB::pprint(const char *newline) const {
     if (_reshapable) {
         ss << ", reshapable";
     }
+    if (tile_size > 0) {
+        ss << ", tile: " << tile_size;
+    }
     if (_news.size() > 0) {
         ss << ", news: {";
         for (const bh_base *b : _news) {
@@ -497,6 +567,14 @@ Block create_nested_block(const vector<InstrPtr> &instr_list, int rank, int64_t
 
 pair<vector<const LoopB *>, uint64_t> util_find_threaded_blocks(const LoopB &block) {
     pair<vector<const LoopB*>, uint64_t> ret;
+    ret.second = 1;
+
+    // An add-scatter accumulates into arbitrary elements thus no loop around it is data-parallel
+    for (const InstrPtr &instr: block.getAllInstr()) {
+        if (instr->opcode == BH_ADD_SCATTER) {
+            return ret;
+        }
+    }
 
     // We should search in 'this' block and its sub-blocks
     vector<const LoopB *> block_list = {&block};
@@ -504,7 +582,6 @@ pair<vector<const LoopB *>, uint64_t> util_find_threaded_blocks(const LoopB &blo
 
     // Find threaded blocks
     constexpr int MAX_NUM_OF_THREADED_BLOCKS = 3;
-    ret.second = 1;
     for (const LoopB *b: block_list) {
         if (b->_sweeps.size() > 0) {
             break;
@@ -569,14 +646,14 @@ bool data_parallel_compatible(const InstrPtr a, const InstrPtr b) {
     }
 
     // Scatter writes in arbitrary order
-    if (a->opcode == BH_SCATTER or a->opcode == BH_COND_SCATTER) {
+    if (a->opcode == BH_SCATTER or a->opcode == BH_COND_SCATTER or a->opcode == BH_ADD_SCATTER) {
 
         for(size_t i=0; i<b->operand.size(); ++i) {
             if ((not bh_is_constant(&b->operand[i])) and a->operand[0].base == b->operand[i].base) {
                 return false;
             }
         }
-    } else if (b->opcode == BH_SCATTER or b->opcode == BH_COND_SCATTER) {
+    } else if (b->opcode == BH_SCATTER or b->opcode == BH_COND_SCATTER or b->opcode == BH_ADD_SCATTER) {
         for(size_t i=0; i<a->operand.size(); ++i) {
             if ((not bh_is_constant(&a->operand[i])) and b->operand[0].base == a->operand[i].base) {
                 return false;
@@ -620,9 +697,12 @@ bool data_parallel_compatible(const LoopB &b1, const LoopB &b2) {
 
 // Check if 'block' accesses the output of a sweep in 'sweeps'
 bool sweeps_accessed_by_block(const set<InstrPtr> &sweeps, const LoopB &loop_block) {
-    for (InstrPtr instr: sweeps) {
+    if (sweeps.empty()) {
+        return false;
+    }
+    const auto bases = loop_block.getAllBases();
+    for (const InstrPtr &instr: sweeps) {
         assert(instr->operand.size() > 0);
-        auto bases = loop_block.getAllBases();
         if (bases.find(instr->operand[0].base) != bases.end())
             return true;
     }
@@ -641,6 +721,14 @@ Block reshape(const LoopB &l1, int64_t size_of_rank_dim) {
 } // Unnamed namespace
 
 
+InstrPtr make_instr(const bh_instruction &instr) {
+    return std::allocate_shared<bh_instruction>(PoolAllocator<bh_instruction>(), instr);
+}
+
+InstrPtr make_instr(bh_instruction &&instr) {
+    return std::allocate_shared<bh_instruction>(PoolAllocator<bh_instruction>(), std::move(instr));
+}
+
 // Reshape and merges the two loop blocks 'l1' and 'l2' (in that order).
 // NB: the loop blocks must be mergeable!
 Block reshape_and_merge(const LoopB &l1, const LoopB &l2) {
@@ -663,35 +751,42 @@ Block reshape_and_merge(const LoopB &l1, const LoopB &l2) {
 
 
 bool mergeable(const Block &b1, const Block &b2, bool avoid_rank0_sweep) {
+    return unmergeable_reason(b1, b2, avoid_rank0_sweep) == NULL;
+}
+
+const char *unmergeable_reason(const Block &b1, const Block &b2, bool avoid_rank0_sweep) {
     if (b1.isInstr() or b2.isInstr()) {
-        return false;
+        return "instruction block";
     }
     const LoopB &l1 = b1.getLoop();
     const LoopB &l2 = b2.getLoop();
 
     // System-only blocks are very flexible because they array sizes does not have to match when reshaping.
     if (l2.isSystemOnly()) {
-        return true;
+        return NULL;
     }
 
     // We might have to avoid fusion when one of the (root) blocks are sweeping
     if (avoid_rank0_sweep and l1.rank == 0 and l2.rank == 0) {
         if ((l1._sweeps.size() > 0) != (l2._sweeps.size() > 0)) {
-            return false;
+            return "rank-0 sweep avoidance";
         }
     }
 
     // If instructions in 'b2' reads the sweep output of 'b1' than we cannot merge them
     if (sweeps_accessed_by_block(l1._sweeps, l2)) {
-        return false;
+        return "reads a sweep output";
     }
 
     if (l1.size == l2.size or // Perfect match
         (l2._reshapable && l2.size % l1.size == 0) or // 'l2' is reshapable to match 'l1'
         (l1._reshapable && l1.size % l2.size == 0)) { // 'l1' is reshapable to match 'l2'
-        return data_parallel_compatible(l1, l2);
+        if (not data_parallel_compatible(l1, l2)) {
+            return "not data-parallel compatible";
+        }
+        return NULL;
     } else {
-        return false;
+        return "shape mismatch";
     }
 }
 
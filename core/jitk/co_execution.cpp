@@ -0,0 +1,195 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <set>
+#include <cmath>
+#include <algorithm>
+
+#include <bh_opcode.h>
+#include <jitk/co_execution.hpp>
+
+using namespace std;
+
+namespace bohrium {
+namespace jitk {
+
+namespace {
+
+// Returns 'share' clamped to the shares that leaves iterations to both the device and the CPU
+int clamp_share(long share, int steps) {
+    return static_cast<int>(std::max<long>(1, std::min<long>(steps - 1, share)));
+}
+
+// Returns true when the rows of 'view' along the first axis cover disjoint and ascending memory
+bool disjoint_rows(const bh_view &view) {
+    if (view.stride[0] <= 0) {
+        return false;
+    }
+    int64_t row_span = 1;
+    for (int64_t i = 1; i < view.ndim; ++i) {
+        if (view.stride[i] < 0) {
+            return false;
+        }
+        row_span += (view.shape[i] - 1) * view.stride[i];
+    }
+    return row_span <= view.stride[0];
+}
+
+// Returns 'instr' where each view is sliced to [begin, end) along the first axis
+bh_instruction slice(const bh_instruction &instr, int64_t begin, int64_t end) {
+    bh_instruction ret(instr);
+    for (bh_view &view: ret.operand) {
+        if (not bh_is_constant(&view)) {
+            view.start += begin * view.stride[0];
+            view.shape[0] = end - begin;
+        }
+    }
+    return ret;
+}
+
+// Slices the instructions of 'loop' and its sub-blocks to [begin, end) along the first axis
+void slice_loop(LoopB &loop, int64_t begin, int64_t end) {
+    for (Block &b: loop._block_list) {
+        if (not b.isInstr()) {
+            slice_loop(b.getLoop(), begin, end);
+        } else if (not bh_opcode_is_system(b.getInstr()->opcode)) {
+            b.setInstr(slice(*b.getInstr(), begin, end));
+        }
+    }
+    // The sweeps points to the instructions thus they must be found again
+    loop._sweeps.clear();
+    for (const InstrPtr &instr: loop.getAllInstr()) {
+        if (instr->sweep_axis() == loop.rank) {
+            loop._sweeps.insert(instr);
+        }
+    }
+}
+
+} // Anon namespace
+
+CoExecution::CoExecution(const ConfigParser &config) :
+        min_elements(config.defaultGet<uint64_t>("co_execution_min_elements", 1048576)),
+        steps(std::max(2, config.defaultGet<int>("co_execution_steps", 8))),
+        initial(clamp_share(std::lround(config.defaultGet<double>("co_execution_device_share", 0.75) * steps),
+                            steps)) {}
+
+bool CoExecution::splittable(const LoopB &block) const {
+    if (block.rank != 0 or not block._sweeps.empty() or block.tile_size > 0 or block.size < 2) {
+        return false;
+    }
+    const vector<InstrPtr> instr_list = block.getAllInstr();
+    const set<bh_base *> temps = block.getAllTemps();
+    map<const bh_base *, const bh_view *> written;
+    uint64_t nelem = 0;
+    for (const InstrPtr &instr: instr_list) {
+        if (bh_opcode_is_system(instr->opcode)) {
+            continue;
+        }
+        // The result of these depends on more than the elements of the same row
+        switch (instr->opcode) {
+            case BH_RANGE:
+            case BH_RANDOM:
+            case BH_GATHER:
+            case BH_SCATTER:
+            case BH_COND_SCATTER:
+            case BH_ADD_SCATTER:
+                return false;
+            default:
+                break;
+        }
+        for (const bh_view &view: instr->operand) {
+            if (not bh_is_constant(&view) and (view.ndim < 1 or view.shape[0] != block.size)) {
+                return false;
+            }
+        }
+        const bh_view &out = instr->operand[0];
+        if (temps.find(out.base) == temps.end()) {
+            if (not disjoint_rows(out)) {
+                return false;
+            }
+            auto it = written.insert(make_pair(out.base, &out)).first;
+            if (not (*it->second == out)) {
+                return false;
+            }
+        }
+        const vector<int64_t> shape = instr->shape();
+        nelem = std::max<uint64_t>(nelem, static_cast<uint64_t>(bh_nelements(shape.size(), &shape[0])));
+    }
+    // A row must not read the rows of the other share, which it could through another view of a written array
+    for (const InstrPtr &instr: instr_list) {
+        for (const bh_view &view: instr->operand) {
+            if (not bh_is_constant(&view) and not bh_opcode_is_system(instr->opcode)) {
+                auto it = written.find(view.base);
+                if (it != written.end() and not (*it->second == view)) {
+                    return false;
+                }
+            }
+        }
+    }
+    return nelem >= min_elements;
+}
+
+int64_t CoExecution::split(const vector<int64_t> &key, int64_t size) {
+    auto it = _shares.find(key);
+    const int share = it == _shares.end() ? initial : it->second;
+    return std::max<int64_t>(1, std::min<int64_t>(size - 1, size * share / steps));
+}
+
+void CoExecution::update(const vector<int64_t> &key, int64_t split, int64_t size, double cpu_seconds,
+                         double wait_seconds) {
+    int &share = _shares.insert(make_pair(key, initial)).first->second;
+    // When the device finished with the CPU, all we know is that the device might handle more iterations
+    if (wait_seconds <= 0.01 * cpu_seconds) {
+        share = clamp_share(share + 1, steps);
+        return;
+    }
+    const double device_rate = split / (cpu_seconds + wait_seconds);
+    const double cpu_rate = (size - split) / cpu_seconds;
+    share = clamp_share(std::lround(steps * device_rate / (device_rate + cpu_rate)), steps);
+}
+
+LoopB slice_outermost(const LoopB &block, int64_t begin, int64_t end) {
+    LoopB ret(block);
+    ret.size = end - begin;
+    slice_loop(ret, begin, end);
+    return ret;
+}
+
+vector<bh_instruction> slice_instr(const LoopB &block, int64_t begin, int64_t end) {
+    vector<bh_instruction> ret;
+    for (const InstrPtr &instr: block.getAllInstr()) {
+        if (not bh_opcode_is_system(instr->opcode)) {
+            ret.push_back(slice(*instr, begin, end));
+        }
+    }
+    return ret;
+}
+
+pair<uint64_t, uint64_t> view_byte_range(const bh_view &view) {
+    int64_t last = view.start;
+    for (int64_t i = 0; i < view.ndim; ++i) {
+        last += (view.shape[i] - 1) * view.stride[i];
+    }
+    const uint64_t elem_size = bh_type_size(view.base->type);
+    return make_pair(view.start * elem_size, (last - view.start + 1) * elem_size);
+}
+
+} // jitk
+} // bohrium
@@ -0,0 +1,160 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cstring>
+#include <algorithm>
+
+#include <jitk/codegen_cache.hpp>
+
+
+using namespace std;
+
+namespace bohrium {
+namespace jitk {
+
+namespace {
+
+constexpr int64_t SEP_INSTR = INT64_MIN;
+constexpr int64_t SEP_OP = INT64_MIN + 1;
+constexpr int64_t SEP_BLOCK = INT64_MIN + 2;
+constexpr int64_t SEP_KERNEL = INT64_MIN + 3;
+constexpr int64_t SEP_CONST = INT64_MIN + 4;
+
+// Appends the symbol IDs of 'bases' in sorted order
+template<typename T>
+void key_bases(const T &bases, const SymbolTable &symbols, vector<int64_t> &out) {
+    vector<int64_t> ids;
+    for (const bh_base *base: bases) {
+        ids.push_back(symbols.baseID(base));
+    }
+    sort(ids.begin(), ids.end());
+    out.insert(out.end(), ids.begin(), ids.end());
+    out.push_back(SEP_OP);
+}
+
+/* The constant key consists of the following fields:
+ * <SEP_CONST><type><const_id>[<value>]
+ * where the value is only included when the constant is hard-coded
+ */
+void key_constant(const bh_constant &constant, int64_t const_id, vector<int64_t> &out) {
+    out.push_back(SEP_CONST);
+    out.push_back(static_cast<int64_t>(constant.type));
+    out.push_back(const_id);
+    if (const_id < 0) {
+        int64_t value[2] = {0, 0};
+        static_assert(sizeof(value) >= sizeof(constant.value), "the constant value must fit two int64_t");
+        memcpy(value, &constant.value, bh_type_size(constant.type));
+        out.push_back(value[0]);
+        out.push_back(value[1]);
+    }
+}
+
+/* The view key consists of the following fields:
+ * <base_id><base_type><base_nelem><start><ndim>[<shape><stride>...]<SEP_OP>
+ */
+void key_view(const bh_view &view, const SymbolTable &symbols, vector<int64_t> &out) {
+    out.push_back(symbols.baseID(view.base));
+    out.push_back(static_cast<int64_t>(view.base->type));
+    out.push_back(view.base->nelem);
+    out.push_back(view.start);
+    out.push_back(view.ndim);
+    for (int64_t i = 0; i < view.ndim; ++i) {
+        out.push_back(view.shape[i]);
+        out.push_back(view.stride[i]);
+    }
+    out.push_back(SEP_OP);
+}
+
+/* The instruction key consists of the following fields:
+ * <opcode><constructor>[<key_view>|<key_constant>...]<SEP_INSTR>
+ */
+void key_instr(const bh_instruction &instr, const SymbolTable &symbols, vector<int64_t> &out) {
+    out.push_back(instr.opcode);
+    out.push_back(instr.constructor);
+    for (const bh_view &op: instr.operand) {
+        if (bh_is_constant(&op)) {
+            key_constant(instr.constant, symbols.constID(instr), out);
+        } else {
+            key_view(op, symbols, out);
+        }
+    }
+    out.push_back(SEP_INSTR);
+}
+
+/* The block key consists of the following fields:
+ * <rank><size><loop_size_id><reshapable><tile_size><num_sweeps><news><frees>[<key_instr>|<key_block>...]<SEP_BLOCK>
+ */
+void key_block(const LoopB &block, const SymbolTable &symbols, vector<int64_t> &out) {
+    out.push_back(block.rank);
+    out.push_back(block.size);
+    out.push_back(symbols.loopSizeID(block.size));
+    out.push_back(block._reshapable);
+    out.push_back(block.tile_size);
+    out.push_back(block._sweeps.size());
+    key_bases(block._news, symbols, out);
+    key_bases(block._frees, symbols, out);
+    for (const Block &b: block._block_list) {
+        if (b.isInstr()) {
+            key_instr(*b.getInstr(), symbols, out);
+        } else {
+            key_block(b.getLoop(), symbols, out);
+        }
+    }
+    out.push_back(SEP_BLOCK);
+}
+
+} // Anon namespace
+
+vector<int64_t> CodegenCache::fingerprint(const Kernel &kernel, const SymbolTable &symbols,
+                                          const vector<const LoopB*> &threaded_blocks) {
+    vector<int64_t> ret;
+    ret.reserve(256);
+    ret.push_back(kernel.useRandom());
+    // NB: the order of the non-temporary arrays matters since they make up the kernel parameters
+    for (const bh_base *base: kernel.getNonTemps()) {
+        ret.push_back(symbols.baseID(base));
+    }
+    ret.push_back(SEP_OP);
+    key_bases(kernel.getAllTemps(), symbols, ret);
+    for (const LoopB *b: threaded_blocks) {
+        ret.push_back(b->rank);
+    }
+    ret.push_back(SEP_KERNEL);
+    key_block(kernel.block, symbols, ret);
+    return ret;
+}
+
+pair<string, bool> CodegenCache::get(const Key &fingerprint) {
+    ++stat.codegen_cache_lookups;
+    auto it = _cache.find(fingerprint);
+    if (it != _cache.end()) { // Cache hit!
+        return make_pair(it->second, true);
+    } else { // Cache miss!
+        ++stat.codegen_cache_misses;
+        return make_pair(string(), false);
+    }
+}
+
+void CodegenCache::insert(const Key &fingerprint, const string &source) {
+    _cache.insert(make_pair(fingerprint, source));
+}
+
+} // jitk
+} // bohrium
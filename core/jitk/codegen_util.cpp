@@ -19,11 +19,15 @@ If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include <limits>
+#include <algorithm>
+#include <cstdlib>
 #include <iomanip>
+#include <unistd.h>
 #include <jitk/codegen_util.hpp>
 #include <jitk/view.hpp>
 #include <jitk/instruction.hpp>
 #include <jitk/kernel.hpp>
+#include <jitk/graph.hpp>
 
 using namespace std;
 
@@ -45,8 +49,11 @@ bool sweeping_innermost_axis(InstrPtr instr) {
 
 
 void spaces(std::stringstream &out, int num) {
-    for (int i = 0; i < num; ++i) {
-        out << " ";
+    static const string blanks(128, ' ');
+    while (num > 0) {
+        const int n = std::min(num, static_cast<int>(blanks.size()));
+        out.write(blanks.data(), n);
+        num -= n;
     }
 }
 
@@ -56,6 +63,39 @@ string hash_filename(size_t hash, string extension) {
     return ss.str();
 }
 
+string util_memory_report(size_t num_largest) {
+    const char *names[BH_MEMORY_NUM_DEVICES] = {"host", "CUDA", "OpenCL"};
+    const double mb = 1024.0 * 1024.0;
+    stringstream ss;
+    ss << fixed << setprecision(3);
+    for (int device = 0; device < BH_MEMORY_NUM_DEVICES; ++device) {
+        uint64_t current, peak;
+        bh_memory_usage(device, &current, &peak);
+        if (peak == 0) {
+            continue;
+        }
+        ss << "[Memory] " << names[device] << ": " << current / mb << " MB live, " << peak / mb << " MB peak\n";
+        uint64_t counts[BH_MEMORY_SIZE_CLASSES];
+        bh_memory_size_classes(device, counts);
+        ss << "  allocations per size class:\n";
+        for (int i = 0; i < BH_MEMORY_SIZE_CLASSES; ++i) {
+            if (counts[i] > 0) {
+                ss << "    <= 2^" << setw(2) << i << " bytes: " << counts[i] << "\n";
+            }
+        }
+        vector<const void *> keys(num_largest);
+        vector<uint64_t> bytes(num_largest);
+        const uint64_t num = bh_memory_largest(device, num_largest, keys.data(), bytes.data());
+        if (num > 0) {
+            ss << "  largest live arrays:\n";
+        }
+        for (uint64_t i = 0; i < num; ++i) {
+            ss << "    " << keys[i] << ": " << bytes[i] / mb << " MB\n";
+        }
+    }
+    return ss.str();
+}
+
 boost::filesystem::path write_source2file(const std::string &src,
                                           const boost::filesystem::path &dir,
                                           size_t hash,
@@ -73,6 +113,68 @@ boost::filesystem::path write_source2file(const std::string &src,
     return srcfile;
 }
 
+void util_record_source(Statistics &stat, size_t hash, const std::string &source,
+                        const boost::filesystem::path &dir, const std::string &file_ext) {
+    if (stat.enabled) {
+        KernelProfile &k = stat.kernel_profiles[hash];
+        if (k.source_file.empty()) {
+            k.source_file = write_source2file(source, dir, hash, file_ext, false).string();
+        }
+    }
+}
+
+boost::filesystem::path expand_user(const string &path) {
+    if (path.size() > 0 and path[0] == '~') {
+        const char *home = getenv("HOME");
+        if (home != NULL) {
+            return boost::filesystem::path(home) / path.substr(1);
+        }
+    }
+    return boost::filesystem::path(path);
+}
+
+namespace {
+// The first line of a kernel trace, which is followed by the name of the backend
+const string trace_header = "# Bohrium kernel trace: ";
+}
+
+/* The kernel trace consists of the header line followed by each kernel:
+ * <source size>\n<source>
+ */
+void write_kernel_trace(const string &filename, const string &backend_name, const vector<string> &sources) {
+    ofstream ofs(filename);
+    if (not ofs.good()) {
+        throw runtime_error("write_kernel_trace(): cannot open '" + filename + "'");
+    }
+    ofs << trace_header << backend_name << "\n";
+    for (const string &src: sources) {
+        ofs << src.size() << "\n" << src;
+    }
+}
+
+vector<string> read_kernel_trace(const string &filename, const string &backend_name) {
+    ifstream ifs(filename);
+    if (not ifs.good()) {
+        throw runtime_error("read_kernel_trace(): cannot open '" + filename + "'");
+    }
+    vector<string> ret;
+    string header;
+    getline(ifs, header);
+    if (header != trace_header + backend_name) {
+        return ret;
+    }
+    size_t size;
+    while (ifs >> size) {
+        ifs.ignore(1); // The newline after the size
+        string src(size, '\0');
+        if (not ifs.read(&src[0], size)) {
+            throw runtime_error("read_kernel_trace(): '" + filename + "' is truncated");
+        }
+        ret.push_back(std::move(src));
+    }
+    return ret;
+}
+
 pair<uint32_t, uint32_t> work_ranges(uint64_t work_group_size, int64_t block_size) {
     if (numeric_limits<uint32_t>::max() <= work_group_size or
         numeric_limits<uint32_t>::max() <= block_size or
@@ -114,6 +216,12 @@ void write_kernel_function_arguments(const Kernel &kernel, const SymbolTable &sy
             ss << " vs" << symbols.offsetStridesID(*view) << "_" << i;
         }
     }
+    for (size_t i = 0; i < symbols.loopSizes().size(); ++i) {
+        ss << ", " << type_writer(bh_type::UINT64);
+        if (all_pointers)
+            ss << "*";
+        ss << " vsz" << i;
+    }
     if (symbols.constIDs().size() > 0) {
         if (kernel.getNonTemps().size() > 0) {
             ss << ", "; // If any args were written before us, we need a comma
@@ -132,6 +240,588 @@ void write_kernel_function_arguments(const Kernel &kernel, const SymbolTable &sy
     ss << ")";
 }
 
+void write_loop_size(const SymbolTable &symbols, const LoopB &block, stringstream &out) {
+    const int64_t id = symbols.loopSizeID(block.size);
+    if (id >= 0) {
+        out << "vsz" << id;
+    } else {
+        out << block.size;
+    }
+}
+
+void write_tile_loops(const SymbolTable &symbols, const LoopB &block, stringstream &out) {
+    assert(block.tile_size > 0 and block._block_list.size() == 1);
+    for (const LoopB *loop: {&block, &block._block_list[0].getLoop()}) {
+        out << "for(uint64_t ii" << loop->rank << "=0; ii" << loop->rank << " < ";
+        write_loop_size(symbols, *loop, out);
+        out << "; ii" << loop->rank << " += " << loop->tile_size << ") {\n";
+        spaces(out, 4 + block.rank * 4);
+    }
+}
+
+void write_tiled_loop_range(const SymbolTable &symbols, const LoopB &block, stringstream &out) {
+    assert(block.tile_size > 0);
+    out << "i" << block.rank << "=ii" << block.rank << "; i" << block.rank << " < (ii" << block.rank
+        << "+" << block.tile_size << " < ";
+    write_loop_size(symbols, block, out);
+    out << " ? ii" << block.rank << "+" << block.tile_size << " : ";
+    write_loop_size(symbols, block, out);
+    out << ")";
+}
+
+namespace {
+
+// Returns true when the instructions of 'block' are basic elementwise instructions on one non-complex type, which
+// is written to 'type', where the arrays are contiguous along the axis of 'block' and only accessed through identical
+// views and where the temporaries are local to 'block'
+bool simd_elementwise_type(const Scope &scope, const LoopB &block, const set<bh_base *> &local_tmps, bh_type &type) {
+    bool has_type = false;
+    vector<const bh_view *> arrays;
+    for (const InstrPtr &instr: block.getLocalInstr()) {
+        if (bh_opcode_is_system(instr->opcode)) {
+            continue;
+        }
+        switch (instr->opcode) {
+            case BH_ADD:
+            case BH_SUBTRACT:
+            case BH_MULTIPLY:
+            case BH_DIVIDE:
+            case BH_IDENTITY:
+            case BH_BITWISE_AND:
+            case BH_BITWISE_OR:
+            case BH_BITWISE_XOR:
+                break;
+            default:
+                return false;
+        }
+        for (const bh_view &view: instr->operand) {
+            if (bh_is_constant(&view)) {
+                continue;
+            }
+            if (not has_type) {
+                type = view.base->type;
+                has_type = true;
+            } else if (view.base->type != type) {
+                return false;
+            }
+            // The 16-bit floating-point types are converted to float32, which we leave to the compiler
+            if (bh_type_compute(type) != type) {
+                return false;
+            }
+            if (scope.isTmp(view.base)) {
+                if (local_tmps.find(view.base) == local_tmps.end()) {
+                    return false;
+                }
+                continue;
+            }
+            if (not (scope.isArray(view) or scope.isScalarReplaced_R(view)) or view.ndim <= block.rank or
+                view.stride[block.rank] != 1) {
+                return false;
+            }
+            for (const bh_view *v: arrays) {
+                if (v->base == view.base and not (*v == view)) {
+                    return false;
+                }
+            }
+            arrays.push_back(&view);
+        }
+        // Integer division needs the Python semantic and bitwise operations needs integers
+        const bool is_float = bh_type_is_float(type);
+        if (instr->opcode == BH_DIVIDE and not is_float) {
+            return false;
+        }
+        if (is_float and (instr->opcode == BH_BITWISE_AND or instr->opcode == BH_BITWISE_OR or
+                          instr->opcode == BH_BITWISE_XOR)) {
+            return false;
+        }
+    }
+    return has_type and not arrays.empty() and not bh_type_is_complex(type) and type != bh_type::BOOL;
+}
+
+// Returns the number of vector lanes when 'block' can be written as an explicit SIMD loop of 'simd_bytes' wide
+// vectors, or zero when it can't. This requires an innermost loop of basic elementwise instructions (see
+// simd_elementwise_type()). NB: the outermost loop keeps its "omp parallel for" instead.
+int64_t explicit_simd_lanes(const Scope &scope, const LoopB &block, const set<bh_base *> &local_tmps,
+                            const ConfigParser &config, bool opencl, int simd_bytes) {
+    if (opencl or simd_bytes <= 0 or not block.isInnermost() or not block._sweeps.empty() or block.tile_size > 0) {
+        return 0;
+    }
+    // NB: the outermost loop is left to the OpenMP pragma or the range of the thread pool
+    if (block.rank == 0 and (config.defaultGet<bool>("compiler_openmp", false) or
+                             config.defaultGet<string>("executor", "openmp") == "pool")) {
+        return 0;
+    }
+    bh_type type = bh_type::BOOL;
+    if (not simd_elementwise_type(scope, block, local_tmps, type)) {
+        return 0;
+    }
+    const int64_t lanes = simd_bytes / bh_type_size(type);
+    return lanes > 1 ? lanes : 0;
+}
+
+// Writes the stride of the 'axis' of 'view' in elements, which is either a literal or a kernel argument
+void write_stride(const Scope &scope, const bh_view &view, int axis, stringstream &out) {
+    if (scope.strides_as_variables and scope.isArray(view) and scope.symbols.existOffsetStridesID(view)) {
+        out << "(int64_t)vs" << scope.symbols.offsetStridesID(view) << "_" << axis;
+    } else {
+        out << view.stride[axis];
+    }
+}
+
+// Writes the load of the scalar replaced 'view', which is either from its local memory tile or from the array itself
+void write_scalar_load(const SymbolTable &symbols, const Scope &scope, const bh_view &view, stringstream &out) {
+    const string *tile = scope.getLocalTile(view);
+    if (tile != NULL) {
+        out << *tile;
+    } else {
+        out << "a" << symbols.baseID(view.base);
+        write_array_subscription(scope, view, out);
+    }
+}
+
+// Writes software prefetches, 'bh_prefetch_distance' iterations ahead, of the inputs of the innermost loop 'block'
+// that are read with a stride of at least a cache line and of the elements that BH_GATHER reads
+void write_prefetches(const SymbolTable &symbols, const Scope &scope, const LoopB &block, stringstream &out) {
+    constexpr int64_t cache_line = 64;
+    const int rank = block.rank;
+    set<bh_view> prefetched;
+    for (const InstrPtr &instr: block.getLocalInstr()) {
+        if (bh_opcode_is_system(instr->opcode)) {
+            continue;
+        }
+        if (instr->opcode == BH_GATHER) {
+            const bh_view &in = instr->operand[1];
+            const bh_view &index = instr->operand[2];
+            if (scope.isArray(in) and scope.isArray(index) and index.ndim > rank and index.stride[rank] != 0) {
+                // NB: the index array must not be read beyond the loop
+                spaces(out, 8 + rank * 4);
+                out << "if (i" << rank << " + bh_prefetch_distance < ";
+                write_loop_size(symbols, block, out);
+                out << ") __builtin_prefetch(&a" << symbols.baseID(in.base) << "[" << in.start << " + *(&a"
+                    << symbols.baseID(index.base);
+                write_array_subscription(scope, index, out);
+                out << " + (int64_t)bh_prefetch_distance * ";
+                write_stride(scope, index, rank, out);
+                out << ")], 0, 1);\n";
+            }
+            continue;
+        }
+        for (size_t o = 1; o < instr->operand.size(); ++o) {
+            const bh_view &view = instr->operand[o];
+            if (bh_is_constant(&view) or not scope.isArray(view) or view.ndim <= rank or
+                std::abs(view.stride[rank]) * bh_type_size(view.base->type) < cache_line or
+                prefetched.find(view) != prefetched.end()) {
+                continue;
+            }
+            prefetched.insert(view);
+            spaces(out, 8 + rank * 4);
+            out << "__builtin_prefetch(&a" << symbols.baseID(view.base);
+            write_array_subscription(scope, view, out);
+            out << " + (int64_t)bh_prefetch_distance * ";
+            write_stride(scope, view, rank, out);
+            out << ", 0, 1);\n";
+        }
+    }
+}
+
+// Returns the minimum size in bytes of the outputs written with non-temporal stores, which defaults to the size
+// of the last level cache (zero when 'compiler_streaming_stores' is disabled)
+int64_t streaming_store_bytes(const ConfigParser &config) {
+    if (not config.defaultGet<bool>("compiler_streaming_stores", false)) {
+        return 0;
+    }
+    const int64_t bytes = config.defaultGet<int64_t>("compiler_streaming_store_bytes", 0);
+    if (bytes > 0) {
+        return bytes;
+    }
+    long llc = 0;
+#ifdef _SC_LEVEL3_CACHE_SIZE
+    llc = sysconf(_SC_LEVEL3_CACHE_SIZE);
+#endif
+    return llc > 0 ? llc : 8 * 1024 * 1024;
+}
+
+// Returns the non-temporal store intrinsic and the macro of the ISA it requires for vectors of 'simd_bytes' bytes
+pair<const char *, const char *> streaming_store_intrinsic(int64_t simd_bytes) {
+    switch (simd_bytes) {
+        case 16:
+            return make_pair("_mm_stream_si128((__m128i *)", "__SSE2__");
+        case 32:
+            return make_pair("_mm256_stream_si256((__m256i *)", "__AVX__");
+        case 64:
+            return make_pair("_mm512_stream_si512((__m512i *)", "__AVX512F__");
+        default:
+            return make_pair((const char *) NULL, (const char *) NULL);
+    }
+}
+
+// Writes 'block' as a vector loop of 'lanes' lanes between a scalar peel, which aligns the first output array,
+// and a scalar remainder loop. The vector loop is skipped at runtime when an array isn't contiguous.
+// The aligned output is written with non-temporal stores when the kernel constructs it, no other instruction
+// of 'block' accesses it, and it is at least 'streaming_bytes' bytes (zero disables).
+void write_simd_loop(const SymbolTable &symbols, const Scope &scope, const LoopB &block, int64_t lanes,
+                     int64_t streaming_bytes, std::function<const char *(bh_type type)> type_writer,
+                     std::function<void (Scope &body_scope)> write_body, stringstream &out) {
+    const vector<InstrPtr> instr_list = block.getLocalInstr();
+    const bh_view *aligned_output = NULL;
+    const bh_instruction *aligned_instr = NULL;
+    bh_type type = bh_type::BOOL;
+    set<size_t> stride_ids;
+    for (const InstrPtr &instr: instr_list) {
+        if (bh_opcode_is_system(instr->opcode)) {
+            continue;
+        }
+        for (size_t o = 0; o < instr->operand.size(); ++o) {
+            const bh_view &view = instr->operand[o];
+            if (bh_is_constant(&view) or scope.isTmp(view.base)) {
+                continue;
+            }
+            type = view.base->type;
+            if (o == 0 and aligned_output == NULL) {
+                aligned_output = &view;
+                aligned_instr = &(*instr);
+            }
+            if (scope.strides_as_variables and scope.isArray(view) and symbols.existOffsetStridesID(view)) {
+                stride_ids.insert(symbols.offsetStridesID(view));
+            }
+        }
+    }
+    const char *elem_type = type_writer(type);
+    const int64_t simd_bytes = lanes * bh_type_size(type);
+
+    // Let's find out whether the aligned output is written-only and large enough for non-temporal stores
+    const pair<const char *, const char *> stream = streaming_store_intrinsic(simd_bytes);
+    bool streaming = streaming_bytes > 0 and stream.first != NULL and aligned_instr != NULL and
+                     aligned_instr->constructor and bh_base_size(aligned_output->base) >= streaming_bytes;
+    for (const InstrPtr &instr: instr_list) {
+        for (size_t o = 0; streaming and not bh_opcode_is_system(instr->opcode) and o < instr->operand.size(); ++o) {
+            if (not (&(*instr) == aligned_instr and o == 0) and not bh_is_constant(&instr->operand[o]) and
+                instr->operand[o].base == aligned_output->base) {
+                streaming = false;
+            }
+        }
+    }
+    const int indent = 4 + block.rank * 4;
+    stringstream itername;
+    itername << "i" << block.rank;
+    stringstream size;
+    write_loop_size(symbols, block, size);
+
+    out << "{ // Explicit SIMD loop of " << lanes << " lanes\n";
+    spaces(out, indent + 4);
+    out << "typedef " << elem_type << " bh_vec __attribute__((vector_size(" << simd_bytes << "), aligned("
+        << bh_type_size(type) << ")));\n";
+    spaces(out, indent + 4);
+    out << "uint64_t " << itername.str() << " = 0;\n";
+    spaces(out, indent + 4);
+    if (not stride_ids.empty()) {
+        out << "if (";
+        for (auto it = stride_ids.begin(); it != stride_ids.end(); ++it) {
+            if (it != stride_ids.begin()) {
+                out << " && ";
+            }
+            out << "vs" << *it << "_" << block.rank << " == 1";
+        }
+        out << ") ";
+    }
+    out << "{\n";
+    if (aligned_output != NULL) {
+        spaces(out, indent + 8);
+        out << "for(; " << itername.str() << " < " << size.str() << " && ((uintptr_t)&a"
+            << symbols.baseID(aligned_output->base);
+        write_array_subscription(scope, *aligned_output, out, true);
+        out << ") % " << simd_bytes << " != 0; ++" << itername.str() << ") {\n";
+        Scope peel_scope(scope);
+        write_body(peel_scope);
+        spaces(out, indent + 8);
+        out << "}\n";
+    }
+    spaces(out, indent + 8);
+    out << "for(; " << itername.str() << " + " << lanes << " <= " << size.str() << "; " << itername.str()
+        << " += " << lanes << ") {\n";
+    {
+        Scope vec_scope(scope);
+        for (const InstrPtr &instr: instr_list) {
+            for (const bh_view *view: instr->get_views()) {
+                if (vec_scope.isTmp(view->base) and not vec_scope.isDeclared(*view)) {
+                    spaces(out, indent + 12);
+                    vec_scope.writeDeclaration(*view, "bh_vec", out);
+                    out << "\n";
+                }
+            }
+        }
+        for (const InstrPtr &instr: instr_list) {
+            if (streaming and &(*instr) == aligned_instr) {
+                spaces(out, indent + 12);
+                out << "{\n";
+                spaces(out, indent + 16);
+                out << "bh_vec bh_nt;\n";
+                spaces(out, indent + 16);
+                write_instr_simd(vec_scope, *instr, "bh_vec", elem_type, out, "bh_nt");
+                out << "#if defined(" << stream.second << ")\n";
+                spaces(out, indent + 16);
+                out << stream.first << "&a" << symbols.baseID(aligned_output->base);
+                write_array_subscription(vec_scope, *aligned_output, out, true);
+                out << ", (" << (simd_bytes == 16 ? "__m128i" : simd_bytes == 32 ? "__m256i" : "__m512i")
+                    << ")bh_nt);\n";
+                out << "#else\n";
+                spaces(out, indent + 16);
+                out << "*(bh_vec *)&a" << symbols.baseID(aligned_output->base);
+                write_array_subscription(vec_scope, *aligned_output, out, true);
+                out << " = bh_nt;\n";
+                out << "#endif\n";
+                spaces(out, indent + 12);
+                out << "}\n";
+            } else if (not bh_opcode_is_system(instr->opcode)) {
+                spaces(out, indent + 12);
+                write_instr_simd(vec_scope, *instr, "bh_vec", elem_type, out);
+            }
+        }
+    }
+    spaces(out, indent + 8);
+    out << "}\n";
+    // The non-temporal stores are weakly ordered thus we fence them before anyone reads the output
+    if (streaming) {
+        out << "#if defined(" << stream.second << ")\n";
+        spaces(out, indent + 8);
+        out << "_mm_sfence();\n";
+        out << "#endif\n";
+    }
+    spaces(out, indent + 4);
+    out << "}\n";
+    spaces(out, indent + 4);
+    out << "for(; " << itername.str() << " < " << size.str() << "; ++" << itername.str() << ") {\n";
+    Scope remainder_scope(scope);
+    write_body(remainder_scope);
+    spaces(out, indent + 4);
+    out << "}\n";
+    spaces(out, indent);
+    out << "}\n";
+}
+
+// Writes the threaded block 'block' of a kernel where each work-item processes 'BH_VECTOR_WIDTH' consecutive
+// elements starting at 'bh_first' using vloadN/vstoreN, which the kernel header defines (see opencl_vector_width()).
+// The work-items at the end of the block and the kernels with non-contiguous arrays run the scalar body instead.
+void write_vector_work_item(const SymbolTable &symbols, const Scope &scope, const LoopB &block,
+                            std::function<const char *(bh_type type)> type_writer,
+                            std::function<void (Scope &body_scope)> write_body, stringstream &out) {
+    const vector<InstrPtr> instr_list = block.getLocalInstr();
+    bh_type type = bh_type::BOOL;
+    set<size_t> stride_ids;
+    for (const InstrPtr &instr: instr_list) {
+        if (bh_opcode_is_system(instr->opcode)) {
+            continue;
+        }
+        for (const bh_view &view: instr->operand) {
+            if (bh_is_constant(&view) or scope.isTmp(view.base)) {
+                continue;
+            }
+            type = view.base->type;
+            if (scope.strides_as_variables and scope.isArray(view) and symbols.existOffsetStridesID(view)) {
+                stride_ids.insert(symbols.offsetStridesID(view));
+            }
+        }
+    }
+    const int indent = 4 + block.rank * 4;
+    stringstream itername;
+    itername << "i" << block.rank;
+    stringstream size;
+    write_loop_size(symbols, block, size);
+
+    out << "{ // Threaded block (ID " << itername.str() << ") of BH_VECTOR_WIDTH elements per work-item\n";
+    out << "#if BH_VECTOR_WIDTH > 1\n";
+    spaces(out, indent + 4);
+    out << "if (bh_first + BH_VECTOR_WIDTH <= " << size.str();
+    for (size_t id: stride_ids) {
+        out << " && vs" << id << "_" << block.rank << " == 1";
+    }
+    out << ") {\n";
+    {
+        Scope vec_scope(scope);
+        spaces(out, indent + 8);
+        out << "typedef BH_VEC(" << type_writer(type) << ", BH_VECTOR_WIDTH) bh_vec;\n";
+        spaces(out, indent + 8);
+        out << "const " << type_writer(bh_type::UINT64) << " " << itername.str() << " = bh_first;\n";
+        for (const InstrPtr &instr: instr_list) {
+            for (const bh_view *view: instr->get_views()) {
+                if (vec_scope.isTmp(view->base) and not vec_scope.isDeclared(*view)) {
+                    spaces(out, indent + 8);
+                    vec_scope.writeDeclaration(*view, "bh_vec", out);
+                    out << "\n";
+                }
+            }
+        }
+        for (const InstrPtr &instr: instr_list) {
+            if (bh_opcode_is_system(instr->opcode)) {
+                continue;
+            }
+            const bh_view &output = instr->operand[0];
+            spaces(out, indent + 8);
+            if (vec_scope.isTmp(output.base)) {
+                write_instr_simd(vec_scope, *instr, "bh_vec", type_writer(type), out, NULL, true);
+                continue;
+            }
+            // The arrays are written a vector at a time through the variable 'bh_v'
+            out << "{\n";
+            spaces(out, indent + 12);
+            out << "bh_vec bh_v;\n";
+            spaces(out, indent + 12);
+            write_instr_simd(vec_scope, *instr, "bh_vec", type_writer(type), out, "bh_v", true);
+            spaces(out, indent + 12);
+            out << "bh_vstore(bh_v, 0, &a" << symbols.baseID(output.base);
+            write_array_subscription(vec_scope, output, out, true);
+            out << ");\n";
+            spaces(out, indent + 8);
+            out << "}\n";
+        }
+    }
+    spaces(out, indent + 4);
+    out << "} else\n";
+    out << "#endif\n";
+    spaces(out, indent + 4);
+    out << "for(" << type_writer(bh_type::UINT64) << " " << itername.str() << " = bh_first; " << itername.str()
+        << " < bh_first + BH_VECTOR_WIDTH && " << itername.str() << " < " << size.str() << "; ++"
+        << itername.str() << ") {\n";
+    Scope remainder_scope(scope);
+    write_body(remainder_scope);
+    spaces(out, indent + 4);
+    out << "}\n";
+    spaces(out, indent);
+    out << "}\n";
+}
+
+// Returns the views that stay in registers during an iteration of the non-innermost 'block', which are the views of
+// persistent bases that are invariant within the iteration (i.e. zero strides beyond the rank of 'block') and that
+// sub-blocks or multiple instructions access. Every access of their bases within 'block' must go through the same
+// view. The bases of the views that 'block' reads and writes are inserted into 'reads' and 'writes'.
+vector<const bh_view*> scalar_replaced_invariants(const SymbolTable &symbols, const Scope *parent_scope,
+                                                  const LoopB &block, const vector<const LoopB *> &threaded_blocks,
+                                                  set<const bh_base*> &reads, set<const bh_base*> &writes) {
+    vector<const bh_view*> ret;
+    if (block.isInnermost() or not block._sweeps.empty()) {
+        return ret;
+    }
+    // NB: the threads of a threaded sub-block would all write the same elements
+    for (const Block &b: block._block_list) {
+        if (not b.isInstr()) {
+            for (const LoopB *t: threaded_blocks) {
+                if (*t == b.getLoop()) {
+                    return ret;
+                }
+            }
+        }
+    }
+    const set<bh_base *> tmps = block.getAllTemps();
+    vector<const bh_base*> order; // The bases in the order of their first access
+    map<const bh_base*, const bh_view*> views;
+    map<const bh_base*, int> accesses;
+    set<const bh_base*> rejected;
+    auto visit = [&](const bh_instruction &instr, bool nested) {
+        if (bh_opcode_is_system(instr.opcode)) {
+            return;
+        }
+        const bool irregular = bh_opcode_is_accumulate(instr.opcode) or instr.opcode == BH_GATHER or
+                               instr.opcode == BH_SCATTER or instr.opcode == BH_COND_SCATTER or
+                               instr.opcode == BH_ADD_SCATTER;
+        for (size_t i = 0; i < instr.operand.size(); ++i) {
+            const bh_view &view = instr.operand[i];
+            if (bh_is_constant(&view) or util::exist(rejected, view.base)) {
+                continue;
+            }
+            bool invariant = not irregular;
+            // The axes of a reduction output are only the axes of the loops until the swept axis
+            if (i == 0 and bh_opcode_is_reduction(instr.opcode) and instr.sweep_axis() <= block.rank) {
+                invariant = false;
+            }
+            for (int64_t a = block.rank + 1; a < view.ndim; ++a) {
+                if (view.stride[a] != 0 and view.shape[a] > 1) {
+                    invariant = false;
+                }
+            }
+            if (not invariant or util::exist(tmps, view.base) or symbols.isAlwaysArray(view.base) or
+                (parent_scope != NULL and not parent_scope->isArray(view)) or
+                (util::exist(views, view.base) and not (*views[view.base] == view))) {
+                rejected.insert(view.base);
+                continue;
+            }
+            if (not util::exist(views, view.base)) {
+                order.push_back(view.base);
+                views[view.base] = &view;
+            }
+            accesses[view.base] += nested ? 2 : 1;
+            if (i == 0) {
+                writes.insert(view.base);
+            } else {
+                reads.insert(view.base);
+            }
+        }
+    };
+    for (const Block &b: block._block_list) {
+        if (b.isInstr()) {
+            visit(*b.getInstr(), false);
+        } else {
+            for (const InstrPtr &instr: b.getLoop().getAllInstr()) {
+                visit(*instr, true);
+            }
+        }
+    }
+    for (const bh_base *base: order) {
+        if (not util::exist(rejected, base) and accesses[base] > 1) {
+            ret.push_back(views[base]);
+        }
+    }
+    return ret;
+}
+
+} // Anon namespace
+
+int opencl_vector_width(const SymbolTable &symbols, const LoopB &block, const vector<const LoopB *> &threaded_blocks,
+                        const ConfigParser &config) {
+    const int width = config.defaultGet<int>("vector_width", 0);
+    if ((width != 2 and width != 4 and width != 8 and width != 16) or threaded_blocks.size() != 1 or
+        not (*threaded_blocks[0] == block) or not block.isInnermost() or not block._sweeps.empty()) {
+        return 0;
+    }
+    const set<bh_base *> &local_tmps = block.getLocalTemps();
+    const Scope scope(symbols, NULL, local_tmps, vector<const bh_view*>(), vector<const bh_view*>(), config);
+    bh_type type = bh_type::BOOL;
+    return simd_elementwise_type(scope, block, local_tmps, type) ? width : 0;
+}
+
+bool unrolled_loop(const SymbolTable &symbols, const LoopB &block, const vector<const LoopB *> &threaded_blocks,
+                   const ConfigParser &config) {
+    const int64_t max_size = config.defaultGet<int64_t>("unroll_max_size", 0);
+    if (block.size > max_size or not block.isInnermost() or block.tile_size > 0 or symbols.loopSizeID(block.size) >= 0) {
+        return false;
+    }
+    for (const LoopB *b: threaded_blocks) {
+        if (*b == block) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool innermost_after_unrolling(const SymbolTable &symbols, const LoopB &block,
+                               const vector<const LoopB *> &threaded_blocks, const ConfigParser &config) {
+    for (const Block &b: block._block_list) {
+        if (not b.isInstr() and not unrolled_loop(symbols, b.getLoop(), threaded_blocks, config)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void unthread_unrolled_loop(vector<const LoopB *> &threaded_blocks, const ConfigParser &config) {
+    // NB: the loop sizes of shape-generic kernels are kernel arguments, which cannot be unrolled
+    if (threaded_blocks.size() < 2 or config.defaultGet<bool>("shape_as_var", false)) {
+        return;
+    }
+    const LoopB &block = *threaded_blocks.back();
+    if (block.isInnermost() and block.tile_size == 0 and block.size <= config.defaultGet<int64_t>("unroll_max_size", 0)) {
+        threaded_blocks.pop_back();
+    }
+}
 
 void write_loop_block(const SymbolTable &symbols,
                       const Scope *parent_scope,
@@ -147,7 +837,8 @@ void write_loop_block(const SymbolTable &symbols,
                                           bool loop_is_peeled,
                                           const std::vector<const LoopB *> &threaded_blocks,
                                           std::stringstream &out)> head_writer,
-                      std::stringstream &out) {
+                      std::stringstream &out,
+                      int simd_bytes) {
 
     if (block.isSystemOnly()) {
         out << "// Removed loop with only system instructions\n";
@@ -157,6 +848,8 @@ void write_loop_block(const SymbolTable &symbols,
 
     // Let's find the local temporary arrays and the arrays to scalar replace
     const set<bh_base *> &local_tmps = block.getLocalTemps();
+    // NB: the analyses and the declarations below all visit the local instructions thus we collect them once
+    const vector<InstrPtr> local_instr = block.getLocalInstr();
 
     // Let's scalar replace reduction outputs that reduces over the innermost axis
     vector<const bh_view*> scalar_replaced_reduction_outputs;
@@ -203,9 +896,26 @@ void write_loop_block(const SymbolTable &symbols,
         }
     }
 
+    // Let's scalar replace the views that are invariant within an iteration of an outer loop, which keeps them in
+    // registers across the sub-blocks, e.g. the sum of a row that a following sub-block divides the row by
+    vector<const bh_view*> scalar_replaced_invariant;
+    set<const bh_base*> invariant_reads, invariant_writes;
+    if (config.defaultGet<bool>("scalar_replace_invariants", false)) {
+        scalar_replaced_invariant = scalar_replaced_invariants(symbols, parent_scope, block, threaded_blocks,
+                                                               invariant_reads, invariant_writes);
+        for (const bh_view *view: scalar_replaced_invariant) {
+            scalar_replaced_input_only.erase(remove_if(scalar_replaced_input_only.begin(),
+                                                       scalar_replaced_input_only.end(),
+                                                       [&](const bh_view *v) { return v->base == view->base; }),
+                                             scalar_replaced_input_only.end());
+        }
+    }
+    vector<const bh_view*> scalar_replaced_rw(scalar_replaced_reduction_outputs);
+    scalar_replaced_rw.insert(scalar_replaced_rw.end(), scalar_replaced_invariant.begin(),
+                              scalar_replaced_invariant.end());
+
     // And then create the scope
-    Scope scope(symbols, parent_scope, local_tmps, scalar_replaced_reduction_outputs,
-                scalar_replaced_input_only, config);
+    Scope scope(symbols, parent_scope, local_tmps, scalar_replaced_rw, scalar_replaced_input_only, config);
 
     // When a reduction output is a scalar (e.g. because of array contraction or scalar replacement),
     // it should be declared before the for-loop
@@ -214,7 +924,7 @@ void write_loop_block(const SymbolTable &symbols,
             const bh_view &output = instr->operand[0];
             if (not scope.isDeclared(output) and not scope.isArray(output)) {
                 // Let's write the declaration of the scalar variable
-                scope.writeDeclaration(output, type_writer(output.base->type), out);
+                scope.writeDeclaration(output, type_writer(bh_type_compute(output.base->type)), out);
                 out << "\n";
                 spaces(out, 4 + block.rank * 4);
             }
@@ -225,7 +935,7 @@ void write_loop_block(const SymbolTable &symbols,
     vector<const bh_view*> indexes;
     {
         set<bh_view, idx_less> candidates;
-        for (const InstrPtr &instr: block.getLocalInstr()) {
+        for (const InstrPtr &instr: local_instr) {
             for (const bh_view* view: instr->get_views()) {
                 if (symbols.existIdxID(*view) and scope.isArray(*view)) {
                     if (util::exist(candidates, *view)) { // 'view' is used multiple times
@@ -255,7 +965,7 @@ void write_loop_block(const SymbolTable &symbols,
         for (const InstrPtr instr: block._sweeps) {
             const bh_view &view = instr->operand[0];
             if (not scope.isArray(view) and not scope.isDeclared(view)) {
-                scope.writeDeclaration(view, type_writer(view.base->type), out);
+                scope.writeDeclaration(view, type_writer(bh_type_compute(view.base->type)), out);
                 out << "\n";
                 spaces(out, 4 + block.rank * 4);
             }
@@ -283,24 +993,24 @@ void write_loop_block(const SymbolTable &symbols,
             peeled_block.replaceInstr(instr, sweep_instr);
         }
         string itername;
-        {stringstream t; t << "i" << block.rank; itername = t.str();}
+        itername = "i" + to_string(block.rank);
         out << "{ // Peeled loop, 1. sweep iteration\n";
         spaces(out, 8 + block.rank*4);
         out << type_writer(bh_type::UINT64) << " " << itername << " = 0;\n";
 
         // Write temporary and scalar replaced array declarations
-        for (const InstrPtr instr: block.getLocalInstr()) {
+        for (const InstrPtr &instr: local_instr) {
             for (const bh_view *view: instr->get_views()) {
                 if (not peeled_scope.isDeclared(*view)) {
                     if (peeled_scope.isTmp(view->base)) {
                         spaces(out, 8 + block.rank * 4);
-                        peeled_scope.writeDeclaration(*view, type_writer(view->base->type), out);
+                        peeled_scope.writeDeclaration(*view, type_writer(bh_type_compute(view->base->type)), out);
                         out << "\n";
                     } else if (peeled_scope.isScalarReplaced_R(*view)) {
                         spaces(out, 8 + block.rank * 4);
-                        peeled_scope.writeDeclaration(*view, type_writer(view->base->type), out);
-                        out << " " << peeled_scope.getName(*view) << " = a" << symbols.baseID(view->base);
-                        write_array_subscription(peeled_scope, *view, out);
+                        peeled_scope.writeDeclaration(*view, type_writer(bh_type_compute(view->base->type)), out);
+                        out << " " << peeled_scope.getName(*view) << " = ";
+                        write_scalar_load(symbols, peeled_scope, *view, out);
                         out << ";";
                         out << "\n";
                     }
@@ -323,7 +1033,8 @@ void write_loop_block(const SymbolTable &symbols,
                     write_instr(peeled_scope, *b.getInstr(), out, opencl);
                 }
             } else {
-                write_loop_block(symbols, &peeled_scope, b.getLoop(), config, threaded_blocks, opencl, type_writer, head_writer, out);
+                write_loop_block(symbols, &peeled_scope, b.getLoop(), config, threaded_blocks, opencl, type_writer,
+                                 head_writer, out, simd_bytes);
             }
         }
         spaces(out, 4 + block.rank*4);
@@ -331,74 +1042,149 @@ void write_loop_block(const SymbolTable &symbols,
         spaces(out, 4 + block.rank*4);
     }
 
-    // Write the for-loop header
-    head_writer(symbols, scope, block, config, need_to_peel, threaded_blocks, out);
+    const bool unrolled = unrolled_loop(symbols, block, threaded_blocks, config);
 
-    // Write temporary and scalar replaced array declarations
-    for (const InstrPtr instr: block.getLocalInstr()) {
-        for (const bh_view *view: instr->get_views()) {
-            if (not scope.isDeclared(*view)) {
-                if (scope.isTmp(view->base)) {
-                    spaces(out, 8 + block.rank * 4);
-                    scope.writeDeclaration(*view, type_writer(view->base->type), out);
-                    out << "\n";
-                } else if (scope.isScalarReplaced_R(*view)) {
-                    spaces(out, 8 + block.rank * 4);
-                    scope.writeDeclaration(*view, type_writer(view->base->type), out);
-                    out << " " << scope.getName(*view) << " = a" << symbols.baseID(view->base);
-                    write_array_subscription(scope, *view, out);
-                    out << ";";
-                    out << "\n";
+    // Writes the declarations and instructions of the for-loop body using 'body_scope'
+    auto write_body = [&](Scope &body_scope) {
+        // Write temporary and scalar replaced array declarations
+        for (const InstrPtr &instr: local_instr) {
+            for (const bh_view *view: instr->get_views()) {
+                if (not body_scope.isDeclared(*view)) {
+                    if (body_scope.isTmp(view->base)) {
+                        spaces(out, 8 + block.rank * 4);
+                        body_scope.writeDeclaration(*view, type_writer(bh_type_compute(view->base->type)), out);
+                        out << "\n";
+                    } else if (body_scope.isScalarReplaced_R(*view)) {
+                        spaces(out, 8 + block.rank * 4);
+                        body_scope.writeDeclaration(*view, type_writer(bh_type_compute(view->base->type)), out);
+                        out << " " << body_scope.getName(*view) << " = ";
+                        write_scalar_load(symbols, body_scope, *view, out);
+                        out << ";";
+                        out << "\n";
+                    }
                 }
             }
         }
-    }
-    // Write the indexes declarations
-    for (const bh_view *view: indexes) {
-        if (not scope.isIdxDeclared(*view)) {
+        // Write the declarations and loads of the invariant views, which the iteration writes back at its end
+        for (const bh_view *view: scalar_replaced_invariant) {
             spaces(out, 8 + block.rank * 4);
-            scope.writeIdxDeclaration(*view, type_writer(bh_type::UINT64), out);
+            body_scope.writeDeclaration(*view, type_writer(bh_type_compute(view->base->type)), out);
+            if (util::exist(invariant_reads, view->base)) {
+                out << " " << body_scope.getName(*view) << " = ";
+                write_scalar_load(symbols, body_scope, *view, out);
+                out << ";";
+            }
             out << "\n";
         }
-    }
-
-    // Write the for-loop body
-    // The body in OpenCL and OpenMP are very similar but OpenMP might need to insert "#pragma omp atomic/critical"
-    if (opencl) {
-        for (const Block &b: block._block_list) {
-            if (b.isInstr()) { // Finally, let's write the instruction
-                if (b.getInstr() != NULL and not bh_opcode_is_system(b.getInstr()->opcode)) {
-                    spaces(out, 4 + b.rank()*4);
-                    write_instr(scope, *b.getInstr(), out, true);
+        // Write the partial indexes of the arrays of the nested loops
+        if (body_scope.strength_reduce and not opencl and not block.isInnermost()) {
+            for (const InstrPtr &instr: block.getAllInstr()) {
+                for (const bh_view *view: instr->get_views()) {
+                    if (body_scope.isArray(*view)) {
+                        stringstream decl;
+                        write_partial_index_declaration(body_scope, *view, block.rank, decl);
+                        if (not decl.str().empty()) {
+                            spaces(out, 8 + block.rank * 4);
+                            out << decl.str() << "\n";
+                        }
+                    }
                 }
-            } else {
-                write_loop_block(symbols, &scope, b.getLoop(), config, threaded_blocks, opencl, type_writer, head_writer, out);
             }
         }
-    } else {
-        for (const Block &b: block._block_list) {
-            if (b.isInstr()) { // Finally, let's write the instruction
-                const InstrPtr instr = b.getInstr();
-                if (not bh_opcode_is_system(instr->opcode)) {
-                    if (instr->operand.size() > 0) {
-                        if (scope.isOpenmpAtomic(instr->operand[0])) {
-                            spaces(out, 4 + b.rank()*4);
-                            out << "#pragma omp atomic\n";
-                        } else if (scope.isOpenmpCritical(instr->operand[0])) {
-                            spaces(out, 4 + b.rank()*4);
-                            out << "#pragma omp critical\n";
+
+        // Write the indexes declarations
+        for (const bh_view *view: indexes) {
+            if (not body_scope.isIdxDeclared(*view)) {
+                spaces(out, 8 + block.rank * 4);
+                body_scope.writeIdxDeclaration(*view, type_writer(bh_type::UINT64), out);
+                out << "\n";
+            }
+        }
+
+        // Write the software prefetches of the innermost loop
+        if (not opencl and not unrolled and block.isInnermost() and config.defaultGet<bool>("compiler_prefetch", false)) {
+            write_prefetches(symbols, body_scope, block, out);
+        }
+
+        // Write the for-loop body
+        // The body in OpenCL and OpenMP are very similar but OpenMP might need to insert "#pragma omp atomic/critical"
+        if (opencl) {
+            for (const Block &b: block._block_list) {
+                if (b.isInstr()) { // Finally, let's write the instruction
+                    if (b.getInstr() != NULL and not bh_opcode_is_system(b.getInstr()->opcode)) {
+                        spaces(out, 4 + b.rank()*4);
+                        write_instr(body_scope, *b.getInstr(), out, true);
+                    }
+                } else {
+                    write_loop_block(symbols, &body_scope, b.getLoop(), config, threaded_blocks, opencl, type_writer, head_writer, out,
+                                     simd_bytes);
+                }
+            }
+        } else {
+            for (const Block &b: block._block_list) {
+                if (b.isInstr()) { // Finally, let's write the instruction
+                    const InstrPtr instr = b.getInstr();
+                    if (not bh_opcode_is_system(instr->opcode)) {
+                        if (instr->operand.size() > 0) {
+                            if (body_scope.isOpenmpAtomic(instr->operand[0])) {
+                                spaces(out, 4 + b.rank()*4);
+                                out << "#pragma omp atomic\n";
+                            } else if (body_scope.isOpenmpCritical(instr->operand[0])) {
+                                spaces(out, 4 + b.rank()*4);
+                                out << "#pragma omp critical\n";
+                            }
                         }
+                        spaces(out, 4 + b.rank()*4);
+                        write_instr(body_scope, *instr, out);
                     }
-                    spaces(out, 4 + b.rank()*4);
-                    write_instr(scope, *instr, out);
+                } else {
+                    write_loop_block(symbols, &body_scope, b.getLoop(), config, threaded_blocks, opencl, type_writer, head_writer, out,
+                                     simd_bytes);
                 }
-            } else {
-                write_loop_block(symbols, &scope, b.getLoop(), config, threaded_blocks, opencl, type_writer, head_writer, out);
             }
         }
+        for (const bh_view *view: scalar_replaced_invariant) {
+            if (util::exist(invariant_writes, view->base)) {
+                spaces(out, 8 + block.rank * 4);
+                out << "a" << symbols.baseID(view->base);
+                write_array_subscription(body_scope, *view, out, true);
+                out << " = " << body_scope.getName(*view) << ";\n";
+            }
+        }
+    };
+
+    const int64_t simd_lanes = unrolled ? 0 : explicit_simd_lanes(scope, block, local_tmps, config, opencl, simd_bytes);
+    if (unrolled) {
+        // Every iteration gets its own copy of the body where the iterator is a constant
+        string itername;
+        itername = "i" + to_string(block.rank);
+        out << "{ // Unrolled loop\n";
+        for (int64_t i = (block._sweeps.size() > 0 and need_to_peel) ? 1 : 0; i < block.size; ++i) {
+            Scope unrolled_scope(scope);
+            spaces(out, 8 + block.rank*4);
+            out << "{ " << type_writer(bh_type::UINT64) << " " << itername << " = " << i << ";\n";
+            write_body(unrolled_scope);
+            spaces(out, 8 + block.rank*4);
+            out << "}\n";
+        }
+        spaces(out, 4 + block.rank*4);
+        out << "}\n";
+    } else if (simd_lanes > 1) {
+        write_simd_loop(symbols, scope, block, simd_lanes, streaming_store_bytes(config), type_writer, write_body, out);
+    } else if (opencl and parent_scope == NULL and opencl_vector_width(symbols, block, threaded_blocks, config) > 1) {
+        write_vector_work_item(symbols, scope, block, type_writer, write_body, out);
+    } else {
+        // Write the for-loop header
+        head_writer(symbols, scope, block, config, need_to_peel, threaded_blocks, out);
+        write_body(scope);
+        spaces(out, 4 + block.rank*4);
+        out << "}\n";
+    }
+    // The tile loops of a tiled nest are closed by its outer loop
+    if (not opencl and block.tile_size > 0 and not block.isInnermost()) {
+        spaces(out, 4 + block.rank*4);
+        out << "}}\n";
     }
-    spaces(out, 4 + block.rank*4);
-    out << "}\n";
 
     // Let's copy the scalar replaced reduction outputs back to the original array
     for (const bh_view *view: scalar_replaced_reduction_outputs) {
@@ -411,25 +1197,369 @@ void write_loop_block(const SymbolTable &symbols,
     }
 }
 
+vector<LocalTile> find_local_tiles(const Kernel &kernel, const SymbolTable &symbols,
+                                   const vector<const LoopB*> &threaded_blocks,
+                                   uint64_t group_size, int64_t max_halo, uint64_t max_bytes) {
+    vector<LocalTile> ret;
+    if (threaded_blocks.size() != 1 or not threaded_blocks[0]->isInnermost() or threaded_blocks[0]->rank != 0) {
+        return ret;
+    }
+    const LoopB &block = *threaded_blocks[0];
+    const vector<bh_base*> &non_temps = kernel.getNonTemps();
+
+    // We ignore the bases that the kernel writes or accesses through index arrays
+    set<const bh_base*> ignore_bases;
+    map<const bh_base*, set<bh_view> > views;
+    for (const InstrPtr &instr: block.getLocalInstr()) {
+        if (bh_opcode_is_system(instr->opcode) or instr->operand.empty()) {
+            continue;
+        }
+        ignore_bases.insert(instr->operand[0].base);
+        const bool indexed = instr->opcode == BH_GATHER or instr->opcode == BH_SCATTER or
+                             instr->opcode == BH_COND_SCATTER or instr->opcode == BH_ADD_SCATTER;
+        for (size_t i = 1; i < instr->operand.size(); ++i) {
+            const bh_view &view = instr->operand[i];
+            if (not bh_is_constant(&view)) {
+                if (indexed) {
+                    ignore_bases.insert(view.base);
+                } else {
+                    views[view.base].insert(view);
+                }
+            }
+        }
+    }
+
+    uint64_t total_bytes = 0;
+    for (const auto &base_and_views: views) {
+        const bh_base *base = base_and_views.first;
+        const set<bh_view> &base_views = base_and_views.second;
+        if (base_views.size() < 2 or util::exist(ignore_bases, base) or symbols.isAlwaysArray(base) or
+            std::find(non_temps.begin(), non_temps.end(), base) == non_temps.end()) {
+            continue;
+        }
+        // All views must have the same stride and start a whole number of strides apart
+        const bh_view &first = *base_views.begin();
+        if (first.ndim != 1 or first.stride[0] == 0) {
+            continue;
+        }
+        const int64_t stride = first.stride[0];
+        map<bh_view, int64_t> shifts;
+        int64_t min_shift = 0, max_shift = 0;
+        for (const bh_view &view: base_views) {
+            if (view.ndim != 1 or view.shape[0] != block.size or view.stride[0] != stride or
+                (view.start - first.start) % stride != 0) {
+                shifts.clear();
+                break;
+            }
+            const int64_t shift = (view.start - first.start) / stride;
+            min_shift = std::min(min_shift, shift);
+            max_shift = std::max(max_shift, shift);
+            shifts[view] = shift;
+        }
+        const int64_t halo = max_shift - min_shift;
+        if (shifts.empty() or halo > max_halo) {
+            continue;
+        }
+        const uint64_t bytes = (group_size + halo) * bh_type_size(base->type);
+        if (total_bytes + bytes > max_bytes) {
+            continue;
+        }
+        total_bytes += bytes;
+        LocalTile tile;
+        tile.base = base;
+        tile.start = first.start + min_shift * stride;
+        tile.stride = stride;
+        tile.halo = halo;
+        for (const auto &view_and_shift: shifts) {
+            tile.shifts[view_and_shift.first] = view_and_shift.second - min_shift;
+        }
+        ret.push_back(tile);
+    }
+    return ret;
+}
+
+void write_local_tiles(const SymbolTable &symbols, const vector<LocalTile> &tiles, const LoopB &threaded_block,
+                       uint64_t group_size, std::function<const char *(bh_type type)> type_writer,
+                       const char *local_prefix, const char *local_id, const char *local_size, const char *barrier,
+                       Scope &scope, stringstream &out) {
+    if (tiles.empty()) {
+        return;
+    }
+    const char *int64_type = type_writer(bh_type::INT64);
+    spaces(out, 4);
+    out << "// The stencil tiles in local memory\n";
+    for (const LocalTile &tile: tiles) {
+        const size_t id = symbols.baseID(tile.base);
+        spaces(out, 4);
+        out << local_prefix << " " << type_writer(tile.base->type) << " l" << id << "[" << group_size + tile.halo
+            << "];\n";
+        spaces(out, 4);
+        out << "for (" << int64_type << " j = " << local_id << "; j < (" << int64_type << ")" << local_size << " + "
+            << tile.halo << "; j += " << local_size << ") {\n";
+        spaces(out, 8);
+        out << "const " << int64_type << " g = (" << int64_type << ")(i" << threaded_block.rank << " - " << local_id
+            << ") + j;\n";
+        spaces(out, 8);
+        out << "if (g < (" << int64_type << ")";
+        write_loop_size(symbols, threaded_block, out);
+        out << " + " << tile.halo << ") {l" << id << "[j] = a" << id << "[" << tile.start << " + g * (" << tile.stride
+            << ")];}\n";
+        spaces(out, 4);
+        out << "}\n";
+        for (const auto &view_and_shift: tile.shifts) {
+            stringstream load;
+            load << "l" << id << "[" << local_id << " + " << view_and_shift.second << "]";
+            scope.insertLocalTile(view_and_shift.first, load.str());
+        }
+    }
+    spaces(out, 4);
+    out << barrier << ";\n";
+}
+
 // Handle the extension methods within the 'bhir'
+vector<size_t> find_concurrent_waves(const vector<Block> &block_list) {
+    const graph::DAG dag = graph::from_block_list(block_list);
+    vector<size_t> ret(block_list.size(), 0);
+    size_t wave_begin = 0;
+    for (size_t i = 1; i < block_list.size(); ++i) {
+        // NB: the vertices are the blocks in topological order thus a path from within the wave to 'i'
+        //     ends with an edge from within the wave
+        bool depend = false;
+        for (size_t j = wave_begin; j < i and not depend; ++j) {
+            depend = boost::edge(j, i, dag).second;
+        }
+        if (depend) {
+            wave_begin = i;
+            ret[i] = ret[i - 1] + 1;
+        } else {
+            ret[i] = ret[i - 1];
+        }
+    }
+    return ret;
+}
+
+namespace {
+// Whether 'instr' accesses 'base'
+bool accesses(const bh_instruction &instr, const bh_base *base) {
+    for (const bh_view &view: instr.operand) {
+        if (view.base == base) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Whether the instructions in [begin, end) of 'instr_list' access 'base'
+bool accessed(const vector<bh_instruction> &instr_list, size_t begin, size_t end, const bh_base *base) {
+    for (size_t i = begin; i < end; ++i) {
+        if (accesses(instr_list[i], base)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Whether 'base' is freed in 'instr_list' after 'begin' and not accessed before that
+bool freed_after(const vector<bh_instruction> &instr_list, size_t begin, const bh_base *base) {
+    for (size_t i = begin; i < instr_list.size(); ++i) {
+        if (accesses(instr_list[i], base)) {
+            return instr_list[i].opcode == BH_FREE;
+        }
+    }
+    return false;
+}
+
+// Folds the instruction at 'epi', which must be the next access of the result 'tmp' of the extension method at
+// 'pc', into the epilogue of the extension method. Returns false when the instruction isn't a scaling or an
+// addition that the epilogue can compute.
+bool fold_epilogue(vector<bh_instruction> &instr_list, size_t pc, size_t epi) {
+    bh_instruction &ext = instr_list[pc];
+    const bh_instruction &instr = instr_list[epi];
+    const bh_view &tmp = ext.operand[0];
+    if (instr.operand.size() != 3 or (instr.opcode != BH_MULTIPLY and instr.opcode != BH_ADD)) {
+        return false;
+    }
+    // The operand that isn't the result of the extension method
+    const bh_view *other;
+    if (instr.operand[1] == tmp) {
+        other = &instr.operand[2];
+    } else if (instr.operand[2] == tmp) {
+        other = &instr.operand[1];
+    } else {
+        return false;
+    }
+    const bh_view &out = instr.operand[0];
+    if (bh_is_constant(&out) or out.base->type != tmp.base->type or not bh_view_same_shape(&out, &tmp)) {
+        return false;
+    }
+    // The result is written in place of the extension method thus it must not alias the other operands or be
+    // accessed in between
+    for (size_t o = 1; o < ext.operand.size(); ++o) {
+        if (ext.operand[o].base == out.base) {
+            return false;
+        }
+    }
+    if (out.base != tmp.base and accessed(instr_list, pc + 1, epi, out.base)) {
+        return false;
+    }
+    const bool has_addend = ext.operand.size() > 3 and not bh_is_constant(&ext.operand[3]);
+    const bool has_alpha = bh_is_constant(&ext.operand.back()) and ext.operand.size() > 3;
+    if (instr.opcode == BH_MULTIPLY) {
+        // alpha * (A op B + D) isn't an epilogue
+        if (not bh_is_constant(other) or has_alpha or has_addend or bh_type_is_complex(instr.constant.type)) {
+            return false;
+        }
+        ext.operand[0] = out;
+        ext.operand.push_back(*other);
+        ext.constant = instr.constant;
+    } else {
+        if (bh_is_constant(other) or has_addend or other->base->type != tmp.base->type or
+            not bh_view_same_shape(other, &tmp) or (other->base == out.base and *other != out) or
+            other->base == tmp.base or accessed(instr_list, pc + 1, epi, other->base)) {
+            return false;
+        }
+        ext.operand[0] = out;
+        ext.operand.insert(ext.operand.begin() + 3, *other);
+    }
+    instr_list.erase(instr_list.begin() + epi);
+    return true;
+}
+}
+
+void util_fold_extmethod_epilogues(vector<bh_instruction> &instr_list,
+                                   std::map<bh_opcode, extmethod::ExtmethodFace> &extmethods) {
+    for (size_t pc = 0; pc < instr_list.size(); ++pc) {
+        auto ext = extmethods.find(instr_list[pc].opcode);
+        if (ext == extmethods.end() or not ext->second.getImpl()->epilogue() or instr_list[pc].operand.size() != 3) {
+            continue;
+        }
+        // The result is a temporary when the next access is the instruction we fold and the one after that frees it
+        // (unless the instruction writes the result in place)
+        while (true) {
+            const bh_view tmp = instr_list[pc].operand[0];
+            size_t epi = pc + 1;
+            while (epi < instr_list.size() and not accesses(instr_list[epi], tmp.base)) {
+                ++epi;
+            }
+            if (epi == instr_list.size() or
+                (instr_list[epi].operand[0] != tmp and not freed_after(instr_list, epi + 1, tmp.base)) or
+                not fold_epilogue(instr_list, pc, epi)) {
+                break;
+            }
+        }
+    }
+}
+
+vector<bh_instruction> util_extmethod_dependencies(vector<bh_instruction> &instr_list, const bh_instruction &ext) {
+    // The bases that the dependencies (and the extension method) read and write.
+    // NB: we don't know which operands the extension method writes thus it might write all of them
+    set<const bh_base *> reads, writes;
+    for (const bh_view &view: ext.operand) {
+        if (not bh_is_constant(&view)) {
+            writes.insert(view.base);
+        }
+    }
+    // An instruction is a dependency when it conflicts with a later dependency, which we find backwards
+    vector<bool> dependency(instr_list.size(), false);
+    for (size_t i = instr_list.size(); i-- > 0;) {
+        const bh_instruction &instr = instr_list[i];
+        // The first operand is the output except of BH_SYNC
+        bool conflict = false;
+        for (size_t o = 0; o < instr.operand.size() and not conflict; ++o) {
+            const bh_view &view = instr.operand[o];
+            if (bh_is_constant(&view)) {
+                continue;
+            }
+            const bool write = o == 0 and instr.opcode != BH_SYNC;
+            conflict = writes.find(view.base) != writes.end() or (write and reads.find(view.base) != reads.end());
+        }
+        if (conflict) {
+            dependency[i] = true;
+            for (size_t o = 0; o < instr.operand.size(); ++o) {
+                const bh_view &view = instr.operand[o];
+                if (not bh_is_constant(&view)) {
+                    (o == 0 and instr.opcode != BH_SYNC ? writes : reads).insert(view.base);
+                }
+            }
+        }
+    }
+    vector<bh_instruction> ret, rest;
+    for (size_t i = 0; i < instr_list.size(); ++i) {
+        (dependency[i] ? ret : rest).push_back(std::move(instr_list[i]));
+    }
+    instr_list = std::move(rest);
+    return ret;
+}
+
+ExtmethodPlacement::ExtmethodPlacement(const ConfigParser &config) :
+        device_flops(config.defaultGet<double>("extmethod_device_gflops", 0) * 1e9),
+        device_bytes(config.defaultGet<double>("extmethod_device_gbps", 0) * 1e9),
+        host_flops(config.defaultGet<double>("extmethod_host_gflops", 0) * 1e9),
+        host_bytes(config.defaultGet<double>("extmethod_host_gbps", 0) * 1e9),
+        transfer_bytes(config.defaultGet<double>("extmethod_transfer_gbps", 0) * 1e9) {}
+
 void util_handle_extmethod(component::ComponentImpl *self,
                            bh_ir *bhir,
                            std::map<bh_opcode, extmethod::ExtmethodFace> &extmethods) {
 
+    if (not util_has_extmethod(bhir->instr_list, extmethods)) {
+        return; // Nothing to do thus we don't touch the instruction list
+    }
+    util_fold_extmethod_epilogues(bhir->instr_list, extmethods);
     std::vector<bh_instruction> instr_list;
+    instr_list.reserve(bhir->instr_list.size());
     for (bh_instruction &instr: bhir->instr_list) {
         auto ext = extmethods.find(instr.opcode);
         if (ext != extmethods.end()) {
+            // Execute the instructions up until now that the extension method depends on, the rest are fused with
+            // the instructions after it
             bh_ir b;
-            b.instr_list = instr_list;
-            self->execute(&b); // Execute the instructions up until now
-            instr_list.clear();
+            b.instr_list = util_extmethod_dependencies(instr_list, instr);
+            if (not b.instr_list.empty()) {
+                self->execute(&b);
+            }
             ext->second.execute(&instr, NULL); // Execute the extension method
         } else {
-            instr_list.push_back(instr);
+            instr_list.push_back(std::move(instr));
+        }
+    }
+    bhir->instr_list = std::move(instr_list);
+}
+
+bool util_has_extmethod(const std::vector<bh_instruction> &instr_list,
+                        const std::map<bh_opcode, extmethod::ExtmethodFace> &extmethods,
+                        const std::set<bh_opcode> *child_extmethods) {
+    if (extmethods.empty() and (child_extmethods == NULL or child_extmethods->empty())) {
+        return false;
+    }
+    for (const bh_instruction &instr: instr_list) {
+        if (extmethods.find(instr.opcode) != extmethods.end() or
+            (child_extmethods != NULL and child_extmethods->find(instr.opcode) != child_extmethods->end())) {
+            return true;
         }
     }
-    bhir->instr_list = instr_list;
+    return false;
+}
+
+bool util_is_system_only(const std::vector<bh_instruction> &instr_list) {
+    for (const bh_instruction &instr: instr_list) {
+        if (not bh_opcode_is_system(instr.opcode)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool util_fast_math(const ConfigParser &config) {
+    return config.defaultGet<bool>("fast_math", false) or config.defaultGet<bool>("fast_math_region", false);
+}
+
+bool util_fast_math_message(ConfigParser &config, const string &msg) {
+    if (msg != "fast_math: on" and msg != "fast_math: off") {
+        return false;
+    }
+    config.set(config.getName(), "fast_math_region", msg == "fast_math: on" ? "true" : "false");
+    return true;
 }
 
 } // jitk
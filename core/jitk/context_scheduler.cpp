@@ -0,0 +1,137 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <map>
+#include <memory>
+#include <vector>
+#include <algorithm>
+
+#include <jitk/context_scheduler.hpp>
+
+using namespace std;
+
+namespace bohrium {
+namespace jitk {
+
+ContextScheduler &ContextScheduler::get(const string &device, uint64_t capacity) {
+    static mutex schedulers_mutex;
+    static map<string, unique_ptr<ContextScheduler> > schedulers;
+    lock_guard<mutex> lock(schedulers_mutex);
+    unique_ptr<ContextScheduler> &ret = schedulers[device];
+    if (ret == nullptr) {
+        ret.reset(new ContextScheduler(std::max<uint64_t>(1, capacity)));
+    }
+    return *ret;
+}
+
+void ContextScheduler::grant() {
+    vector<Context *> waiting;
+    for (Context *context: _contexts) {
+        if (context->_waiting) {
+            waiting.push_back(context);
+        }
+    }
+    // The highest priority goes first, then the smallest usage, and then the first to arrive
+    std::sort(waiting.begin(), waiting.end(), [](const Context *a, const Context *b) {
+        if (a->_priority != b->_priority) {
+            return a->_priority > b->_priority;
+        }
+        if (a->_usage != b->_usage) {
+            return a->_usage < b->_usage;
+        }
+        return a->_arrival < b->_arrival;
+    });
+    // NB: we stop at the first context that doesn't fit thus the smaller quotas behind it cannot starve it
+    bool granted = false;
+    for (Context *context: waiting) {
+        if (_in_use + context->_quota > capacity) {
+            break;
+        }
+        context->_waiting = false;
+        context->_held = context->_quota;
+        _in_use += context->_held;
+        granted = true;
+    }
+    if (granted) {
+        _granted.notify_all();
+    }
+}
+
+ContextScheduler::Context::Context(const string &device, uint64_t capacity, const ConfigParser &config,
+                                   const string &quota_option) :
+        _scheduler(ContextScheduler::get(device, capacity)), _quota_option(quota_option) {
+    reconfigure(config);
+    lock_guard<mutex> lock(_scheduler._mutex);
+    // A new context starts at the least usage of the others thus it cannot monopolize the device
+    bool first = true;
+    for (const Context *context: _scheduler._contexts) {
+        _usage = first ? context->_usage : std::min(_usage, context->_usage);
+        first = false;
+    }
+    _scheduler._contexts.push_back(this);
+}
+
+ContextScheduler::Context::~Context() {
+    lock_guard<mutex> lock(_scheduler._mutex);
+    _scheduler._contexts.remove(this);
+}
+
+void ContextScheduler::Context::reconfigure(const ConfigParser &config) {
+    lock_guard<mutex> lock(_scheduler._mutex);
+    _priority = config.defaultGet<int64_t>("priority", 0);
+    _share = std::max(1e-6, config.defaultGet<double>("share", 1.0));
+    // Zero or a quota beyond the capacity means the whole device
+    const uint64_t quota = config.defaultGet<uint64_t>(_quota_option, 0);
+    _quota = quota == 0 ? _scheduler.capacity : std::min(quota, _scheduler.capacity);
+}
+
+bool ContextScheduler::Context::shared() const {
+    lock_guard<mutex> lock(_scheduler._mutex);
+    return _scheduler._contexts.size() > 1;
+}
+
+ContextScheduler::Slot::Slot(Context *context) : _context(context) {
+    if (_context == NULL) {
+        return;
+    }
+    ContextScheduler &scheduler = _context->_scheduler;
+    unique_lock<mutex> lock(scheduler._mutex);
+    _context->_waiting = true;
+    _context->_arrival = scheduler._arrivals++;
+    scheduler.grant();
+    scheduler._granted.wait(lock, [this]() { return not _context->_waiting; });
+    _begin = chrono::steady_clock::now();
+}
+
+ContextScheduler::Slot::~Slot() {
+    if (_context == NULL) {
+        return;
+    }
+    const chrono::duration<double> elapsed = chrono::steady_clock::now() - _begin;
+    ContextScheduler &scheduler = _context->_scheduler;
+    lock_guard<mutex> lock(scheduler._mutex);
+    _context->_usage += elapsed.count() * _context->_held / _context->_share;
+    scheduler._in_use -= _context->_held;
+    _context->_held = 0;
+    scheduler.grant();
+}
+
+} // jitk
+} // bohrium
@@ -0,0 +1,170 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <map>
+#include <set>
+#include <algorithm>
+
+#include <jitk/cost_model.hpp>
+
+using namespace std;
+
+namespace bohrium {
+namespace jitk {
+
+namespace {
+
+// Returns the bytes of 'view' where broadcasted dimensions are only read once
+double view_bytes(const bh_view &view) {
+    return static_cast<double>(bh_nelements_nbcast(&view)) * bh_type_size(view.base->type);
+}
+
+// Returns the distinct non-constant views in 'instr_list' that isn't one of the 'temps'
+set<bh_view> non_temp_views(const vector<InstrPtr> &instr_list, const set<bh_base *> &temps) {
+    set<bh_view> ret;
+    for (const InstrPtr &instr: instr_list) {
+        for (const bh_view &view: instr->operand) {
+            if (not bh_is_constant(&view) and temps.find(view.base) == temps.end()) {
+                ret.insert(view);
+            }
+        }
+    }
+    return ret;
+}
+
+} // Anon namespace
+
+CostModel::CostModel(const ConfigParser &config) :
+        cache_bytes(config.defaultGet<uint64_t>("cost_model_cache_bytes", 262144)),
+        max_streams(config.defaultGet<uint64_t>("cost_model_streams", 16)),
+        registers(config.defaultGet<uint64_t>("cost_model_registers", 16)),
+        vector_bytes(config.defaultGet<uint64_t>("cost_model_vector_bytes", 32)) {}
+
+double CostModel::cost(const Block &block) const {
+    if (block.isSystemOnly()) {
+        return 0;
+    }
+    const set<bh_base *> temps = block.isInstr() ? set<bh_base *>() : block.getLoop().getAllTemps();
+    set<const bh_base *> non_temps;
+    for (const InstrPtr &instr: block.getAllInstr()) {
+        for (const bh_view &view: instr->operand) {
+            if (not bh_is_constant(&view) and temps.find(view.base) == temps.end()) {
+                non_temps.insert(view.base);
+            }
+        }
+    }
+    double ret = 0;
+    for (const bh_base *base: non_temps) {
+        ret += bh_base_size(base);
+    }
+    if (not block.isInstr()) {
+        ret += extra_traffic(block.getLoop());
+    }
+    return ret;
+}
+
+double CostModel::extra_traffic(const LoopB &loop) const {
+    double ret = 0;
+    const set<bh_base *> temps = loop.getAllTemps();
+
+    if (loop.isInnermost()) {
+        const vector<InstrPtr> instr_list = loop.getLocalInstr();
+        const set<bh_view> streams = non_temp_views(instr_list, temps);
+
+        // The live arrays of an iteration are the streams and the contracted temporaries. Each vector
+        // iteration handles 'lanes' elements of the smallest type thus larger types occupy several registers.
+        set<const bh_base *> live_temps;
+        uint64_t min_type_size = 8;
+        uint64_t nelem = 0;
+        for (const InstrPtr &instr: instr_list) {
+            for (const bh_view &view: instr->operand) {
+                if (not bh_is_constant(&view)) {
+                    min_type_size = std::min<uint64_t>(min_type_size, bh_type_size(view.base->type));
+                    if (temps.find(view.base) != temps.end()) {
+                        live_temps.insert(view.base);
+                    }
+                }
+            }
+            if (not bh_opcode_is_system(instr->opcode)) {
+                const vector<int64_t> shape = instr->shape();
+                nelem = std::max<uint64_t>(nelem, static_cast<uint64_t>(bh_nelements(shape.size(), &shape[0])));
+            }
+        }
+        const uint64_t lanes = std::max<uint64_t>(1, vector_bytes / min_type_size);
+        auto registers_needed = [&](const bh_base *base) -> uint64_t {
+            const uint64_t bytes = lanes * bh_type_size(base->type);
+            return (bytes + vector_bytes - 1) / vector_bytes;
+        };
+        uint64_t demand = 0;
+        for (const bh_view &view: streams) {
+            demand += registers_needed(view.base);
+        }
+        for (const bh_base *base: live_temps) {
+            demand += registers_needed(base);
+        }
+        // Each excess register is spilled and reloaded once per vector iteration
+        if (demand > registers) {
+            ret += 2.0 * (demand - registers) * vector_bytes * (static_cast<double>(nelem) / lanes);
+        }
+        // Streams beyond what the hardware tracks slow down all streams proportionally
+        if (streams.size() > max_streams) {
+            double stream_bytes = 0;
+            for (const bh_view &view: streams) {
+                stream_bytes += view_bytes(view);
+            }
+            ret += stream_bytes * (streams.size() - max_streams) / max_streams;
+        }
+        return ret;
+    }
+
+    vector<const LoopB *> sub_loops;
+    for (const Block &b: loop._block_list) {
+        if (not b.isInstr()) {
+            sub_loops.push_back(&b.getLoop());
+            ret += extra_traffic(b.getLoop());
+        }
+    }
+
+    // Sibling sub-blocks only reuse each other's arrays through the cache when the data touched
+    // by one iteration of this loop fits in cache
+    if (sub_loops.size() > 1 and loop.size > 0) {
+        double footprint = 0;
+        for (const bh_view &view: non_temp_views(loop.getAllInstr(), temps)) {
+            footprint += view_bytes(view) / loop.size;
+        }
+        if (footprint > cache_bytes) {
+            map<const bh_base *, uint64_t> num_readers;
+            for (const LoopB *sub: sub_loops) {
+                for (const bh_base *base: sub->getAllBases()) {
+                    if (temps.find(const_cast<bh_base *>(base)) == temps.end()) {
+                        ++num_readers[base];
+                    }
+                }
+            }
+            for (const auto &readers: num_readers) {
+                ret += static_cast<double>(readers.second - 1) * bh_base_size(readers.first);
+            }
+        }
+    }
+    return ret;
+}
+
+} // jitk
+} // bohrium
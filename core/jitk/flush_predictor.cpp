@@ -0,0 +1,95 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <set>
+#include <boost/functional/hash.hpp>
+
+#include <jitk/flush_predictor.hpp>
+
+using namespace std;
+
+namespace bohrium {
+namespace jitk {
+
+void FlushPredictor::record(uint64_t hash, const string &source) {
+    boost::hash_combine(_current, hash);
+    _sources.push_back(source);
+}
+
+vector<string> FlushPredictor::endFlush() {
+    vector<string> ret;
+    if (_sources.empty()) {
+        return ret;
+    }
+    const uint64_t current = _current;
+    _current = 0;
+
+    // Let's remember the flush and where it came from
+    auto it = _flushes.find(current);
+    if (it == _flushes.end()) {
+        it = _flushes.insert(make_pair(current, Flush())).first;
+        it->second.sources.swap(_sources);
+        _lru.push_front(current);
+    } else {
+        _lru.splice(_lru.begin(), _lru, it->second.lru);
+    }
+    it->second.lru = _lru.begin();
+    _sources.clear();
+    auto previous = _flushes.find(_previous);
+    if (previous != _flushes.end()) {
+        ++previous->second.next[current];
+    }
+    _previous = current;
+    while (_flushes.size() > max_flushes) {
+        _flushes.erase(_lru.back());
+        _lru.pop_back();
+    }
+
+    // And follow the most frequent transitions from it
+    set<uint64_t> visited = {current};
+    const Flush *flush = &it->second;
+    for (uint64_t i = 0; i < depth; ++i) {
+        uint64_t best = 0, best_count = 0;
+        for (const auto &next: flush->next) {
+            if (next.second > best_count) {
+                best = next.first;
+                best_count = next.second;
+            }
+        }
+        auto next = _flushes.find(best);
+        if (best_count < min_count or next == _flushes.end() or not visited.insert(best).second) {
+            break;
+        }
+        flush = &next->second;
+        ret.insert(ret.end(), flush->sources.begin(), flush->sources.end());
+    }
+    return ret;
+}
+
+void FlushPredictor::clear() {
+    _flushes.clear();
+    _lru.clear();
+    _previous = 0;
+    _current = 0;
+    _sources.clear();
+}
+
+} // jitk
+} // bohrium
@@ -22,6 +22,8 @@ If not, see <http://www.gnu.org/licenses/>.
 #include <numeric>
 #include <queue>
 #include <cassert>
+#include <unordered_map>
+#include <unordered_set>
 
 #include <jitk/fuser.hpp>
 #include <jitk/graph.hpp>
@@ -88,72 +90,132 @@ bool fully_data_parallel_compatible(const bh_view &writer, const bh_view &reader
     return true;
 }
 
-// Check if 'a' and 'b' (in that order) supports data-parallelism when merged
-bool fully_data_parallel_compatible(const InstrPtr a, const InstrPtr b) {
-    if (bh_opcode_is_system(a->opcode) || bh_opcode_is_system(b->opcode))
-        return true;
-
-    // Gather reads its first input in arbitrary order
-    if (b->opcode == BH_GATHER) {
-        if (a->operand[0].base == b->operand[1].base) {
+/* The accesses of the instructions of a block, which checks in O(1) per operand that an instruction is fully fusible
+ * with all of them (in that order). It is the same check as fully_data_parallel_compatible() between the instruction
+ * and each instruction of the block, but only the instructions that access the same bases can conflict thus we only
+ * need the views of each base and whether they are all identical.
+ */
+class BlockAccess {
+    // The first view of a base and whether all other views of the base are identical to it
+    struct Views {
+        bh_view first;
+        bool uniform;
+    };
+    // The dominating shape of the non-system instructions
+    vector<int64_t> _shape;
+    bool _empty = true;
+    // The views written and the views accessed (read or written) of each base
+    unordered_map<const bh_base*, Views> _written, _accessed;
+    // The bases written by scatters and the bases accessed by instructions that aren't scatters
+    unordered_set<const bh_base*> _scattered, _accessed_by_nonscatter;
+    // The views written by the ranges of the block
+    unordered_map<const bh_base*, Views> _ranges;
+
+    static bool is_scatter(const bh_instruction &instr) {
+        return instr.opcode == BH_SCATTER or instr.opcode == BH_COND_SCATTER or instr.opcode == BH_ADD_SCATTER;
+    }
+    // A range writes the offsets of its view (without the start) thus a scatter through the indexes of a range of the
+    // block writes the element of each iteration, and it is elementwise on its output with the strides of the range
+    bool elementwise_scatter(const bh_instruction &instr, bh_view &out) const {
+        if (not is_scatter(instr) or bh_is_constant(&instr.operand[2])) {
             return false;
         }
-    }
-
-    // Scatter writes in arbitrary order
-    if (a->opcode == BH_SCATTER or a->opcode == BH_COND_SCATTER) {
-        for(size_t i=0; i<b->operand.size(); ++i) {
-            if ((not bh_is_constant(&b->operand[i])) and a->operand[0].base == b->operand[i].base) {
-                return false;
-            }
+        auto it = _ranges.find(instr.operand[2].base);
+        if (it == _ranges.end() or not it->second.uniform or
+            not fully_data_parallel_compatible(it->second.first, instr.operand[2])) {
+            return false;
         }
-    } else if (b->opcode == BH_SCATTER or b->opcode == BH_COND_SCATTER) {
-        for(size_t i=0; i<a->operand.size(); ++i) {
-            if ((not bh_is_constant(&a->operand[i])) and b->operand[0].base == a->operand[i].base) {
-                return false;
-            }
+        const int64_t start = instr.operand[0].start;
+        out = instr.operand[2];
+        out.base = instr.operand[0].base;
+        out.start = start;
+        return true;
+    }
+    static void add_view(unordered_map<const bh_base*, Views> &views, const bh_view &view) {
+        auto it = views.find(view.base);
+        if (it == views.end()) {
+            views.insert(make_pair(view.base, Views{view, true}));
+        } else if (it->second.uniform and not fully_data_parallel_compatible(it->second.first, view)) {
+            it->second.uniform = false;
         }
     }
+    // Whether all the views of 'view.base' in 'views' are identical to 'view'
+    static bool all_identical(const unordered_map<const bh_base*, Views> &views, const bh_view &view) {
+        auto it = views.find(view.base);
+        return it == views.end() or (it->second.uniform and fully_data_parallel_compatible(it->second.first, view));
+    }
 
-    {// The output of 'a' cannot conflict with the input and output of 'b'
-        const bh_view &src = a->operand[0];
-        for (const bh_view &b_op: b->operand) {
-            if (not fully_data_parallel_compatible(src, b_op)) {
+public:
+    // Check if all instructions in the block is fully fusible with 'instr' (in that order)
+    bool fusible(const bh_instruction &instr) const {
+        if (_empty or bh_opcode_is_system(instr.opcode)) {
+            return true;
+        }
+        if (instr.shape() != _shape) {
+            return false;
+        }
+        // Gather reads its first input in arbitrary order
+        if (instr.opcode == BH_GATHER and util::exist(_written, instr.operand[1].base)) {
+            return false;
+        }
+        bh_view out = instr.operand[0];
+        const bool elementwise = elementwise_scatter(instr, out);
+        for (size_t i = 0; i < instr.operand.size(); ++i) {
+            const bh_view &v = i == 0 ? out : instr.operand[i];
+            if (bh_is_constant(&v)) {
+                continue;
+            }
+            // Scatter writes in arbitrary order
+            if (util::exist(_scattered, v.base)) {
                 return false;
             }
-        }
-    }
-    {// The output of 'b' cannot conflict with the input and output of 'a'
-        const bh_view &src = b->operand[0];
-        for (const bh_view &a_op: a->operand) {
-            if (not fully_data_parallel_compatible(src, a_op)) {
+            // The outputs of the block cannot conflict with the input and output of 'instr'
+            if (not all_identical(_written, v)) {
                 return false;
             }
         }
-    }
-    return true;
-}
-
-// Check if all instructions in 'instr_list' is fully fusible with 'instr' (in that order)
-bool fully_fusible(const vector<InstrPtr> &instr_list, const InstrPtr &instr) {
-
-    if (instr_list.size() == 0)
-        return true;
-    if (bh_opcode_is_system(instr->opcode)) {
-        return true;
+        if (elementwise) {
+            return all_identical(_accessed, out);
+        }
+        if (is_scatter(instr) and util::exist(_accessed_by_nonscatter, instr.operand[0].base)) {
+            return false;
+        }
+        // The output of 'instr' cannot conflict with the input and output of the block
+        return all_identical(_accessed, instr.operand[0]);
     }
 
-    const auto dshape = instr->shape();
-    for (const InstrPtr &i: instr_list) {
-        if (bh_opcode_is_system(i->opcode)) {
-            continue;
+    // Add 'instr' to the block
+    void add(const bh_instruction &instr) {
+        if (bh_opcode_is_system(instr.opcode)) {
+            return;
         }
-        if (i->shape() != dshape or not fully_data_parallel_compatible(i, instr)) {
-            return false;
+        if (_empty) {
+            _shape = instr.shape();
+            _empty = false;
+        }
+        bh_view out = instr.operand[0];
+        const bool elementwise = elementwise_scatter(instr, out);
+        // Only the ranges of bases that nothing else writes hold the indexes of the iterations
+        if (instr.opcode == BH_RANGE and not util::exist(_written, out.base)) {
+            add_view(_ranges, out);
+        } else {
+            _ranges.erase(out.base);
+        }
+        add_view(_written, out);
+        if (is_scatter(instr) and not elementwise) {
+            _scattered.insert(instr.operand[0].base);
+        }
+        for (size_t i = 0; i < instr.operand.size(); ++i) {
+            const bh_view &v = i == 0 ? out : instr.operand[i];
+            if (not bh_is_constant(&v)) {
+                add_view(_accessed, v);
+                if (not is_scatter(instr) or elementwise) {
+                    _accessed_by_nonscatter.insert(v.base);
+                }
+            }
         }
     }
-    return true;
-}
+};
 
 // Returns a set of bases that the instruction accesses and is in 'container'
 set<bh_base*> instr_accessing(const bh_instruction *instr, const set<bh_base*> &container) {
@@ -172,11 +234,11 @@ set<bh_base*> instr_accessing(const bh_instruction *instr, const set<bh_base*> &
 vector<InstrPtr> simplify_instr_list(const vector<bh_instruction *> &instr_list) {
 
     // Map from instruction to the set of bases that it is the last to access
-    map<const bh_instruction*, set<bh_base *> > last_access;
+    unordered_map<const bh_instruction*, set<bh_base *> > last_access;
     // Map from a base to the instruction that frees it (if any)
-    map<bh_base*, const bh_instruction*> base2frees_instr;
+    unordered_map<bh_base*, const bh_instruction*> base2frees_instr;
     // Set of free instruction
-    set<const bh_instruction*> instr_frees;
+    unordered_set<const bh_instruction*> instr_frees;
 
     // Find the instructions that should have frees inserted after them
     {
@@ -201,6 +263,7 @@ vector<InstrPtr> simplify_instr_list(const vector<bh_instruction *> &instr_list)
 
     // Simplify and move BH_FREE's up the list
     vector<InstrPtr> ret;
+    ret.reserve(instr_list.size());
     for (const bh_instruction *instr: instr_list) {
         if (util::exist(instr_frees, instr)) {
             continue; // Skipping frees that were moved
@@ -209,14 +272,15 @@ vector<InstrPtr> simplify_instr_list(const vector<bh_instruction *> &instr_list)
         {
             bh_instruction instr_simply(*instr);
             simplify_instr(instr_simply);
-            ret.push_back(std::make_shared<const bh_instruction>(instr_simply));
+            ret.push_back(make_instr(std::move(instr_simply)));
         }
         // Insert BH_FREE's after the instruction that last accesses them
-        if (util::exist(last_access, instr)) {
-            for (bh_base *base: last_access.at(instr)) {
-                ret.push_back(std::make_shared<const bh_instruction>(*base2frees_instr.at(base)));
+        auto it = last_access.find(instr);
+        if (it != last_access.end()) {
+            for (bh_base *base: it->second) {
+                ret.push_back(make_instr(*base2frees_instr.at(base)));
             }
-            last_access.erase(instr);
+            last_access.erase(it);
         }
     }
     return ret;
@@ -232,10 +296,13 @@ vector<Block> pre_fuser_lossy(const vector<bh_instruction *> &instr_list) {
             // We should not make blocks that start with a sysop since we only have LoopB::insert_system_after()
             continue;
         }
+        BlockAccess access;
+        access.add(**it);
         ++it;
         // Let's search for fully fusible blocks
         for (; it != instr_list_simply.end(); ++it) {
-            if (fully_fusible(block, *it)) {
+            if (access.fusible(**it)) {
+                access.add(**it);
                 block.push_back(*it);
             } else {
                 break;
@@ -375,16 +442,48 @@ void fuser_reshapable_first(vector<Block> &block_list, bool avoid_rank0_sweep) {
     block_list = ret;
 }
 
-void fuser_greedy(vector<Block> &block_list, bool avoid_rank0_sweep) {
+void fuser_greedy(vector<Block> &block_list, bool avoid_rank0_sweep, graph::FuseModel model) {
+
+    graph::DAG dag = graph::from_block_list(block_list);
+    graph::greedy(dag, avoid_rank0_sweep, NULL, model);
+    vector<Block> ret = graph::fill_block_list(dag);
+
+    // Let's fuse at the next rank level
+    for (Block &b: ret) {
+        if (not b.isInstr()) {
+            fuser_greedy(b.getLoop()._block_list, avoid_rank0_sweep, model);
+        }
+    }
+    block_list = ret;
+}
+
+void fuser_cost_model(vector<Block> &block_list, bool avoid_rank0_sweep, const CostModel &cost_model,
+                      graph::FuseModel model) {
+
+    graph::DAG dag = graph::from_block_list(block_list);
+    graph::greedy(dag, avoid_rank0_sweep, &cost_model, model);
+    vector<Block> ret = graph::fill_block_list(dag);
+
+    // Let's fuse at the next rank level
+    for (Block &b: ret) {
+        if (not b.isInstr()) {
+            fuser_cost_model(b.getLoop()._block_list, avoid_rank0_sweep, cost_model, model);
+        }
+    }
+    block_list = ret;
+}
+
+void fuser_beam(vector<Block> &block_list, bool avoid_rank0_sweep, size_t width,
+                chrono::steady_clock::time_point deadline, graph::FuseModel model) {
 
     graph::DAG dag = graph::from_block_list(block_list);
-    graph::greedy(dag, avoid_rank0_sweep);
+    graph::beam(dag, avoid_rank0_sweep, width, deadline, model);
     vector<Block> ret = graph::fill_block_list(dag);
 
     // Let's fuse at the next rank level
     for (Block &b: ret) {
         if (not b.isInstr()) {
-            fuser_greedy(b.getLoop()._block_list, avoid_rank0_sweep);
+            fuser_beam(b.getLoop()._block_list, avoid_rank0_sweep, width, deadline, model);
         }
     }
     block_list = ret;
@@ -20,10 +20,11 @@ If not, see <http://www.gnu.org/licenses/>.
 
 #include <vector>
 #include <iostream>
-#include <boost/functional/hash.hpp>
+#include <fstream>
+#include <boost/filesystem.hpp>
 
 #include <jitk/fuser_cache.hpp>
-#include <bh_seqset.hpp>
+#include <jitk/codegen_util.hpp>
 
 
 using namespace std;
@@ -33,50 +34,57 @@ namespace jitk {
 
 namespace {
 
-boost::hash<string> hasher;
-constexpr size_t SEP_INSTR = SIZE_MAX;
-constexpr size_t SEP_OP = SIZE_MAX - 1;
-// constexpr size_t SEP_BLOCK = SIZE_MAX - 2;
-constexpr size_t SEP_SHAPE = SIZE_MAX - 3;
+constexpr uint64_t SEP_INSTR = UINT64_MAX;
+constexpr uint64_t SEP_OP = UINT64_MAX - 1;
+constexpr uint64_t SEP_CONST = UINT64_MAX - 2;
 
-/* The Instruction hash consists of the following fields:
- * <view_id><start><ndim>[<shape><stride><SEP_SHAPE>...]<SEP_OP>
+// Streaming 64-bit hash, which mixes one word at a time using the multiply-xorshift steps of wyhash/splitmix64
+class StreamHash {
+    uint64_t _state;
+public:
+    explicit StreamHash(uint64_t seed) : _state(seed ^ 0x9e3779b97f4a7c15ULL) {}
+
+    StreamHash &operator<<(uint64_t word) {
+        word *= 0xbf58476d1ce4e5b9ULL;
+        word ^= word >> 31;
+        _state = (_state ^ word) * 0x94d049bb133111ebULL;
+        _state ^= _state >> 29;
+        return *this;
+    }
+
+    uint64_t value() const {
+        return _state;
+    }
+};
+
+/* The view hash consists of the following fields:
+ * <base_id><type><start><ndim>[<shape><stride>...]<SEP_OP>
+ * where 'base_id' is the index of the base in the order of first appearance
  */
-void hash_view(const bh_view &view, seqset<bh_view> &views, std::stringstream &ss) {
-    if (not bh_is_constant(&view)) {
-        size_t view_id = views.insert(view).first;
-        ss << view_id;
-        ss << view.start;
-        ss << view.ndim;
+void hash_view(const bh_view &view, unordered_map<const bh_base*, uint64_t> &base_ids, StreamHash &hash) {
+    if (bh_is_constant(&view)) {
+        hash << SEP_CONST;
+    } else {
+        const uint64_t base_id = base_ids.insert(make_pair(view.base, base_ids.size())).first->second;
+        hash << base_id << static_cast<uint64_t>(view.base->type);
+        hash << static_cast<uint64_t>(view.start) << static_cast<uint64_t>(view.ndim);
         for (int j = 0; j < view.ndim; ++j) {
-            ss << view.shape[j];
-            ss << view.stride[j];
-            ss << SEP_SHAPE;
+            hash << static_cast<uint64_t>(view.shape[j]) << static_cast<uint64_t>(view.stride[j]);
         }
-        ss << SEP_OP;
+        hash << SEP_OP;
     }
 }
 
 /* The Instruction hash consists of the following fields:
- * <opcode[<hash_view>...]<sweep_axis()><SEP_INSTR>
+ * <opcode>[<hash_view>...]<sweep_axis()><SEP_INSTR>
  */
-void hash_instr(const bh_instruction &instr, seqset<bh_view> &views, std::stringstream &ss) {
-    ss << instr.opcode; // <opcode>
+void hash_instr(const bh_instruction &instr, unordered_map<const bh_base*, uint64_t> &base_ids, StreamHash &hash) {
+    hash << static_cast<uint64_t>(instr.opcode);
     for(const bh_view &op: instr.operand) {
-        hash_view(op, views, ss);
-    }
-    ss << instr.sweep_axis();
-    ss << SEP_INSTR;
-}
-
-// Hash of an instruction list
-size_t hash_instr_list(const vector<bh_instruction *> &instr_list) {
-    stringstream ss;
-    seqset<bh_view> views;
-    for (const bh_instruction *instr: instr_list) {
-        hash_instr(*instr, views, ss);
+        hash_view(op, base_ids, hash);
     }
-    return hasher(ss.str());
+    hash << static_cast<uint64_t>(instr.sweep_axis());
+    hash << SEP_INSTR;
 }
 
 void updateWithOrigin(bh_view &view, const bh_view &origin) {
@@ -112,34 +120,365 @@ void updateWithOrigin(Block &block, const map<int64_t, const bh_instruction *> &
     }
 }
 
+// Returns true when a segment ends just before the i'th instruction of 'instr_list'
+// NB: a segment must not start with a system instruction since the pre-fuser cannot handle that
+bool is_segment_end(const vector<bh_instruction *> &instr_list, size_t i) {
+    if (i == instr_list.size()) {
+        return true;
+    }
+    return i > 0 and bh_opcode_is_system(instr_list[i-1]->opcode) and not bh_opcode_is_system(instr_list[i]->opcode);
+}
+
+// Returns the estimated memory usage of 'block' including its sub-blocks and instructions
+uint64_t estimate_bytes(const Block &block) {
+    // Estimated size of a node in a std::set
+    constexpr uint64_t SET_NODE = 4 * sizeof(void*);
+    uint64_t ret = sizeof(Block);
+    if (block.isInstr()) {
+        const bh_instruction &instr = *block.getInstr();
+        ret += sizeof(bh_instruction) + instr.operand.capacity() * sizeof(bh_view);
+    } else {
+        const LoopB &loop = block.getLoop();
+        for (const Block &b: loop._block_list) {
+            ret += estimate_bytes(b);
+        }
+        ret += (loop._sweeps.size() + loop._news.size() + loop._frees.size()) * SET_NODE;
+    }
+    return ret;
+}
+
+/* The fuse cache file consists of the header followed by each entry:
+ *     <hash><number of blocks>[<block>...]
+ * where a block is either an instruction or a loop:
+ *     <BLOCK_INSTR><rank><opcode><origin_id><constructor><constant><number of operands>[<view>...]
+ *     <BLOCK_LOOP><rank><size><tile_size><number of sub-blocks>[<block>...]
+ * and a view is <is_constant> or <is_constant><start><ndim>[<shape><stride>...]
+ * NB: the bases of the views are not saved since get() replaces them with the bases of the origin instructions
+ */
+const char file_header[] = "BHFUSECACHE3";
+constexpr uint8_t BLOCK_INSTR = 0;
+constexpr uint8_t BLOCK_LOOP = 1;
+
+// The base of the loaded views, which only marks them as non-constants until get() replaces it
+bh_base placeholder_base;
+
+template <typename T>
+void write_pod(ostream &out, const T &value) {
+    out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+template <typename T>
+T read_pod(istream &in) {
+    T ret;
+    in.read(reinterpret_cast<char*>(&ret), sizeof(T));
+    if (not in) {
+        throw runtime_error("fuse cache file is truncated");
+    }
+    return ret;
+}
+
+void write_block(ostream &out, const Block &block) {
+    if (block.isInstr()) {
+        const bh_instruction &instr = *block.getInstr();
+        write_pod(out, BLOCK_INSTR);
+        write_pod<int32_t>(out, block.rank());
+        write_pod<int32_t>(out, instr.opcode);
+        write_pod<int64_t>(out, instr.origin_id);
+        write_pod<uint8_t>(out, instr.constructor);
+        write_pod(out, instr.constant);
+        write_pod<uint32_t>(out, instr.operand.size());
+        for (const bh_view &view: instr.operand) {
+            const bool is_constant = bh_is_constant(&view);
+            write_pod<uint8_t>(out, is_constant);
+            if (not is_constant) {
+                write_pod<int64_t>(out, view.start);
+                write_pod<int64_t>(out, view.ndim);
+                for (int64_t i = 0; i < view.ndim; ++i) {
+                    write_pod<int64_t>(out, view.shape[i]);
+                    write_pod<int64_t>(out, view.stride[i]);
+                }
+            }
+        }
+    } else {
+        const LoopB &loop = block.getLoop();
+        write_pod(out, BLOCK_LOOP);
+        write_pod<int32_t>(out, loop.rank);
+        write_pod<int64_t>(out, loop.size);
+        write_pod<int64_t>(out, loop.tile_size);
+        write_pod<uint64_t>(out, loop._block_list.size());
+        for (const Block &b: loop._block_list) {
+            write_block(out, b);
+        }
+    }
+}
+
+Block read_block(istream &in) {
+    const uint8_t kind = read_pod<uint8_t>(in);
+    if (kind == BLOCK_INSTR) {
+        const int rank = read_pod<int32_t>(in);
+        bh_instruction instr;
+        instr.opcode = static_cast<bh_opcode>(read_pod<int32_t>(in));
+        instr.origin_id = read_pod<int64_t>(in);
+        instr.constructor = read_pod<uint8_t>(in) != 0;
+        instr.constant = read_pod<bh_constant>(in);
+        instr.operand.resize(read_pod<uint32_t>(in));
+        for (bh_view &view: instr.operand) {
+            if (read_pod<uint8_t>(in)) {
+                view.base = NULL;
+            } else {
+                view.base = &placeholder_base;
+                view.start = read_pod<int64_t>(in);
+                view.ndim = read_pod<int64_t>(in);
+                if (view.ndim < 0 or view.ndim > BH_MAXDIM) {
+                    throw runtime_error("fuse cache file is corrupted");
+                }
+                for (int64_t i = 0; i < view.ndim; ++i) {
+                    view.shape[i] = read_pod<int64_t>(in);
+                    view.stride[i] = read_pod<int64_t>(in);
+                }
+            }
+        }
+        return Block(instr, rank);
+    } else if (kind == BLOCK_LOOP) {
+        LoopB loop;
+        loop.rank = read_pod<int32_t>(in);
+        loop.size = read_pod<int64_t>(in);
+        loop.tile_size = read_pod<int64_t>(in);
+        loop._block_list.resize(read_pod<uint64_t>(in));
+        for (Block &b: loop._block_list) {
+            b = read_block(in);
+        }
+        loop.metadata_update();
+        return Block(std::move(loop));
+    } else {
+        throw runtime_error("fuse cache file is corrupted");
+    }
+}
+
 } // Anon namespace
 
-pair<vector<Block>, bool> FuseCache::get(const vector<bh_instruction *> &instr_list) {
-    const size_t lookup_hash = hash_instr_list(instr_list);
+FuseCache::FuseCache(const ConfigParser &config, jitk::Statistics &stat) :
+        stat(stat),
+        max_entries(config.defaultGet<uint64_t>("fuser_cache_max_entries", 0)),
+        max_bytes(config.defaultGet<uint64_t>("fuser_cache_max_bytes", 0)),
+        filename(expand_user(config.defaultGet<string>("fuser_cache_file", "")).string()),
+        verbose(config.defaultGet<bool>("verbose", false)) {
+    _store = open_store();
+    std::lock_guard<std::mutex> lock(_store->mutex);
+    stat.fuser_cache_entries = _store->cache.size();
+    stat.fuser_cache_bytes = _store->bytes;
+}
+
+FuseCache::~FuseCache() {
+    std::lock_guard<std::mutex> lock(_store->mutex);
+    if (not filename.empty() and _store->dirty) {
+        try {
+            save();
+            _store->dirty = false;
+        } catch (const std::exception &e) {
+            cerr << "[FuseCache] could not save \"" << filename << "\": " << e.what() << endl;
+        }
+    }
+}
+
+shared_ptr<FuseCache::Store> FuseCache::open_store() {
+    if (filename.empty()) {
+        return make_shared<Store>();
+    }
+    static std::mutex registry_mutex;
+    static map<string, weak_ptr<Store> > registry;
+    std::lock_guard<std::mutex> registry_lock(registry_mutex);
+    shared_ptr<Store> ret = registry[filename].lock();
+    if (not ret) {
+        ret = make_shared<Store>();
+        registry[filename] = ret;
+        _store = ret;
+        std::lock_guard<std::mutex> lock(_store->mutex);
+        load();
+    }
+    return ret;
+}
+
+void FuseCache::load() {
+    ifstream in(filename, ios::binary);
+    if (not in.good()) { // No file is not an error, the first process creates it
+        return;
+    }
+    try {
+        char header[sizeof(file_header)];
+        in.read(header, sizeof(header));
+        if (not in or string(header, sizeof(header)) != string(file_header, sizeof(file_header))) {
+            throw runtime_error("fuse cache file has the wrong format or version");
+        }
+        const uint64_t num_entries = read_pod<uint64_t>(in);
+        for (uint64_t i = 0; i < num_entries; ++i) {
+            const uint64_t lookup_hash = read_pod<uint64_t>(in);
+            vector<Block> block_list(read_pod<uint64_t>(in));
+            for (Block &block: block_list) {
+                block = read_block(in);
+            }
+            insert_entry(lookup_hash, block_list);
+        }
+    } catch (const std::exception &e) {
+        cerr << "[FuseCache] ignoring \"" << filename << "\": " << e.what() << endl;
+        _store->cache.clear();
+        _store->lru.clear();
+        _store->bytes = 0;
+    }
+    if (verbose) {
+        cout << "[FuseCache] loaded " << _store->cache.size() << " entries from \"" << filename << "\"" << endl;
+    }
+}
+
+void FuseCache::save() const {
+    namespace fs = boost::filesystem;
+    const fs::path path(filename);
+    if (path.has_parent_path()) {
+        fs::create_directories(path.parent_path());
+    }
+    // We write to a unique file and rename it thus concurrent processes never see a partial file
+    const fs::path tmpfile = fs::path(filename + fs::unique_path("-%%%%%%%%.tmp").string());
+    {
+        ofstream out(tmpfile.string(), ios::binary);
+        out.write(file_header, sizeof(file_header));
+        write_pod<uint64_t>(out, _store->cache.size());
+        // We write the least recently used first thus loading the file recreates the LRU order
+        for (auto it = _store->lru.rbegin(); it != _store->lru.rend(); ++it) {
+            const vector<Block> &block_list = _store->cache.at(*it).block_list;
+            write_pod<uint64_t>(out, *it);
+            write_pod<uint64_t>(out, block_list.size());
+            for (const Block &block: block_list) {
+                write_block(out, block);
+            }
+        }
+        if (not out.good()) {
+            fs::remove(tmpfile);
+            throw runtime_error("writing failed");
+        }
+    }
+    fs::rename(tmpfile, path);
+}
+
+vector<size_t> FuseCache::segment_ends(const vector<bh_instruction *> &instr_list) {
+    vector<size_t> ret;
+    for (size_t i = 1; i <= instr_list.size(); ++i) {
+        if (is_segment_end(instr_list, i)) {
+            ret.push_back(i);
+        }
+    }
+    return ret;
+}
+
+void FuseCache::hash_prefixes(const vector<bh_instruction *> &instr_list, size_t prefix_size) {
+    assert(prefix_size <= instr_list.size());
+    _hashes.resize(prefix_size + 1);
+    _base_ids.clear();
+    _hashes[0] = 0;
+    for (size_t i = 0; i < prefix_size; ++i) {
+        StreamHash hash(_hashes[i]);
+        hash_instr(*instr_list[i], _base_ids, hash);
+        _hashes[i+1] = hash.value();
+    }
+}
+
+void FuseCache::rebind(vector<Block> &block_list, const vector<bh_instruction *> &instr_list) {
+    // Create a map: 'origin_id' => instruction
+    map<int64_t, const bh_instruction *> origin_id_to_instr;
+    for(const bh_instruction *instr: instr_list) {
+        assert(instr->origin_id >= 0);
+        assert(origin_id_to_instr.find(instr->origin_id) == origin_id_to_instr.end());
+        origin_id_to_instr.insert(make_pair(instr->origin_id, instr));
+    }
+    // Let's update the blocks with the base data from origin
+    for(Block &block: block_list) {
+        updateWithOrigin(block, origin_id_to_instr);
+    }
+}
+
+pair<vector<Block>, size_t> FuseCache::get(const vector<bh_instruction *> &instr_list) {
+    hash_prefixes(instr_list, instr_list.size());
     ++stat.fuser_cache_lookups;
-    if (_cache.find(lookup_hash) != _cache.end()) { // Cache hit!
-        vector<Block> ret = _cache.at(lookup_hash);
-        // Create a map: 'origin_id' => instruction
-        map<int64_t, const bh_instruction *> origin_id_to_instr;
-        for(const bh_instruction *instr: instr_list) {
-            assert(instr->origin_id >= 0);
-            assert(origin_id_to_instr.find(instr->origin_id) == origin_id_to_instr.end());
-            origin_id_to_instr.insert(make_pair(instr->origin_id, instr));
-        }
-        // Let's update the cached blocks in 'ret' with the base data from origin
-        for(Block &block: ret) {
-            updateWithOrigin(block, origin_id_to_instr);
-        }
-        return make_pair(ret, true);
-    } else { // Cache miss!
+
+    // Let's find the longest cached prefix and copy its block list
+    vector<Block> ret;
+    size_t prefix_size = 0;
+    {
+        std::lock_guard<std::mutex> lock(_store->mutex);
+        for (size_t i = instr_list.size(); i > 0; --i) {
+            if (is_segment_end(instr_list, i)) {
+                auto hit = _store->cache.find(_hashes[i]);
+                if (hit != _store->cache.end()) {
+                    prefix_size = i;
+                    _store->lru.splice(_store->lru.begin(), _store->lru, hit->second.lru);
+                    ret = hit->second.block_list;
+                    break;
+                }
+            }
+        }
+    }
+    if (prefix_size < instr_list.size()) {
         ++stat.fuser_cache_misses;
-        return make_pair(vector<Block>(), false);
     }
+    if (prefix_size > 0) { // Cache hit!
+        if (prefix_size < instr_list.size()) {
+            ++stat.fuser_cache_partial_hits;
+        }
+        rebind(ret, instr_list);
+        return make_pair(ret, prefix_size);
+    } else { // Cache miss!
+        return make_pair(vector<Block>(), 0);
+    }
+}
+
+void FuseCache::insert(const vector<bh_instruction *> &instr_list, size_t prefix_size,
+                       const vector<Block> &block_list) {
+    hash_prefixes(instr_list, prefix_size);
+    const uint64_t lookup_hash = _hashes[prefix_size];
+    std::lock_guard<std::mutex> lock(_store->mutex);
+    if (insert_entry(lookup_hash, block_list)) {
+        _store->dirty = true;
+    }
+    stat.fuser_cache_entries = _store->cache.size();
+    stat.fuser_cache_bytes = _store->bytes;
 }
 
-void FuseCache::insert(const vector<bh_instruction *> &instr_list, const vector<Block> &block_list) {
-    const size_t lookup_hash = hash_instr_list(instr_list);
-    _cache.insert(make_pair(lookup_hash, block_list));
+bool FuseCache::insert_entry(uint64_t lookup_hash, const vector<Block> &block_list) {
+    if (_store->cache.find(lookup_hash) != _store->cache.end()) {
+        return false;
+    }
+    uint64_t bytes = 0;
+    for (const Block &block: block_list) {
+        bytes += estimate_bytes(block);
+    }
+    _store->lru.push_front(lookup_hash);
+    _store->cache.insert(make_pair(lookup_hash, Entry{block_list, bytes, _store->lru.begin()}));
+    _store->bytes += bytes;
+    evict();
+    return true;
+}
+
+void FuseCache::clear() {
+    std::lock_guard<std::mutex> lock(_store->mutex);
+    _store->cache.clear();
+    _store->lru.clear();
+    _store->bytes = 0;
+    _store->dirty = true;
+    stat.fuser_cache_entries = 0;
+    stat.fuser_cache_bytes = 0;
+}
+
+void FuseCache::evict() {
+    // NB: we never evict the most recently inserted entry
+    Store &store = *_store;
+    while (store.cache.size() > 1 and ((max_entries > 0 and store.cache.size() > max_entries) or
+                                       (max_bytes > 0 and store.bytes > max_bytes))) {
+        auto it = store.cache.find(store.lru.back());
+        assert(it != store.cache.end());
+        store.bytes -= it->second.bytes;
+        store.cache.erase(it);
+        store.lru.pop_back();
+        ++stat.fuser_cache_evictions;
+    }
 }
 
 } // jitk
@@ -24,9 +24,12 @@ If not, see <http://www.gnu.org/licenses/>.
 #include <boost/graph/graphviz.hpp>
 #include <boost/graph/topological_sort.hpp>
 #include <boost/foreach.hpp>
+#include <boost/dynamic_bitset.hpp>
 #include <fstream>
 #include <numeric>
 #include <queue>
+#include <iomanip>
+#include <algorithm>
 #include <cassert>
 
 #include <jitk/graph.hpp>
@@ -119,7 +122,42 @@ vector<Block> fill_block_list(const DAG &dag) {
     return ret;
 }
 
-uint64_t weight(const Block &b1, const Block &b2) {
+namespace {
+// Returns the non-constant views in 'block' of arrays that aren't temporary arrays of 'block'
+set<bh_view> non_temp_views(const Block &block) {
+    set<bh_view> ret;
+    const set<bh_base *> temps = block.isInstr()?set<bh_base *>():block.getLoop().getAllTemps();
+    for (const InstrPtr instr: block.getAllInstr()) {
+        for(const bh_view &v: instr->operand) {
+            if (not bh_is_constant(&v) and temps.find(v.base) == temps.end()) {
+                ret.insert(v);
+            }
+        }
+    }
+    return ret;
+}
+
+// Returns the bytes that 'view' accesses
+uint64_t view_bytes(const bh_view &view) {
+    return static_cast<uint64_t>(bh_nelements(view)) * bh_type_size(view.base->type);
+}
+
+// Returns the bases that 'block' reads
+set<bh_base *> read_bases(const Block &block) {
+    set<bh_base *> ret;
+    for (const InstrPtr instr: block.getAllInstr()) {
+        for (size_t i = 1; i < instr->operand.size(); ++i) {
+            if (not bh_is_constant(&instr->operand[i])) {
+                ret.insert(instr->operand[i].base);
+            }
+        }
+    }
+    return ret;
+}
+} // Anon namespace
+
+// The weight of merging 'b1' into 'b2', which greedy() maximizes, priced by 'model'
+uint64_t weight(const Block &b1, const Block &b2, FuseModel model = FuseModel::BYTES) {
     if (b1.isInstr() or b2.isInstr()) {
         return 0; // Instruction blocks cannot be fused
     }
@@ -127,15 +165,45 @@ uint64_t weight(const Block &b1, const Block &b2) {
     const set<bh_base *> frees = b2.getLoop().getAllFrees();
     vector<bh_base *> new_temps;
     set_intersection(news.begin(), news.end(), frees.begin(), frees.end(), back_inserter(new_temps));
+    if (model == FuseModel::TEMP_ELIMINATION) {
+        return new_temps.size();
+    }
 
     uint64_t totalsize = 0;
     for (const bh_base *base: new_temps) {
         totalsize += bh_base_size(base);
     }
+    if (model == FuseModel::UNIQUE_VIEWS) {
+        // The views that both blocks access are accessed once by the merged block
+        const set<bh_view> views1 = non_temp_views(b1);
+        const set<bh_view> views2 = non_temp_views(b2);
+        vector<bh_view> shared;
+        set_intersection(views1.begin(), views1.end(), views2.begin(), views2.end(), back_inserter(shared));
+        for (const bh_view &view: shared) {
+            totalsize += view_bytes(view);
+        }
+    } else if (model == FuseModel::MAX_SHARE) {
+        // The arrays that both blocks read are loaded once by the merged block
+        const set<bh_base *> reads1 = read_bases(b1);
+        const set<bh_base *> reads2 = read_bases(b2);
+        vector<bh_base *> shared;
+        set_intersection(reads1.begin(), reads1.end(), reads2.begin(), reads2.end(), back_inserter(shared));
+        for (const bh_base *base: shared) {
+            totalsize += bh_base_size(base);
+        }
+    }
     return totalsize;
 }
 
-uint64_t block_cost(const Block &block) {
+// The cost of 'block', which beam() minimizes, priced by 'model'
+uint64_t block_cost(const Block &block, FuseModel model = FuseModel::BYTES) {
+    if (model == FuseModel::UNIQUE_VIEWS) {
+        uint64_t totalsize = 0;
+        for (const bh_view &view: non_temp_views(block)) {
+            totalsize += view_bytes(view);
+        }
+        return totalsize;
+    }
     std::vector<bh_base*> non_temps;
     const set<bh_base *> temps = block.isInstr()?set<bh_base *>():block.getLoop().getAllTemps();
     for (const InstrPtr instr: block.getAllInstr()) {
@@ -148,6 +216,9 @@ uint64_t block_cost(const Block &block) {
             }
         }
     }
+    if (model == FuseModel::TEMP_ELIMINATION) {
+        return non_temps.size();
+    }
     uint64_t totalsize = 0;
     for (const bh_base *base: non_temps) {
         totalsize += bh_base_size(base);
@@ -159,6 +230,69 @@ bool validate(DAG &dag) {
     return true;
 }
 
+namespace {
+// Returns the fusible edges of 'dag' after removing its transitive edges
+vector<Edge> find_fusibles(DAG &dag, bool avoid_rank0_sweep) {
+    vector<Edge> fusibles;
+    auto edges = boost::edges(dag);
+    for (auto it = edges.first; it != edges.second;) {
+        Edge e = *it; ++it; // NB: we iterate here because boost::remove_edge() invalidates 'it'
+        Vertex v1 = source(e, dag);
+        Vertex v2 = target(e, dag);
+        // Remove transitive edges
+        if(path_exist(v1, v2, dag, true)) {
+            boost::remove_edge(e, dag);
+        } else {
+            const Block &b1 = dag[v1];
+            const Block &b2 = dag[v2];
+            if (mergeable(b1, b2, avoid_rank0_sweep)) {
+                fusibles.push_back(e);
+            }
+        }
+    }
+    return fusibles;
+}
+
+// Returns the sweep axes of the instructions of 'block'
+set<int> sweep_axes(const Block &block) {
+    set<int> ret;
+    for (const InstrPtr &instr: block.getAllInstr()) {
+        if (bh_opcode_is_sweep(instr->opcode)) {
+            ret.insert(instr->sweep_axis());
+        }
+    }
+    return ret;
+}
+
+// Returns the bases that the instructions of 'block' read but don't write
+set<const bh_base *> input_bases(const Block &block) {
+    set<const bh_base *> read, written;
+    for (const InstrPtr &instr: block.getAllInstr()) {
+        if (instr->operand.empty() or bh_opcode_is_system(instr->opcode)) {
+            continue;
+        }
+        written.insert(instr->operand[0].base);
+        for (size_t i = 1; i < instr->operand.size(); ++i) {
+            if (not bh_is_constant(&instr->operand[i])) {
+                read.insert(instr->operand[i].base);
+            }
+        }
+    }
+    set<const bh_base *> ret;
+    set_difference(read.begin(), read.end(), written.begin(), written.end(), inserter(ret, ret.begin()));
+    return ret;
+}
+
+// Returns the sum of the block_cost() of all vertices in 'dag'
+uint64_t total_cost(const DAG &dag, FuseModel model) {
+    uint64_t ret = 0;
+    BOOST_FOREACH(Vertex v, boost::vertices(dag)) {
+        ret += block_cost(dag[v], model);
+    }
+    return ret;
+}
+} // Anon namespace
+
 void merge_vertices(DAG &dag, Vertex a, Vertex b, const bool remove_b) {
     // Let's merge the two blocks and save it in vertex 'a'
     assert(not dag[a].isInstr());
@@ -186,13 +320,27 @@ void merge_vertices(DAG &dag, Vertex a, Vertex b, const bool remove_b) {
 }
 
 void transitive_reduction(DAG &dag) {
-    vector<Edge> removals;
-    BOOST_FOREACH(Edge e, boost::edges(dag)) {
-        if(path_exist(source(e,dag), target(e,dag), dag, true))
-            removals.push_back(e);
+    // We visit the vertices in reverse topological order and collect the descendants of each vertex in a bitset.
+    // An edge 'v->child' is transitive when 'child' is a descendant of one of the other children of 'v'.
+    vector<Vertex> reverse_topological_order;
+    boost::topological_sort(dag, back_inserter(reverse_topological_order));
+    vector<boost::dynamic_bitset<> > descendants(boost::num_vertices(dag));
+    vector<pair<Vertex, Vertex> > removals;
+    for (Vertex v: reverse_topological_order) {
+        boost::dynamic_bitset<> long_paths(boost::num_vertices(dag));
+        BOOST_FOREACH(Vertex child, boost::adjacent_vertices(v, dag)) {
+            long_paths |= descendants[child];
+        }
+        descendants[v] = long_paths;
+        BOOST_FOREACH(Vertex child, boost::adjacent_vertices(v, dag)) {
+            if (long_paths[child]) {
+                removals.push_back(make_pair(v, child));
+            }
+            descendants[v].set(child);
+        }
     }
-    for (Edge &e: removals) {
-        remove_edge(e, dag);
+    for (const pair<Vertex, Vertex> &e: removals) {
+        boost::remove_edge(e.first, e.second, dag);
     }
     assert(validate(dag));
 }
@@ -281,9 +429,12 @@ void pprint(const DAG &dag, const char *filename, bool avoid_rank0_sweep) {
             Vertex src = source(e, graph);
             Vertex dst = target(e, graph);
             out << "[label=\" ";
-            out << (double) weight(graph[src], graph[dst]) << " bytes\"";
-            if (not mergeable(graph[src], graph[dst], avoid_sweep)) {
-                out << " color=red";
+            out << (double) weight(graph[src], graph[dst]) << " bytes";
+            const char *reason = unmergeable_reason(graph[src], graph[dst], avoid_sweep);
+            if (reason != NULL) {
+                out << "\\n" << reason << "\" color=red";
+            } else {
+                out << "\"";
             }
             out << "]";
         }
@@ -299,51 +450,241 @@ void pprint(const DAG &dag, const char *filename, bool avoid_rank0_sweep) {
     file.close();
 }
 
-void greedy(DAG &dag, bool avoid_rank0_sweep) {
-    while(1) {
-        // First we find all fusible edges
-        vector<Edge> fusibles;
-        {
-            auto edges = boost::edges(dag);
-            for (auto it = edges.first; it != edges.second;) {
-                Edge e = *it; ++it; // NB: we iterate here because boost::remove_edge() invalidates 'it'
-                Vertex v1 = source(e, dag);
-                Vertex v2 = target(e, dag);
-                // Remove transitive edges
-                if(path_exist(v1, v2, dag, true)) {
-                    boost::remove_edge(e, dag);
-                } else {
-                    const Block &b1 = dag[v1];
-                    const Block &b2 = dag[v2];
-                    if (mergeable(b1, b2, avoid_rank0_sweep)) {
-                        fusibles.push_back(e);
-                    }
-                }
+string fusion_report(const DAG &dag, bool avoid_rank0_sweep, const CostModel *cost_model) {
+    struct Rejection {
+        Vertex src, dst;
+        uint64_t bytes;
+        string reason;
+    };
+    vector<Rejection> rejections;
+    map<string, pair<uint64_t, uint64_t> > reasons; // Number of edges and bytes of each reason
+    uint64_t total_bytes = 0;
+    BOOST_FOREACH(Edge e, boost::edges(dag)) {
+        const Vertex src = source(e, dag);
+        const Vertex dst = target(e, dag);
+        string reason;
+        const char *unmergeable = unmergeable_reason(dag[src], dag[dst], avoid_rank0_sweep);
+        if (unmergeable != NULL) {
+            reason = unmergeable;
+        } else if (path_exist(src, dst, dag, true)) {
+            reason = "merging would create a cycle";
+        } else if (cost_model != NULL and
+                   not cost_model->accept(dag[src], dag[dst], reshape_and_merge(dag[src].getLoop(),
+                                                                                dag[dst].getLoop()))) {
+            reason = "rejected by the cost model";
+        } else {
+            reason = "not chosen by the fuser";
+        }
+        const uint64_t bytes = weight(dag[src], dag[dst]);
+        rejections.push_back(Rejection{src, dst, bytes, reason});
+        reasons[reason].first += 1;
+        reasons[reason].second += bytes;
+        total_bytes += bytes;
+    }
+    stable_sort(rejections.begin(), rejections.end(),
+                [](const Rejection &a, const Rejection &b) {return a.bytes > b.bytes;});
+
+    stringstream ss;
+    ss << "Fusion report: " << boost::num_vertices(dag) << " blocks, " << rejections.size()
+       << " edges not merged, " << (double) total_bytes << " bytes not contracted\n";
+    for (const auto &reason: reasons) {
+        ss << "  " << left << setw(32) << reason.first << right << setw(6) << reason.second.first << " edges "
+           << (double) reason.second.second << " bytes\n";
+    }
+    for (const Rejection &r: rejections) {
+        ss << "  Kernel " << r.src << " -> Kernel " << r.dst << ": " << (double) r.bytes << " bytes, "
+           << r.reason << "\n";
+    }
+    return ss.str();
+}
+
+FuseModel fuse_model_from_string(const string &name) {
+    if (name == "bytes") {
+        return FuseModel::BYTES;
+    } else if (name == "unique_views") {
+        return FuseModel::UNIQUE_VIEWS;
+    } else if (name == "temp_elimination") {
+        return FuseModel::TEMP_ELIMINATION;
+    } else if (name == "max_share") {
+        return FuseModel::MAX_SHARE;
+    }
+    cout << "Unknown fuse model: \"" << name << "\"" << endl;
+    throw runtime_error("Unknown fuse model!");
+}
+
+void greedy(DAG &dag, bool avoid_rank0_sweep, const CostModel *cost_model, FuseModel model) {
+    /* Instead of searching all edges after each merge, we keep the fusible edges in a priority queue ordered by
+     * weight and validate an edge lazily when it reaches the top. A merge only changes the blocks of the two
+     * merged vertices thus only their edges get new candidates. The other edges keep their weight and
+     * mergeability but might have become transitive, which we check on the top edge only.
+     * NB: ties are broken by the vertex IDs, which is the order the original full edge search used.
+     */
+
+    // Most transitive edges exist from the start and are cheaper to remove in one go
+    transitive_reduction(dag);
+
+    struct Candidate {
+        uint64_t weight;
+        Vertex v1, v2;
+        // The versions of 'v1' and 'v2' when the candidate was made, which detects stale candidates
+        uint64_t version1, version2;
+    };
+    auto lower_priority = [](const Candidate &a, const Candidate &b) -> bool {
+        if (a.weight != b.weight) {
+            return a.weight < b.weight;
+        } else if (a.v1 != b.v1) {
+            return a.v1 > b.v1;
+        }
+        return a.v2 > b.v2;
+    };
+    priority_queue<Candidate, vector<Candidate>, decltype(lower_priority)> candidates(lower_priority);
+    // NB: merged vertices are cleared but not removed until the end thus the vertex IDs are stable
+    vector<uint64_t> versions(boost::num_vertices(dag), 0);
+    vector<bool> cleared(boost::num_vertices(dag), false);
+
+    auto push_candidate = [&](Vertex v1, Vertex v2) {
+        if (mergeable(dag[v1], dag[v2], avoid_rank0_sweep)) {
+            candidates.push(Candidate{weight(dag[v1], dag[v2], model), v1, v2, versions[v1], versions[v2]});
+        }
+    };
+    BOOST_FOREACH(Edge e, boost::edges(dag)) {
+        push_candidate(source(e, dag), target(e, dag));
+    }
+
+    while (not candidates.empty()) {
+        const Candidate c = candidates.top();
+        candidates.pop();
+        if (versions[c.v1] != c.version1 or versions[c.v2] != c.version2 or not boost::edge(c.v1, c.v2, dag).second) {
+            continue; // The candidate is stale
+        }
+        // Remove transitive edges
+        if (path_exist(c.v1, c.v2, dag, true)) {
+            boost::remove_edge(c.v1, c.v2, dag);
+            continue;
+        }
+        if (cost_model != NULL) {
+            // NB: the cost of the two blocks doesn't change thus a rejected candidate stays rejected
+            const Block merged_block = reshape_and_merge(dag[c.v1].getLoop(), dag[c.v2].getLoop());
+            if (not cost_model->accept(dag[c.v1], dag[c.v2], merged_block)) {
+                continue;
             }
         }
-        // Any more vertices to fuse?
-        if (fusibles.size() == 0) {
-            break;
+//      cout << "merge: " << c.v1 << ", " << c.v2 << endl;
+        merge_vertices(dag, c.v1, c.v2, false);
+        ++versions[c.v1];
+        ++versions[c.v2];
+        cleared[c.v2] = true;
+
+        // The merged vertex has new edges and a new block
+        BOOST_FOREACH(Vertex child, boost::adjacent_vertices(c.v1, dag)) {
+            push_candidate(c.v1, child);
         }
+        BOOST_FOREACH(Vertex parent, boost::inv_adjacent_vertices(c.v1, dag)) {
+            push_candidate(parent, c.v1);
+        }
+    }
 
-        // Let's find the greatest weight edge.
-        Edge greatest = fusibles.front();
-        uint64_t greatest_weight = weight(dag[source(greatest, dag)], dag[target(greatest, dag)]);
-        for (Edge e: fusibles) {
-            const uint64_t w = weight(dag[source(e, dag)], dag[target(e, dag)]);
-            if (w > greatest_weight) {
-                greatest = e;
-                greatest_weight = w;
+    /* Independent blocks have no edge thus the merges above never combine reductions that only share their input,
+     * such as sum(x) and sum(x*x). We merge such siblings when they sweep the same axes, which reads the input once
+     * and computes the reductions in one loop with an accumulator each. Since neither vertex reaches the other,
+     * the merge cannot make a cycle. */
+    for (bool merged = true; merged;) {
+        merged = false;
+        // The sweeping vertices by the bases they read
+        map<const bh_base *, vector<Vertex> > readers;
+        BOOST_FOREACH(Vertex v, boost::vertices(dag)) {
+            if (not cleared[v] and not dag[v].isInstr() and not sweep_axes(dag[v]).empty()) {
+                for (const bh_base *base: input_bases(dag[v])) {
+                    readers[base].push_back(v);
+                }
+            }
+        }
+        for (auto it = readers.begin(); it != readers.end() and not merged; ++it) {
+            const vector<Vertex> &vs = it->second;
+            for (size_t i = 0; i < vs.size() and not merged; ++i) {
+                for (size_t j = i + 1; j < vs.size() and not merged; ++j) {
+                    const Vertex v1 = vs[i], v2 = vs[j];
+                    if (sweep_axes(dag[v1]) != sweep_axes(dag[v2]) or
+                        not mergeable(dag[v1], dag[v2], avoid_rank0_sweep) or
+                        path_exist(v1, v2, dag, false) or path_exist(v2, v1, dag, false)) {
+                        continue;
+                    }
+                    if (cost_model != NULL) {
+                        const Block merged_block = reshape_and_merge(dag[v1].getLoop(), dag[v2].getLoop());
+                        if (not cost_model->accept(dag[v1], dag[v2], merged_block)) {
+                            continue;
+                        }
+                    }
+                    merge_vertices(dag, v1, v2, false);
+                    cleared[v2] = true;
+                    merged = true;
+                }
             }
         }
-        Vertex v1 = source(greatest, dag);
-        Vertex v2 = target(greatest, dag);
-//        cout << "merge: " << v1 << ", " << v2 << endl;
+    }
 
-        assert(not path_exist(v1, v2, dag, true)); // Transitive edges should have been removed by now
+    // Finally, we remove the cleared vertices starting from the back thus the IDs of the rest stay valid
+    for (Vertex v = cleared.size(); v-- > 0;) {
+        if (cleared[v]) {
+            boost::remove_vertex(v, dag);
+        }
+    }
+    assert(validate(dag));
+}
 
-        merge_vertices(dag, v1, v2, true);
+void beam(DAG &dag, bool avoid_rank0_sweep, size_t width, chrono::steady_clock::time_point deadline,
+          FuseModel model) {
+    // The greedy partition is the one to beat
+    DAG best = dag;
+    greedy(best, avoid_rank0_sweep, NULL, model);
+    uint64_t best_cost = total_cost(best, model);
+
+    // A candidate is the cost of merging an edge, given by its vertices, in one of the frontier DAGs
+    struct Candidate {
+        uint64_t cost;
+        size_t state;
+        Vertex v1, v2;
+    };
+    vector<DAG> frontier(1, dag);
+    while (not frontier.empty()) {
+        const bool out_of_time = chrono::steady_clock::now() > deadline;
+        vector<Candidate> candidates;
+        for (size_t i = 0; i < frontier.size(); ++i) {
+            DAG &state = frontier[i];
+            const vector<Edge> fusibles = find_fusibles(state, avoid_rank0_sweep);
+            if (fusibles.empty() or out_of_time) {
+                // A complete partition (or the greedy completion of it when we are out of time)
+                if (not fusibles.empty()) {
+                    greedy(state, avoid_rank0_sweep, NULL, model);
+                }
+                const uint64_t cost = total_cost(state, model);
+                if (cost < best_cost) {
+                    best = state;
+                    best_cost = cost;
+                }
+                continue;
+            }
+            const uint64_t cost = total_cost(state, model);
+            for (Edge e: fusibles) {
+                const Vertex v1 = source(e, state);
+                const Vertex v2 = target(e, state);
+                const Block merged = reshape_and_merge(state[v1].getLoop(), state[v2].getLoop());
+                const uint64_t c = cost - block_cost(state[v1], model) - block_cost(state[v2], model) +
+                                   block_cost(merged, model);
+                candidates.push_back(Candidate{c, i, v1, v2});
+            }
+        }
+        // Let's continue with the 'width' cheapest merges
+        stable_sort(candidates.begin(), candidates.end(),
+                    [](const Candidate &a, const Candidate &b) {return a.cost < b.cost;});
+        vector<DAG> next;
+        for (size_t i = 0; i < candidates.size() and next.size() < width; ++i) {
+            next.push_back(frontier[candidates[i].state]);
+            merge_vertices(next.back(), candidates[i].v1, candidates[i].v2, true);
+        }
+        frontier = std::move(next);
     }
+    dag = std::move(best);
     assert(validate(dag));
 }
 
@@ -0,0 +1,96 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <sys/mman.h>
+
+#include <bh_mem_signal.h>
+#include <jitk/host_mirrors.hpp>
+
+using namespace std;
+
+namespace bohrium {
+namespace jitk {
+
+namespace {
+// Give the host back write access to the mirror and stop watching it
+void unprotect(void *addr, uint64_t bytes) {
+    bh_mem_signal_detach(addr);
+    // NB: the data might have been unmapped by the host thus we ignore errors
+    mprotect(addr, bytes, PROT_READ | PROT_WRITE);
+}
+} // Anon namespace
+
+HostMirrors::HostMirrors() {
+    bh_mem_signal_init();
+}
+
+HostMirrors::~HostMirrors() {
+    for (auto &base_and_mirror: _mirrors) {
+        if (not base_and_mirror.second->written) {
+            unprotect(base_and_mirror.second->addr, base_and_mirror.second->bytes);
+        }
+    }
+}
+
+void HostMirrors::on_write(void *idx, void *addr) {
+    Mirror *mirror = static_cast<Mirror *>(idx);
+    unprotect(mirror->addr, mirror->bytes);
+    mirror->written = 1;
+}
+
+void HostMirrors::protect(bh_base *base) {
+    release(base);
+    const uint64_t bytes = static_cast<uint64_t>(bh_base_size(base));
+    if (base->data == NULL or bytes == 0) {
+        return;
+    }
+    unique_ptr<Mirror> mirror(new Mirror{base->data, bytes, 0});
+    if (mprotect(mirror->addr, bytes, PROT_READ) != 0) {
+        return; // We cannot detect the host writes thus the device buffer must go as usual
+    }
+    bh_mem_signal_attach(mirror.get(), mirror->addr, bytes, on_write);
+    _mirrors[base] = std::move(mirror);
+}
+
+void HostMirrors::release(bh_base *base) {
+    auto it = _mirrors.find(base);
+    if (it != _mirrors.end()) {
+        if (not it->second->written) {
+            unprotect(it->second->addr, it->second->bytes);
+        }
+        _mirrors.erase(it);
+    }
+}
+
+vector<bh_base *> HostMirrors::takeWritten() {
+    vector<bh_base *> ret;
+    for (auto it = _mirrors.begin(); it != _mirrors.end();) {
+        if (it->second->written) {
+            ret.push_back(it->first);
+            it = _mirrors.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    return ret;
+}
+
+} // jitk
+} // bohrium
@@ -336,6 +336,10 @@ void write_operation(const bh_instruction &instr, const vector<string> &ops, str
                     << ops[0] << ", " << ops[1] << ", " << ops[2] << ");\n";
             } else if (opencl and bh_type_is_integer(t0)) {
                 out << "IPOW(" << ops[0] << ", " << ops[1] << ", " << ops[2] << ");\n";
+            } else if (not opencl and (t0 == bh_type::FLOAT32 or t0 == bh_type::FLOAT64)) {
+                // The integral exponents takes a fast path (see kernel_dependencies/power_openmp.h)
+                out << ops[0] << " = bh_pow_" << (t0 == bh_type::FLOAT32 ? "float32" : "float64") << "(" \
+                    << ops[1] << ", " << ops[2] << ");\n";
             } else {
                 out << ops[0] << " = pow(" << ops[1] << ", " << ops[2] << ");\n";
             }
@@ -519,6 +523,9 @@ void write_operation(const bh_instruction &instr, const vector<string> &ops, str
         case BH_COND_SCATTER:
             out << "if (" << ops[2] << ") {" << ops[0] << " = " << ops[1] << ";}\n";
             break;
+        case BH_ADD_SCATTER:
+            out << ops[0] << " += " << ops[1] << ";\n";
+            break;
         default:
             cerr << "Instruction \"" << instr << "\" not supported\n";
             throw runtime_error("Instruction not supported.");
@@ -548,31 +555,120 @@ void dtype_min(bh_type dtype, stringstream &out) {
     }
 }
 
+// Write the complex 'instr' using the inline arithmetic of kernel_dependencies/complex_openmp.h (see is_inline_complex())
+void write_inline_complex_operation(const bh_instruction &instr, const vector<string> &ops, stringstream &out) {
+    const char *suffix = instr.operand_type(1) == bh_type::COMPLEX64 ? "complex64" : "complex128";
+    switch (instr.opcode) {
+        case BH_MULTIPLY:
+        case BH_MULTIPLY_ACCUMULATE:
+            out << ops[0] << " = bh_cmul_" << suffix << "(" << ops[1] << ", " << ops[2] << ");\n";
+            break;
+        case BH_MULTIPLY_REDUCE:
+            out << ops[0] << " = bh_cmul_" << suffix << "(" << ops[0] << ", " << ops[1] << ");\n";
+            break;
+        case BH_DIVIDE:
+            out << ops[0] << " = bh_cdiv_" << suffix << "(" << ops[1] << ", " << ops[2] << ");\n";
+            break;
+        case BH_ABSOLUTE:
+            out << ops[0] << " = bh_cabs_" << suffix << "(" << ops[1] << ");\n";
+            break;
+        case BH_EXP:
+            out << ops[0] << " = bh_cexp_" << suffix << "(" << ops[1] << ");\n";
+            break;
+        default:
+            throw runtime_error("write_inline_complex_operation(): not an inline complex instruction");
+    }
+}
+
+// Write the integer division, modulo, or remainder 'instr' through the magic numbers of its constant divisor
+// (see is_magic_division())
+void write_magic_division_operation(const bh_instruction &instr, const vector<string> &ops, stringstream &out) {
+    const bool is_signed = bh_type_is_signed_integer(instr.operand[0].base->type);
+    out << ops[0] << " = ";
+    switch (instr.opcode) {
+        case BH_DIVIDE: // Python/NumPy rounds the signed integer division towards minus infinity
+            out << (is_signed ? "bh_sdiv64_floor" : "bh_udiv64");
+            break;
+        case BH_MOD:
+            out << (is_signed ? "bh_smod64_trunc" : "bh_umod64");
+            break;
+        case BH_REMAINDER:
+            out << (is_signed ? "bh_smod64_floor" : "bh_umod64");
+            break;
+        default:
+            throw runtime_error("write_magic_division_operation(): not a magic division instruction");
+    }
+    out << "(" << ops[1] << ", " << ops[2] << "_div);\n";
+}
+
+// Returns the operand written into 'ss' and clears 'ss' for the next operand, which reuses one stream
+// instead of constructing a stringstream (and its locale) per operand
+string take_operand(stringstream &ss) {
+    string ret = ss.str();
+    ss.str(string());
+    return ret;
+}
+
 } // Anon namespace
 
+bool is_magic_division(const SymbolTable &symbols, const bh_instruction &instr) {
+    if (not (instr.opcode == BH_DIVIDE or instr.opcode == BH_MOD or instr.opcode == BH_REMAINDER) or
+        instr.operand.size() != 3 or bh_is_constant(&instr.operand[1]) or not bh_is_constant(&instr.operand[2])) {
+        return false;
+    }
+    const bh_type type = instr.operand[0].base->type;
+    return bh_type_is_integer(type) and type != bh_type::BOOL and bh_type_is_integer(instr.constant.type) and
+           symbols.constID(instr) >= 0;
+}
+
+void write_magic_divisors(const SymbolTable &symbols, const vector<InstrPtr> &instr_list, stringstream &out) {
+    set<int64_t> written;
+    for (const InstrPtr &instr: instr_list) {
+        if (is_magic_division(symbols, *instr) and written.insert(symbols.constID(*instr)).second) {
+            const int64_t id = symbols.constID(*instr);
+            const bool is_signed = bh_type_is_signed_integer(instr->operand[0].base->type);
+            out << "    const " << (is_signed ? "bh_sdiv64_t" : "bh_udiv64_t") << " c" << id << "_div = "
+                << (is_signed ? "bh_sdiv64_magic" : "bh_udiv64_magic") << "(c" << id << ");\n";
+        }
+    }
+}
+
+bool is_inline_complex(const bh_instruction &instr) {
+    switch (instr.opcode) {
+        case BH_MULTIPLY:
+        case BH_MULTIPLY_ACCUMULATE:
+        case BH_MULTIPLY_REDUCE:
+        case BH_DIVIDE:
+        case BH_ABSOLUTE:
+        case BH_EXP:
+            return instr.operand.size() > 1 and bh_type_is_complex(instr.operand_type(1));
+        default:
+            return false;
+    }
+}
+
 void write_instr(const Scope &scope, const bh_instruction &instr, stringstream &out, bool opencl) {
     if (bh_opcode_is_system(instr.opcode))
         return;
+    stringstream ss; // The operands are written one by one into 'ss' (see take_operand())
     if (instr.opcode == BH_RANGE) {
         vector<string> ops;
         // Write output operand
         {
-            stringstream ss;
             scope.getName(instr.operand[0], ss);
             if (scope.isArray(instr.operand[0])) {
                 write_array_subscription(scope, instr.operand[0], ss);
             }
-            ops.push_back(ss.str());
+            ops.push_back(take_operand(ss));
         }
         // Let's find the flatten index of the output view
         {
-            stringstream ss;
             ss << "(";
             for(int64_t i=0; i < instr.operand[0].ndim; ++i) {
                 ss << "+i" << i << "*" << instr.operand[0].stride[i];
             }
             ss << ")";
-            ops.push_back(ss.str());
+            ops.push_back(take_operand(ss));
         }
         write_operation(instr, ops, out, opencl);
         return;
@@ -581,16 +677,14 @@ void write_instr(const Scope &scope, const bh_instruction &instr, stringstream &
         vector<string> ops;
         // Write output operand
         {
-            stringstream ss;
             scope.getName(instr.operand[0], ss);
             if (scope.isArray(instr.operand[0])) {
                 write_array_subscription(scope, instr.operand[0], ss);
             }
-            ops.push_back(ss.str());
+            ops.push_back(take_operand(ss));
         }
         // Write the random generation
         {
-            stringstream ss;
             ss << "random123(" << instr.constant.value.r123.start \
                << ", " << instr.constant.value.r123.key << ", ";
 
@@ -599,7 +693,7 @@ void write_instr(const Scope &scope, const bh_instruction &instr, stringstream &
                 ss << "+i" << i << "*" << instr.operand[0].stride[i];
             }
             ss << ")";
-            ops.push_back(ss.str());
+            ops.push_back(take_operand(ss));
         }
         write_operation(instr, ops, out, opencl);
         return;
@@ -608,46 +702,45 @@ void write_instr(const Scope &scope, const bh_instruction &instr, stringstream &
         vector<string> ops;
         // Write output operand
         {
-            stringstream ss;
             scope.getName(instr.operand[0], ss);
             if (scope.isArray(instr.operand[0])) {
                 write_array_subscription(scope, instr.operand[0], ss);
             }
-            ops.push_back(ss.str());
+            ops.push_back(take_operand(ss));
         }
         // Write the previous element access, NB: this works because of loop peeling
         {
-            stringstream ss;
             scope.getName(instr.operand[0], ss);
             write_array_subscription(scope, instr.operand[0], ss, true, BH_MAXDIM, make_pair(instr.sweep_axis(), -1));
-            ops.push_back(ss.str());
+            ops.push_back(take_operand(ss));
         }
         // Write the current element access
         {
-            stringstream ss;
             scope.getName(instr.operand[1], ss);
             if (scope.isArray(instr.operand[1])) {
                 write_array_subscription(scope, instr.operand[1], ss);
             }
-            ops.push_back(ss.str());
+            ops.push_back(take_operand(ss));
+        }
+        if (not opencl and scope.inline_complex and is_inline_complex(instr)) {
+            write_inline_complex_operation(instr, ops, out);
+        } else {
+            write_operation(instr, ops, out, opencl);
         }
-        write_operation(instr, ops, out, opencl);
         return;
     }
     if (instr.opcode == BH_GATHER) {
         // Format of GATHER: out[<loop-indexes>] = in1[in1.start + in2[<loop-indexes>]]
         vector<string> ops;
         {
-            stringstream ss;
             scope.getName(instr.operand[0], ss);
             if (scope.isArray(instr.operand[0])) {
                 write_array_subscription(scope, instr.operand[0], ss);
             }
-            ops.push_back(ss.str());
+            ops.push_back(take_operand(ss));
         }
         {
             assert(not bh_is_constant(&instr.operand[1]));
-            stringstream ss;
             scope.getName(instr.operand[1], ss);
             ss << "[" << instr.operand[1].start << " + ";
             scope.getName(instr.operand[2], ss);
@@ -655,16 +748,15 @@ void write_instr(const Scope &scope, const bh_instruction &instr, stringstream &
                 write_array_subscription(scope, instr.operand[2], ss);
             }
             ss << "]";
-            ops.push_back(ss.str());
+            ops.push_back(take_operand(ss));
         }
         write_operation(instr, ops, out, opencl);
         return;
     }
-    if (instr.opcode == BH_SCATTER or instr.opcode == BH_COND_SCATTER) {
+    if (instr.opcode == BH_SCATTER or instr.opcode == BH_COND_SCATTER or instr.opcode == BH_ADD_SCATTER) {
         // Format of SCATTER: out[out.start + in2[<loop-indexes>]] = in1[<loop-indexes>]
         vector<string> ops;
         {
-            stringstream ss;
             scope.getName(instr.operand[0], ss);
             ss << "[" << instr.operand[0].start << " + ";
             scope.getName(instr.operand[2], ss);
@@ -672,23 +764,36 @@ void write_instr(const Scope &scope, const bh_instruction &instr, stringstream &
                 write_array_subscription(scope, instr.operand[2], ss);
             }
             ss << "]";
-            ops.push_back(ss.str());
+            ops.push_back(take_operand(ss));
         }
-        {
-            stringstream ss;
+        if (bh_is_constant(&instr.operand[1])) { // The input of an add-scatter can be a constant
+            const int64_t constID = scope.symbols.constID(instr);
+            if (constID >= 0) {
+                ss << "c" << constID;
+            } else {
+                instr.constant.pprint(ss, opencl);
+            }
+            ops.push_back(take_operand(ss));
+        } else {
             scope.getName(instr.operand[1], ss);
             if (scope.isArray(instr.operand[1])) {
                 write_array_subscription(scope, instr.operand[1], ss);
             }
-            ops.push_back(ss.str());
+            ops.push_back(take_operand(ss));
         }
         if (instr.opcode == BH_COND_SCATTER) { // Add the conditional array (fourth operand)
-            stringstream ss;
             scope.getName(instr.operand[3], ss);
             if (scope.isArray(instr.operand[3])) {
                 write_array_subscription(scope, instr.operand[3], ss);
             }
-            ops.push_back(ss.str());
+            ops.push_back(take_operand(ss));
+        }
+        // With unique indexes, no two elements write the same element thus the conditional scatter can
+        // write the old value back instead of branching, which lets the compiler vectorize it as a blend
+        if (instr.opcode == BH_COND_SCATTER and scope.predicated_scatter and
+            scope.symbols.isUniqueIndexes(instr.operand[2])) {
+            out << ops[0] << " = " << ops[2] << " ? " << ops[1] << " : " << ops[0] << ";\n";
+            return;
         }
         write_operation(instr, ops, out, opencl);
         return;
@@ -698,7 +803,6 @@ void write_instr(const Scope &scope, const bh_instruction &instr, stringstream &
     vector<string> ops;
     for (size_t o = 0; o < instr.operand.size(); ++o) {
         const bh_view &view = instr.operand[o];
-        stringstream ss;
         if (bh_is_constant(&view)) {
             const int64_t constID = scope.symbols.constID(instr);
             if (constID >= 0) {
@@ -718,7 +822,48 @@ void write_instr(const Scope &scope, const bh_instruction &instr, stringstream &
                 }
             }
         }
-        ops.push_back(ss.str());
+        ops.push_back(take_operand(ss));
+    }
+    if (not opencl and scope.inline_complex and is_inline_complex(instr)) {
+        write_inline_complex_operation(instr, ops, out);
+    } else if (not opencl and scope.magic_division and is_magic_division(scope.symbols, instr)) {
+        write_magic_division_operation(instr, ops, out);
+    } else {
+        write_operation(instr, ops, out, opencl);
+    }
+}
+
+void write_instr_simd(const Scope &scope, const bh_instruction &instr, const char *vec_type, const char *elem_type,
+                      stringstream &out, const char *out_name, bool opencl) {
+    vector<string> ops;
+    stringstream ss;
+    for (const bh_view &view: instr.operand) {
+        if (ops.empty() and out_name != NULL) {
+            ss << out_name;
+        } else if (bh_is_constant(&view)) {
+            if (opencl) {
+                ss << "((" << vec_type << ")(" << elem_type << ")(";
+            } else {
+                ss << "((" << vec_type << "){0} + (" << elem_type << ")(";
+            }
+            const int64_t constID = scope.symbols.constID(instr);
+            if (constID >= 0) {
+                ss << "c" << constID;
+            } else {
+                instr.constant.pprint(ss, false);
+            }
+            ss << "))";
+        } else if (scope.isTmp(view.base)) {
+            scope.getName(view, ss);
+        } else if (opencl) {
+            ss << "bh_vload(0, &a" << scope.symbols.baseID(view.base);
+            write_array_subscription(scope, view, ss, true);
+            ss << ")";
+        } else {
+            ss << "*(" << vec_type << " *)&a" << scope.symbols.baseID(view.base);
+            write_array_subscription(scope, view, ss, true);
+        }
+        ops.push_back(take_operand(ss));
     }
     write_operation(instr, ops, out, opencl);
 }
@@ -781,6 +926,43 @@ vector<bh_instruction*> remove_non_computed_system_instr(vector<bh_instruction>
     return ret;
 }
 
+namespace {
+// Appends the 'size' instructions of 'instr_list' starting at 'first' to 'out' where BH_REPEATs are unrolled
+void unroll_repeats(const vector<bh_instruction> &instr_list, size_t first, size_t size, vector<bh_instruction> &out) {
+    for (size_t i = first; i < first + size and i < instr_list.size(); ++i) {
+        const bh_instruction &instr = instr_list[i];
+        if (instr.opcode == BH_REPEAT) {
+            const size_t body = static_cast<size_t>(instr.constant.value.r123.start);
+            for (uint64_t j = 0; j < instr.constant.value.r123.key; ++j) {
+                unroll_repeats(instr_list, i + 1, body, out);
+            }
+            i += body;
+        } else {
+            out.push_back(instr);
+        }
+    }
+}
+}
+
+vector<pair<vector<bh_instruction>, int64_t> > split_repeats(const vector<bh_instruction> &instr_list) {
+    vector<pair<vector<bh_instruction>, int64_t> > ret;
+    for (size_t i = 0; i < instr_list.size(); ++i) {
+        const bh_instruction &instr = instr_list[i];
+        if (instr.opcode == BH_REPEAT) {
+            const size_t body = static_cast<size_t>(instr.constant.value.r123.start);
+            ret.emplace_back(vector<bh_instruction>(), static_cast<int64_t>(instr.constant.value.r123.key));
+            unroll_repeats(instr_list, i + 1, body, ret.back().first);
+            i += body;
+        } else {
+            if (ret.empty() or ret.back().second != 1) {
+                ret.emplace_back(vector<bh_instruction>(), 1);
+            }
+            ret.back().first.push_back(instr);
+        }
+    }
+    return ret;
+}
+
 InstrPtr reshape_rank(const InstrPtr &instr, int rank, int64_t size_of_rank_dim) {
     vector<int64_t> shape((size_t) rank + 1);
     // The dimensions up til 'rank' (not including 'rank') are unchanged
@@ -800,7 +982,7 @@ InstrPtr reshape_rank(const InstrPtr &instr, int rank, int64_t size_of_rank_dim)
     }
     bh_instruction ret = bh_instruction(*instr);
     ret.reshape(shape);
-    return std::make_shared<bh_instruction>(ret);
+    return make_instr(ret);
 }
 
 } // jitk
@@ -31,6 +31,8 @@ namespace jitk {
 Kernel::Kernel(const LoopB &block) : block(block) {
 
     _useRandom = false;
+    _useFloat16 = false;
+    _useBFloat16 = false;
     const set<bh_base *> temps = getAllTemps();
     for (const InstrPtr instr: getAllInstr()) {
         if (instr->opcode == BH_RANDOM) {
@@ -42,6 +44,10 @@ Kernel::Kernel(const LoopB &block) : block(block) {
         }
         // Find non-temporary arrays
         for(const bh_view &v: instr->operand) {
+            if (not bh_is_constant(&v)) {
+                _useFloat16 |= v.base->type == bh_type::FLOAT16;
+                _useBFloat16 |= v.base->type == bh_type::BFLOAT16;
+            }
             if (not bh_is_constant(&v) and temps.find(v.base) == temps.end()) {
                 if (std::find(_non_temps.begin(), _non_temps.end(), v.base) == _non_temps.end()) {
                     _non_temps.push_back(v.base);
@@ -51,6 +57,53 @@ Kernel::Kernel(const LoopB &block) : block(block) {
     }
 }
 
+namespace {
+void get_loop_sizes(const LoopB &block, vector<int64_t> &out) {
+    if (std::find(out.begin(), out.end(), block.size) == out.end()) {
+        out.push_back(block.size);
+    }
+    for (const Block &b: block._block_list) {
+        if (not b.isInstr()) {
+            get_loop_sizes(b.getLoop(), out);
+        }
+    }
+}
+}
+
+vector<int64_t> Kernel::getLoopSizes() const {
+    vector<int64_t> ret;
+    get_loop_sizes(block, ret);
+    return ret;
+}
+
+KernelTraffic Kernel::getTraffic() const {
+    KernelTraffic ret;
+    set<bh_view> reads, writes;
+    for (const InstrPtr instr: getAllInstr()) {
+        if (bh_opcode_is_system(instr->opcode)) {
+            continue;
+        }
+        const vector<int64_t> shape = instr->shape();
+        const uint64_t nelem = bh_nelements(shape.size(), shape.data());
+        ret.elements = std::max(ret.elements, nelem);
+        if (instr->opcode != BH_IDENTITY and instr->opcode != BH_RANDOM and instr->opcode != BH_RANGE) {
+            ret.flops += nelem;
+        }
+        for (size_t i = 0; i < instr->operand.size(); ++i) {
+            const bh_view &v = instr->operand[i];
+            if (not bh_is_constant(&v) and util::exist_linearly(_non_temps, v.base)) {
+                (i == 0 ? writes : reads).insert(v);
+            }
+        }
+    }
+    for (const bh_view &v: reads) {
+        ret.bytes_read += bh_nelements(v) * bh_type_size(v.base->type);
+    }
+    for (const bh_view &v: writes) {
+        ret.bytes_written += bh_nelements(v) * bh_type_size(v.base->type);
+    }
+    return ret;
+}
 
 Kernel create_kernel_object(const Block &block, const bool verbose, Statistics &stat) {
     const Kernel kernel(block.getLoop());
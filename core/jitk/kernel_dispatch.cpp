@@ -0,0 +1,80 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <functional>
+
+#include <jitk/kernel_dispatch.hpp>
+
+using namespace std;
+
+namespace bohrium {
+namespace jitk {
+
+namespace {
+
+// The weight of a new measurement in the moving averages of the throughputs
+constexpr double SMOOTHING = 0.25;
+
+// Returns the moving average of 'rate' and the throughput of 'bytes' in 'seconds' after 'latency'
+double update_rate(double rate, double bytes, double seconds, double latency) {
+    const double busy = seconds - latency;
+    if (bytes <= 0 or busy <= 0) {
+        return rate;
+    }
+    return (1 - SMOOTHING) * rate + SMOOTHING * (bytes / busy);
+}
+
+} // Anon namespace
+
+KernelDispatch::KernelDispatch(const ConfigParser &config) :
+        device_latency(config.defaultGet<double>("dispatch_device_latency_us", 20) * 1e-6),
+        host_latency(config.defaultGet<double>("dispatch_host_latency_us", 2) * 1e-6),
+        transfer_rate(std::max(1e-3, config.defaultGet<double>("dispatch_transfer_gbps", 8)) * 1e9),
+        sample_interval(std::max<uint64_t>(1, config.defaultGet<uint64_t>("dispatch_sample_interval", 16))),
+        _device_rate(std::max(1e-3, config.defaultGet<double>("dispatch_device_gbps", 100)) * 1e9),
+        _host_rate(std::max(1e-3, config.defaultGet<double>("dispatch_host_gbps", 10)) * 1e9) {}
+
+bool KernelDispatch::sample(const string &source) {
+    if (_seen.insert(std::hash<string>()(source)).second) {
+        return false;
+    }
+    if (++_since_sample < sample_interval) {
+        return false;
+    }
+    _since_sample = 0;
+    return true;
+}
+
+void KernelDispatch::recordDevice(double bytes, double seconds) {
+    _device_rate = update_rate(_device_rate, bytes, seconds, device_latency);
+}
+
+void KernelDispatch::recordHost(double bytes, double seconds) {
+    _host_rate = update_rate(_host_rate, bytes, seconds, host_latency);
+}
+
+double KernelDispatch::traffic(const Kernel &kernel) {
+    const KernelTraffic t = kernel.getTraffic();
+    return static_cast<double>(t.bytes_read + t.bytes_written);
+}
+
+} // jitk
+} // bohrium
@@ -0,0 +1,183 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <stdexcept>
+
+#include <bh_memory.h>
+#include <jitk/kernel.hpp>
+#include <jitk/memory_plan.hpp>
+
+using namespace std;
+
+namespace bohrium {
+namespace jitk {
+
+MemoryPlan::MemoryPlan(const vector<Block> &block_list) {
+    // The first and the last kernel that access each array that the flush allocates, and the freed arrays
+    // NB: an array is dead after its last access thus its buffer is free for the next kernels even though the
+    //     BH_FREE of the array usually comes with a later kernel
+    map<bh_base *, size_t> first, last;
+    set<bh_base *> excluded, freed;
+    for (size_t i = 0; i < block_list.size(); ++i) {
+        const Kernel kernel(block_list[i].getLoop());
+        for (bh_base *base: kernel.getNonTemps()) {
+            if (base->data != nullptr) {
+                excluded.insert(base);
+            } else {
+                first.insert(make_pair(base, i));
+                last[base] = i;
+            }
+        }
+        // A synced array outlives the flush
+        excluded.insert(kernel.getSyncs().begin(), kernel.getSyncs().end());
+        freed.insert(kernel.getFrees().begin(), kernel.getFrees().end());
+    }
+    struct Lifetime {
+        bh_base *base;
+        size_t first, last;
+        uint64_t bytes;
+    };
+    vector<Lifetime> lifetimes;
+    for (const auto &f: first) {
+        const int64_t bytes = bh_base_size(f.first);
+        if (freed.find(f.first) != freed.end() and excluded.find(f.first) == excluded.end() and bytes > 0) {
+            lifetimes.push_back(Lifetime{f.first, f.second, last.at(f.first), static_cast<uint64_t>(bytes)});
+        }
+    }
+    sort(lifetimes.begin(), lifetimes.end(), [](const Lifetime &a, const Lifetime &b) {
+        return a.first != b.first ? a.first < b.first : a.bytes > b.bytes;
+    });
+
+    // Each array takes the smallest free buffer that fits, or grows the largest free buffer, where a buffer is free
+    // after the last access of its last array
+    struct Color {
+        uint64_t bytes;
+        size_t free_after;
+        vector<size_t> lifetimes;
+    };
+    vector<Color> colors;
+    for (size_t i = 0; i < lifetimes.size(); ++i) {
+        const Lifetime &lifetime = lifetimes[i];
+        size_t best = colors.size();
+        for (size_t c = 0; c < colors.size(); ++c) {
+            if (colors[c].free_after >= lifetime.first) {
+                continue;
+            }
+            if (best == colors.size()) {
+                best = c;
+                continue;
+            }
+            const bool fits = colors[c].bytes >= lifetime.bytes;
+            const bool best_fits = colors[best].bytes >= lifetime.bytes;
+            if (fits != best_fits ? fits : (fits ? colors[c].bytes < colors[best].bytes
+                                                 : colors[c].bytes > colors[best].bytes)) {
+                best = c;
+            }
+        }
+        if (best == colors.size()) {
+            colors.push_back(Color{0, 0, {}});
+        }
+        Color &color = colors[best];
+        color.bytes = std::max(color.bytes, lifetime.bytes);
+        color.free_after = lifetime.last;
+        color.lifetimes.push_back(i);
+    }
+
+    for (const Color &color: colors) {
+        if (color.lifetimes.size() < 2) {
+            continue;
+        }
+        Buffer buffer;
+        buffer.bytes = color.bytes;
+        buffer.arrays = color.lifetimes.size();
+        _buffers.push_back(buffer);
+        for (size_t i: color.lifetimes) {
+            const Lifetime &lifetime = lifetimes[i];
+            _assignment[lifetime.base] = _buffers.size() - 1;
+            _first_use[lifetime.first].push_back(lifetime.base);
+            _array_bytes += lifetime.bytes;
+        }
+    }
+}
+
+namespace {
+void free_buffer(void *&data, uint64_t bytes) {
+    if (data != nullptr) {
+        bh_memory_track_free(BH_MEMORY_HOST, data);
+        bh_memory_free(data, static_cast<int64_t>(bytes));
+        data = nullptr;
+    }
+}
+} // Anon namespace
+
+MemoryPlan::~MemoryPlan() {
+    for (Buffer &buffer: _buffers) {
+        free_buffer(buffer.data, buffer.bytes);
+    }
+}
+
+void MemoryPlan::assign(size_t block_idx) {
+    auto it = _first_use.find(block_idx);
+    if (it == _first_use.end()) {
+        return;
+    }
+    for (bh_base *base: it->second) {
+        Buffer &buffer = _buffers[_assignment.at(base)];
+        if (buffer.data == nullptr) {
+            buffer.data = bh_memory_malloc(static_cast<int64_t>(buffer.bytes));
+            if (buffer.data == nullptr) {
+                throw runtime_error("MemoryPlan: could not allocate a buffer");
+            }
+            bh_memory_track_alloc(BH_MEMORY_HOST, buffer.data, buffer.bytes);
+        }
+        if (base->data == nullptr) {
+            base->data = buffer.data;
+        }
+    }
+}
+
+void MemoryPlan::release(const set<bh_base *> &frees) {
+    for (bh_base *base: frees) {
+        auto it = _assignment.find(base);
+        if (it == _assignment.end()) {
+            continue;
+        }
+        Buffer &buffer = _buffers[it->second];
+        if (base->data == buffer.data) {
+            base->data = nullptr;
+        }
+        if (++buffer.freed == buffer.arrays) {
+            buffer.freed = 0;
+            free_buffer(buffer.data, buffer.bytes);
+        }
+    }
+}
+
+uint64_t MemoryPlan::bufferBytes() const {
+    uint64_t ret = 0;
+    for (const Buffer &buffer: _buffers) {
+        ret += buffer.bytes;
+    }
+    return ret;
+}
+
+} // jitk
+} // bohrium
@@ -0,0 +1,85 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+
+#include <jitk/replay_cache.hpp>
+#include <jitk/fuser_cache.hpp>
+
+
+using namespace std;
+
+namespace bohrium {
+namespace jitk {
+
+namespace {
+vector<bool> constructor_flags(const vector<bh_instruction *> &instr_list) {
+    vector<bool> ret;
+    ret.reserve(instr_list.size());
+    for (const bh_instruction *instr: instr_list) {
+        ret.push_back(instr->constructor);
+    }
+    return ret;
+}
+}
+
+bool ReplayCache::get(int64_t id, const vector<bh_instruction *> &instr_list, vector<Block> &block_list,
+                      vector<string> &sources) {
+    if (not enabled or id < 0) {
+        return false;
+    }
+    ++stat.replay_cache_lookups;
+    auto hit = _cache.find(id);
+    if (hit == _cache.end() or hit->second.constructors != constructor_flags(instr_list)) {
+        ++stat.replay_cache_misses;
+        return false;
+    }
+    // Like get_block_list(), the origin ids are the positions in 'instr_list'
+    int64_t count = 0;
+    for (bh_instruction *instr: instr_list) {
+        instr->origin_id = count++;
+    }
+    hit->second.last_use = ++_clock;
+    block_list = hit->second.block_list;
+    FuseCache::rebind(block_list, instr_list);
+    sources = hit->second.sources;
+    return true;
+}
+
+void ReplayCache::insert(int64_t id, const vector<bh_instruction *> &instr_list, const vector<Block> &block_list,
+                         const vector<string> &sources) {
+    if (not enabled or id < 0) {
+        return;
+    }
+    Entry &entry = _cache[id];
+    entry.block_list = block_list;
+    entry.sources = sources;
+    entry.constructors = constructor_flags(instr_list);
+    entry.last_use = ++_clock;
+    if (max_entries > 0 and _cache.size() > max_entries) {
+        _cache.erase(min_element(_cache.begin(), _cache.end(),
+                                 [](const pair<const int64_t, Entry> &a, const pair<const int64_t, Entry> &b) {
+                                     return a.second.last_use < b.second.last_use;
+                                 }));
+    }
+}
+
+} // jitk
+} // bohrium
@@ -0,0 +1,108 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+
+#include <jitk/staged_io.hpp>
+
+using namespace std;
+
+namespace bohrium {
+namespace jitk {
+
+void write_file(int fd, const void *data, uint64_t nbytes, uint64_t offset) {
+    const char *src = static_cast<const char *>(data);
+    while (nbytes > 0) {
+        const ssize_t n = pwrite(fd, src, nbytes, offset);
+        if (n < 0 and errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            throw runtime_error(string("StagedIO: writing the file failed: ") + strerror(errno));
+        }
+        src += n;
+        offset += n;
+        nbytes -= n;
+    }
+}
+
+void read_file(int fd, void *data, uint64_t nbytes, uint64_t offset) {
+    char *dst = static_cast<char *>(data);
+    while (nbytes > 0) {
+        const ssize_t n = pread(fd, dst, nbytes, offset);
+        if (n < 0 and errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            throw runtime_error(string("StagedIO: reading the file failed: ") + strerror(errno));
+        }
+        if (n == 0) {
+            throw runtime_error("StagedIO: the file ended before the data");
+        }
+        dst += n;
+        offset += n;
+        nbytes -= n;
+    }
+}
+
+void StagedIO::store(int fd, uint64_t file_offset, uint64_t nbytes, const Copy &copy, const Wait &wait) const {
+    const uint64_t nchunks = (nbytes + _chunk_bytes - 1) / _chunk_bytes;
+    if (nchunks == 0) {
+        return;
+    }
+    copy(0, 0, std::min(_chunk_bytes, nbytes));
+    for (uint64_t i = 0; i < nchunks; ++i) {
+        const int slot = i % 2;
+        const uint64_t offset = i * _chunk_bytes;
+        wait(slot);
+        // The download of the next chunk overlaps the write of this one
+        if (i + 1 < nchunks) {
+            const uint64_t next = offset + _chunk_bytes;
+            copy(1 - slot, next, std::min(_chunk_bytes, nbytes - next));
+        }
+        write_file(fd, _staging[slot], std::min(_chunk_bytes, nbytes - offset), file_offset + offset);
+    }
+}
+
+void StagedIO::load(int fd, uint64_t file_offset, uint64_t nbytes, const Copy &copy, const Wait &wait) const {
+    const uint64_t nchunks = (nbytes + _chunk_bytes - 1) / _chunk_bytes;
+    for (uint64_t i = 0; i < nchunks; ++i) {
+        const int slot = i % 2;
+        const uint64_t offset = i * _chunk_bytes;
+        // The staging buffer is free when the upload of the chunk before last is done
+        if (i >= 2) {
+            wait(slot);
+        }
+        const uint64_t size = std::min(_chunk_bytes, nbytes - offset);
+        read_file(fd, _staging[slot], size, file_offset + offset);
+        copy(slot, offset, size);
+    }
+    for (uint64_t i = nchunks > 2 ? nchunks - 2 : 0; i < nchunks; ++i) {
+        wait(i % 2);
+    }
+}
+
+} // jitk
+} // bohrium
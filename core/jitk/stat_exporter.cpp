@@ -0,0 +1,251 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include <netdb.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <jitk/stat_exporter.hpp>
+
+using namespace std;
+
+namespace bohrium {
+namespace jitk {
+
+namespace {
+// A metric of the export, where the counters only increase and the gauges are levels
+struct Metric {
+    const char *name;
+    bool counter;
+    double value;
+};
+
+vector<Metric> metrics(const Statistics &stat) {
+    return {
+        {"base_arrays",                true,  static_cast<double>(stat.num_base_arrays)},
+        {"temp_arrays",                true,  static_cast<double>(stat.num_temp_arrays)},
+        {"syncs",                      true,  static_cast<double>(stat.num_syncs)},
+        {"work",                       true,  static_cast<double>(stat.totalwork)},
+        {"kernel_cache_lookups",       true,  static_cast<double>(stat.kernel_cache_lookups)},
+        {"kernel_cache_misses",        true,  static_cast<double>(stat.kernel_cache_misses)},
+        {"codegen_cache_lookups",      true,  static_cast<double>(stat.codegen_cache_lookups)},
+        {"codegen_cache_misses",       true,  static_cast<double>(stat.codegen_cache_misses)},
+        {"fuse_cache_lookups",         true,  static_cast<double>(stat.fuser_cache_lookups)},
+        {"fuse_cache_misses",          true,  static_cast<double>(stat.fuser_cache_misses)},
+        {"fuse_cache_partial_hits",    true,  static_cast<double>(stat.fuser_cache_partial_hits)},
+        {"fuse_cache_evictions",       true,  static_cast<double>(stat.fuser_cache_evictions)},
+        {"replay_cache_lookups",       true,  static_cast<double>(stat.replay_cache_lookups)},
+        {"replay_cache_misses",        true,  static_cast<double>(stat.replay_cache_misses)},
+        {"memory_pool_lookups",        true,  static_cast<double>(stat.memory_pool_lookups)},
+        {"memory_pool_hits",           true,  static_cast<double>(stat.memory_pool_hits)},
+        {"device_pool_lookups",        true,  static_cast<double>(stat.device_pool_lookups)},
+        {"device_pool_hits",           true,  static_cast<double>(stat.device_pool_hits)},
+        {"interpreted_kernels",        true,  static_cast<double>(stat.num_interpreted_kernels)},
+        {"speculative_compiles",       true,  static_cast<double>(stat.num_speculative_compiles)},
+        {"batched_kernels",            true,  static_cast<double>(stat.num_batched_kernels)},
+        {"time_blocked_kernels",       true,  static_cast<double>(stat.num_time_blocked_kernels)},
+        {"instrs_into_fuser",          true,  static_cast<double>(stat.num_instrs_into_fuser)},
+        {"blocks_out_of_fuser",        true,  static_cast<double>(stat.num_blocks_out_of_fuser)},
+        {"time_total_execution_seconds", true, stat.time_total_execution.count()},
+        {"time_pre_fusion_seconds",    true,  stat.time_pre_fusion.count()},
+        {"time_fusion_seconds",        true,  stat.time_fusion.count()},
+        {"time_codegen_seconds",       true,  stat.time_codegen.count()},
+        {"time_compile_seconds",       true,  stat.time_compile.count()},
+        {"time_exec_seconds",          true,  stat.time_exec.count()},
+        {"time_offload_seconds",       true,  stat.time_offload.count()},
+        {"time_copy2dev_seconds",      true,  stat.time_copy2dev.count()},
+        {"time_copy2host_seconds",     true,  stat.time_copy2host.count()},
+        {"fuse_cache_entries",         false, static_cast<double>(stat.fuser_cache_entries)},
+        {"fuse_cache_bytes",           false, static_cast<double>(stat.fuser_cache_bytes)},
+        {"max_memory_bytes",           false, static_cast<double>(stat.max_memory_usage)},
+        {"max_hugepage_bytes",         false, static_cast<double>(stat.max_hugepage_bytes)},
+    };
+}
+} // Unnamed namespace
+
+bool StatExporter::enabled(const ConfigParser &config) {
+    return not config.defaultGet<string>("stat_export", "").empty();
+}
+
+unique_ptr<StatExporter> StatExporter::create(const ConfigParser &config, const string &engine_name) {
+    const string format = config.defaultGet<string>("stat_export", "");
+    if (format.empty()) {
+        return nullptr;
+    }
+    if (format != "prometheus" and format != "statsd") {
+        cerr << "[" << engine_name << "] Warning: unknown stat_export '" << format << "', the export is disabled\n";
+        return nullptr;
+    }
+    const string target = config.defaultGet<string>("stat_export_target", "");
+    if (target.empty()) {
+        cerr << "[" << engine_name << "] Warning: stat_export needs stat_export_target, the export is disabled\n";
+        return nullptr;
+    }
+    return unique_ptr<StatExporter>(new StatExporter(
+            format == "prometheus" ? Format::PROMETHEUS : Format::STATSD, target, engine_name,
+            chrono::duration<double>(config.defaultGet<double>("stat_export_interval", 10)),
+            config.defaultGet<size_t>("stat_export_kernels", 10)));
+}
+
+StatExporter::StatExporter(Format format, const string &target, const string &engine_name,
+                           chrono::duration<double> interval, size_t num_kernels) :
+        _format(format), _target(target), _engine_name(engine_name), _interval(interval),
+        _num_kernels(num_kernels), _next_update(chrono::steady_clock::now()) {
+    if (_format == Format::STATSD) {
+        const size_t colon = _target.rfind(':');
+        const string host = _target.substr(0, colon);
+        const string port = colon == string::npos ? "8125" : _target.substr(colon + 1);
+        addrinfo hints, *addr;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_DGRAM;
+        if (getaddrinfo(host.c_str(), port.c_str(), &hints, &addr) == 0) {
+            _socket = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+            if (_socket >= 0 and connect(_socket, addr->ai_addr, addr->ai_addrlen) != 0) {
+                close(_socket);
+                _socket = -1;
+            }
+            freeaddrinfo(addr);
+        }
+        if (_socket < 0) {
+            cerr << "[" << _engine_name << "] Warning: cannot connect to the StatsD address '" << _target << "'\n";
+        }
+    }
+    _thread = thread(&StatExporter::run, this);
+}
+
+StatExporter::~StatExporter() {
+    {
+        lock_guard<mutex> lock(_mutex);
+        _stop = true;
+    }
+    _cond.notify_one();
+    _thread.join();
+    if (_socket >= 0) {
+        close(_socket);
+    }
+}
+
+string StatExporter::prometheus(const Statistics &stat) const {
+    stringstream ss;
+    ss.precision(15);
+    const string label = "{engine=\"" + _engine_name + "\"}";
+    for (const Metric &m: metrics(stat)) {
+        const string name = string("bohrium_") + m.name + (m.counter ? "_total" : "");
+        ss << "# TYPE " << name << (m.counter ? " counter\n" : " gauge\n") << name << label << " " << m.value << "\n";
+    }
+    const auto kernels = stat.top_kernels(_num_kernels);
+    if (not kernels.empty()) {
+        ss << "# TYPE bohrium_kernel_exec_seconds_total counter\n";
+        for (const auto &k: kernels) {
+            ss << "bohrium_kernel_exec_seconds_total{engine=\"" << _engine_name << "\",kernel=\"" << hex << k.first
+               << dec << "\"} " << k.second->time_exec.count() << "\n";
+        }
+        ss << "# TYPE bohrium_kernel_launches_total counter\n";
+        for (const auto &k: kernels) {
+            ss << "bohrium_kernel_launches_total{engine=\"" << _engine_name << "\",kernel=\"" << hex << k.first
+               << dec << "\"} " << k.second->launches << "\n";
+        }
+    }
+    return ss.str();
+}
+
+string StatExporter::statsd(const Statistics &stat) const {
+    stringstream ss;
+    ss.precision(15);
+    const string prefix = "bohrium." + _engine_name + ".";
+    for (const Metric &m: metrics(stat)) {
+        ss << prefix << m.name << ":" << m.value << "|g\n";
+    }
+    for (const auto &k: stat.top_kernels(_num_kernels)) {
+        ss << prefix << "kernel." << hex << k.first << dec << ".exec_seconds:" << k.second->time_exec.count()
+           << "|g\n";
+        ss << prefix << "kernel." << hex << k.first << dec << ".launches:" << k.second->launches << "|g\n";
+    }
+    return ss.str();
+}
+
+void StatExporter::render(const Statistics &stat) {
+    string rendering = _format == Format::PROMETHEUS ? prometheus(stat) : statsd(stat);
+    _next_update = chrono::steady_clock::now() + chrono::duration_cast<chrono::steady_clock::duration>(_interval);
+    {
+        lock_guard<mutex> lock(_mutex);
+        _rendering.swap(rendering);
+    }
+    _cond.notify_one();
+}
+
+void StatExporter::run() {
+    unique_lock<mutex> lock(_mutex);
+    while (true) {
+        // The latest rendering is emitted every interval and when stopping
+        _cond.wait_for(lock, _interval, [this]() { return _stop; });
+        if (not _rendering.empty()) {
+            const string rendering = _rendering;
+            lock.unlock();
+            emit(rendering);
+            lock.lock();
+        }
+        if (_stop) {
+            return;
+        }
+    }
+}
+
+void StatExporter::emit(const string &rendering) {
+    if (_format == Format::PROMETHEUS) {
+        // The file is replaced atomically such that a reader never sees a partial export
+        const string tmp = _target + ".tmp";
+        {
+            ofstream out(tmp);
+            out << rendering;
+        }
+        if (rename(tmp.c_str(), _target.c_str()) != 0) {
+            cerr << "[" << _engine_name << "] Warning: cannot write the statistics to '" << _target << "'\n";
+        }
+    } else if (_socket >= 0) {
+        // The lines are sent in datagrams that fit a typical MTU
+        size_t begin = 0;
+        while (begin < rendering.size()) {
+            size_t end = begin;
+            while (end < rendering.size()) {
+                const size_t next = rendering.find('\n', end) + 1;
+                if (next - begin > 1400 and end > begin) {
+                    break;
+                }
+                end = next;
+            }
+            if (send(_socket, rendering.data() + begin, end - begin, 0) < 0) {
+                return;
+            }
+            begin = end;
+        }
+    }
+}
+
+} // jitk
+} // bohrium
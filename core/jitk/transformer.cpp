@@ -18,6 +18,10 @@ GNU Lesser General Public License along with Bohrium.
 If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <cstdlib>
+#include <map>
+#include <memory>
+
 #include <jitk/transformer.hpp>
 
 using namespace std;
@@ -33,7 +37,7 @@ vector<InstrPtr> swap_axis(const vector<InstrPtr> &instr_list, int64_t axis1, in
     for (const InstrPtr &instr: instr_list) {
         bh_instruction tmp(*instr);
         tmp.transpose(axis1, axis2);
-        ret.push_back(std::make_shared<bh_instruction>(tmp));
+        ret.push_back(make_instr(tmp));
     }
     return ret;
 }
@@ -78,6 +82,37 @@ const LoopB *find_swappable_sub_block(const LoopB &parent) {
     return NULL;
 }
 
+// Help function that returns the innermost sub-block of 'parent' if swapping the two makes more of the
+// accessed bytes unit-stride in the innermost loop. NB: 'parent' must be a perfect nest without sweeps.
+const LoopB *find_unit_stride_sub_block(const LoopB &parent) {
+    if (not parent._sweeps.empty() or parent._block_list.size() != 1 or parent._block_list[0].isInstr()) {
+        return NULL;
+    }
+    const LoopB &child = parent._block_list[0].getLoop();
+    if (not child._sweeps.empty() or not child.isInnermost()) {
+        return NULL;
+    }
+    uint64_t parent_unit_bytes = 0;
+    uint64_t child_unit_bytes = 0;
+    for (const InstrPtr &instr: child.getLocalInstr()) {
+        if (bh_opcode_is_system(instr->opcode)) {
+            continue;
+        }
+        for (const bh_view &view: instr->operand) {
+            if (not bh_is_constant(&view) and view.ndim > child.rank) {
+                const uint64_t nbytes = bh_nelements(view) * bh_type_size(view.base->type);
+                if (std::abs(view.stride[parent.rank]) == 1) {
+                    parent_unit_bytes += nbytes;
+                }
+                if (std::abs(view.stride[child.rank]) == 1) {
+                    child_unit_bytes += nbytes;
+                }
+            }
+        }
+    }
+    return parent_unit_bytes > child_unit_bytes ? &child : NULL;
+}
+
 // Help function that collapses 'axis' and 'axis+1' in all instructions within 'loop'
 // Returns false if encountering a non-compatible instruction
 bool collapse_instr_axes(LoopB &loop, const int axis) {
@@ -158,6 +193,26 @@ void push_reductions_inwards(vector<Block> &block_list) {
     block_list = ret;
 }
 
+void push_unit_stride_inwards(vector<Block> &block_list) {
+    vector<Block> ret;
+    for (const Block &block: block_list) {
+        if (block.isInstr()) {
+            ret.push_back(block);
+            continue;
+        }
+        Block b(block);
+        push_unit_stride_inwards(b.getLoop()._block_list);
+        const LoopB *swappable = find_unit_stride_sub_block(b.getLoop());
+        if (swappable != NULL) {
+            const vector<Block> tmp = swap_blocks(b.getLoop(), swappable);
+            ret.insert(ret.end(), tmp.begin(), tmp.end());
+        } else {
+            ret.push_back(std::move(b));
+        }
+    }
+    block_list = ret;
+}
+
 void split_for_threading(vector<Block> &block_list, uint64_t min_threading, uint64_t cur_threading) {
     vector<Block> ret;
 
@@ -238,6 +293,164 @@ void collapse_redundant_axes(vector<Block> &block_list) {
     }
     block_list = ret;
 }
+
+namespace {
+
+// Returns true when 'outer' is a perfect nest of two loops without sweeps, which are both larger
+// than 'tile_size' and where a view traverses memory faster along the outer axis than the inner axis
+bool tileable(const LoopB &outer, int64_t tile_size) {
+    if (outer.size <= tile_size or outer._sweeps.size() > 0 or outer._block_list.size() != 1 or
+        outer._block_list[0].isInstr()) {
+        return false;
+    }
+    const LoopB &inner = outer._block_list[0].getLoop();
+    if (not inner.isInnermost() or inner.size <= tile_size or inner._sweeps.size() > 0) {
+        return false;
+    }
+    for (const InstrPtr &instr: inner.getLocalInstr()) {
+        for (const bh_view &view: instr->operand) {
+            if (not bh_is_constant(&view) and view.ndim > inner.rank) {
+                const int64_t outer_stride = std::abs(view.stride[outer.rank]);
+                if (outer_stride > 0 and outer_stride < std::abs(view.stride[inner.rank])) {
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+} // Anon namespace
+
+void tile_loops(vector<Block> &block_list, int64_t tile_size) {
+    if (tile_size <= 0) {
+        return;
+    }
+    for (Block &b: block_list) {
+        if (not b.isInstr()) {
+            LoopB &loop = b.getLoop();
+            if (tileable(loop, tile_size)) {
+                loop.tile_size = tile_size;
+                loop._block_list[0].getLoop().tile_size = tile_size;
+            } else { // NB: we clear old tiles since a re-applied transformer might have changed the nest
+                loop.tile_size = 0;
+                tile_loops(loop._block_list, tile_size);
+            }
+        }
+    }
+}
+
+namespace {
+
+/* Returns the number of columns of the column blocks of 'loop' or zero when 'loop' isn't a reduction over the rows
+ * of a 2D nest, whose output rows are wider than two blocks of 'block_bytes'. The nest must consist of reductions
+ * over axis 0 and elementwise instructions on (rows, cols) views, where the written bases are accessed through one
+ * view only thus the columns are independent. */
+int64_t column_block_cols(const LoopB &loop, int64_t block_bytes) {
+    if (loop.rank != 0 or loop._sweeps.empty() or loop.tile_size > 0 or loop.size < 2 or
+        loop._block_list.size() != 1 or loop._block_list[0].isInstr()) {
+        return 0;
+    }
+    const LoopB &inner = loop._block_list[0].getLoop();
+    if (not inner.isInnermost() or not inner._sweeps.empty()) {
+        return 0;
+    }
+    const int64_t rows = loop.size, cols = inner.size;
+    int64_t elem_bytes = 1;
+    for (const InstrPtr &instr: loop._sweeps) {
+        if (not bh_opcode_is_reduction(instr->opcode) or instr->sweep_axis() != 0) {
+            return 0;
+        }
+        elem_bytes = std::max<int64_t>(elem_bytes, bh_type_size(instr->operand[0].base->type));
+    }
+    const int64_t target = std::max<int64_t>(1, block_bytes / elem_bytes);
+    if (cols < 2 * target) {
+        return 0;
+    }
+    map<const bh_base *, bh_view> written;
+    for (const InstrPtr &instr: loop.getAllInstr()) {
+        if (bh_opcode_is_system(instr->opcode)) {
+            continue;
+        }
+        for (size_t i = 0; i < instr->operand.size(); ++i) {
+            const bh_view &view = instr->operand[i];
+            if (bh_is_constant(&view)) {
+                continue;
+            }
+            const bool reduced = i == 0 and bh_opcode_is_sweep(instr->opcode);
+            if (reduced ? (view.ndim != 1 or view.shape[0] != cols) :
+                          (view.ndim != 2 or view.shape[0] != rows or view.shape[1] != cols)) {
+                return 0;
+            }
+            if (i == 0) {
+                written.insert(make_pair(view.base, view));
+            }
+        }
+    }
+    for (const InstrPtr &instr: loop.getAllInstr()) {
+        for (const bh_view &view: instr->operand) {
+            auto it = bh_is_constant(&view) ? written.end() : written.find(view.base);
+            if (it != written.end() and it->second != view) {
+                return 0;
+            }
+        }
+    }
+    // The widest block of at most 'target' columns that divides the rows, but not one much narrower
+    for (int64_t b = target; b >= std::max<int64_t>(1, target / 4); --b) {
+        if (cols % b == 0) {
+            return b;
+        }
+    }
+    return 0;
+}
+
+// Splits the columns of 'view' into blocks of 'b' columns that become the new outermost axis
+void split_columns(bh_view &view, int64_t b) {
+    const int64_t col = view.ndim - 1;
+    const int64_t col_stride = view.stride[col];
+    const int64_t nblocks = view.shape[col] / b;
+    for (int64_t i = view.ndim; i > 0; --i) {
+        view.shape[i] = view.shape[i - 1];
+        view.stride[i] = view.stride[i - 1];
+    }
+    ++view.ndim;
+    view.shape[0] = nblocks;
+    view.stride[0] = b * col_stride;
+    view.shape[view.ndim - 1] = b;
+}
+} // Anon namespace
+
+void block_column_reductions(vector<Block> &block_list, int64_t block_bytes) {
+    if (block_bytes <= 0) {
+        return;
+    }
+    for (Block &block: block_list) {
+        if (block.isInstr()) {
+            continue;
+        }
+        const int64_t b = column_block_cols(block.getLoop(), block_bytes);
+        if (b == 0) {
+            continue;
+        }
+        // The nest of the instructions on (cols/b, rows, b) views reduces over the new axis 1
+        const int64_t rows = block.getLoop().size;
+        vector<InstrPtr> instr_list;
+        for (const InstrPtr &instr: block.getAllInstr()) {
+            bh_instruction split(*instr);
+            for (bh_view &view: split.operand) {
+                if (not bh_is_constant(&view) and view.ndim > 0 and view.shape[view.ndim - 1] % b == 0 and
+                    (view.ndim == 1 or (view.ndim == 2 and view.shape[0] == rows))) {
+                    split_columns(view, b);
+                }
+            }
+            if (bh_opcode_is_sweep(split.opcode)) {
+                split.constant = bh_constant(int64_t{1});
+            }
+            instr_list.push_back(std::make_shared<bh_instruction>(std::move(split)));
+        }
+        block = create_nested_block(instr_list, 0);
+    }
+}
+
 } // jitk
 } // bohrium
 
@@ -28,8 +28,93 @@ using namespace std;
 namespace bohrium {
 namespace jitk {
 
+namespace {
+// Returns true when the index of 'view' uses the offset-and-strides variables
+bool uses_variables(const Scope &scope, const bh_view &view) {
+    return scope.strides_as_variables and scope.isArray(view) and scope.symbols.existOffsetStridesID(view);
+}
+
+// Returns the strides of the first 'naxes' axes of 'view' as they are written in the index
+vector<string> index_strides(const Scope &scope, const bh_view &view, int naxes) {
+    vector<string> ret;
+    const bool variables = uses_variables(scope, view);
+    for (int i = 0; i < naxes; ++i) {
+        if (variables) {
+            ret.push_back("vs" + to_string(scope.symbols.offsetStridesID(view)) + "_" + to_string(i));
+        } else {
+            ret.push_back(to_string(view.stride[i]));
+        }
+    }
+    return ret;
+}
+
+// Writes the terms of the axes [begin, end) of the index
+void write_index_terms(const vector<string> &strides, int begin, int end, stringstream &out) {
+    for (int i = begin; i < end; ++i) {
+        if (strides[i] != "0") {
+            out << " +i" << i;
+            if (strides[i] != "1") {
+                out << "*" << strides[i];
+            }
+        }
+    }
+}
+
+// Writes the index of 'view' using the innermost partial index in 'scope' and returns false when there is none
+bool write_reduced_index(const Scope &scope, const bh_view &view, stringstream &out) {
+    if (not scope.strength_reduce or view.ndim < 2 or bh_is_scalar(&view)) {
+        return false;
+    }
+    const vector<string> strides = index_strides(scope, view, view.ndim);
+    for (int rank = view.ndim - 2; rank >= 0; --rank) {
+        const string *partial = scope.getPartialIdx(vector<string>(strides.begin(), strides.begin() + rank + 1));
+        if (partial != NULL) {
+            if (uses_variables(scope, view)) {
+                out << "vo" << scope.symbols.offsetStridesID(view);
+            } else {
+                out << view.start;
+            }
+            out << " +" << *partial;
+            write_index_terms(strides, rank + 1, view.ndim, out);
+            return true;
+        }
+    }
+    return false;
+}
+} // Anon namespace
+
+void write_partial_index_declaration(Scope &scope, const bh_view &view, int rank, stringstream &out) {
+    if (view.ndim <= rank + 1 or bh_is_scalar(&view)) {
+        return;
+    }
+    const vector<string> strides = index_strides(scope, view, rank + 1);
+    if (scope.isPartialIdxDeclaredLocally(strides)) {
+        return;
+    }
+    const string *parent = rank > 0 ? scope.getPartialIdx(vector<string>(strides.begin(), strides.end() - 1)) : NULL;
+    if (strides[rank] == "0") {
+        if (parent != NULL) {
+            scope.insertPartialIdx(strides, *parent);
+        }
+        return;
+    }
+    out << "const uint64_t " << scope.insertPartialIdx(strides) << " = ";
+    if (parent == NULL) {
+        stringstream terms;
+        write_index_terms(strides, 0, rank + 1, terms);
+        out << terms.str().substr(2); // Without the leading " +"
+    } else {
+        out << *parent;
+        write_index_terms(strides, rank, rank + 1, out);
+    }
+    out << ";";
+}
+
 void write_array_index(const Scope &scope, const bh_view &view, stringstream &out,
                        int hidden_axis, const pair<int, int> axis_offset) {
+    if (hidden_axis == BH_MAXDIM and axis_offset.first == BH_MAXDIM and write_reduced_index(scope, view, out)) {
+        return;
+    }
     bool empty_subscription = true;
     if (view.start > 0) {
         out << view.start;
@@ -59,6 +144,9 @@ void write_array_index(const Scope &scope, const bh_view &view, stringstream &ou
 
 void write_array_index_variables(const Scope &scope, const bh_view &view, stringstream &out,
                                  int hidden_axis, const pair<int, int> axis_offset) {
+    if (hidden_axis == BH_MAXDIM and axis_offset.first == BH_MAXDIM and write_reduced_index(scope, view, out)) {
+        return;
+    }
 
     // Write view.start using the offset-and-strides variable
     out << "vo" << scope.symbols.offsetStridesID(view);
@@ -0,0 +1,203 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <limits>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+
+#include <jitk/work_group_tuner.hpp>
+
+using namespace std;
+namespace fs = boost::filesystem;
+
+namespace bohrium {
+namespace jitk {
+
+const size_t WorkGroupTuner::NOT_TIMED = numeric_limits<size_t>::max();
+
+namespace {
+// The vector widths to try besides the configured one
+const vector<uint32_t> tuned_widths = {1, 2, 4, 8};
+
+// Reads the tuning file 'file' into 'out', which maps kernel keys to the winning local work sizes and vector widths.
+// The width is optional and zero when the kernel doesn't process vectors.
+void read_tunings(const fs::path &file, map<uint64_t, pair<WorkGroupTuner::Local, uint32_t> > &out) {
+    ifstream in(file.string());
+    string line;
+    while (getline(in, line)) {
+        istringstream ss(line);
+        uint64_t key;
+        WorkGroupTuner::Local local;
+        if (ss >> key >> local[0] >> local[1] >> local[2] and local[0] > 0 and local[1] > 0 and local[2] > 0) {
+            uint32_t width = 0;
+            if (not (ss >> width)) {
+                width = 0;
+            }
+            out[key] = make_pair(local, width);
+        }
+    }
+}
+
+// Returns the local work sizes to try of a kernel with 'ndim' dimensions starting with 'configured'
+vector<WorkGroupTuner::Local> candidates(size_t ndim, uint64_t max_size, const WorkGroupTuner::Local &max_local,
+                                         const WorkGroupTuner::Local &configured) {
+    vector<WorkGroupTuner::Local> all = {configured};
+    switch (ndim) {
+        case 1:
+            for (uint32_t x: {32, 64, 128, 256, 512, 1024}) {
+                all.push_back({{x, 1, 1}});
+            }
+            break;
+        case 2:
+            all.insert(all.end(), {{{8, 8, 1}}, {{16, 16, 1}}, {{32, 4, 1}}, {{32, 8, 1}}, {{64, 4, 1}}, {{128, 2, 1}}});
+            break;
+        default:
+            all.insert(all.end(), {{{8, 8, 4}}, {{8, 8, 8}}, {{16, 4, 4}}, {{32, 2, 2}}, {{32, 4, 2}}, {{64, 2, 2}}});
+    }
+    vector<WorkGroupTuner::Local> ret;
+    for (const WorkGroupTuner::Local &local: all) {
+        const uint64_t size = static_cast<uint64_t>(local[0]) * local[1] * local[2];
+        if (size <= max_size and local[0] <= max_local[0] and local[1] <= max_local[1] and
+            local[2] <= max_local[2] and std::find(ret.begin(), ret.end(), local) == ret.end()) {
+            ret.push_back(local);
+        }
+    }
+    return ret;
+}
+} // Anon namespace
+
+WorkGroupTuner::WorkGroupTuner(int runs, const fs::path &file) : runs(std::max(1, runs)), file(file) {
+    if (not file.empty()) {
+        map<uint64_t, pair<Local, uint32_t> > loaded;
+        read_tunings(file, loaded);
+        for (const auto &kv: loaded) {
+            Tuning &t = _tunings[kv.first];
+            t.tuned = true;
+            t.winner = kv.second.first;
+            t.winner_width = kv.second.second;
+        }
+    }
+}
+
+WorkGroupTuner::~WorkGroupTuner() {
+    if (not _dirty or file.empty()) {
+        return;
+    }
+    // We merge with the tunings other processes might have written meanwhile
+    map<uint64_t, pair<Local, uint32_t> > winners;
+    read_tunings(file, winners);
+    for (const auto &kv: _tunings) {
+        if (kv.second.tuned) {
+            winners[kv.first] = make_pair(kv.second.winner, kv.second.winner_width);
+        }
+    }
+    // We write to a unique file and rename it thus concurrent processes never see a partial file
+    const fs::path tmpfile = fs::path(file.string() + fs::unique_path("-%%%%%%%%.tmp").string());
+    {
+        ofstream out(tmpfile.string());
+        for (const auto &kv: winners) {
+            const Local &local = kv.second.first;
+            out << kv.first << " " << local[0] << " " << local[1] << " " << local[2];
+            if (kv.second.second > 0) {
+                out << " " << kv.second.second;
+            }
+            out << "\n";
+        }
+    }
+    boost::system::error_code ec;
+    fs::rename(tmpfile, file, ec);
+    if (ec) {
+        fs::remove(tmpfile, ec);
+    }
+}
+
+size_t WorkGroupTuner::begin(uint64_t key, size_t ndim, uint64_t max_size, const Local &max_local, Local &local,
+                             uint32_t *width) {
+    Tuning &t = _tunings[key];
+    if (t.tuned) {
+        local = t.winner;
+        if (width != NULL and t.winner_width > 0) {
+            *width = t.winner_width;
+        }
+        return NOT_TIMED;
+    }
+    // The first launch warms up the caches thus we don't time it
+    if (not t.warm) {
+        t.warm = true;
+        const vector<Local> locals = candidates(ndim, max_size, max_local, local);
+        // Each local work size is tried with each vector width starting with the configured one
+        vector<uint32_t> widths = {width == NULL ? 0 : *width};
+        for (uint32_t w: tuned_widths) {
+            if (width != NULL and std::find(widths.begin(), widths.end(), w) == widths.end()) {
+                widths.push_back(w);
+            }
+        }
+        for (uint32_t w: widths) {
+            for (const Local &l: locals) {
+                t.candidates.push_back(l);
+                t.widths.push_back(w);
+            }
+        }
+        if (t.candidates.size() <= 1) { // Nothing to tune
+            t.tuned = true;
+            t.winner = t.candidates.empty() ? local : t.candidates[0];
+            t.winner_width = t.widths.empty() ? widths[0] : t.widths[0];
+        } else {
+            t.seconds.assign(t.candidates.size(), 0);
+            t.launches.assign(t.candidates.size(), 0);
+        }
+        return NOT_TIMED;
+    }
+    for (size_t i = 0; i < t.candidates.size(); ++i) {
+        if (t.launches[i] < runs) {
+            local = t.candidates[i];
+            if (width != NULL) {
+                *width = t.widths[i];
+            }
+            return i;
+        }
+    }
+    return NOT_TIMED;
+}
+
+void WorkGroupTuner::end(uint64_t key, size_t candidate, double seconds) {
+    if (candidate == NOT_TIMED) {
+        return;
+    }
+    Tuning &t = _tunings[key];
+    t.seconds[candidate] += seconds;
+    ++t.launches[candidate];
+    if (candidate + 1 == t.candidates.size() and t.launches[candidate] >= runs) {
+        size_t winner = 0;
+        for (size_t i = 1; i < t.candidates.size(); ++i) {
+            if (t.seconds[i] < t.seconds[winner]) {
+                winner = i;
+            }
+        }
+        t.tuned = true;
+        t.winner = t.candidates[winner];
+        t.winner_width = t.widths[winner];
+        _dirty = true;
+    }
+}
+
+} // jitk
+} // bohrium
@@ -0,0 +1,153 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdexcept>
+#include <cstring>
+#include <algorithm>
+
+#include <bh_extmethod.hpp>
+
+using namespace bohrium;
+using namespace extmethod;
+using namespace std;
+
+namespace {
+
+/* The bytes of a row are packed or unpacked in blocks of this many bytes, which are independent
+ * and thus distributed among the threads */
+constexpr int64_t block_size = 1 << 14;
+
+/* A view of the 2-D operand, where the bits are packed along the rows (the last axis) */
+template<typename T>
+struct Rows {
+    T *data;
+    int64_t stride0, stride1;
+    Rows(const bh_view *view) : data(reinterpret_cast<T *>(view->base->data) + view->start),
+                                stride0(view->stride[0]), stride1(view->stride[1]) {}
+    T &operator()(int64_t r, int64_t i) const { return data[r * stride0 + i * stride1]; }
+};
+
+/* Packs eight contiguous booleans (0 or 1) into a byte where the first boolean is the most significant bit:
+ * the multiplication moves byte 'i' of the little-endian word to bit '63 - i' without carries */
+inline bh_uint8 pack8(const bh_bool *in) {
+    uint64_t word;
+    memcpy(&word, in, sizeof(word));
+    return static_cast<bh_uint8>((word * 0x8040201008040201ULL) >> 56);
+}
+
+/* Packs the booleans of the bytes [first, last) of row 'r' of 'n' booleans, the missing bits of the last byte
+ * are zero */
+void pack_block(const Rows<const bh_bool> &in, const Rows<bh_uint8> &out, int64_t r, int64_t first, int64_t last,
+                int64_t n) {
+    int64_t k = first;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    if (in.stride1 == 1) {
+        for (; k < last and 8 * k + 8 <= n; ++k) {
+            out(r, k) = pack8(&in(r, 8 * k));
+        }
+    }
+#endif
+    for (; k < last; ++k) {
+        bh_uint8 byte = 0;
+        for (int64_t b = 0; b < 8 and 8 * k + b < n; ++b) {
+            byte |= static_cast<bh_uint8>((in(r, 8 * k + b) ? 1 : 0) << (7 - b));
+        }
+        out(r, k) = byte;
+    }
+}
+
+/* Unpacks the bytes [first, last) of row 'r' into the 'n' booleans of the output row */
+void unpack_block(const Rows<const bh_uint8> &in, const Rows<bh_bool> &out, int64_t r, int64_t first,
+                  int64_t last, int64_t n) {
+    for (int64_t k = first; k < last; ++k) {
+        const bh_uint8 byte = in(r, k);
+        for (int64_t b = 0; b < 8 and 8 * k + b < n; ++b) {
+            out(r, 8 * k + b) = static_cast<bh_bool>((byte >> (7 - b)) & 1);
+        }
+    }
+}
+
+/* The bit-packing extension methods of the rows of 2-D arrays, which store a boolean mask in an eighth of
+ * the memory (the bit order of numpy.packbits()):
+ *   - "packbits" packs the booleans of each row of 'in' (operand 1) into the 'ceil(n / 8)' bytes of the row
+ *     of 'out' (operand 0), which is uint8. The first boolean is the most significant bit and the missing bits
+ *     of the last byte are zero.
+ *   - "unpackbits" unpacks the uint8 rows of 'in' into the booleans of 'out', which has 'n' columns where
+ *     'ceil(n / 8)' is the number of columns of 'in'.
+ * The bitwise ufuncs of the packed bytes are the logical ufuncs of the booleans, eight at a time.
+ */
+template<bool pack>
+class BitpackImpl : public ExtmethodImpl {
+public:
+    void execute(bh_instruction *instr, void* arg) {
+        bh_view *out = &instr->operand[0];
+        const bh_view *in = &instr->operand[1];
+        if (in->ndim != 2 or out->ndim != 2 or in->shape[0] != out->shape[0]) {
+            throw runtime_error("bitpack: the operands must be 2-D arrays of the same number of rows");
+        }
+        const bh_type bool_type = pack ? in->base->type : out->base->type;
+        const bh_type byte_type = pack ? out->base->type : in->base->type;
+        if (bool_type != bh_type::BOOL or byte_type != bh_type::UINT8) {
+            throw runtime_error("bitpack: packbits packs BOOL into UINT8 and unpackbits unpacks UINT8 into BOOL");
+        }
+        // The number of booleans and bytes of a row
+        const int64_t n = pack ? in->shape[1] : out->shape[1];
+        const int64_t nbytes = pack ? out->shape[1] : in->shape[1];
+        if ((n + 7) / 8 != nbytes) {
+            throw runtime_error("bitpack: the rows of 'n' booleans must have 'ceil(n / 8)' bytes");
+        }
+
+        // Make sure that the arrays memory are allocated.
+        bh_data_malloc(in->base);
+        bh_data_malloc(out->base);
+
+        const int64_t rows = in->shape[0];
+        if (rows == 0 or nbytes == 0) {
+            return;
+        }
+        const int64_t nblocks = (nbytes + block_size - 1) / block_size;
+        const int64_t items = rows * nblocks;
+
+        #pragma omp parallel for schedule(static) if(items > 1)
+        for (int64_t item = 0; item < items; ++item) {
+            const int64_t r = item / nblocks;
+            const int64_t first = (item % nblocks) * block_size;
+            const int64_t last = std::min(nbytes, first + block_size);
+            if (pack) {
+                pack_block(Rows<const bh_bool>(in), Rows<bh_uint8>(out), r, first, last, n);
+            } else {
+                unpack_block(Rows<const bh_uint8>(in), Rows<bh_bool>(out), r, first, last, n);
+            }
+        }
+    }
+};
+} // Unnamed namespace
+
+extern "C" ExtmethodImpl* packbits_create() {
+    return new BitpackImpl<true>();
+}
+extern "C" void packbits_destroy(ExtmethodImpl* self) {
+    delete self;
+}
+extern "C" ExtmethodImpl* unpackbits_create() {
+    return new BitpackImpl<false>();
+}
+extern "C" void unpackbits_destroy(ExtmethodImpl* self) {
+    delete self;
+}
@@ -1,14 +1,17 @@
 struct @!uname!@Impl : public ExtmethodImpl {
 public:
-    void execute(bh_instruction *instr, void* arg) {
-        // All matrices must be contigous
-        assert(instr->is_contiguous());
+    <!--(if if_epilogue)-->
+    bool epilogue() const { return true; }
+    <!--(end)-->
 
+    void execute(bh_instruction *instr, void* arg) {
+        // The matrices may be strided views, which the calls address by their leading dimensions
         // A is a m*k matrix
         bh_view* A = &instr->operand[1];
         // We allocate the A data, if not already present
         bh_data_malloc(A->base);
-        void *A_data = A->base->data;
+        // The transposed views of the methods that take a transpose flag swap the flag instead of being copied
+        Matrix A_mat(A, <!--(if if_transposable)-->true<!--(else)-->false<!--(end)-->, false);
 
         <!--(if if_B)-->
         // B is a k*n matrix
@@ -17,7 +20,8 @@ public:
         bh_data_malloc(B->base);
 
         assert(A->base->type == B->base->type);
-        void *B_data = B->base->data;
+        // The methods without C write B
+        Matrix B_mat(B, <!--(if if_transposable)-->true<!--(else)-->false<!--(end)-->, <!--(if if_C)-->false<!--(else)-->true<!--(end)-->);
         <!--(end)-->
 
         <!--(if if_C)-->
@@ -28,10 +32,25 @@ public:
         bh_data_malloc(C->base);
 
         assert(A->base->type == C->base->type);
-        void *C_data = C->base->data;
         <!--(end)-->
 
-        int k = A->shape[1];
+        <!--(if if_epilogue)-->
+        // The epilogue 'C = alpha * op(A, B) + D' of the scaling and addition that are fused into the instruction
+        const size_t nops = instr->operand.size();
+        const double alpha_scale = nops > 3 and bh_is_constant(&instr->operand[nops - 1]) ? instr->constant.get_double() : 1.0;
+        const bh_view *D = nops > 3 and not bh_is_constant(&instr->operand[3]) ? &instr->operand[3] : NULL;
+        const double beta_scale = D != NULL ? 1.0 : 0.0;
+        if (D != NULL and *D != *C) {
+            bh_data_malloc(D->base);
+            copy_view(D, C);
+        }
+        <!--(end)-->
+        <!--(if not if_epilogue)--> const double alpha_scale = 1.0; <!--(end)-->
+        <!--(if if_C and not if_epilogue)--> const double beta_scale = 0.0; <!--(end)-->
+
+        <!--(if if_C)--> Matrix C_mat(C, false, true); <!--(end)-->
+
+        <!--(if if_k)--> int k = A->shape[1]; <!--(end)-->
         <!--(if if_m)--> int m = A->shape[0]; <!--(end)-->
         <!--(if if_n)-->
             int n;
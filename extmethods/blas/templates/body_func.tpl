@@ -5,24 +5,24 @@ case @!utype!@: {
         <!--(if if_layout)-->   CblasRowMajor, <!--(end)-->
         <!--(if if_side)-->     CblasLeft,     <!--(end)-->
         <!--(if if_uplo)-->     CblasUpper,    <!--(end)-->
-        <!--(if if_notransA)--> CblasNoTrans,  <!--(end)-->
-        <!--(if if_transA)-->   CblasTrans,    <!--(end)-->
-        <!--(if if_notransB)--> CblasNoTrans,  <!--(end)-->
+        <!--(if if_notransA)--> A_mat.trans ? CblasTrans : CblasNoTrans, <!--(end)-->
+        <!--(if if_transA)-->   A_mat.trans ? CblasNoTrans : CblasTrans, <!--(end)-->
+        <!--(if if_notransB)--> B_mat.trans ? CblasTrans : CblasNoTrans, <!--(end)-->
         <!--(if if_diag)-->     CblasUnit,     <!--(end)-->
         <!--(if if_m)-->        m,             <!--(end)-->
         <!--(if if_n)-->        n,             <!--(end)-->
         <!--(if if_k)-->        k,             <!--(end)-->
         @!alpha_arg!@,
-        (@!blas_type!@*)(((@!type!@*) A_data) + A->start),
-        k,
+        (@!blas_type!@*) A_mat.data,
+        A_mat.ld,
         <!--(if if_B)-->
-        (@!blas_type!@*)(((@!type!@*) B_data) + B->start),
-        n<!--(if if_C)-->,<!--(end)-->
+        (@!blas_type!@*) B_mat.data,
+        B_mat.ld<!--(if if_C)-->,<!--(end)-->
         <!--(end)-->
         <!--(if if_C)-->
         @!beta_arg!@,
-        (@!blas_type!@*)(((@!type!@*) C_data) + C->start),
-        n
+        (@!blas_type!@*) C_mat.data,
+        C_mat.ld
         <!--(end)-->
     );
     break;
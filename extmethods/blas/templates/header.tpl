@@ -11,6 +11,9 @@
 #endif
 
 #include <stdexcept>
+#include <algorithm>
+#include <cstring>
+#include <vector>
 
 using namespace bohrium;
 using namespace extmethod;
@@ -19,21 +22,89 @@ using namespace std;
 namespace {
 
     void cblas_sgemmt(CBLAS_ORDER layout, CBLAS_TRANSPOSE TransA, CBLAS_TRANSPOSE TransB, const int M, const int N, const int K, const bh_float32 alpha, const bh_float32 *A, const int lda, const bh_float32 *B, const int ldb, const bh_float32 beta, bh_float32 *C, const int ldc) {
-        cblas_sgemm(layout, TransA, TransB, K, N, M, alpha, A, K, B, K, beta, C, ldc);
+        cblas_sgemm(layout, TransA, TransB, K, N, M, alpha, A, lda, B, ldb, beta, C, ldc);
     }
 
     void cblas_dgemmt(CBLAS_ORDER layout, CBLAS_TRANSPOSE TransA, CBLAS_TRANSPOSE TransB, const int M, const int N, const int K, const bh_float64 alpha, const bh_float64 *A, const int lda, const bh_float64 *B, const int ldb, const bh_float64 beta, bh_float64 *C, const int ldc) {
-        cblas_dgemm(layout, TransA, TransB, K, N, M, alpha, A, K, B, K, beta, C, ldc);
+        cblas_dgemm(layout, TransA, TransB, K, N, M, alpha, A, lda, B, ldb, beta, C, ldc);
     }
 
     void cblas_cgemmt(CBLAS_ORDER layout, CBLAS_TRANSPOSE TransA, CBLAS_TRANSPOSE TransB, const int M, const int N, const int K, float* alpha, const float *A, const int lda, const float *B, const int ldb, float* beta, float *C, const int ldc) {
-        cblas_cgemm(layout, TransA, TransB, K, N, M, alpha, A, K, B, K, beta, C, ldc);
+        cblas_cgemm(layout, TransA, TransB, K, N, M, alpha, A, lda, B, ldb, beta, C, ldc);
     }
 
     void cblas_zgemmt(CBLAS_ORDER layout, CBLAS_TRANSPOSE TransA, CBLAS_TRANSPOSE TransB, const int M, const int N, const int K, double* alpha, const double *A, const int lda, const double *B, const int ldb, double* beta, double *C, const int ldc) {
-        cblas_zgemm(layout, TransA, TransB, K, N, M, alpha, A, K, B, K, beta, C, ldc);
+        cblas_zgemm(layout, TransA, TransB, K, N, M, alpha, A, lda, B, ldb, beta, C, ldc);
     }
 
+    // Copies the elements of the matrix view 'src' to 'dst' of the same shape and type
+    void copy_view(const bh_view *src, const bh_view *dst) {
+        const size_t elem = bh_type_size(src->base->type);
+        const char *s = static_cast<const char *>(src->base->data);
+        char *d = static_cast<char *>(dst->base->data);
+        for (int64_t i = 0; i < src->shape[0]; ++i) {
+            for (int64_t j = 0; j < src->shape[1]; ++j) {
+                memcpy(d + (dst->start + i * dst->stride[0] + j * dst->stride[1]) * elem,
+                       s + (src->start + i * src->stride[0] + j * src->stride[1]) * elem, elem);
+            }
+        }
+    }
+
+    // The BLAS layout of a matrix view: its first element, whether it is the transpose of a row-major matrix, and
+    // its leading dimension. A view without such a layout (e.g. of a non-unit inner stride) is copied to a row-major
+    // matrix, which is written back to the view at destruction when 'write_back' is set.
+    class Matrix {
+    public:
+        void *data;
+        bool trans = false;
+        int ld;
+
+        Matrix(const bh_view *view, bool allow_trans, bool write_back) : _view(view), _write_back(write_back) {
+            const int64_t m = view->shape[0], n = view->shape[1];
+            const int64_t s0 = view->stride[0], s1 = view->stride[1];
+            data = static_cast<char *>(view->base->data) + view->start * bh_type_size(view->base->type);
+            if ((n == 1 or s1 == 1) and (m == 1 or s0 >= std::max<int64_t>(1, n))) {
+                ld = static_cast<int>(m == 1 ? std::max<int64_t>(1, n) : s0);
+            } else if (allow_trans and (m == 1 or s0 == 1) and (n == 1 or s1 >= std::max<int64_t>(1, m))) {
+                trans = true;
+                ld = static_cast<int>(n == 1 ? std::max<int64_t>(1, m) : s1);
+            } else {
+                _copy.resize(m * n * bh_type_size(view->base->type));
+                copy(true);
+                data = _copy.data();
+                ld = static_cast<int>(std::max<int64_t>(1, n));
+            }
+        }
+
+        ~Matrix() {
+            if (_write_back and not _copy.empty()) {
+                copy(false);
+            }
+        }
+
+    private:
+        const bh_view *_view;
+        const bool _write_back;
+        std::vector<char> _copy;
+
+        // Copies the view to the row-major copy or back
+        void copy(bool to_copy) {
+            const size_t elem = bh_type_size(_view->base->type);
+            char *base = static_cast<char *>(_view->base->data);
+            for (int64_t i = 0; i < _view->shape[0]; ++i) {
+                for (int64_t j = 0; j < _view->shape[1]; ++j) {
+                    char *v = base + (_view->start + i * _view->stride[0] + j * _view->stride[1]) * elem;
+                    char *c = &_copy[(i * _view->shape[1] + j) * elem];
+                    if (to_copy) {
+                        memcpy(c, v, elem);
+                    } else {
+                        memcpy(v, c, elem);
+                    }
+                }
+            }
+        }
+    };
+
     @!body!@
 } /* end of namespace */
 
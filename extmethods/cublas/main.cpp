@@ -0,0 +1,360 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <bh_extmethod.hpp>
+#include "../ve/cuda/engine_cuda.hpp"
+
+#include <cublas_v2.h>
+
+using namespace bohrium;
+using namespace extmethod;
+using namespace std;
+
+namespace {
+
+void checkCublas(cublasStatus_t status, const char *call) {
+    if (status != CUBLAS_STATUS_SUCCESS) {
+        throw runtime_error(string("[cuBLAS] ") + call + " failed with status " + to_string(static_cast<int>(status)));
+    }
+}
+
+cublasStatus_t gemm(cublasHandle_t h, cublasOperation_t ta, cublasOperation_t tb, int m, int n, int k,
+                    const float *alpha, const float *A, int lda, const float *B, int ldb, const float *beta,
+                    float *C, int ldc) {
+    return cublasSgemm(h, ta, tb, m, n, k, alpha, A, lda, B, ldb, beta, C, ldc);
+}
+
+cublasStatus_t gemm(cublasHandle_t h, cublasOperation_t ta, cublasOperation_t tb, int m, int n, int k,
+                    const double *alpha, const double *A, int lda, const double *B, int ldb, const double *beta,
+                    double *C, int ldc) {
+    return cublasDgemm(h, ta, tb, m, n, k, alpha, A, lda, B, ldb, beta, C, ldc);
+}
+
+cublasStatus_t gemm(cublasHandle_t h, cublasOperation_t ta, cublasOperation_t tb, int m, int n, int k,
+                    const cuComplex *alpha, const cuComplex *A, int lda, const cuComplex *B, int ldb,
+                    const cuComplex *beta, cuComplex *C, int ldc) {
+    return cublasCgemm(h, ta, tb, m, n, k, alpha, A, lda, B, ldb, beta, C, ldc);
+}
+
+cublasStatus_t gemm(cublasHandle_t h, cublasOperation_t ta, cublasOperation_t tb, int m, int n, int k,
+                    const cuDoubleComplex *alpha, const cuDoubleComplex *A, int lda, const cuDoubleComplex *B,
+                    int ldb, const cuDoubleComplex *beta, cuDoubleComplex *C, int ldc) {
+    return cublasZgemm(h, ta, tb, m, n, k, alpha, A, lda, B, ldb, beta, C, ldc);
+}
+
+cublasStatus_t getrfBatched(cublasHandle_t h, int n, float *const A[], int lda, int *P, int *info, int batch) {
+    return cublasSgetrfBatched(h, n, A, lda, P, info, batch);
+}
+
+cublasStatus_t getrfBatched(cublasHandle_t h, int n, double *const A[], int lda, int *P, int *info, int batch) {
+    return cublasDgetrfBatched(h, n, A, lda, P, info, batch);
+}
+
+cublasStatus_t getrsBatched(cublasHandle_t h, int n, int nrhs, const float *const A[], int lda, const int *P,
+                            float *const B[], int ldb, int *info, int batch) {
+    return cublasSgetrsBatched(h, CUBLAS_OP_N, n, nrhs, A, lda, P, B, ldb, info, batch);
+}
+
+cublasStatus_t getrsBatched(cublasHandle_t h, int n, int nrhs, const double *const A[], int lda, const int *P,
+                            double *const B[], int ldb, int *info, int batch) {
+    return cublasDgetrsBatched(h, CUBLAS_OP_N, n, nrhs, A, lda, P, B, ldb, info, batch);
+}
+
+template <typename T> T one();
+template <> float one<float>() { return 1.0f; }
+template <> double one<double>() { return 1.0; }
+template <> cuComplex one<cuComplex>() { return make_cuComplex(1.0f, 0.0f); }
+template <> cuDoubleComplex one<cuDoubleComplex>() { return make_cuDoubleComplex(1.0, 0.0); }
+
+template <typename T> T zero();
+template <> float zero<float>() { return 0.0f; }
+template <> double zero<double>() { return 0.0; }
+template <> cuComplex zero<cuComplex>() { return make_cuComplex(0.0f, 0.0f); }
+template <> cuDoubleComplex zero<cuDoubleComplex>() { return make_cuDoubleComplex(0.0, 0.0); }
+
+// The layout of a matrix view: 0 when it is row-major, 1 when it is the transpose of a row-major matrix, and -1
+// when it has neither layout
+int layout(const bh_view &view) {
+    const int64_t m = view.shape[0], n = view.shape[1];
+    const int64_t s0 = view.stride[0], s1 = view.stride[1];
+    if ((n == 1 or s1 == 1) and (m == 1 or s0 >= std::max<int64_t>(1, n))) {
+        return 0;
+    } else if ((m == 1 or s0 == 1) and (n == 1 or s1 >= std::max<int64_t>(1, m))) {
+        return 1;
+    }
+    return -1;
+}
+
+// Whether cuBLAS computes with 'type'
+bool supported_type(bh_type type) {
+    return type == bh_type::FLOAT32 or type == bh_type::FLOAT64 or
+           type == bh_type::COMPLEX64 or type == bh_type::COMPLEX128;
+}
+
+// The real floating-point operations of a multiply-add of 'type'
+double madd_flops(bh_type type) {
+    return bh_type_is_complex(type) ? 8 : 2;
+}
+
+// The layout of a matrix view in its device buffer: whether it is the transpose of a row-major matrix, and its
+// leading dimension. Unlike the BLAS extmethod, a view without such a layout isn't copied but rejected.
+struct Matrix {
+    CUdeviceptr data;
+    bool trans = false;
+    int ld;
+
+    Matrix(EngineCUDA &engine, const bh_view &view) {
+        const int64_t m = view.shape[0], n = view.shape[1];
+        switch (layout(view)) {
+            case 0:
+                ld = static_cast<int>(m == 1 ? std::max<int64_t>(1, n) : view.stride[0]);
+                break;
+            case 1:
+                trans = true;
+                ld = static_cast<int>(n == 1 ? std::max<int64_t>(1, m) : view.stride[1]);
+                break;
+            default:
+                throw runtime_error("[cuBLAS] the matrices must have a unit stride in one of the dimensions");
+        }
+        bh_base *base = view.base;
+        data = *engine.getBuffer(base) + view.start * bh_type_size(base->type);
+    }
+};
+
+/* The matrix product 'C = op(A) * B' where 'op' transposes A when 'trans_a' is set (gemmt).
+ * The kernels and cuBLAS both run on the default stream thus neither the engine nor the host waits for the call.
+ * cuBLAS is column-major, which views a row-major matrix as its transpose, thus the call computes
+ * 'C^T = B^T * op(A)^T' where a transposed view swaps the operation instead.
+ */
+class Impl : public ExtmethodImpl {
+private:
+    const bool _trans_a;
+    cublasHandle_t _handle = NULL;
+
+    template <typename T>
+    void gemm_call(EngineCUDA &engine, const bh_view &C, const bh_view &A, const bh_view &B) {
+        const int m = static_cast<int>(C.shape[0]);
+        const int n = static_cast<int>(C.shape[1]);
+        const int k = static_cast<int>(_trans_a ? A.shape[0] : A.shape[1]);
+        if ((_trans_a ? A.shape[1] : A.shape[0]) != m or B.shape[0] != k or B.shape[1] != n) {
+            throw runtime_error("[cuBLAS] the shapes of the matrices don't match");
+        }
+        Matrix a(engine, A), b(engine, B), c(engine, C);
+        if (c.trans) {
+            throw runtime_error("[cuBLAS] the output matrix must be row-major");
+        }
+        const cublasOperation_t op_a = a.trans != _trans_a ? CUBLAS_OP_T : CUBLAS_OP_N;
+        const cublasOperation_t op_b = b.trans ? CUBLAS_OP_T : CUBLAS_OP_N;
+        const T alpha = one<T>(), beta = zero<T>();
+        checkCublas(gemm(_handle, op_b, op_a, n, m, k, &alpha, reinterpret_cast<const T *>(b.data), b.ld,
+                         reinterpret_cast<const T *>(a.data), a.ld, &beta, reinterpret_cast<T *>(c.data), c.ld),
+                    "gemm");
+    }
+
+public:
+    explicit Impl(bool trans_a) : _trans_a(trans_a) {}
+
+    Cost cost(const bh_instruction &instr) const {
+        const bh_view &C = instr.operand[0];
+        const bh_view &A = instr.operand[1];
+        const double m = C.shape[0], n = C.shape[1], k = _trans_a ? A.shape[0] : A.shape[1];
+        const bh_type type = A.base->type;
+        return Cost{madd_flops(type) * m * n * k, (m * k + k * n + m * n) * bh_type_size(type)};
+    }
+
+    bool supports(const bh_instruction &instr) const {
+        const bh_view &C = instr.operand[0];
+        const bh_view &A = instr.operand[1];
+        const bh_view &B = instr.operand[2];
+        return A.ndim == 2 and B.ndim == 2 and C.ndim == 2 and supported_type(A.base->type) and
+               A.base->type == B.base->type and A.base->type == C.base->type and
+               layout(A) >= 0 and layout(B) >= 0 and layout(C) == 0;
+    }
+
+    ~Impl() {
+        if (_handle != NULL) {
+            cublasDestroy(_handle);
+        }
+    }
+
+    void execute(bh_instruction *instr, void* arg) {
+        EngineCUDA *engine = static_cast<EngineCUDA *>(arg);
+        // The handle is created at the first call where the context of the engine is current
+        if (_handle == NULL) {
+            checkCublas(cublasCreate(&_handle), "cublasCreate");
+        }
+        const bh_view &C = instr->operand[0];
+        const bh_view &A = instr->operand[1];
+        const bh_view &B = instr->operand[2];
+        if (A.ndim != 2 or B.ndim != 2 or C.ndim != 2) {
+            throw runtime_error("[cuBLAS] the operands must be matrices");
+        }
+        if (A.base->type != B.base->type or A.base->type != C.base->type) {
+            throw runtime_error("[cuBLAS] the matrices must have the same type");
+        }
+        switch (A.base->type) {
+            case bh_type::FLOAT32:
+                gemm_call<float>(*engine, C, A, B);
+                break;
+            case bh_type::FLOAT64:
+                gemm_call<double>(*engine, C, A, B);
+                break;
+            case bh_type::COMPLEX64:
+                gemm_call<cuComplex>(*engine, C, A, B);
+                break;
+            case bh_type::COMPLEX128:
+                gemm_call<cuDoubleComplex>(*engine, C, A, B);
+                break;
+            default:
+                throw runtime_error("[cuBLAS] unsupported type");
+        }
+    }
+};
+/* The LAPACK 'gesv' of the column-major A and B of the CPU driver, where a 3-D A is a stack of independent systems.
+ * The stack is solved by the batched LU factorization and solve of cuBLAS, whose pointer arrays, pivots,
+ * and infos are kept in a device buffer that the calls reuse.
+ */
+class GesvImpl : public ExtmethodImpl {
+private:
+    cublasHandle_t _handle = NULL;
+    CUdeviceptr _scratch = 0;
+    size_t _scratch_bytes = 0;
+
+    template <typename T>
+    void gesv_call(EngineCUDA &engine, const bh_view &A, const bh_view &B, int batch, int n, int nrhs) {
+        bh_base *a_base = A.base, *b_base = B.base;
+        const CUdeviceptr a = *engine.getBuffer(a_base) + A.start * sizeof(T);
+        const CUdeviceptr b = *engine.getBuffer(b_base) + B.start * sizeof(T);
+        vector<CUdeviceptr> ptrs(2 * batch);
+        for (int i = 0; i < batch; ++i) {
+            ptrs[i] = a + static_cast<CUdeviceptr>(i) * n * n * sizeof(T);
+            ptrs[batch + i] = b + static_cast<CUdeviceptr>(i) * n * nrhs * sizeof(T);
+        }
+        const size_t ptr_bytes = ptrs.size() * sizeof(CUdeviceptr);
+        const size_t bytes = ptr_bytes + (static_cast<size_t>(batch) * n + batch) * sizeof(int);
+        if (bytes > _scratch_bytes) {
+            if (_scratch != 0) {
+                checkCudaErrors(cuMemFree(_scratch));
+            }
+            checkCudaErrors(cuMemAlloc(&_scratch, bytes));
+            _scratch_bytes = bytes;
+        }
+        checkCudaErrors(cuMemcpyHtoD(_scratch, ptrs.data(), ptr_bytes));
+        T **a_ptrs = reinterpret_cast<T **>(_scratch);
+        T **b_ptrs = a_ptrs + batch;
+        int *pivots = reinterpret_cast<int *>(_scratch + ptr_bytes);
+        int *infos = pivots + static_cast<size_t>(batch) * n;
+
+        checkCublas(getrfBatched(_handle, n, a_ptrs, n, pivots, infos, batch), "getrfBatched");
+        int info = 0;
+        checkCublas(getrsBatched(_handle, n, nrhs, a_ptrs, n, pivots, b_ptrs, n, &info, batch), "getrsBatched");
+        if (info != 0) {
+            throw runtime_error("[cuBLAS] getrsBatched got the illegal parameter " + to_string(-info));
+        }
+    }
+
+public:
+    // The LU factorization of each system and the solve of its right-hand sides
+    Cost cost(const bh_instruction &instr) const {
+        const bh_view &A = instr.operand[1];
+        const bh_view &B = instr.operand[2];
+        const bool batched = A.ndim == 3;
+        const double batch = batched ? A.shape[0] : 1;
+        const double n = B.shape[batched];
+        const double nrhs = B.ndim == 1 + batched ? 1 : B.shape[1 + batched];
+        return Cost{batch * (2.0 / 3.0 * n * n * n + 2 * n * n * nrhs),
+                    batch * (n * n + 2 * n * nrhs) * bh_type_size(A.base->type)};
+    }
+
+    bool supports(const bh_instruction &instr) const {
+        const bh_view &A = instr.operand[1];
+        const bh_view &B = instr.operand[2];
+        return bh_is_contiguous(&A) and bh_is_contiguous(&B) and A.base->type == B.base->type and
+               (A.base->type == bh_type::FLOAT32 or A.base->type == bh_type::FLOAT64);
+    }
+
+    ~GesvImpl() {
+        if (_scratch != 0) {
+            cuMemFree(_scratch);
+        }
+        if (_handle != NULL) {
+            cublasDestroy(_handle);
+        }
+    }
+
+    void execute(bh_instruction *instr, void* arg) {
+        EngineCUDA *engine = static_cast<EngineCUDA *>(arg);
+        if (_handle == NULL) {
+            checkCublas(cublasCreate(&_handle), "cublasCreate");
+        }
+        const bh_view &A = instr->operand[1];
+        const bh_view &B = instr->operand[2];
+        if (not bh_is_contiguous(&A) or not bh_is_contiguous(&B)) {
+            throw runtime_error("[cuBLAS] the matrices of gesv must be contiguous");
+        }
+        if (A.base->type != B.base->type) {
+            throw runtime_error("[cuBLAS] the matrices of gesv must have the same type");
+        }
+        const bool batched = A.ndim == 3;
+        const int batch = batched ? static_cast<int>(A.shape[0]) : 1;
+        const int n = static_cast<int>(B.shape[batched]);
+        const int nrhs = B.ndim == 1 + batched ? 1 : static_cast<int>(B.shape[1 + batched]);
+        if (batch == 0 or n == 0) {
+            return;
+        }
+        switch (A.base->type) {
+            case bh_type::FLOAT32:
+                gesv_call<float>(*engine, A, B, batch, n, nrhs);
+                break;
+            case bh_type::FLOAT64:
+                gesv_call<double>(*engine, A, B, batch, n, nrhs);
+                break;
+            default:
+                throw runtime_error("[cuBLAS] unsupported type of gesv");
+        }
+    }
+};
+} // Unnamed namespace
+
+/* Not 'cublas_gemm_create' because we want to override the method from BLAS */
+extern "C" ExtmethodImpl* blas_gemm_create() {
+    return new Impl(false);
+}
+extern "C" void blas_gemm_destroy(ExtmethodImpl* self) {
+    delete self;
+}
+
+extern "C" ExtmethodImpl* blas_gemmt_create() {
+    return new Impl(true);
+}
+extern "C" void blas_gemmt_destroy(ExtmethodImpl* self) {
+    delete self;
+}
+
+/* Overrides the LAPACK driver */
+extern "C" ExtmethodImpl* lapack_gesv_create() {
+    return new GesvImpl();
+}
+extern "C" void lapack_gesv_destroy(ExtmethodImpl* self) {
+    delete self;
+}
@@ -0,0 +1,145 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdexcept>
+#include <string>
+#include <cmath>
+#include <map>
+#include <tuple>
+#include <vector>
+
+#include <bh_extmethod.hpp>
+#include "../ve/cuda/engine_cuda.hpp"
+
+#include <cufft.h>
+
+using namespace bohrium;
+using namespace extmethod;
+using namespace std;
+
+namespace {
+
+void checkCufft(cufftResult result, const char *call) {
+    if (result != CUFFT_SUCCESS) {
+        throw runtime_error(string("[cuFFT] ") + call + " failed with result " + to_string(static_cast<int>(result)));
+    }
+}
+
+// The plans are specific to the shape and the type of the arrays, but not to their buffers nor the direction
+struct PlanKey {
+    vector<int> shape;
+    bh_type type;
+
+    bool operator<(const PlanKey &other) const {
+        return tie(shape, type) < tie(other.shape, other.type);
+    }
+};
+
+/* The FFT of all dimensions of contiguous complex arrays in the device buffers of the CUDA engine, which
+ * overrides the FFTW method. The kernels and cuFFT both run on the default stream thus neither the engine
+ * nor the host waits for the call.
+ */
+class Impl : public ExtmethodImpl {
+private:
+    map<PlanKey, cufftHandle> _plans;
+
+public:
+    ~Impl() {
+        for (auto &p: _plans) {
+            cufftDestroy(p.second);
+        }
+    }
+
+    // The '5 N log2(N)' operations of a complex FFT of N elements
+    Cost cost(const bh_instruction &instr) const {
+        const bh_view &out = instr.operand[0];
+        const double nelem = static_cast<double>(bh_nelements(out));
+        return Cost{nelem > 1 ? 5 * nelem * std::log2(nelem) : 0, 2 * nelem * bh_type_size(out.base->type)};
+    }
+
+    bool supports(const bh_instruction &instr) const {
+        const bh_view &out = instr.operand[0];
+        const bh_view &in = instr.operand[1];
+        if (in.base->type != out.base->type or
+            (in.base->type != bh_type::COMPLEX64 and in.base->type != bh_type::COMPLEX128)) {
+            return false;
+        }
+        if (in.ndim != out.ndim or in.ndim > 3) {
+            return false;
+        }
+        for (int64_t d = 0; d < in.ndim; ++d) {
+            if (in.shape[d] != out.shape[d]) {
+                return false;
+            }
+        }
+        return bh_is_contiguous(&in) and bh_is_contiguous(&out);
+    }
+
+    void execute(bh_instruction *instr, void* arg) {
+        EngineCUDA *engine = static_cast<EngineCUDA *>(arg);
+        bh_view *out  = &instr->operand[0];
+        bh_view *in   = &instr->operand[1];
+        bh_base *args = instr->operand[2].base;
+        if (args->nelem != 1 or args->type != bh_type::INT32) {
+            throw runtime_error("[cuFFT] the argument must be the sign of the transform");
+        }
+        if (not supports(*instr)) {
+            throw runtime_error("[cuFFT] the arrays must be contiguous and have the same complex type and shape "
+                                "of up to three dimensions");
+        }
+
+        // The sign might have been computed by a kernel
+        std::vector<bh_base *> arg_bases = {args};
+        engine->copyToHost(arg_bases);
+        const int sign = static_cast<bh_int32 *>(args->data)[0] < 0 ? CUFFT_FORWARD : CUFFT_INVERSE;
+
+        PlanKey key;
+        key.shape.assign(in->shape, in->shape + in->ndim);
+        key.type = in->base->type;
+        auto it = _plans.find(key);
+        if (it == _plans.end()) {
+            cufftHandle plan;
+            const cufftType type = key.type == bh_type::COMPLEX64 ? CUFFT_C2C : CUFFT_Z2Z;
+            checkCufft(cufftPlanMany(&plan, static_cast<int>(key.shape.size()), key.shape.data(),
+                                     NULL, 1, 0, NULL, 1, 0, type, 1), "cufftPlanMany");
+            it = _plans.insert(make_pair(key, plan)).first;
+        }
+
+        bh_base *in_base = in->base, *out_base = out->base;
+        const size_t elem = bh_type_size(key.type);
+        CUdeviceptr i = *engine->getBuffer(in_base) + in->start * elem;
+        CUdeviceptr o = *engine->getBuffer(out_base) + out->start * elem;
+        if (key.type == bh_type::COMPLEX64) {
+            checkCufft(cufftExecC2C(it->second, reinterpret_cast<cufftComplex *>(i),
+                                    reinterpret_cast<cufftComplex *>(o), sign), "cufftExecC2C");
+        } else {
+            checkCufft(cufftExecZ2Z(it->second, reinterpret_cast<cufftDoubleComplex *>(i),
+                                    reinterpret_cast<cufftDoubleComplex *>(o), sign), "cufftExecZ2Z");
+        }
+    }
+};
+} // Unnamed namespace
+
+/* Not 'cufft_create' because we want to override the method from FFTW */
+extern "C" ExtmethodImpl* fftw_create() {
+    return new Impl();
+}
+extern "C" void fftw_destroy(ExtmethodImpl* self) {
+    delete self;
+}
@@ -19,6 +19,11 @@ If not, see <http://www.gnu.org/licenses/>.
 */
 #include <stdexcept>
 #include <cassert>
+#include <cstdlib>
+#include <algorithm>
+#include <map>
+#include <tuple>
+#include <vector>
 #include <fftw3.h>
 #if defined(_OPENMP)
 #include <omp.h>
@@ -35,8 +40,116 @@ using namespace extmethod;
 using namespace std;
 
 namespace {
+
+// The plans are specific to the layout of the arrays, the direction, the alignment, and the number of threads
+struct PlanKey {
+    vector<int64_t> shape, in_stride, out_stride;
+    int sign;
+    bh_type type;
+    int in_align, out_align;
+    bool in_place;
+    int nthreads;
+
+    bool operator<(const PlanKey &other) const {
+        return tie(shape, in_stride, out_stride, sign, type, in_align, out_align, in_place, nthreads) <
+               tie(other.shape, other.in_stride, other.out_stride, other.sign, other.type, other.in_align,
+                   other.out_align, other.in_place, other.nthreads);
+    }
+};
+
+struct CachedPlan {
+    fftw_plan plan;
+    // Whether the plan is made with the configured planner rigor
+    bool tuned;
+    uint64_t calls;
+};
+
+// Returns the planner flag of the name of the 'planner' option
+unsigned planner_flag(const string &name) {
+    if (name == "estimate") {
+        return FFTW_ESTIMATE;
+    } else if (name == "measure") {
+        return FFTW_MEASURE;
+    } else if (name == "patient") {
+        return FFTW_PATIENT;
+    } else if (name == "exhaustive") {
+        return FFTW_EXHAUSTIVE;
+    }
+    throw runtime_error("[FFTW] unknown planner '" + name + "'");
+}
+
 class Impl : public ExtmethodImpl {
+    // The plans of the arrays seen so far
+    map<PlanKey, CachedPlan> _plans;
+    // The rigor of the plans of repeated FFTs and the number of calls of a key before we plan with it
+    unsigned _planner;
+    uint64_t _tune_after;
+    // The file to import the wisdom from and export it to (empty means none)
+    string _wisdom_file;
+    // Whether we made a tuned plan, which the wisdom file doesn't have yet
+    bool _new_wisdom = false;
+
+    // Makes a plan of the layout of 'in' and 'out', where the planners besides FFTW_ESTIMATE overwrite the arrays
+    // thus they plan on scratch arrays of the same extent and alignment
+    fftw_plan make_plan(const bh_view &in, const bh_view &out, fftw_complex *i, fftw_complex *o, int sign,
+                        unsigned flag) {
+        vector<fftw_iodim64> dims(in.ndim);
+        // The lowest and highest element offset of both views
+        int64_t in_lo = 0, in_hi = 0, out_lo = 0, out_hi = 0;
+        for(int64_t d=0; d<in.ndim; ++d)
+        {
+            dims[d].n = in.shape[d];
+            dims[d].is = in.stride[d];
+            dims[d].os = out.stride[d];
+            (in.stride[d] < 0 ? in_lo : in_hi) += (in.shape[d] - 1) * in.stride[d];
+            (out.stride[d] < 0 ? out_lo : out_hi) += (out.shape[d] - 1) * out.stride[d];
+        }
+        const int64_t lo = std::min(in_lo, out_lo), hi = std::max(in_hi, out_hi);
+        if (flag == FFTW_ESTIMATE) {
+            return fftw_plan_guru64_dft(in.ndim, dims.data(), 0, NULL, i, o, sign, FFTW_ESTIMATE);
+        }
+        constexpr size_t max_align = 64;
+        const size_t nelem = static_cast<size_t>(hi - lo + 1);
+        char *scratch = static_cast<char *>(fftw_malloc((i == o ? 1 : 2) * nelem * sizeof(fftw_complex) + 2 * max_align));
+        if (scratch == NULL) {
+            throw runtime_error("[FFTW] out of memory");
+        }
+        // We offset the scratch arrays to the alignment of the arrays, which the new-array execution requires
+        fftw_complex *si = reinterpret_cast<fftw_complex *>(scratch + fftw_alignment_of(reinterpret_cast<double *>(i))) - lo;
+        fftw_complex *so = si;
+        if (i != o) {
+            char *scratch_out = scratch + nelem * sizeof(fftw_complex) + max_align;
+            so = reinterpret_cast<fftw_complex *>(scratch_out + fftw_alignment_of(reinterpret_cast<double *>(o))) - lo;
+        }
+        fftw_plan ret = fftw_plan_guru64_dft(in.ndim, dims.data(), 0, NULL, si, so, sign, flag);
+        fftw_free(scratch);
+        return ret;
+    }
+
 public:
+    Impl() {
+        const ConfigParser config(-1);
+        _planner = planner_flag(config.defaultGet<string>("fftw", "planner", "measure"));
+        _tune_after = config.defaultGet<uint64_t>("fftw", "tune_after", 2);
+        _wisdom_file = config.defaultGet<string>("fftw", "wisdom_file", "");
+        fftw_init_threads();
+        if (not _wisdom_file.empty()) {
+            // NB: a missing wisdom file is fine, we write it at exit
+            fftw_import_wisdom_from_filename(_wisdom_file.c_str());
+        }
+    }
+
+    ~Impl() {
+        if (_new_wisdom and not _wisdom_file.empty()) {
+            fftw_export_wisdom_to_filename(_wisdom_file.c_str());
+        }
+        for(auto &p: _plans)
+        {
+            fftw_destroy_plan(p.second.plan);
+        }
+        fftw_cleanup_threads();
+    }
+
     void execute(bh_instruction *instr, void* arg) {
         bh_view *out  = &instr->operand[0];
         bh_view *in   = &instr->operand[1];
@@ -44,8 +157,8 @@ public:
         assert(args != NULL);
         assert(instr->operand[2].base->nelem == 1);
         assert(in->ndim == out->ndim);
-        assert(out->base->type == BH_COMPLEX128);
-        assert(in->base->type == BH_COMPLEX128);
+        assert(out->base->type == bh_type::COMPLEX128);
+        assert(in->base->type == bh_type::COMPLEX128);
 
         int sign = args[0];
 
@@ -53,27 +166,46 @@ public:
         bh_data_malloc(out->base);
         bh_data_malloc(in->base);
 
-        fftw_complex *i = (fftw_complex*) in->base->data;
-        fftw_complex *o = (fftw_complex*) out->base->data;
+        fftw_complex *i = (fftw_complex*) in->base->data + in->start;
+        fftw_complex *o = (fftw_complex*) out->base->data + out->start;
 
-        //Convert shape to int
-        int shape[BH_MAXDIM];
-        for(int i=0; i<in->ndim; ++i)
+        PlanKey key;
+        key.shape.assign(in->shape, in->shape + in->ndim);
+        key.in_stride.assign(in->stride, in->stride + in->ndim);
+        key.out_stride.assign(out->stride, out->stride + out->ndim);
+        for(int64_t d=0; d<in->ndim; ++d)
         {
-            shape[i] = in->shape[i];
-            assert(shape[i] == out->shape[i]);
+            assert(in->shape[d] == out->shape[d]);
         }
+        key.sign = sign;
+        key.type = in->base->type;
+        key.in_align = fftw_alignment_of(reinterpret_cast<double *>(i));
+        key.out_align = fftw_alignment_of(reinterpret_cast<double *>(o));
+        key.in_place = i == o;
+        key.nthreads = omp_get_max_threads();
+        fftw_plan_with_nthreads(key.nthreads);
 
-        fftw_init_threads();
-        fftw_plan_with_nthreads(omp_get_max_threads());
-
-        fftw_plan p = fftw_plan_dft(in->ndim, shape, i, o, sign, FFTW_ESTIMATE);
-        if(p == NULL)
-            throw runtime_error("fftw plan fail!");
-
-        fftw_execute(p);
-        fftw_destroy_plan(p);
-        fftw_cleanup_threads();
+        // The first calls of a key use an estimated plan and the repeated ones a tuned plan
+        auto it = _plans.find(key);
+        if (it == _plans.end()) {
+            const bool tune = _planner == FFTW_ESTIMATE or _tune_after <= 1;
+            fftw_plan p = make_plan(*in, *out, i, o, sign, tune ? _planner : FFTW_ESTIMATE);
+            if(p == NULL)
+                throw runtime_error("fftw plan fail!");
+            it = _plans.insert(make_pair(key, CachedPlan{p, tune, 0})).first;
+            _new_wisdom |= tune and _planner != FFTW_ESTIMATE;
+        }
+        CachedPlan &cached = it->second;
+        if (not cached.tuned and ++cached.calls >= _tune_after) {
+            fftw_plan p = make_plan(*in, *out, i, o, sign, _planner);
+            if (p != NULL) {
+                fftw_destroy_plan(cached.plan);
+                cached.plan = p;
+                _new_wisdom = true;
+            }
+            cached.tuned = true;
+        }
+        fftw_execute_dft(cached.plan, i, o);
     }
 };
 } // Unnamed namespace
@@ -0,0 +1,110 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include <bh_extmethod.hpp>
+
+namespace bohrium {
+namespace interop {
+
+/* The sharing of device buffers with other frameworks, e.g. through DLPack, without copies:
+ *   device_export: operand[0] is an uint64 array of three elements that gets the address of the buffer (a
+ *                  CUdeviceptr or a cl_mem), the DLPack device type, and the device id, and operand[1] is the array
+ *   device_import: operand[0] is the array that adopts the buffer and operand[1] is an uint64 array of the address
+ * The arrays must be the contiguous views of their entire base. Unused operands may repeat the others.
+ */
+
+// The DLPack device types
+enum DeviceType : uint64_t { DL_CPU = 1, DL_CUDA = 2, DL_OPENCL = 4 };
+
+// The address of a buffer, which is a handle (cl_mem) or an integer (CUdeviceptr), as an uint64 and back
+inline uint64_t to_uint64(const void *handle) { return reinterpret_cast<uintptr_t>(handle); }
+inline uint64_t to_uint64(unsigned long long address) { return address; }
+template <typename Address>
+typename std::enable_if<std::is_pointer<Address>::value, Address>::type from_uint64(uint64_t address) {
+    return reinterpret_cast<Address>(static_cast<uintptr_t>(address));
+}
+template <typename Address>
+typename std::enable_if<not std::is_pointer<Address>::value, Address>::type from_uint64(uint64_t address) {
+    return static_cast<Address>(address);
+}
+
+// Throws when 'view' isn't the contiguous view of its entire base
+inline void check_whole(const bh_view &view) {
+    if (view.start != 0 or not bh_is_contiguous(&view) or bh_nelements(view) != view.base->nelem) {
+        throw std::runtime_error("[interop] the array must be the contiguous view of its entire base");
+    }
+}
+
+// Throws when 'view' isn't an uint64 array of 'nelem' elements
+inline void check_args(const bh_view &view, int64_t nelem) {
+    if (view.base->type != bh_type::UINT64 or view.base->nelem != nelem) {
+        throw std::runtime_error("[interop] the arguments must be an uint64 array of " + std::to_string(nelem) +
+                                 " elements");
+    }
+}
+
+template <typename Engine, DeviceType device_type>
+class ExportImpl : public extmethod::ExtmethodImpl {
+public:
+    void execute(bh_instruction *instr, void *arg) override {
+        Engine &engine = *static_cast<Engine *>(arg);
+        const bh_view &ary = instr->operand[1];
+        bh_base *out = instr->operand[0].base;
+        check_whole(ary);
+        check_args(instr->operand[0], 3);
+        const uint64_t address = to_uint64(engine.exportBuffer(ary.base));
+        // The result is written on the host
+        engine.delBuffer(out);
+        bh_data_malloc(out);
+        uint64_t *data = static_cast<uint64_t *>(out->data);
+        data[0] = address;
+        data[1] = device_type;
+        data[2] = 0;
+    }
+};
+
+template <typename Engine, typename Address>
+class ImportImpl : public extmethod::ExtmethodImpl {
+public:
+    void execute(bh_instruction *instr, void *arg) override {
+        Engine &engine = *static_cast<Engine *>(arg);
+        const bh_view &ary = instr->operand[0];
+        const bh_view &args = instr->operand[1];
+        check_whole(ary);
+        check_args(args, 1);
+        std::vector<bh_base *> bases = {args.base};
+        engine.copyToHost(bases);
+        if (args.base->data == nullptr) {
+            throw std::runtime_error("[interop] the address has no data");
+        }
+        const uint64_t address = *static_cast<const uint64_t *>(args.base->data);
+        engine.importBuffer(ary.base, from_uint64<Address>(address));
+    }
+};
+
+} // interop
+} // bohrium
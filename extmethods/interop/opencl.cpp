@@ -0,0 +1,39 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "interop.hpp"
+#include "../ve/opencl/engine_opencl.hpp"
+
+using namespace bohrium;
+using namespace extmethod;
+
+extern "C" ExtmethodImpl* device_export_create() {
+    return new interop::ExportImpl<EngineOpenCL, interop::DL_OPENCL>();
+}
+extern "C" void device_export_destroy(ExtmethodImpl* self) {
+    delete self;
+}
+
+extern "C" ExtmethodImpl* device_import_create() {
+    return new interop::ImportImpl<EngineOpenCL, cl_mem>();
+}
+extern "C" void device_import_destroy(ExtmethodImpl* self) {
+    delete self;
+}
@@ -11,9 +11,15 @@ public:
 
         void *B_data = B->base->data;
 
-        int n    = B->shape[0];
-        int nrhs = B->ndim == 1 ? 1 : B->shape[1];
+        // A 3-D A is a stack of independent systems, whose B has the same leading dimension, and which are
+        // solved in parallel
+        const bool batched = <!--(if if_A)-->instr->operand[1].ndim == 3<!--(else)-->false<!--(end)-->;
+        const int64_t batch = batched ? B->shape[0] : 1;
+
+        int n    = B->shape[batched];
+        int nrhs = B->ndim == 1 + batched ? 1 : B->shape[1 + batched];
         int ldb  = n;
+        const int64_t B_step = static_cast<int64_t>(n) * nrhs;
 
         <!--(if if_A)-->
             // A is a n-by-n square matrix
@@ -24,8 +30,10 @@ public:
             void *A_data = A->base->data;
 
             int lda = n;
+            const int64_t A_step = static_cast<int64_t>(n) * n;
 
             assert(A->base->type == B->base->type);
+            assert(not batched or A->shape[0] == batch);
         <!--(end)-->
 
         <!--(if if_AB)-->
@@ -168,13 +176,6 @@ public:
             char uplo = 'U';
         <!--(end)-->
 
-        <!--(if if_ipiv)-->
-            int *ipiv = NULL;
-            ipiv = new int[n];
-        <!--(end)-->
-
-        int info;
-
         switch(B->base->type) {
             @!func!@
             default:
@@ -1,32 +1,37 @@
 case @!utype!@: {
-    LAPACK_FUN(@!t!@@!name!@)(
-        <!--(if if_uplo)--> &uplo, <!--(end)-->
+    #pragma omp parallel for if(batch > 1)
+    for(int64_t i = 0; i < batch; ++i) {
+        <!--(if if_ipiv)--> vector<int> ipiv(n); <!--(end)-->
+        int info;
+        LAPACK_FUN(@!t!@@!name!@)(
+            <!--(if if_uplo)--> &uplo, <!--(end)-->
 
-        &n,
+            &n,
 
-        <!--(if if_klku)-->
-            &kl,
-            &ku,
-        <!--(end)-->
+            <!--(if if_klku)-->
+                &kl,
+                &ku,
+            <!--(end)-->
 
-        &nrhs,
+            &nrhs,
 
-        <!--(if if_A)-->    ((@!type!@*) A_data) + A->start,   <!--(end)-->
-        <!--(if if_AB)-->   ((@!type!@*) AB_data) + AB->start, <!--(end)-->
-        <!--(if if_AP)-->   ((@!type!@*) AP_data) + AP->start, <!--(end)-->
-        <!--(if if_lda)-->  &lda,                              <!--(end)-->
-        <!--(if if_ipiv)--> ipiv,                              <!--(end)-->
+            <!--(if if_A)-->    ((@!type!@*) A_data) + A->start + i * A_step, <!--(end)-->
+            <!--(if if_AB)-->   ((@!type!@*) AB_data) + AB->start, <!--(end)-->
+            <!--(if if_AP)-->   ((@!type!@*) AP_data) + AP->start, <!--(end)-->
+            <!--(if if_lda)-->  &lda,                              <!--(end)-->
+            <!--(if if_ipiv)--> ipiv.data(),                       <!--(end)-->
 
-        <!--(if if_DLDDU)-->
-            (@!type!@*) DL,
-            (@!type!@*) D,
-            (@!type!@*) DU,
-        <!--(end)-->
+            <!--(if if_DLDDU)-->
+                (@!type!@*) DL,
+                (@!type!@*) D,
+                (@!type!@*) DU,
+            <!--(end)-->
 
-        ((@!type!@*) B_data) + B->start,
-        &ldb,
+            ((@!type!@*) B_data) + B->start + i * B_step,
+            &ldb,
 
-        &info
-    );
+            &info
+        );
+    }
     break;
 }
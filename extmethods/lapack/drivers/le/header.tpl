@@ -14,6 +14,7 @@
 
 #include <stdexcept>
 #include <algorithm>
+#include <vector>
 
 using namespace bohrium;
 using namespace extmethod;
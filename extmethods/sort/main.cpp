@@ -0,0 +1,341 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdexcept>
+#include <cassert>
+#include <cstring>
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <type_traits>
+#if defined(_OPENMP)
+#include <omp.h>
+#else
+static inline int omp_get_max_threads() { return 1; }
+static inline int omp_get_thread_num()  { return 0; }
+static inline int omp_get_num_threads() { return 1; }
+#endif
+
+#include <bh_extmethod.hpp>
+
+using namespace bohrium;
+using namespace extmethod;
+using namespace std;
+
+namespace {
+
+// The rows shorter than this are sorted by std::stable_sort rather than the radix sort
+constexpr int64_t radix_threshold = 1 << 10;
+
+// The smallest row that more than one thread sorts
+constexpr int64_t parallel_threshold = 1 << 16;
+
+// The number of bits of each digit of the radix sort
+constexpr int digit_bits = 8;
+constexpr int num_buckets = 1 << digit_bits;
+
+/* The radix key of an element is an unsigned integer that has the same order as the element,
+ * where NaN goes after everything else like in NumPy */
+template<typename T>
+using Key = typename std::conditional<sizeof(T) == 1, uint8_t,
+            typename std::conditional<sizeof(T) == 2, uint16_t,
+            typename std::conditional<sizeof(T) == 4, uint32_t, uint64_t>::type>::type>::type;
+
+template<typename T>
+constexpr Key<T> sign_bit() { return Key<T>(1) << (sizeof(T) * 8 - 1); }
+
+template<typename T>
+typename std::enable_if<std::is_unsigned<T>::value, Key<T> >::type to_key(T v) { return v; }
+template<typename T>
+typename std::enable_if<std::is_unsigned<T>::value, T>::type from_key(Key<T> k) { return k; }
+
+template<typename T>
+typename std::enable_if<std::is_signed<T>::value and std::is_integral<T>::value, Key<T> >::type to_key(T v) {
+    return static_cast<Key<T> >(v) ^ sign_bit<T>();
+}
+template<typename T>
+typename std::enable_if<std::is_signed<T>::value and std::is_integral<T>::value, T>::type from_key(Key<T> k) {
+    return static_cast<T>(k ^ sign_bit<T>());
+}
+
+// The negative floats are flipped and the positive floats get the sign bit thus all NaNs become the largest key
+template<typename T>
+typename std::enable_if<std::is_floating_point<T>::value, Key<T> >::type to_key(T v) {
+    if (v != v) {
+        v = std::numeric_limits<T>::quiet_NaN();
+    }
+    Key<T> k;
+    memcpy(&k, &v, sizeof(T));
+    return (k & sign_bit<T>()) ? ~k : (k | sign_bit<T>());
+}
+template<typename T>
+typename std::enable_if<std::is_floating_point<T>::value, T>::type from_key(Key<T> k) {
+    k = (k & sign_bit<T>()) ? (k ^ sign_bit<T>()) : ~k;
+    T v;
+    memcpy(&v, &k, sizeof(T));
+    return v;
+}
+
+// The digit of 'key' in the pass that starts at bit 'shift'
+template<typename K>
+inline int digit(K key, int shift) {
+    return static_cast<int>((key >> shift) & (num_buckets - 1));
+}
+
+/* Least-significant-digit radix sort of the 'n' keys in 'keys' (and the indexes in 'idx' when not NULL), which
+ * uses the buffers 'keys_tmp' and 'idx_tmp' of the same size. The sort is stable and the result is in 'keys'
+ * and 'idx'. The threads sort a chunk each: they count their digits, the prefix sum over the buckets and threads
+ * gives each thread its own offsets in each bucket, and the threads move their keys there in order.
+ * A pass where all keys have the same digit is skipped.
+ */
+template<typename K>
+void radix_sort(K *keys, K *keys_tmp, int64_t *idx, int64_t *idx_tmp, int64_t n, int nthreads) {
+    vector<int64_t> counts(static_cast<size_t>(nthreads) * num_buckets);
+    K *src = keys, *dst = keys_tmp;
+    int64_t *isrc = idx, *idst = idx_tmp;
+
+    #pragma omp parallel num_threads(nthreads)
+    {
+        const int nthds = omp_get_num_threads();
+        const int t = omp_get_thread_num();
+        const int64_t chunk = (n + nthds - 1) / nthds;
+        const int64_t first = std::min(n, t * chunk), last = std::min(n, first + chunk);
+        int64_t *count = &counts[static_cast<size_t>(t) * num_buckets];
+
+        for (int shift = 0; shift < static_cast<int>(sizeof(K) * 8); shift += digit_bits) {
+            std::fill(count, count + num_buckets, 0);
+            for (int64_t i = first; i < last; ++i) {
+                ++count[digit(src[i], shift)];
+            }
+            bool skip = false;
+            #pragma omp barrier
+            // The prefix sum turns the counts into the offsets of the threads in each bucket
+            #pragma omp single copyprivate(skip)
+            {
+                int64_t offset = 0;
+                for (int b = 0; b < num_buckets; ++b) {
+                    int64_t total = 0;
+                    for (int j = 0; j < nthds; ++j) {
+                        total += counts[static_cast<size_t>(j) * num_buckets + b];
+                    }
+                    if (total == n) {
+                        skip = true;
+                    }
+                    for (int j = 0; j < nthds; ++j) {
+                        int64_t &c = counts[static_cast<size_t>(j) * num_buckets + b];
+                        const int64_t tmp = c;
+                        c = offset;
+                        offset += tmp;
+                    }
+                }
+            }
+            if (not skip) {
+                for (int64_t i = first; i < last; ++i) {
+                    const int64_t o = count[digit(src[i], shift)]++;
+                    dst[o] = src[i];
+                    if (isrc != NULL) {
+                        idst[o] = isrc[i];
+                    }
+                }
+                #pragma omp barrier
+                #pragma omp single
+                {
+                    std::swap(src, dst);
+                    std::swap(isrc, idst);
+                }
+            }
+        }
+    }
+    if (src != keys) {
+        memcpy(keys, src, static_cast<size_t>(n) * sizeof(K));
+        if (idx != NULL) {
+            memcpy(idx, isrc, static_cast<size_t>(n) * sizeof(int64_t));
+        }
+    }
+}
+
+// Sorts the keys (and indexes) of one row
+template<typename K>
+void sort_row(K *keys, K *keys_tmp, int64_t *idx, int64_t *idx_tmp, int64_t n, int nthreads) {
+    if (n >= radix_threshold) {
+        radix_sort(keys, keys_tmp, idx, idx_tmp, n, nthreads);
+    } else if (idx == NULL) {
+        std::sort(keys, keys + n);
+    } else {
+        std::stable_sort(idx, idx + n, [&](int64_t a, int64_t b) { return keys[a] < keys[b]; });
+        for (int64_t i = 0; i < n; ++i) {
+            keys_tmp[i] = keys[idx[i]];
+        }
+        memcpy(keys, keys_tmp, static_cast<size_t>(n) * sizeof(K));
+    }
+}
+
+enum class Method { SORT, ARGSORT, PARTITION };
+
+/* Applies 'method' to each row of 'in', which is the last axis of the 2-D view, and writes the rows of 'out'.
+ * The rows are independent thus many rows are a thread each, and fewer rows than threads are each sorted by
+ * all threads.
+ */
+template<typename T>
+void sort_rows(Method method, const bh_view *in, bh_view *out, int64_t kth) {
+    typedef Key<T> K;
+    const int64_t rows = in->shape[0];
+    const int64_t n = in->shape[1];
+    if (rows == 0 or n == 0) {
+        return;
+    }
+    const T *src = reinterpret_cast<const T *>(in->base->data) + in->start;
+    const int max_threads = omp_get_max_threads();
+    const bool row_threads = rows >= max_threads or n < parallel_threshold;
+    const int outer_threads = rows * n < parallel_threshold ? 1 : (row_threads ? max_threads : 1);
+    const int inner_threads = row_threads ? 1 : max_threads;
+
+    #pragma omp parallel num_threads(outer_threads)
+    {
+        vector<K> keys(static_cast<size_t>(n)), keys_tmp(static_cast<size_t>(n));
+        vector<int64_t> idx, idx_tmp;
+        if (method == Method::ARGSORT) {
+            idx.resize(static_cast<size_t>(n));
+            idx_tmp.resize(static_cast<size_t>(n));
+        }
+        #pragma omp for schedule(static)
+        for (int64_t r = 0; r < rows; ++r) {
+            const T *row = src + r * in->stride[0];
+            for (int64_t i = 0; i < n; ++i) {
+                keys[i] = to_key<T>(row[i * in->stride[1]]);
+            }
+            if (method == Method::ARGSORT) {
+                for (int64_t i = 0; i < n; ++i) {
+                    idx[i] = i;
+                }
+                sort_row(keys.data(), keys_tmp.data(), idx.data(), idx_tmp.data(), n, inner_threads);
+                int64_t *dst = reinterpret_cast<int64_t *>(out->base->data) + out->start + r * out->stride[0];
+                for (int64_t i = 0; i < n; ++i) {
+                    dst[i * out->stride[1]] = idx[i];
+                }
+            } else {
+                if (method == Method::SORT) {
+                    sort_row<K>(keys.data(), keys_tmp.data(), NULL, NULL, n, inner_threads);
+                } else {
+                    std::nth_element(keys.begin(), keys.begin() + kth, keys.end());
+                }
+                T *dst = reinterpret_cast<T *>(out->base->data) + out->start + r * out->stride[0];
+                for (int64_t i = 0; i < n; ++i) {
+                    dst[i * out->stride[1]] = from_key<T>(keys[i]);
+                }
+            }
+        }
+    }
+}
+
+/* The sort extension methods of the rows of the 2-D array 'in', which is operand 1:
+ *   - "sort" writes the sorted rows to 'out' (operand 0)
+ *   - "argsort" writes the int64 indexes that sort the rows (stable) to 'out'
+ *   - "partition" writes the rows to 'out' where the element at index 'kth' is in its sorted position,
+ *     the elements before it are not larger and the elements after it are not smaller. 'kth' is the first
+ *     element of the int64 array in operand 2, which sort and argsort do not use.
+ */
+template<Method method>
+class SortImpl : public ExtmethodImpl {
+public:
+    void execute(bh_instruction *instr, void* arg) {
+        bh_view *out = &instr->operand[0];
+        const bh_view *in = &instr->operand[1];
+        assert(in->ndim == 2 and out->ndim == 2);
+        assert(in->shape[0] == out->shape[0] and in->shape[1] == out->shape[1]);
+        if (method == Method::ARGSORT) {
+            assert(out->base->type == bh_type::INT64);
+        } else {
+            assert(out->base->type == in->base->type);
+        }
+
+        // Make sure that the arrays memory are allocated.
+        bh_data_malloc(in->base);
+        bh_data_malloc(out->base);
+
+        int64_t kth = 0;
+        if (method == Method::PARTITION) {
+            const bh_view *k = &instr->operand[2];
+            assert(k->base->type == bh_type::INT64);
+            bh_data_malloc(k->base);
+            kth = reinterpret_cast<const int64_t *>(k->base->data)[k->start];
+            if (kth < 0 or (in->shape[1] > 0 and kth >= in->shape[1])) {
+                throw runtime_error("partition: kth is out of bounds");
+            }
+        }
+
+        switch(in->base->type) {
+            case bh_type::BOOL:
+                sort_rows<bh_bool>(method, in, out, kth);
+                break;
+            case bh_type::INT8:
+                sort_rows<bh_int8>(method, in, out, kth);
+                break;
+            case bh_type::INT16:
+                sort_rows<bh_int16>(method, in, out, kth);
+                break;
+            case bh_type::INT32:
+                sort_rows<bh_int32>(method, in, out, kth);
+                break;
+            case bh_type::INT64:
+                sort_rows<bh_int64>(method, in, out, kth);
+                break;
+            case bh_type::UINT8:
+                sort_rows<bh_uint8>(method, in, out, kth);
+                break;
+            case bh_type::UINT16:
+                sort_rows<bh_uint16>(method, in, out, kth);
+                break;
+            case bh_type::UINT32:
+                sort_rows<bh_uint32>(method, in, out, kth);
+                break;
+            case bh_type::UINT64:
+                sort_rows<bh_uint64>(method, in, out, kth);
+                break;
+            case bh_type::FLOAT32:
+                sort_rows<bh_float32>(method, in, out, kth);
+                break;
+            case bh_type::FLOAT64:
+                sort_rows<bh_float64>(method, in, out, kth);
+                break;
+            default:
+                throw runtime_error("DTYPE must be a boolean, an integer, float32, or float64");
+        }
+    }
+};
+} // Unnamed namespace
+
+extern "C" ExtmethodImpl* sort_create() {
+    return new SortImpl<Method::SORT>();
+}
+extern "C" void sort_destroy(ExtmethodImpl* self) {
+    delete self;
+}
+extern "C" ExtmethodImpl* argsort_create() {
+    return new SortImpl<Method::ARGSORT>();
+}
+extern "C" void argsort_destroy(ExtmethodImpl* self) {
+    delete self;
+}
+extern "C" ExtmethodImpl* partition_create() {
+    return new SortImpl<Method::PARTITION>();
+}
+extern "C" void partition_destroy(ExtmethodImpl* self) {
+    delete self;
+}
@@ -0,0 +1,88 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <bh_extmethod.hpp>
+
+namespace bohrium {
+namespace storage {
+
+/* The direct file I/O of the arrays of an accelerator engine, which moves the device buffers to and from the files
+ * without leaving the data on the host (see storeFile() and loadFile() of the CUDA and OpenCL engines):
+ *   store_file: operand[0] is an uint64 array of the file descriptor and the file offset, which the extmethod
+ *               doesn't change, and operand[1] is the array to write
+ *   load_file:  operand[0] is the array to read and operand[1] is the uint64 array of the file descriptor and
+ *               the file offset
+ * The arrays must be the contiguous views of their entire base. Unused operands may repeat the others.
+ */
+
+// Returns the file descriptor and the file offset in 'args'
+template <typename Engine>
+std::pair<int, uint64_t> file_args(Engine &engine, const bh_view &args) {
+    if (args.base->type != bh_type::UINT64 or args.base->nelem != 2) {
+        throw std::runtime_error("[storage] the file arguments must be an uint64 array of two elements");
+    }
+    std::vector<bh_base *> bases = {args.base};
+    engine.copyToHost(bases);
+    if (args.base->data == nullptr) {
+        throw std::runtime_error("[storage] the file arguments have no data");
+    }
+    const uint64_t *data = static_cast<const uint64_t *>(args.base->data);
+    return std::make_pair(static_cast<int>(data[0]), data[1]);
+}
+
+// Throws when 'view' isn't the contiguous view of its entire base
+inline void check_whole(const bh_view &view) {
+    if (view.start != 0 or not bh_is_contiguous(&view) or bh_nelements(view) != view.base->nelem) {
+        throw std::runtime_error("[storage] the array must be the contiguous view of its entire base");
+    }
+}
+
+template <typename Engine>
+class StoreImpl : public extmethod::ExtmethodImpl {
+public:
+    void execute(bh_instruction *instr, void *arg) override {
+        Engine &engine = *static_cast<Engine *>(arg);
+        const bh_view &ary = instr->operand[1];
+        check_whole(ary);
+        const std::pair<int, uint64_t> file = file_args(engine, instr->operand[0]);
+        engine.storeFile(ary.base, file.first, file.second);
+    }
+};
+
+template <typename Engine>
+class LoadImpl : public extmethod::ExtmethodImpl {
+public:
+    void execute(bh_instruction *instr, void *arg) override {
+        Engine &engine = *static_cast<Engine *>(arg);
+        const bh_view &ary = instr->operand[0];
+        check_whole(ary);
+        const std::pair<int, uint64_t> file = file_args(engine, instr->operand[1]);
+        engine.loadFile(ary.base, file.first, file.second);
+    }
+};
+
+} // storage
+} // bohrium
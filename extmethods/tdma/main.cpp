@@ -19,6 +19,13 @@ If not, see <http://www.gnu.org/licenses/>.
 */
 #include <stdexcept>
 #include <cassert>
+#include <vector>
+#if defined(_OPENMP)
+#include <omp.h>
+#else
+static inline int omp_get_max_threads() { return 1; }
+static inline int omp_get_thread_num()  { return 0; }
+#endif
 
 #include <bh_extmethod.hpp>
 
@@ -27,50 +34,131 @@ using namespace extmethod;
 using namespace std;
 
 namespace {
+
+// The number of systems that a batch solves at once, which fills a cache line of each row
+template<typename T>
+constexpr int lanes() { return 64 / sizeof(T); }
+
+// The smallest number of elements that is solved by more than one thread
+constexpr int64_t parallel_threshold = 1 << 14;
+
+// The first elements and the element strides of the diagonals, the right-hand side, and the output of the systems
+template<typename T>
+struct Systems {
+    const T *a, *b, *c, *d;
+    T *out;
+    int64_t diag_sys, diag_elem, rhs_sys, rhs_elem, out_sys, out_elem;
+};
+
 class TDMAImpl : public ExtmethodImpl {
 private:
+    // The scratch buffers of the threads, which the calls reuse
+    vector<char> _scratch;
+
+    /* Solves the 'w' systems from system 'first' on in the lanes of the 4*n*lanes() elements of 'scratch'.
+     * The systems are interleaved thus each step of the Thomas algorithm
+     * (see https://en.wikipedia.org/wiki/Tridiagonal_matrix_algorithm) is a vector operation over the lanes.
+     * The unused lanes of the last batch solve the identity.
+     */
     template<typename T>
-    void tdma(const T* a, const T* b, const T* c, const T* d, T* c_prime, T* d_prime, const int n) const
+    void tdma_batch(const Systems<T> &s, int64_t first, int w, int64_t n, T *scratch) const
     {
-      // See https://en.wikipedia.org/wiki/Tridiagonal_matrix_algorithm
-      c_prime[0] = c[0] / b[0];
-      d_prime[0] = d[0] / b[0];
-      for(int i=1; i < n; ++i)
+      const int L = lanes<T>();
+      T *A = scratch, *B = A + n * L, *C = B + n * L, *D = C + n * L;
+      for(int j=0; j < w; ++j)
+      {
+          const int64_t diag = (first + j) * s.diag_sys, rhs = (first + j) * s.rhs_sys;
+          for(int64_t i=0; i < n; ++i)
+          {
+              A[i*L+j] = s.a[diag + i * s.diag_elem];
+              B[i*L+j] = s.b[diag + i * s.diag_elem];
+              C[i*L+j] = s.c[diag + i * s.diag_elem];
+              D[i*L+j] = s.d[rhs + i * s.rhs_elem];
+          }
+      }
+      for(int j=w; j < L; ++j)
+      {
+          for(int64_t i=0; i < n; ++i)
+          {
+              A[i*L+j] = 0; B[i*L+j] = 1; C[i*L+j] = 0; D[i*L+j] = 0;
+          }
+      }
+
+      #pragma omp simd
+      for(int j=0; j < L; ++j)
+      {
+          C[j] /= B[j];
+          D[j] /= B[j];
+      }
+      for(int64_t i=1; i < n; ++i)
       {
-          const T m = 1. / (b[i] - a[i] * c_prime[i-1]);
-          c_prime[i] = c[i] * m;
-          d_prime[i] = (d[i] - a[i] * d_prime[i-1]) * m;
+          T *a = A + i * L, *b = B + i * L, *c = C + i * L, *d = D + i * L;
+          #pragma omp simd
+          for(int j=0; j < L; ++j)
+          {
+              const T m = 1. / (b[j] - a[j] * c[j - L]);
+              c[j] *= m;
+              d[j] = (d[j] - a[j] * d[j - L]) * m;
+          }
       }
-      for(int i=n-2; i > -1; --i)
+      for(int64_t i=n-2; i > -1; --i)
       {
-          d_prime[i] -= c_prime[i] * d_prime[i+1];
+          const T *c = C + i * L;
+          T *d = D + i * L;
+          #pragma omp simd
+          for(int j=0; j < L; ++j)
+          {
+              d[j] -= c[j] * d[j + L];
+          }
+      }
+
+      for(int j=0; j < w; ++j)
+      {
+          const int64_t out = (first + j) * s.out_sys;
+          for(int64_t i=0; i < n; ++i)
+          {
+              s.out[out + i * s.out_elem] = D[i*L+j];
+          }
       }
     }
 
     template<typename T>
-    void tdma_reduce(const bh_view* diagonals, const bh_view* rhs, bh_view* out) const
+    void tdma_reduce(const bh_view* diagonals, const bh_view* rhs, bh_view* out)
     {
-      const int m = rhs->shape[0];
-      const int n = rhs->shape[1];
-      T* tmp = (T*) malloc(n * m * sizeof(T));
-      T *a = (T*) diagonals->base->data + diagonals->start;
-      T *b = (T*) diagonals->base->data + diagonals->start + diagonals->stride[0];
-      T *c = (T*) diagonals->base->data + diagonals->start + 2*diagonals->stride[0];
-      T *r = (T*) rhs->base->data + rhs->start;
-      T *o = (T*) out->base->data + out->start;
-
-      #pragma omp parallel for
-      for(int i=0; i < m; ++i)
+      const int64_t m = rhs->shape[0];
+      const int64_t n = rhs->shape[1];
+      if (m == 0 or n == 0) {
+          return;
+      }
+      const T *diag = (T*) diagonals->base->data + diagonals->start;
+      Systems<T> s;
+      s.a = diag;
+      s.b = diag + diagonals->stride[0];
+      s.c = diag + 2 * diagonals->stride[0];
+      s.d = (T*) rhs->base->data + rhs->start;
+      s.out = (T*) out->base->data + out->start;
+      s.diag_sys = diagonals->stride[1];
+      s.diag_elem = diagonals->stride[2];
+      s.rhs_sys = rhs->stride[0];
+      s.rhs_elem = rhs->stride[1];
+      s.out_sys = out->stride[0];
+      s.out_elem = out->stride[1];
+
+      const int L = lanes<T>();
+      const int64_t nbatches = (m + L - 1) / L;
+      const int nthreads = m * n < parallel_threshold ? 1 : static_cast<int>(min<int64_t>(omp_get_max_threads(), nbatches));
+      const int64_t scratch_elems = 4 * n * L;
+      if (_scratch.size() < nthreads * scratch_elems * sizeof(T)) {
+          _scratch.resize(nthreads * scratch_elems * sizeof(T));
+      }
+      T *scratch = reinterpret_cast<T*>(_scratch.data());
+
+      #pragma omp parallel for schedule(static) num_threads(nthreads)
+      for(int64_t i=0; i < nbatches; ++i)
       {
-          tdma(a + i * diagonals->stride[1],
-               b + i * diagonals->stride[1],
-               c + i * diagonals->stride[1],
-               r + i * rhs->stride[0],
-               tmp + i * n,
-               o + i * out->stride[0],
-               n);
+          const int w = static_cast<int>(min<int64_t>(L, m - i * L));
+          tdma_batch(s, i * L, w, n, scratch + omp_get_thread_num() * scratch_elems);
       }
-      free(tmp);
     }
 
 public:
@@ -0,0 +1,110 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as 
+published by the Free Software Foundation, either version 3 
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the 
+GNU Lesser General Public License along with Bohrium. 
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "interop.hpp"
+
+#ifdef VISUALIZER_CUDA
+
+#include <cstring>
+#include <map>
+#include <vector>
+
+#include "../ve/cuda/engine_cuda.hpp"
+#include <cudaGL.h>
+
+using namespace bohrium;
+
+namespace {
+// The pixel buffers that are registered with CUDA
+std::map<unsigned int, CUgraphicsResource> resources;
+}
+
+bool interop_copy(void *engine, const bh_view *view, int step, int rows, int cols, unsigned int pbo)
+{
+    if (view->base->type != bh_type::FLOAT32 or view->stride[1] != 1) {
+        return false;
+    }
+    bh_base *base = view->base;
+    const CUdeviceptr src = *static_cast<EngineCUDA*>(engine)->getBuffer(base) + view->start * sizeof(float);
+
+    auto it = resources.find(pbo);
+    if (it == resources.end()) {
+        CUgraphicsResource resource;
+        if (cuGraphicsGLRegisterBuffer(&resource, pbo, CU_GRAPHICS_REGISTER_FLAGS_WRITE_DISCARD) != CUDA_SUCCESS) {
+            return false;
+        }
+        it = resources.insert(std::make_pair(pbo, resource)).first;
+    }
+    CUgraphicsResource resource = it->second;
+    checkCudaErrors(cuGraphicsMapResources(1, &resource, 0));
+    CUdeviceptr dst;
+    size_t nbytes;
+    checkCudaErrors(cuGraphicsResourceGetMappedPointer(&dst, &nbytes, resource));
+    if (step == 1) {
+        // The rows of the view are copied as a whole
+        CUDA_MEMCPY2D copy;
+        memset(&copy, 0, sizeof(copy));
+        copy.srcMemoryType = CU_MEMORYTYPE_DEVICE;
+        copy.srcDevice = src;
+        copy.srcPitch = view->stride[0] * sizeof(float);
+        copy.dstMemoryType = CU_MEMORYTYPE_DEVICE;
+        copy.dstDevice = dst;
+        copy.dstPitch = cols * sizeof(float);
+        copy.WidthInBytes = cols * sizeof(float);
+        copy.Height = rows;
+        checkCudaErrors(cuMemcpy2D(&copy));
+    } else {
+        // Every sample is a 'row' of one element of a 3-D copy, whose pitch skips 'step' columns and whose
+        // slices skip 'step' rows
+        CUDA_MEMCPY3D copy;
+        memset(&copy, 0, sizeof(copy));
+        copy.srcMemoryType = CU_MEMORYTYPE_DEVICE;
+        copy.srcDevice = src;
+        copy.srcPitch = step * sizeof(float);
+        copy.srcHeight = view->stride[0];
+        copy.dstMemoryType = CU_MEMORYTYPE_DEVICE;
+        copy.dstDevice = dst;
+        copy.dstPitch = sizeof(float);
+        copy.dstHeight = cols;
+        copy.WidthInBytes = sizeof(float);
+        copy.Height = cols;
+        copy.Depth = rows;
+        checkCudaErrors(cuMemcpy3D(&copy));
+    }
+    checkCudaErrors(cuGraphicsUnmapResources(1, &resource, 0));
+    return true;
+}
+
+void interop_sync(void *engine, bh_base *base)
+{
+    std::vector<bh_base*> bases = {base};
+    static_cast<EngineCUDA*>(engine)->copyToHost(bases);
+}
+
+#else
+
+bool interop_copy(void *engine, const bh_view *view, int step, int rows, int cols, unsigned int pbo)
+{
+    return false;
+}
+
+void interop_sync(void *engine, bh_base *base) {}
+
+#endif
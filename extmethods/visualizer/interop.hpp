@@ -0,0 +1,37 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as 
+published by the Free Software Foundation, either version 3 
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the 
+GNU Lesser General Public License along with Bohrium. 
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __VISUALIZER_INTEROP
+#define __VISUALIZER_INTEROP
+
+#include <bh_view.hpp>
+
+// The device path of the visualizer, which the CUDA build (VISUALIZER_CUDA) implements for the CUDA engine 'engine'.
+// The other builds read the host data and ignore the engine.
+
+// Copies every 'step' row and column of the 'rows' x 'cols' samples of the float32 matrix 'view' from the device
+// buffer to the OpenGL pixel buffer 'pbo' without a transfer to the host. Returns false when it can't, in which case
+// the caller reads the samples of the host data instead.
+bool interop_copy(void *engine, const bh_view *view, int step, int rows, int cols, unsigned int pbo);
+
+// Makes the host data of 'base' up to date
+void interop_sync(void *engine, bh_base *base);
+
+#endif
@@ -35,7 +35,10 @@ public:
     void execute(bh_instruction *instr, void* arg) {
         bh_view *subject = &instr->operand[0];
 
-        bh_float32 *args = (bh_float32*) &instr->operand[1].base->data;
+        // The arguments and, at the initialization, the subject are read on the host
+        bh_base *args_base = instr->operand[1].base;
+        interop_sync(arg, args_base);
+        bh_float32 *args = (bh_float32*) args_base->data;
 
         assert(args != NULL);
         assert(instr->operand[1].base->nelem == 5);
@@ -46,9 +49,6 @@ public:
                 throw runtime_error("Cannot visualize because of input shape");
             }
         }
-        if (subject->base->data == NULL) {
-            throw runtime_error("You are trying to visualize non-existing data");
-        }
 
         bh_int32 cm    = static_cast<bh_int32>(args[0]);
         bh_bool flat   = static_cast<bh_bool>(args[1]);
@@ -57,6 +57,10 @@ public:
         bh_float32 max = static_cast<bh_float32>(args[4]);
 
         if (!bh_visualize_initialized) {
+            interop_sync(arg, subject->base);
+            if (subject->base->data == NULL) {
+                throw runtime_error("You are trying to visualize non-existing data");
+            }
             if (subject->ndim == 3) {
                 Visualizer::getInstance().setValues(
                         subject,
@@ -76,7 +80,7 @@ public:
             }
             bh_visualize_initialized = true;
         }
-        Visualizer::getInstance().run(subject);
+        Visualizer::getInstance().run(subject, arg);
     }
 };
 }
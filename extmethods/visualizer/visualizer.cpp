@@ -22,6 +22,8 @@ If not, see <http://www.gnu.org/licenses/>.
 #define XWIDTH 100.0f
 #define ZWIDTH 100.0f
 #define YWIDTH 100.0f
+// The largest number of samples per dimension of the texture of the shader path
+#define MAX_SAMPLES 1024
 
 /*
  *
@@ -67,7 +69,7 @@ Visualizer& Visualizer::getInstance()
     return self;
 }
 
-Visualizer::Visualizer() : fullscreen(false), valid(false)
+Visualizer::Visualizer() : fullscreen(false), valid(false), shaded(false), samples(NULL), engine(NULL)
 {
 
 }
@@ -104,14 +106,16 @@ void Visualizer::setValues(bh_view* _bh, int w, int h, int d, int _cm, bool f, b
         if (!cubes){
             if (flat){
                 computeVertices2D();
-
+                shaded = initShader();
             }
             else{
                 computeVertices3D();
             }
             computeIndices();
-            updateColors();
-            updateNormals();
+            if (!shaded){
+                updateColors();
+                updateNormals();
+            }
         }
         else {
             computeVerticesCube();
@@ -128,6 +132,7 @@ Visualizer::~Visualizer()
   delete[] normals;
   delete[] indices;
   delete[] colors;
+  delete[] samples;
 }
 
 /*
@@ -137,14 +142,27 @@ Visualizer::~Visualizer()
  * This function is the one which refreshed the given scene.
  *
  */
-void Visualizer::run(bh_view* array)
+void Visualizer::run(bh_view* array, void* _engine)
 {
     A = array;
     B = array->base;
+    engine = _engine;
     if (valid)
-    {   if (!cubes)
+    {   // Only the shader path might read the values without the host data
+        if (!shaded)
+        {
+            interop_sync(engine, B);
+            if (B->data == NULL)
+            {
+                cout << "You are trying to visualize non-existing data" << endl;
+                exit(-1);
+            }
+        }
+        if (!cubes)
         {
-            if(flat)
+            if (shaded)
+                updateTexture();
+            else if(flat)
                 updateArray2D();
             else
                 updateArray3D();
@@ -396,6 +414,175 @@ float Visualizer::interpolateColor(float v, const float (* rgb)[3])
     }
     return 0.0f;
 }
+/*
+ *
+ * Shader path
+ *
+ * The values are a float texture of every 'step' row and column of the array,
+ * which the fragment shader maps through the colormap texture.
+ *
+ */
+static const char* vertexSource =
+    "#version 120\n"
+    "varying vec2 uv;\n"
+    "void main() {\n"
+    "    uv = gl_MultiTexCoord0.xy;\n"
+    "    gl_Position = gl_ModelViewProjectionMatrix * gl_Vertex;\n"
+    "}\n";
+
+static const char* fragmentSource =
+    "#version 120\n"
+    "uniform sampler2D values;\n"
+    "uniform sampler1D colormap;\n"
+    "uniform float vmin;\n"
+    "uniform float vmax;\n"
+    "varying vec2 uv;\n"
+    "void main() {\n"
+    "    float v = (texture2D(values, uv).r - vmin) / (vmax - vmin);\n"
+    "    gl_FragColor = texture1D(colormap, clamp(v, 0.0, 1.0));\n"
+    "}\n";
+
+static GLuint compileShader(GLenum kind, const char* source)
+{
+    GLuint shader = glCreateShader(kind);
+    glShaderSource(shader, 1, &source, NULL);
+    glCompileShader(shader);
+    GLint ok = GL_FALSE;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+    if (ok != GL_TRUE)
+    {
+        glDeleteShader(shader);
+        return 0;
+    }
+    return shader;
+}
+
+bool Visualizer::initShader()
+{
+    // The float textures need OpenGL 3.0
+    const char* version = (const char*) glGetString(GL_VERSION);
+    if (version == NULL || atoi(version) < 3 || type != bh_type::FLOAT32)
+        return false;
+
+    GLuint vs = compileShader(GL_VERTEX_SHADER, vertexSource);
+    GLuint fs = compileShader(GL_FRAGMENT_SHADER, fragmentSource);
+    if (vs == 0 || fs == 0)
+        return false;
+    program = glCreateProgram();
+    glAttachShader(program, vs);
+    glAttachShader(program, fs);
+    glLinkProgram(program);
+    glDeleteShader(vs);
+    glDeleteShader(fs);
+    GLint ok = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &ok);
+    if (ok != GL_TRUE)
+    {
+        glDeleteProgram(program);
+        return false;
+    }
+
+    // Large arrays are downsampled before they are read
+    GLint maxSize = MAX_SAMPLES;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+    const int limit = min(MAX_SAMPLES, (int) maxSize);
+    step = 1 + (max(A->shape[0], A->shape[1]) - 1) / limit;
+    texHeight = (A->shape[0] + step - 1) / step;
+    texWidth = (A->shape[1] + step - 1) / step;
+    samples = new float[texWidth*texHeight];
+
+    glGenTextures(1, &valueTexture);
+    glBindTexture(GL_TEXTURE_2D, valueTexture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, texWidth, texHeight, 0, GL_RED, GL_FLOAT, NULL);
+
+    // The colormap is sampled once
+    float rgb[256*3];
+    for (int i = 0; i < 256; i++)
+    {
+        const float v = i / 255.0f;
+        rgb[3*i] = interpolateColor(v, cm.red);
+        rgb[3*i+1] = interpolateColor(v, cm.green);
+        rgb[3*i+2] = interpolateColor(v, cm.blue);
+    }
+    glGenTextures(1, &colormapTexture);
+    glBindTexture(GL_TEXTURE_1D, colormapTexture);
+    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexImage1D(GL_TEXTURE_1D, 0, GL_RGB32F, 256, 0, GL_RGB, GL_FLOAT, rgb);
+
+    glGenBuffers(1, &pixelBuffer);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixelBuffer);
+    glBufferData(GL_PIXEL_UNPACK_BUFFER, texWidth*texHeight*sizeof(float), NULL, GL_STREAM_DRAW);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    glUseProgram(program);
+    glUniform1i(glGetUniformLocation(program, "values"), 0);
+    glUniform1i(glGetUniformLocation(program, "colormap"), 1);
+    glUniform1f(glGetUniformLocation(program, "vmin"), min);
+    glUniform1f(glGetUniformLocation(program, "vmax"), max);
+    glUseProgram(0);
+    return true;
+}
+
+void Visualizer::updateTexture()
+{
+    glBindTexture(GL_TEXTURE_2D, valueTexture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    if (interop_copy(engine, A, step, texHeight, texWidth, pixelBuffer))
+    {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixelBuffer);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, texWidth, texHeight, GL_RED, GL_FLOAT, 0);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        return;
+    }
+    interop_sync(engine, B);
+    if (B->data == NULL)
+    {
+        cout << "You are trying to visualize non-existing data" << endl;
+        exit(-1);
+    }
+    const float* data = (const float*) B->data;
+    for (int i = 0; i < texHeight; i++)
+    {
+        for (int j = 0; j < texWidth; j++)
+        {
+            samples[i*texWidth + j] = data[A->start + i*step*A->stride[0] + j*step*A->stride[1]];
+        }
+    }
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, texWidth, texHeight, GL_RED, GL_FLOAT, samples);
+}
+
+void Visualizer::displayShaded()
+{
+  glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  glLoadIdentity();
+
+  glUseProgram(program);
+  glActiveTexture(GL_TEXTURE0);
+  glBindTexture(GL_TEXTURE_2D, valueTexture);
+  glActiveTexture(GL_TEXTURE1);
+  glBindTexture(GL_TEXTURE_1D, colormapTexture);
+
+  glBegin(GL_QUADS);
+  glTexCoord2f(0.0f, 0.0f); glVertex3f(-XWIDTH/2.0f, -ZWIDTH/2.0f, 0.0f);
+  glTexCoord2f(1.0f, 0.0f); glVertex3f(XWIDTH/2.0f, -ZWIDTH/2.0f, 0.0f);
+  glTexCoord2f(1.0f, 1.0f); glVertex3f(XWIDTH/2.0f, ZWIDTH/2.0f, 0.0f);
+  glTexCoord2f(0.0f, 1.0f); glVertex3f(-XWIDTH/2.0f, ZWIDTH/2.0f, 0.0f);
+  glEnd();
+
+  glUseProgram(0);
+  glActiveTexture(GL_TEXTURE0);
+  glFlush();
+  glutSwapBuffers();
+
+  /* Update again and again */
+  glutPostRedisplay();
+}
 void Visualizer::computeVerticesCube()
 {
     uint64_t i = 0;
@@ -544,6 +731,11 @@ void Visualizer::displayCube(){
 
 void Visualizer::display2D()
 {
+  if (shaded)
+  {
+    displayShaded();
+    return;
+  }
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
   glLoadIdentity();
 
@@ -3,13 +3,16 @@
 
 #include <iostream>
 #include <stdlib.h>
+#define GL_GLEXT_PROTOTYPES
 #include <GL/freeglut.h>
+#include <GL/glext.h>
 #include <iostream>
 #include <sys/resource.h>
 #include <stdio.h>
 #include <math.h>
 #include <string.h>
 #include <bh_view.hpp>
+#include "interop.hpp"
 #include "Vector3.hpp"
 #include "colormaps.hpp"
 #define max(a,b) (a>=b?a:b)
@@ -39,7 +42,7 @@ class Visualizer
 
     ~Visualizer();
     static Visualizer& getInstance();
-    void run(bh_view* array);
+    void run(bh_view* array, void* engine);
     void setValues(bh_view* array, int width, int height, int depth, int cm, bool flat, bool cubes, float min, float max);
 
     // OpenGL Methods and variables
@@ -47,6 +50,9 @@ class Visualizer
     void updateNormals();
     void updateColors();
     float interpolateColor(float value, const float (* rgb)[3]);
+    bool initShader();
+    void updateTexture();
+    void displayShaded(void);
 
     bool toggleFullscreen(void);
 
@@ -80,6 +86,14 @@ class Visualizer
     int nbQuads;
     float min;
     float max;
+
+    // The flat mode maps the colors in a shader, which reads the values of a float texture with every 'step' row
+    // and column of the array. The CUDA engine fills the texture from its device buffer through 'pixelBuffer'.
+    bool shaded;
+    int step, texWidth, texHeight;
+    GLuint program, valueTexture, colormapTexture, pixelBuffer;
+    float* samples;
+    void* engine;
 };
 
 #endif
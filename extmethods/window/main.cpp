@@ -0,0 +1,265 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdexcept>
+#include <cassert>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <type_traits>
+
+#include <bh_extmethod.hpp>
+
+using namespace bohrium;
+using namespace extmethod;
+using namespace std;
+
+namespace {
+
+/* The outputs of a row are computed in blocks of at least this many outputs, which are independent and
+ * thus distributed among the threads. Each block starts its running sum from scratch, which also bounds
+ * the rounding error of the floating-point sums. */
+constexpr int64_t block_size = 1 << 12;
+
+enum class Method { SUM, MIN, MAX, MEAN };
+
+// The accumulator of the running sums, float32 is summed in float64
+template<typename T>
+using Acc = typename std::conditional<std::is_same<T, float>::value, double, T>::type;
+
+// NaN and infinity cannot leave a running sum again, and NaN has no order
+template<typename T>
+inline bool is_finite(T v) { return not std::is_floating_point<T>::value or std::isfinite(static_cast<double>(v)); }
+template<typename T>
+inline bool is_nan(T v) { return v != v; }
+
+/* A view of the 2-D operand, where the window slides along the rows (the last axis) */
+template<typename T>
+struct Rows {
+    T *data;
+    int64_t stride0, stride1;
+    Rows(const bh_view *view) : data(reinterpret_cast<T *>(view->base->data) + view->start),
+                                stride0(view->stride[0]), stride1(view->stride[1]) {}
+    T &operator()(int64_t r, int64_t i) const { return data[r * stride0 + i * stride1]; }
+};
+
+/* The sum (or mean) of the windows [first, last) of row 'r': the running sum adds the element that enters
+ * the window and subtracts the element that leaves it. The non-finite elements are left out of the running
+ * sum, and a window that contains one is summed directly. */
+template<typename T>
+void block_sum(const Rows<T> &in, const Rows<T> &out, int64_t r, int64_t first, int64_t last, int64_t window,
+               bool mean) {
+    Acc<T> sum = 0;
+    int64_t last_bad = -1;
+    for (int64_t j = first; j < first + window - 1; ++j) {
+        const T v = in(r, j);
+        if (is_finite(v)) {
+            sum += v;
+        } else {
+            last_bad = j;
+        }
+    }
+    for (int64_t i = first; i < last; ++i) {
+        const int64_t j = i + window - 1;
+        const T v = in(r, j);
+        if (is_finite(v)) {
+            sum += v;
+        } else {
+            last_bad = j;
+        }
+        Acc<T> res = sum;
+        if (last_bad >= i) {
+            res = 0;
+            for (int64_t k = i; k <= j; ++k) {
+                res += in(r, k);
+            }
+        }
+        out(r, i) = static_cast<T>(mean ? res / static_cast<Acc<T> >(window) : res);
+        const T leaving = in(r, i);
+        if (is_finite(leaving)) {
+            sum -= leaving;
+        }
+    }
+}
+
+/* The minimum (or maximum) of the windows [first, last) of row 'r' by a monotonic deque of the indexes in
+ * 'deque': the front is the extreme of the window and each element is pushed and popped at most once.
+ * NaN is not pushed, a window that contains one is NaN like in NumPy. */
+template<typename T, bool maximum>
+void block_extreme(const Rows<T> &in, const Rows<T> &out, int64_t r, int64_t first, int64_t last, int64_t window,
+                   vector<int64_t> &deque) {
+    size_t head = 0, tail = 0;
+    int64_t last_nan = -1;
+    for (int64_t j = first; j < last + window - 1; ++j) {
+        const T v = in(r, j);
+        if (is_nan(v)) {
+            last_nan = j;
+        } else {
+            while (tail > head and (maximum ? in(r, deque[tail - 1]) <= v : in(r, deque[tail - 1]) >= v)) {
+                --tail;
+            }
+            deque[tail++] = j;
+        }
+        const int64_t i = j - window + 1;
+        if (i >= first) {
+            while (head < tail and deque[head] < i) {
+                ++head;
+            }
+            out(r, i) = last_nan >= i ? std::numeric_limits<T>::quiet_NaN() : in(r, deque[head]);
+        }
+    }
+}
+
+/* Applies 'method' to the windows of 'window' elements of each row of 'in' and writes the row of
+ * 'in->shape[1] - window + 1' results of 'out' */
+template<typename T>
+void window_rows(Method method, const bh_view *in, bh_view *out, int64_t window) {
+    const int64_t rows = in->shape[0];
+    const int64_t n = out->shape[1];
+    if (rows == 0 or n == 0) {
+        return;
+    }
+    const Rows<T> src(in), dst(out);
+    const int64_t block = std::max(block_size, window);
+    const int64_t nblocks = (n + block - 1) / block;
+    const int64_t items = rows * nblocks;
+
+    #pragma omp parallel if(items > 1)
+    {
+        vector<int64_t> deque;
+        if (method == Method::MIN or method == Method::MAX) {
+            deque.resize(static_cast<size_t>(std::min(block, n) + window));
+        }
+        #pragma omp for schedule(static)
+        for (int64_t item = 0; item < items; ++item) {
+            const int64_t r = item / nblocks;
+            const int64_t first = (item % nblocks) * block;
+            const int64_t last = std::min(n, first + block);
+            switch (method) {
+                case Method::SUM:
+                    block_sum<T>(src, dst, r, first, last, window, false);
+                    break;
+                case Method::MEAN:
+                    block_sum<T>(src, dst, r, first, last, window, true);
+                    break;
+                case Method::MIN:
+                    block_extreme<T, false>(src, dst, r, first, last, window, deque);
+                    break;
+                case Method::MAX:
+                    block_extreme<T, true>(src, dst, r, first, last, window, deque);
+                    break;
+            }
+        }
+    }
+}
+
+/* The sliding-window extension methods of the rows of the 2-D array 'in', which is operand 1:
+ *   - "window_sum", "window_min", "window_max", and "window_mean" write the sum, minimum, maximum, and mean
+ *     of each window of 'window' consecutive elements of a row to 'out' (operand 0), which has the type of
+ *     'in' and 'in->shape[1] - window + 1' columns. 'window' is the first element of the int64 array in
+ *     operand 2. "window_mean" supports float32 and float64 only.
+ */
+template<Method method>
+class WindowImpl : public ExtmethodImpl {
+public:
+    void execute(bh_instruction *instr, void* arg) {
+        bh_view *out = &instr->operand[0];
+        const bh_view *in = &instr->operand[1];
+        const bh_view *w = &instr->operand[2];
+        assert(in->ndim == 2 and out->ndim == 2);
+        assert(out->base->type == in->base->type);
+        assert(w->base->type == bh_type::INT64);
+
+        // Make sure that the arrays memory are allocated.
+        bh_data_malloc(in->base);
+        bh_data_malloc(out->base);
+        bh_data_malloc(w->base);
+
+        const int64_t window = reinterpret_cast<const int64_t *>(w->base->data)[w->start];
+        if (window < 1 or window > in->shape[1]) {
+            throw runtime_error("window: the window size is out of bounds");
+        }
+        if (in->shape[0] != out->shape[0] or in->shape[1] - window + 1 != out->shape[1]) {
+            throw runtime_error("window: the output must have 'n - window + 1' columns");
+        }
+
+        switch(in->base->type) {
+            case bh_type::INT8:
+                if (method != Method::MEAN) { window_rows<bh_int8>(method, in, out, window); return; }
+                break;
+            case bh_type::INT16:
+                if (method != Method::MEAN) { window_rows<bh_int16>(method, in, out, window); return; }
+                break;
+            case bh_type::INT32:
+                if (method != Method::MEAN) { window_rows<bh_int32>(method, in, out, window); return; }
+                break;
+            case bh_type::INT64:
+                if (method != Method::MEAN) { window_rows<bh_int64>(method, in, out, window); return; }
+                break;
+            case bh_type::UINT8:
+                if (method != Method::MEAN) { window_rows<bh_uint8>(method, in, out, window); return; }
+                break;
+            case bh_type::UINT16:
+                if (method != Method::MEAN) { window_rows<bh_uint16>(method, in, out, window); return; }
+                break;
+            case bh_type::UINT32:
+                if (method != Method::MEAN) { window_rows<bh_uint32>(method, in, out, window); return; }
+                break;
+            case bh_type::UINT64:
+                if (method != Method::MEAN) { window_rows<bh_uint64>(method, in, out, window); return; }
+                break;
+            case bh_type::FLOAT32:
+                window_rows<bh_float32>(method, in, out, window);
+                return;
+            case bh_type::FLOAT64:
+                window_rows<bh_float64>(method, in, out, window);
+                return;
+            default:
+                break;
+        }
+        throw runtime_error("DTYPE must be an integer, float32, or float64 (float32 or float64 for the mean)");
+    }
+};
+} // Unnamed namespace
+
+extern "C" ExtmethodImpl* window_sum_create() {
+    return new WindowImpl<Method::SUM>();
+}
+extern "C" void window_sum_destroy(ExtmethodImpl* self) {
+    delete self;
+}
+extern "C" ExtmethodImpl* window_min_create() {
+    return new WindowImpl<Method::MIN>();
+}
+extern "C" void window_min_destroy(ExtmethodImpl* self) {
+    delete self;
+}
+extern "C" ExtmethodImpl* window_max_create() {
+    return new WindowImpl<Method::MAX>();
+}
+extern "C" void window_max_destroy(ExtmethodImpl* self) {
+    delete self;
+}
+extern "C" ExtmethodImpl* window_mean_create() {
+    return new WindowImpl<Method::MEAN>();
+}
+extern "C" void window_mean_destroy(ExtmethodImpl* self) {
+    delete self;
+}
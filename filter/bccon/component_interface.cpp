@@ -36,7 +36,14 @@ public:
                                        config.defaultGet<bool>("reduction", false),
                                        config.defaultGet<bool>("stupidmath", false),
                                        config.defaultGet<bool>("collect", false),
-                                       config.defaultGet<bool>("muladd", false)) {};
+                                       config.defaultGet<bool>("muladd", false),
+                                       config.defaultGet<bool>("cse", false),
+                                       config.defaultGet<bool>("deadstore", false),
+                                       config.defaultGet<bool>("constprop", false),
+                                       config.defaultGet<bool>("gather", false),
+                                       config.defaultGet<bool>("generators", false),
+                                       config.defaultGet<bool>("cow", false),
+                                       config.defaultGet<bool>("casts", false)) {};
 
     ~Impl() {}; // NB: a destructor implementation must exist
     void execute(bh_ir *bhir) {
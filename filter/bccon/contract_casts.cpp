@@ -0,0 +1,145 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "contracter.hpp"
+#include "rewrite.hpp"
+
+using namespace std;
+
+namespace bohrium {
+namespace filter {
+namespace bccon {
+
+using namespace rewrite;
+
+// Whether 'to' represents every value of 'from' exactly, thus a cast from 'from' to 'to' is value-preserving
+static bool widens(bh_type from, bh_type to)
+{
+    if (from == to or from == bh_type::BOOL) {
+        return is_real(to) or to == bh_type::BOOL;
+    }
+    const int from_size = bh_type_size(from);
+    const int to_size = bh_type_size(to);
+    if (from == bh_type::FLOAT32) {
+        return to == bh_type::FLOAT64;
+    }
+    if (not bh_type_is_integer(from)) {
+        return false;
+    }
+    // The mantissa of float32 holds 24 bits and float64 holds 53 bits
+    if (to == bh_type::FLOAT32) {
+        return from_size <= 2;
+    }
+    if (to == bh_type::FLOAT64) {
+        return from_size <= 4;
+    }
+    if (not bh_type_is_integer(to)) {
+        return false;
+    }
+    if (bh_type_is_signed_integer(from)) {
+        return bh_type_is_signed_integer(to) and to_size >= from_size;
+    }
+    return bh_type_is_signed_integer(to) ? to_size > from_size : to_size >= from_size;
+}
+
+static bool is_comparison(bh_opcode opcode)
+{
+    return opcode == BH_EQUAL or opcode == BH_NOT_EQUAL or opcode == BH_GREATER or opcode == BH_GREATER_EQUAL or
+           opcode == BH_LESS or opcode == BH_LESS_EQUAL;
+}
+
+// The root with the read of the result of the cast replaced by the input of the cast
+static bh_instruction sink(const Match &match)
+{
+    bh_instruction ret = match.root();
+    const bh_view &result = match.instr(0).operand[0];
+    for (size_t o = 1; o < ret.operand.size(); ++o) {
+        if (not bh_is_constant(&ret.operand[o]) and ret.operand[o] == result) {
+            ret.operand[o] = match.vars.at(0);
+        }
+    }
+    return ret;
+}
+
+// Whether the cast of the match widens its input and the root computes in the type of the result of the cast
+static bool sinkable(const Match &match)
+{
+    const bh_instruction &cast = match.instr(0);
+    const bh_instruction &root = match.root();
+    const bh_type type = cast.operand[0].base->type;
+    if (not widens(match.vars.at(0).base->type, type) or type == bh_type::BOOL) {
+        return false;
+    }
+    for (size_t o = 1; o < root.operand.size(); ++o) {
+        if (root.operand_type(static_cast<int>(o)) != type) {
+            return false;
+        }
+    }
+    return is_comparison(root.opcode) or root.operand[0].base->type == type;
+}
+
+/*
+We are looking for casts (BH_IDENTITY between types) of a temporary array such as:
+
+  BH_IDENTITY t:float64 a0:int32
+  BH_IDENTITY a1:int32 t:float64
+
+where the first cast is value-preserving, thus the two casts are one cast (here a copy):
+
+  BH_IDENTITY a1:int32 a0:int32
+
+and widening casts that only feed a binary operation in the wider type such as:
+
+  BH_IDENTITY t:float64 a0:int32
+  BH_ADD a2:float64 t:float64 a1:float64
+
+where the operation converts the input when it loads it instead of reading the converted temporary:
+
+  BH_ADD a2:float64 a0:int32 a1:float64
+
+NB: the kernels compute in C, which converts the narrower input to the type of the other operands exactly like the
+    cast. Thus we only sink the casts that preserve the value into the arithmetic and comparison operations whose
+    other operands have the type of the cast.
+*/
+void Contracter::contract_casts(bh_ir &bhir)
+{
+    const vector<bh_opcode> binary = {BH_ADD, BH_SUBTRACT, BH_MULTIPLY, BH_DIVIDE, BH_MAXIMUM, BH_MINIMUM,
+                                      BH_EQUAL, BH_NOT_EQUAL, BH_GREATER, BH_GREATER_EQUAL, BH_LESS, BH_LESS_EQUAL};
+    const vector<Rule> rules = {
+        {"Casts", {{{BH_IDENTITY}, {var(0)}},
+                   {{BH_IDENTITY}, {result(0)}}},
+         [](const Match &m) {
+             const bh_type type = m.root().operand[0].base->type;
+             return widens(m.vars.at(0).base->type, m.instr(0).operand[0].base->type) and
+                    (is_real(type) or type == bh_type::BOOL);
+         },
+         [](const Match &m) { return bh_instruction(BH_IDENTITY, {m.root().operand[0], m.vars.at(0)}); }},
+        {"Casts", {{{BH_IDENTITY}, {var(0)}},
+                   {binary, {result(0), var(1)}}}, sinkable, sink},
+        {"Casts", {{{BH_IDENTITY}, {var(0)}},
+                   {binary, {var(1), result(0)}}}, sinkable, sink},
+        {"Casts", {{{BH_IDENTITY}, {var(0)}},
+                   {binary, {result(0), constant()}}}, sinkable, sink},
+        {"Casts", {{{BH_IDENTITY}, {var(0)}},
+                   {binary, {constant(), result(0)}}}, sinkable, sink},
+    };
+    rewrite::apply(bhir, rules);
+}
+
+}}}
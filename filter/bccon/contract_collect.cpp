@@ -18,6 +18,9 @@ GNU Lesser General Public License along with Bohrium.
 If not, see <http://www.gnu.org/licenses/>.
 */
 #include "contracter.hpp"
+#include "rewrite.hpp"
+
+#include <cmath>
 
 using namespace std;
 
@@ -25,218 +28,81 @@ namespace bohrium {
 namespace filter {
 namespace bccon {
 
-static inline bool is_add_sub(const bh_opcode& opc)
-{
-    return opc == BH_ADD or opc == BH_SUBTRACT;
-}
+using namespace rewrite;
 
-static inline bool is_mul_div(const bh_opcode& opc)
+// Whether the constants of the chain and the variable are of the result type, which the folding supports
+static bool same_type(const Match &match)
 {
-    return opc == BH_MULTIPLY or opc == BH_DIVIDE;
+    const bh_type type = match.root().operand[0].base->type;
+    return is_real(type) and match.vars.at(0).base->type == type and
+           match.instr(0).operand[0].base->type == type and
+           match.instr(0).constant.type == type and match.root().constant.type == type and
+           representable(type, match.instr(0).constant.get_double()) and
+           representable(type, match.root().constant.get_double());
 }
 
-static inline bool is_none_free(const bh_opcode& opc)
+// The constant that 'instr' adds or multiplies its input with
+static double addend(const bh_instruction &instr)
 {
-    return opc == BH_NONE or opc == BH_FREE;
+    const double value = instr.constant.get_double();
+    return instr.opcode == BH_SUBTRACT ? -value : value;
 }
 
-static bool chain_has_same_type(vector<bh_instruction*>& chain)
+static double factor(const bh_instruction &instr)
 {
-    const bh_type type = chain.front()->constant.type;
-
-    for(auto const instr : chain) {
-        if (type != instr->constant.type) {
-            return false;
-        }
-    }
-
-    return true;
+    const double value = instr.constant.get_double();
+    return instr.opcode == BH_DIVIDE ? 1.0 / value : value;
 }
 
-static void rewrite_chain_add_sub(bh_ir &bhir, vector<bh_instruction*>& chain)
-{
-    bh_instruction& first = *chain.front();
-    bh_instruction& last = *chain.back();
-
-    if (!chain_has_same_type(chain)) {
-        verbose_print("[Collect] \tAddsub chain doesn't have same type.");
-        return;
-    }
-
-    switch (first.constant.type) {
-        case bh_type::BOOL:
-        case bh_type::COMPLEX64:
-        case bh_type::COMPLEX128:
-        case bh_type::R123:
-            verbose_print("[Collect] \tDon't know how to do complex types, yet.");
-            return;
-        default:
-            break;
-    }
-
-    float_t sum = 0.0;
-
-    // Update first instruction's result base to last
-    first.operand[0].base = last.operand[0].base;
-
-    // Get first instructions value
-    if (first.opcode == BH_ADD) {
-        sum += first.constant.get_double();
-    } else {
-        sum -= first.constant.get_double();
-    }
-
-    // Loop through rest and accumulate value
-    for(vector<bh_instruction*>::iterator ite=chain.begin()+1; ite != chain.end(); ++ite) {
-        bh_instruction& rinstr = **ite;
-        if (rinstr.opcode == BH_ADD) {
-            sum += rinstr.constant.get_double();
-        } else {
-            sum -= rinstr.constant.get_double();
-        }
-        // Remove instruction
-        rinstr.opcode = BH_NONE;
-    }
-
-    // We might have to reverse the original first opcode
-    // If sum is below zero, we want to subtract
-    if (sum < 0) {
-        first.opcode = BH_SUBTRACT;
-        sum = -sum;
-    } else {
-        first.opcode = BH_ADD;
-    }
-
-    // Set first instruction's new value
-    first.constant.set_double(sum);
-}
+/*
+We are looking for chains of constant additions and subtractions, or
+multiplications and divisions, like:
 
-static void rewrite_chain_mul_div(bh_ir &bhir, vector<bh_instruction*>& chain)
-{
-    bh_instruction& first = *chain.front();
-    bh_instruction& last = *chain.back();
-
-    if (!chain_has_same_type(chain)) {
-        verbose_print("[Collect] \tMuldiv chain doesn't have same type.");
-        return;
-    }
-
-    switch (first.constant.type) {
-        case bh_type::BOOL:
-        case bh_type::COMPLEX64:
-        case bh_type::COMPLEX128:
-        case bh_type::R123:
-            verbose_print("[Collect] \tDon't know how to do complex types, yet.");
-            return;
-        default:
-            break;
-    }
-
-    float_t result = 1.0;
-
-    // Update first instruction's result base to last
-    first.operand[0].base = last.operand[0].base;
-
-    // Get first instructions value
-    if (first.opcode == BH_MULTIPLY) {
-        result *= first.constant.get_double();
-    } else {
-        result /= first.constant.get_double();
-    }
-
-    // Loop through rest and accumulate value
-    for(vector<bh_instruction*>::iterator ite=chain.begin()+1; ite != chain.end(); ++ite) {
-        bh_instruction& rinstr = **ite;
-        if (rinstr.opcode == BH_MULTIPLY) {
-            result *= rinstr.constant.get_double();
-        } else {
-            result /= rinstr.constant.get_double();
-        }
-        // Remove instruction
-        rinstr.opcode = BH_NONE;
-    }
-
-    // Set first instruction's new value
-    first.opcode = BH_MULTIPLY;
-    first.constant.set_double(result);
-}
+  BH_ADD a1 a0 2
+  BH_SUBTRACT a2 a1 5
+  BH_FREE a1
 
-static void rewrite_chain(bh_ir &bhir, vector<bh_instruction*>& chain)
-{
-    bh_opcode opc = chain[0]->opcode;
-    if (is_add_sub(opc)) {
-        verbose_print("[Collect] \tAddSub rewrite.");
-        rewrite_chain_add_sub(bhir, chain);
-    } else if (is_mul_div(opc)) {
-        verbose_print("[Collect] \tMulDiv rewrite.");
-        rewrite_chain_mul_div(bhir, chain);
-    }
-}
+which we rewrite into:
+
+  BH_SUBTRACT a2 a0 3
 
+The rules apply repeatedly thus longer chains collapse one link at a time.
+NB: the floating-point chains are reassociated, which may change the rounding.
+*/
 void Contracter::contract_collect(bh_ir &bhir)
 {
-    bh_opcode collect_opcode = BH_NONE;
-    vector<const bh_view*> views;
-    vector<bh_instruction*> chain;
-
-    for(size_t pc = 0; pc < bhir.instr_list.size(); ++pc) {
-        bh_instruction& instr = bhir.instr_list[pc];
-
-        if ((is_add_sub(instr.opcode) or is_mul_div(instr.opcode)) and bh_is_constant(&(instr.operand[2]))) {
-            collect_opcode = instr.opcode;
-            views.push_back(&instr.operand[0]);
-            chain.push_back(&instr);
-
-            for(size_t pc_chain = pc+1; pc_chain < bhir.instr_list.size(); ++pc_chain) {
-                bh_instruction& other_instr = bhir.instr_list[pc_chain];
-
-                if (is_add_sub(collect_opcode) and is_add_sub(other_instr.opcode) and bh_is_constant(&other_instr.operand[2])) {
-                    // Both are ADD or SUBTRACT
-                    if (*views.back() == other_instr.operand[1]) {
-                        views.push_back(&other_instr.operand[0]);
-                        chain.push_back(&other_instr);
-                    }
-                } else if (is_mul_div(collect_opcode) and is_mul_div(other_instr.opcode) and bh_is_constant(&other_instr.operand[2])) {
-                    // Both are MULTIPLY or DIVIDE
-
-                    // We are not allowed to DIVIDE when the result operand has integer type
-                    if (bh_type_is_integer(other_instr.operand[0].base->type)) {
-                        chain.clear();
-                        views.clear();
-                        break;
-                    } else if (*views.back() == other_instr.operand[1]) {
-                        views.push_back(&other_instr.operand[0]);
-                        chain.push_back(&other_instr);
-                    }
-                } else {
-                    if (is_none_free(other_instr.opcode)) {
-                        continue;
-                    } else {
-                        // Is not ADD, SUBTRACT, MULTIPLY, DIVIDE, NONE, FREE
-                        // End chain
-                        if (chain.size() > 1) {
-                            verbose_print("[Collect] Rewriting chain of length " + std::to_string(chain.size()));
-                            rewrite_chain(bhir, chain);
-                        }
-
-                        // Reset
-                        chain.clear();
-                        views.clear();
-                        break;
-                    }
-                }
-            }
-        }
-
-        // Rewrite if end of instruction list
-        if (chain.size() > 1) {
-            verbose_print("[Collect] End of loop rewriting chain of length " + std::to_string(chain.size()));
-            rewrite_chain(bhir, chain);
-        }
-
-        chain.clear();
-        views.clear();
-    }
+    const vector<Rule> rules = {
+        {"Collect", {{{BH_ADD, BH_SUBTRACT}, {var(0), constant()}},
+                     {{BH_ADD, BH_SUBTRACT}, {result(0), constant()}}},
+         [](const Match &m) {
+             const bh_type type = m.root().operand[0].base->type;
+             return same_type(m) and representable(type, std::fabs(addend(m.instr(0)) + addend(m.root())));
+         },
+         [](const Match &m) {
+             const double sum = addend(m.instr(0)) + addend(m.root());
+             return with_constant(sum < 0 ? BH_SUBTRACT : BH_ADD, m.root().operand[0], m.vars.at(0),
+                                  m.root().constant.type, std::fabs(sum));
+         }},
+        // The integer divisions truncate thus only the integer multiplications are folded
+        {"Collect", {{{BH_MULTIPLY, BH_DIVIDE}, {var(0), constant()}},
+                     {{BH_MULTIPLY, BH_DIVIDE}, {result(0), constant()}}},
+         [](const Match &m) {
+             const bh_type type = m.root().operand[0].base->type;
+             if (not same_type(m)) {
+                 return false;
+             }
+             if (bh_type_is_integer(type)) {
+                 return m.instr(0).opcode == BH_MULTIPLY and m.root().opcode == BH_MULTIPLY and
+                        representable(type, factor(m.instr(0)) * factor(m.root()));
+             }
+             return m.instr(0).constant.get_double() != 0 and m.root().constant.get_double() != 0;
+         },
+         [](const Match &m) {
+             return with_constant(BH_MULTIPLY, m.root().operand[0], m.vars.at(0), m.root().constant.type,
+                                  factor(m.instr(0)) * factor(m.root()));
+         }},
+    };
+    rewrite::apply(bhir, rules);
 }
 
 }}}
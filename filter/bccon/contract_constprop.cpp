@@ -0,0 +1,183 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "contracter.hpp"
+#include "rewrite.hpp"
+
+#include <cmath>
+#include <algorithm>
+#include <unordered_map>
+
+using namespace std;
+
+namespace bohrium {
+namespace filter {
+namespace bccon {
+
+using rewrite::is_real;
+using rewrite::representable;
+
+// Evaluates 'opcode' of 'args' into 'result' of 'type' when the result is exact in the bytecode semantics
+static bool evaluate(bh_opcode opcode, bh_type type, const vector<bh_constant> &args, bh_constant &result)
+{
+    if (not is_real(type)) {
+        return false;
+    }
+    vector<double> x;
+    for (const bh_constant &arg: args) {
+        const double value = arg.get_double();
+        if (not is_real(arg.type) or not representable(arg.type, value) or std::isnan(value)) {
+            return false;
+        }
+        x.push_back(value);
+    }
+    double value;
+    switch (opcode) {
+        case BH_IDENTITY:
+            value = bh_type_is_integer(type) ? std::trunc(x[0]) : x[0];
+            break;
+        case BH_ABSOLUTE:
+            value = std::fabs(x[0]);
+            break;
+        case BH_ADD:
+            value = x[0] + x[1];
+            break;
+        case BH_SUBTRACT:
+            value = x[0] - x[1];
+            break;
+        case BH_MULTIPLY:
+            value = x[0] * x[1];
+            break;
+        case BH_DIVIDE:
+            // The integer divisions depend on the rounding of the engine
+            if (bh_type_is_integer(type)) {
+                return false;
+            }
+            value = x[0] / x[1];
+            break;
+        case BH_MAXIMUM:
+            value = std::max(x[0], x[1]);
+            break;
+        case BH_MINIMUM:
+            value = std::min(x[0], x[1]);
+            break;
+        default:
+            return false;
+    }
+    // The integers must not overflow since the engines wrap around
+    if (not representable(type, value)) {
+        return false;
+    }
+    result.type = type;
+    result.set_double(value);
+    return true;
+}
+
+/*
+We are looking for the elementwise instructions whose inputs are constants or
+1-element bases that an earlier instruction of the flush set to a known value:
+
+  BH_IDENTITY a1[0:1] 2
+  BH_MULTIPLY a2[0:1] a1[0:1] 3
+  BH_MULTIPLY a3[0:100] a0[0:100] a2[0:1]
+
+which we rewrite into:
+
+  BH_IDENTITY a1[0:1] 2
+  BH_IDENTITY a2[0:1] 6
+  BH_MULTIPLY a3[0:100] a0[0:100] 6
+
+The instructions that set the 1-element bases remain, which the dead-store
+elimination removes when nothing else reads them. The identities such as 'x*1'
+that the propagated constants give are removed by the stupid math rules.
+*/
+void Contracter::contract_constprop(bh_ir &bhir)
+{
+    for (const bh_instruction &instr: bhir.instr_list) {
+        if (instr.opcode == BH_REPEAT) {
+            return;
+        }
+    }
+
+    // The value of the 1-element bases that the flush set from constants
+    unordered_map<const bh_base*, bh_constant> known;
+    for (bh_instruction &instr: bhir.instr_list) {
+        if (instr.opcode == BH_NONE or instr.opcode == BH_SYNC or instr.operand.empty()) {
+            continue;
+        }
+        if (instr.opcode == BH_FREE) {
+            known.erase(instr.operand[0].base);
+            continue;
+        }
+        const bh_view out = instr.operand[0];
+        if (not bh_opcode_is_elementwise(instr.opcode) or bh_opcode_is_system(instr.opcode)) {
+            known.erase(out.base);
+            continue;
+        }
+
+        vector<bh_constant> args;
+        size_t num_known = 0, known_operand = 0;
+        bh_constant known_value;
+        for (size_t o = 1; o < instr.operand.size(); ++o) {
+            const bh_view &view = instr.operand[o];
+            if (bh_is_constant(&view)) {
+                args.push_back(instr.constant);
+                continue;
+            }
+            const auto it = known.find(view.base);
+            if (it == known.end()) {
+                continue;
+            }
+            args.push_back(it->second);
+            ++num_known;
+            known_operand = o;
+            known_value = it->second;
+        }
+
+        bh_constant result;
+        if (args.size() == instr.operand.size() - 1 and evaluate(instr.opcode, out.base->type, args, result)) {
+            const bool folded = instr.opcode == BH_IDENTITY and bh_is_constant(&instr.operand[1]) and
+                                instr.constant == result;
+            if (not folded) {
+                verbose_print("[Constprop] Evaluating " + instr.pprint());
+                bh_view constant;
+                constant.base = nullptr;
+                instr.opcode = BH_IDENTITY;
+                instr.operand = {out, constant};
+                instr.constant = result;
+            }
+            if (out.base->nelem == 1) {
+                known[out.base] = result;
+            } else {
+                known.erase(out.base);
+            }
+            continue;
+        }
+        known.erase(out.base);
+
+        // An instruction has at most one constant
+        if (num_known == 1 and not instr.has_constant() and instr.operand.size() == 3) {
+            verbose_print("[Constprop] Propagating into " + instr.pprint());
+            instr.constant = known_value;
+            instr.operand[known_operand].base = nullptr;
+        }
+    }
+}
+
+}}}
@@ -0,0 +1,139 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "contracter.hpp"
+
+#include <sstream>
+
+using namespace std;
+
+namespace bohrium {
+namespace filter {
+namespace bccon {
+
+// Whether 'view' is all of its base in order
+static bool whole(const bh_view &view)
+{
+    return view.start == 0 and bh_is_contiguous(&view) and bh_nelements(view) == view.base->nelem;
+}
+
+/* A copy is a BH_IDENTITY of all of a base into all of a fresh base of the same type. Instead of copying, we remove
+ * the copy and the copy becomes an alias of the source (copy-on-write):
+ *  - the instructions that read the copy read the source instead
+ *  - an instruction that writes or syncs the copy, or that writes, frees, or syncs the source, gets the copy
+ *    inserted before it, which the engine fuses into the kernel of the write
+ *  - a flush that frees the copy drops it
+ * NB: the source is materialized on sync since the bridge might write its data directly afterwards.
+ */
+static bool is_copy(const bh_instruction &instr)
+{
+    if (instr.opcode != BH_IDENTITY or instr.operand.size() != 2 or bh_is_constant(&instr.operand[1])) {
+        return false;
+    }
+    const bh_view &out = instr.operand[0];
+    const bh_view &in = instr.operand[1];
+    return out.base != in.base and out.base->data == nullptr and out.base->type == in.base->type and
+           out.base->nelem == in.base->nelem and whole(out) and whole(in);
+}
+
+void Contracter::contract_cow(bh_ir &bhir)
+{
+    bool repeat = false, any = not copies_.empty();
+    for (const bh_instruction &instr: bhir.instr_list) {
+        repeat = repeat or instr.opcode == BH_REPEAT;
+        any = any or is_copy(instr);
+    }
+    if (not any) {
+        return;
+    }
+
+    vector<bh_instruction> instr_list;
+    instr_list.reserve(bhir.instr_list.size());
+    // A bh_ir with repeats gets all the copies before anything else, which keeps the repeat bodies intact
+    if (repeat) {
+        for (auto &copy: copies_) {
+            instr_list.push_back(std::move(copy.second));
+        }
+        copies_.clear();
+        copy_sources_.clear();
+        instr_list.insert(instr_list.end(), bhir.instr_list.begin(), bhir.instr_list.end());
+        bhir.instr_list = std::move(instr_list);
+        return;
+    }
+
+    uint64_t aliased = 0, materialized = 0;
+    // Inserts the copy into 'copy' or drops it when it is dead
+    auto materialize = [&](const bh_base *copy, bool dead) {
+        auto it = copies_.find(copy);
+        const bh_base *source = it->second.operand[1].base;
+        if (not dead) {
+            instr_list.push_back(std::move(it->second));
+            ++materialized;
+        }
+        copies_.erase(it);
+        auto sources = copy_sources_.find(source);
+        sources->second.erase(copy);
+        if (sources->second.empty()) {
+            copy_sources_.erase(sources);
+        }
+    };
+    for (bh_instruction &instr: bhir.instr_list) {
+        for (bh_view &view: instr.operand) {
+            if (bh_is_constant(&view)) {
+                continue;
+            }
+            // The output of writes, syncs, frees, and extension methods
+            const bool writes = &view == &instr.operand[0];
+            // The source is about to change thus its copies must be made first
+            auto sources = copy_sources_.find(view.base);
+            if (sources != copy_sources_.end() and writes) {
+                const set<const bh_base*> copies = sources->second;
+                for (const bh_base *copy: copies) {
+                    materialize(copy, false);
+                }
+            }
+            auto it = copies_.find(view.base);
+            if (it != copies_.end()) {
+                if (instr.opcode == BH_FREE or view.base->data != nullptr) { // Dead or set by the bridge
+                    materialize(view.base, true);
+                } else if (writes) {
+                    materialize(view.base, false);
+                } else {
+                    view.base = it->second.operand[1].base;
+                }
+            }
+        }
+        if (is_copy(instr)) {
+            copy_sources_[instr.operand[1].base].insert(instr.operand[0].base);
+            copies_[instr.operand[0].base] = std::move(instr);
+            ++aliased;
+            continue;
+        }
+        instr_list.push_back(std::move(instr));
+    }
+    bhir.instr_list = std::move(instr_list);
+
+    if (aliased > 0 or materialized > 0) {
+        stringstream ss;
+        ss << "Copy-on-write: " << aliased << " copies aliased and " << materialized << " materialized.";
+        verbose_print(ss.str());
+    }
+}
+
+}}}
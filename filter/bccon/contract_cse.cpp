@@ -0,0 +1,245 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "contracter.hpp"
+
+#include <unordered_map>
+#include <unordered_set>
+#include <boost/functional/hash.hpp>
+
+using namespace std;
+
+namespace bohrium {
+namespace filter {
+namespace bccon {
+
+// Whether the output of 'instr' is a function of its inputs only
+static bool is_pure(const bh_instruction &instr)
+{
+    if (instr.opcode >= BH_MAX_OPCODE_ID or bh_opcode_is_system(instr.opcode) or instr.operand.empty()) {
+        return false;
+    }
+    // The scatters only write some of the output thus the rest of the output is an input
+    return instr.opcode != BH_SCATTER and instr.opcode != BH_COND_SCATTER and instr.opcode != BH_ADD_SCATTER;
+}
+
+// The hash of the opcode, the output type and shape, and the inputs of 'instr'
+static size_t expr_hash(const bh_instruction &instr)
+{
+    size_t ret = static_cast<size_t>(instr.opcode);
+    const bh_view &out = instr.operand[0];
+    boost::hash_combine(ret, static_cast<int>(out.base->type));
+    boost::hash_combine(ret, out.ndim);
+    for (int64_t d = 0; d < out.ndim; ++d) {
+        boost::hash_combine(ret, out.shape[d]);
+    }
+    for (size_t o = 1; o < instr.operand.size(); ++o) {
+        const bh_view &view = instr.operand[o];
+        if (bh_is_constant(&view)) {
+            boost::hash_combine(ret, static_cast<int>(instr.constant.type));
+        } else {
+            boost::hash_combine(ret, view.base);
+            boost::hash_combine(ret, view.start);
+            for (int64_t d = 0; d < view.ndim; ++d) {
+                boost::hash_combine(ret, view.shape[d]);
+                boost::hash_combine(ret, view.stride[d]);
+            }
+        }
+    }
+    return ret;
+}
+
+// Whether 'a' and 'b' compute the same values into outputs of the same type and shape
+static bool same_expr(const bh_instruction &a, const bh_instruction &b)
+{
+    const bh_view &out_a = a.operand[0];
+    const bh_view &out_b = b.operand[0];
+    if (a.opcode != b.opcode or a.operand.size() != b.operand.size() or out_a.base->type != out_b.base->type or
+        out_a.ndim != out_b.ndim) {
+        return false;
+    }
+    for (int64_t d = 0; d < out_a.ndim; ++d) {
+        if (out_a.shape[d] != out_b.shape[d]) {
+            return false;
+        }
+    }
+    for (size_t o = 1; o < a.operand.size(); ++o) {
+        const bh_view &va = a.operand[o];
+        const bh_view &vb = b.operand[o];
+        if (bh_is_constant(&va) xor bh_is_constant(&vb)) {
+            return false;
+        } else if (bh_is_constant(&va)) {
+            if (a.constant != b.constant) {
+                return false;
+            }
+        } else if (va != vb) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* Replace the reads of the output of the duplicate 'instr_list[dup]' with the output 'result' of the earlier
+ * instruction, which is possible when the output base of the duplicate is only read through the output view
+ * and freed in this flush and 'result' isn't written in the meantime. Returns whether it replaced the reads.
+ */
+static bool forward_result(vector<bh_instruction> &instr_list, size_t dup, const bh_view &result,
+                           const unordered_set<const bh_base*> &referenced)
+{
+    const bh_view out = instr_list[dup].operand[0];
+    if (referenced.find(out.base) != referenced.end()) {
+        return false;
+    }
+    vector<bh_view*> reads;
+    for (size_t pc = dup + 1; pc < instr_list.size(); ++pc) {
+        bh_instruction &instr = instr_list[pc];
+        if (instr.opcode == BH_NONE) {
+            continue;
+        }
+        if (instr.opcode == BH_FREE) {
+            if (instr.operand[0].base == out.base) {
+                for (bh_view *view: reads) {
+                    *view = result;
+                }
+                return true;
+            } else if (instr.operand[0].base == result.base) {
+                return false;
+            }
+            continue;
+        }
+        if (instr.opcode == BH_SYNC) {
+            if (instr.operand[0].base == out.base) {
+                return false;
+            }
+            continue;
+        }
+        if (instr.opcode == BH_REPEAT) {
+            return false;
+        }
+        if (bh_opcode_is_system(instr.opcode)) {
+            continue;
+        }
+        for (size_t o = 0; o < instr.operand.size(); ++o) {
+            bh_view &view = instr.operand[o];
+            if (bh_is_constant(&view)) {
+                continue;
+            }
+            if (o == 0 and view.base == result.base) {
+                return false;
+            }
+            if (view.base == out.base) {
+                if (o == 0 or view != out) {
+                    return false;
+                }
+                reads.push_back(&view);
+            }
+        }
+    }
+    // The output is visible after the flush
+    return false;
+}
+
+void Contracter::contract_cse(bh_ir &bhir)
+{
+    vector<bh_instruction> &instr_list = bhir.instr_list;
+    // The available expressions by their hash and the available expressions that use each base
+    unordered_multimap<size_t, size_t> available;
+    unordered_map<const bh_base*, vector<size_t> > users;
+    vector<bool> is_available(instr_list.size(), false);
+    // The bases that the instructions so far refer to
+    unordered_set<const bh_base*> referenced;
+
+    auto invalidate = [&](const bh_base *base) {
+        auto it = users.find(base);
+        if (it != users.end()) {
+            for (size_t pc: it->second) {
+                is_available[pc] = false;
+            }
+            users.erase(it);
+        }
+    };
+
+    for (size_t pc = 0; pc < instr_list.size(); ++pc) {
+        bh_instruction &instr = instr_list[pc];
+        if (instr.opcode == BH_NONE or instr.opcode == BH_SYNC or instr.opcode == BH_TALLY) {
+            continue;
+        }
+        if (instr.opcode == BH_REPEAT) {
+            // The body of a repeat executes several times thus nothing stays available
+            std::fill(is_available.begin(), is_available.end(), false);
+            available.clear();
+            users.clear();
+            continue;
+        }
+        if (instr.operand.empty()) {
+            continue;
+        }
+
+        if (is_pure(instr)) {
+            const size_t hash = expr_hash(instr);
+            auto range = available.equal_range(hash);
+            for (auto it = range.first; it != range.second; ++it) {
+                const bh_instruction &earlier = instr_list[it->second];
+                if (is_available[it->second] and same_expr(earlier, instr)) {
+                    const bh_view result = earlier.operand[0];
+                    if (forward_result(instr_list, pc, result, referenced)) {
+                        verbose_print("[CSE] \tForward the result of a duplicate " + string(bh_opcode_text(instr.opcode)));
+                        instr.opcode = BH_NONE;
+                    } else if (instr.opcode != BH_IDENTITY and instr.operand[0].base != result.base) {
+                        verbose_print("[CSE] \tCopy the result of a duplicate " + string(bh_opcode_text(instr.opcode)));
+                        instr.opcode = BH_IDENTITY;
+                        instr.operand.resize(2);
+                        instr.operand[1] = result;
+                    }
+                    break;
+                }
+            }
+            if (instr.opcode == BH_NONE) {
+                continue;
+            }
+        }
+
+        // The instruction writes or frees its output, which invalidates the expressions that use it
+        for (const bh_view &view: instr.operand) {
+            if (not bh_is_constant(&view)) {
+                referenced.insert(view.base);
+            }
+        }
+        invalidate(instr.operand[0].base);
+
+        // And its expression is available unless it overwrites one of its inputs
+        if (is_pure(instr)) {
+            bool in_place = false;
+            for (size_t o = 1; o < instr.operand.size(); ++o) {
+                in_place |= instr.operand[o].base == instr.operand[0].base;
+            }
+            if (not in_place) {
+                is_available[pc] = true;
+                available.insert(make_pair(expr_hash(instr), pc));
+                for (const bh_view &view: instr.operand) {
+                    if (not bh_is_constant(&view)) {
+                        users[view.base].push_back(pc);
+                    }
+                }
+            }
+        }
+    }
+}
+
+}}}
@@ -0,0 +1,107 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "contracter.hpp"
+#include "contracter.hpp"
+
+#include <unordered_set>
+
+using namespace std;
+
+namespace bohrium {
+namespace filter {
+namespace bccon {
+
+// Whether removing 'instr' has no effect other than not writing its output
+static bool is_removable(const bh_instruction &instr)
+{
+    return instr.opcode < BH_MAX_OPCODE_ID and not bh_opcode_is_system(instr.opcode) and not instr.operand.empty();
+}
+
+// Whether 'view' writes all of its base thus the earlier values of the base are dead
+static bool covers_base(const bh_view &view)
+{
+    return view.start == 0 and bh_is_contiguous(&view) and bh_nelements(view) == view.base->nelem;
+}
+
+void Contracter::contract_deadstore(bh_ir &bhir)
+{
+    vector<bh_instruction> &instr_list = bhir.instr_list;
+    for (const bh_instruction &instr: instr_list) {
+        if (instr.opcode == BH_REPEAT) {
+            // A value that is dead at the end of a repeat body is read by the next repetition
+            return;
+        }
+    }
+
+    // We scan backwards thus 'dead' is the bases whose values are never read after the current instruction,
+    // which are the bases that are freed or overwritten before anything reads or syncs them
+    unordered_set<const bh_base*> dead;
+    uint64_t count = 0;
+    for (auto it = instr_list.rbegin(); it != instr_list.rend(); ++it) {
+        bh_instruction &instr = *it;
+        switch (instr.opcode) {
+            case BH_NONE:
+            case BH_TALLY:
+                continue;
+            case BH_FREE:
+                dead.insert(instr.operand[0].base);
+                continue;
+            case BH_SYNC:
+                dead.erase(instr.operand[0].base);
+                continue;
+            default:
+                break;
+        }
+        if (instr.operand.empty()) {
+            continue;
+        }
+
+        const bh_view &out = instr.operand[0];
+        if (is_removable(instr) and dead.find(out.base) != dead.end()) {
+            // Nothing reads the output thus the instruction and its reads are gone
+            instr.opcode = BH_NONE;
+            ++count;
+            continue;
+        }
+
+        // The output is dead before the instruction when it overwrites the whole base without reading it
+        bool reads_output = instr.opcode == BH_SCATTER or instr.opcode == BH_COND_SCATTER or
+                            instr.opcode == BH_ADD_SCATTER or
+                            instr.opcode >= BH_MAX_OPCODE_ID or not covers_base(out);
+        for (size_t o = 1; o < instr.operand.size(); ++o) {
+            reads_output |= instr.operand[o].base == out.base;
+        }
+        if (reads_output) {
+            dead.erase(out.base);
+        } else {
+            dead.insert(out.base);
+        }
+        for (size_t o = 1; o < instr.operand.size(); ++o) {
+            if (not bh_is_constant(&instr.operand[o])) {
+                dead.erase(instr.operand[o].base);
+            }
+        }
+    }
+    if (count > 0) {
+        verbose_print("[Deadstore] \tRemoved " + std::to_string(count) + " instructions with dead outputs.");
+    }
+}
+
+}}}
@@ -0,0 +1,247 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "contracter.hpp"
+
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+
+using namespace std;
+
+namespace bohrium {
+namespace filter {
+namespace bccon {
+
+namespace {
+
+// The values of a view written by BH_RANGE followed by multiplications and additions of integer constants,
+// which is 'offset' plus the sum of 'coef[d]' times the index of dimension d
+struct Affine {
+    bh_view view;
+    int64_t offset;
+    int64_t coef[BH_MAXDIM];
+
+    // The smallest and largest value
+    int64_t min() const {
+        int64_t ret = offset;
+        for (int64_t d = 0; d < view.ndim; ++d) {
+            ret += std::min(int64_t{0}, coef[d] * (view.shape[d] - 1));
+        }
+        return ret;
+    }
+    int64_t max() const {
+        int64_t ret = offset;
+        for (int64_t d = 0; d < view.ndim; ++d) {
+            ret += std::max(int64_t{0}, coef[d] * (view.shape[d] - 1));
+        }
+        return ret;
+    }
+};
+
+// The largest coefficient or offset we track, which keeps the products and sums far from overflowing
+constexpr int64_t MAX_VALUE = int64_t{1} << 40;
+
+// Whether 'a' times 'b' is at most MAX_VALUE in magnitude
+bool product_fits(int64_t a, int64_t b) {
+    return b == 0 or std::abs(a) <= MAX_VALUE / std::abs(b);
+}
+
+// Whether all values of 'affine' are representable in the type of its view
+bool fits(const Affine &affine) {
+    const bh_type type = affine.view.base->type;
+    if (not bh_type_is_integer(type) or std::abs(affine.offset) > MAX_VALUE) {
+        return false;
+    }
+    // NB: each term of min() and max() is at most MAX_VALUE thus they cannot overflow
+    for (int64_t d = 0; d < affine.view.ndim; ++d) {
+        if (std::abs(affine.coef[d]) > MAX_VALUE / std::max(affine.view.shape[d], int64_t{1})) {
+            return false;
+        }
+    }
+    const int64_t lo = affine.min(), hi = affine.max();
+    return lo >= bh_type_limit_min_integer(type) and
+           static_cast<uint64_t>(std::max(hi, int64_t{0})) <= bh_type_limit_max_integer(type);
+}
+
+// The view of 'base' at 'start' whose elements are at the values of 'affine'
+bh_view indexed_view(bh_base *base, int64_t start, const Affine &affine) {
+    bh_view ret(affine.view);
+    ret.base = base;
+    ret.start = start + affine.offset;
+    for (int64_t d = 0; d < ret.ndim; ++d) {
+        ret.stride[d] = affine.coef[d];
+    }
+    return ret;
+}
+
+// Whether all elements of 'view' are inside its base
+bool in_bounds(const bh_view &view, const Affine &affine) {
+    const int64_t lo = view.start - affine.offset + affine.min();
+    const int64_t hi = view.start - affine.offset + affine.max();
+    return lo >= 0 and hi < view.base->nelem;
+}
+
+// Whether no two elements of 'view' are the same element of its base
+bool non_overlapping(const bh_view &view) {
+    vector<pair<int64_t, int64_t> > dims; // The absolute stride and shape of the dimensions
+    for (int64_t d = 0; d < view.ndim; ++d) {
+        if (view.shape[d] > 1) {
+            dims.push_back(make_pair(std::abs(view.stride[d]), view.shape[d]));
+        }
+    }
+    std::sort(dims.begin(), dims.end());
+    int64_t extent = 1; // The number of elements spanned by the smaller dimensions
+    for (const pair<int64_t, int64_t> &dim: dims) {
+        if (dim.first < extent) {
+            return false;
+        }
+        extent = dim.first * dim.second;
+    }
+    return true;
+}
+}
+
+void Contracter::contract_gather(bh_ir &bhir)
+{
+    vector<bh_instruction> &instr_list = bhir.instr_list;
+    for (const bh_instruction &instr: instr_list) {
+        if (instr.opcode == BH_REPEAT) {
+            // The body of a repeat is executed with the values of the previous repetition
+            return;
+        }
+    }
+
+    // The affine values of each base since its last write
+    unordered_map<const bh_base*, Affine> affines;
+    uint64_t count = 0;
+    for (bh_instruction &instr: instr_list) {
+        if (instr.operand.empty() or instr.opcode == BH_NONE or instr.opcode == BH_TALLY or
+            instr.opcode == BH_SYNC) {
+            continue;
+        }
+        const bh_view &out = instr.operand[0];
+        if ((instr.opcode == BH_GATHER or instr.opcode == BH_SCATTER) and
+            instr.operand[0].base != instr.operand[1].base) {
+            // Gather and scatter of indexes in 'affine' are copies of strided views
+            auto it = affines.find(instr.operand[2].base);
+            bool same_shape = it != affines.end() and it->second.view == instr.operand[2] and
+                              out.ndim == instr.operand[2].ndim;
+            for (int64_t d = 0; same_shape and d < out.ndim; ++d) {
+                same_shape = out.shape[d] == instr.operand[2].shape[d];
+            }
+            if (same_shape) {
+                const Affine &affine = it->second;
+                if (instr.opcode == BH_GATHER) {
+                    const bh_view in = indexed_view(instr.operand[1].base, instr.operand[1].start, affine);
+                    if (in_bounds(in, affine)) {
+                        instr.opcode = BH_IDENTITY;
+                        instr.operand = {out, in};
+                        ++count;
+                    }
+                } else {
+                    const bh_view dst = indexed_view(out.base, out.start, affine);
+                    if (in_bounds(dst, affine) and non_overlapping(dst)) {
+                        instr.opcode = BH_IDENTITY;
+                        instr.operand = {dst, instr.operand[1]};
+                        ++count;
+                    }
+                }
+            }
+        }
+
+        // Let's find the affine values of the output, if any
+        const bh_view &dst = instr.operand[0];
+        Affine affine;
+        bool found = false;
+        if (instr.opcode == BH_RANGE) {
+            affine.view = dst;
+            affine.offset = 0;
+            for (int64_t d = 0; d < dst.ndim; ++d) {
+                affine.coef[d] = dst.stride[d];
+            }
+            found = true;
+        } else if (instr.operand.size() >= 2 and (instr.opcode == BH_IDENTITY or instr.opcode == BH_ADD or
+                                                  instr.opcode == BH_SUBTRACT or instr.opcode == BH_MULTIPLY)) {
+            // The array input and the integer constant, if any
+            const bool const_first = instr.operand.size() == 3 and bh_is_constant(&instr.operand[1]);
+            const bh_view &in = instr.operand[const_first ? 2 : 1];
+            const bool has_const = instr.operand.size() == 3 and bh_is_constant(&instr.operand[const_first ? 1 : 2]);
+            auto it = bh_is_constant(&in) ? affines.end() : affines.find(in.base);
+            const bool valid_const = has_const ? bh_type_is_integer(instr.constant.type)
+                                               : instr.opcode == BH_IDENTITY;
+            bool same_shape = it != affines.end() and it->second.view == in and valid_const and dst.ndim == in.ndim;
+            for (int64_t d = 0; same_shape and d < dst.ndim; ++d) {
+                same_shape = dst.shape[d] == in.shape[d];
+            }
+            // The constant, which is clamped to the largest int64 when it is a larger unsigned integer
+            int64_t k = 0;
+            if (has_const and valid_const) {
+                if (bh_type_is_signed_integer(instr.constant.type)) {
+                    k = instr.constant.get_int64();
+                } else {
+                    k = static_cast<int64_t>(std::min(instr.constant.get_uint64(), uint64_t{INT64_MAX}));
+                }
+            }
+            if (same_shape and std::abs(k) <= MAX_VALUE) {
+                affine = it->second;
+                affine.view = dst;
+                switch (instr.opcode) {
+                    case BH_ADD:
+                        affine.offset += k;
+                        found = true;
+                        break;
+                    case BH_SUBTRACT:
+                        if (const_first) { // The constant minus the values
+                            affine.offset = k - affine.offset;
+                            for (int64_t d = 0; d < dst.ndim; ++d) {
+                                affine.coef[d] = -affine.coef[d];
+                            }
+                        } else {
+                            affine.offset -= k;
+                        }
+                        found = true;
+                        break;
+                    case BH_MULTIPLY:
+                        found = product_fits(affine.offset, k);
+                        affine.offset *= found ? k : 0;
+                        for (int64_t d = 0; d < dst.ndim; ++d) {
+                            found = found and product_fits(affine.coef[d], k);
+                            affine.coef[d] *= found ? k : 0;
+                        }
+                        break;
+                    default:
+                        found = true;
+                        break;
+                }
+            }
+        }
+
+        // The write invalidates the earlier values of the base
+        affines.erase(dst.base);
+        if (found and fits(affine)) {
+            affines[dst.base] = affine;
+        }
+    }
+    if (count > 0) {
+        verbose_print("[Gather] \tReplaced " + std::to_string(count) + " gathers and scatters with strided copies.");
+    }
+}
+
+}}}
@@ -0,0 +1,157 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "contracter.hpp"
+
+#include <sstream>
+
+using namespace std;
+
+namespace bohrium {
+namespace filter {
+namespace bccon {
+
+/* A generator is a BH_RANGE, BH_RANDOM, or a fill with a constant that writes all of a fresh base. Instead of
+ * materializing the base, we remove the generator and insert it again in the flushes that use the base:
+ *  - a flush that only reads the base gets the generator writing a temporary base, which replaces the base in the
+ *    reads and is freed at the end of the flush, thus the engine fuses the generator into the kernels that read it
+ *  - a flush that writes, syncs, or calls an extension method on the base gets the generator writing the base
+ *    itself before the first access, which materializes it
+ *  - a flush that frees the base drops the generator
+ * NB: the base must stay without data while it is virtual, which rules out a bridge that sets the data directly.
+ */
+static bool is_generator(const bh_instruction &instr)
+{
+    if (instr.operand.empty() or instr.operand[0].base == nullptr) {
+        return false;
+    }
+    if (instr.opcode != BH_RANGE and instr.opcode != BH_RANDOM and instr.opcode != BH_IDENTITY) {
+        return false;
+    }
+    for (size_t i = 1; i < instr.operand.size(); ++i) {
+        if (not bh_is_constant(&instr.operand[i])) {
+            return false;
+        }
+    }
+    if (instr.opcode == BH_IDENTITY and not instr.has_constant()) {
+        return false;
+    }
+    const bh_view &out = instr.operand[0];
+    return out.base->data == nullptr and out.start == 0 and bh_is_contiguous(&out) and
+           bh_nelements(out) == out.base->nelem;
+}
+
+// Whether 'instr' needs the data of 'base' in memory rather than only reading its values
+static bool materializes(const bh_instruction &instr, const bh_base *base)
+{
+    return instr.opcode >= BH_MAX_OPCODE_ID or instr.opcode == BH_SYNC or instr.operand[0].base == base;
+}
+
+void Contracter::contract_generators(bh_ir &bhir)
+{
+    // The temporary bases of the previous flush, which freed them
+    generator_temps_.clear();
+    bool repeat = false, any = not generators_.empty();
+    for (const bh_instruction &instr: bhir.instr_list) {
+        repeat = repeat or instr.opcode == BH_REPEAT;
+        any = any or is_generator(instr);
+    }
+    if (not any) {
+        return;
+    }
+
+    vector<bh_instruction> instr_list;
+    instr_list.reserve(bhir.instr_list.size());
+    // A bh_ir with repeats materializes the bases it uses before anything else, which keeps the repeat bodies intact
+    if (repeat) {
+        for (const bh_instruction &instr: bhir.instr_list) {
+            for (const bh_view &view: instr.operand) {
+                auto it = bh_is_constant(&view) ? generators_.end() : generators_.find(view.base);
+                if (it != generators_.end()) {
+                    if (view.base->data == nullptr) {
+                        instr_list.push_back(it->second);
+                    }
+                    generators_.erase(it);
+                }
+            }
+        }
+        instr_list.insert(instr_list.end(), bhir.instr_list.begin(), bhir.instr_list.end());
+        bhir.instr_list = std::move(instr_list);
+        return;
+    }
+
+    // The temporary base of each virtual base that this flush reads
+    map<const bh_base*, bh_base*> temps;
+    uint64_t deferred = 0, inlined = 0, materialized = 0;
+    for (bh_instruction &instr: bhir.instr_list) {
+        if (is_generator(instr)) {
+            generators_[instr.operand[0].base] = instr;
+            temps.erase(instr.operand[0].base);
+            ++deferred;
+            continue;
+        }
+        for (bh_view &view: instr.operand) {
+            if (bh_is_constant(&view)) {
+                continue;
+            }
+            auto it = generators_.find(view.base);
+            if (it != generators_.end()) {
+                if (instr.opcode == BH_FREE or view.base->data != nullptr) { // Dead or set by the bridge
+                    generators_.erase(it);
+                    temps.erase(view.base);
+                } else if (materializes(instr, view.base)) {
+                    instr_list.push_back(it->second);
+                    generators_.erase(it);
+                    temps.erase(view.base);
+                    ++materialized;
+                } else {
+                    bh_base *&temp = temps[view.base];
+                    if (temp == nullptr) {
+                        generator_temps_.emplace_back(new bh_base(*view.base));
+                        temp = generator_temps_.back().get();
+                        instr_list.push_back(it->second);
+                        instr_list.back().operand[0].base = temp;
+                        ++inlined;
+                    }
+                    view.base = temp;
+                }
+            }
+        }
+        instr_list.push_back(std::move(instr));
+    }
+    for (const unique_ptr<bh_base> &temp: generator_temps_) {
+        bh_view view;
+        view.base = temp.get();
+        view.start = 0;
+        view.ndim = 1;
+        view.shape[0] = temp->nelem;
+        view.stride[0] = 1;
+        instr_list.emplace_back(BH_FREE, vector<bh_view>{view});
+    }
+    bhir.instr_list = std::move(instr_list);
+
+    if (deferred > 0 or inlined > 0 or materialized > 0) {
+        stringstream ss;
+        ss << "Generators: " << deferred << " deferred, " << inlined << " inlined, and " << materialized
+           << " materialized.";
+        verbose_print(ss.str());
+    }
+}
+
+}}}
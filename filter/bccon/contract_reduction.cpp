@@ -18,6 +18,7 @@ GNU Lesser General Public License along with Bohrium.
 If not, see <http://www.gnu.org/licenses/>.
 */
 #include "contracter.hpp"
+#include "rewrite.hpp"
 
 using namespace std;
 
@@ -25,97 +26,85 @@ namespace bohrium {
 namespace filter {
 namespace bccon {
 
-static void rewrite_chain(vector<bh_instruction*>& links, bh_instruction* &first, bh_instruction* &last)
-{
-    // Rewrite the first reduction as a "COMPLETE" REDUCE.
-    // Copy the meta-data of the SCALAR output from the last REDUCE
-    first->operand[0] = last->operand[0];
-
-    // Set the last reduction to NONE, it no longer needs execution.
-    last->opcode = BH_NONE;
+using namespace rewrite;
 
-    // Set all the instructions "links" in the chain as BH_NONE
-    // they no longer need execution.
-    vector<bh_instruction*>::iterator rit;
-    for(rit = links.begin(); rit != links.end(); ++rit) {
-        bh_instruction& rinstr = **rit;
-        rinstr.opcode = BH_NONE;
+/* The input of the first reduction where the two reduced axes are merged into one, which it returns the index
+ * of, or -1 when the strides of the axes do not nest. The reduction over both axes does not depend on their order
+ * thus the axes need not be adjacent and either axis may be the inner one.
+ */
+static int64_t merged_input(const Match &match, bh_view &merged)
+{
+    const bh_view &in = match.vars.at(0);
+    const int64_t first = match.instr(0).constant.get_int64();
+    const int64_t second = match.root().constant.get_int64();
+    if (in.ndim < 2 or first < 0 or first >= in.ndim or second < 0 or second >= in.ndim - 1) {
+        return -1;
     }
+    // Reducing the rows of a matrix and then the partials is already a parallel reduction (see bcexp's reduce1d)
+    if (in.ndim == 2 and first == 1) {
+        return -1;
+    }
+    // The axis of the input that the second reduction reduces
+    const int64_t axis = second < first ? second : second + 1;
+    const int64_t lo = std::min(first, axis);
+    const int64_t hi = std::max(first, axis);
+    int64_t inner;
+    if (in.shape[hi] == 1 or in.stride[lo] == in.stride[hi] * in.shape[hi]) {
+        inner = hi;
+    } else if (in.shape[lo] == 1 or in.stride[hi] == in.stride[lo] * in.shape[lo]) {
+        inner = lo;
+    } else {
+        return -1;
+    }
+    merged = in;
+    merged.shape[lo] = in.shape[lo] * in.shape[hi];
+    merged.stride[lo] = in.stride[inner];
+    merged.remove_axis(hi);
+    return lo;
 }
 
-void Contracter::contract_reduction(bh_ir &bhir)
-{
-    bh_opcode reduce_opcode = BH_NONE;
-    bh_instruction* first;
-    bh_instruction* last;
-
-    std::set<const bh_base*> bases;
-
-    // Instructions in the chain that are not, the first and the last reduction.
-    vector<bh_instruction*> links;
-
-    for(size_t pc = 0; pc < bhir.instr_list.size(); ++pc) {
-        bh_instruction& instr = bhir.instr_list[pc];
-
-        // Look for the "first" reduction in a chain of reductions
-        if (bh_opcode_is_reduction(instr.opcode) and instr.operand[0].base->nelem > 1) {
-            reduce_opcode = instr.opcode;
-            bases.insert(instr.operand[0].base);
-
-            first = &instr;
-            last  = NULL;
-
-            for(size_t pc_chain = pc+1; pc_chain < bhir.instr_list.size(); ++pc_chain) {
-                bh_instruction& other_instr = bhir.instr_list[pc_chain];
-
-                bool other_use = false;
-                for(bh_view &other_view: other_instr.operand) {
-                    if (bh_is_constant(&other_view)) {
-                        continue;
-                    }
-
-                    if (bases.find(other_view.base) != bases.end()) {
-                        other_use = true;
-                        break;
-                    }
-                }
-
-                if (!other_use) {
-                    continue;
-                }
+/*
+We are looking for chains of the same reduction where the intermediate result
+is only reduced further, like np.sum() of a matrix, which reduces one axis at
+a time:
 
-                bool is_none    = other_instr.opcode == BH_NONE;
-                bool is_freed   = other_instr.opcode == BH_FREE;
-                bool is_reduced = other_instr.opcode == reduce_opcode;
+  BH_ADD_REDUCE a1[0:3] a0[0:4,0:3] 0
+  BH_ADD_REDUCE a2[0:1] a1[0:3] 0
+  BH_FREE a1
 
-                if (!(is_none or is_freed or is_reduced)) {
-                    // Chain is broken - Reset the search
-                    first = NULL;
-                    break;
-                } else if (other_instr.operand[0].base->nelem == 1) {
-                    // Scalar output - End of the chain
-                    last = &other_instr;
-                } else {
-                    links.push_back(&other_instr);
-                    if (other_instr.opcode == reduce_opcode) {
-                        bases.insert(other_instr.operand[0].base);
-                    }
-                }
-            }
+which we rewrite into one reduction over the two axes:
 
-            if (first and last) {
-                verbose_print("[Reduction] Rewriting chain of length " + std::to_string(links.size()));
-                rewrite_chain(links, first, last);
-            }
+  BH_ADD_REDUCE a2[0:1] a0[0:12] 0
 
-            // Reset the search
-            reduce_opcode = BH_NONE;
-            first         = NULL;
-            last          = NULL;
-            links.clear();
-            bases.clear();
-        }
-    }
+The rule applies repeatedly thus the chain of a multi-axis reduction collapses
+into one reduction without the intermediate temporaries, which is a flat 1-D
+reduction when the input is contiguous (in any axis order).
+NB: the floating-point additions and multiplications are reassociated.
+*/
+void Contracter::contract_reduction(bh_ir &bhir)
+{
+    const vector<bh_opcode> reductions = {
+        BH_ADD_REDUCE, BH_MULTIPLY_REDUCE, BH_MINIMUM_REDUCE, BH_MAXIMUM_REDUCE,
+        BH_LOGICAL_AND_REDUCE, BH_LOGICAL_OR_REDUCE, BH_LOGICAL_XOR_REDUCE,
+        BH_BITWISE_AND_REDUCE, BH_BITWISE_OR_REDUCE, BH_BITWISE_XOR_REDUCE
+    };
+    const vector<Rule> rules = {
+        {"Reduction", {{reductions, {var(0), constant()}},
+                       {reductions, {result(0), constant()}}},
+         [](const Match &m) {
+             bh_view merged;
+             const bh_type type = m.root().operand[0].base->type;
+             return m.instr(0).opcode == m.root().opcode and m.vars.at(0).base->type == type and
+                    m.instr(0).operand[0].base->type == type and merged_input(m, merged) >= 0;
+         },
+         [](const Match &m) {
+             bh_view merged;
+             const int64_t axis = merged_input(m, merged);
+             return with_constant(m.root().opcode, m.root().operand[0], merged, bh_type::INT64,
+                                  static_cast<double>(axis));
+         }},
+    };
+    rewrite::apply(bhir, rules);
 }
 
 }}}
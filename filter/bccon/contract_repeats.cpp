@@ -108,6 +108,7 @@ void Contracter::contract_repeats(bh_ir &bhir)
                     // Create a BH_REPEAT instruction
                     bh_instruction repeat_instr;
                     repeat_instr.opcode = BH_REPEAT;
+                    repeat_instr.operand.resize(1);
                     repeat_instr.operand[0].base = NULL;
 
                     // We use the BH_R123 type, because this can hold two values
@@ -18,6 +18,7 @@ GNU Lesser General Public License along with Bohrium.
 If not, see <http://www.gnu.org/licenses/>.
 */
 #include "contracter.hpp"
+#include "rewrite.hpp"
 
 using namespace std;
 
@@ -25,74 +26,74 @@ namespace bohrium {
 namespace filter {
 namespace bccon {
 
-static inline bool is_multiplying_by_one(const bh_instruction& instr)
-{
-    return instr.opcode == BH_MULTIPLY and
-           instr.constant.get_double() == 1.0;
-}
+using namespace rewrite;
 
-static inline bool is_dividing_by_one(const bh_instruction& instr)
+// Whether the constant of the root is 'value' and the output has the type of the input
+static bool is_neutral(const Match &match, double value, bool allow_float)
 {
-    return instr.opcode == BH_DIVIDE and
-           instr.constant.get_double() == 1.0;
+    const bh_instruction &instr = match.root();
+    const bh_type type = instr.operand[0].base->type;
+    if (instr.constant.type != type or match.vars.at(0).base->type != type) {
+        return false;
+    }
+    if (not (bh_type_is_integer(type) or (allow_float and is_real(type)))) {
+        return false;
+    }
+    return instr.constant.get_double() == value;
 }
 
-static inline bool is_adding_zero(const bh_instruction& instr)
+static bh_instruction identity(const Match &match)
 {
-    return instr.opcode == BH_ADD and
-           instr.constant.get_double() == 0.0;
+    return bh_instruction(BH_IDENTITY, {match.root().operand[0], match.vars.at(0)});
 }
 
-static inline bool is_subtracting_zero(const bh_instruction& instr)
+// Sets the output of the root to 'value'
+static bh_instruction fill(const Match &match, double value)
 {
-    return instr.opcode == BH_SUBTRACT and
-           instr.constant.get_double() == 0.0;
+    const bh_view &out = match.root().operand[0];
+    bh_view constant;
+    constant.base = nullptr;
+    bh_instruction ret(BH_IDENTITY, {out, constant});
+    ret.constant.type = out.base->type;
+    ret.constant.set_double(value);
+    return ret;
 }
 
-static inline bool is_entire_view(const bh_instruction& instr)
-{
-    for(const bh_view &view: instr.operand) {
-        if (bh_is_contiguous(&view)) {
-            return true;
-        }
-    }
-    return false;
-}
+/*
+We are looking for the instructions that do not change their input such as:
 
-static inline bool is_doing_stupid_math(const bh_instruction& instr)
-{
-    return instr.has_constant() and
-           bh_type_is_integer(instr.constant.type) and
-           (
-               is_multiplying_by_one(instr) or
-               is_dividing_by_one(instr) or
-               is_adding_zero(instr) or
-               is_subtracting_zero(instr)
-           ) and
-           is_entire_view(instr);
-}
+  BH_ADD B A 0
+
+which we replace with:
+
+  BH_IDENTITY B A
 
+or whose output does not depend on the input, such as 'x**0', which we replace
+with an identity of the constant.
+
+NB: adding zero to negative zero gives positive zero thus we only remove
+    the floating-point multiplications, divisions, and subtractions. Likewise,
+    multiplying NaN by zero gives NaN thus only the integer 'x*0' is removed.
+*/
 void Contracter::contract_stupidmath(bh_ir &bhir)
 {
-    for(bh_instruction& instr: bhir.instr_list) {
-        if (is_doing_stupid_math(instr)) {
-            verbose_print("[Stupid math] Is doing stupid math with a " + std::string(bh_opcode_text(instr.opcode)));
-
-            // We could have the following:
-            //   BH_ADD B A 0
-            //   BH_FREE A
-            //   BH_SYNC B
-            // We want to find the add and replace it with BH_IDENTITY
-            instr.opcode = BH_IDENTITY;
-
-            // We need to figure out which operand is the constant, and remove it
-            if (bh_is_constant(&(instr.operand[1]))) {
-                instr.operand.erase(instr.operand.begin() + 1);
-            } else {
-                instr.operand.erase(instr.operand.begin() + 2);
-            }
-        }
-    }
+    const vector<Rule> rules = {
+        {"Stupid math", {{{BH_ADD}, {var(0), constant()}}},
+         [](const Match &m) { return is_neutral(m, 0.0, false); }, identity},
+        {"Stupid math", {{{BH_SUBTRACT}, {var(0), constant()}}},
+         [](const Match &m) { return is_neutral(m, 0.0, true); }, identity},
+        {"Stupid math", {{{BH_MULTIPLY, BH_DIVIDE}, {var(0), constant()}}},
+         [](const Match &m) { return is_neutral(m, 1.0, true); }, identity},
+        {"Stupid math", {{{BH_POWER}, {var(0), constant()}}},
+         [](const Match &m) { return is_neutral(m, 1.0, true); }, identity},
+        {"Stupid math", {{{BH_POWER}, {var(0), constant()}}},
+         [](const Match &m) { return is_neutral(m, 0.0, true); },
+         [](const Match &m) { return fill(m, 1.0); }},
+        {"Stupid math", {{{BH_MULTIPLY}, {var(0), constant()}}},
+         [](const Match &m) { return is_neutral(m, 0.0, false); },
+         [](const Match &m) { return fill(m, 0.0); }},
+    };
+    rewrite::apply(bhir, rules);
 }
 
 }}}
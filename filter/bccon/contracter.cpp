@@ -32,12 +32,26 @@ Contracter::Contracter(
     bool reduction,
     bool stupidmath,
     bool collect,
-    bool muladd)
+    bool muladd,
+    bool cse,
+    bool deadstore,
+    bool constprop,
+    bool gather,
+    bool generators,
+    bool cow,
+    bool casts)
     : repeats_(repeats),
       reduction_(reduction),
       stupidmath_(stupidmath),
       collect_(collect),
-      muladd_(muladd) {
+      muladd_(muladd),
+      cse_(cse),
+      deadstore_(deadstore),
+      constprop_(constprop),
+      gather_(gather),
+      generators_enabled_(generators),
+      cow_(cow),
+      casts_(casts) {
             __verbose = verbose;
       }
 
@@ -45,10 +59,19 @@ Contracter::~Contracter(void) {}
 
 void Contracter::contract(bh_ir& bhir)
 {
+    // NB: the removed round trips of casts might leave copies, which become aliases
+    if(casts_)      contract_casts(bhir);
+    // NB: the aliases of the copies might read virtual bases thus the copies go before the generators
+    if(cow_)        contract_cow(bhir);
+    if(generators_enabled_) contract_generators(bhir);
+    if(constprop_)  contract_constprop(bhir);
     if(reduction_)  contract_reduction(bhir);
     if(stupidmath_) contract_stupidmath(bhir);
     if(collect_)    contract_collect(bhir);
     if(muladd_)     contract_muladd(bhir);
+    if(cse_)        contract_cse(bhir);
+    if(gather_)     contract_gather(bhir);
+    if(deadstore_)  contract_deadstore(bhir);
     if(repeats_)    contract_repeats(bhir);
 }
 
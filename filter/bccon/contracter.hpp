@@ -1,6 +1,11 @@
 #ifndef __BH_FILTER_COMPOSITE_CONTRACTER
 #define __BH_FILTER_COMPOSITE_CONTRACTER
 
+#include <map>
+#include <memory>
+#include <set>
+#include <vector>
+
 #include <bh_component.hpp>
 
 namespace bohrium {
@@ -13,23 +18,52 @@ extern void verbose_print(std::string str);
 class Contracter
 {
 public:
-    Contracter(bool verbose, bool repeats, bool reduction, bool stupidmath, bool collect, bool muladd);
+    Contracter(bool verbose, bool repeats, bool reduction, bool stupidmath, bool collect, bool muladd, bool cse,
+               bool deadstore, bool constprop, bool gather, bool generators, bool cow, bool casts);
 
     ~Contracter(void);
 
     void contract(bh_ir& bhir);
 
     void contract_repeats(bh_ir& bhir);
+    // Evaluates the instructions whose inputs are constants or 1-element bases with known values
+    void contract_constprop(bh_ir& bhir);
     void contract_reduction(bh_ir& bhir);
     void contract_stupidmath(bh_ir& bhir);
     void contract_collect(bh_ir& bhir);
     void contract_muladd(bh_ir& bhir);
+    // Common-subexpression elimination of the instructions that compute the same values as an earlier instruction
+    void contract_cse(bh_ir& bhir);
+    // Removes the instructions whose output is freed or overwritten before anything reads it
+    void contract_deadstore(bh_ir& bhir);
+    // Replaces the gathers and scatters of indexes that are affine in a BH_RANGE with copies of strided views
+    void contract_gather(bh_ir& bhir);
+    // Keeps the bases that generators (BH_RANGE, BH_RANDOM, and constant fills) write virtual across flushes
+    // by inlining the generators into the flushes that read them
+    void contract_generators(bh_ir& bhir);
+    // Replaces the whole-array copies (BH_IDENTITY) with aliases of their source until either side is written
+    void contract_cow(bh_ir& bhir);
+    // Removes the value-preserving round trips of casts and sinks widening casts into the operation that reads them
+    void contract_casts(bh_ir& bhir);
 private:
     bool repeats_;
     bool reduction_;
     bool stupidmath_;
     bool collect_;
     bool muladd_;
+    bool cse_;
+    bool deadstore_;
+    bool constprop_;
+    bool gather_;
+    bool generators_enabled_;
+    // The generators of the virtual bases and the temporary bases that the last flush inlined them into
+    std::map<const bh_base*, bh_instruction> generators_;
+    std::vector<std::unique_ptr<bh_base> > generator_temps_;
+    bool cow_;
+    // The copies that are aliases of their source and the aliases of each source
+    std::map<const bh_base*, bh_instruction> copies_;
+    std::map<const bh_base*, std::set<const bh_base*> > copy_sources_;
+    bool casts_;
 };
 
 }}}
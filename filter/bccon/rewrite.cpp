@@ -0,0 +1,399 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "contracter.hpp"
+#include "rewrite.hpp"
+
+#include <set>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <unordered_map>
+
+using namespace std;
+
+namespace bohrium {
+namespace filter {
+namespace bccon {
+namespace rewrite {
+
+namespace {
+
+const size_t NOT_MATCHED = numeric_limits<size_t>::max();
+
+bool is_commutative(bh_opcode opcode)
+{
+    switch (opcode) {
+        case BH_ADD:
+        case BH_MULTIPLY:
+        case BH_MAXIMUM:
+        case BH_MINIMUM:
+        case BH_EQUAL:
+        case BH_NOT_EQUAL:
+        case BH_LOGICAL_AND:
+        case BH_LOGICAL_OR:
+        case BH_LOGICAL_XOR:
+        case BH_BITWISE_AND:
+        case BH_BITWISE_OR:
+        case BH_BITWISE_XOR:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Whether 'instr' writes to 'base'
+bool writes(const bh_instruction &instr, const bh_base *base)
+{
+    return not bh_opcode_is_system(instr.opcode) and not instr.operand.empty() and instr.operand[0].base == base;
+}
+
+class Rewriter {
+public:
+    explicit Rewriter(vector<bh_instruction> &instr_list) : instr_list(instr_list) {
+        index();
+    }
+
+    // Rewrites the instruction at 'pc' with 'rule' when it applies
+    bool rewrite(const Rule &rule, size_t pc);
+
+private:
+    vector<bh_instruction> &instr_list;
+    // The indices of the instructions that use each base in ascending order
+    unordered_map<const bh_base *, vector<size_t> > uses;
+
+    void index();
+    // The instruction before 'pc' that computes 'view' or -1 when the value of 'view' at 'pc' has another origin
+    int64_t producer(size_t pc, const bh_view &view) const;
+    bool match_instr(const Rule &rule, size_t index, size_t pc, Match &match) const;
+    bool match_inputs(const Rule &rule, size_t index, size_t pc, const vector<size_t> &order, Match &match) const;
+    // Whether only the match reads the result of the instruction 'index' of the match
+    bool is_private(const Match &match, size_t index) const;
+    // Whether the variables of the match have the same value at the root as where the match reads them
+    bool is_stable(const Match &match) const;
+};
+
+void Rewriter::index()
+{
+    uses.clear();
+    for (size_t pc = 0; pc < instr_list.size(); ++pc) {
+        const bh_instruction &instr = instr_list[pc];
+        if (instr.opcode == BH_NONE) {
+            continue;
+        }
+        for (const bh_view &view: instr.operand) {
+            if (bh_is_constant(&view)) {
+                continue;
+            }
+            vector<size_t> &pcs = uses[view.base];
+            if (pcs.empty() or pcs.back() != pc) {
+                pcs.push_back(pc);
+            }
+        }
+    }
+}
+
+int64_t Rewriter::producer(size_t pc, const bh_view &view) const
+{
+    const auto it = uses.find(view.base);
+    if (it == uses.end()) {
+        return -1;
+    }
+    const vector<size_t> &pcs = it->second;
+    for (auto i = lower_bound(pcs.begin(), pcs.end(), pc); i != pcs.begin();) {
+        --i;
+        const bh_instruction &instr = instr_list[*i];
+        if (instr.opcode == BH_FREE) {
+            return -1;
+        }
+        if (writes(instr, view.base)) {
+            // The scatters and extension methods do not compute all of their output from their inputs
+            const bool full = instr.opcode < BH_MAX_OPCODE_ID and instr.opcode != BH_SCATTER and
+                              instr.opcode != BH_COND_SCATTER and instr.opcode != BH_ADD_SCATTER;
+            return full and instr.operand[0] == view ? static_cast<int64_t>(*i) : -1;
+        }
+    }
+    return -1;
+}
+
+bool Rewriter::match_instr(const Rule &rule, size_t index, size_t pc, Match &match) const
+{
+    const Instr &pattern = rule.match[index];
+    const bh_instruction &instr = instr_list[pc];
+    if (find(pattern.opcodes.begin(), pattern.opcodes.end(), instr.opcode) == pattern.opcodes.end() or
+        instr.operand.size() != pattern.inputs.size() + 1 or
+        find(match.pcs.begin(), match.pcs.end(), pc) != match.pcs.end()) {
+        return false;
+    }
+
+    vector<vector<size_t> > orders(1);
+    for (size_t i = 0; i < pattern.inputs.size(); ++i) {
+        orders[0].push_back(i);
+    }
+    if (is_commutative(instr.opcode) and pattern.inputs.size() == 2) {
+        orders.push_back({1, 0});
+    }
+    for (const vector<size_t> &order: orders) {
+        Match attempt = match;
+        attempt.pcs[index] = pc;
+        if (match_inputs(rule, index, pc, order, attempt)) {
+            match = attempt;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Rewriter::match_inputs(const Rule &rule, size_t index, size_t pc, const vector<size_t> &order,
+                            Match &match) const
+{
+    const Instr &pattern = rule.match[index];
+    const bh_instruction &instr = instr_list[pc];
+    for (size_t i = 0; i < pattern.inputs.size(); ++i) {
+        const Operand &input = pattern.inputs[i];
+        const bh_view &view = instr.operand[1 + order[i]];
+        if (input.kind == Operand::CONSTANT) {
+            if (not bh_is_constant(&view)) {
+                return false;
+            }
+            continue;
+        }
+        if (bh_is_constant(&view)) {
+            return false;
+        }
+        if (input.kind == Operand::VAR) {
+            const auto it = match.vars.find(input.id);
+            if (it == match.vars.end()) {
+                match.vars.insert(make_pair(input.id, view));
+            } else if (not (it->second == view)) {
+                return false;
+            }
+            continue;
+        }
+        assert(input.kind == Operand::RESULT and static_cast<size_t>(input.id) < index);
+        const int64_t p = producer(pc, view);
+        if (p < 0) {
+            return false;
+        }
+        if (match.pcs[input.id] != NOT_MATCHED) {
+            if (match.pcs[input.id] != static_cast<size_t>(p)) {
+                return false;
+            }
+        } else if (not match_instr(rule, input.id, static_cast<size_t>(p), match)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Rewriter::is_private(const Match &match, size_t index) const
+{
+    const size_t pc = match.pcs[index];
+    const size_t root_pc = match.pcs.back();
+    const bh_view &result = instr_list[pc].operand[0];
+    for (size_t i: uses.at(result.base)) {
+        if (i <= pc) {
+            continue;
+        }
+        const bh_instruction &instr = instr_list[i];
+        if (i > root_pc) {
+            return instr.opcode == BH_FREE;
+        }
+        if (i < root_pc and
+            (find(match.pcs.begin(), match.pcs.end(), i) == match.pcs.end() or writes(instr, result.base))) {
+            return false;
+        }
+        for (size_t o = 1; o < instr.operand.size(); ++o) {
+            const bh_view &view = instr.operand[o];
+            if (not bh_is_constant(&view) and view.base == result.base and not (view == result)) {
+                return false;
+            }
+        }
+        // The root may overwrite the result, which then is invisible to the rest of the flush
+        if (i == root_pc and writes(instr, result.base)) {
+            return instr.operand[0] == result;
+        }
+    }
+    // The result is visible after the flush
+    return false;
+}
+
+bool Rewriter::is_stable(const Match &match) const
+{
+    const size_t root_pc = match.pcs.back();
+    const bh_instruction &root = instr_list[root_pc];
+    for (const auto &v: match.vars) {
+        const bh_view &var = v.second;
+        if (writes(root, var.base) and not (root.operand[0] == var)) {
+            return false;
+        }
+        // The matched instructions that read the variable
+        size_t first = NOT_MATCHED, last = 0;
+        for (size_t pc: match.pcs) {
+            const bh_instruction &instr = instr_list[pc];
+            for (size_t o = 1; o < instr.operand.size(); ++o) {
+                if (not bh_is_constant(&instr.operand[o]) and instr.operand[o].base == var.base) {
+                    first = std::min(first, pc);
+                    last = std::max(last, pc);
+                }
+            }
+        }
+        // A matched instruction may write the variable after the last read since the rewrite removes it
+        for (size_t i: uses.at(var.base)) {
+            const bh_instruction &instr = instr_list[i];
+            if (i <= first or i >= root_pc or not (writes(instr, var.base) or instr.opcode == BH_FREE)) {
+                continue;
+            }
+            if (i < last or instr.opcode == BH_FREE or
+                find(match.pcs.begin(), match.pcs.end(), i) == match.pcs.end()) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool Rewriter::rewrite(const Rule &rule, size_t pc)
+{
+    Match match;
+    match.instr_list = &instr_list;
+    match.pcs.assign(rule.match.size(), NOT_MATCHED);
+    if (not match_instr(rule, rule.match.size() - 1, pc, match)) {
+        return false;
+    }
+    for (size_t index = 0; index + 1 < match.pcs.size(); ++index) {
+        if (match.pcs[index] == NOT_MATCHED or not is_private(match, index)) {
+            return false;
+        }
+    }
+    if (not is_stable(match) or (rule.guard and not rule.guard(match))) {
+        return false;
+    }
+    bh_instruction instr = rule.build(match);
+    if (not well_formed(instr)) {
+        verbose_print("[" + rule.name + "] \tRewrite is not well-formed: " + instr.pprint());
+        return false;
+    }
+    instr.constructor = instr_list[pc].constructor;
+    instr.origin_id = instr_list[pc].origin_id;
+
+    verbose_print("[" + rule.name + "] Rewriting " + std::to_string(match.pcs.size()) + " instructions into: " +
+                  instr.pprint());
+    for (size_t i = 0; i + 1 < match.pcs.size(); ++i) {
+        instr_list[match.pcs[i]].opcode = BH_NONE;
+    }
+    instr_list[pc] = instr;
+    index();
+    return true;
+}
+
+} // Anon namespace
+
+bool is_real(bh_type type)
+{
+    return bh_type_is_integer(type) or type == bh_type::FLOAT32 or type == bh_type::FLOAT64;
+}
+
+bool representable(bh_type type, double value)
+{
+    if (not bh_type_is_integer(type)) {
+        return is_real(type);
+    }
+    // The doubles are exact integers below 2^53
+    if (value != std::trunc(value) or std::fabs(value) > 9007199254740992.0) {
+        return false;
+    }
+    bh_constant constant;
+    constant.type = type;
+    constant.set_double(value);
+    return constant.get_double() == value;
+}
+
+bh_instruction with_constant(bh_opcode opcode, const bh_view &out, const bh_view &in, bh_type type, double value)
+{
+    bh_view constant;
+    constant.base = nullptr;
+    bh_instruction ret(opcode, {out, in, constant});
+    ret.constant.type = type;
+    ret.constant.set_double(value);
+    return ret;
+}
+
+bool well_formed(const bh_instruction &instr)
+{
+    if (instr.operand.empty() or bh_is_constant(&instr.operand[0])) {
+        return false;
+    }
+    if (bh_opcode_is_elementwise(instr.opcode)) {
+        return instr.all_same_shape();
+    }
+    if (bh_opcode_is_reduction(instr.opcode)) {
+        if (instr.operand.size() != 3 or bh_is_constant(&instr.operand[1]) or not bh_is_constant(&instr.operand[2])) {
+            return false;
+        }
+        const bh_view &out = instr.operand[0];
+        const bh_view &in = instr.operand[1];
+        const int64_t axis = instr.constant.get_int64();
+        if (axis < 0 or axis >= in.ndim) {
+            return false;
+        }
+        if (in.ndim == 1) {
+            return out.ndim == 1 and out.shape[0] == 1;
+        }
+        if (out.ndim != in.ndim - 1) {
+            return false;
+        }
+        for (int64_t d = 0; d < out.ndim; ++d) {
+            if (out.shape[d] != in.shape[d < axis ? d : d + 1]) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+uint64_t apply(bh_ir &bhir, const vector<Rule> &rules)
+{
+    // The instructions of a repeat body are executed several times, which the def-use chains do not model
+    for (const bh_instruction &instr: bhir.instr_list) {
+        if (instr.opcode == BH_REPEAT) {
+            return 0;
+        }
+    }
+
+    uint64_t ret = 0;
+    Rewriter rewriter(bhir.instr_list);
+    bool progress = true;
+    while (progress) {
+        progress = false;
+        for (size_t pc = 0; pc < bhir.instr_list.size(); ++pc) {
+            for (const Rule &rule: rules) {
+                const vector<bh_opcode> &opcodes = rule.match.back().opcodes;
+                if (find(opcodes.begin(), opcodes.end(), bhir.instr_list[pc].opcode) != opcodes.end() and
+                    rewriter.rewrite(rule, pc)) {
+                    ++ret;
+                    progress = true;
+                }
+            }
+        }
+    }
+    return ret;
+}
+
+}}}}
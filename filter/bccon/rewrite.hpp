@@ -0,0 +1,98 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef __BH_FILTER_BCCON_REWRITE
+#define __BH_FILTER_BCCON_REWRITE
+
+#include <map>
+#include <string>
+#include <vector>
+#include <functional>
+
+#include <bh_ir.hpp>
+
+namespace bohrium {
+namespace filter {
+namespace bccon {
+namespace rewrite {
+
+// An input of a pattern instruction, which is a variable, the constant, or the result of another pattern instruction
+struct Operand {
+    enum Kind {VAR, CONSTANT, RESULT};
+    Kind kind;
+    // The variable id of a VAR or the index (in Rule::match) of the instruction of a RESULT
+    int id;
+};
+
+inline Operand var(int id) { return Operand{Operand::VAR, id}; }
+inline Operand constant() { return Operand{Operand::CONSTANT, -1}; }
+inline Operand result(int index) { return Operand{Operand::RESULT, index}; }
+
+// An instruction of a pattern, which matches any of 'opcodes'. The inputs of commutative opcodes match in both orders.
+struct Instr {
+    std::vector<bh_opcode> opcodes;
+    std::vector<Operand> inputs;
+};
+
+// The instructions and views that a rule matched
+struct Match {
+    const std::vector<bh_instruction> *instr_list;
+    // The index in the instruction list of each instruction in Rule::match
+    std::vector<size_t> pcs;
+    // The view of each variable
+    std::map<int, bh_view> vars;
+
+    const bh_instruction &instr(size_t index) const { return (*instr_list)[pcs[index]]; }
+    const bh_instruction &root() const { return instr(pcs.size() - 1); }
+};
+
+/* A rewrite of the instructions in 'match' where the last instruction is the root and the others compute results,
+ * which only the pattern reads. The root is replaced by the instruction of 'build' and the others are removed.
+ * A variable that occurs several times must be the same view each time.
+ */
+struct Rule {
+    std::string name;
+    std::vector<Instr> match;
+    // Whether the rule applies to a match, e.g. the types and values of the constants
+    std::function<bool(const Match &)> guard;
+    // The instruction that computes the result of the root from the variables and constants of the match
+    std::function<bh_instruction(const Match &)> build;
+};
+
+// Whether 'type' is an integer or a real floating-point type, which the constant folding of the rules supports
+bool is_real(bh_type type);
+
+// Whether a constant of 'type' represents 'value' exactly
+bool representable(bh_type type, double value);
+
+// An instruction that computes 'opcode' of 'in' and the constant 'value' of 'type' into 'out'
+bh_instruction with_constant(bh_opcode opcode, const bh_view &out, const bh_view &in, bh_type type, double value);
+
+// Whether the non-constant views of 'instr' have the shapes that the opcode requires
+bool well_formed(const bh_instruction &instr);
+
+/* Rewrite the instructions of 'bhir' with 'rules' until none applies and returns the number of rewrites.
+ * A rule only applies when the results of its non-root instructions are neither read nor written by other
+ * instructions and are freed in the flush (or overwritten by the root), when the variables are not written
+ * between the use in the pattern and the root, and when the rewritten root is well-formed.
+ */
+uint64_t apply(bh_ir &bhir, const std::vector<Rule> &rules);
+
+}}}}
+#endif
@@ -18,6 +18,9 @@ GNU Lesser General Public License along with Bohrium.
 If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <cstdlib>
+#include <algorithm>
+
 #include <bh_component.hpp>
 #include "expander.hpp"
 
@@ -26,9 +29,27 @@ using namespace component;
 using namespace std;
 
 namespace {
+
+// The hardware threads that the engine reports in its info or zero when it reports none
+int engine_threads(ComponentFace &child) {
+    string info;
+    try {
+        info = child.message("info");
+    } catch (const std::exception &) {
+        return 0;
+    }
+    const string key = "Hardware threads:";
+    const size_t pos = info.find(key);
+    if (pos == string::npos) {
+        return 0;
+    }
+    return std::max(0, std::atoi(info.c_str() + pos + key.size()));
+}
+
 class Impl : public ComponentImplWithChild {
 private:
     filter::bcexp::Expander expander;
+    bool threads_known = false;
 public:
     Impl(int stack_level) : ComponentImplWithChild(stack_level),
                             expander(config.defaultGet<bool>("verbose", false),
@@ -36,13 +57,31 @@ public:
                                      config.defaultGet<bool>("sign", true),
                                      config.defaultGet<bool>("powk", true),
                                      config.defaultGet<int>("reduce1d", 32000),
-                                     config.defaultGet<bool>("repeat", true)) {};
+                                     config.defaultGet<int>("scan1d", 32000),
+                                     config.defaultGet<bool>("repeat", true)) {
+        expander.set_deterministic(config.defaultGet<bool>("deterministic", false));
+    };
 
     ~Impl() {}; // NB: a destructor implementation must exist
     void execute(bh_ir *bhir) {
+        // Unless configured, ask the engine for its threads on the first flush
+        if (not threads_known) {
+            const int threads = config.defaultGet<int>("threads", 0);
+            expander.set_threads(threads > 0 ? threads : engine_threads(child));
+            threads_known = true;
+        }
         expander.expand(*bhir);
         child.execute(bhir);
     };
+
+    void extmethod(const string &name, bh_opcode opcode) {
+        // The stencils are expanded into instructions that the engines fuse, thus the child never sees them
+        if (name == "stencil_correlate" and config.defaultGet<bool>("stencil", true)) {
+            expander.set_stencil_opcode(opcode);
+        } else {
+            child.extmethod(name, opcode);
+        }
+    }
 };
 } //Unnamed namespace
 
@@ -28,6 +28,85 @@ namespace bcexp {
 
 static const int64_t max_exponent_unfolding = 100;
 
+namespace {
+
+// Searches for a star chain of length 'length' that ends in 'n' where each element
+// is the previous element plus the element at the index in 'terms'
+bool search_chain(vector<int64_t>& chain, vector<size_t>& terms, int64_t n, size_t length)
+{
+    const int64_t last = chain.back();
+    const size_t remaining = length - (chain.size() - 1);
+    if (remaining == 0) {
+        return last == n;
+    }
+    // Even doubling in every remaining step cannot reach 'n'
+    if ((last << remaining) < n) {
+        return false;
+    }
+    for (size_t j = chain.size(); j-- > 0;) {
+        const int64_t next = last + chain[j];
+        if (next > n) {
+            continue;
+        }
+        chain.push_back(next);
+        terms.push_back(j);
+        if (search_chain(chain, terms, n, length)) {
+            return true;
+        }
+        chain.pop_back();
+        terms.pop_back();
+    }
+    return false;
+}
+
+/**
+ *  Returns the optimal addition chain of 'n' >= 1 as the index of the second term of each
+ *  element, i.e. chain[i] = chain[i-1] + chain[terms[i-1]] where chain[0] = 1.
+ *
+ *  NB: star chains are optimal for all n < 12509 thus the iterative deepening finds an
+ *  optimal chain, e.g. x^15 takes five multiplications where the binary method takes six.
+ */
+vector<size_t> addition_chain(int64_t n)
+{
+    for (size_t length = 0;; ++length) {
+        vector<int64_t> chain = {1};
+        vector<size_t> terms;
+        if (search_chain(chain, terms, n, length)) {
+            return terms;
+        }
+    }
+}
+
+bool is_real(bh_type type)
+{
+    return bh_type_is_float(type) and not bh_type_is_complex(type);
+}
+
+}
+
+/**
+ *  Expand BH_POWER with a constant exponent at the given PC into:
+ *
+ *  x^n     = the multiplications of the optimal addition chain of n where
+ *            the intermediate powers are temporaries, e.g. x^15 as:
+ *
+ *              MULTIPLY, t1, x, x      (x^2)
+ *              MULTIPLY, t2, t1, t1    (x^4)
+ *              FREE, t1
+ *              MULTIPLY, t3, t2, x     (x^5)
+ *              FREE, t2
+ *              MULTIPLY, t4, t3, t3    (x^10)
+ *              MULTIPLY, out, t4, t3   (x^15)
+ *              FREE, t3
+ *              FREE, t4
+ *
+ *  x^-n    = 1 / x^n (real floating-point types only)
+ *  x^0.5   = SQRT, out, x
+ *  x^-0.5  = 1 / SQRT(x)
+ *
+ *  where 0 <= n <= 100 and the exponent is an integer or an integral floating-point value.
+ *  Returns the number of instructions used.
+ */
 int Expander::expand_powk(bh_ir& bhir, int pc)
 {
     verbose_print("[Powk] Expanding BH_POWER");
@@ -42,30 +121,33 @@ int Expander::expand_powk(bh_ir& bhir, int pc)
         return 0;
     }
 
-    if (!bh_type_is_integer(instr.constant.type)) {
-        return 0;
-    }
-
-    int64_t exponent;
-    try {
-        // Extract the exponent
-        exponent = instr.constant.get_int64();
-    } catch (overflow_error& e) {
-        // Give up, if we cannot get a signed integer
-        verbose_print("[Powk] \tCan't expand BH_POWER with non-integer");
+    const bh_type type = instr.operand[0].base->type;
+    double exponent;
+    if (bh_type_is_integer(instr.constant.type)) {
+        try {
+            exponent = instr.constant.get_int64();
+        } catch (overflow_error& e) {
+            // Give up, if we cannot get a signed integer
+            verbose_print("[Powk] \tCan't expand BH_POWER with non-integer");
+            return 0;
+        }
+    } else if (is_real(instr.constant.type) and is_real(type)) {
+        exponent = instr.constant.get_double();
+    } else {
         return 0;
     }
 
-    if (0 > exponent || exponent > max_exponent_unfolding) {
+    const bool square_root = is_real(type) and fabs(exponent) == 0.5;
+    const bool reciprocal = exponent < 0;
+    if (!square_root and (exponent != floor(exponent) or fabs(exponent) > max_exponent_unfolding)) {
         verbose_print("[Powk] \tCan't expand BH_POWER with exponent " + std::to_string(exponent));
         return 0;
     }
-
-    // TODO: Add support for this case by using intermediates.
-    if (instr.operand[0].base == instr.operand[1].base) {
-        verbose_print("[Powk] \tCan't expand BH_POWER without intermediates.");
+    if (reciprocal and !is_real(type)) {
+        verbose_print("[Powk] \tCan't expand BH_POWER with a negative exponent of a non-real type");
         return 0;
     }
+    const int64_t n = static_cast<int64_t>(fabs(exponent));
 
     // Lazy choice... no re-use just NOP it.
     instr.opcode = BH_NONE;
@@ -74,30 +156,80 @@ int Expander::expand_powk(bh_ir& bhir, int pc)
     bh_view out = instr.operand[0];
     bh_view in1 = instr.operand[1];
 
-    // Transform BH_POWER into BH_MULTIPLY sequences.
-    if (exponent == 0) {                                // x^0 = [1,1,...,1]
-        inject(bhir, ++pc, BH_IDENTITY, out, 1);
-    } else if (exponent == 1) {                         // x^1 = x
-        inject(bhir, ++pc, BH_IDENTITY, out, in1);
-    } else {                                            // x^n = (x*x)*(x*x)*...
-        int highest_power_below_input = pow(2, (int)log2(exponent));
-        exponent -= highest_power_below_input;
-
-        // Do x=x^2 as many times as n is a power of 2
-        inject(bhir, ++pc, BH_MULTIPLY, out, in1, in1);
-        highest_power_below_input /= 2;
-
-        while(highest_power_below_input != 1) {
-            inject(bhir, ++pc, BH_MULTIPLY, out, out, out);
-            highest_power_below_input /= 2;
+    // Inherit ndim and shape
+    bh_view meta = instr.operand[0];
+    meta.start = 0;
+
+    // Count number of elements
+    int64_t nelements = 1;
+
+    // Contiguous stride
+    for(int64_t dim=meta.ndim-1; dim >= 0; --dim) {
+        meta.stride[dim] = nelements;
+        nelements *= meta.shape[dim];
+    }
+
+    // The output is only written by the last instruction thus it may alias the input
+    // when they are the same view. Otherwise, we copy the input first.
+    vector<bh_view> frees;
+    if (out.base == in1.base and !(out == in1) and n > 1) {
+        bh_view copy = make_temp(meta, type, nelements);
+        inject(bhir, ++pc, BH_IDENTITY, copy, in1);
+        frees.push_back(copy);
+        in1 = copy;
+    }
+
+    // The result of x^n, which is the output unless we need the reciprocal
+    bh_view result = out;
+    if (reciprocal) {
+        result = (n == 1 and !square_root) ? in1 : make_temp(meta, type, nelements);
+    }
+
+    if (square_root) {                                  // x^0.5 = sqrt(x)
+        inject(bhir, ++pc, BH_SQRT, result, in1);
+    } else if (n == 0) {                                // x^0 = [1,1,...,1]
+        inject(bhir, ++pc, BH_IDENTITY, result, 1);
+    } else if (n == 1) {                                // x^1 = x
+        if (!reciprocal) {
+            inject(bhir, ++pc, BH_IDENTITY, out, in1);
+        }
+    } else {                                            // x^n = the addition chain of n
+        const vector<size_t> terms = addition_chain(n);
+
+        // The last use of each power in the chain, which frees it
+        vector<size_t> last_use(terms.size() + 1, 0);
+        for (size_t i = 0; i < terms.size(); ++i) {
+            last_use[i] = i + 1;
+            last_use[terms[i]] = max(last_use[terms[i]], i + 1);
         }
 
-        // Linear unroll the rest
-        for(int exp=0; exp<exponent; ++exp) {
-            inject(bhir, ++pc, BH_MULTIPLY, out, out, in1);
+        vector<bh_view> powers = {in1};
+        for (size_t i = 1; i <= terms.size(); ++i) {
+            powers.push_back(i == terms.size() ? result : make_temp(meta, type, nelements));
+            inject(bhir, ++pc, BH_MULTIPLY, powers[i], powers[i - 1], powers[terms[i - 1]]);
+            for (size_t j = 1; j < i; ++j) {
+                if (last_use[j] == i) {
+                    inject(bhir, ++pc, BH_FREE, powers[j]);
+                }
+            }
         }
     }
 
+    if (reciprocal) {                                   // x^-n = 1 / x^n
+        bh_instruction divide(BH_DIVIDE, {out});
+        divide.operand.resize(3);
+        bh_set_constant(divide, 1, type, 1.0);
+        divide.operand[2] = result;
+        inject(bhir, ++pc, divide);
+        if (!(result == in1)) {
+            frees.push_back(result);
+        }
+    }
+
+    for (bh_view& view: frees) {
+        inject(bhir, ++pc, BH_FREE, view);
+    }
+
     return pc - start_pc;
 }
 
@@ -18,7 +18,8 @@ GNU Lesser General Public License along with Bohrium.
 If not, see <http://www.gnu.org/licenses/>.
 */
 #include "expander.hpp"
-#include <map>
+
+#include <algorithm>
 
 using namespace std;
 
@@ -26,43 +27,46 @@ namespace bohrium {
 namespace filter {
 namespace bcexp {
 
-static std::map<int, int> fold_map;
+/*
+Splits a large 1-D reduction into partial reductions, which the engine computes
+in parallel, and the reduction of the partials:
 
-static inline int find_fold(int64_t elements, int thread_limit)
-{
-    for (int i = elements/thread_limit; i > 1; i--)
-    {
-        if (elements%i == 0)
-            return i;
-    }
-    return 1;
-}
+  BH_ADD_REDUCE a1[0:1] a0[0:100003] 0
 
-// TODO: What does this do? Give example like expand_sign.cpp
-int Expander::expand_reduce1d(bh_ir& bhir, int pc, int thread_limit)
+with four partials becomes:
+
+  BH_ADD_REDUCE t[0:4] a0[0:4,0:25000] 1
+  BH_ADD_REDUCE t[4:5] a0[100000:100003] 0
+  BH_ADD_REDUCE a1[0:1] t[0:5] 0
+  BH_FREE t
+
+There is a partial per thread of the engine (when it reports its threads) and
+every partial reduces at least 'min_elements' elements. The elements that do not
+divide evenly go into an extra partial.
+
+When deterministic, every partial reduces exactly 'min_elements' elements no
+matter the threads, and the reduction of the partials is split the same way,
+which makes a tree of fixed shape: the engine reduces each partial in order
+thus the result is the same for every number of threads.
+*/
+int Expander::expand_reduce1d(bh_ir& bhir, int pc, int min_elements)
 {
     int start_pc = pc;
     bh_instruction& instr = bhir.instr_list[pc];
     bh_opcode opcode = instr.opcode;
-    int64_t elements = bh_nelements(instr.operand[1]);
+    const int64_t elements = bh_nelements(instr.operand[1]);
     verbose_print("[Reduce1D] Expanding " + string(bh_opcode_text(opcode)));
 
-    if (elements * 2 < thread_limit) {
-        return 0;
-    }
-
-    int fold = 0;
-    if (fold_map.find(elements) != fold_map.end()) {
-        fold = fold_map.find(elements)->second;
-    } else {
-        fold = find_fold(elements,thread_limit);
-        fold_map[elements] = fold;
+    int64_t fold = elements / min_elements;
+    if (threads_ > 0 and not deterministic_) {
+        fold = std::min<int64_t>(fold, threads_);
     }
-
     if (fold < 2) {
         verbose_print("[Reduce1D] \tCan't expand " + string(bh_opcode_text(opcode)) + " with a fold less than 2.");
         return 0;
     }
+    const int64_t part = deterministic_ ? min_elements : elements / fold;
+    const int64_t remainder = elements - fold * part;
 
     // Lazy choice... no re-use just NOP it.
     instr.opcode = BH_NONE;
@@ -70,18 +74,32 @@ int Expander::expand_reduce1d(bh_ir& bhir, int pc, int thread_limit)
     // Grab operands
     bh_view out = instr.operand[0];
     bh_view in  = instr.operand[1];
+    bh_view rest = in;
 
     in.ndim = 2;
     in.shape[0] = fold;
-    in.shape[1] = elements / fold;
+    in.shape[1] = part;
 
     in.stride[1] = in.stride[0];
-    in.stride[0] = in.stride[0] * elements / fold;
-
-    bh_view temp = make_temp(in.base->type, elements/fold);
-
-    inject(bhir, ++pc, opcode,  temp, in,   0, bh_type::INT64);
+    in.stride[0] = in.stride[0] * part;
+
+    bh_view temp = make_temp(in.base->type, remainder > 0 ? fold + 1 : fold);
+    bh_view partials = temp;
+    partials.shape[0] = fold;
+
+    inject(bhir, ++pc, opcode, partials, in, 1, bh_type::INT64);
+    if (remainder > 0) {
+        rest.start += fold * part * rest.stride[0];
+        rest.shape[0] = remainder;
+        bh_view last = temp;
+        last.start = fold;
+        last.shape[0] = 1;
+        inject(bhir, ++pc, opcode, last, rest, 0, bh_type::INT64);
+    }
     inject(bhir, ++pc, opcode,  out,  temp, 0, bh_type::INT64);
+    if (deterministic_) {
+        pc += expand_reduce1d(bhir, pc, min_elements);
+    }
     inject(bhir, ++pc, BH_FREE, temp);
 
     return pc - start_pc;
@@ -0,0 +1,141 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "expander.hpp"
+
+#include <algorithm>
+
+using namespace std;
+
+namespace bohrium {
+namespace filter {
+namespace bcexp {
+
+/*
+Splits a large 1-D accumulation into a blocked two-pass scan: the engine scans
+the blocks in parallel, scans the block totals, and adds the carry of the
+preceding blocks to each block:
+
+  BH_ADD_ACCUMULATE a1[0:100003] a0[0:100003] 0
+
+with four blocks becomes:
+
+  BH_ADD_ACCUMULATE a1[0:4,0:25000] a0[0:4,0:25000] 1
+  BH_ADD_ACCUMULATE a1[100000:100003] a0[100000:100003] 0
+  BH_ADD_ACCUMULATE t[0:4] a1[24999:100000:25000] 0
+  BH_ADD a1[25000:100000] a1[25000:100000] t[0:3] (broadcast along the blocks)
+  BH_ADD a1[100000:100003] a1[100000:100003] t[3] (broadcast)
+  BH_FREE t
+
+The work is twice that of the sequential scan, which is the same as the
+work-efficient parallel scans, and every pass but the small scan of the totals
+is parallel. The blocks are chosen as in expand_reduce1d().
+*/
+int Expander::expand_scan1d(bh_ir& bhir, int pc, int min_elements)
+{
+    int start_pc = pc;
+    bh_instruction& instr = bhir.instr_list[pc];
+    bh_opcode opcode = instr.opcode;
+    const bh_opcode combine = opcode == BH_ADD_ACCUMULATE ? BH_ADD : BH_MULTIPLY;
+    verbose_print("[Scan1D] Expanding " + string(bh_opcode_text(opcode)));
+
+    if (bh_is_constant(&instr.operand[1]) or instr.operand[0].ndim != 1 or
+        instr.operand[0].shape[0] != instr.operand[1].shape[0]) {
+        verbose_print("[Scan1D] \tCan't expand " + string(bh_opcode_text(opcode)) + " of these operands.");
+        return 0;
+    }
+    const int64_t elements = instr.operand[1].shape[0];
+    int64_t fold = elements / min_elements;
+    if (threads_ > 0) {
+        fold = std::min<int64_t>(fold, threads_);
+    }
+    if (fold < 2) {
+        verbose_print("[Scan1D] \tCan't expand " + string(bh_opcode_text(opcode)) + " with a fold less than 2.");
+        return 0;
+    }
+    const int64_t part = elements / fold;
+    const int64_t remainder = elements - fold * part;
+
+    // Lazy choice... no re-use just NOP it.
+    instr.opcode = BH_NONE;
+
+    // Grab operands
+    bh_view out = instr.operand[0];
+    bh_view in  = instr.operand[1];
+    const int64_t out_stride = out.stride[0];
+    const int64_t in_stride = in.stride[0];
+
+    // The blocks as the rows of a matrix, which are scanned independently
+    bh_view out_blocks = out;
+    out_blocks.ndim = 2;
+    out_blocks.shape[0] = fold;
+    out_blocks.shape[1] = part;
+    out_blocks.stride[0] = out_stride * part;
+    out_blocks.stride[1] = out_stride;
+    bh_view in_blocks = in;
+    in_blocks.ndim = 2;
+    in_blocks.shape[0] = fold;
+    in_blocks.shape[1] = part;
+    in_blocks.stride[0] = in_stride * part;
+    in_blocks.stride[1] = in_stride;
+    inject(bhir, ++pc, opcode, out_blocks, in_blocks, 1, bh_type::INT64);
+
+    // The elements that do not divide evenly are scanned as an extra block
+    bh_view out_rest = out;
+    if (remainder > 0) {
+        out_rest.start += fold * part * out_stride;
+        out_rest.shape[0] = remainder;
+        bh_view in_rest = in;
+        in_rest.start += fold * part * in_stride;
+        in_rest.shape[0] = remainder;
+        inject(bhir, ++pc, opcode, out_rest, in_rest, 0, bh_type::INT64);
+    }
+
+    // The inclusive scan of the block totals, i.e. the last element of each block
+    bh_view totals = out;
+    totals.start += (part - 1) * out_stride;
+    totals.shape[0] = fold;
+    totals.stride[0] = out_stride * part;
+    bh_view carry = make_temp(out.base->type, fold);
+    inject(bhir, ++pc, opcode, carry, totals, 0, bh_type::INT64);
+
+    // Every block but the first combines with the carry of the preceding blocks
+    bh_view tail_blocks = out_blocks;
+    tail_blocks.start += out_stride * part;
+    tail_blocks.shape[0] = fold - 1;
+    bh_view carry_blocks = carry;
+    carry_blocks.ndim = 2;
+    carry_blocks.shape[0] = fold - 1;
+    carry_blocks.shape[1] = part;
+    carry_blocks.stride[0] = 1;
+    carry_blocks.stride[1] = 0;
+    inject(bhir, ++pc, combine, tail_blocks, tail_blocks, carry_blocks);
+    if (remainder > 0) {
+        bh_view carry_rest = carry;
+        carry_rest.start = fold - 1;
+        carry_rest.shape[0] = remainder;
+        carry_rest.stride[0] = 0;
+        inject(bhir, ++pc, combine, out_rest, out_rest, carry_rest);
+    }
+    inject(bhir, ++pc, BH_FREE, carry);
+
+    return pc - start_pc;
+}
+
+}}}
@@ -0,0 +1,120 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdexcept>
+
+#include "expander.hpp"
+
+using namespace std;
+
+namespace bohrium {
+namespace filter {
+namespace bcexp {
+
+/**
+ *  Expand the "stencil_correlate" extension method at the given PC, which is the
+ *  'valid' correlation of IN1 with the weights of IN2 (of the same number of dimensions)
+ *  into OUT of the shape IN1.shape - IN2.shape + 1, into a multiply-add per weight:
+ *
+ *  MULTIPLY, acc, in1[shift(0)], in2[0] (broadcast)
+ *  MULTIPLY, t, in1[shift(i)], in2[i] (broadcast)
+ *  ADD, acc, acc, t
+ *  FREE, t
+ *  ...
+ *
+ *  where 'shift(i)' is the view of IN1 of the shape of OUT that starts at weight i.
+ *  The engines fuse the sequence into a single loop nest, which also fuses with the
+ *  element-wise instructions around it, on the device of the arrays.
+ *  The accumulation is in a temporary, which is copied to OUT, when OUT is the base of IN1 or IN2.
+ *
+ *  Returns the number of instructions used.
+ */
+int Expander::expand_stencil(bh_ir& bhir, int pc)
+{
+    int start_pc = pc;
+    bh_instruction& composite = bhir.instr_list[pc];
+    const bh_view output  = composite.operand[0];
+    const bh_view input   = composite.operand[1];
+    const bh_view weights = composite.operand[2];
+
+    if (input.ndim != output.ndim or weights.ndim != output.ndim) {
+        throw runtime_error("[Stencil] the input, the weights, and the output must have the same number of dimensions");
+    }
+    if (input.base->type != output.base->type or weights.base->type != output.base->type) {
+        throw runtime_error("[Stencil] the input, the weights, and the output must have the same type");
+    }
+    int64_t nelements = 1;
+    int64_t ntaps = 1;
+    for(int64_t d=0; d < output.ndim; ++d) {
+        if (output.shape[d] != input.shape[d] - weights.shape[d] + 1) {
+            throw runtime_error("[Stencil] the output must have the shape of the input minus the weights plus one");
+        }
+        nelements *= output.shape[d];
+        ntaps *= weights.shape[d];
+    }
+    composite.opcode = BH_NONE;
+    if (nelements == 0 or ntaps == 0) {
+        return 0;
+    }
+    verbose_print("[Stencil] Expanding stencil_correlate");
+
+    // Contiguous temporaries of the shape of the output
+    bh_view meta = output;
+    meta.start = 0;
+    for(int64_t d=meta.ndim-1, stride=1; d >= 0; --d) {
+        meta.stride[d] = stride;
+        stride *= meta.shape[d];
+    }
+    const bh_type type = output.base->type;
+    const bool aliased = output.base == input.base or output.base == weights.base;
+    bh_view acc = aliased ? make_temp(meta, type, nelements) : output;
+
+    vector<int64_t> tap(weights.ndim, 0);
+    for(int64_t i=0; i < ntaps; ++i) {
+        bh_view shifted = input;
+        bh_view weight = weights;
+        for(int64_t d=0; d < output.ndim; ++d) {
+            shifted.start += tap[d] * input.stride[d];
+            shifted.shape[d] = output.shape[d];
+            weight.start += tap[d] * weights.stride[d];
+            weight.shape[d] = output.shape[d];
+            weight.stride[d] = 0;
+        }
+        if (i == 0) {
+            inject(bhir, ++pc, BH_MULTIPLY, acc, shifted, weight);
+        } else {
+            bh_view term = make_temp(meta, type, nelements);
+            inject(bhir, ++pc, BH_MULTIPLY, term,  shifted, weight);
+            inject(bhir, ++pc, BH_ADD,      acc,   acc, term);
+            inject(bhir, ++pc, BH_FREE,     term);
+        }
+        // The next weight in row-major order
+        for(int64_t d=weights.ndim-1; d >= 0 and ++tap[d] == weights.shape[d]; --d) {
+            tap[d] = 0;
+        }
+    }
+    if (aliased) {
+        bh_view out = output;
+        inject(bhir, ++pc, BH_IDENTITY, out, acc);
+        inject(bhir, ++pc, BH_FREE,     acc);
+    }
+    return pc - start_pc;
+}
+
+}}}
@@ -32,15 +32,34 @@ Expander::Expander(
     int sign,
     int powk,
     int reduce1d,
+    int scan1d,
     int repeat)
     : gc_threshold_(threshold),
       sign_(sign),
       powk_(powk),
       reduce1d_(reduce1d),
-      repeat_(repeat) {
+      scan1d_(scan1d),
+      repeat_(repeat),
+      threads_(0),
+      deterministic_(false) {
           __verbose = verbose;
       }
 
+void Expander::set_threads(int threads)
+{
+    threads_ = threads;
+}
+
+void Expander::set_deterministic(bool deterministic)
+{
+    deterministic_ = deterministic;
+}
+
+void Expander::set_stencil_opcode(bh_opcode opcode)
+{
+    stencil_opcodes_.insert(opcode);
+}
+
 void Expander::expand(bh_ir& bhir)
 {
     int end = bhir.instr_list.size();
@@ -90,7 +109,22 @@ void Expander::expand(bh_ir& bhir)
                 pc += increase;
             }
             break;
+
+        case BH_ADD_ACCUMULATE:
+        case BH_MULTIPLY_ACCUMULATE:
+            if (scan1d_ && instr.operand[1].ndim == 1)
+            {
+                increase = expand_scan1d(bhir, pc, scan1d_);
+                end += increase;
+                pc += increase;
+            }
+            break;
         default:
+            if (stencil_opcodes_.find(instr.opcode) != stencil_opcodes_.end()) {
+                increase = expand_stencil(bhir, pc);
+                end += increase;
+                pc += increase;
+            }
             break;
         }
     }
@@ -1,6 +1,8 @@
 #ifndef __BH_FILTER_COMPOSITE_EXPANDER
 #define __BH_FILTER_COMPOSITE_EXPANDER
 
+#include <set>
+
 #include <bh_component.hpp>
 
 namespace bohrium {
@@ -19,7 +21,7 @@ public:
     /**
      *  Construct the expander.
      */
-    Expander(bool verbose, size_t threshold, int sign, int powk, int reduce_1d, int repeat);
+    Expander(bool verbose, size_t threshold, int sign, int powk, int reduce_1d, int scan_1d, int repeat);
 
     /**
      *  Tear down the expander.
@@ -27,6 +29,25 @@ public:
      */
     ~Expander(void);
 
+    /**
+     *  Set the number of threads of the engine, which bounds the number of
+     *  partial reductions of reduce1d and the blocks of scan1d (zero means unknown).
+     */
+    void set_threads(int threads);
+
+    /**
+     *  Split the 1-D reductions into partials of exactly 'reduce1d' elements,
+     *  independent of the threads, and reduce the partials the same way until
+     *  they fit a single partial, which makes the result reproducible.
+     */
+    void set_deterministic(bool deterministic);
+
+    /**
+     *  Expand the extension method of 'opcode' as the "stencil_correlate"
+     *  method, which no component below implements.
+     */
+    void set_stencil_opcode(bh_opcode opcode);
+
     /**
      *  Modifies the given bhir, expanding composites per configuration.
      */
@@ -82,8 +103,10 @@ public:
 
     int expand_sign(bh_ir& bhir, int pc);
     int expand_powk(bh_ir& bhir, int pc);
-    int expand_reduce1d(bh_ir& bhir, int pc, int fold_limit);
+    int expand_reduce1d(bh_ir& bhir, int pc, int min_elements);
+    int expand_scan1d(bh_ir& bhir, int pc, int min_elements);
     int expand_repeat(bh_ir& bhir, int pc);
+    int expand_stencil(bh_ir& bhir, int pc);
 
 private:
     static const char TAG[];
@@ -92,7 +115,11 @@ private:
     int sign_;
     int powk_;
     int reduce1d_;
+    int scan1d_;
     int repeat_;
+    int threads_;
+    bool deterministic_;
+    std::set<bh_opcode> stencil_opcodes_;
 };
 
 void Expander::inject(bh_ir& bhir, int pc, bh_opcode opcode, bh_view& out, bh_view& in1, bh_view& in2)
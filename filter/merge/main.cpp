@@ -0,0 +1,284 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <chrono>
+#include <map>
+#include <memory>
+#include <set>
+#include <sstream>
+#include <vector>
+
+#include <bh_component.hpp>
+
+using namespace bohrium;
+using namespace component;
+using namespace std;
+
+namespace {
+// Returns which instructions of 'instr_list' the BH_SYNCs need, which is the backwards slice of the syncs through
+// the instructions that access the same bases (empty when the list has no sync or a BH_REPEAT, which we don't split).
+// A sync counts as a write of its base since the host might write its data after the sync. The frees of the bases
+// that the rest doesn't access go with the slice.
+vector<bool> sync_slice(const vector<bh_instruction> &instr_list) {
+    vector<bool> ret(instr_list.size(), false);
+    bool has_sync = false;
+    for (const bh_instruction &instr: instr_list) {
+        if (instr.opcode == BH_REPEAT) {
+            return vector<bool>();
+        }
+        has_sync |= instr.opcode == BH_SYNC;
+    }
+    if (not has_sync) {
+        return vector<bool>();
+    }
+    // The bases that the needed instructions read and write
+    set<const bh_base *> reads, writes;
+    for (size_t i = instr_list.size(); i-- > 0;) {
+        const bh_instruction &instr = instr_list[i];
+        bool needed = instr.opcode == BH_SYNC;
+        for (size_t o = 0; not needed and o < instr.operand.size(); ++o) {
+            const bh_view &view = instr.operand[o];
+            if (not bh_is_constant(&view)) {
+                needed = writes.find(view.base) != writes.end() or (o == 0 and reads.find(view.base) != reads.end());
+            }
+        }
+        if (not needed) {
+            continue;
+        }
+        ret[i] = true;
+        for (size_t o = 0; o < instr.operand.size(); ++o) {
+            const bh_view &view = instr.operand[o];
+            if (not bh_is_constant(&view)) {
+                (o == 0 ? writes : reads).insert(view.base);
+            }
+        }
+    }
+    // The frees of the bases that the rest doesn't access go with the slice, e.g. the frees of synced arrays
+    set<const bh_base *> accessed_by_rest;
+    for (size_t i = 0; i < instr_list.size(); ++i) {
+        if (not ret[i] and instr_list[i].opcode != BH_FREE) {
+            for (const bh_view &view: instr_list[i].operand) {
+                if (not bh_is_constant(&view)) {
+                    accessed_by_rest.insert(view.base);
+                }
+            }
+        }
+    }
+    for (size_t i = 0; i < instr_list.size(); ++i) {
+        if (instr_list[i].opcode == BH_FREE) {
+            ret[i] = accessed_by_rest.find(instr_list[i].operand[0].base) == accessed_by_rest.end();
+        }
+    }
+    return ret;
+}
+
+// Holds back the flushes that neither sync nor free arrays that the child has seen, and merges them with the next
+// flush, thus the fuser of the child fuses across flush boundaries. A flush is held back until the oldest held-back
+// flush is 'latency_budget_ms' old or the merged flush reaches 'max_instructions' instructions.
+// With 'partial_sync', a sync only sends the instructions that it needs and the rest stays held back.
+// NB: the bridges read and write host data only after a sync, which always executes what the sync needs.
+class Impl : public ComponentImplWithChild {
+  private:
+    const chrono::duration<double, milli> latency_budget;
+    const uint64_t max_instructions;
+    const bool partial_sync;
+    // The instructions of the held-back flushes and the time of the oldest of them
+    vector<bh_instruction> pending;
+    chrono::steady_clock::time_point pending_since;
+    // The copies of the bases that the held-back flushes free, since the bridge deletes its bases after the flush
+    map<const bh_base *, unique_ptr<bh_base> > owned;
+    // The bases that the child has seen and not freed yet, which the child might know by their address
+    set<const bh_base *> seen;
+    // Number of flushes received and sent to the child, and the number of syncs that left instructions held back
+    uint64_t num_received = 0;
+    uint64_t num_sent = 0;
+    uint64_t num_partial = 0;
+
+    // Whether the latency budget of the held-back flushes is used up
+    bool overdue() const {
+        return not pending.empty() and chrono::steady_clock::now() - pending_since > latency_budget;
+    }
+
+    // Whether 'instr_list' can be held back when 'known' are the bases that the child has seen
+    static bool holdable(const vector<bh_instruction> &instr_list, const set<const bh_base *> &known) {
+        for (const bh_instruction &instr: instr_list) {
+            if (instr.opcode == BH_SYNC or instr.opcode == BH_TALLY or
+                (instr.opcode == BH_FREE and known.find(instr.operand[0].base) != known.end())) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Whether 'bhir' may be held back
+    bool deferrable(const bh_ir &bhir) const {
+        return pending.size() + bhir.instr_list.size() <= max_instructions and not overdue() and
+               holdable(bhir.instr_list, seen);
+    }
+
+    // Replace the bridge's base of each BH_FREE in 'pending' from 'begin' with a copy that we own
+    void own_freed(size_t begin) {
+        map<const bh_base *, bh_base *> copies;
+        for (size_t i = begin; i < pending.size(); ++i) {
+            bh_base *base = pending[i].operand.empty() ? nullptr : pending[i].operand[0].base;
+            if (pending[i].opcode == BH_FREE and owned.find(base) == owned.end()) {
+                bh_base *copy = new bh_base(*base);
+                owned[copy].reset(copy);
+                copies[base] = copy;
+                // The data is the copy's now thus the bridge deletes a base without data
+                base->data = nullptr;
+            }
+        }
+        if (copies.empty()) {
+            return;
+        }
+        for (bh_instruction &instr: pending) {
+            for (bh_view &view: instr.operand) {
+                if (bh_is_constant(&view)) {
+                    continue;
+                }
+                auto it = copies.find(view.base);
+                if (it != copies.end()) {
+                    view.base = it->second;
+                }
+            }
+        }
+    }
+
+    // Send 'bhir' to the child and remember the bases that it has seen
+    void send(bh_ir &bhir) {
+        child.execute(&bhir);
+        ++num_sent;
+        for (const bh_instruction &instr: bhir.instr_list) {
+            if (instr.opcode == BH_FREE) {
+                seen.erase(instr.operand[0].base);
+                owned.erase(instr.operand[0].base);
+                continue;
+            }
+            for (const bh_view &view: instr.operand) {
+                if (not bh_is_constant(&view)) {
+                    seen.insert(view.base);
+                }
+            }
+        }
+    }
+
+    // Send the instructions of 'pending' that its syncs need and keep the rest held back, which requires that the
+    // rest can be held back after the child has seen the sent instructions. Returns false when nothing is sent.
+    bool send_sync_slice() {
+        if (overdue()) {
+            return false;
+        }
+        const vector<bool> needed = sync_slice(pending);
+        if (needed.empty()) {
+            return false;
+        }
+        vector<bh_instruction> sent, rest;
+        set<const bh_base *> known = seen;
+        for (size_t i = 0; i < pending.size(); ++i) {
+            (needed[i] ? sent : rest).push_back(pending[i]);
+            if (not needed[i]) {
+                continue;
+            }
+            for (const bh_view &view: pending[i].operand) {
+                if (bh_is_constant(&view)) {
+                    continue;
+                }
+                if (pending[i].opcode == BH_FREE) {
+                    known.erase(view.base);
+                } else {
+                    known.insert(view.base);
+                }
+            }
+        }
+        if (rest.empty() or not holdable(rest, known)) {
+            return false;
+        }
+        pending = std::move(rest);
+        own_freed(0);
+        bh_ir bhir(sent.size(), sent.data());
+        bhir.tally = false;
+        send(bhir);
+        ++num_partial;
+        return true;
+    }
+
+    // Send the held-back flushes
+    void send_pending(bool tally = false) {
+        if (pending.empty()) {
+            return;
+        }
+        bh_ir bhir(pending.size(), pending.data());
+        bhir.tally = tally;
+        pending.clear();
+        send(bhir);
+    }
+
+  public:
+    Impl(int stack_level) : ComponentImplWithChild(stack_level),
+                            latency_budget(config.defaultGet<double>("latency_budget_ms", 10)),
+                            max_instructions(config.defaultGet<uint64_t>("max_instructions", 10000)),
+                            partial_sync(config.defaultGet<bool>("partial_sync", false)) {}
+    ~Impl() {
+        send_pending();
+    }
+
+    void execute(bh_ir *bhir) {
+        ++num_received;
+        const bool defer = deferrable(*bhir);
+        if (pending.empty() and not defer and not partial_sync) {
+            send(*bhir);
+            return;
+        }
+        if (pending.empty()) {
+            pending_since = chrono::steady_clock::now();
+        }
+        const size_t begin = pending.size();
+        pending.insert(pending.end(), bhir->instr_list.begin(), bhir->instr_list.end());
+        if (defer) {
+            own_freed(begin);
+        } else if (not partial_sync or not send_sync_slice()) {
+            send_pending(bhir->tally);
+        }
+    }
+
+    // The messages might depend on the held-back flushes, e.g. "statistic" and "GPU: disable"
+    string message(const string &msg) {
+        send_pending();
+        if (msg == "statistic") {
+            stringstream ss;
+            ss << "[" << config.getName() << "] Merged " << num_received << " flushes into " << num_sent;
+            if (partial_sync) {
+                ss << ", " << num_partial << " partial syncs";
+            }
+            ss << "\n";
+            return ss.str() + ComponentImplWithChild::message(msg);
+        }
+        return ComponentImplWithChild::message(msg);
+    }
+};
+} //Unnamed namespace
+
+extern "C" ComponentImpl* create(int stack_level) {
+    return new Impl(stack_level);
+}
+extern "C" void destroy(ComponentImpl* self) {
+    delete self;
+}
@@ -25,43 +25,13 @@ using namespace component;
 using namespace std;
 
 namespace {
-int remove_none(vector<bh_instruction> &bh_instr_list, int from, int to, int decrementer)
-{
-    int i = from;
-
-    // Loop through the partial instruction list. Increment happens inside.
-    for(auto it = bh_instr_list.begin() + from; it != bh_instr_list.begin() + to; ++i)
-    {
-        switch(it->opcode) {
-            case BH_REPEAT:
-                // Recursively remove BH_NONE from inner part of BH_REPEAT
-                decrementer = remove_none(bh_instr_list, i + 1, i + 1 + it->constant.value.r123.start, decrementer);
-                it->constant.value.r123.start -= decrementer;
-
-                // Increment iterator manually
-                ++it;
-                break;
-            case BH_NONE:
-                // Remove the BH_NONE and increase the decrementer for inner BH_REPEAT
-                it = bh_instr_list.erase(it);
-                ++decrementer;
-                break;
-            default:
-                // Increment iterator manually
-                ++it;
-        }
-    }
-
-    return decrementer;
-}
-
 class Impl : public ComponentImplWithChild {
   public:
     Impl(int stack_level) : ComponentImplWithChild(stack_level) {};
     ~Impl() {}; // NB: a destructor implementation must exist
     void execute(bh_ir *bhir) {
         // Remove BH_NONE from entire instruction list
-        remove_none(bhir->instr_list, 0, bhir->instr_list.size(), 0);
+        bhir->remove_none();
         child.execute(bhir);
     };
 };
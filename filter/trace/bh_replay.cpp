@@ -0,0 +1,224 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Replays a trace of the trace filter through the component stack of BH_STACK, e.g.
+ *
+ *     BH_STACK=opencl bh-replay --repeat 3 bh_trace.bin
+ *
+ * The base arrays get the data of their snapshots in the trace and zeros when the recorded base array had data
+ * but no snapshot. '--print' writes the instructions instead, in the format of the pprint filter.
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <bh_bytecode.hpp>
+#include <bh_component.hpp>
+#include <bh_config_parser.hpp>
+
+#include "trace_file.hpp"
+
+using namespace bohrium;
+using namespace std;
+
+namespace {
+
+// The statistics of a replay of the trace
+struct Replayed {
+    uint64_t flushes = 0;
+    uint64_t instructions = 0;
+    chrono::duration<double> time{0};
+};
+
+class Replayer {
+    component::ComponentFace *_runtime;
+    // The base arrays of this process of the base array pointers of the trace
+    map<uint64_t, unique_ptr<bh_base> > _bases;
+    // The snapshots of the next BhIR
+    map<uint64_t, vector<char> > _snapshots;
+    // Whether the extension methods have been registered (the first replay does it)
+    bool _extmethods_registered = false;
+
+    // Returns the local base array of the new base array 'ptr' of the trace described by 'desc'
+    bh_base *new_base(uint64_t ptr, const bh_base &desc) {
+        unique_ptr<bh_base> base(new bh_base(desc));
+        base->data = NULL;
+        auto snapshot = _snapshots.find(ptr);
+        if (snapshot != _snapshots.end()) {
+            bh_data_malloc(base.get());
+            memcpy(base->data, snapshot->second.data(), min<size_t>(snapshot->second.size(), bh_base_size(base.get())));
+        } else if (desc.data != NULL) {
+            bh_data_malloc(base.get());
+            memset(base->data, 0, bh_base_size(base.get()));
+        }
+        bh_base *ret = base.get();
+        _bases[ptr] = move(base);
+        return ret;
+    }
+
+    // Replace the base arrays of the trace in 'bhir' with local base arrays
+    void bind(bh_ir &bhir, const vector<bh_base> &new_bases) {
+        size_t next_new = 0;
+        for (bh_instruction &instr: bhir.instr_list) {
+            for (bh_view &view: instr.operand) {
+                if (bh_is_constant(&view)) {
+                    continue;
+                }
+                const uint64_t ptr = reinterpret_cast<uint64_t>(view.base);
+                auto it = _bases.find(ptr);
+                if (it != _bases.end()) {
+                    view.base = it->second.get();
+                } else if (next_new < new_bases.size()) {
+                    view.base = new_base(ptr, new_bases[next_new++]);
+                } else {
+                    throw runtime_error("bh-replay: the trace has an instruction of an unknown base array");
+                }
+            }
+        }
+        _snapshots.clear();
+    }
+
+  public:
+    // Print the instructions instead of executing them when 'runtime' is NULL
+    explicit Replayer(component::ComponentFace *runtime) : _runtime(runtime) {}
+
+    // Replay all records of 'trace' once
+    Replayed replay(tracefile::Reader &trace) {
+        Replayed ret;
+        bytecode::Decoder decoder;
+        tracefile::Kind kind;
+        vector<char> payload;
+        bh_ir bhir;
+        vector<bh_base> new_bases;
+        while (trace.next(kind, payload)) {
+            if (kind == tracefile::Kind::EXTMETHOD) {
+                uint64_t opcode;
+                memcpy(&opcode, payload.data(), sizeof(opcode));
+                if (_runtime != NULL and not _extmethods_registered) {
+                    _runtime->extmethod(string(payload.begin() + sizeof(opcode), payload.end()),
+                                        static_cast<bh_opcode>(opcode));
+                }
+            } else if (kind == tracefile::Kind::DATA) {
+                uint64_t ptr;
+                memcpy(&ptr, payload.data(), sizeof(ptr));
+                _snapshots[ptr].assign(payload.begin() + sizeof(ptr), payload.end());
+            } else if (kind == tracefile::Kind::BHIR) {
+                decoder.decode(payload.data(), payload.size(), bhir, new_bases);
+                ++ret.flushes;
+                ret.instructions += bhir.instr_list.size();
+                if (_runtime == NULL) {
+                    cout << "Trace " << ret.flushes << ":" << endl;
+                    for (const bh_instruction &instr: bhir.instr_list) {
+                        cout << instr << endl;
+                    }
+                    cout << endl;
+                    continue;
+                }
+                bind(bhir, new_bases);
+                const auto begin = chrono::steady_clock::now();
+                _runtime->execute(&bhir);
+                ret.time += chrono::steady_clock::now() - begin;
+                for (const bh_instruction &instr: bhir.instr_list) {
+                    if (instr.opcode == BH_FREE) {
+                        _bases.erase(reinterpret_cast<uint64_t>(instr.operand[0].base));
+                    }
+                }
+            } else {
+                throw runtime_error("bh-replay: unknown record in the trace");
+            }
+        }
+        _extmethods_registered = true;
+        release();
+        return ret;
+    }
+
+    // Free the base arrays that the trace didn't free
+    void release() {
+        if (_bases.empty() or _runtime == NULL) {
+            return;
+        }
+        bh_ir bhir;
+        for (const auto &base: _bases) {
+            bh_view view;
+            view.base = base.second.get();
+            view.start = 0;
+            view.ndim = 1;
+            view.shape[0] = base.second->nelem;
+            view.stride[0] = 1;
+            bhir.instr_list.emplace_back(BH_FREE, vector<bh_view>{view});
+        }
+        _runtime->execute(&bhir);
+        _bases.clear();
+    }
+};
+
+} // Unnamed namespace
+
+int main(int argc, char *argv[]) {
+    int repeat = 1;
+    bool print = false;
+    string filename;
+    for (int i = 1; i < argc; ++i) {
+        const string arg = argv[i];
+        if (i + 1 < argc and arg == "--repeat") {
+            repeat = max(1, atoi(argv[++i]));
+        } else if (arg == "--print") {
+            print = true;
+        } else if (filename.empty() and arg.compare(0, 2, "--") != 0) {
+            filename = arg;
+        } else {
+            filename.clear();
+            break;
+        }
+    }
+    if (filename.empty()) {
+        cerr << "Usage: " << argv[0] << " [--repeat N] [--print] TRACE\n"
+             << "Replays TRACE, which the trace filter recorded, through the component stack of BH_STACK\n";
+        return 2;
+    }
+
+    try {
+        tracefile::Reader trace(filename);
+        if (print) {
+            Replayer(NULL).replay(trace);
+            return 0;
+        }
+        // The replay is the bridge (stack level -1) and the child is stack level 0
+        ConfigParser config(-1);
+        component::ComponentFace runtime(config.getChildLibraryPath(), 0);
+        Replayer replayer(&runtime);
+        for (int r = 0; r < repeat; ++r) {
+            trace.rewind();
+            const Replayed replayed = replayer.replay(trace);
+            cerr << "[bh-replay] " << (repeat > 1 ? "replay " + to_string(r + 1) + ": " : "") << replayed.flushes
+                 << " flushes, " << replayed.instructions << " instructions, " << replayed.time.count() << "s\n";
+        }
+    } catch (const exception &e) {
+        cerr << "bh-replay: " << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
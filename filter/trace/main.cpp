@@ -0,0 +1,99 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <iostream>
+#include <set>
+#include <vector>
+
+#include <bh_component.hpp>
+#include <bh_bytecode.hpp>
+
+#include "trace_file.hpp"
+
+using namespace bohrium;
+using namespace component;
+using namespace std;
+
+namespace {
+class Impl : public ComponentImplWithChild {
+  private:
+    tracefile::Writer writer;
+    bytecode::Encoder encoder;
+    vector<char> buffer;
+    // Whether to record the data of the base arrays that have data when they first appear, and the limit in bytes
+    const bool snapshots;
+    const uint64_t snapshot_max_bytes;
+    uint64_t snapshot_bytes = 0;
+    // The base arrays that have appeared and aren't freed yet
+    set<const bh_base *> known_bases;
+
+    // Record the data of the new base arrays of 'bhir'
+    void snapshot(const bh_ir &bhir) {
+        for (const bh_instruction &instr: bhir.instr_list) {
+            for (const bh_view &view: instr.operand) {
+                if (bh_is_constant(&view) or not known_bases.insert(view.base).second or view.base->data == NULL) {
+                    continue;
+                }
+                const uint64_t nbytes = static_cast<uint64_t>(bh_base_size(view.base));
+                if (not snapshots or (snapshot_max_bytes > 0 and snapshot_bytes + nbytes > snapshot_max_bytes)) {
+                    continue;
+                }
+                const uint64_t ptr = reinterpret_cast<uint64_t>(view.base);
+                writer.write(tracefile::Kind::DATA, view.base->data, nbytes, &ptr, sizeof(ptr));
+                snapshot_bytes += nbytes;
+            }
+        }
+        for (const bh_instruction &instr: bhir.instr_list) {
+            if (instr.opcode == BH_FREE) {
+                known_bases.erase(instr.operand[0].base);
+            }
+        }
+    }
+
+  public:
+    Impl(int stack_level) : ComponentImplWithChild(stack_level),
+                            writer(config.defaultGet<string>("filename", "bh_trace.bin")),
+                            snapshots(config.defaultGet("snapshots", false)),
+                            snapshot_max_bytes(config.defaultGet<uint64_t>("snapshot_max_mb", 0) * 1024 * 1024) {}
+    ~Impl() {}; // NB: a destructor implementation must exist
+
+    void execute(bh_ir *bhir) {
+        snapshot(*bhir);
+        buffer.clear();
+        encoder.encode(*bhir, buffer);
+        writer.write(tracefile::Kind::BHIR, buffer.data(), buffer.size());
+        writer.flush();
+        child.execute(bhir);
+    }
+
+    void extmethod(const string &name, bh_opcode opcode) {
+        const uint64_t op = static_cast<uint64_t>(opcode);
+        writer.write(tracefile::Kind::EXTMETHOD, name.data(), name.size(), &op, sizeof(op));
+        child.extmethod(name, opcode);
+    }
+};
+} //Unnamed namespace
+
+extern "C" ComponentImpl* create(int stack_level) {
+    return new Impl(stack_level);
+}
+extern "C" void destroy(ComponentImpl* self) {
+    delete self;
+}
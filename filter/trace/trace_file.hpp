@@ -0,0 +1,107 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __BH_FILTER_TRACE_TRACE_FILE_HPP
+#define __BH_FILTER_TRACE_TRACE_FILE_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace bohrium {
+namespace tracefile {
+
+/* The binary trace file of the trace filter, which starts with MAGIC followed by records of a one-byte kind,
+ * a 64-bit little-endian payload size, and the payload:
+ *   - EXTMETHOD: the 64-bit opcode followed by the name of an extension method
+ *   - DATA:      the 64-bit base array pointer (of the recording process) followed by the data of the base array
+ *                when it first appeared, which comes just before the BhIR where it appears
+ *   - BHIR:      a BhIR in the bytecode format of bytecode::Encoder, which must be decoded in order
+ */
+constexpr char MAGIC[8] = {'B', 'H', 'T', 'R', 'A', 'C', 'E', '1'};
+enum class Kind : char {EXTMETHOD = 'X', DATA = 'D', BHIR = 'I'};
+
+class Writer {
+    std::ofstream _out;
+
+  public:
+    explicit Writer(const std::string &filename) : _out(filename, std::ios::binary) {
+        if (not _out) {
+            throw std::runtime_error("trace: cannot open '" + filename + "' for writing");
+        }
+        _out.write(MAGIC, sizeof(MAGIC));
+    }
+
+    // Writes a record of 'size' bytes of 'data' after the 'prefix_size' bytes of 'prefix'
+    void write(Kind kind, const void *data, uint64_t size, const void *prefix = nullptr, uint64_t prefix_size = 0) {
+        const uint64_t total = prefix_size + size;
+        _out.put(static_cast<char>(kind));
+        _out.write(reinterpret_cast<const char *>(&total), sizeof(total));
+        _out.write(static_cast<const char *>(prefix), prefix_size);
+        _out.write(static_cast<const char *>(data), size);
+    }
+
+    void flush() {
+        _out.flush();
+    }
+};
+
+class Reader {
+    std::ifstream _in;
+
+  public:
+    explicit Reader(const std::string &filename) : _in(filename, std::ios::binary) {
+        char magic[sizeof(MAGIC)];
+        if (not _in.read(magic, sizeof(magic)) or memcmp(magic, MAGIC, sizeof(MAGIC)) != 0) {
+            throw std::runtime_error("trace: '" + filename + "' is not a trace file");
+        }
+    }
+
+    // Reads the next record into 'kind' and 'payload' and returns false at the end of the file
+    bool next(Kind &kind, std::vector<char> &payload) {
+        const int k = _in.get();
+        if (k == std::char_traits<char>::eof()) {
+            return false;
+        }
+        uint64_t size;
+        if (not _in.read(reinterpret_cast<char *>(&size), sizeof(size))) {
+            throw std::runtime_error("trace: truncated record");
+        }
+        payload.resize(size);
+        if (not _in.read(payload.data(), size)) {
+            throw std::runtime_error("trace: truncated record");
+        }
+        kind = static_cast<Kind>(k);
+        return true;
+    }
+
+    // Rewinds to the first record
+    void rewind() {
+        _in.clear();
+        _in.seekg(sizeof(MAGIC));
+    }
+};
+
+}} // bohrium::tracefile
+
+#endif
@@ -87,6 +87,16 @@ int64_t bh_base_size(const bh_base *base);
  */
 DLLEXPORT void bh_data_malloc(bh_base* base);
 
+/* Use the data at 'offset' in the file 'path' as the data of the given base,
+ * which must not be allocated. The file is mapped copy-on-write, see bh_memory_map_file().
+ *
+ * @base    The base in question
+ * @path    The file that holds the data in the byte order of the machine
+ * @offset  The offset in bytes of the data in the file
+ * @return  Whether the file was mapped, otherwise the base is unchanged
+ */
+DLLEXPORT bool bh_data_map_file(bh_base* base, const char *path, int64_t offset);
+
 /* Frees data memory for the given view.
  * For convenience, the view is allowed to be NULL.
  *
@@ -0,0 +1,92 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __BH_BYTECODE_H
+#define __BH_BYTECODE_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+
+#include <bh_ir.hpp>
+
+namespace bohrium {
+namespace bytecode {
+
+// The version of the bytecode format, which is the first byte of each encoded BhIR
+constexpr uint8_t VERSION = 1;
+
+/* The encoder of the compact bytecode format of BhIRs:
+ *   - integers are varints (zigzag when signed) and a view only has 'ndim' shapes and strides
+ *   - a base array is encoded as its pointer and description the first time and as an id afterwards
+ *   - an instruction that only differs from a previous one by its base arrays and constant value is
+ *     encoded as a reference to the template of the previous one
+ * The ids and templates persist across encode() calls (until the base arrays are freed) thus the
+ * decoder must decode the encodings in the same order.
+ */
+class Encoder
+{
+public:
+    // At most 'max_templates' instruction templates are remembered
+    explicit Encoder(size_t max_templates = 4096) : max_templates(max_templates) {}
+
+    // Appends the encoding of 'bhir' to 'out'
+    void encode(const bh_ir &bhir, std::vector<char> &out);
+
+private:
+    const size_t max_templates;
+    std::unordered_map<const bh_base *, uint64_t> _base_ids;
+    uint64_t _next_base_id = 0;
+    std::map<std::string, uint64_t> _templates;
+    // The encoding of the current template, which is reused
+    std::string _template;
+};
+
+/* The decoder of the bytecode format of the Encoder */
+class Decoder
+{
+public:
+    explicit Decoder(size_t max_templates = 4096) : max_templates(max_templates) {}
+
+    /* Decodes the 'size' bytes of 'data' into 'bhir'. The instructions of 'bhir' are reused thus
+     * decoding a steady stream of similar BhIRs doesn't allocate memory.
+     *
+     * @bhir       The decoded BhIR, whose base arrays are the pointers of the encoder's side
+     * @new_bases  The descriptions of the base arrays that are new to the decoder in the order they appear,
+     *             where 'data' is non-NULL when the encoder's side has data
+     */
+    void decode(const char *data, size_t size, bh_ir &bhir, std::vector<bh_base> &new_bases);
+
+private:
+    const size_t max_templates;
+    std::unordered_map<uint64_t, bh_base *> _bases;
+    uint64_t _next_base_id = 0;
+    // The instruction templates without base arrays and constant values
+    std::vector<bh_instruction> _templates;
+    // Marks the non-constant views of a new template until their base arrays are decoded
+    bh_base _placeholder;
+    // The ids of the base arrays freed by the current BhIR
+    std::vector<uint64_t> _freed;
+};
+
+}}
+#endif
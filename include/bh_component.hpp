@@ -22,12 +22,14 @@ If not, see <http://www.gnu.org/licenses/>.
 #define __BH_COMPONENT_HPP
 
 #include <string>
+#include <chrono>
 #include <boost/property_tree/ptree.hpp>
 #include <boost/property_tree/ini_parser.hpp>
 
 #include <bh_config_parser.hpp>
 #include <bh_ir.hpp>
 #include <bh_opcode.h>
+#include <bh_trace.hpp>
 
 namespace bohrium {
 namespace component {
@@ -47,6 +49,15 @@ namespace component {
  *    use these two functions.
  */
 
+// The executions of a component, which ComponentFace::execute() records
+struct ExecuteTiming {
+    // Number of calls to execute() and the total number of instructions they received
+    uint64_t calls = 0;
+    uint64_t instrs = 0;
+    // The wall-clock time of the calls including the time spent in the children
+    std::chrono::duration<double> time{0};
+};
+
 // Representation of a component implementation, which is a virtual class
 // that all Bohrium components should implement
 class ComponentImpl {
@@ -54,8 +65,10 @@ class ComponentImpl {
     // The level in the runtime stack starting a -1, which is the bridge,
     // 0 is the first component in the stack list, 1 is the second component etc.
     const int stack_level;
-    // The configure file
-    const ConfigParser config;
+    // The configure file, which the "config: reload" message re-reads
+    ConfigParser config;
+    // The executions of this component, which the "statistic_enable_and_reset" message resets
+    ExecuteTiming timing;
     // Constructor
     ComponentImpl(int stack_level) : stack_level(stack_level), config(stack_level) {};
     virtual ~ComponentImpl() {}; // NB: a destructor implementation must exist
@@ -114,9 +127,23 @@ class ComponentFace {
      */
     void execute(bh_ir *bhir) {
         assert(_implementation != NULL);
+        const uint64_t ninstrs = bhir->instr_list.size();
+        trace::Scope scope("component", trace::enabled() ? _implementation->config.getName() : std::string());
+        scope.arg("instructions", ninstrs);
+        const auto start = std::chrono::steady_clock::now();
         _implementation->execute(bhir);
+        ExecuteTiming &timing = _implementation->timing;
+        ++timing.calls;
+        timing.instrs += ninstrs;
+        timing.time += std::chrono::steady_clock::now() - start;
     };
 
+    // The executions of the component (see ExecuteTiming)
+    const ExecuteTiming &timing() const {
+        assert(_implementation != NULL);
+        return _implementation->timing;
+    }
+
     /* Register a new extension method.
      *
      * @name   Name of the function
@@ -136,6 +163,16 @@ class ComponentFace {
      */
     std::string message(const std::string &msg) {
         assert(_implementation != NULL);
+        if (msg == "statistic_enable_and_reset") {
+            _implementation->timing = ExecuteTiming();
+        } else if (msg == "config: reload") {
+            // NB: options that a component reads at construction keep their value
+            _implementation->config.reload();
+        } else if (msg.compare(0, 7, "config:") == 0) {
+            // A "config:[section.]option=value" message sets the option in every component of the stack, where
+            // the components that read it at construction rebuild what depends on it when they get the message
+            _implementation->config.set(msg.substr(7));
+        }
         return _implementation->message(msg);
     }
 };
@@ -143,6 +180,8 @@ class ComponentFace {
 // Representation of a component implementation that has a child.
 // This is purely for convenience, it adds a child interface and implement
 // pass-through implementations of the required component methods.
+// The "statistic" message prepends the timing of the component (see timing_statistic()) to the child's statistic
+// thus the bridge gets the timing of every component in the stack.
 class ComponentImplWithChild : public ComponentImpl {
 protected:
     // The interface of the child
@@ -150,6 +189,10 @@ protected:
     // Flag that indicate whether the component is enabled or disabled.
     // When disabled, the component should pass through instructions untouched to its child
     bool disabled;
+
+    // Returns the executions of this component, the instructions it sends to its child, and its self time,
+    // which is the time not spent in the child
+    std::string timing_statistic() const;
 public:
     ComponentImplWithChild(int stack_level)
             : ComponentImpl(stack_level),
@@ -162,6 +205,9 @@ public:
         child.extmethod(name, opcode);
     };
     virtual std::string message(const std::string &msg) {
+        if (msg == "statistic") {
+            return timing_statistic() + child.message(msg);
+        }
         return child.message(msg);
     }
 };
@@ -25,6 +25,9 @@ If not, see <http://www.gnu.org/licenses/>.
 #include <boost/lexical_cast.hpp>
 #include <string>
 #include <vector>
+#include <sstream>
+#include <typeinfo>
+#include <unordered_map>
 
 // We need to specialize lexical_cast() in order to support booleans
 // other then the standard 0/1 to true/false conversion.
@@ -96,10 +99,35 @@ class ConfigParser {
     std::vector<std::string> _stack_list;
     // The config data
     boost::property_tree::ptree _config;
-    // Return section/option first looking at the environment variable
-    // and then the ini file.
-    std::string lookup(const std::string &section,
-                       const std::string &option) const;
+    // The snapshot of the values of each section and option, which are the ini file (without quotes) overridden by
+    // the environment variables BH_<SECTION>_<OPTION>. Thus, a lookup never walks the ptree or the environment.
+    std::unordered_map<std::string, std::unordered_map<std::string, std::string> > _values;
+    // The values set at runtime by set(), which overrides the ini file and the environment variables
+    std::unordered_map<std::string, std::unordered_map<std::string, std::string> > _overrides;
+    // Builds '_values' from the ini file, the environment variables, and '_overrides'
+    void snapshot();
+    // Return the value of section/option or NULL when it doesn't exist
+    const std::string *lookup(const std::string &section, const std::string &option) const {
+        auto s = _values.find(section);
+        if (s == _values.end()) {
+            return NULL;
+        }
+        auto o = s->second.find(option);
+        return o == s->second.end() ? NULL : &o->second;
+    }
+    // Convert 'value' of section/option to type 'T'
+    // Throws ConfigBadCast if the value cannot be converted
+    template<typename T>
+    static T convert(const std::string &section, const std::string &option, const std::string &value) {
+        try {
+            return boost::lexical_cast<T>(value);
+        } catch (const boost::bad_lexical_cast&) {
+            std::stringstream ss;
+            ss << "ConfigParser cannot convert '" << section << "." << option
+               << "=" << value << "' to type <" << typeid(T).name() << ">" << std::endl;
+            throw ConfigBadCast(ss.str());
+        }
+    }
   public:
     /* Uses 'stack_level' to find the default section to use with get()
      * and when calculating the child in getChild()
@@ -119,27 +147,14 @@ class ConfigParser {
      */
     template<typename T>
     T get(const std::string &section, const std::string &option) const {
-        using namespace std;
-        using namespace boost;
-        //Retrieve the option
-        string ret;
-        try {
-            ret = lookup(section, option);
-        } catch (const property_tree::ptree_bad_path&) {
-            stringstream ss;
+        const std::string *ret = lookup(section, option);
+        if (ret == NULL) {
+            std::stringstream ss;
             ss << "Error parsing the config file '" << file_path << "': '" \
-               << section << "." << option << "' not found!" << endl;
+               << section << "." << option << "' not found!" << std::endl;
             throw ConfigKeyNotFound(ss.str());
         }
-        //Now let's try to convert the value to the requested type
-        try {
-            return lexical_cast<T>(ret);
-        } catch (const boost::bad_lexical_cast&) {
-            stringstream ss;
-            ss << "ConfigParser cannot convert '" << section << "." << option
-               << "=" << ret << "' to type <" << typeid(T).name() << ">" << endl;
-            throw ConfigBadCast(ss.str());
-        }
+        return convert<T>(section, option, *ret);
     }
     template<typename T>
     T get(const std::string &option) const {
@@ -159,11 +174,11 @@ class ConfigParser {
     template<typename T>
     T defaultGet(const std::string &section, const std::string &option,
                  const T &default_value) const {
-        try {
-            return get<T>(section, option);
-        } catch (const ConfigKeyNotFound&) {
+        const std::string *ret = lookup(section, option);
+        if (ret == NULL) {
             return default_value;
         }
+        return convert<T>(section, option, *ret);
     }
     template<typename T>
     T defaultGet(const std::string &option, const T &default_value) const {
@@ -198,11 +213,10 @@ class ConfigParser {
      */
     std::vector<std::string> defaultGetList(const std::string &section, const std::string &option,
                                             const std::vector<std::string> &default_value) const {
-        try {
-            return getList(section, option);
-        } catch (const ConfigKeyNotFound&) {
+        if (lookup(section, option) == NULL) {
             return default_value;
         }
+        return getList(section, option);
     }
     std::vector<std::string> defaultGetList(const std::string &option,
                                             const std::vector<std::string> &default_value) const {
@@ -222,6 +236,30 @@ class ConfigParser {
      * @return Component name as given in the config file
      */
     std::string getName() const { return _default_section; };
+
+    /* Re-read the ini file and the environment variables, which the
+     * lookups see from now on (the "config: reload" message calls this)
+     */
+    void reload();
+
+    /* Set the 'option' within the 'section' to 'value' at runtime, which
+     * overrides the ini file and the environment variables (also after a reload)
+     *
+     * @section  The ini section e.g. [gpu]
+     * @option   The ini option e.g. timing
+     * @value    The new value
+     */
+    void set(const std::string &section, const std::string &option, const std::string &value);
+
+    /* Set an option from an 'assignment' of the form "[section.]option=value"
+     * where the default section is used when the section is omitted
+     * (the "config:<assignment>" message calls this)
+     *
+     * @assignment  The assignment e.g. "work_group_size_1dx=256"
+     * @return      The "section.option" and the value
+     * Throws ConfigError if 'assignment' has no '='
+     */
+    std::pair<std::string, std::string> set(const std::string &assignment);
 };
 
 } //namespace bohrium
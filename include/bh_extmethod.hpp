@@ -68,6 +68,26 @@ class ExtmethodImpl {
      * Throws exceptions on error
      */
     virtual void execute(bh_instruction *instr, void* arg) = 0;
+
+    /* Whether the extmethod computes the epilogue 'out = alpha * f(in...) + D' of its result 'out' (the first
+     * operand) of its three operands when the instruction has the additional operands D (an array of the shape of
+     * 'out') and/or alpha (a real constant in the instruction's constant), in that order
+     */
+    virtual bool epilogue() const { return false; }
+
+    // The work of an instruction: its floating-point operations and the bytes of the operands that it reads and writes
+    struct Cost {
+        double flops;
+        double bytes;
+    };
+
+    /* The work of executing 'instr', which the parent weighs on its own device and on the one of its child when both
+     * implement the extmethod. A negative 'flops' means unknown, which executes the extmethod in the parent.
+     */
+    virtual Cost cost(const bh_instruction &instr) const { return Cost{-1, 0}; }
+
+    // Whether the extmethod can execute 'instr', e.g. its types and layouts, or else the child of the parent must
+    virtual bool supports(const bh_instruction &instr) const { return true; }
 };
 
 // Representation of an extmethod interface, which consist of a create()
@@ -43,6 +43,12 @@ struct bh_instruction
         origin_id   = instr.origin_id;
         operand     = instr.operand;
     }
+    // NB: moving an instruction moves its operands thus passing an instruction down the stack doesn't copy them
+    bh_instruction(bh_instruction&& instr) noexcept : opcode(instr.opcode), operand(std::move(instr.operand)),
+                                                      constant(instr.constant), constructor(instr.constructor),
+                                                      origin_id(instr.origin_id) {}
+    bh_instruction& operator=(const bh_instruction& instr) = default;
+    bh_instruction& operator=(bh_instruction&& instr) = default;
 
     // Return a set of all bases used by the instruction
     std::set<const bh_base *> get_bases_const() const;
@@ -56,7 +56,7 @@ public:
     */
     bh_ir(const char bhir[], int64_t size);
 
-    /* Serialize the BhIR object into a char buffer
+    /* Serialize the BhIR object into a char buffer using the bytecode format of bh_bytecode.hpp
     *  (use the bh_ir constructor above to deserialization)
     *
     *  @buffer   The char vector to serialize into
@@ -66,9 +66,20 @@ public:
     //The list of Bohrium instructions in topological order
     std::vector<bh_instruction> instr_list;
 
+    /* Removes the BH_NONE instructions of 'instr_list' in one pass and shrinks the bodies of the BH_REPEATs
+     * accordingly. Thus, a component erases instructions by overwriting their opcode with BH_NONE (a tombstone)
+     * instead of erasing them from the middle of the vector one at a time.
+     */
+    void remove_none();
+
     // Should the ve tally after this bh_ir
     bool tally;
 
+    // The id of the trace that this bh_ir replays, which the node VEM sets when the bh_ir is structurally equal
+    // to a previous bh_ir up to the base arrays and constant values (-1 means no replay).
+    // NB: it isn't serialized thus components across a network doesn't see it
+    int64_t replay_trace = -1;
+
 protected:
     // Serialization using Boost
     friend class boost::serialization::access;
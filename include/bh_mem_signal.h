@@ -50,12 +50,31 @@ void bh_mem_signal_shutdown(void);
 void bh_mem_signal_attach(const void *idx, const void *addr, uint64_t size,
                          void (*callback)(void*, void*));
 
+/** Attach 'count' continues memory segments to signal handler at once, which is
+ *  cheaper than attaching them one by one. Either all or none of them are attached.
+ *
+ * @param count - Number of memory segments
+ * @param idx - Id of each memory segment
+ * @param addr - Start address of each memory segment
+ * @param size - Size of each memory segment in bytes
+ * @param callback - Callback function of all the memory segments (see bh_mem_signal_attach())
+ */
+void bh_mem_signal_attach_batch(uint64_t count, const void *const idx[], const void *const addr[],
+                                const uint64_t size[], void (*callback)(void*, void*));
+
 /** Detach signal
  *
  * @param addr - Start address of memory segment.
  */
 void bh_mem_signal_detach(const void *addr);
 
+/** Detach 'count' signals at once
+ *
+ * @param count - Number of memory segments
+ * @param addr - Start address of each memory segment
+ */
+void bh_mem_signal_detach_batch(uint64_t count, const void *const addr[]);
+
 /** Check if signal exist
  *
  * @param addr - Start address of memory segment.
@@ -1,51 +1,157 @@
-/*
-This file is part of Bohrium and copyright (c) 2012 the Bohrium
-team <http://www.bh107.org>.
-
-Bohrium is free software: you can redistribute it and/or modify
-it under the terms of the GNU Lesser General Public License as
-published by the Free Software Foundation, either version 3
-of the License, or (at your option) any later version.
-
-Bohrium is distributed in the hope that it will be useful,
-but WITHOUT ANY WARRANTY; without even the implied warranty of
-MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
-GNU General Public License for more details.
-
-You should have received a copy of the
-GNU Lesser General Public License along with Bohrium.
-
-If not, see <http://www.gnu.org/licenses/>.
-*/
-
-#ifndef __BH_MEMORY_H
-#define __BH_MEMORY_H
-
-#include <bh_type.hpp>
-
-#ifdef __cplusplus
-extern "C" {
-#endif
-
-/* Allocate an alligned contigous block of memory,
- * without any initialization
- *
- * @size  The size of the allocated block
- * @return A pointer to data, and NULL on error
- */
-void* bh_memory_malloc(int64_t size);
-
-/* Frees a previously allocated data block
- *
- * @data  The pointer returned from a call to bh_memory_malloc
- * @size  The size of the allocated block
- * @return A pointer to data, and NULL on error
- */
-int64_t bh_memory_free(void* data, int64_t size);
-
-#ifdef __cplusplus
-}
-#endif
-
-#endif
-
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __BH_MEMORY_H
+#define __BH_MEMORY_H
+
+#include <bh_type.hpp>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Allocate an alligned contigous block of memory,
+ * without any initialization
+ *
+ * @size  The size of the allocated block
+ * @return A pointer to data, and NULL on error
+ */
+void* bh_memory_malloc(int64_t size);
+
+/* Frees a previously allocated data block
+ *
+ * @data  The pointer returned from a call to bh_memory_malloc
+ * @size  The size of the allocated block
+ * @return A pointer to data, and NULL on error
+ */
+int64_t bh_memory_free(void* data, int64_t size);
+
+/* Hands the block 'data', which wasn't allocated by bh_memory_malloc(), over to
+ * bh_memory_free(), which then frees it by calling 'free_fn(data, arg)'
+ *
+ * @data     The block to adopt
+ * @free_fn  The function that frees the block
+ * @arg      The argument passed to 'free_fn'
+ */
+void bh_memory_adopt(void *data, void (*free_fn)(void *data, void *arg), void *arg);
+
+/* Takes a block handed over by bh_memory_adopt() back, which bh_memory_free()
+ * must no longer free
+ *
+ * @data  The adopted block
+ */
+void bh_memory_disown(void *data);
+
+/* Returns whether the block 'data' was handed over by bh_memory_adopt(), thus
+ * bh_memory_free() calls the free function of its owner
+ *
+ * @data  The block
+ */
+bool bh_memory_is_adopted(const void *data);
+
+/* Maps the 'size' bytes at 'offset' of the file 'path' copy-on-write, thus the
+ * pages are read lazily on first access and writes never reach the file.
+ * The block is adopted (see bh_memory_adopt()) and bh_memory_free() unmaps it.
+ *
+ * @path    The file to map
+ * @offset  The offset in bytes of the block in the file
+ * @size    The size of the block
+ * @return  A pointer to the block, and NULL on error
+ */
+void* bh_memory_map_file(const char *path, int64_t offset, int64_t size);
+
+/* Returns the number of bytes currently allocated by bh_memory_malloc()
+ * that are backed by huge pages, see BH_HUGEPAGE_THRESHOLD
+ *
+ * @return The number of bytes
+ */
+uint64_t bh_memory_hugepage_bytes(void);
+
+/* Returns the number of allocations looked up in the pool of freed blocks
+ * and the number of them that reused a block, see BH_MEMORY_POOL_BYTES
+ *
+ * @lookups  The number of lookups
+ * @hits     The number of hits
+ */
+void bh_memory_pool_stats(uint64_t *lookups, uint64_t *hits);
+
+/* The devices of the memory tracker, which records the live arrays of bh_data_malloc()
+ * (the host) and of the device buffers of the engines */
+enum {BH_MEMORY_HOST = 0, BH_MEMORY_CUDA = 1, BH_MEMORY_OPENCL = 2, BH_MEMORY_NUM_DEVICES = 3};
+
+/* The number of size classes of the tracker, where class 'i' counts the allocations
+ * of more than 2^(i-1) and at most 2^i bytes */
+#define BH_MEMORY_SIZE_CLASSES 64
+
+/* Records that the array 'key' has 'bytes' allocated on 'device', which replaces
+ * an earlier record of 'key'
+ *
+ * @device  The device, e.g. BH_MEMORY_HOST
+ * @key     The array, e.g. its base
+ * @bytes   The allocated bytes
+ */
+void bh_memory_track_alloc(int device, const void *key, uint64_t bytes);
+
+/* Records that the array 'key' on 'device' is freed (unknown arrays are ignored)
+ *
+ * @device  The device
+ * @key     The array
+ */
+void bh_memory_track_free(int device, const void *key);
+
+/* Returns whether the array 'key' is live on 'device'
+ *
+ * @device  The device
+ * @key     The array
+ */
+bool bh_memory_is_tracked(int device, const void *key);
+
+/* Returns the bytes of the live arrays on 'device' now and at most so far, which
+ * doesn't lock anything
+ *
+ * @device   The device
+ * @current  The current bytes
+ * @peak     The peak bytes
+ */
+void bh_memory_usage(int device, uint64_t *current, uint64_t *peak);
+
+/* Returns the number of allocations on 'device' of each size class
+ *
+ * @device  The device
+ * @counts  The BH_MEMORY_SIZE_CLASSES counts
+ */
+void bh_memory_size_classes(int device, uint64_t *counts);
+
+/* Returns the 'num' largest live arrays on 'device' in decreasing size
+ *
+ * @device  The device
+ * @num     The maximum number of arrays
+ * @keys    The 'num' keys of the arrays
+ * @bytes   The 'num' sizes of the arrays
+ * @return  The number of arrays returned
+ */
+uint64_t bh_memory_largest(int device, uint64_t num, const void **keys, uint64_t *bytes);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
@@ -28,6 +28,7 @@ If not, see <http://www.gnu.org/licenses/>.
 #include <bh_view.hpp>
 #include <bh_ir.hpp>
 #include <bh_instruction.hpp>
+#include <bh_bytecode.hpp>
 
 // Forward declaration of class boost::serialization::access
 namespace boost {namespace serialization {class access;}}
@@ -42,7 +43,9 @@ enum Type
     TYPE_INIT,
     TYPE_SHUTDOWN,
     TYPE_EXEC,
-    TYPE_EXTMETHOD
+    TYPE_EXTMETHOD,
+    TYPE_FETCH,     // The remote bases of synced arrays that the frontend didn't receive yet
+    TYPE_FETCH_RANGE // The remote base and the byte range [begin, end) of a synced array that the frontend reads
 };
 
 struct Header
@@ -67,6 +70,7 @@ struct Init
 class ExecuteFrontend
 {
     std::set<const bh_base *> known_base_arrays;
+    bytecode::Encoder encoder;
 public:
     void serialize(const bh_ir &bhir, std::vector<char> &buffer, std::vector<bh_base*> &data_send, std::vector<bh_base*> &data_recv);
     void cleanup(bh_ir &bhir);
@@ -76,9 +80,12 @@ class ExecuteBackend
 {
     std::map<const bh_base*, bh_base> remote2local;
     std::set<const bh_base*> remote_frees;
+    bytecode::Decoder decoder;
 public:
     bh_ir deserialize(std::vector<char> &buffer, std::vector<bh_base*> &data_send, std::vector<bh_base*> &data_recv);
     void cleanup(const bh_ir &bhir);
+    // Returns the local base array of the 'remote' base array or NULL when it is unknown
+    bh_base *local(const bh_base *remote);
 };
 
 
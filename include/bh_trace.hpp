@@ -0,0 +1,113 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __BH_TRACE_HPP
+#define __BH_TRACE_HPP
+
+#include <chrono>
+#include <string>
+#include <cstring>
+#include <cstdint>
+
+/* The timeline of the execution pipeline, e.g. the flushes of the bridge, the executions of the components,
+ * and the fusion, compilation, kernels, and copies of the engines. Each thread records its events in its own ring
+ * buffer thus the recording doesn't lock. The events are written as Chrome trace JSON, which Perfetto and
+ * chrome://tracing display, when the process exits. The 'trace_filename' option of the bridge enables it.
+ */
+namespace bohrium {
+namespace trace {
+
+// An event of the timeline, whose strings are copied since the components that record them might be unloaded
+// before the events are written
+struct Event {
+    char category[16];
+    char name[32];
+    // The nanoseconds of the steady clock
+    uint64_t begin;
+    uint64_t duration;
+    // Up to two arguments where empty names are omitted
+    char arg_names[2][16];
+    uint64_t args[2];
+};
+
+// Copy the string 'src' into 'dst', which it might truncate
+template<size_t N>
+void copy(char (&dst)[N], const char *src) {
+    std::strncpy(dst, src, N - 1);
+    dst[N - 1] = '\0';
+}
+
+// Whether the timeline is recorded
+bool enabled();
+
+// Record 'event' in the ring buffer of the calling thread
+void record(const Event &event);
+
+// Write the recorded events into the trace file, which the exit of the process also does
+void write();
+
+// The current time in nanoseconds of the steady clock
+inline uint64_t now() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// Records the lifetime of a scope as an event, which does nothing when the timeline isn't recorded
+class Scope {
+    bool _enabled;
+    Event _event;
+
+  public:
+    Scope(const char *category, const char *name) : _enabled(enabled()) {
+        if (_enabled) {
+            copy(_event.category, category);
+            copy(_event.name, name);
+            _event.arg_names[0][0] = _event.arg_names[1][0] = '\0';
+            _event.begin = now();
+        }
+    }
+    Scope(const char *category, const std::string &name) : Scope(category, name.c_str()) {}
+
+    ~Scope() {
+        end();
+    }
+
+    // End the event before the end of the scope
+    void end() {
+        if (_enabled) {
+            _event.duration = now() - _event.begin;
+            record(_event);
+            _enabled = false;
+        }
+    }
+
+    // Add the argument 'name' of the event, e.g. the hash of a kernel or the bytes of a copy (up to two)
+    void arg(const char *name, uint64_t value) {
+        if (_enabled) {
+            const int i = _event.arg_names[0][0] == '\0' ? 0 : 1;
+            copy(_event.arg_names[i], name);
+            _event.args[i] = value;
+        }
+    }
+};
+
+}} // namespace bohrium::trace
+
+#endif
@@ -23,6 +23,7 @@ If not, see <http://www.gnu.org/licenses/>.
 
 #include <stdexcept>
 #include <complex>
+#include <iosfwd>
 #include <stdint.h>
 #include <bh_win.h>
 
@@ -42,6 +43,23 @@ typedef struct { float real, imag; } bh_complex64;
 typedef struct { double real, imag; } bh_complex128;
 typedef struct { bh_uint64 start, key; } bh_r123;
 
+/* The 16-bit floating-point storage types: IEEE 754 half precision and bfloat16 (the upper half of a float32).
+ * They only store values, which are converted to and computed as float32 */
+struct DLLEXPORT bh_float16 {
+    uint16_t bits;
+    bh_float16() = default;
+    explicit bh_float16(float value);
+    operator float() const;
+};
+struct DLLEXPORT bh_bfloat16 {
+    uint16_t bits;
+    bh_bfloat16() = default;
+    explicit bh_bfloat16(float value);
+    operator float() const;
+};
+DLLEXPORT std::ostream &operator<<(std::ostream &out, bh_float16 value);
+DLLEXPORT std::ostream &operator<<(std::ostream &out, bh_bfloat16 value);
+
 /* Codes for data types */
 enum class bh_type
 {
@@ -58,7 +76,9 @@ enum class bh_type
     FLOAT64,
     COMPLEX64,
     COMPLEX128,
-    R123
+    R123,
+    FLOAT16,
+    BFLOAT16
 };
 
 // Return a `bh_type` based on a template type
@@ -107,6 +127,12 @@ template<> inline bh_type bh_type_from_template<std::complex<double> >() {
 template<> inline bh_type bh_type_from_template<bh_r123>() {
     return bh_type::R123;
 }
+template<> inline bh_type bh_type_from_template<bh_float16>() {
+    return bh_type::FLOAT16;
+}
+template<> inline bh_type bh_type_from_template<bh_bfloat16>() {
+    return bh_type::BFLOAT16;
+}
 
 typedef int64_t    bh_opcode;
 
@@ -160,6 +186,13 @@ DLLEXPORT int bh_type_is_float(bh_type type);
  */
 DLLEXPORT int bh_type_is_complex(bh_type type);
 
+/* The type that computes the values of a type, which is FLOAT32 for the 16-bit floating-point storage types
+ *
+ * @type   The type.
+ * @return The compute type.
+ */
+DLLEXPORT bh_type bh_type_compute(bh_type type);
+
 /* Maximum value of integer type (incl. boolean)
  *
  * @type   The type.
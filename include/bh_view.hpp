@@ -29,6 +29,7 @@ If not, see <http://www.gnu.org/licenses/>.
 #include <cstring>
 #include <cassert>
 #include <tuple>
+#include <functional>
 #include "bh_type.hpp"
 #include "bh_base.hpp"
 #include <bh_constant.hpp>
@@ -60,6 +61,20 @@ struct bh_view
         std::memcpy(shape, view.shape, ndim * sizeof(int64_t));
         std::memcpy(stride, view.stride, ndim * sizeof(int64_t));
     }
+    // Like the copy constructor, we only copy the 'ndim' first dimensions instead of all BH_MAXDIM
+    bh_view& operator=(const bh_view& view)
+    {
+        base = view.base;
+        if(base == NULL) {
+            return *this; //'view' is a constant thus the rest are garbage
+        }
+        start = view.start;
+        ndim = view.ndim;
+        assert(ndim < BH_MAXDIM);
+        std::memcpy(shape, view.shape, ndim * sizeof(int64_t));
+        std::memcpy(stride, view.stride, ndim * sizeof(int64_t));
+        return *this;
+    }
 
     /// Pointer to the base array.
     bh_base*      base;
@@ -143,6 +158,22 @@ struct bh_view
         return !(*this == other);
     }
 
+    // Returns a hash of the start, the 'ndim' first shapes and strides, and the base if 'with_base'
+    size_t hash(bool with_base = true) const
+    {
+        uint64_t ret = with_base ? reinterpret_cast<uint64_t>(base) : 0;
+        auto mix = [&ret](uint64_t value) {
+            ret ^= value + 0x9e3779b97f4a7c15ull + (ret << 6) + (ret >> 2);
+        };
+        mix(static_cast<uint64_t>(start));
+        mix(static_cast<uint64_t>(ndim));
+        for (int64_t i = 0; i < ndim; ++i) {
+            mix(static_cast<uint64_t>(shape[i]));
+            mix(static_cast<uint64_t>(stride[i]));
+        }
+        return static_cast<size_t>(ret);
+    }
+
     template<class Archive>
     void save(Archive & ar, const unsigned int version) const
     {
@@ -172,6 +203,15 @@ struct bh_view
     BOOST_SERIALIZATION_SPLIT_MEMBER()
 };
 
+namespace std {
+// NB: like 'operator==', the hash is only meaningful for non-constant views
+template<> struct hash<bh_view> {
+    size_t operator()(const bh_view &view) const {
+        return view.hash();
+    }
+};
+}
+
 //Implements pprint of views
 DLLEXPORT std::ostream& operator<<(std::ostream& out, const bh_view& v);
 
@@ -42,8 +42,9 @@ std::vector<Block> apply_pre_fusion(const std::vector<bh_instruction*> &instr_li
 
 // Apply the list of tranformers specified by the names in 'transformer_names'
 // 'avoid_rank0_sweep' will avoid fusion of sweeped and non-sweeped blocks at the root level
+// 'config' holds the parameters of the transformers such as the machine parameters of the "cost_model" fuser
 void apply_transformers(std::vector<Block> &block_list, const std::vector<std::string> &transformer_names,
-                        bool avoid_rank0_sweep);
+                        bool avoid_rank0_sweep, const ConfigParser &config);
 
 // Create a block list based on 'instr_list' and what is in the 'config' and 'fcache'
 // 'avoid_rank0_sweep' will avoid fusion of sweeped and non-sweeped blocks at the root level
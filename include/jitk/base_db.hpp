@@ -22,9 +22,11 @@ If not, see <http://www.gnu.org/licenses/>.
 #define __BH_JITK_BASE_DB_H
 
 #include <map>
+#include <unordered_map>
 #include <vector>
 #include <string>
 #include <sstream>
+#include <stdexcept>
 
 #include <bh_view.hpp>
 #include <bh_util.hpp>
@@ -55,6 +57,18 @@ struct idx_less {
     }
 };
 
+// Hash and equality classes of the index maps, which like 'idx_less' ignore the bases
+struct idx_hash {
+    size_t operator() (const bh_view& v) const {
+        return v.hash(false);
+    }
+};
+struct idx_equal {
+    bool operator() (const bh_view& v1, const bh_view& v2) const {
+        return not idx_less()(v1, v2) and not idx_less()(v2, v1);
+    }
+};
+
 // Compare class for the OffsetAndStrides sets and maps
 struct OffsetAndStrides_less {
     // This compare is the same as view compare ('v1 < v2') but ignoring their bases
@@ -74,6 +88,26 @@ struct OffsetAndStrides_less {
     }
 };
 
+// Hash and equality classes of the OffsetAndStrides maps, which like 'OffsetAndStrides_less' ignore the bases
+// and the shapes
+struct OffsetAndStrides_hash {
+    size_t operator() (const bh_view& v) const {
+        size_t ret = std::hash<int64_t>()(v.start) ^ (std::hash<int64_t>()(v.ndim) << 1);
+        for (int64_t i = 0; i < v.ndim; ++i) {
+            ret ^= std::hash<int64_t>()(v.stride[i]) + 0x9e3779b97f4a7c15ull + (ret << 6) + (ret >> 2);
+        }
+        return ret;
+    }
+};
+struct OffsetAndStrides_equal {
+    bool operator() (const bh_view& v1, const bh_view& v2) const {
+        if (v1.ndim != v2.ndim or v1.start != v2.start) {
+            return false;
+        }
+        return std::equal(v1.stride, v1.stride + v1.ndim, v2.stride);
+    }
+};
+
 // Compare class for the constant_map
 struct Constant_less {
     // This compare tje 'origin_id' member of the instructions
@@ -82,32 +116,143 @@ struct Constant_less {
     }
 };
 
+// Hash and equality classes of the view maps, which compare the views including their bases
+struct view_hash {
+    size_t operator() (const bh_view& v) const {
+        return v.hash(true);
+    }
+};
+struct view_equal {
+    bool operator() (const bh_view& v1, const bh_view& v2) const {
+        return v1 == v2;
+    }
+};
+
+/* An open-addressing (linear probing) map from views to IDs, which assigns the IDs in insertion order.
+ * The map points to the inserted views, which must outlive it, and keeps their hashes thus neither inserts
+ * nor lookups copy a view. 'Hash' and 'Equal' define which parts of the views make up the key.
+ */
+template <typename Hash, typename Equal>
+class ViewIDMap {
+private:
+    struct Slot {
+        const bh_view *view; // NULL marks an empty slot
+        size_t hash;
+        size_t id;
+    };
+    std::vector<Slot> _slots; // The number of slots is a power of two and at least twice the number of IDs
+    size_t _size = 0;
+
+    void grow() {
+        std::vector<Slot> old(_slots.size() * 2, Slot{NULL, 0, 0});
+        old.swap(_slots);
+        for (const Slot &slot: old) {
+            if (slot.view != NULL) {
+                size_t i = slot.hash & (_slots.size() - 1);
+                while (_slots[i].view != NULL) {
+                    i = (i + 1) & (_slots.size() - 1);
+                }
+                _slots[i] = slot;
+            }
+        }
+    }
+
+    // Returns the slot of 'view', which is empty when 'view' isn't in the map
+    size_t probe(const bh_view &view, size_t hash) const {
+        size_t i = hash & (_slots.size() - 1);
+        while (_slots[i].view != NULL and (_slots[i].hash != hash or not Equal()(*_slots[i].view, view))) {
+            i = (i + 1) & (_slots.size() - 1);
+        }
+        return i;
+    }
+
+public:
+    // 'capacity' is the expected number of views, which avoids rehashing
+    explicit ViewIDMap(size_t capacity = 0) {
+        size_t num_slots = 16;
+        while (num_slots < capacity * 2) {
+            num_slots *= 2;
+        }
+        _slots.resize(num_slots, Slot{NULL, 0, 0});
+    }
+
+    size_t size() const {
+        return _size;
+    }
+
+    // Inserts 'view' with the ID size() unless an equal view is in the map already
+    void insert(const bh_view *view) {
+        const size_t hash = Hash()(*view);
+        size_t i = probe(*view, hash);
+        if (_slots[i].view == NULL) {
+            if ((_size + 1) * 2 > _slots.size()) {
+                grow();
+                i = probe(*view, hash);
+            }
+            _slots[i] = Slot{view, hash, _size++};
+        }
+    }
+
+    // Returns the ID of 'view' or -1 when 'view' isn't in the map
+    int64_t find(const bh_view &view) const {
+        const Slot &slot = _slots[probe(view, Hash()(view))];
+        return slot.view == NULL ? -1 : static_cast<int64_t>(slot.id);
+    }
+
+    // Returns the ID of 'view', throws exception if 'view' doesn't exist
+    size_t at(const bh_view &view) const {
+        const int64_t id = find(view);
+        if (id < 0) {
+            throw std::out_of_range("ViewIDMap::at(): unknown view");
+        }
+        return static_cast<size_t>(id);
+    }
+};
+
 class SymbolTable {
 private:
-    std::map<const bh_base*, size_t> _base_map; // Mapping a base to its ID
-    std::map<bh_view, size_t> _view_map; // Mapping a view to its ID
-    std::map<bh_view, size_t, idx_less> _idx_map; // Mapping a index (of an array) to its ID
-    std::map<bh_view, size_t, OffsetAndStrides_less> _offset_strides_map; // Mapping a offset-and-strides to its ID
+    // NB: the maps point to the views of the instructions thus we keep the instructions alive
+    std::vector<InstrPtr> _instr_list;
+    // NB: the IDs only depend on the order of the 'instr_list' thus the maps are unordered
+    std::unordered_map<const bh_base*, size_t> _base_map; // Mapping a base to its ID
+    ViewIDMap<view_hash, view_equal> _view_map; // Mapping a view to its ID
+    ViewIDMap<idx_hash, idx_equal> _idx_map; // Mapping a index (of an array) to its ID
+    ViewIDMap<OffsetAndStrides_hash, OffsetAndStrides_equal> _offset_strides_map; // Mapping a offset-and-strides to its ID
     std::set<InstrPtr, Constant_less> _constant_set; // Sets of instructions to a constant ID
+    std::vector<int64_t> _constant_ids; // The ID of the constant of each 'origin_id' or -1
     std::set<const bh_base*> _array_always; // Sets of base arrays that should always be arrays
+    std::set<bh_view> _unique_indexes; // Sets of views that only the BH_RANGE instructions of the kernel write
+    std::vector<int64_t> _loop_sizes; // The loop sizes that are kernel arguments ("shape as variable")
 
 public:
-    SymbolTable(const std::vector<InstrPtr> &instr_list, bool index_as_var, bool const_as_var) {
+    // NB: an empty 'loop_sizes' deactivate "shape as variable"
+    SymbolTable(const std::vector<InstrPtr> &instr_list, bool index_as_var, bool const_as_var,
+                const std::vector<int64_t> &loop_sizes = std::vector<int64_t>()) :
+            _instr_list(instr_list),
+            _view_map(instr_list.size() * 3),
+            _idx_map(index_as_var ? instr_list.size() * 3 : 0),
+            _offset_strides_map(instr_list.size() * 3),
+            _loop_sizes(loop_sizes) {
         // NB: by assigning the IDs in the order they appear in the 'instr_list',
         //     the kernels can better be reused
-        for (const InstrPtr &instr: instr_list) {
-            for (const bh_view *view: instr->get_views()) {
-                _base_map.insert(std::make_pair(view->base, _base_map.size()));
-                _view_map.insert(std::make_pair(*view, _view_map.size()));
+        for (const InstrPtr &instr: _instr_list) {
+            for (const bh_view &view: instr->operand) {
+                if (bh_is_constant(&view)) {
+                    continue;
+                }
+                _base_map.insert(std::make_pair(view.base, _base_map.size()));
+                _view_map.insert(&view);
                 if (index_as_var) {
-                    _idx_map.insert(std::make_pair(*view, _idx_map.size()));
+                    _idx_map.insert(&view);
                 }
-                _offset_strides_map.insert(std::make_pair(*view, _offset_strides_map.size()));
+                _offset_strides_map.insert(&view);
             }
             if (const_as_var) {
                 assert(instr->origin_id >= 0);
+                // The constants of the 16-bit floating-point types are written as literals, which computes in float32
                 if (instr->has_constant() and bh_opcode_is_elementwise(instr->opcode)
-                    and instr->opcode != BH_RANDOM) {
+                    and instr->opcode != BH_RANDOM
+                    and bh_type_compute(instr->constant.type) == instr->constant.type) {
                     _constant_set.insert(instr);
                 }
             }
@@ -116,10 +261,33 @@ public:
                     _array_always.insert(instr->operand[1].base);
                 }
             }
-            if (instr->opcode == BH_SCATTER or instr->opcode == BH_COND_SCATTER) {
+            if (instr->opcode == BH_SCATTER or instr->opcode == BH_COND_SCATTER or instr->opcode == BH_ADD_SCATTER) {
                 _array_always.insert(instr->operand[0].base);
             }
         }
+        // A view that a BH_RANGE writes holds unique values, when no other instruction of the kernel writes its base
+        {
+            std::map<const bh_base*, int> writers;
+            for (const InstrPtr &instr: _instr_list) {
+                if (bh_opcode_is_system(instr->opcode) or instr->operand.empty()) {
+                    continue;
+                }
+                ++writers[instr->operand[0].base];
+            }
+            for (const InstrPtr &instr: _instr_list) {
+                if (instr->opcode == BH_RANGE and writers[instr->operand[0].base] == 1) {
+                    _unique_indexes.insert(instr->operand[0]);
+                }
+            }
+        }
+        // The ID of a constant is its (one-based) position in '_constant_set'
+        int64_t count = 0;
+        for (const InstrPtr &instr: _constant_set) {
+            if (static_cast<size_t>(instr->origin_id) >= _constant_ids.size()) {
+                _constant_ids.resize(instr->origin_id + 1, -1);
+            }
+            _constant_ids[instr->origin_id] = ++count;
+        }
     };
     // Get the ID of 'base', throws exception if 'base' doesn't exist
     size_t baseID(const bh_base *base) const {
@@ -135,14 +303,14 @@ public:
     }
     // Check if 'index' exist
     bool existIdxID(const bh_view &index) const {
-        return util::exist(_idx_map, index);
+        return _idx_map.find(index) >= 0;
     }
     // Get the offset-and-strides ID of 'view', throws exception if 'view' doesn't exist
     size_t offsetStridesID(const bh_view &view) const {
         return _offset_strides_map.at(view);
     }
     bool existOffsetStridesID(const bh_view &view) const {
-        return util::exist(_offset_strides_map,view);
+        return _offset_strides_map.find(view) >= 0;
     }
     // Get the set of constants
     const std::set<InstrPtr, Constant_less> &constIDs() const {
@@ -152,12 +320,8 @@ public:
     // Or returns -1 when 'instr' has no ID
     int64_t constID(const bh_instruction &instr) const {
         assert(instr.origin_id >= 0);
-        size_t count=0;
-        // Since the size of '_constant_set' is small (way below a 1000), we simply do a linear search
-        for (const InstrPtr &i: _constant_set) {
-            count++;
-            if (i->origin_id == instr.origin_id)
-                return count;
+        if (static_cast<size_t>(instr.origin_id) < _constant_ids.size()) {
+            return _constant_ids[instr.origin_id];
         }
         return -1;
     }
@@ -165,6 +329,37 @@ public:
     bool isAlwaysArray(const bh_base *base) const {
         return util::exist(_array_always, base);
     }
+    // Return true when the elements of 'view' are unique within the kernel, which is the case when only BH_RANGE
+    // writes it (e.g. the indexes of a scatter that therefore never write the same element twice)
+    bool isUniqueIndexes(const bh_view &view) const {
+        return util::exist(_unique_indexes, view);
+    }
+    // Get the loop sizes that are kernel arguments
+    const std::vector<int64_t> &loopSizes() const {
+        return _loop_sizes;
+    }
+    // Get the ID of the loop 'size' or returns -1 when 'size' isn't a kernel argument
+    int64_t loopSizeID(int64_t size) const {
+        // Since the number of loop sizes is tiny, we simply do a linear search
+        for (size_t i = 0; i < _loop_sizes.size(); ++i) {
+            if (_loop_sizes[i] == size)
+                return i;
+        }
+        return -1;
+    }
+};
+
+// Appends the names of the symbols to a string, which is much cheaper than constructing a stringstream per name
+struct NameWriter {
+    std::string str;
+    NameWriter &operator<<(const char *s) {
+        str += s;
+        return *this;
+    }
+    NameWriter &operator<<(size_t id) {
+        str += std::to_string(id);
+        return *this;
+    }
 };
 
 class Scope {
@@ -180,11 +375,21 @@ private:
     std::set<bh_base*> _declared_base; // Set of bases that have been locally declared (e.g. a temporary variable)
     std::set<bh_view> _declared_view; // Set of views that have been locally declared (e.g. a temporary variable)
     std::set<bh_view, idx_less> _declared_idx; // Set of indexes that have been locally declared
+    std::map<bh_view, std::string> _local_tiles; // Map of scalar replaced arrays to their loads from local memory
+    std::map<std::vector<std::string>, std::string> _partial_idx; // Map of the strides of outer axes to their partial indexes
 public:
     // Should we declare scalar variables using the volatile keyword?
     const bool use_volatile;
     // Should we use offset and strides as variables?
     const bool strides_as_variables;
+    // Should we hoist the terms of the outer axes of the array indexes into the enclosing loops?
+    const bool strength_reduce;
+    // Should we write the complex operations as inline arithmetic on the real and imaginary parts (OpenMP)?
+    const bool inline_complex;
+    // Should we divide by the constant integer divisors through their magic numbers (OpenMP)?
+    const bool magic_division;
+    // Should we write the conditional scatters with unique indexes as branch-free selects?
+    const bool predicated_scatter;
 
     template<typename T1, typename T2>
     Scope(const SymbolTable &symbols,
@@ -194,7 +399,11 @@ public:
           const T2 &scalar_replacements_r,
           const ConfigParser &config) : symbols(symbols), parent(parent),
                                         use_volatile(config.defaultGet<bool>("volatile", false)),
-                                        strides_as_variables(config.defaultGet<bool>("strides_as_variables", true)) {
+                                        strides_as_variables(config.defaultGet<bool>("strides_as_variables", true)),
+                                        strength_reduce(config.defaultGet<bool>("strength_reduce_index", false)),
+                                        inline_complex(config.defaultGet<bool>("compiler_complex_inline", false)),
+                                        magic_division(config.defaultGet<bool>("compiler_magic_division", false)),
+                                        predicated_scatter(config.defaultGet<bool>("compiler_predicated_scatter", false)) {
         for(const bh_base* base: tmps) {
             if (not symbols.isAlwaysArray(base))
                 _tmps.insert(base);
@@ -239,6 +448,50 @@ public:
         }
     }
 
+    // Insert 'view' as scalar replaced using the load 'load' from local memory (e.g. a stencil tile)
+    void insertLocalTile(const bh_view &view, const std::string &load) {
+        _scalar_replacements_r.insert(view);
+        _local_tiles[view] = load;
+    }
+    // Returns the name of the partial index of the outer axes whose strides are 'strides' (see
+    // write_partial_index_declaration()) or NULL when it isn't declared
+    const std::string *getPartialIdx(const std::vector<std::string> &strides) const {
+        auto it = _partial_idx.find(strides);
+        if (it != _partial_idx.end()) {
+            return &it->second;
+        } else if (parent != NULL) {
+            return parent->getPartialIdx(strides);
+        } else {
+            return NULL;
+        }
+    }
+    // Check if the partial index of 'strides' is declared in this scope (ignoring the parents)
+    bool isPartialIdxDeclaredLocally(const std::vector<std::string> &strides) const {
+        return util::exist(_partial_idx, strides);
+    }
+    // Insert the partial index of 'strides' and return its name
+    const std::string &insertPartialIdx(const std::vector<std::string> &strides) {
+        NameWriter name;
+        name << "ip" << strides.size() - 1 << "_" << _partial_idx.size();
+        return _partial_idx[strides] = name.str;
+    }
+    // Insert the partial index of 'strides' as an alias of the partial index 'name'
+    void insertPartialIdx(const std::vector<std::string> &strides, const std::string &name) {
+        _partial_idx[strides] = name;
+    }
+
+    // Returns the load of 'view' from local memory or NULL when it is read from 'view' itself
+    const std::string *getLocalTile(const bh_view &view) const {
+        auto it = _local_tiles.find(view);
+        if (it != _local_tiles.end()) {
+            return &it->second;
+        } else if (parent != NULL) {
+            return parent->getLocalTile(view);
+        } else {
+            return NULL;
+        }
+    }
+
     // Check if 'base' has been scalar replaced read-only or read/write
     bool isScalarReplaced_R(const bh_view &view) const {
         if (util::exist(_scalar_replacements_r, view)) {
@@ -346,9 +599,9 @@ public:
         }
     }
     std::string getName(const bh_view &view) const {
-        std::stringstream ss;
-        getName(view, ss);
-        return ss.str();
+        NameWriter ret;
+        getName(view, ret);
+        return ret.str;
     }
 
     // Write the variable declaration of 'base' using 'type_str' as the type string
@@ -377,9 +630,9 @@ public:
         out << "idx" << symbols.idxID(view);
     }
     std::string getIdxName(const bh_view &view) const {
-        std::stringstream ss;
-        getIdxName(view, ss);
-        return ss.str();
+        NameWriter ret;
+        getIdxName(view, ret);
+        return ret.str;
     }
 
     // Write the variable declaration of the index calculation of 'view' using 'type_str' as the type string
@@ -45,10 +45,15 @@ namespace jitk {
 // Forward declaration
 class Block;
 
-// We use a shared pointer of an const instruction. The idea is to never change an instruction inplace
-// instead, create a whole new instruction.
+// We use a shared pointer of an const instruction. The idea is to never change a shared instruction inplace
+// instead, create a whole new instruction. Only Block::setInstr() changes an instruction that no one else shares.
 typedef std::shared_ptr<const bh_instruction> InstrPtr;
 
+// Returns a pointer to a copy of 'instr', which draws its memory from a per-thread pool that recycles the memory
+// of freed instructions thus a flush seldom allocates. All instructions of the blocks must be created this way.
+InstrPtr make_instr(const bh_instruction &instr);
+InstrPtr make_instr(bh_instruction &&instr);
+
 // Representation of a for-loop, which contains a list of nested loops (_block_list)
 class LoopB {
 public:
@@ -66,6 +71,8 @@ public:
     std::set<bh_base *> _frees;
     // Is this loop and all its sub-blocks reshapable
     bool _reshapable = false;
+    // Tile size when this loop and its parent or its single sub-loop are cache blocked (0 means no tiling)
+    int64_t tile_size = 0;
 
     // Unique id of this block
     int _id;
@@ -184,7 +191,7 @@ public:
     // Note, the rank is only to make pretty printing easier
     Block(const bh_instruction &instr, int rank) {
         assert(_var.which() == 0);
-        InstrB _instr{std::make_shared<bh_instruction>(instr), rank};
+        InstrB _instr{make_instr(instr), rank};
         _var = std::move(_instr);
     }
 
@@ -198,11 +205,16 @@ public:
     const LoopB &getLoop() const {return boost::get<LoopB>(_var);}
 
     // Retrieve the instruction within the instruction block
-    const InstrPtr getInstr() const {return boost::get<InstrB>(_var).instr;}
-    InstrPtr getInstr() {return boost::get<InstrB>(_var).instr;}
+    const InstrPtr &getInstr() const {return boost::get<InstrB>(_var).instr;}
     void setInstr(const bh_instruction &instr) {
         assert(_var.which() == 0 or _var.which() == 2);
-        boost::get<InstrB>(_var).instr.reset(new bh_instruction(instr));
+        InstrPtr &ptr = boost::get<InstrB>(_var).instr;
+        if (ptr.use_count() == 1) {
+            // NB: make_instr() creates non-const instructions thus we can update an unshared one in place
+            *const_cast<bh_instruction *>(ptr.get()) = instr;
+        } else {
+            ptr = make_instr(instr);
+        }
     }
 
     // Return the rank of this block
@@ -291,6 +303,9 @@ std::pair<std::vector<const LoopB *>, uint64_t> util_find_threaded_blocks(const
 // 'avoid_rank0_sweep' will not allow fusion of sweeped and non-sweeped blocks at the root level
 bool mergeable(const Block &b1, const Block &b2, bool avoid_rank0_sweep);
 
+// Returns why the two blocks 'b1' and 'b2' (in that order) aren't mergeable or NULL when they are
+const char *unmergeable_reason(const Block &b1, const Block &b2, bool avoid_rank0_sweep);
+
 // Reshape and merges the two loop blocks 'l1' and 'l2' (in that order).
 // NB: the loop blocks must be mergeable!
 Block reshape_and_merge(const LoopB &l1, const LoopB &l2);
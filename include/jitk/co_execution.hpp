@@ -0,0 +1,83 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __BH_JITK_CO_EXECUTION_HPP
+#define __BH_JITK_CO_EXECUTION_HPP
+
+#include <map>
+#include <vector>
+#include <cstdint>
+
+#include <bh_config_parser.hpp>
+#include <jitk/block.hpp>
+
+namespace bohrium {
+namespace jitk {
+
+/* Co-execution splits the outermost loop of large data-parallel kernels between the device and the CPU.
+ * The device executes the first iterations while the CPU child executes the rest concurrently. The device
+ * share of each kernel starts at 'co_execution_device_share' and follows the measured throughput of the two.
+ * The share is a multiple of 1/'co_execution_steps', which bounds the number of distinct kernels to compile.
+ */
+class CoExecution {
+public:
+    // Kernels with fewer elements than this isn't split
+    const uint64_t min_elements;
+    // The possible shares are the multiples of 1/steps
+    const int steps;
+    // The initial share of the device in steps
+    const int initial;
+
+    explicit CoExecution(const ConfigParser &config);
+
+    // Returns true when the outermost loop of the kernel 'block' can be split, which requires that every
+    // instruction is an element-wise operation along the outermost loop, and that the arrays it writes are
+    // accessed through a single view whose rows doesn't overlap
+    bool splittable(const LoopB &block) const;
+
+    // Returns the number of outermost iterations of the kernel 'key' that the device should execute
+    int64_t split(const std::vector<int64_t> &key, int64_t size);
+
+    // Records that the CPU executed the iterations [split, size) of the kernel 'key' in 'cpu_seconds' and that
+    // the device finished its iterations 'wait_seconds' later
+    void update(const std::vector<int64_t> &key, int64_t split, int64_t size, double cpu_seconds,
+                double wait_seconds);
+
+private:
+    // The share of the device of each kernel in steps
+    std::map<std::vector<int64_t>, int> _shares;
+};
+
+// Returns a copy of the kernel 'block' that only executes the iterations [begin, end) of the outermost loop
+// NB: system instructions are kept as they are
+LoopB slice_outermost(const LoopB &block, int64_t begin, int64_t end);
+
+// Returns the computing instructions of the kernel 'block' with their views sliced to [begin, end) along
+// the outermost axis
+std::vector<bh_instruction> slice_instr(const LoopB &block, int64_t begin, int64_t end);
+
+// Returns the byte offset and size of the memory that 'view' covers
+// NB: the strides of 'view' must be non-negative
+std::pair<uint64_t, uint64_t> view_byte_range(const bh_view &view);
+
+} // jitk
+} // bohrium
+
+#endif
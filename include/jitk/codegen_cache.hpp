@@ -0,0 +1,71 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __BH_JITK_CODEGEN_CACHE_HPP
+#define __BH_JITK_CODEGEN_CACHE_HPP
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <boost/functional/hash.hpp>
+
+#include <jitk/kernel.hpp>
+#include <jitk/base_db.hpp>
+#include <jitk/statistics.hpp>
+
+
+namespace bohrium {
+namespace jitk {
+
+/* The code generation cache maps the structure of a kernel to its generated source code.
+ * It is the first level in front of the engines' kernel cache (which is keyed on the source code),
+ * thus kernels that hit the cache skip the code generation altogether.
+ */
+class CodegenCache {
+private:
+    typedef std::vector<int64_t> Key;
+    std::unordered_map<Key, std::string, boost::hash<Key> > _cache;
+public:
+    // Some statistics
+    jitk::Statistics &stat;
+
+    // The constructor takes the statistic object
+    CodegenCache(jitk::Statistics &stat) : stat(stat) {}
+
+    // Returns the structural fingerprint of 'kernel', which covers everything the code generation depends on.
+    // NB: the bases are represented by their symbol IDs thus new temporary arrays doesn't change the fingerprint
+    static Key fingerprint(const Kernel &kernel, const SymbolTable &symbols,
+                           const std::vector<const LoopB*> &threaded_blocks);
+
+    // Check the cache for the source code that matches 'fingerprint'
+    std::pair<std::string, bool> get(const Key &fingerprint);
+    // Insert 'source' as a hit when requesting 'fingerprint'
+    void insert(const Key &fingerprint, const std::string &source);
+    // Remove all entries, e.g. when the code generation options change
+    void clear() {
+        _cache.clear();
+    }
+};
+
+
+} // jit
+} // bohrium
+
+#endif
@@ -22,24 +22,34 @@ If not, see <http://www.gnu.org/licenses/>.
 #define __BH_JITK_CODEGEN_UTIL_H
 
 #include <map>
+#include <algorithm>
 #include <vector>
 #include <string>
 #include <sstream>
 #include <functional>
+#include <memory>
 #include <boost/filesystem/path.hpp>
 
 #include <bh_util.hpp>
 #include <bh_type.hpp>
 #include <bh_instruction.hpp>
+#include <bh_memory.h>
 #include <bh_component.hpp>
 #include <bh_extmethod.hpp>
 #include <bh_config_parser.hpp>
+#include <bh_trace.hpp>
 #include <jitk/block.hpp>
 #include <jitk/base_db.hpp>
 #include <jitk/kernel.hpp>
 #include <jitk/instruction.hpp>
 #include <jitk/fuser_cache.hpp>
+#include <jitk/codegen_cache.hpp>
+#include <jitk/replay_cache.hpp>
+#include <jitk/co_execution.hpp>
+#include <jitk/kernel_dispatch.hpp>
+#include <jitk/context_scheduler.hpp>
 #include <jitk/apply_fusion.hpp>
+#include <jitk/memory_plan.hpp>
 
 
 namespace bohrium {
@@ -49,9 +59,17 @@ namespace jitk {
 // Write 'num' of spaces to 'out'
 void spaces(std::stringstream &out, int num);
 
+// Write 'source' of the kernel 'hash' into 'dir' the first time its profile in 'stat' is recorded
+void util_record_source(Statistics &stat, size_t hash, const std::string &source,
+                        const boost::filesystem::path &dir, const std::string &file_ext);
+
 // Returns the filename of the given hash and file extension
 std::string hash_filename(size_t hash, std::string file_extension);
 
+// Returns the current and peak bytes, the allocations per size class, and the 'num_largest' largest live arrays
+// of each device of the memory tracker (see bh_memory_track_alloc()) that has allocated anything
+std::string util_memory_report(size_t num_largest = 10);
+
 // Write `src` to file in `dir` using `hash_filename()` to generate the filename
 boost::filesystem::path write_source2file(const std::string &src,
                                           const boost::filesystem::path &dir,
@@ -59,6 +77,17 @@ boost::filesystem::path write_source2file(const std::string &src,
                                           const std::string &file_ext,
                                           bool verbose);
 
+// Expand a leading '~' in 'path' to the home directory of the user
+boost::filesystem::path expand_user(const std::string &path);
+
+// Write the kernel trace 'sources' of the backend 'backend_name' to 'filename'
+void write_kernel_trace(const std::string &filename, const std::string &backend_name,
+                        const std::vector<std::string> &sources);
+
+// Read the kernel trace in 'filename' written by write_kernel_trace().
+// Returns no sources when the trace belongs to another backend than 'backend_name'
+std::vector<std::string> read_kernel_trace(const std::string &filename, const std::string &backend_name);
+
 // Calculate the work group sizes.
 // Return pair (global work size, local work size)
 std::pair<uint32_t, uint32_t> work_ranges(uint64_t work_group_size, int64_t block_size);
@@ -73,9 +102,19 @@ void write_kernel_function_arguments(const Kernel &kernel, const SymbolTable &sy
                                      const bool all_pointers);
 
 
+// Write the size of the loop 'block', which is either a literal or a kernel argument (see SymbolTable::loopSizes())
+void write_loop_size(const SymbolTable &symbols, const LoopB &block, std::stringstream &out);
+
+// Write the two tile loops, which goes outside the loops of the tiled nest 'block' (see tile_loops())
+void write_tile_loops(const SymbolTable &symbols, const LoopB &block, std::stringstream &out);
+
+// Write the range, e.g. "i0=ii0; i0 < (ii0+32 < 1000 ? ii0+32 : 1000)", of a loop within a tiled nest
+void write_tiled_loop_range(const SymbolTable &symbols, const LoopB &block, std::stringstream &out);
+
 // Writes a loop block, which corresponds to a parallel for-loop.
 // The two functions 'type_writer' and 'head_writer' should write the
 // backend specific data type names and for-loop headers respectively.
+// When 'simd_bytes' is non-zero, the contiguous innermost loops are written using explicit SIMD vectors of that width.
 void write_loop_block(const SymbolTable &symbols,
                       const Scope *parent_scope,
                       const LoopB &block,
@@ -90,7 +129,61 @@ void write_loop_block(const SymbolTable &symbols,
                                           bool loop_is_peeled,
                                           const std::vector<const LoopB *> &threaded_blocks,
                                           std::stringstream &out)> head_writer,
-                      std::stringstream &out);
+                      std::stringstream &out,
+                      int simd_bytes = 0);
+
+// Returns the number of elements, 'vector_width' of the config, that each work-item of the OpenCL kernel processes
+// when 'block' is the only threaded block and consists of basic elementwise instructions on contiguous arrays,
+// or zero when it doesn't. The kernel header must then define the first element 'bh_first' of the work-item,
+// 'BH_VECTOR_WIDTH', and the macros 'BH_VEC(type, width)' and 'bh_vstore', which write_loop_block() uses.
+int opencl_vector_width(const SymbolTable &symbols, const LoopB &block, const std::vector<const LoopB *> &threaded_blocks,
+                        const ConfigParser &config);
+
+// Returns true when write_loop_block() fully unrolls 'block', which must be an innermost loop of a literal size of
+// at most 'unroll_max_size' of the config that isn't tiled or one of the 'threaded_blocks'
+bool unrolled_loop(const SymbolTable &symbols, const LoopB &block, const std::vector<const LoopB *> &threaded_blocks,
+                   const ConfigParser &config);
+
+// Returns true when 'block' is the innermost loop of the generated code, i.e. when it has no sub-blocks or when all
+// of its sub-blocks are unrolled (see unrolled_loop())
+bool innermost_after_unrolling(const SymbolTable &symbols, const LoopB &block,
+                               const std::vector<const LoopB *> &threaded_blocks, const ConfigParser &config);
+
+// Removes the innermost of the 'threaded_blocks' when write_loop_block() can unroll it instead, which leaves the
+// threading to the enclosing blocks
+void unthread_unrolled_loop(std::vector<const LoopB *> &threaded_blocks, const ConfigParser &config);
+
+// The tile in local memory of a read-only base that several shifted views read in a 1D threaded kernel
+// e.g. the stencil `a[1:-1] + a[:-2] + a[2:]`. Entry 'j' of the tile of a work-group, which starts at
+// iteration 'g', is the element 'start + (g + j) * stride' and the view 'v' reads entry 'shifts[v]' + local ID.
+struct LocalTile {
+    const bh_base *base;
+    int64_t start;
+    int64_t stride;
+    // The number of entries beyond the work-group size, i.e. the largest shift
+    int64_t halo;
+    std::map<bh_view, int64_t> shifts;
+};
+
+// Returns the tiles of the read-only bases of 'kernel' that are read through several views shifted by at most
+// 'max_halo' elements along the threaded axis. Only kernels with one threaded block, which must be innermost, are
+// tiled and the tiles of work-groups of 'group_size' threads must fit in 'max_bytes' bytes.
+std::vector<LocalTile> find_local_tiles(const Kernel &kernel, const SymbolTable &symbols,
+                                        const std::vector<const LoopB*> &threaded_blocks,
+                                        uint64_t group_size, int64_t max_halo, uint64_t max_bytes);
+
+// Writes the declarations and the loads of 'tiles' followed by a barrier and inserts the tiled views into 'scope'.
+// NB: every thread of the work-group must execute the loads thus they go before the overflow check of the threads.
+// The strings are the backend specific keyword of local memory, the local thread ID, the work-group size, and
+// the barrier.
+void write_local_tiles(const SymbolTable &symbols, const std::vector<LocalTile> &tiles, const LoopB &threaded_block,
+                       uint64_t group_size, std::function<const char *(bh_type type)> type_writer,
+                       const char *local_prefix, const char *local_id, const char *local_size, const char *barrier,
+                       Scope &scope, std::stringstream &out);
+
+// Returns the wave of each block in 'block_list' where consecutive blocks of the same wave are independent
+// of each other, i.e. no path in the DAG of 'block_list' connects them, thus they can execute concurrently
+std::vector<size_t> find_concurrent_waves(const std::vector<Block> &block_list);
 
 // Sets the constructor flag of each instruction in 'instr_list'
 // 'remotely_allocated_bases' is a collection of array bases already remotely allocated
@@ -115,32 +208,119 @@ void util_set_constructor_flag(std::vector<bh_instruction *> &instr_list, const
     }
 }
 
+/* Fold the scaling and addition of the result of the extension methods that support an epilogue (see
+ * ExtmethodImpl::epilogue()) into the extension methods, e.g. 'T = A@B; U = T*alpha; R = U+D' becomes
+ * 'R = alpha*A@B + D' when the temporaries are freed in 'instr_list' and nothing else accesses them.
+ */
+void util_fold_extmethod_epilogues(std::vector<bh_instruction> &instr_list,
+                                   std::map<bh_opcode, extmethod::ExtmethodFace> &extmethods);
+
+// Removes and returns the instructions of 'instr_list' that must execute before the extension method 'ext', which
+// are the ones that conflict with 'ext' or with a later dependency through a base. The remaining instructions don't
+// depend on 'ext' thus they can be fused with the instructions after it.
+std::vector<bh_instruction> util_extmethod_dependencies(std::vector<bh_instruction> &instr_list,
+                                                        const bh_instruction &ext);
+
 // Handle the extension methods within the 'bhir'
 void util_handle_extmethod(component::ComponentImpl *self,
                            bh_ir *bhir,
                            std::map<bh_opcode, extmethod::ExtmethodFace> &extmethods);
 
+// Whether 'instr_list' has an instruction of 'extmethods' or of 'child_extmethods' (if not NULL)
+bool util_has_extmethod(const std::vector<bh_instruction> &instr_list,
+                        const std::map<bh_opcode, extmethod::ExtmethodFace> &extmethods,
+                        const std::set<bh_opcode> *child_extmethods = NULL);
+
+// Whether 'instr_list' only has system instructions, e.g. the frees and syncs of arrays that nothing computed yet
+bool util_is_system_only(const std::vector<bh_instruction> &instr_list);
+
+// Whether the kernels may relax the floating-point semantic for speed, e.g. reassociate and assume no NaN or infinity.
+// The 'fast_math' option relaxes every kernel, otherwise only the flushes between the "fast_math: on" and
+// "fast_math: off" messages of the bridge, e.g. of a `bohrium.FastMath()` context, are relaxed.
+bool util_fast_math(const ConfigParser &config);
+
+// Handles the "fast_math: on" and "fast_math: off" messages by setting the runtime option of util_fast_math() in
+// 'config' and returns whether 'msg' was one of them
+bool util_fast_math_message(ConfigParser &config, const std::string &msg);
+
+/* The placement of the extension methods that both an engine and its child implement, which executes an instruction
+ * where its compute time plus the time of moving its operands is the smallest. The device time uploads the operands
+ * that aren't on the device and the host time downloads the ones that are. The rates are the '*_gflops' and '*_gbps'
+ * options of the engine, where zero rates always execute on the engine's device.
+ */
+struct ExtmethodPlacement {
+    double device_flops, device_bytes, host_flops, host_bytes, transfer_bytes;
+
+    explicit ExtmethodPlacement(const ConfigParser &config);
+
+    // Whether the rates are known
+    bool enabled() const {
+        return device_flops > 0 and device_bytes > 0 and host_flops > 0 and host_bytes > 0 and transfer_bytes > 0;
+    }
+
+    // Whether to execute 'instr', whose work is 'cost', on the device of 'engine' rather than on the child
+    // 'T' must have a onDevice(bh_base*) method
+    template<typename T>
+    bool onDevice(const bh_instruction &instr, const extmethod::ExtmethodImpl::Cost &cost, const T *engine) const {
+        if (not enabled() or cost.flops < 0 or engine == NULL) {
+            return true;
+        }
+        std::set<bh_base *> bases;
+        for (const bh_view &view: instr.operand) {
+            if (not bh_is_constant(&view)) {
+                bases.insert(view.base);
+            }
+        }
+        double upload = 0, download = 0;
+        for (bh_base *base: bases) {
+            (engine->onDevice(base) ? download : upload) += bh_base_size(base);
+        }
+        const double device = cost.flops / device_flops + cost.bytes / device_bytes + upload / transfer_bytes;
+        const double host = cost.flops / host_flops + cost.bytes / host_bytes + download / transfer_bytes;
+        return device <= host;
+    }
+};
+
 // Handle the extension methods within the 'bhir'
 // This version takes a child component and possible an engine that must have a copyToHost() method
+// An instruction that both implement goes to the child when the extmethod doesn't support it or when 'placement'
+// (if not NULL) places it on the host, in which case 'T' must also have a onDevice() method
 template<typename T>
 void util_handle_extmethod(component::ComponentImpl *self,
                            bh_ir *bhir,
                            std::map<bh_opcode, extmethod::ExtmethodFace> &extmethods,
                            std::set<bh_opcode> &child_extmethods,
                            component::ComponentFace &child,
-                           T *acc_engine = NULL) {
+                           T *acc_engine = NULL,
+                           const ExtmethodPlacement *placement = NULL) {
 
+    if (not util_has_extmethod(bhir->instr_list, extmethods, &child_extmethods)) {
+        return; // Nothing to do thus we don't touch the instruction list
+    }
+    util_fold_extmethod_epilogues(bhir->instr_list, extmethods);
     std::vector<bh_instruction> instr_list;
+    instr_list.reserve(bhir->instr_list.size());
     for (bh_instruction &instr: bhir->instr_list) {
         auto ext = extmethods.find(instr.opcode);
         auto childext = child_extmethods.find(instr.opcode);
 
         if (ext != extmethods.end() or childext != child_extmethods.end()) {
-            // Execute the instructions up until now
+            // Execute the instructions up until now that the extension method depends on
             bh_ir b;
-            b.instr_list = instr_list;
-            self->execute(&b);
-            instr_list.clear();
+            b.instr_list = util_extmethod_dependencies(instr_list, instr);
+            if (not b.instr_list.empty()) {
+                self->execute(&b);
+            }
+
+            // The child cannot execute the epilogue that was folded into an instruction of the extmethod
+            if (ext != extmethods.end() and childext != child_extmethods.end() and
+                not (ext->second.getImpl()->epilogue() and instr.operand.size() > 3)) {
+                const extmethod::ExtmethodImpl *impl = ext->second.getImpl();
+                if (not impl->supports(instr) or
+                    (placement != NULL and not placement->onDevice(instr, impl->cost(instr), acc_engine))) {
+                    ext = extmethods.end();
+                }
+            }
 
             if (ext != extmethods.end()) {
                 // Execute the extension method
@@ -151,16 +331,15 @@ void util_handle_extmethod(component::ComponentImpl *self,
                 if (acc_engine != NULL) {
                     acc_engine->copyToHost(ext_bases);
                 }
-                std::vector<bh_instruction> child_instr_list;
-                child_instr_list.push_back(instr);
-                b.instr_list = child_instr_list;
+                b.instr_list.clear();
+                b.instr_list.push_back(std::move(instr));
                 child.execute(&b);
             }
         } else {
-            instr_list.push_back(instr);
+            instr_list.push_back(std::move(instr));
         }
     }
-    bhir->instr_list = instr_list;
+    bhir->instr_list = std::move(instr_list);
 }
 
 
@@ -170,141 +349,469 @@ void util_handle_extmethod(component::ComponentImpl *self,
  *     - void write_kernel(...)
  * 'EngineType' most be a engine implementation that exposes:
  *     - set_constructor_flag(...)
+ *     - void compileAll(...)
+ *     - void beginConcurrent() and void endConcurrent()
+ *     - int64_t timeBlockIterations(), void beginTimeBlock(), and void endTimeBlock(), which the temporal blocking uses
+ *     - void endFlush(), which is called after the last kernel of 'bhir'
  *     - void copyToHost(...)
  *     - void copyToDevice(...)
  *     - void delBuffer(...)
+ *     - void hostWrites(...), void waitKernels(), and void copyRangeToDevice(...), which the co-execution uses
+ *     - void prefetchToDevice(...), which starts the uploads of the arrays of the next kernels
+ *     - bool onDevice(bh_base*), which the dispatching uses
  * 'child' can only be NULL when find_threaded_blocks() always returns one or more blocks
+ * 'coexec' splits the large kernels between the device and 'child' (NULL disables co-execution)
+ * 'dispatch' executes the kernels that the CPU executes faster on 'child' (NULL disables dispatching)
+ * 'rcache' replays the block list and sources of the traces that the node VEM detects
+ * 'context' takes turns with the other contexts of the device at each kernel (NULL disables the scheduling)
  */
 template<typename SelfType, typename EngineType>
 void handle_execution(SelfType &self, bh_ir *bhir, EngineType &engine, const ConfigParser &config, Statistics &stat,
-                      FuseCache &fcache, component::ComponentFace *child) {
+                      FuseCache &fcache, CodegenCache &ccache, ReplayCache &rcache, component::ComponentFace *child,
+                      CoExecution *coexec = NULL, KernelDispatch *dispatch = NULL,
+                      ContextScheduler::Context *context = NULL) {
     using namespace std;
 
     auto texecution = chrono::steady_clock::now();
 
     const bool verbose = config.defaultGet<bool>("verbose", false);
     const bool strides_as_variables = config.defaultGet<bool>("strides_as_variables", true);
-
-    // Some statistics
-    stat.record(bhir->instr_list);
-
-    // Let's start by cleanup the instructions from the 'bhir'
-    vector<bh_instruction*> instr_list;
-    {
+    const bool shape_as_var = config.defaultGet<bool>("shape_as_var", false);
+    const bool codegen_cache = config.defaultGet<bool>("codegen_cache", true);
+    const size_t prefetch_blocks = config.defaultGet<size_t>("prefetch_blocks", 0);
+
+    // Code generation of 'kernel' where an empty 'offset_strides' deactivate "strides as variables"
+    // NB: the codegen cache is checked first thus only kernels with a new structure are generated
+    auto generate_source = [&](Kernel &kernel, const SymbolTable &symbols,
+                               const vector<const LoopB*> &threaded_blocks) -> string {
+        vector<int64_t> fingerprint;
+        if (codegen_cache) {
+            fingerprint = CodegenCache::fingerprint(kernel, symbols, threaded_blocks);
+            // The relaxed and strict floating-point variants of a kernel are different sources
+            fingerprint.push_back(util_fast_math(config) ? 1 : 0);
+            pair<string, bool> cached = ccache.get(fingerprint);
+            if (cached.second) {
+                return cached.first;
+            }
+        }
+        trace::Scope codegen_scope("jitk", "codegen");
+        auto tcodegen = chrono::steady_clock::now();
+        vector<const bh_view*> offset_strides;
+        if (strides_as_variables) {
+            offset_strides = kernel.getOffsetAndStrides();
+        }
+        stringstream ss;
+        self.write_kernel(kernel, symbols, config, threaded_blocks, offset_strides, ss);
+        const string source = ss.str();
+        stat.time_codegen += chrono::steady_clock::now() - tcodegen;
+        if (codegen_cache) {
+            ccache.insert(fingerprint, source);
+        }
+        return source;
+    };
+
+    // Executes the first iterations of the outermost loop of 'kernel' on the device while 'child' executes
+    // the rest, and returns false when 'kernel' isn't split (see CoExecution)
+    auto co_execute = [&](const Kernel &kernel, const SymbolTable &symbols,
+                          const vector<const LoopB*> &threaded_blocks) -> bool {
+        if (coexec == NULL or child == NULL or not coexec->splittable(kernel.block)) {
+            return false;
+        }
+        const vector<int64_t> key = CodegenCache::fingerprint(kernel, symbols, threaded_blocks);
+        const int64_t size = kernel.block.size;
+        const int64_t split = coexec->split(key, size);
+        const LoopB device_block = slice_outermost(kernel.block, 0, split);
+        Kernel device_kernel(device_block);
+        const vector<const LoopB*> device_threaded = self.find_threaded_blocks(device_kernel);
+        if (device_threaded.empty()) {
+            return false;
+        }
+        if (verbose) {
+            cout << "Co-executing iterations [0, " << split << ") on the device and [" << split << ", " << size
+                 << ") on the CPU\n";
+        }
+        auto tcoexec = chrono::steady_clock::now();
+
+        // The CPU reads the host data and the device needs a buffer of every non-temporary array
+        engine.copyToHost(kernel.getNonTemps());
+        engine.copyToDevice(kernel.getNonTemps());
+
+        // Let's start the device share
+        const SymbolTable device_symbols(device_kernel.getAllInstr(),
+                                         config.defaultGet("index_as_var", true),
+                                         config.defaultGet("const_as_var", true),
+                                         shape_as_var ? device_kernel.getLoopSizes() : vector<int64_t>());
+        vector<const bh_view*> offset_strides;
+        if (strides_as_variables) {
+            offset_strides = device_kernel.getOffsetAndStrides();
+        }
+        const string source = generate_source(device_kernel, device_symbols, device_threaded);
+        vector<const bh_instruction*> constants;
+        for (const InstrPtr &instr: device_symbols.constIDs()) {
+            constants.push_back(&(*instr));
+        }
+        engine.execute(source, device_kernel, device_threaded, offset_strides, device_symbols.loopSizes(),
+                       constants);
+        engine.endFlush();
+
+        // The CPU share writes the rows of the non-temporary outputs, which must be merged into the device buffers
+        vector<bh_instruction> cpu_instr_list = slice_instr(kernel.block, split, size);
+        const set<bh_base*> temps = kernel.getAllTemps();
+        map<bh_base*, pair<uint64_t, uint64_t> > cpu_rows;
+        for (const bh_instruction &instr: cpu_instr_list) {
+            bh_base *base = instr.operand[0].base;
+            if (temps.find(base) == temps.end() and kernel.getFrees().find(base) == kernel.getFrees().end()) {
+                cpu_rows[base] = view_byte_range(instr.operand[0]);
+            }
+        }
+        vector<bh_base*> cpu_outputs;
+        for (const auto &rows: cpu_rows) {
+            cpu_outputs.push_back(rows.first);
+        }
+        engine.hostWrites(cpu_outputs);
+        auto tcpu = chrono::steady_clock::now();
+        bh_ir tmp_bhir(cpu_instr_list.size(), &cpu_instr_list[0]);
+        child->execute(&tmp_bhir);
+        auto twait = chrono::steady_clock::now();
+        engine.waitKernels();
+        auto tdone = chrono::steady_clock::now();
+        for (const auto &rows: cpu_rows) {
+            engine.copyRangeToDevice(rows.first, rows.second.first, rows.second.second);
+        }
+        coexec->update(key, split, size, chrono::duration<double>(twait - tcpu).count(),
+                       chrono::duration<double>(tdone - twait).count());
+        stat.time_offload += chrono::steady_clock::now() - tcoexec;
+        return true;
+    };
+
+    // Executes the instructions of 'segment' 'repeat' times where the instructions are only fused once
+    // NB: a BH_REPEAT body (see split_repeats()) is one segment thus its kernels are compiled once
+    // When executing independent kernels concurrently, the engine executes the kernels of a wave between
+    // beginConcurrent() and endConcurrent() thus the syncs and frees of the wave must wait for endConcurrent()
+    const bool concurrent = config.defaultGet<bool>("concurrent_kernels", false) and child == NULL;
+    // The trace that 'bhir' replays (see ReplayCache)
+    int64_t replay_trace = bhir->replay_trace;
+    // The iterations of a BH_REPEAT body are executed in time blocks of 'timeBlockIterations()' iterations, which the
+    // engine might tile together (see EngineOpenMP::flushTimeBlock()), thus the frees must wait for endTimeBlock()
+    const int64_t time_block = child == NULL and not concurrent ? engine.timeBlockIterations() : 0;
+    auto execute_segment = [&](vector<bh_instruction> &segment, int64_t repeat) {
+        vector<bh_instruction*> instr_list;
         set<bh_base*> syncs;
         set<bh_base*> frees;
-        instr_list = remove_non_computed_system_instr(bhir->instr_list, syncs, frees);
+        vector<Block> block_list;
+        vector<string> sources;
+        vector<size_t> waves;
+        bool replayed = false;
+        bool in_time_block = false;
+        set<bh_base*> time_block_frees;
+        unique_ptr<MemoryPlan> memory_plan;
+        for (int64_t iteration = 0; iteration < repeat; ++iteration) {
+            // Some statistics
+            stat.record(segment);
+
+            // Let's start by cleanup the instructions from the 'segment'
+            {
+                syncs.clear();
+                frees.clear();
+                instr_list = remove_non_computed_system_instr(segment, syncs, frees);
+
+                // Let's copy sync'ed arrays back to the host
+                engine.copyToHost(syncs);
+
+                // Let's free device buffers and array memory
+                for(bh_base *base: frees) {
+                    engine.delBuffer(base);
+                    bh_data_free(base);
+                }
+            }
 
-        // Let's copy sync'ed arrays back to the host
-        engine.copyToHost(syncs);
+            if (iteration == 0) {
+                // Set the constructor flag
+                if (config.defaultGet<bool>("array_contraction", true)) {
+                    engine.set_constructor_flag(instr_list);
+                } else {
+                    for (bh_instruction *instr: instr_list) {
+                        instr->constructor = false;
+                    }
+                }
 
-        // Let's free device buffers and array memory
-        for(bh_base *base: frees) {
-            engine.delBuffer(base);
-            bh_data_free(base);
-        }
-    }
+                // A replay of a recorded trace gets the block list and the sources of the trace
+                // NB: the sources are only reused when they doesn't hard-code the constant values
+                replayed = rcache.get(replay_trace, instr_list, block_list, sources);
+                if (replayed and not config.defaultGet("const_as_var", true)) {
+                    sources.assign(block_list.size(), string());
+                }
+            }
 
-    // Set the constructor flag
-    if (config.defaultGet<bool>("array_contraction", true)) {
-        engine.set_constructor_flag(instr_list);
-    } else {
-        for (bh_instruction *instr: instr_list) {
-            instr->constructor = false;
-        }
-    }
+            if (iteration == 0 and not replayed) {
+                // Let's get the block list
+                // NB: 'avoid_rank0_sweep' is set to true when we have a child to offload to or when the reductions
+                //     must be reproducible, which keeps the parallel loops out of the serial reductions.
+                block_list = get_block_list(instr_list, config, fcache, stat,
+                                            child != NULL or config.defaultGet<bool>("deterministic_reductions", false));
+
+                // When batch compiling, we generate the source of all kernels before executing any of them
+                // thus the engine can compile the kernel misses in parallel
+                sources.assign(block_list.size(), string());
+                if (config.defaultGet<bool>("batch_compile", false)) {
+                    vector<string> batch;
+                    for (size_t i = 0; i < block_list.size(); ++i) {
+                        Kernel kernel(block_list[i].getLoop());
+                        const vector<const LoopB*> threaded_blocks = self.find_threaded_blocks(kernel);
+                        if (kernel.block.isSystemOnly() or threaded_blocks.size() == 0) {
+                            continue;
+                        }
+                        const SymbolTable symbols(kernel.getAllInstr(),
+                                                  config.defaultGet("index_as_var", true),
+                                                  config.defaultGet("const_as_var", true),
+                                                  shape_as_var ? kernel.getLoopSizes() : vector<int64_t>());
+                        sources[i] = generate_source(kernel, symbols, threaded_blocks);
+                        batch.push_back(sources[i]);
+                    }
+                    engine.compileAll(batch);
+                }
+            }
 
-    // Let's get the block list
-    // NB: 'avoid_rank0_sweep' is set to true when we have a child to offload to.
-    const vector<Block> block_list = get_block_list(instr_list, config, fcache, stat, child != NULL);
+            if (iteration == 0 and concurrent) {
+                waves = find_concurrent_waves(block_list);
+            }
 
-    for(const Block &block: block_list) {
-        assert(not block.isInstr());
+            // The memory plan shares host buffers between the arrays of the flush whose lifetimes are disjoint.
+            // NB: the offloaded kernels, the waves, and the time blocks free arrays outside the order of the kernels.
+            if (iteration == 0 and child == NULL and not concurrent and time_block <= 1 and
+                config.defaultGet<bool>("memory_plan", false)) {
+                memory_plan.reset(new MemoryPlan(block_list));
+                stat.num_planned_arrays += memory_plan->numArrays();
+                stat.planned_array_bytes += memory_plan->arrayBytes();
+                stat.planned_buffer_bytes += memory_plan->bufferBytes();
+            }
 
-        //Let's create a kernel
-        Kernel kernel = create_kernel_object(block, verbose, stat);
+            // A time block never includes a sync since the sync'ed arrays must be up to date at each iteration
+            if (time_block > 1 and not in_time_block and syncs.empty() and iteration + 1 < repeat) {
+                engine.beginTimeBlock();
+                in_time_block = true;
+            }
 
-        const SymbolTable symbols(kernel.getAllInstr(),
-                                  config.defaultGet("index_as_var", true),
-                                  config.defaultGet("const_as_var", true));
+            bool in_wave = false;
+            vector<bh_base*> wave_syncs, wave_frees;
+            auto end_wave = [&]() {
+                if (in_wave) {
+                    {
+                        // The wave takes one turn of the device scheduling
+                        ContextScheduler::Slot slot(context);
+                        engine.endConcurrent();
+                    }
+                    engine.copyToHost(wave_syncs);
+                    for (bh_base *base: wave_frees) {
+                        engine.delBuffer(base);
+                        bh_data_free(base);
+                    }
+                    wave_syncs.clear();
+                    wave_frees.clear();
+                    in_wave = false;
+                }
+            };
 
-        // We can skip a lot of steps if the kernel does no computation
-        const bool kernel_is_computing = not kernel.block.isSystemOnly();
+            for (size_t block_idx = 0; block_idx < block_list.size(); ++block_idx) {
+                const Block &block = block_list[block_idx];
+                assert(not block.isInstr());
 
-        // Find the parallel blocks
-        const vector<const LoopB*> threaded_blocks = self.find_threaded_blocks(kernel);
+                //Let's create a kernel
+                Kernel kernel = create_kernel_object(block, verbose, stat);
+                if (memory_plan) {
+                    memory_plan->assign(block_idx);
+                }
 
-        // We might have to offload the execution to the CPU
-        if (threaded_blocks.size() == 0 and kernel_is_computing) {
-            if (verbose)
-                cout << "Offloading to CPU\n";
+                const SymbolTable symbols(kernel.getAllInstr(),
+                                          config.defaultGet("index_as_var", true),
+                                          config.defaultGet("const_as_var", true),
+                                          shape_as_var ? kernel.getLoopSizes() : vector<int64_t>());
 
-            if (child == NULL) {
-                throw runtime_error("handle_execution(): threaded_blocks cannot be empty when child == NULL!");
-            }
+                // We can skip a lot of steps if the kernel does no computation
+                const bool kernel_is_computing = not kernel.block.isSystemOnly();
 
-            auto toffload = chrono::steady_clock::now();
+                // Find the parallel blocks
+                const vector<const LoopB*> threaded_blocks = self.find_threaded_blocks(kernel);
 
-            // Let's copy all non-temporary to the host
-            engine.copyToHost(kernel.getNonTemps());
+                // A wave ends at the first kernel that depends on it or doesn't compute anything
+                if (concurrent) {
+                    const bool joins_wave = kernel_is_computing and threaded_blocks.size() > 0;
+                    if (not joins_wave or (in_wave and waves[block_idx] != waves[block_idx - 1])) {
+                        end_wave();
+                    }
+                    if (joins_wave and not in_wave) {
+                        engine.beginConcurrent();
+                        in_wave = true;
+                    }
+                }
 
-            // Let's free device buffers
-            for (bh_base *base: kernel.getFrees()) {
-                engine.delBuffer(base);
-            }
+                // The dispatching might move the kernel to the CPU, which the cost model estimates faster
+                const bool dispatched = dispatch != NULL and child != NULL and kernel_is_computing and
+                                        threaded_blocks.size() > 0 and dispatch->onHost(kernel, engine);
 
-            // Let's send the kernel instructions to our child
-            vector<bh_instruction> child_instr_list;
-            for (const InstrPtr instr: kernel.block.getAllInstr()) {
-                child_instr_list.push_back(*instr);
-            }
-            bh_ir tmp_bhir(child_instr_list.size(), &child_instr_list[0]);
-            child->execute(&tmp_bhir);
-            stat.time_offload += chrono::steady_clock::now() - toffload;
-            continue;
-        }
+                // We might have to offload the execution to the CPU
+                if ((threaded_blocks.size() == 0 and kernel_is_computing) or dispatched) {
+                    if (verbose)
+                        cout << (dispatched ? "Dispatching to CPU\n" : "Offloading to CPU\n");
 
-        // Let's execute the kernel
-        if (kernel_is_computing) {
+                    if (child == NULL) {
+                        throw runtime_error("handle_execution(): threaded_blocks cannot be empty when child == NULL!");
+                    }
 
-            // We need a memory buffer on the device for each non-temporary array in the kernel
-            engine.copyToDevice(kernel.getNonTemps());
+                    auto toffload = chrono::steady_clock::now();
 
-            // Get the offset and strides (an empty 'offset_strides' deactivate "strides as variables")
-            vector<const bh_view*> offset_strides;
-            if (strides_as_variables) {
-                offset_strides = kernel.getOffsetAndStrides();
-            }
+                    // Let's copy all non-temporary to the host
+                    engine.copyToHost(kernel.getNonTemps());
 
-            // Code generation
-            stringstream ss;
-            self.write_kernel(kernel, symbols, config, threaded_blocks, offset_strides, ss);
+                    // Let's free device buffers
+                    for (bh_base *base: kernel.getFrees()) {
+                        engine.delBuffer(base);
+                    }
 
-            // Create the constant vector
-            vector<const bh_instruction*> constants;
-            constants.reserve(symbols.constIDs().size());
-            for (const InstrPtr &instr: symbols.constIDs()) {
-                constants.push_back(&(*instr));
-            }
+                    // Let's send the kernel instructions to our child
+                    bh_ir tmp_bhir;
+                    const vector<InstrPtr> kernel_instrs = kernel.block.getAllInstr();
+                    tmp_bhir.instr_list.reserve(kernel_instrs.size());
+                    for (const InstrPtr &instr: kernel_instrs) {
+                        tmp_bhir.instr_list.push_back(*instr);
+                    }
+                    auto tchild = chrono::steady_clock::now();
+                    child->execute(&tmp_bhir);
+                    if (dispatch != NULL) {
+                        const chrono::duration<double> elapsed = chrono::steady_clock::now() - tchild;
+                        dispatch->recordHost(KernelDispatch::traffic(kernel), elapsed.count());
+                    }
+                    stat.time_offload += chrono::steady_clock::now() - toffload;
+                    continue;
+                }
 
-            // Let's execute the OpenCL kernel
-            engine.execute(ss.str(), kernel, threaded_blocks, offset_strides, constants);
-        }
+                // Let's execute the kernel unless it is split between the device and the CPU
+                if (kernel_is_computing and not co_execute(kernel, symbols, threaded_blocks)) {
 
-        // Let's copy sync'ed arrays back to the host
-        engine.copyToHost(kernel.getSyncs());
+                    // We need a memory buffer on the device for each non-temporary array in the kernel
+                    engine.copyToDevice(kernel.getNonTemps());
 
-        // Let's free device buffers
-        const auto &kernel_frees = kernel.getFrees();
-        for(bh_base *base: kernel.getFrees()) {
-            engine.delBuffer(base);
+                    // Get the offset and strides (an empty 'offset_strides' deactivate "strides as variables")
+                    vector<const bh_view*> offset_strides;
+                    if (strides_as_variables) {
+                        offset_strides = kernel.getOffsetAndStrides();
+                    }
+
+                    // Code generation (unless it was done by the batch compilation)
+                    if (sources[block_idx].empty()) {
+                        sources[block_idx] = generate_source(kernel, symbols, threaded_blocks);
+                    }
+
+                    // Create the constant vector
+                    vector<const bh_instruction*> constants;
+                    constants.reserve(symbols.constIDs().size());
+                    for (const InstrPtr &instr: symbols.constIDs()) {
+                        constants.push_back(&(*instr));
+                    }
+
+                    // The dispatching measures some of the kernels, which waits for the kernels before it
+                    const bool measured = dispatch != NULL and not in_wave and dispatch->sample(sources[block_idx]);
+                    if (measured) {
+                        engine.waitKernels();
+                    }
+                    auto tdevice = chrono::steady_clock::now();
+
+                    // Let's execute the OpenCL kernel
+                    // NB: when other contexts share the device, the kernel finishes before they get the device
+                    {
+                        ContextScheduler::Slot slot(in_wave ? NULL : context);
+                        engine.execute(sources[block_idx], kernel, threaded_blocks, offset_strides,
+                                       symbols.loopSizes(), constants);
+                        if (slot.shared()) {
+                            engine.waitKernels();
+                        }
+                    }
+
+                    if (measured) {
+                        engine.waitKernels();
+                        const chrono::duration<double> elapsed = chrono::steady_clock::now() - tdevice;
+                        dispatch->recordDevice(KernelDispatch::traffic(kernel), elapsed.count());
+                    }
+
+                    // Let's upload the host data of the next kernels while this kernel executes
+                    // NB: an upload is never stale since only the offloaded kernels write the host data in a flush,
+                    //     and they copy their arrays to the host, which drops the device copies
+                    if (prefetch_blocks > 0) {
+                        vector<bh_base*> ahead;
+                        set<const bh_base*> seen;
+                        const size_t end = std::min(block_list.size(), block_idx + 1 + prefetch_blocks);
+                        for (size_t i = block_idx + 1; i < end; ++i) {
+                            for (const bh_base *base: block_list[i].getAllBases()) {
+                                if (base->data != nullptr and seen.insert(base).second) {
+                                    ahead.push_back(const_cast<bh_base*>(base));
+                                }
+                            }
+                        }
+                        engine.prefetchToDevice(ahead);
+                    }
+                }
+
+                if (in_wave) {
+                    wave_syncs.insert(wave_syncs.end(), kernel.getSyncs().begin(), kernel.getSyncs().end());
+                    wave_frees.insert(wave_frees.end(), kernel.getFrees().begin(), kernel.getFrees().end());
+                    continue;
+                }
+                if (in_time_block) {
+                    engine.copyToHost(kernel.getSyncs());
+                    time_block_frees.insert(kernel.getFrees().begin(), kernel.getFrees().end());
+                    continue;
+                }
+
+                // Let's copy sync'ed arrays back to the host
+                engine.copyToHost(kernel.getSyncs());
+
+                // Let's free device buffers
+                const auto &kernel_frees = kernel.getFrees();
+                for(bh_base *base: kernel.getFrees()) {
+                    engine.delBuffer(base);
+                }
+
+                // Finally, let's cleanup
+                if (memory_plan) {
+                    memory_plan->release(kernel_frees);
+                }
+                for(bh_base *base: kernel_frees) {
+                    bh_data_free(base);
+                }
+            }
+            end_wave();
+
+            if (in_time_block and ((iteration + 1) % time_block == 0 or iteration + 1 == repeat)) {
+                engine.endTimeBlock();
+                in_time_block = false;
+                for (bh_base *base: time_block_frees) {
+                    engine.delBuffer(base);
+                    bh_data_free(base);
+                }
+                time_block_frees.clear();
+            }
         }
 
-        // Finally, let's cleanup
-        for(bh_base *base: kernel_frees) {
-            bh_data_free(base);
+        // The first execution of a trace records the trace for its replays
+        if (not replayed) {
+            rcache.insert(replay_trace, instr_list, block_list, sources);
         }
+    };
+
+    if (any_of(bhir->instr_list.begin(), bhir->instr_list.end(),
+               [](const bh_instruction &instr) { return instr.opcode == BH_REPEAT; })) {
+        replay_trace = -1;
+        for (auto &segment: split_repeats(bhir->instr_list)) {
+            execute_segment(segment.first, segment.second);
+        }
+    } else {
+        execute_segment(bhir->instr_list, 1);
     }
+    engine.endFlush();
+    stat.max_hugepage_bytes = std::max<uint64_t>(stat.max_hugepage_bytes, bh_memory_hugepage_bytes());
+    uint64_t host_bytes;
+    bh_memory_usage(BH_MEMORY_HOST, &host_bytes, &stat.max_host_memory_usage);
+    bh_memory_pool_stats(&stat.memory_pool_lookups, &stat.memory_pool_hits);
     stat.time_total_execution += chrono::steady_clock::now() - texecution;
 }
 
@@ -0,0 +1,115 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __BH_JITK_CONTEXT_SCHEDULER_HPP
+#define __BH_JITK_CONTEXT_SCHEDULER_HPP
+
+#include <list>
+#include <mutex>
+#include <chrono>
+#include <string>
+#include <cstdint>
+#include <condition_variable>
+
+#include <bh_config_parser.hpp>
+
+namespace bohrium {
+namespace jitk {
+
+/* The context scheduler shares a device between the Bohrium contexts of a process, e.g. the sessions of the
+ * proxy server or several bhxx runtimes, which would otherwise oversubscribe the threads and queues.
+ * A context holds 'quota' units of the device's capacity while it executes a kernel, thus the contexts take
+ * turns at kernel boundaries: the waiting context with the highest 'priority' goes first and the contexts
+ * of the same priority share the device in proportion to their 'share'.
+ */
+class ContextScheduler {
+public:
+    // A context of the device, which joins the scheduler of the device until it is destroyed
+    class Context {
+    public:
+        // Reads the priority, the share, and the 'quota_option' of 'config'
+        Context(const std::string &device, uint64_t capacity, const ConfigParser &config,
+                const std::string &quota_option);
+        ~Context();
+
+        // Re-reads the options of 'config' (see the constructor)
+        void reconfigure(const ConfigParser &config);
+
+        // Returns the number of capacity units of each kernel
+        uint64_t quota() const { return _quota; }
+
+        // Returns true when other contexts use the device
+        bool shared() const;
+
+    private:
+        friend class ContextScheduler;
+        ContextScheduler &_scheduler;
+        const std::string _quota_option;
+        int64_t _priority = 0;
+        double _share = 1;
+        uint64_t _quota = 1;
+        // The used capacity-seconds divided by the share
+        double _usage = 0;
+        // The order of arrival of the waiting context
+        uint64_t _arrival = 0;
+        bool _waiting = false;
+        // The units of the running kernel (zero when the context waits or is idle)
+        uint64_t _held = 0;
+    };
+
+    // The kernel slot of a context, which is held from construction to destruction
+    // NB: a NULL context makes the slot a no-op
+    class Slot {
+    public:
+        explicit Slot(Context *context);
+        ~Slot();
+
+        // Returns true when other contexts use the device thus the kernel should finish before the slot ends
+        bool shared() const { return _context != NULL and _context->shared(); }
+
+    private:
+        Context *_context;
+        std::chrono::steady_clock::time_point _begin;
+    };
+
+    // Returns the scheduler of 'device', whose capacity is the 'capacity' of the first caller
+    static ContextScheduler &get(const std::string &device, uint64_t capacity);
+
+private:
+    explicit ContextScheduler(uint64_t capacity) : capacity(capacity) {}
+
+    // Grants the slots that the waiting contexts are next in line for (the caller holds '_mutex')
+    void grant();
+
+    // The capacity units of the device
+    const uint64_t capacity;
+    // The units of the running contexts
+    uint64_t _in_use = 0;
+    // The number of waits
+    uint64_t _arrivals = 0;
+    std::list<Context *> _contexts;
+    mutable std::mutex _mutex;
+    std::condition_variable _granted;
+};
+
+} // jitk
+} // bohrium
+
+#endif
@@ -0,0 +1,67 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __BH_JITK_COST_MODEL_HPP
+#define __BH_JITK_COST_MODEL_HPP
+
+#include <cstdint>
+
+#include <bh_config_parser.hpp>
+#include <jitk/block.hpp>
+
+namespace bohrium {
+namespace jitk {
+
+/* The cost model predicts the runtime of a block as the bytes it moves between memory and the cores.
+ * On top of the bytes of the non-temporary arrays (like graph::block_cost()), it charges:
+ *   - the re-reads of arrays shared by sibling sub-blocks when the data of one iteration exceeds the cache
+ *   - the spills of innermost loops that have more live arrays than vector registers
+ *   - the stalls of innermost loops that have more streams than the hardware prefetchers track
+ */
+class CostModel {
+public:
+    // Size of the cache in bytes that sibling sub-blocks can reuse data through (e.g. the L2 cache)
+    uint64_t cache_bytes;
+    // Number of concurrent memory streams the hardware handles well
+    uint64_t max_streams;
+    // Number of vector registers and the width in bytes of each one
+    uint64_t registers;
+    uint64_t vector_bytes;
+
+    // The constructor reads the machine parameters from the 'cost_model_*' options of 'config'
+    explicit CostModel(const ConfigParser &config);
+
+    // Returns the predicted cost of executing 'block' as a kernel
+    double cost(const Block &block) const;
+
+    // Returns true when merging 'b1' and 'b2' into 'merged' doesn't raise the predicted cost
+    bool accept(const Block &b1, const Block &b2, const Block &merged) const {
+        return cost(merged) <= cost(b1) + cost(b2);
+    }
+
+private:
+    // Returns the extra traffic of 'loop' and its sub-blocks
+    double extra_traffic(const LoopB &loop) const;
+};
+
+} // jitk
+} // bohrium
+
+#endif
@@ -0,0 +1,133 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __BH_JITK_DEVICE_POOL_HPP
+#define __BH_JITK_DEVICE_POOL_HPP
+
+#include <map>
+#include <vector>
+#include <cstdint>
+#include <iterator>
+#include <functional>
+
+#include <jitk/statistics.hpp>
+
+namespace bohrium {
+namespace jitk {
+
+/* The device pool caches the device buffers of freed arrays thus new arrays of the same size class reuse
+ * them instead of allocating device memory. 'Buffer' is the engine's buffer type, which 'release' frees.
+ * The engines must allocate 'sizeClass(bytes)' bytes for the buffers they put() in the pool.
+ */
+template <typename Buffer>
+class DevicePool {
+private:
+    // The cached buffers of each size class
+    std::map<uint64_t, std::vector<Buffer> > _free;
+    // The total size of the cached buffers
+    uint64_t _cached_bytes = 0;
+    // Maximum total size of the cached buffers (zero disables the pool)
+    const uint64_t max_bytes;
+    // Frees a buffer on the device
+    const std::function<void(Buffer &)> release;
+    // Some statistics
+    Statistics &stat;
+
+    // Release the buffers of the largest size classes until the pool holds at most 'bytes' bytes
+    void trimTo(uint64_t bytes) {
+        while (_cached_bytes > bytes) {
+            auto largest = std::prev(_free.end());
+            release(largest->second.back());
+            largest->second.pop_back();
+            _cached_bytes -= largest->first;
+            if (largest->second.empty()) {
+                _free.erase(largest);
+            }
+        }
+    }
+
+public:
+    DevicePool(uint64_t max_bytes, std::function<void(Buffer &)> release, Statistics &stat) :
+            max_bytes(max_bytes), release(release), stat(stat) {}
+
+    ~DevicePool() {
+        clear();
+    }
+
+    // Returns the size class of 'bytes': powers of two up to 1MB and whole megabytes beyond,
+    // which wastes at most half of the small buffers and 1MB of the large ones
+    static uint64_t sizeClass(uint64_t bytes) {
+        const uint64_t mb = 1024 * 1024;
+        if (bytes > mb) {
+            return (bytes + mb - 1) / mb * mb;
+        }
+        uint64_t ret = 256;
+        while (ret < bytes) {
+            ret *= 2;
+        }
+        return ret;
+    }
+
+    // Moves a cached buffer of 'size_class' into 'out' and returns true, or returns false when there is none
+    bool get(uint64_t size_class, Buffer &out) {
+        if (max_bytes == 0) {
+            return false;
+        }
+        ++stat.device_pool_lookups;
+        auto it = _free.find(size_class);
+        if (it == _free.end()) {
+            return false;
+        }
+        out = std::move(it->second.back());
+        it->second.pop_back();
+        _cached_bytes -= size_class;
+        if (it->second.empty()) {
+            _free.erase(it);
+        }
+        ++stat.device_pool_hits;
+        return true;
+    }
+
+    // Caches 'buf' of 'size_class', which is released straight away when the pool is full
+    void put(uint64_t size_class, Buffer buf) {
+        if (size_class > max_bytes) {
+            release(buf);
+            return;
+        }
+        trimTo(max_bytes - size_class);
+        _free[size_class].push_back(std::move(buf));
+        _cached_bytes += size_class;
+    }
+
+    // Release all cached buffers, e.g. when the device runs out of memory
+    void clear() {
+        trimTo(0);
+    }
+
+    // Returns the total size of the cached buffers
+    uint64_t cachedBytes() const {
+        return _cached_bytes;
+    }
+};
+
+} // jitk
+} // bohrium
+
+#endif
@@ -47,6 +47,8 @@ const char *write_c99_type(bh_type dtype) {
         case bh_type::COMPLEX64:  return "float complex";
         case bh_type::COMPLEX128: return "double complex";
         case bh_type::R123:       return "struct { uint64_t start, key; }";
+        case bh_type::FLOAT16:    return "_Float16";
+        case bh_type::BFLOAT16:   return "__bf16";
         default:
             std::cerr << "Unknown C99 type: " << bh_type_text(dtype) << std::endl;
             throw std::runtime_error("Unknown C99 type");
@@ -70,6 +72,7 @@ const char* write_opencl_type(bh_type dtype) {
         case bh_type::COMPLEX64:  return "float2";
         case bh_type::COMPLEX128: return "double2";
         case bh_type::R123:       return "ulong2";
+        case bh_type::FLOAT16:    return "half";
         default:
             std::cerr << "Unknown OpenCL type: " << bh_type_text(dtype) << std::endl;
             throw std::runtime_error("Unknown OpenCL type");
@@ -93,6 +96,8 @@ const char *write_cuda_type(bh_type dtype) {
         case bh_type::COMPLEX64:  return "cuFloatComplex";
         case bh_type::COMPLEX128: return "cuDoubleComplex";
         case bh_type::R123:       return "ulong2";
+        case bh_type::FLOAT16:    return "__half";
+        case bh_type::BFLOAT16:   return "__nv_bfloat16";
         default:
             std::cerr << "Unknown CUDA type: " << bh_type_text(dtype) << std::endl;
             throw std::runtime_error("Unknown CUDA type");
@@ -100,6 +105,7 @@ const char *write_cuda_type(bh_type dtype) {
 }
 
 // Writes the union of C99 types that can make up a constant
+// NB: the 16-bit floating-point types are never kernel constants (see SymbolTable) thus not in the union
 void write_c99_dtype_union(std::stringstream& out) {
     out << "union dtype {\n";
     spaces(out, 4);
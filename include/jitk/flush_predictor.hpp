@@ -0,0 +1,78 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __BH_JITK_FLUSH_PREDICTOR_HPP
+#define __BH_JITK_FLUSH_PREDICTOR_HPP
+
+#include <map>
+#include <list>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+namespace bohrium {
+namespace jitk {
+
+/* The flush predictor learns how often each flush follows another, where a flush is identified by the hashes
+ * of its kernel sources, and predicts the flushes that come next. It keeps the sources of the 'max_flushes'
+ * most recent distinct flushes thus the engine can compile the kernels of the predicted flushes ahead of time.
+ */
+class FlushPredictor {
+public:
+    // Number of distinct flushes to remember
+    const uint64_t max_flushes;
+    // Number of flushes to predict ahead
+    const uint64_t depth;
+    // Minimum number of times a transition must have been seen before it is predicted
+    const uint64_t min_count;
+
+    FlushPredictor(uint64_t max_flushes, uint64_t depth, uint64_t min_count) :
+            max_flushes(max_flushes), depth(depth), min_count(min_count) {}
+
+    // Records the kernel 'source' (whose hash is 'hash') of the current flush
+    void record(uint64_t hash, const std::string &source);
+
+    // Ends the current flush and returns the kernel sources of the flushes that most likely follow it
+    std::vector<std::string> endFlush();
+
+    // Forgets everything
+    void clear();
+
+private:
+    struct Flush {
+        std::vector<std::string> sources;
+        // The number of times each flush followed this one
+        std::map<uint64_t, uint64_t> next;
+        std::list<uint64_t>::iterator lru;
+    };
+    std::map<uint64_t, Flush> _flushes;
+    // The flushes ordered by their last use (most recent first)
+    std::list<uint64_t> _lru;
+    // The previous flush (zero when unknown)
+    uint64_t _previous = 0;
+    // The identity and sources of the current flush
+    uint64_t _current = 0;
+    std::vector<std::string> _sources;
+};
+
+} // jitk
+} // bohrium
+
+#endif
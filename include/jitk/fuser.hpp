@@ -23,8 +23,11 @@ If not, see <http://www.gnu.org/licenses/>.
 
 #include <set>
 #include <vector>
+#include <chrono>
 
 #include <jitk/block.hpp>
+#include <jitk/cost_model.hpp>
+#include <jitk/graph.hpp>
 #include <bh_instruction.hpp>
 
 namespace bohrium {
@@ -53,9 +56,20 @@ void fuser_breadth_first(std::vector<Block> &block_list, bool avoid_rank0_sweep)
 // 'avoid_rank0_sweep' will avoid fusion of sweeped and non-sweeped blocks at the root level
 void fuser_reshapable_first(std::vector<Block> &block_list, bool avoid_rank0_sweep);
 
-// Fuses 'block_list' greedily
+// Fuses 'block_list' greedily in the order of the merge weights of 'model'
 // 'avoid_rank0_sweep' will avoid fusion of sweeped and non-sweeped blocks at the root level
-void fuser_greedy(std::vector<Block> &block_list, bool avoid_rank0_sweep);
+void fuser_greedy(std::vector<Block> &block_list, bool avoid_rank0_sweep,
+                  graph::FuseModel model = graph::FuseModel::BYTES);
+
+// Fuses 'block_list' greedily but only where 'cost_model' doesn't predict a slowdown
+// 'avoid_rank0_sweep' will avoid fusion of sweeped and non-sweeped blocks at the root level
+void fuser_cost_model(std::vector<Block> &block_list, bool avoid_rank0_sweep, const CostModel &cost_model,
+                      graph::FuseModel model = graph::FuseModel::BYTES);
+
+// Fuses 'block_list' using a beam search of 'width' that minimizes the total block cost of 'model' until 'deadline'
+// 'avoid_rank0_sweep' will avoid fusion of sweeped and non-sweeped blocks at the root level
+void fuser_beam(std::vector<Block> &block_list, bool avoid_rank0_sweep, size_t width,
+                std::chrono::steady_clock::time_point deadline, graph::FuseModel model = graph::FuseModel::BYTES);
 
 } // jit
 } // bohrium
@@ -22,9 +22,14 @@ If not, see <http://www.gnu.org/licenses/>.
 #define __BH_JITK_CACHE_HPP
 
 #include <map>
+#include <list>
+#include <mutex>
+#include <memory>
 #include <vector>
+#include <unordered_map>
 
 #include <bh_instruction.hpp>
+#include <bh_config_parser.hpp>
 #include <jitk/block.hpp>
 #include <jitk/statistics.hpp>
 
@@ -34,18 +39,83 @@ namespace jitk {
 
 class FuseCache {
 private:
-    std::map<size_t, std::vector<Block> > _cache;
+    // A cached block list and its position in the LRU list
+    struct Entry {
+        std::vector<Block> block_list;
+        uint64_t bytes;
+        std::list<uint64_t>::iterator lru;
+    };
+    // The entries of the cache, which all instances with the same 'filename' in a process share thus
+    // concurrent component stacks (e.g. the sessions of the proxy backend) warm-start from each other
+    struct Store {
+        std::mutex mutex;
+        std::map<uint64_t, Entry> cache;
+        // The hashes of the cached block lists where the most recently used is first
+        std::list<uint64_t> lru;
+        // The estimated memory usage of all entries in the cache
+        uint64_t bytes = 0;
+        // Set when the cache has entries that isn't in 'filename'
+        bool dirty = false;
+    };
+    std::shared_ptr<Store> _store;
+
+    // Returns the store of 'filename', which is created and loaded by the first instance
+    std::shared_ptr<Store> open_store();
+
+    // Evict the least recently used entries until we are within 'max_entries' and 'max_bytes'
+    // NB: the following methods must be called with the store locked
+    void evict();
+
+    // Insert 'block_list' into the cache as the most recently used entry unless 'lookup_hash' is cached already
+    bool insert_entry(uint64_t lookup_hash, const std::vector<Block> &block_list);
+
+    // Load the entries in 'filename' and save all entries to 'filename'
+    void load();
+    void save() const;
+
+    // Scratch space of hash_prefixes(), which is reused between calls to avoid allocations
+    std::vector<uint64_t> _hashes;
+    std::unordered_map<const bh_base*, uint64_t> _base_ids;
+
+    // Hash the first 'prefix_size' instructions of 'instr_list' into '_hashes' where the i'th hash covers
+    // the first 'i' instructions. NB: the hashes are chained thus a prefix hashes the same no matter what follows it
+    void hash_prefixes(const std::vector<bh_instruction *> &instr_list, size_t prefix_size);
 public:
     // Some statistics
     jitk::Statistics &stat;
 
-    // The constructor takes the statistic object
-    FuseCache(jitk::Statistics &stat) : stat(stat) {}
+    // Maximum number of entries and maximum estimated memory usage in bytes (zero means unlimited)
+    const uint64_t max_entries;
+    const uint64_t max_bytes;
+
+    // File that persists the cache between processes (empty means no persistence nor sharing).
+    // It is loaded by the first instance of the process and saved on destruction.
+    const std::string filename;
+    const bool verbose;
+
+    // The constructor takes the component config and the statistic object
+    FuseCache(const ConfigParser &config, jitk::Statistics &stat);
+    ~FuseCache();
+
+    // Returns the prefix sizes of 'instr_list' that are cached, in increasing order, which are the
+    // positions just after a run of system instructions and the size of the whole list
+    static std::vector<size_t> segment_ends(const std::vector<bh_instruction *> &instr_list);
+
+    // Update the bases and constants of the instructions in 'block_list' with the instructions of 'instr_list'
+    // that have the same origin id, which must be the structural equal instructions of another flush
+    static void rebind(std::vector<Block> &block_list, const std::vector<bh_instruction *> &instr_list);
+
+    // Check the cache for the longest prefix of 'instr_list' that has a block list.
+    // Returns the block list and the number of instructions it covers, which is zero on a miss.
+    std::pair<std::vector<Block>, size_t> get(const std::vector<bh_instruction *> &instr_list);
+
+    // Insert 'block_list' as a hit when requesting the first 'prefix_size' instructions of 'instr_list'
+    // NB: 'prefix_size' should be one of the segment_ends() of 'instr_list'
+    void insert(const std::vector<bh_instruction *> &instr_list, size_t prefix_size,
+                const std::vector<Block> &block_list);
 
-    // Check the cache for a block list that matches 'instr_list'
-    std::pair<std::vector<Block>, bool> get(const std::vector<bh_instruction *> &instr_list);
-    // Insert 'block_list' as a hit when requesting 'instr_list'
-    void insert(const std::vector<bh_instruction *> &instr_list, const std::vector<Block> &block_list);
+    // Remove all entries, e.g. when the fusion options change, which also clears the other instances of the store
+    void clear();
 };
 
 
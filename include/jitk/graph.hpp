@@ -24,8 +24,10 @@ If not, see <http://www.gnu.org/licenses/>.
 #include <set>
 #include <vector>
 #include <string>
+#include <chrono>
 
 #include <jitk/block.hpp>
+#include <jitk/cost_model.hpp>
 #include <bh_instruction.hpp>
 
 #include <boost/graph/graph_traits.hpp>
@@ -69,6 +71,13 @@ void merge_system_pendants(DAG &dag);
 // Pretty print the DAG. A "-<id>.dot" is append the filename.
 void pprint(const DAG &dag, const char *filename, bool avoid_rank0_sweep);
 
+/* Returns a report of the edges of 'dag', which no fuser merged, with the reason of each and the bytes that
+ * merging it would have contracted (the weight of the edge), largest first. The vertices are the "Kernel <id>"
+ * of pprint().
+ * 'cost_model' is the cost model of the fuser if any, which explains the rejections of mergeable edges
+ */
+std::string fusion_report(const DAG &dag, bool avoid_rank0_sweep, const CostModel *cost_model = NULL);
+
 // Create a dag based on the 'block_list'
 DAG from_block_list(const std::vector <Block> &block_list);
 
@@ -135,9 +144,35 @@ std::vector<Block> topological(DAG &dag, bool avoid_rank0_sweep) {
     return ret;
 }
 
+/* The price models of the fusers, which greedy() uses to order the merges (the weight of an edge) and beam()
+ * uses to compare the partitions (the cost of a block):
+ *   - BYTES: a merge weighs the bytes of the arrays it contracts and a block costs the bytes of its
+ *     non-temporary arrays
+ *   - UNIQUE_VIEWS: a merge also weighs the bytes of the views both blocks access and a block costs the bytes
+ *     of its distinct non-temporary views, thus strided accesses of the same array count separately
+ *   - TEMP_ELIMINATION: a merge weighs the number of arrays it contracts and a block costs the number of its
+ *     non-temporary arrays
+ *   - MAX_SHARE: a merge also weighs the bytes of the arrays both blocks read and a block costs like BYTES
+ */
+enum class FuseModel {BYTES, UNIQUE_VIEWS, TEMP_ELIMINATION, MAX_SHARE};
+
+// Returns the model named 'name', which is "bytes", "unique_views", "temp_elimination", or "max_share"
+FuseModel fuse_model_from_string(const std::string &name);
+
 // Merges the vertices in 'dag' greedily.
 // 'avoid_rank0_sweep' will avoid fusion of sweeped and non-sweeped blocks at the root level
-void greedy(DAG &dag, bool avoid_rank0_sweep);
+// 'cost_model' rejects merges that raise the predicted cost (NULL accepts all merges)
+// 'model' orders the merges
+void greedy(DAG &dag, bool avoid_rank0_sweep, const CostModel *cost_model = NULL,
+            FuseModel model = FuseModel::BYTES);
+
+// Merges the vertices in 'dag' using a beam search that keeps the 'width' cheapest partial partitions
+// in each step and returns the partition with the lowest total block cost, which is never worse than greedy().
+// When passing 'deadline', the remaining partial partitions are completed greedily.
+// 'avoid_rank0_sweep' will avoid fusion of sweeped and non-sweeped blocks at the root level
+// 'model' prices the partitions
+void beam(DAG &dag, bool avoid_rank0_sweep, size_t width, std::chrono::steady_clock::time_point deadline,
+          FuseModel model = FuseModel::BYTES);
 
 } // graph
 } // jit
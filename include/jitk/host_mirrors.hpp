@@ -0,0 +1,75 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __BH_JITK_HOST_MIRRORS_HPP
+#define __BH_JITK_HOST_MIRRORS_HPP
+
+#include <map>
+#include <vector>
+#include <memory>
+#include <csignal>
+
+#include <bh_base.hpp>
+
+namespace bohrium {
+namespace jitk {
+
+/* The host mirrors are arrays synced to the host whose device buffer is still valid. The engines keep the
+ * device buffer and write-protect the host data (using bh_mem_signal) thus a host that only reads the data
+ * doesn't invalidate it. The first host write unprotects the data and marks the mirror as written, which
+ * tells the engine to drop the device buffer. NB: the host data must be allocated by bh_data_malloc().
+ */
+class HostMirrors {
+private:
+    struct Mirror {
+        void *addr;
+        uint64_t bytes;
+        // Set by the signal handler on the first host write
+        volatile sig_atomic_t written;
+    };
+    std::map<bh_base *, std::unique_ptr<Mirror> > _mirrors;
+
+    // The bh_mem_signal callback of a host write to the mirror 'idx'
+    static void on_write(void *idx, void *addr);
+
+public:
+    HostMirrors();
+    ~HostMirrors();
+
+    // Write-protect the host data of 'base', which now mirrors its device buffer
+    void protect(bh_base *base);
+
+    // Returns true when the host data of 'base' mirrors its device buffer
+    bool valid(bh_base *base) const {
+        auto it = _mirrors.find(base);
+        return it != _mirrors.end() and not it->second->written;
+    }
+
+    // Stop mirroring 'base', e.g. because the device is about to write it
+    void release(bh_base *base);
+
+    // Stop mirroring the bases that the host has written since and return them
+    std::vector<bh_base *> takeWritten();
+};
+
+} // jitk
+} // bohrium
+
+#endif
@@ -35,6 +35,25 @@ namespace jitk {
 // Write the source code of an instruction (set 'opencl' for OpenCL specific output)
 void write_instr(const Scope &scope, const bh_instruction &instr, std::stringstream &out, bool opencl = false);
 
+// Returns true when the OpenMP source of 'instr' can use the inline complex arithmetic of
+// kernel_dependencies/complex_openmp.h instead of the C99 complex operations (see Scope::inline_complex)
+bool is_inline_complex(const bh_instruction &instr);
+
+// Returns true when 'instr' is an integer division, modulo, or remainder by a constant that is a kernel argument,
+// which the OpenMP source can divide by through the magic numbers of kernel_dependencies/integer_operations.h.
+// The kernel must declare the magic numbers of the constant 'c<id>' as 'c<id>_div' (see write_magic_divisors()).
+bool is_magic_division(const SymbolTable &symbols, const bh_instruction &instr);
+
+// Writes the declarations of the magic numbers of the constant divisors of 'instr_list' (see is_magic_division())
+void write_magic_divisors(const SymbolTable &symbols, const std::vector<InstrPtr> &instr_list, std::stringstream &out);
+
+// Write the source code of an elementwise instruction on vectors of 'vec_type', which consists of 'elem_type'
+// elements: arrays are accessed a vector at a time, temporaries are vectors, and constants are broadcasted.
+// When 'out_name' isn't NULL, the result is assigned to the vector variable 'out_name' instead of the output.
+// Set 'opencl' for OpenCL vectors, which are read using 'bh_vload()' and must be written through 'out_name'.
+void write_instr_simd(const Scope &scope, const bh_instruction &instr, const char *vec_type, const char *elem_type,
+                      std::stringstream &out, const char *out_name = NULL, bool opencl = false);
+
 // Return true when 'opcode' has a neutral initial reduction value
 bool has_reduce_identity(bh_opcode opcode);
 
@@ -46,6 +65,10 @@ void write_reduce_identity(bh_opcode opcode, bh_type dtype, std::stringstream &o
 std::vector<bh_instruction*> remove_non_computed_system_instr(std::vector<bh_instruction> &instr_list,
                                                               std::set<bh_base *> &syncs, std::set<bh_base *> &frees);
 
+// Splits 'instr_list' at its BH_REPEAT instructions into segments and the number of times each segment executes.
+// The body of a BH_REPEAT is one segment where nested BH_REPEATs are unrolled.
+std::vector<std::pair<std::vector<bh_instruction>, int64_t> > split_repeats(const std::vector<bh_instruction> &instr_list);
+
 // Reshape 'instr' to match 'size_of_rank_dim' at the 'rank' dimension.
 // The dimensions from zero to 'rank-1' are untouched.
 InstrPtr reshape_rank(const InstrPtr &instr, int rank, int64_t size_of_rank_dim);
@@ -35,6 +35,8 @@ class Kernel {
 private:
     // Do the kernel use random?
     bool _useRandom;
+    // Do the kernel use the 16-bit floating-point types?
+    bool _useFloat16, _useBFloat16;
     // Arrays freed
     std::set<bh_base*> _frees;
     // Arrays sync'ed
@@ -55,6 +57,14 @@ public:
         return _useRandom;
     }
 
+    // Do the kernel use the 16-bit floating-point types?
+    bool useFloat16() const {
+        return _useFloat16;
+    }
+    bool useBFloat16() const {
+        return _useBFloat16;
+    }
+
     // Return the freed arrays
     const std::set<bh_base*> &getFrees() const {
         return _frees;
@@ -107,6 +117,13 @@ public:
         }
         return ret;
     }
+
+    // Returns the distinct sizes of all loop blocks in the order they appear in the kernel
+    std::vector<int64_t> getLoopSizes() const;
+
+    // Returns the bytes of the distinct views of the non-temporary arrays that the kernel reads and writes and
+    // its estimated floating-point operations
+    KernelTraffic getTraffic() const;
 };
 
 // Create a new Kernel object including statistics and verbosity
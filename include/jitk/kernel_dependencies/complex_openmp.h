@@ -0,0 +1,62 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef __BH_JITK_KERNEL_DEPENDENCIES_COMPLEX_OPENMP_H
+#define __BH_JITK_KERNEL_DEPENDENCIES_COMPLEX_OPENMP_H
+
+// The complex operations as inline arithmetic on the real and imaginary parts, which skips the NaN and infinity
+// recovery of C99 Annex G (e.g. the __muldc3() call of a multiplication) and the library calls of cabs() and cexp().
+// NB: the math functions are type-generic through <tgmath.h>
+#define BH_COMPLEX_INLINE(T, NAME)                                                      \
+static inline T complex bh_cmake_##NAME(T re, T im) {                                   \
+    T complex r;                                                                        \
+    ((T *) &r)[0] = re;                                                                 \
+    ((T *) &r)[1] = im;                                                                 \
+    return r;                                                                           \
+}                                                                                       \
+static inline T complex bh_cmul_##NAME(T complex a, T complex b) {                      \
+    const T ar = creal(a), ai = cimag(a), br = creal(b), bi = cimag(b);                 \
+    return bh_cmake_##NAME(ar * br - ai * bi, ar * bi + ai * br);                       \
+}                                                                                       \
+/* Smith's algorithm, which avoids the overflow of |b|^2 */                             \
+static inline T complex bh_cdiv_##NAME(T complex a, T complex b) {                      \
+    const T ar = creal(a), ai = cimag(a), br = creal(b), bi = cimag(b);                 \
+    if (fabs(br) >= fabs(bi)) {                                                         \
+        const T ratio = bi / br, denom = br + bi * ratio;                               \
+        return bh_cmake_##NAME((ar + ai * ratio) / denom, (ai - ar * ratio) / denom);   \
+    } else {                                                                            \
+        const T ratio = br / bi, denom = bi + br * ratio;                               \
+        return bh_cmake_##NAME((ar * ratio + ai) / denom, (ai * ratio - ar) / denom);   \
+    }                                                                                   \
+}                                                                                       \
+/* NB: without the overflow protection of hypot() */                                    \
+static inline T bh_cabs_##NAME(T complex a) {                                           \
+    const T ar = creal(a), ai = cimag(a);                                               \
+    return sqrt(ar * ar + ai * ai);                                                     \
+}                                                                                       \
+static inline T complex bh_cexp_##NAME(T complex a) {                                   \
+    const T e = exp(creal(a)), ai = cimag(a);                                           \
+    return bh_cmake_##NAME(e * cos(ai), e * sin(ai));                                   \
+}
+
+BH_COMPLEX_INLINE(float, complex64)
+BH_COMPLEX_INLINE(double, complex128)
+#endif
@@ -27,4 +27,90 @@ If not, see <http://www.gnu.org/licenses/>.
                         e >>= 1;               \
                         b *= b;                \
                     }
+
+// Division by a divisor that is invariant within the kernel as a multiplication and shifts by "magic numbers"
+// (Granlund and Montgomery, "Division by invariant integers using multiplication"), which the OpenMP kernels
+// compute once per launch of the constant divisors that are kernel arguments
+#if !defined(__OPENCL_VERSION__) && !defined(__CUDACC__)
+typedef struct { uint64_t d, m; int sh1, sh2; } bh_udiv64_t;
+typedef struct { bh_udiv64_t u; int64_t d; } bh_sdiv64_t;
+
+// The upper 64 bits of the product 'a * b'
+static inline uint64_t bh_mulhi_u64(uint64_t a, uint64_t b) {
+#if defined(__SIZEOF_INT128__)
+    return (uint64_t) (((unsigned __int128) a * b) >> 64);
+#else
+    const uint64_t a_lo = (uint32_t) a, a_hi = a >> 32, b_lo = (uint32_t) b, b_hi = b >> 32;
+    const uint64_t hi_lo = a_hi * b_lo, lo_hi = a_lo * b_hi;
+    const uint64_t cross = ((a_lo * b_lo) >> 32) + (uint32_t) hi_lo + lo_hi;
+    return a_hi * b_hi + (hi_lo >> 32) + (cross >> 32);
+#endif
+}
+
+// NB: a zero divisor gives a quotient of 'n' instead of a trap
+static inline bh_udiv64_t bh_udiv64_magic(uint64_t d) {
+    bh_udiv64_t v;
+    int l = 0; // ceil(log2(d))
+    while (l < 64 && (1ULL << l) < d) {
+        ++l;
+    }
+    // m = floor(2^64 * (2^l - d) / d) + 1, where 2^l - d < d
+    const uint64_t t = (l == 64 ? 0 : (1ULL << l)) - d;
+    uint64_t q = 0, r = t;
+    for (int i = 0; i < 64; ++i) {
+        const uint64_t carry = r >> 63;
+        r <<= 1;
+        q <<= 1;
+        if (carry || r >= d) {
+            r -= d;
+            q |= 1;
+        }
+    }
+    v.d = d;
+    v.m = q + 1;
+    v.sh1 = l > 0 ? 1 : 0;
+    v.sh2 = l > 0 ? l - 1 : 0;
+    return v;
+}
+
+static inline uint64_t bh_udiv64(uint64_t n, bh_udiv64_t v) {
+    const uint64_t t = bh_mulhi_u64(v.m, n);
+    return (t + ((n - t) >> v.sh1)) >> v.sh2;
+}
+
+static inline uint64_t bh_umod64(uint64_t n, bh_udiv64_t v) {
+    return n - bh_udiv64(n, v) * v.d;
+}
+
+static inline bh_sdiv64_t bh_sdiv64_magic(int64_t d) {
+    bh_sdiv64_t v;
+    v.u = bh_udiv64_magic(d < 0 ? -(uint64_t) d : (uint64_t) d);
+    v.d = d;
+    return v;
+}
+
+// The quotient rounded towards zero like the C division
+static inline int64_t bh_sdiv64_trunc(int64_t n, bh_sdiv64_t v) {
+    const uint64_t q = bh_udiv64(n < 0 ? -(uint64_t) n : (uint64_t) n, v.u);
+    return (int64_t) ((n < 0) != (v.d < 0) ? -q : q);
+}
+
+// The quotient rounded towards minus infinity like the Python division
+static inline int64_t bh_sdiv64_floor(int64_t n, bh_sdiv64_t v) {
+    const int64_t q = bh_sdiv64_trunc(n, v);
+    const int64_t r = n - q * v.d;
+    return (r != 0 && (r < 0) != (v.d < 0)) ? q - 1 : q;
+}
+
+// The remainder with the sign of 'n' like the C modulo
+static inline int64_t bh_smod64_trunc(int64_t n, bh_sdiv64_t v) {
+    return n - bh_sdiv64_trunc(n, v) * v.d;
+}
+
+// The remainder with the sign of the divisor like the Python modulo
+static inline int64_t bh_smod64_floor(int64_t n, bh_sdiv64_t v) {
+    const int64_t r = bh_smod64_trunc(n, v);
+    return (r != 0 && (r < 0) != (v.d < 0)) ? r + v.d : r;
+}
+#endif
 #endif
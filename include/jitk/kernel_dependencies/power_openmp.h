@@ -0,0 +1,53 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __BH_JITK_KERNEL_DEPENDENCIES_POWER_OPENMP_H
+#define __BH_JITK_KERNEL_DEPENDENCIES_POWER_OPENMP_H
+
+// The integral exponents up to this magnitude are computed by binary exponentiation instead of pow(),
+// which is much slower and cannot be vectorized
+#define BH_POW_MAX_EXPONENT 64
+
+#define BH_POW_INTEGRAL(T, b, e) {                     \
+    if (fabs(e) <= BH_POW_MAX_EXPONENT) {              \
+        const int n = (int) (e);                       \
+        if (n == (e)) {                                \
+            unsigned int m = n < 0 ? -n : n;           \
+            T r = 1;                                   \
+            while (m) {                                \
+                if (m & 1) { r *= b; }                 \
+                m >>= 1;                               \
+                b *= b;                                \
+            }                                          \
+            return n < 0 ? 1 / r : r;                  \
+        }                                              \
+    }                                                  \
+}
+
+static inline float bh_pow_float32(float b, float e) {
+    BH_POW_INTEGRAL(float, b, e)
+    return powf(b, e);
+}
+
+static inline double bh_pow_float64(double b, double e) {
+    BH_POW_INTEGRAL(double, b, e)
+    return pow(b, e);
+}
+#endif
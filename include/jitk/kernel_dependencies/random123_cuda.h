@@ -25,17 +25,21 @@ If not, see <http://www.gnu.org/licenses/>.
 
 #include <Random123/philox.h>
 
-__device__ philox2x32_ctr_t philox2x32_R(unsigned int R, philox2x32_ctr_t ctr, philox2x32_key_t key);
-
+// Philox2x32 of the counter 'start + index' and the low word of 'key', which equals philox2x32_R() of Random123
+// but keeps the words in registers instead of type punning the structs of Random123 through memory
 __inline__ __device__ uint64_t random123(uint64_t start, uint64_t key, uint64_t index) {
-    uint64_t i = start + index;
-
-    philox2x32_ctr_t _index = *((philox2x32_ctr_t*)&i);
-    philox2x32_key_t _key   = *((philox2x32_key_t*)&key);
-
-    philox2x32_ctr_t result = philox2x32_R(philox2x32_rounds, _index, _key);
-
-    return *((uint64_t*)&result);
+    const uint64_t ctr = start + index;
+    uint32_t x0 = (uint32_t) ctr;
+    uint32_t x1 = (uint32_t) (ctr >> 32);
+    uint32_t k = (uint32_t) key;
+    for (int r = 0; r < PHILOX2x32_DEFAULT_ROUNDS; ++r) {
+        const uint32_t hi = __umulhi(PHILOX_M2x32_0, x0);
+        const uint32_t lo = PHILOX_M2x32_0 * x0;
+        x0 = hi ^ k ^ x1;
+        x1 = lo;
+        k += PHILOX_W32_0;
+    }
+    return (((uint64_t) x1) << 32) | x0;
 }
 
 #endif
@@ -0,0 +1,86 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __BH_JITK_KERNEL_DISPATCH_HPP
+#define __BH_JITK_KERNEL_DISPATCH_HPP
+
+#include <set>
+#include <string>
+#include <cstdint>
+
+#include <bh_config_parser.hpp>
+#include <jitk/kernel.hpp>
+
+namespace bohrium {
+namespace jitk {
+
+/* The dispatching executes each kernel on the device or on the CPU child, whichever the cost model estimates
+ * faster. The time of a side is its launch latency, plus the bytes the kernel accesses over the throughput of
+ * the side, plus the bytes of the arrays that must move to the side over the transfer rate. The throughputs
+ * start at the 'dispatch_*_gbps' options and follow the measured kernels as moving averages, where the CPU
+ * kernels are always measured and every 'dispatch_sample_interval'th device kernel is measured by waiting for it.
+ */
+class KernelDispatch {
+public:
+    explicit KernelDispatch(const ConfigParser &config);
+
+    // Whether to execute 'kernel' on the CPU child rather than on the device of 'engine'
+    // 'T' must have a onDevice(bh_base*) method
+    template<typename T>
+    bool onHost(const Kernel &kernel, const T &engine) const {
+        double upload = 0, download = 0;
+        for (bh_base *base: kernel.getNonTemps()) {
+            if (engine.onDevice(base)) {
+                download += bh_base_size(base);
+            } else if (base->data != nullptr) {
+                upload += bh_base_size(base);
+            }
+        }
+        const double bytes = traffic(kernel);
+        return host_latency + bytes / _host_rate + download / transfer_rate <
+               device_latency + bytes / _device_rate + upload / transfer_rate;
+    }
+
+    // Whether to measure the device kernel 'source', which must have been compiled before thus the measurement
+    // doesn't include the compilation
+    bool sample(const std::string &source);
+
+    // Records that a kernel that accesses 'bytes' bytes took 'seconds' on the device or on the CPU
+    void recordDevice(double bytes, double seconds);
+    void recordHost(double bytes, double seconds);
+
+    // Returns the bytes that 'kernel' reads and writes
+    static double traffic(const Kernel &kernel);
+
+private:
+    // The latencies in seconds and the transfer rate in bytes per second
+    const double device_latency, host_latency, transfer_rate;
+    const uint64_t sample_interval;
+    // The measured throughputs in bytes per second
+    double _device_rate, _host_rate;
+    // The hashes of the device kernels seen so far and the device kernels since the last measurement
+    std::set<size_t> _seen;
+    uint64_t _since_sample = 0;
+};
+
+} // jitk
+} // bohrium
+
+#endif
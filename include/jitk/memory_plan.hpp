@@ -0,0 +1,81 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __BH_JITK_MEMORY_PLAN_HPP
+#define __BH_JITK_MEMORY_PLAN_HPP
+
+#include <map>
+#include <set>
+#include <vector>
+
+#include <bh_base.hpp>
+#include <jitk/block.hpp>
+
+namespace bohrium {
+namespace jitk {
+
+/* The memory plan of a flush shares host buffers between the arrays that the flush allocates and frees without
+ * contracting them. The lifetime of such an array is the kernels from its first to its last access, and the arrays
+ * of disjoint lifetimes share a buffer, which is the greedy coloring of the interval graph in the order of the first
+ * accesses. A buffer is allocated at the first access of its first array and freed with the last of its arrays, and
+ * an array that would get a buffer of its own is left to bh_data_malloc().
+ */
+class MemoryPlan {
+private:
+    struct Buffer {
+        uint64_t bytes = 0;
+        void *data = nullptr;
+        // The number of arrays of the buffer and of them freed so far, where the last free frees the buffer
+        size_t arrays = 0, freed = 0;
+    };
+    std::vector<Buffer> _buffers;
+    // The buffer of each planned array and the planned arrays by the kernel that accesses them first
+    std::map<bh_base *, size_t> _assignment;
+    std::map<size_t, std::vector<bh_base *> > _first_use;
+    uint64_t _array_bytes = 0;
+
+public:
+    MemoryPlan() = default;
+
+    // Plan the arrays of the kernels of 'block_list', which execute in order
+    explicit MemoryPlan(const std::vector<Block> &block_list);
+
+    // Frees the buffers that are still allocated
+    ~MemoryPlan();
+    MemoryPlan(const MemoryPlan &) = delete;
+    MemoryPlan &operator=(const MemoryPlan &) = delete;
+
+    // Sets the data of the planned arrays that the kernel 'block_idx' accesses first
+    void assign(size_t block_idx);
+
+    // Detaches the data of the planned arrays of 'frees' thus bh_data_free() leaves the buffers alone, and frees the
+    // buffers whose arrays are all freed
+    void release(const std::set<bh_base *> &frees);
+
+    // The number of planned arrays, their bytes, and the bytes of the buffers they share
+    uint64_t numArrays() const { return _assignment.size(); }
+    uint64_t arrayBytes() const { return _array_bytes; }
+    uint64_t bufferBytes() const;
+};
+
+} // jitk
+} // bohrium
+
+#endif
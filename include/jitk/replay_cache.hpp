@@ -0,0 +1,84 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __BH_JITK_REPLAY_CACHE_HPP
+#define __BH_JITK_REPLAY_CACHE_HPP
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <bh_instruction.hpp>
+#include <bh_config_parser.hpp>
+#include <jitk/block.hpp>
+#include <jitk/statistics.hpp>
+
+
+namespace bohrium {
+namespace jitk {
+
+/* The replay cache maps the traces that the node VEM detects (see bh_ir::replay_trace) to the block list and
+ * kernel sources of the trace, thus a replay skips the fuse cache lookup, the fusion, and the code generation.
+ * A replay only applies when the constructor flags of the replay equals the flags of the recorded trace.
+ */
+class ReplayCache {
+private:
+    struct Entry {
+        std::vector<Block> block_list;
+        std::vector<std::string> sources;
+        // The constructor flag of each instruction
+        std::vector<bool> constructors;
+        // The time of the last use where the least recently used entry is evicted first
+        uint64_t last_use;
+    };
+    std::map<int64_t, Entry> _cache;
+    uint64_t _clock = 0;
+public:
+    // Some statistics
+    jitk::Statistics &stat;
+
+    // Maximum number of entries (zero means unlimited)
+    const uint64_t max_entries;
+    const bool enabled;
+
+    // The constructor takes the component config and the statistic object
+    ReplayCache(const ConfigParser &config, jitk::Statistics &stat) :
+            stat(stat), max_entries(config.defaultGet<uint64_t>("replay_cache_entries", 64)),
+            enabled(config.defaultGet<bool>("replay_cache", true)) {}
+
+    // Get the block list and sources of trace 'id' rebound to 'instr_list' (see FuseCache::rebind()).
+    // Returns false when 'id' isn't cached or when the constructor flags of 'instr_list' doesn't match.
+    bool get(int64_t id, const std::vector<bh_instruction *> &instr_list, std::vector<Block> &block_list,
+             std::vector<std::string> &sources);
+
+    // Insert the 'block_list' and 'sources' of 'instr_list' as trace 'id'
+    void insert(int64_t id, const std::vector<bh_instruction *> &instr_list, const std::vector<Block> &block_list,
+                const std::vector<std::string> &sources);
+    // Remove all entries, e.g. when the fusion or code generation options change
+    void clear() {
+        _cache.clear();
+    }
+};
+
+
+} // jit
+} // bohrium
+
+#endif
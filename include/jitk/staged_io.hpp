@@ -0,0 +1,64 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __BH_JITK_STAGED_IO_HPP
+#define __BH_JITK_STAGED_IO_HPP
+
+#include <cstdint>
+#include <functional>
+
+namespace bohrium {
+namespace jitk {
+
+/* The file I/O of device buffers through two host staging buffers of 'chunk_bytes' bytes, e.g. page-locked memory.
+ * The file I/O of a chunk in one staging buffer overlaps the device copy of the next chunk in the other buffer.
+ * The engine implements the asynchronous copies and the waits for them:
+ *   copy(slot, offset, nbytes) starts the copy of the 'nbytes' bytes at 'offset' in the device buffer
+ *                              to (when storing) or from (when loading) the staging buffer 'slot'
+ *   wait(slot)                 waits for the last copy of 'slot' to finish
+ * Throws std::runtime_error when the file I/O fails.
+ */
+class StagedIO {
+public:
+    typedef std::function<void(int slot, uint64_t offset, uint64_t nbytes)> Copy;
+    typedef std::function<void(int slot)> Wait;
+
+    StagedIO(uint64_t chunk_bytes, char *staging0, char *staging1) : _chunk_bytes(chunk_bytes),
+                                                                     _staging{staging0, staging1} {}
+
+    // Write the 'nbytes' bytes of the device buffer to 'fd' at 'file_offset', where 'copy' downloads a chunk
+    void store(int fd, uint64_t file_offset, uint64_t nbytes, const Copy &copy, const Wait &wait) const;
+
+    // Read the 'nbytes' bytes of the device buffer from 'fd' at 'file_offset', where 'copy' uploads a chunk
+    void load(int fd, uint64_t file_offset, uint64_t nbytes, const Copy &copy, const Wait &wait) const;
+
+private:
+    const uint64_t _chunk_bytes;
+    char *const _staging[2];
+};
+
+// Write or read all 'nbytes' bytes of 'data' at 'offset' of 'fd', which throws std::runtime_error on failures
+void write_file(int fd, const void *data, uint64_t nbytes, uint64_t offset);
+void read_file(int fd, void *data, uint64_t nbytes, uint64_t offset);
+
+} // jitk
+} // bohrium
+
+#endif
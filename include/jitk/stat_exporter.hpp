@@ -0,0 +1,103 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __BH_JITK_STAT_EXPORTER_HPP
+#define __BH_JITK_STAT_EXPORTER_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <bh_config_parser.hpp>
+#include <jitk/statistics.hpp>
+
+namespace bohrium {
+namespace jitk {
+
+/* Exports the statistics of an engine periodically while it runs, which the options of the engine's section
+ * configure:
+ *   - stat_export:          "prometheus" writes the Prometheus text format to the file 'stat_export_target'
+ *                           (e.g. for the textfile collector of the node exporter) and "statsd" sends gauges to
+ *                           the UDP address 'stat_export_target' ("host:port"); empty disables the export
+ *   - stat_export_interval: seconds between the exports
+ *   - stat_export_kernels:  the number of kernels (with the largest execution time) that are exported
+ *
+ * The engine calls update() after each flush, which renders the statistics when the interval has passed, and a
+ * background thread writes or sends the latest rendering every interval. When disabled, create() returns NULL
+ * thus the engines only test a pointer.
+ */
+class StatExporter {
+  public:
+    enum class Format {PROMETHEUS, STATSD};
+
+    // Returns the exporter of the config of 'engine_name' or NULL when the export is disabled
+    static std::unique_ptr<StatExporter> create(const ConfigParser &config, const std::string &engine_name);
+
+    // Whether the config enables the export, which needs the statistics of the engine to be enabled
+    static bool enabled(const ConfigParser &config);
+
+    StatExporter(Format format, const std::string &target, const std::string &engine_name,
+                 std::chrono::duration<double> interval, size_t num_kernels);
+    ~StatExporter();
+    StatExporter(const StatExporter &other) = delete;
+
+    // Render 'stat' for the background thread if the interval has passed since the last rendering
+    void update(const Statistics &stat) {
+        if (std::chrono::steady_clock::now() >= _next_update) {
+            render(stat);
+        }
+    }
+
+    // Render 'stat' for the background thread now, e.g. at the end of the engine
+    void render(const Statistics &stat);
+
+    // Returns the Prometheus text format or the StatsD lines of 'stat'
+    std::string prometheus(const Statistics &stat) const;
+    std::string statsd(const Statistics &stat) const;
+
+  private:
+    const Format _format;
+    const std::string _target;
+    const std::string _engine_name;
+    const std::chrono::duration<double> _interval;
+    const size_t _num_kernels;
+    std::chrono::steady_clock::time_point _next_update;
+
+    // The latest rendering, which '_mutex' protects together with '_stop'
+    std::mutex _mutex;
+    std::condition_variable _cond;
+    std::string _rendering;
+    bool _stop = false;
+    std::thread _thread;
+    // The UDP socket of StatsD (-1 when not connected)
+    int _socket = -1;
+
+    // Write or send the latest rendering every interval until stopped
+    void run();
+    void emit(const std::string &rendering);
+};
+
+} // jitk
+} // bohrium
+
+#endif
@@ -27,6 +27,9 @@ If not, see <http://www.gnu.org/licenses/>.
 #include <sstream>
 #include <fstream>
 #include <vector>
+#include <map>
+#include <limits>
+#include <algorithm>
 
 #include <bh_instruction.hpp>
 #include <colors.hpp>
@@ -43,6 +46,82 @@ std::string pprint_ratio(uint64_t a, uint64_t b) {
 }
 }
 
+// The bytes of the non-temporary arrays that a kernel reads and writes, the elements of its iteration space, and
+// its floating-point operations, which are estimated as one per element of each computing instruction
+struct KernelTraffic {
+    uint64_t bytes_read = 0;
+    uint64_t bytes_written = 0;
+    uint64_t elements = 0;
+    uint64_t flops = 0;
+};
+
+// The hardware counters of the threads that execute kernels
+struct HardwareCounters {
+    uint64_t cycles = 0;
+    uint64_t instructions = 0;
+    uint64_t llc_misses = 0;
+
+    // The counts since 'before'
+    HardwareCounters since(const HardwareCounters &before) const {
+        HardwareCounters ret;
+        ret.cycles = cycles - before.cycles;
+        ret.instructions = instructions - before.instructions;
+        ret.llc_misses = llc_misses - before.llc_misses;
+        return ret;
+    }
+};
+
+// The profile of the launches of a kernel, which is identified by the hash of its source
+struct KernelProfile {
+    uint64_t launches = 0;
+    // The number of launches whose execution time is known, which excludes e.g. the launches of CUDA graphs
+    uint64_t timed_launches = 0;
+    std::chrono::duration<double> time_exec{0};
+    std::chrono::duration<double> min_exec{std::numeric_limits<double>::infinity()};
+    std::chrono::duration<double> max_exec{0};
+    std::chrono::duration<double> time_compile{0};
+    // The totals of the launches
+    KernelTraffic traffic;
+    // The file with the source of the kernel (empty when it hasn't been written)
+    std::string source_file;
+    // The totals of the counted launches (zero when the engine doesn't count)
+    HardwareCounters counters;
+
+    // The achieved bandwidth in GB/s and elements/s of the timed launches
+    double bandwidth() const {
+        return per_second(traffic.bytes_read + traffic.bytes_written) / 1e9;
+    }
+    double element_rate() const {
+        return per_second(traffic.elements);
+    }
+    double flop_rate() const {
+        return per_second(traffic.flops);
+    }
+
+    // The FLOPs per byte of the views
+    double intensity() const {
+        const uint64_t bytes = traffic.bytes_read + traffic.bytes_written;
+        return bytes == 0 ? 0 : static_cast<double>(traffic.flops) / bytes;
+    }
+
+    // The instructions per cycle and the memory bandwidth in GB/s of the cache lines of the LLC misses
+    double ipc() const {
+        return counters.cycles == 0 ? 0 : static_cast<double>(counters.instructions) / counters.cycles;
+    }
+    double llc_bandwidth() const {
+        return time_exec.count() <= 0 ? 0 : counters.llc_misses * 64.0 / time_exec.count() / 1e9;
+    }
+
+  private:
+    // The rate of the 'total' of all launches where the untimed launches don't count
+    double per_second(uint64_t total) const {
+        if (launches == 0 or time_exec.count() <= 0) {
+            return 0;
+        }
+        return static_cast<double>(timed_launches) / launches * total / time_exec.count();
+    }
+};
+
 class Statistics {
   public:
     bool enabled;
@@ -50,24 +129,52 @@ class Statistics {
     uint64_t num_base_arrays           = 0;
     uint64_t num_temp_arrays           = 0;
     uint64_t num_syncs                 = 0;
-    uint64_t max_memory_usage          = 0;
+    uint64_t max_memory_usage          = 0; // Of the device including its pool
+    uint64_t max_host_memory_usage     = 0; // Of the live arrays of bh_data_malloc()
+    uint64_t max_hugepage_bytes        = 0;
+    uint64_t memory_pool_lookups       = 0;
+    uint64_t memory_pool_hits          = 0;
+    uint64_t num_planned_arrays        = 0; // Of the memory plans, which share buffers between arrays
+    uint64_t planned_array_bytes       = 0;
+    uint64_t planned_buffer_bytes      = 0;
+    uint64_t device_pool_lookups       = 0;
+    uint64_t device_pool_hits          = 0;
     uint64_t totalwork                 = 0;
     uint64_t threading_below_threshold = 0;
     uint64_t kernel_cache_lookups      = 0;
     uint64_t kernel_cache_misses       = 0;
+    uint64_t num_interpreted_kernels   = 0;
+    uint64_t num_speculative_compiles  = 0;
+    uint64_t num_batched_kernels       = 0;
+    uint64_t num_time_blocked_kernels  = 0;
+    uint64_t codegen_cache_lookups     = 0;
+    uint64_t codegen_cache_misses      = 0;
     uint64_t fuser_cache_lookups       = 0;
     uint64_t fuser_cache_misses        = 0;
+    uint64_t fuser_cache_partial_hits  = 0;
+    uint64_t fuser_cache_evictions     = 0;
+    uint64_t fuser_cache_entries       = 0;
+    uint64_t fuser_cache_bytes         = 0;
+    uint64_t replay_cache_lookups      = 0;
+    uint64_t replay_cache_misses       = 0;
     uint64_t num_instrs_into_fuser     = 0;
     uint64_t num_blocks_out_of_fuser   = 0;
+    // The bytes of the arrays placed on each NUMA node (empty when the placement isn't recorded)
+    std::vector<uint64_t> numa_node_bytes;
     std::chrono::duration<double> time_total_execution{0};
     std::chrono::duration<double> time_pre_fusion{0};
     std::chrono::duration<double> time_fusion{0};
     std::chrono::duration<double> time_exec{0};
     std::chrono::duration<double> time_compile{0};
+    std::chrono::duration<double> time_codegen{0};
     std::chrono::duration<double> time_offload{0};
     std::chrono::duration<double> time_copy2dev{0};
     std::chrono::duration<double> time_copy2host{0};
 
+    // The profile of each kernel, by the hash of its source, and the number of kernels in the pretty print
+    std::map<uint64_t, KernelProfile> kernel_profiles;
+    size_t num_top_kernels = 10;
+
     std::chrono::duration<double> wallclock{0};
     std::chrono::time_point<std::chrono::steady_clock> time_started{std::chrono::steady_clock::now()};
 
@@ -91,11 +198,40 @@ class Statistics {
 
             out << BLU << "[" << backend_name << "] Profiling: \n" << RST;
             out << "Fuse cache hits:                 " << GRN << fuse_cache_hits()                   << "\n" << RST;
+            out << "Fuse cache partial hits:         " << GRN << fuser_cache_partial_hits            << "\n" << RST;
+            out << "Fuse cache size:                 " << GRN << fuser_cache_entries << " entries ("
+                                                     << fuse_cache_size() << " MB)"                  << "\n" << RST;
+            out << "Fuse cache evictions:            " << GRN << fuser_cache_evictions               << "\n" << RST;
+            out << "Replay cache hits:               " << GRN << replay_cache_hits()                 << "\n" << RST;
             out << "Kernel cache hits                " << GRN << kernel_cache_hits()                 << "\n" << RST;
+            out << "Codegen cache hits:              " << GRN << codegen_cache_hits()                << "\n" << RST;
+            out << "Interpreted kernels:             " << GRN << num_interpreted_kernels             << "\n" << RST;
+            out << "Speculative compiles:            " << GRN << num_speculative_compiles            << "\n" << RST;
+            out << "Batched kernels:                 " << GRN << num_batched_kernels                 << "\n" << RST;
+            out << "Time-blocked kernels:            " << GRN << num_time_blocked_kernels            << "\n" << RST;
             out << "Array contractions:              " << GRN << array_contractions()                << "\n" << RST;
             out << "Outer-fusion ratio:              " << GRN << outer_fusion_ratio()                << "\n" << RST;
             out << "\n";
-            out << "Max memory usage:                " << GRN << memory_usage() << " MB"             << "\n" << RST;
+            if (max_memory_usage > 0) {
+                out << "Max memory usage:                " << GRN << memory_usage() << " MB"         << "\n" << RST;
+            }
+            out << "Max host memory usage:           " << GRN << host_memory_usage() << " MB"        << "\n" << RST;
+            if (memory_pool_lookups > 0) {
+                out << "Memory pool hits:                " << GRN << memory_pool_hit_rate()           << "\n" << RST;
+            }
+            if (device_pool_lookups > 0) {
+                out << "Device pool hits:                " << GRN << device_pool_hit_rate()           << "\n" << RST;
+            }
+            if (num_planned_arrays > 0) {
+                out << "Memory-planned arrays:           " << GRN << num_planned_arrays << " ("
+                    << planned_memory() << " MB in " << planned_buffer_memory() << " MB of buffers)"  << "\n" << RST;
+            }
+            if (max_hugepage_bytes > 0) {
+                out << "Max huge-page memory:            " << GRN << hugepage_usage() << " MB"        << "\n" << RST;
+            }
+            if (not numa_node_bytes.empty()) {
+                out << "Memory per NUMA node:            " << GRN << numa_memory() << " MB"           << "\n" << RST;
+            }
             out << "Syncs to NumPy:                  " << GRN << num_syncs                           << "\n" << RST;
             out << "Total Work:                      " << GRN << totalwork << " operations"          << "\n" << RST;
             out << "Throughput:                      " << GRN << throughput() << "ops"               << "\n" << RST;
@@ -105,6 +241,7 @@ class Statistics {
             out << "Total Execution:                 " << BLU << time_total_execution.count() << "s" << "\n" << RST;
             out << "  Pre-fusion:                    " << YEL << time_pre_fusion.count() << "s"      << "\n" << RST;
             out << "  Fusion:                        " << YEL << time_fusion.count() << "s"          << "\n" << RST;
+            out << "  Codegen:                       " << YEL << time_codegen.count() << "s"         << "\n" << RST;
             out << "  Compile:                       " << YEL << time_compile.count() << "s"         << "\n" << RST;
             out << "  Exec:                          " << YEL << time_exec.count() << "s"            << "\n" << RST;
             out << "  Copy2dev:                      " << YEL << time_copy2dev.count() << "s"        << "\n" << RST;
@@ -113,6 +250,26 @@ class Statistics {
             out << "  Other:                         " << YEL << time_other() << "s"                 << "\n" << RST;
             out << "\n";
             out << BOLD << RED << "Unaccounted for (wall - total):  " << unaccounted() << "s\n" << RST;
+            out << "Codegen saved by cache (est.):   " << GRN << time_codegen_saved() << "s"         << "\n" << RST;
+            if (not kernel_profiles.empty()) {
+                out << "\n";
+                out << "Top kernels by exec time (of " << kernel_profiles.size() << "):" << "\n";
+                for (const auto &p: top_kernels(num_top_kernels)) {
+                    const KernelProfile &k = *p.second;
+                    out << "  " << hex << p.first << dec << ": " << YEL << k.time_exec.count() << "s" << RST
+                        << " in " << k.launches << " launches (min " << min_exec(k) << "s, max "
+                        << k.max_exec.count() << "s), compile " << k.time_compile.count() << "s, "
+                        << GRN << k.bandwidth() << " GB/s, " << k.element_rate() << " elements/s" << RST;
+                    if (k.counters.cycles > 0) {
+                        out << ", IPC " << k.ipc() << ", " << k.counters.llc_misses << " LLC misses ("
+                            << k.llc_bandwidth() << " GB/s)";
+                    }
+                    if (not k.source_file.empty()) {
+                        out << ", " << k.source_file;
+                    }
+                    out << "\n";
+                }
+            }
             out << endl;
         } else {
             out << BLU << "[" << backend_name << "] Profiling: " << RST;
@@ -133,10 +290,38 @@ class Statistics {
             file << "----"                                                      << "\n";
             file << backend_name << ":"                                         << "\n";
             file << "  fuse_cache_hits: "       << fuse_cache_hits()            << "\n";
+            file << "  fuse_cache_partial: "    << fuser_cache_partial_hits     << "\n";
+            file << "  fuse_cache_entries: "    << fuser_cache_entries          << "\n";
+            file << "  fuse_cache_size: "       << fuse_cache_size()            << "\n"; // mb
+            file << "  fuse_cache_evictions: "  << fuser_cache_evictions        << "\n";
+            file << "  replay_cache_hits: "     << replay_cache_hits()          << "\n";
             file << "  kernel_cache_hits: "     << kernel_cache_hits()          << "\n";
+            file << "  codegen_cache_hits: "    << codegen_cache_hits()         << "\n";
+            file << "  interpreted_kernels: "   << num_interpreted_kernels      << "\n";
+            file << "  speculative_compiles: "  << num_speculative_compiles     << "\n";
+            file << "  batched_kernels: "       << num_batched_kernels          << "\n";
+            file << "  time_blocked_kernels: "  << num_time_blocked_kernels     << "\n";
             file << "  array_contractions: "    << array_contractions()         << "\n";
             file << "  outer_fusion_ratio: "    << outer_fusion_ratio()         << "\n";
             file << "  memory_usage: "          << memory_usage()               << "\n"; // mb
+            file << "  host_memory_usage: "     << host_memory_usage()          << "\n"; // mb
+            if (memory_pool_lookups > 0) {
+                file << "  memory_pool_hits: "  << memory_pool_hit_rate()       << "\n";
+            }
+            if (device_pool_lookups > 0) {
+                file << "  device_pool_hits: "  << device_pool_hit_rate()       << "\n";
+            }
+            if (num_planned_arrays > 0) {
+                file << "  planned_arrays: "    << num_planned_arrays           << "\n";
+                file << "  planned_memory: "    << planned_memory()             << "\n"; // mb
+                file << "  planned_buffers: "   << planned_buffer_memory()      << "\n"; // mb
+            }
+            if (max_hugepage_bytes > 0) {
+                file << "  hugepage_memory: "   << hugepage_usage()             << "\n"; // mb
+            }
+            if (not numa_node_bytes.empty()) {
+                file << "  numa_memory: ["      << numa_memory()                << "]\n"; // mb
+            }
             file << "  syncs: "                 << num_syncs                    << "\n";
             file << "  total_work: "            << totalwork                    << "\n"; // ops
             file << "  throughput: "            << throughput()                 << "\n"; // ops
@@ -146,6 +331,8 @@ class Statistics {
             file << "    total_execution: "     << time_total_execution.count() << "\n"; // s
             file << "    pre_fusion: "          << time_pre_fusion.count()      << "\n"; // s
             file << "    fusion: "              << time_fusion.count()          << "\n"; // s
+            file << "    codegen: "             << time_codegen.count()         << "\n"; // s
+            file << "    codegen_saved: "       << time_codegen_saved()         << "\n"; // s
             file << "    compile: "             << time_compile.count()         << "\n"; // s
             file << "    exec: "                << time_exec.count()            << "\n"; // s
             file << "    copy2dev: "            << time_copy2dev.count()        << "\n"; // s
@@ -153,6 +340,30 @@ class Statistics {
             file << "    offload: "             << time_offload.count()         << "\n"; // s
             file << "    other: "               << time_other()                 << "\n"; // s
             file << "    unaccounted: "         << unaccounted()                << "\n"; // s
+            if (not kernel_profiles.empty()) {
+                file << "  kernels:"                                            << "\n";
+                for (const auto &p: top_kernels(kernel_profiles.size())) {
+                    const KernelProfile &k = *p.second;
+                    file << "    - hash: \""        << hex << p.first << dec         << "\"\n";
+                    file << "      launches: "      << k.launches                   << "\n";
+                    file << "      exec: "          << k.time_exec.count()          << "\n"; // s
+                    file << "      min_exec: "      << min_exec(k)                  << "\n"; // s
+                    file << "      max_exec: "      << k.max_exec.count()           << "\n"; // s
+                    file << "      compile: "       << k.time_compile.count()       << "\n"; // s
+                    file << "      bytes_read: "    << k.traffic.bytes_read         << "\n";
+                    file << "      bytes_written: " << k.traffic.bytes_written      << "\n";
+                    file << "      bandwidth: "     << k.bandwidth()                << "\n"; // GB/s
+                    file << "      element_rate: "  << k.element_rate()             << "\n"; // elements/s
+                    if (k.counters.cycles > 0) {
+                        file << "      cycles: "        << k.counters.cycles            << "\n";
+                        file << "      instructions: "  << k.counters.instructions      << "\n";
+                        file << "      llc_misses: "    << k.counters.llc_misses        << "\n";
+                        file << "      ipc: "           << k.ipc()                      << "\n";
+                        file << "      llc_bandwidth: " << k.llc_bandwidth()            << "\n"; // GB/s
+                    }
+                    file << "      source: \""      << k.source_file                << "\"\n";
+                }
+            }
 
             file.close();
         }
@@ -174,7 +385,66 @@ class Statistics {
         }
     }
 
+    // Record the compilation, or the lookup in the kernel cache, of the kernel 'hash'
+    void record_compile(uint64_t hash, std::chrono::duration<double> time) {
+        if (enabled) {
+            kernel_profiles[hash].time_compile += time;
+        }
+    }
+
+    // Record a launch of the kernel 'hash'
+    void record_launch(uint64_t hash, const KernelTraffic &traffic) {
+        if (enabled) {
+            KernelProfile &k = kernel_profiles[hash];
+            ++k.launches;
+            k.traffic.bytes_read += traffic.bytes_read;
+            k.traffic.bytes_written += traffic.bytes_written;
+            k.traffic.elements += traffic.elements;
+            k.traffic.flops += traffic.flops;
+        }
+    }
+
+    // Record the execution time of a launch of the kernel 'hash'
+    void record_exec(uint64_t hash, std::chrono::duration<double> time) {
+        if (enabled) {
+            KernelProfile &k = kernel_profiles[hash];
+            ++k.timed_launches;
+            k.time_exec += time;
+            k.min_exec = std::min(k.min_exec, time);
+            k.max_exec = std::max(k.max_exec, time);
+        }
+    }
+
+    // Record the hardware counters of a launch of the kernel 'hash'
+    void record_counters(uint64_t hash, const HardwareCounters &counters) {
+        if (enabled) {
+            HardwareCounters &k = kernel_profiles[hash].counters;
+            k.cycles += counters.cycles;
+            k.instructions += counters.instructions;
+            k.llc_misses += counters.llc_misses;
+        }
+    }
+
+    // The 'num' kernels with the largest execution time in descending order
+    std::vector<std::pair<uint64_t, const KernelProfile *> > top_kernels(size_t num) const {
+        std::vector<std::pair<uint64_t, const KernelProfile *> > ret;
+        for (const auto &p: kernel_profiles) {
+            ret.push_back(std::make_pair(p.first, &p.second));
+        }
+        std::sort(ret.begin(), ret.end(), [](const std::pair<uint64_t, const KernelProfile *> &a,
+                                             const std::pair<uint64_t, const KernelProfile *> &b) {
+            return a.second->time_exec > b.second->time_exec;
+        });
+        ret.resize(std::min(num, ret.size()));
+        return ret;
+    }
+
   private:
+    // The minimum execution time of 'k', which is zero when none of its launches were timed
+    static double min_exec(const KernelProfile &k) {
+        return k.timed_launches == 0 ? 0 : k.min_exec.count();
+    }
+
     std::string fuse_cache_hits() {
         return pprint_ratio(fuser_cache_lookups - fuser_cache_misses, fuser_cache_lookups);
     }
@@ -183,6 +453,23 @@ class Statistics {
         return pprint_ratio(kernel_cache_lookups - kernel_cache_misses, kernel_cache_lookups);
     }
 
+    std::string replay_cache_hits() {
+        return pprint_ratio(replay_cache_lookups - replay_cache_misses, replay_cache_lookups);
+    }
+
+    std::string codegen_cache_hits() {
+        return pprint_ratio(codegen_cache_lookups - codegen_cache_misses, codegen_cache_lookups);
+    }
+
+    // The code generation time saved by the codegen cache, which we estimate as the hits times the average miss
+    double time_codegen_saved() {
+        if (codegen_cache_misses == 0) {
+            return 0;
+        }
+        const uint64_t hits = codegen_cache_lookups - codegen_cache_misses;
+        return time_codegen.count() / codegen_cache_misses * hits;
+    }
+
     std::string array_contractions() {
         return pprint_ratio(num_temp_arrays, num_base_arrays);
     }
@@ -191,10 +478,47 @@ class Statistics {
         return pprint_ratio(num_blocks_out_of_fuser, num_instrs_into_fuser);
     }
 
+    double fuse_cache_size() {
+        return (double) fuser_cache_bytes / 1024.0 / 1024.0;
+    }
+
     double memory_usage() {
         return (double) max_memory_usage / 1024.0 / 1024.0;
     }
 
+    std::string memory_pool_hit_rate() {
+        return pprint_ratio(memory_pool_hits, memory_pool_lookups);
+    }
+
+    std::string device_pool_hit_rate() {
+        return pprint_ratio(device_pool_hits, device_pool_lookups);
+    }
+
+    double host_memory_usage() {
+        return (double) max_host_memory_usage / 1024.0 / 1024.0;
+    }
+
+    double planned_memory() {
+        return (double) planned_array_bytes / 1024.0 / 1024.0;
+    }
+
+    double planned_buffer_memory() {
+        return (double) planned_buffer_bytes / 1024.0 / 1024.0;
+    }
+
+    double hugepage_usage() {
+        return (double) max_hugepage_bytes / 1024.0 / 1024.0;
+    }
+
+    // The memory of each NUMA node in MB separated by commas
+    std::string numa_memory() {
+        std::stringstream ss;
+        for (size_t i = 0; i < numa_node_bytes.size(); ++i) {
+            ss << (i > 0 ? ", " : "") << (double) numa_node_bytes[i] / 1024.0 / 1024.0;
+        }
+        return ss.str();
+    }
+
     double throughput() {
         return (double) totalwork / (double) wallclock.count();
     }
@@ -205,7 +529,7 @@ class Statistics {
 
     double time_other() {
         std::chrono::duration<double> time_other{0};
-        return (time_total_execution - time_pre_fusion - time_fusion - time_compile - time_exec  - time_copy2dev - time_copy2host - time_offload).count();
+        return (time_total_execution - time_pre_fusion - time_fusion - time_codegen - time_compile - time_exec  - time_copy2dev - time_copy2host - time_offload).count();
     }
 
     double unaccounted() {
@@ -34,12 +34,25 @@ namespace jitk {
 // Transpose blocks such that reductions gets as innermost as possible
 void push_reductions_inwards(std::vector<Block> &block_list);
 
+// Interchange perfectly nested loops without sweeps such that most of the accessed bytes are unit-stride
+// in the innermost loop
+void push_unit_stride_inwards(std::vector<Block> &block_list);
+
 // Splits the 'block_list' in order to achieve a minimum amount of threading (if possible)
 void split_for_threading(std::vector<Block> &block_list, uint64_t min_threading=1000, uint64_t cur_threading=0);
 
 // Collapses redundant axes within the 'block_list'
 void collapse_redundant_axes(std::vector<Block> &block_list);
 
+// Turns the reductions over the rows of a 2D nest, whose output rows are wider than two blocks of 'block_bytes', into
+// a loop over blocks of columns that accumulates the contiguous row segments of a block into its partial results.
+// The column blocks are independent thus the outer loop is parallel without private copies of the results.
+void block_column_reductions(std::vector<Block> &block_list, int64_t block_bytes);
+
+// Cache blocks the perfectly nested 2D loops in 'block_list' that access an array across its rows
+// using tiles of 'tile_size' x 'tile_size' iterations. NB: should be the last transformer applied.
+void tile_loops(std::vector<Block> &block_list, int64_t tile_size);
+
 } // jitk
 } // bohrium
 
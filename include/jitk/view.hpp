@@ -39,6 +39,12 @@ void write_array_index(const Scope &scope, const bh_view &view, std::stringstrea
 void write_array_index_variables(const Scope &scope, const bh_view &view, std::stringstream &out, int hidden_axis = BH_MAXDIM,
                                  const std::pair<int, int> axis_offset = std::make_pair(BH_MAXDIM, 0));
 
+// Writes the declaration of the partial index of 'view' in the body of the loop of 'rank', which is the sum of the
+// terms of the axes up to 'rank', e.g. "const uint64_t ip1_0 = ip0_0 +i1*10;". The array indexes of the nested
+// loops add their innermost terms to the partial index, which views with the same strides of the outer axes share.
+// NB: nothing is written when the partial index exists or the terms are zero
+void write_partial_index_declaration(Scope &scope, const bh_view &view, int rank, std::stringstream &out);
+
 // Write the array subscription, e.g. A[2+i0*1+i1*10], but ignore the loop-variant of 'hidden_axis' if it isn't 'BH_MAXDIM'
 void write_array_subscription(const Scope &scope, const bh_view &view, std::stringstream &out,
                               bool ignore_declared_indexes = false, int hidden_axis = BH_MAXDIM,
@@ -0,0 +1,91 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __BH_JITK_WORK_GROUP_TUNER_HPP
+#define __BH_JITK_WORK_GROUP_TUNER_HPP
+
+#include <map>
+#include <array>
+#include <vector>
+#include <cstdint>
+#include <boost/filesystem.hpp>
+
+namespace bohrium {
+namespace jitk {
+
+/* The work-group tuner times the first launches of each GPU kernel using a few local work sizes, which
+ * are bounded by the kernel's maximum work-group size, and sticks to the fastest one. The kernels whose work-items
+ * process vectors are also timed using a few vector widths. The winners are stored in a file next to the program
+ * cache thus later processes skip the tuning.
+ */
+class WorkGroupTuner {
+public:
+    // The local work size of each dimension (unused dimensions are one)
+    typedef std::array<uint32_t, 3> Local;
+
+    // Index of the candidate when a launch isn't timed
+    static const size_t NOT_TIMED;
+
+    // Each candidate is timed 'runs' times. The tuning is stored in 'file' when it isn't empty.
+    WorkGroupTuner(int runs, const boost::filesystem::path &file);
+    ~WorkGroupTuner();
+
+    // Writes the local work size to use for the next launch of the kernel 'key' to 'local' and returns the
+    // index of the candidate, which must be passed to end() after the launch. The kernel has 'ndim' threaded
+    // dimensions, 'local' holds the configured local work size, 'max_size' is the maximum work-group size of
+    // the kernel, and 'max_local' is the maximum local work size of each dimension.
+    // When 'width' isn't NULL, it holds the configured number of elements of the work-items, which is tuned as well
+    // using the widths 1, 2, 4, and 8, and the width to use for the launch is written to it.
+    size_t begin(uint64_t key, size_t ndim, uint64_t max_size, const Local &max_local, Local &local,
+                 uint32_t *width = NULL);
+
+    // Records that the launch of the kernel 'key' using 'candidate' took 'seconds'
+    void end(uint64_t key, size_t candidate, double seconds);
+
+private:
+    // The tuning state of a kernel
+    struct Tuning {
+        std::vector<Local> candidates;
+        // The vector width of each candidate (zero when the kernel doesn't process vectors)
+        std::vector<uint32_t> widths;
+        // The accumulated seconds and number of launches of each candidate
+        std::vector<double> seconds;
+        std::vector<int> launches;
+        // Whether the first launch, which warms up the caches, is done
+        bool warm = false;
+        // The winning local work size (valid when 'tuned' is true)
+        bool tuned = false;
+        Local winner;
+        uint32_t winner_width = 0;
+    };
+    std::map<uint64_t, Tuning> _tunings;
+
+    // Number of launches to time of each candidate
+    const int runs;
+    // The file of the persistent tuning
+    const boost::filesystem::path file;
+    // Whether there are new winners to save
+    bool _dirty = false;
+};
+
+} // jitk
+} // bohrium
+
+#endif
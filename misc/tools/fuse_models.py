@@ -0,0 +1,78 @@
+#!/usr/bin/env python
+#
+# This file is part of Bohrium and copyright (c) 2018 the Bohrium team:
+# http://cphvb.bitbucket.org
+#
+# Bohrium is free software: you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as
+# published by the Free Software Foundation, either version 3
+# of the License, or (at your option) any later version.
+#
+# Bohrium is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the
+# GNU Lesser General Public License along with Bohrium.
+#
+# If not, see <http://www.gnu.org/licenses/>.
+#
+"""
+Compares the price models of the fusers ('fuse_model' in config.ini) on binary traces recorded by the
+trace filter: each trace is replayed by 'bh-replay' once per model and the table shows the number of
+kernels, the kernel execution time, and the fastest replay, e.g.::
+
+    python fuse_models.py --repeat 5 traces/jacobi.bin traces/heat.bin
+
+The first replay compiles the kernels thus use '--repeat' of two or more to see the kernel runtimes.
+"""
+from __future__ import print_function
+import argparse
+import os
+import re
+import subprocess
+
+MODELS = ["bytes", "unique_views", "temp_elimination", "max_share"]
+
+
+def replay(trace, model, args):
+    """Returns the number of kernels, the kernel execution time, and the fastest replay of 'trace' using 'model'"""
+    ve = args.ve.upper()
+    env = dict(os.environ)
+    env["BH_%s_FUSE_MODEL" % ve] = model
+    env["BH_%s_PROF" % ve] = "true"
+    env["BH_%s_FUSER_CACHE_FILE" % ve] = ""  # The cached block lists don't record the model
+    cmd = [args.replay, "--repeat", str(args.repeat), trace]
+    out = subprocess.check_output(cmd, env=env, stderr=subprocess.STDOUT).decode()
+
+    replays = [float(t) for t in re.findall(r"\[bh-replay\] replay \d+: .*, ([0-9.e+-]+)s", out)]
+    kernels = re.search(r"Kernel cache hits\s+\d+/(\d+)", out)
+    exec_time = re.search(r"^\s*Exec:\s+([0-9.e+-]+)s", out, re.MULTILINE)
+    if not replays or kernels is None or exec_time is None:
+        raise RuntimeError("cannot parse the output of '%s':\n%s" % (" ".join(cmd), out))
+    return int(kernels.group(1)), float(exec_time.group(1)), min(replays)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Compares the fuse models on bh-replay traces.")
+    parser.add_argument("traces", nargs="+", help="The binary traces to replay")
+    parser.add_argument("--models", nargs="+", default=MODELS, choices=MODELS, help="The models to compare")
+    parser.add_argument("--repeat", type=int, default=3, help="The number of replays of each trace")
+    parser.add_argument("--ve", default="openmp", help="The vector engine of the stack (its config section)")
+    parser.add_argument("--replay", default="bh-replay", help="The bh-replay executable")
+    args = parser.parse_args()
+
+    print("%-24s %-18s %10s %12s %12s" % ("trace", "model", "kernels", "exec (s)", "replay (s)"))
+    for trace in args.traces:
+        name = os.path.basename(trace)
+        baseline = None
+        for model in args.models:
+            kernels, exec_time, best = replay(trace, model, args)
+            if baseline is None:
+                baseline = best
+            print("%-24s %-18s %10d %12.6f %12.6f (%.2fx)" % (name, model, kernels, exec_time, best, baseline / best))
+
+
+if __name__ == "__main__":
+    main()
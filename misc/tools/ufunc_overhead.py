@@ -0,0 +1,62 @@
+#!/usr/bin/env python
+#
+# This file is part of Bohrium and copyright (c) 2018 the Bohrium team:
+# http://cphvb.bitbucket.org
+#
+# Bohrium is free software: you can redistribute it and/or modify
+# it under the terms of the GNU Lesser General Public License as 
+# published by the Free Software Foundation, either version 3 
+# of the License, or (at your option) any later version.
+#
+# Bohrium is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the 
+# GNU Lesser General Public License along with Bohrium. 
+#
+# If not, see <http://www.gnu.org/licenses/>.
+#
+"""
+Measures the per-operation overhead of the Python/NumPy bridge: the number of ufunc
+calls per second on arrays from 1 to 1M elements, with Bohrium and with NumPy, e.g.::
+
+    python ufunc_overhead.py --ops 10000 --sizes 1 100 10000 1000000
+"""
+from __future__ import print_function
+import argparse
+import time
+
+import numpy
+
+
+def ops_per_second(np, size, nops, flush):
+    """Returns the number of 'a = a + b' calls per second on arrays of 'size' elements"""
+    a = np.ones(size)
+    b = np.ones(size)
+    flush()
+    start = time.time()
+    for _ in range(nops):
+        a = a + b
+    flush()
+    return nops / (time.time() - start)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Measures the per-operation overhead of the Python/NumPy bridge.')
+    parser.add_argument('--ops', type=int, default=10000, help='The number of operations per measurement.')
+    parser.add_argument('--sizes', type=int, nargs='+', default=[1, 10, 100, 1000, 10000, 100000, 1000000],
+                        help='The array sizes in number of elements.')
+    args = parser.parse_args()
+
+    import bohrium
+    print("%10s %16s %16s" % ("size", "bohrium ops/s", "numpy ops/s"))
+    for size in args.sizes:
+        bh = ops_per_second(bohrium, size, args.ops, bohrium.flush)
+        np = ops_per_second(numpy, size, args.ops, lambda: None)
+        print("%10d %16.0f %16.0f" % (size, bh, np))
+
+
+if __name__ == "__main__":
+    main()
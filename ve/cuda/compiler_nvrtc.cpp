@@ -0,0 +1,124 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <sstream>
+#include <iostream>
+#include <stdexcept>
+#include <iterator>
+
+#ifdef VE_CUDA_NVRTC
+#include <nvrtc.h>
+#endif
+
+#include "compiler_nvrtc.hpp"
+
+using namespace std;
+
+namespace bohrium {
+
+CompilerNVRTC::CompilerNVRTC(string inc, string flg, string arch, bool verbose) : inc_(inc), flg_(flg),
+                                                                                   arch_(arch), verbose_(verbose) {
+    if (not available()) {
+        throw runtime_error("CompilerNVRTC: Bohrium was build without NVRTC");
+    }
+    // NB: NVRTC compiles to a virtual architecture thus "sm_30" becomes "compute_30"
+    stringstream ss(inc_ + " " + flg_);
+    options_.assign(istream_iterator<string>(ss), istream_iterator<string>());
+    string virtual_arch = arch_;
+    if (virtual_arch.compare(0, 3, "sm_") == 0) {
+        virtual_arch = "compute_" + virtual_arch.substr(3);
+    }
+    options_.push_back("--gpu-architecture=" + virtual_arch);
+}
+
+string CompilerNVRTC::text() const {
+    stringstream ss;
+    ss << "CompilerNVRTC {" << endl;
+    ss << "  inc = '" << inc_ << "'," << endl;
+    ss << "  flg = '" << flg_ << "'," << endl;
+    ss << "  arch = '" << arch_ << "'," << endl;
+    ss << "}";
+    return ss.str();
+}
+
+#ifdef VE_CUDA_NVRTC
+
+namespace {
+void check_nvrtc(nvrtcResult result, const string &what) {
+    if (result != NVRTC_SUCCESS) {
+        throw runtime_error("CompilerNVRTC: " + what + " failed: " + nvrtcGetErrorString(result));
+    }
+}
+}
+
+bool CompilerNVRTC::available() {
+    return true;
+}
+
+string CompilerNVRTC::compile(const string &sourcecode, bool fast_math) const {
+    nvrtcProgram prog;
+    check_nvrtc(nvrtcCreateProgram(&prog, sourcecode.c_str(), "kernel.cu", 0, NULL, NULL), "nvrtcCreateProgram()");
+
+    vector<const char*> options;
+    for (const string &opt: options_) {
+        options.push_back(opt.c_str());
+    }
+    if (fast_math) {
+        options.push_back("--use_fast_math");
+    }
+    const nvrtcResult result = nvrtcCompileProgram(prog, (int) options.size(), options.empty() ? NULL : &options[0]);
+
+    // Let's get the compile log, which contains the errors
+    size_t log_size;
+    check_nvrtc(nvrtcGetProgramLogSize(prog, &log_size), "nvrtcGetProgramLogSize()");
+    string log(log_size, '\0');
+    if (log_size > 1) {
+        check_nvrtc(nvrtcGetProgramLog(prog, &log[0]), "nvrtcGetProgramLog()");
+    }
+    if (result != NVRTC_SUCCESS) {
+        cerr << "Error compiling: " << endl << log << endl;
+        nvrtcDestroyProgram(&prog);
+        check_nvrtc(result, "nvrtcCompileProgram()");
+    }
+    if (verbose_ and log_size > 1) {
+        cout << log << endl;
+    }
+
+    size_t ptx_size;
+    check_nvrtc(nvrtcGetPTXSize(prog, &ptx_size), "nvrtcGetPTXSize()");
+    string ptx(ptx_size, '\0');
+    check_nvrtc(nvrtcGetPTX(prog, &ptx[0]), "nvrtcGetPTX()");
+    nvrtcDestroyProgram(&prog);
+    return ptx;
+}
+
+#else
+
+bool CompilerNVRTC::available() {
+    return false;
+}
+
+string CompilerNVRTC::compile(const string &sourcecode, bool fast_math) const {
+    throw runtime_error("CompilerNVRTC: Bohrium was build without NVRTC");
+}
+
+#endif
+
+}
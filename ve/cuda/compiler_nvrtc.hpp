@@ -0,0 +1,61 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __BH_VE_CUDA_COMPILER_NVRTC_HPP
+#define __BH_VE_CUDA_COMPILER_NVRTC_HPP
+
+#include <string>
+#include <vector>
+
+namespace bohrium {
+
+class CompilerNVRTC {
+public:
+    /**
+     * An in-process compiler based on NVRTC, which compiles sourcecode directly
+     * into PTX in memory thus no nvcc process is spawned and no file is written.
+     *
+     * 'inc' and 'flg' are command line options such as "-I/path" and "-DNDEBUG".
+     * 'arch' is the target architecture such as "sm_30".
+     */
+    CompilerNVRTC(std::string inc, std::string flg, std::string arch, bool verbose);
+
+    // Returns whether Bohrium was build with NVRTC
+    static bool available();
+
+    std::string text() const;
+
+    /**
+     *  Compile the given sourcecode into PTX, which adds "--use_fast_math" when 'fast_math' is set.
+     *
+     *  Throws runtime_error on compilation failure
+     */
+    std::string compile(const std::string &sourcecode, bool fast_math = false) const;
+
+private:
+    std::string inc_, flg_, arch_;
+    bool verbose_;
+    // The compile options, which are 'inc_' and 'flg_' split into words followed by the architecture
+    std::vector<std::string> options_;
+};
+
+}
+
+#endif
@@ -18,11 +18,15 @@ GNU Lesser General Public License along with Bohrium.
 If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
 #include <vector>
+#include <cstring>
 #include <iostream>
+#include <fstream>
 #include <boost/functional/hash.hpp>
 #include <iomanip>
 
+#include <bh_memory.h>
 #include <jitk/kernel.hpp>
 
 #include "engine_cuda.hpp"
@@ -34,6 +38,26 @@ namespace bohrium {
 
 static boost::hash<string> hasher;
 
+namespace {
+// Returns the "sm_XX" architecture given by the '-arch' option in the nvcc flags 'flg' or the empty string
+string find_arch(const string &flg) {
+    stringstream ss(flg);
+    string word;
+    while (ss >> word) {
+        for (const string &opt: {string("-arch="), string("--gpu-architecture=")}) {
+            if (word.compare(0, opt.size(), opt) == 0) {
+                return word.substr(opt.size());
+            }
+        }
+        if (word == "-arch" or word == "--gpu-architecture") {
+            ss >> word;
+            return word;
+        }
+    }
+    return string();
+}
+}
+
 EngineCUDA::EngineCUDA(const ConfigParser &config, jitk::Statistics &stat) :
                                     work_group_size_1dx(config.defaultGet<int>("work_group_size_1dx", 128)),
                                     work_group_size_2dx(config.defaultGet<int>("work_group_size_2dx", 32)),
@@ -46,6 +70,11 @@ EngineCUDA::EngineCUDA(const ConfigParser &config, jitk::Statistics &stat) :
                                     platform_no(config.defaultGet<int>("platform_no", -1)),
                                     verbose(config.defaultGet<bool>("verbose", false)),
                                     stat(stat),
+                                    pool(config.defaultGet<uint64_t>("device_pool_max_bytes", 268435456),
+                                         [](CUdeviceptr &buf) {checkCudaErrors(cuMemFree(buf));}, stat),
+                                    pinned_min_bytes(config.defaultGet<uint64_t>("pinned_min_bytes", 1048576)),
+                                    storage_chunk_bytes(std::max<uint64_t>(1, config.defaultGet<uint64_t>(
+                                            "storage_chunk_bytes", 8388608))),
                                     prof(config.defaultGet<bool>("prof", false)),
                                     tmp_dir(fs::temp_directory_path() / fs::unique_path("bohrium_%%%%")),
                                     source_dir(tmp_dir / "src"),
@@ -54,7 +83,15 @@ EngineCUDA::EngineCUDA(const ConfigParser &config, jitk::Statistics &stat) :
                                              config.defaultGet<string>("compiler_inc", ""),
                                              config.defaultGet<string>("compiler_lib", ""),
                                              config.defaultGet<string>("compiler_flg", ""),
-                                             config.defaultGet<string>("compiler_ext", ""))
+                                             config.defaultGet<string>("compiler_ext", "")),
+                                    fast_compiler(config.defaultGet<string>("compiler_cmd", "nvcc"),
+                                                  config.defaultGet<string>("compiler_inc", ""),
+                                                  config.defaultGet<string>("compiler_lib", ""),
+                                                  config.defaultGet<string>("compiler_flg", "") + " --use_fast_math",
+                                                  config.defaultGet<string>("compiler_ext", "")),
+                                    kernel_trace(config.defaultGet<string>("kernel_trace", "")),
+                                    cache_dir(jitk::expand_user(config.defaultGet<string>("cache_dir", ""))),
+                                    graph_min_repeats(config.defaultGet<int>("graph_min_repeats", 0))
 {
     size_t     totalGlobalMem;
     int deviceCount = 0;
@@ -80,6 +117,7 @@ EngineCUDA::EngineCUDA(const ConfigParser &config, jitk::Statistics &stat) :
     printf("> GPU Device has SM %d.%d compute capability\n", major, minor);
 
     checkCudaErrors( cuDeviceTotalMem(&totalGlobalMem, device) );
+    device_bytes = totalGlobalMem;
     printf("  Total amount of global memory:   %llu bytes\n",
            (unsigned long long)totalGlobalMem);
     printf("  64-bit Memory Address:           %s\n",
@@ -93,28 +131,134 @@ EngineCUDA::EngineCUDA(const ConfigParser &config, jitk::Statistics &stat) :
         exit(-1);
     }
 
+    // The unified memory requires that the host and the device can access it concurrently
+    if (config.defaultGet<bool>("managed_memory", false)) {
+#if CUDA_VERSION >= 8000
+        int concurrent = 0;
+        checkCudaErrors(cuDeviceGetAttribute(&concurrent, CU_DEVICE_ATTRIBUTE_CONCURRENT_MANAGED_ACCESS, device));
+        managed = concurrent != 0;
+#endif
+        if (not managed) {
+            cerr << "[CUDA] 'managed_memory' requires concurrent managed access thus it is disabled" << endl;
+        }
+    }
+    // The managed host data is the device data thus there is nothing to mirror
+    if (config.defaultGet<bool>("host_mirrors", true) and not managed) {
+        mirrors.reset(new jitk::HostMirrors());
+    }
+    if (config.defaultGet<bool>("overlap_copies", true)) {
+        checkCudaErrors(cuStreamCreate(&copy_stream, CU_STREAM_NON_BLOCKING));
+    }
+    if (config.defaultGet<bool>("autotune_work_groups", false)) {
+        wg_tuner.reset(new jitk::WorkGroupTuner(config.defaultGet<int>("autotune_runs", 2),
+                                                cache_dir.empty() ? fs::path() : cache_dir / "cuda_work_groups.txt"));
+    }
+
     // Let's make sure that the directories exist
     fs::create_directories(source_dir);
     fs::create_directories(object_dir);
+    if (not cache_dir.empty()) {
+        fs::create_directories(cache_dir);
+    }
+
+    initCompiler(config);
+}
+
+void EngineCUDA::initCompiler(const ConfigParser &config) {
+    // The target architecture is the one in 'compiler_flg' or else the one of the device
+    arch = find_arch(compile_flg);
+    if (arch.empty()) {
+        int major = 0, minor = 0;
+        checkCudaErrors(cuDeviceComputeCapability(&major, &minor, device));
+        stringstream ss;
+        ss << "sm_" << major << minor;
+        arch = ss.str();
+    }
+
+    // Let's create the in-process compiler
+    const string compiler_backend = config.defaultGet<string>("compiler_backend", "process");
+    if (compiler_backend == "nvrtc") {
+        compiler_nvrtc.reset(new CompilerNVRTC(config.defaultGet<string>("compiler_inc", ""),
+                                               config.defaultGet<string>("compiler_nvrtc_flg", ""), arch, verbose));
+    } else if (compiler_backend != "process") {
+        throw runtime_error("VE-CUDA: 'compiler_backend' must be 'process' or 'nvrtc'");
+    }
+
+    // A cubin is only valid for the architecture and compiler that build it
+    cache_hash = hasher(arch);
+    boost::hash_combine(cache_hash, compiler_nvrtc ? compiler_nvrtc->text() : compiler.process_str("OBJ", "SRC"));
+}
+
+void EngineCUDA::reconfigure(const ConfigParser &config) {
+    // The queued launches and the graphs refer to the old kernels
+    submitLaunches();
+    checkCudaErrors(cuCtxSynchronize());
+#ifdef BH_CUDA_GRAPHS
+    for (auto &key_and_graph: _graphs) {
+        Graph &g = key_and_graph.second;
+        if (g.exec != NULL) {
+            cuGraphExecDestroy(g.exec);
+            cuGraphDestroy(g.graph);
+        }
+    }
+#endif
+    _graphs.clear();
+    _programs.clear();
+
+    work_group_size_1dx = config.defaultGet<int>("work_group_size_1dx", 128);
+    work_group_size_2dx = config.defaultGet<int>("work_group_size_2dx", 32);
+    work_group_size_2dy = config.defaultGet<int>("work_group_size_2dy", 4);
+    work_group_size_3dx = config.defaultGet<int>("work_group_size_3dx", 32);
+    work_group_size_3dy = config.defaultGet<int>("work_group_size_3dy", 2);
+    work_group_size_3dz = config.defaultGet<int>("work_group_size_3dz", 2);
+    compile_flg = config.defaultGet<string>("compiler_flg", "");
+    compiler = Compiler(config.defaultGet<string>("compiler_cmd", "nvcc"),
+                        config.defaultGet<string>("compiler_inc", ""),
+                        config.defaultGet<string>("compiler_lib", ""),
+                        compile_flg,
+                        config.defaultGet<string>("compiler_ext", ""));
+    fast_compiler = Compiler(config.defaultGet<string>("compiler_cmd", "nvcc"),
+                             config.defaultGet<string>("compiler_inc", ""),
+                             config.defaultGet<string>("compiler_lib", ""),
+                             compile_flg + " --use_fast_math",
+                             config.defaultGet<string>("compiler_ext", ""));
+    compiler_nvrtc.reset();
+    initCompiler(config);
+    if (verbose) {
+        cout << "[CUDA] reconfigured for " << arch << ": " << compiler.text() << endl;
+    }
+}
+
+jitk::WorkGroupTuner::Local EngineCUDA::configuredLocal(size_t ndim) const {
+    switch (ndim) {
+        case 1:
+            return {{static_cast<uint32_t>(work_group_size_1dx), 1, 1}};
+        case 2:
+            return {{static_cast<uint32_t>(work_group_size_2dx), static_cast<uint32_t>(work_group_size_2dy), 1}};
+        default:
+            return {{static_cast<uint32_t>(work_group_size_3dx), static_cast<uint32_t>(work_group_size_3dy),
+                     static_cast<uint32_t>(work_group_size_3dz)}};
+    }
 }
 
-pair<tuple<uint32_t, uint32_t, uint32_t>, tuple<uint32_t, uint32_t, uint32_t> > EngineCUDA::NDRanges(const vector<const jitk::LoopB*> &threaded_blocks) const {
+pair<tuple<uint32_t, uint32_t, uint32_t>, tuple<uint32_t, uint32_t, uint32_t> > EngineCUDA::NDRanges(const vector<const jitk::LoopB*> &threaded_blocks,
+                                                                                                    const jitk::WorkGroupTuner::Local &local) const {
     const auto &b = threaded_blocks;
     switch (b.size()) {
         case 1: {
-            const auto gsize_and_lsize = jitk::work_ranges(work_group_size_1dx, b[0]->size);
+            const auto gsize_and_lsize = jitk::work_ranges(local[0], b[0]->size);
             return make_pair(make_tuple(gsize_and_lsize.first, 1, 1), make_tuple(gsize_and_lsize.second, 1, 1));
         }
         case 2: {
-            const auto gsize_and_lsize_x = jitk::work_ranges(work_group_size_2dx, b[0]->size);
-            const auto gsize_and_lsize_y = jitk::work_ranges(work_group_size_2dy, b[1]->size);
+            const auto gsize_and_lsize_x = jitk::work_ranges(local[0], b[0]->size);
+            const auto gsize_and_lsize_y = jitk::work_ranges(local[1], b[1]->size);
             return make_pair(make_tuple(gsize_and_lsize_x.first, gsize_and_lsize_y.first, 1),
                              make_tuple(gsize_and_lsize_x.second, gsize_and_lsize_y.second, 1));
         }
         case 3: {
-            const auto gsize_and_lsize_x = jitk::work_ranges(work_group_size_3dx, b[0]->size);
-            const auto gsize_and_lsize_y = jitk::work_ranges(work_group_size_3dy, b[1]->size);
-            const auto gsize_and_lsize_z = jitk::work_ranges(work_group_size_3dz, b[2]->size);
+            const auto gsize_and_lsize_x = jitk::work_ranges(local[0], b[0]->size);
+            const auto gsize_and_lsize_y = jitk::work_ranges(local[1], b[1]->size);
+            const auto gsize_and_lsize_z = jitk::work_ranges(local[2], b[2]->size);
             return make_pair(make_tuple(gsize_and_lsize_x.first, gsize_and_lsize_y.first, gsize_and_lsize_z.first),
                              make_tuple(gsize_and_lsize_x.second, gsize_and_lsize_y.second, gsize_and_lsize_z.second));
         }
@@ -123,15 +267,116 @@ pair<tuple<uint32_t, uint32_t, uint32_t>, tuple<uint32_t, uint32_t, uint32_t> >
     }
 }
 
-void EngineCUDA::execute(const std::string &source, const jitk::Kernel &kernel,
-                           const vector<const jitk::LoopB*> &threaded_blocks,
-                           const vector<const bh_view*> &offset_strides,
-                           const vector<const bh_instruction*> &constants) {
-    size_t hash = hasher(source);
-    ++stat.kernel_cache_lookups;
-    CUfunction program;
+EngineCUDA::~EngineCUDA() {
+    // Let's write the kernel trace, which the "warmup:<file>" message can pre-compile later
+    if (not kernel_trace.empty()) {
+        vector<string> sources;
+        for (const auto &hash_and_source: _trace) {
+            sources.push_back(hash_and_source.second);
+        }
+        try {
+            jitk::write_kernel_trace(kernel_trace, "CUDA", sources);
+        } catch (const std::exception &e) {
+            cerr << e.what() << endl;
+        }
+    }
+    // The launches, graphs, uploads, page-locks, and cached buffers must be freed before the context
+    submitLaunches();
+    checkCudaErrors(cuCtxSynchronize());
+#ifdef BH_CUDA_GRAPHS
+    for (auto &key_and_graph: _graphs) {
+        Graph &g = key_and_graph.second;
+        if (g.exec != NULL) {
+            cuGraphExecDestroy(g.exec);
+            cuGraphDestroy(g.graph);
+        }
+    }
+#endif
+    while (not _upload_events.empty()) {
+        waitUpload(_upload_events.begin()->first);
+    }
+    while (not _pinned.empty()) {
+        unpin(_pinned.begin()->first);
+    }
+    if (copy_stream != NULL) {
+        cuStreamDestroy(copy_stream);
+    }
+    for (int i = 0; i < 2; ++i) {
+        if (_staging[i] != NULL) {
+            cuMemFreeHost(_staging[i]);
+            cuEventDestroy(_staging_events[i]);
+        }
+    }
+    mirrors.reset();
+    // The arrays that outlive the engine get their host data back in regular memory
+    while (not _managed.empty()) {
+        void *data = _managed.begin()->first;
+        bh_base *base = _managed.begin()->second;
+        _managed.erase(_managed.begin());
+        bh_memory_disown(data);
+        if (base->data == data) {
+            base->data = NULL;
+            bh_data_malloc(base);
+            memcpy(base->data, data, bh_base_size(base));
+        }
+        cuMemFree(reinterpret_cast<CUdeviceptr>(data));
+    }
+    pool.clear();
+    cuCtxDetach(context);
+}
 
+void EngineCUDA::makeManaged(bh_base *base) {
+    const uint64_t nbytes = bh_base_size(base);
+    if (nbytes == 0 or (base->data != NULL and _managed.find(base->data) != _managed.end())) {
+        return;
+    }
+    CUdeviceptr buf;
+    checkCudaErrors(cuMemAllocManaged(&buf, nbytes, CU_MEM_ATTACH_GLOBAL));
+    void *data = reinterpret_cast<void*>(buf);
+    // This is the last copy of the data, from now on the host and the device share it
+    if (base->data != NULL) {
+        memcpy(data, base->data, nbytes);
+        bh_data_free(base);
+    }
+    base->data = data;
+    _managed[data] = base;
+    bh_memory_adopt(data, &EngineCUDA::freeManaged, this);
+    bh_memory_track_alloc(BH_MEMORY_CUDA, data, nbytes);
+}
+
+void EngineCUDA::freeManaged(void *data, void *arg) {
+    EngineCUDA *self = static_cast<EngineCUDA*>(arg);
+    // The pending launches might use the data, which cuMemFree() waits for
+    self->submitLaunches();
+    auto it = self->_managed.find(data);
+    if (it != self->_managed.end()) {
+        self->buffers.erase(it->second);
+        self->_managed.erase(it);
+    }
+    bh_memory_track_free(BH_MEMORY_CUDA, data);
+    checkCudaErrors(cuMemFree(reinterpret_cast<CUdeviceptr>(data)));
+}
+
+void EngineCUDA::prefetch(bh_base *base, bool to_host) {
+#if CUDA_VERSION >= 8000
+    if (base->data != NULL) {
+        checkCudaErrors(cuMemPrefetchAsync(reinterpret_cast<CUdeviceptr>(base->data), bh_base_size(base),
+                                           to_host ? CU_DEVICE_CPU : device, 0));
+    }
+#endif
+}
+
+void EngineCUDA::warmup(const vector<string> &sources) {
     auto tcompile = chrono::steady_clock::now();
+    for (const string &source: sources) {
+        getFunction(source);
+    }
+    stat.time_compile += chrono::steady_clock::now() - tcompile;
+}
+
+CUfunction EngineCUDA::getFunction(const string &source) {
+    size_t hash = hasher(source);
+    CUfunction program;
 
     // Do we have the program already?
     if (_programs.find(hash) != _programs.end()) {
@@ -140,27 +385,58 @@ void EngineCUDA::execute(const std::string &source, const jitk::Kernel &kernel,
         // Or do we have to compile it
         ++stat.kernel_cache_misses;
 
-        // The object file path
-        fs::path objfile = object_dir / jitk::hash_filename(hash, ".cubin");
+        // The cubin path in the persistent cache (empty when disabled)
+        const fs::path cached = cachePath(hash);
 
-        // Write the source file and compile it (reading from disk)
-        // TODO: make nvcc read directly from stdin
-        {
-            fs::path srcfile = jitk::write_source2file(source, source_dir, hash, ".cu", verbose);
-            compiler.compile(objfile.string(), srcfile.string());
-        }
-        /* else {
-            // Pipe the source directly into the compiler thus no source file is written
-            compiler.compile(objfile.string(), source.c_str(), source.size());
-        }
-       */
+        // The relaxed kernels are compiled using "--use_fast_math" (see jitk::util_fast_math())
+        const bool fast_math = source.find("#define BH_FAST_MATH\n") != string::npos;
+        const Compiler &process_compiler = fast_math ? fast_compiler : compiler;
 
         CUmodule module;
-        CUresult err = cuModuleLoad(&module, objfile.string().c_str());
-        if (err != CUDA_SUCCESS) {
-            cout << "Error loading the module " << objfile.string() << " CODE: " << err << endl;
-            cuCtxDetach(context);
-            throw runtime_error("cuModuleLoad() failed");
+        CUresult err;
+        if (compiler_nvrtc and (cached.empty() or not fs::exists(cached))) {
+            // Compile in-process and load the cubin directly from memory
+            const string cubin = ptx2cubin(compiler_nvrtc->compile(source, fast_math));
+            err = cuModuleLoadData(&module, cubin.data());
+            if (err != CUDA_SUCCESS) {
+                cout << "Error loading the module from memory CODE: " << err << endl;
+                cuCtxDetach(context);
+                throw runtime_error("cuModuleLoadData() failed");
+            }
+            if (not cached.empty()) {
+                writeCache(cubin, cached);
+            }
+        } else {
+            // The object file path
+            fs::path objfile = cached.empty() ? object_dir / jitk::hash_filename(hash, ".cubin") : cached;
+
+            if (not fs::exists(objfile)) {
+                // Write the source file and compile it (reading from disk)
+                // TODO: make nvcc read directly from stdin
+                fs::path srcfile = jitk::write_source2file(source, source_dir, hash, ".cu", verbose);
+                if (cached.empty()) {
+                    process_compiler.compile(objfile.string(), srcfile.string());
+                } else {
+                    // We compile into a unique file, which we then rename into place
+                    const fs::path tmpfile = cache_dir / fs::unique_path(objfile.stem().string() + "-%%%%%%%%.tmp");
+                    process_compiler.compile(tmpfile.string(), srcfile.string());
+                    fs::rename(tmpfile, objfile);
+                }
+            } else if (verbose) {
+                cout << "Load cached kernel " << objfile << endl;
+            }
+            /* else {
+                // Pipe the source directly into the compiler thus no source file is written
+                compiler.compile(objfile.string(), source.c_str(), source.size());
+            }
+           */
+
+            err = cuModuleLoad(&module, objfile.string().c_str());
+            if (err != CUDA_SUCCESS) {
+                cout << "Error loading the module " << objfile.string() << " CODE: " << err << endl;
+                cuCtxDetach(context);
+                throw runtime_error("cuModuleLoad() failed");
+            }
         }
 
         err = cuModuleGetFunction(&program, module, "execute");
@@ -171,13 +447,100 @@ void EngineCUDA::execute(const std::string &source, const jitk::Kernel &kernel,
         }
         _programs[hash] = program;
     }
-    stat.time_compile += chrono::steady_clock::now() - tcompile;
+    return program;
+}
+
+fs::path EngineCUDA::cachePath(size_t hash) const {
+    if (cache_dir.empty()) {
+        return fs::path();
+    }
+    size_t key = hash;
+    boost::hash_combine(key, cache_hash);
+    return cache_dir / jitk::hash_filename(key, ".cubin");
+}
+
+string EngineCUDA::ptx2cubin(const string &ptx) {
+    CUlinkState link;
+    checkCudaErrors(cuLinkCreate(0, NULL, NULL, &link));
+    checkCudaErrors(cuLinkAddData(link, CU_JIT_INPUT_PTX, (void *) ptx.c_str(), ptx.size(), "kernel.ptx",
+                                  0, NULL, NULL));
+    void *cubin;
+    size_t cubin_size;
+    checkCudaErrors(cuLinkComplete(link, &cubin, &cubin_size));
+    // NB: the cubin is owned by 'link' thus we copy it before destroying 'link'
+    string ret((const char *) cubin, cubin_size);
+    checkCudaErrors(cuLinkDestroy(link));
+    return ret;
+}
+
+void EngineCUDA::writeCache(const string &cubin, const fs::path &cached) const {
+    // Since rename is atomic, concurrent processes sharing 'cache_dir' will never load a partially written cubin
+    const fs::path tmpfile = cached.parent_path() / fs::unique_path(cached.stem().string() + "-%%%%%%%%.tmp");
+    {
+        ofstream ofs(tmpfile.string(), ios::binary);
+        ofs.write(cubin.data(), cubin.size());
+    }
+    boost::system::error_code ec;
+    fs::rename(tmpfile, cached, ec);
+    if (ec) {
+        fs::remove(tmpfile, ec);
+    }
+}
+
+void EngineCUDA::execute(const std::string &source, const jitk::Kernel &kernel,
+                           const vector<const jitk::LoopB*> &threaded_blocks,
+                           const vector<const bh_view*> &offset_strides,
+                           const vector<int64_t> &loop_sizes,
+                           const vector<const bh_instruction*> &constants) {
+    ++stat.kernel_cache_lookups;
+    if (not kernel_trace.empty()) {
+        _trace.insert(make_pair(hasher(source), source));
+    }
+
+    // The profile and the trace of the kernel
+    const size_t hash = stat.enabled or trace::enabled() ? hasher(source) : 0;
+    if (stat.enabled) {
+        jitk::util_record_source(stat, hash, source, source_dir, ".cu");
+        stat.record_launch(hash, kernel.getTraffic());
+    }
+
+    trace::Scope compile_scope("cuda", "compile");
+    compile_scope.arg("hash", hash);
+    auto tcompile = chrono::steady_clock::now();
+    CUfunction program = getFunction(source);
+    const chrono::duration<double> compile_time = chrono::steady_clock::now() - tcompile;
+    stat.time_compile += compile_time;
+    stat.record_compile(hash, compile_time);
+    compile_scope.end();
+
+    // The kernels run asynchronously thus the trace records the time that the host spends on the launch
+    trace::Scope launch_scope("cuda", "launch");
+    launch_scope.arg("hash", hash);
 
     // Let's execute the CUDA kernel
-    vector<void *> args;
+    // NB: the kernel writes its outputs thus their host data are no longer mirrors
+    copyToDevice(kernel.getNonTemps());
+    if (mirrors) {
+        for (const jitk::InstrPtr &instr: kernel.getAllInstr()) {
+            if (not bh_opcode_is_system(instr->opcode) and not instr->operand.empty()) {
+                mirrors->release(instr->operand[0].base);
+            }
+        }
+    }
+
+    // The kernel waits for the uploads of its arrays in 'copy_stream'
+    for (bh_base *base: kernel.getNonTemps()) {
+        auto it = _upload_events.find(base);
+        if (it != _upload_events.end()) {
+            checkCudaErrors(cuStreamWaitEvent(0, it->second, 0));
+            checkCudaErrors(cuEventDestroy(it->second));
+            _upload_events.erase(it);
+        }
+    }
 
+    vector<void *> args;
     for (bh_base *base: kernel.getNonTemps()) { // NB: the iteration order matters!
-        args.push_back(getBuffer(base));
+        args.push_back(&buffers.at(base));
     }
 
     for (const bh_view *view: offset_strides) {
@@ -187,20 +550,246 @@ void EngineCUDA::execute(const std::string &source, const jitk::Kernel &kernel,
         }
     }
 
+    for (const int64_t &size: loop_sizes) {
+        args.push_back((void*)&size);
+    }
+
     auto texec = chrono::steady_clock::now();
 
 
-    tuple<uint32_t, uint32_t, uint32_t> blocks, threads;
-    tie(blocks, threads) = NDRanges(threaded_blocks);
+    // The tuner picks the thread sizes of the first launches of each kernel
+    jitk::WorkGroupTuner::Local local = configuredLocal(threaded_blocks.size());
+    size_t candidate = jitk::WorkGroupTuner::NOT_TIMED;
+    size_t tuning_key = hasher(source);
+    if (wg_tuner) {
+        boost::hash_combine(tuning_key, cache_hash);
+        int max_threads;
+        checkCudaErrors(cuFuncGetAttribute(&max_threads, CU_FUNC_ATTRIBUTE_MAX_THREADS_PER_BLOCK, program));
+        const jitk::WorkGroupTuner::Local max_local = {{1024, 1024, 64}};
+        candidate = wg_tuner->begin(tuning_key, threaded_blocks.size(), max_threads, max_local, local);
+    }
 
+    tuple<uint32_t, uint32_t, uint32_t> blocks, threads;
+    tie(blocks, threads) = NDRanges(threaded_blocks, local);
+
+    // The timed launches of the tuner, and the profiled launches when the graphs are disabled, are waited for
+    const bool timed = candidate != jitk::WorkGroupTuner::NOT_TIMED or (stat.enabled and graph_min_repeats == 0);
+    CUevent start, end;
+    if (timed) {
+        checkCudaErrors(cuEventCreate(&start, CU_EVENT_DEFAULT));
+        checkCudaErrors(cuEventCreate(&end, CU_EVENT_DEFAULT));
+        checkCudaErrors(cuEventRecord(start, 0));
+    }
+    // The launches wait for the end of the flush when the graphs are enabled (the timed launches can't wait)
+    if (graph_min_repeats > 0 and candidate == jitk::WorkGroupTuner::NOT_TIMED) {
+        Launch launch;
+        launch.function = program;
+        launch.grid[0] = get<0>(blocks); launch.grid[1] = get<1>(blocks); launch.grid[2] = get<2>(blocks);
+        launch.block[0] = get<0>(threads); launch.block[1] = get<1>(threads); launch.block[2] = get<2>(threads);
+        for (void *arg: args) {
+            launch.args.push_back(*static_cast<uint64_t*>(arg));
+        }
+        _launches.push_back(std::move(launch));
+        stat.time_exec += chrono::steady_clock::now() - texec;
+        return;
+    }
+    submitLaunches();
     checkCudaErrors(cuLaunchKernel(program,
                                    get<0>(blocks), get<1>(blocks), get<2>(blocks),  // NxNxN blocks
                                    get<0>(threads), get<1>(threads), get<2>(threads),  // NxNxN threads
                                    0, 0, &args[0], 0));
+    if (timed) {
+        checkCudaErrors(cuEventRecord(end, 0));
+        checkCudaErrors(cuEventSynchronize(end));
+        float ms;
+        checkCudaErrors(cuEventElapsedTime(&ms, start, end));
+        if (candidate != jitk::WorkGroupTuner::NOT_TIMED) {
+            wg_tuner->end(tuning_key, candidate, ms / 1e3);
+        }
+        stat.record_exec(hash, chrono::duration<double>(ms / 1e3));
+        checkCudaErrors(cuEventDestroy(start));
+        checkCudaErrors(cuEventDestroy(end));
+    }
 
     stat.time_exec += chrono::steady_clock::now() - texec;
 }
 
+void EngineCUDA::submitLaunches() {
+    if (_launches.empty()) {
+        return;
+    }
+    // The kernel parameters point to the argument values of each launch
+    vector<vector<void*> > params(_launches.size());
+    for (size_t i = 0; i < _launches.size(); ++i) {
+        for (uint64_t &arg: _launches[i].args) {
+            params[i].push_back(&arg);
+        }
+    }
+#ifdef BH_CUDA_GRAPHS
+    vector<uint64_t> key;
+    for (const Launch &l: _launches) {
+        key.push_back(reinterpret_cast<uint64_t>(l.function));
+        key.insert(key.end(), l.grid, l.grid + 3);
+        key.insert(key.end(), l.block, l.block + 3);
+        key.push_back(l.args.size());
+    }
+    Graph &g = _graphs[key];
+    if (_launches.size() > 1 and ++g.seen >= graph_min_repeats) {
+        for (size_t i = 0; i < _launches.size(); ++i) {
+            const Launch &l = _launches[i];
+            CUDA_KERNEL_NODE_PARAMS node_params;
+            memset(&node_params, 0, sizeof(node_params));
+            node_params.func = l.function;
+            node_params.gridDimX = l.grid[0]; node_params.gridDimY = l.grid[1]; node_params.gridDimZ = l.grid[2];
+            node_params.blockDimX = l.block[0]; node_params.blockDimY = l.block[1]; node_params.blockDimZ = l.block[2];
+            node_params.kernelParams = &params[i][0];
+            if (g.exec == NULL) { // The nodes run one after the other like the launches in a stream
+                if (i == 0) {
+                    checkCudaErrors(cuGraphCreate(&g.graph, 0));
+                }
+                CUgraphNode node;
+                checkCudaErrors(cuGraphAddKernelNode(&node, g.graph, i == 0 ? NULL : &g.nodes.back(), i == 0 ? 0 : 1,
+                                                     &node_params));
+                g.nodes.push_back(node);
+            } else { // The replay uses the buffers and offsets of this sequence
+                checkCudaErrors(cuGraphExecKernelNodeSetParams(g.exec, g.nodes[i], &node_params));
+            }
+        }
+        if (g.exec == NULL) {
+#if CUDA_VERSION >= 11040
+            checkCudaErrors(cuGraphInstantiateWithFlags(&g.exec, g.graph, 0));
+#else
+            checkCudaErrors(cuGraphInstantiate(&g.exec, g.graph, NULL, NULL, 0));
+#endif
+        }
+        checkCudaErrors(cuGraphLaunch(g.exec, 0));
+        _launches.clear();
+        return;
+    }
+#endif
+    for (size_t i = 0; i < _launches.size(); ++i) {
+        const Launch &l = _launches[i];
+        checkCudaErrors(cuLaunchKernel(l.function, l.grid[0], l.grid[1], l.grid[2], l.block[0], l.block[1], l.block[2],
+                                       0, 0, &params[i][0], 0));
+    }
+    _launches.clear();
+}
+
+void EngineCUDA::uploadAsync(bh_base *base, CUdeviceptr buf, bool recycled) {
+    const uint64_t bytes = static_cast<uint64_t>(bh_base_size(base));
+    // NB: the upload of pageable host data is synchronous
+    if (pinned_min_bytes > 0 and bytes >= pinned_min_bytes and _pinned.find(base) == _pinned.end()) {
+        if (cuMemHostRegister(base->data, bytes, 0) == CUDA_SUCCESS) {
+            _pinned[base] = base->data;
+        }
+    }
+    if (recycled) {
+        CUevent in_flight;
+        checkCudaErrors(cuEventCreate(&in_flight, CU_EVENT_DISABLE_TIMING));
+        checkCudaErrors(cuEventRecord(in_flight, 0));
+        checkCudaErrors(cuStreamWaitEvent(copy_stream, in_flight, 0));
+        checkCudaErrors(cuEventDestroy(in_flight));
+    }
+    checkCudaErrors(cuMemcpyHtoDAsync(buf, base->data, bytes, copy_stream));
+    CUevent done;
+    checkCudaErrors(cuEventCreate(&done, CU_EVENT_DISABLE_TIMING));
+    checkCudaErrors(cuEventRecord(done, copy_stream));
+    _upload_events[base] = done;
+}
+
+jitk::StagedIO EngineCUDA::stagedIO() {
+    for (int i = 0; i < 2; ++i) {
+        if (_staging[i] == NULL) {
+            checkCudaErrors(cuMemAllocHost(&_staging[i], storage_chunk_bytes));
+            checkCudaErrors(cuEventCreate(&_staging_events[i], CU_EVENT_DISABLE_TIMING));
+        }
+    }
+    return jitk::StagedIO(storage_chunk_bytes, static_cast<char*>(_staging[0]), static_cast<char*>(_staging[1]));
+}
+
+void EngineCUDA::storeFile(bh_base *base, int fd, uint64_t offset) {
+    trace::Scope scope("cuda", "store_file");
+    const uint64_t nbytes = static_cast<uint64_t>(bh_base_size(base));
+    dropHostWrites();
+    submitLaunches();
+    auto it = buffers.find(base);
+    // The host data is up to date, or it is the unified memory that the device writes
+    if (it == buffers.end() or managed or (mirrors and mirrors->valid(base))) {
+        if (managed and it != buffers.end()) {
+            checkCudaErrors(cuCtxSynchronize());
+        }
+        if (base->data == NULL) {
+            throw runtime_error("VE-CUDA: cannot store an array that has no data");
+        }
+        jitk::write_file(fd, base->data, nbytes, offset);
+        scope.arg("bytes", nbytes);
+        return;
+    }
+    auto tcopy = chrono::steady_clock::now();
+    waitUpload(base);
+    const CUdeviceptr buf = it->second;
+    // The downloads are in the default stream thus they follow the kernels that write the buffer
+    stagedIO().store(fd, offset, nbytes, [&](int slot, uint64_t off, uint64_t size) {
+        checkCudaErrors(cuMemcpyDtoHAsync(_staging[slot], buf + off, size, 0));
+        checkCudaErrors(cuEventRecord(_staging_events[slot], 0));
+    }, [&](int slot) {
+        checkCudaErrors(cuEventSynchronize(_staging_events[slot]));
+    });
+    stat.time_copy2host += chrono::steady_clock::now() - tcopy;
+    scope.arg("bytes", nbytes);
+}
+
+void EngineCUDA::loadFile(bh_base *base, int fd, uint64_t offset) {
+    trace::Scope scope("cuda", "load_file");
+    const uint64_t nbytes = static_cast<uint64_t>(bh_base_size(base));
+    dropHostWrites();
+    submitLaunches();
+    // The unified memory is both the host data and the device buffer
+    if (managed) {
+        checkCudaErrors(cuCtxSynchronize());
+        bh_data_malloc(base);
+        jitk::read_file(fd, base->data, nbytes, offset);
+        scope.arg("bytes", nbytes);
+        return;
+    }
+    auto tcopy = chrono::steady_clock::now();
+    if (base->data != NULL) {
+        waitUpload(base);
+        unpin(base);
+        if (mirrors) {
+            mirrors->release(base);
+        }
+        bh_data_free(base);
+    }
+    // Without host data, copyToDevice() only allocates the buffer
+    vector<bh_base*> vec = {base};
+    copyToDevice(vec);
+    const CUdeviceptr buf = buffers.at(base);
+    // The uploads are in the default stream thus they follow the kernels that read the old data or a recycled buffer
+    stagedIO().load(fd, offset, nbytes, [&](int slot, uint64_t off, uint64_t size) {
+        checkCudaErrors(cuMemcpyHtoDAsync(buf + off, _staging[slot], size, 0));
+        checkCudaErrors(cuEventRecord(_staging_events[slot], 0));
+    }, [&](int slot) {
+        checkCudaErrors(cuEventSynchronize(_staging_events[slot]));
+    });
+    stat.time_copy2dev += chrono::steady_clock::now() - tcopy;
+    scope.arg("bytes", nbytes);
+}
+
+void EngineCUDA::importBuffer(bh_base *base, CUdeviceptr ptr) {
+    if (managed) {
+        throw runtime_error("VE-CUDA: cannot import device memory when 'managed_memory' is enabled");
+    }
+    // The launches might still use the old buffer, which goes to the pool
+    submitLaunches();
+    delBuffer(base);
+    if (base->data != NULL) {
+        bh_data_free(base);
+    }
+    buffers[base] = ptr;
+    _foreign.insert(base);
+}
+
 void EngineCUDA::set_constructor_flag(std::vector<bh_instruction*> &instr_list) {
     jitk::util_set_constructor_flag(instr_list, buffers);
 }
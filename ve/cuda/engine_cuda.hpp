@@ -22,6 +22,7 @@ If not, see <http://www.gnu.org/licenses/>.
 #define __BH_VE_OPENCL_ENGINE_OPENCL_HPP
 
 #include <map>
+#include <set>
 #include <memory>
 #include <vector>
 #include <tuple>
@@ -30,13 +31,24 @@ If not, see <http://www.gnu.org/licenses/>.
 
 #include <bh_config_parser.hpp>
 #include <bh_view.hpp>
+#include <bh_memory.h>
 #include <jitk/statistics.hpp>
 #include <jitk/kernel.hpp>
 #include <jitk/codegen_util.hpp>
+#include <jitk/device_pool.hpp>
+#include <jitk/host_mirrors.hpp>
+#include <jitk/staged_io.hpp>
+#include <jitk/work_group_tuner.hpp>
 
 #include <cuda.h>
 
+// CUDA graphs with updatable kernel nodes
+#if CUDA_VERSION >= 10010
+    #define BH_CUDA_GRAPHS
+#endif
+
 #include "compiler.hpp"
+#include "compiler_nvrtc.hpp"
 
 namespace {
     // This will output the proper CUDA error strings
@@ -64,14 +76,14 @@ private:
     CUdevice   device;
     CUcontext  context;
     // OpenMP work group sizes
-    const uint64_t work_group_size_1dx;
-    const uint64_t work_group_size_2dx;
-    const uint64_t work_group_size_2dy;
-    const uint64_t work_group_size_3dx;
-    const uint64_t work_group_size_3dy;
-    const uint64_t work_group_size_3dz;
+    uint64_t work_group_size_1dx;
+    uint64_t work_group_size_2dx;
+    uint64_t work_group_size_2dy;
+    uint64_t work_group_size_3dx;
+    uint64_t work_group_size_3dy;
+    uint64_t work_group_size_3dz;
     // OpenCL compile flags
-    const std::string compile_flg;
+    std::string compile_flg;
     // Default device type
     const std::string default_device_type;
     // Default platform number
@@ -84,6 +96,80 @@ private:
     const bool verbose;
     // Some statistics
     jitk::Statistics &stat;
+    // The freed buffers, which new arrays reuse
+    jitk::DevicePool<CUdeviceptr> pool;
+    // The total size of the buffers in 'buffers' and the size of the device memory
+    uint64_t _buffer_bytes = 0;
+    uint64_t device_bytes = 0;
+    // The synced arrays that keep their device buffer until the host writes them (NULL when disabled)
+    std::unique_ptr<jitk::HostMirrors> mirrors;
+    // When managed, the host data of the arrays are allocated in unified memory, which the kernels access directly.
+    // The 'buffers' then tracks the arrays prefetched to the device instead of holding copies of them.
+    bool managed = false;
+    // The host data in unified memory mapped to their arrays
+    std::map<void*, bh_base*> _managed;
+    // Moves the host data of 'base' to unified memory, which bh_memory_free() frees through freeManaged()
+    void makeManaged(bh_base *base);
+    static void freeManaged(void *data, void *arg);
+    // Migrate the unified memory of 'base' to the host or the device ahead of its use
+    void prefetch(bh_base *base, bool to_host);
+    // The buffers that another framework owns (see importBuffer()), which never go to the pool
+    std::set<bh_base*> _foreign;
+    // Moves the buffer of 'base' to the pool
+    void releaseBuffer(bh_base *base) {
+        auto it = buffers.find(base);
+        if (_foreign.erase(base) > 0) { // The other framework frees the buffer
+            buffers.erase(it);
+        } else if (it != buffers.end() and managed) { // The buffer is the host data
+            buffers.erase(it);
+        } else if (it != buffers.end()) {
+            const uint64_t size_class = pool.sizeClass(bh_base_size(base));
+            pool.put(size_class, it->second);
+            _buffer_bytes -= size_class;
+            buffers.erase(it);
+            bh_memory_track_free(BH_MEMORY_CUDA, base);
+        }
+    }
+    // The stream of the uploads, which overlap the kernels in the default stream (NULL when disabled)
+    CUstream copy_stream = NULL;
+    // The host data of the uploaded arrays of at least 'pinned_min_bytes' bytes are page-locked, which makes
+    // the uploads asynchronous (zero disables the page-locking)
+    const uint64_t pinned_min_bytes;
+    std::map<bh_base*, void*> _pinned;
+    // The events of the uploads in 'copy_stream' that no kernel has waited for yet
+    std::map<bh_base*, CUevent> _upload_events;
+    // Wait for the upload of 'base' on the host
+    void waitUpload(bh_base *base) {
+        auto it = _upload_events.find(base);
+        if (it != _upload_events.end()) {
+            checkCudaErrors(cuEventSynchronize(it->second));
+            checkCudaErrors(cuEventDestroy(it->second));
+            _upload_events.erase(it);
+        }
+    }
+    // Unlock the host data of 'base'
+    void unpin(bh_base *base) {
+        auto it = _pinned.find(base);
+        if (it != _pinned.end()) {
+            cuMemHostUnregister(it->second);
+            _pinned.erase(it);
+        }
+    }
+    // Drop the device buffers of the mirrors that the host has written
+    void dropHostWrites() {
+        if (mirrors) {
+            for (bh_base *base: mirrors->takeWritten()) {
+                releaseBuffer(base);
+            }
+        }
+    }
+    // The page-locked staging buffers of storeFile() and loadFile() of 'storage_chunk_bytes' bytes each and the
+    // events of their last copies, which are allocated on first use
+    const uint64_t storage_chunk_bytes;
+    void *_staging[2] = {NULL, NULL};
+    CUevent _staging_events[2] = {NULL, NULL};
+    // Returns the file I/O through the staging buffers
+    jitk::StagedIO stagedIO();
     // Record profiling statistics
     const bool prof;
 
@@ -97,29 +183,110 @@ private:
     const boost::filesystem::path object_dir;
 
     // The compiler to use when function doesn't exist
-    const Compiler compiler;
+    Compiler compiler;
+    // The compiler of the kernels that relax the floating-point semantic, which adds "--use_fast_math"
+    Compiler fast_compiler;
+
+    // File to write the trace of executed kernels to at shutdown (empty means disabled)
+    const std::string kernel_trace;
+    std::map<uint64_t, std::string> _trace;
+
+    // The in-process compiler, which replaces 'compiler' when enabled (NULL when disabled)
+    std::unique_ptr<CompilerNVRTC> compiler_nvrtc;
+
+    // The target architecture such as "sm_30"
+    std::string arch;
+
+    // Path to the persistent cache of cubins (empty means disabled)
+    const boost::filesystem::path cache_dir;
 
-    // Returns the block and thread sizes based on the 'threaded_blocks'
+    // Hash of the architecture and compiler, which is part of the persistent cache key
+    size_t cache_hash;
+
+    // Set the architecture, the in-process compiler, and 'cache_hash' from 'compile_flg' and 'compiler'
+    void initCompiler(const ConfigParser &config);
+
+    // Launch sequences seen 'graph_min_repeats' times are replayed as one CUDA graph (zero disables the graphs)
+    const int graph_min_repeats;
+
+    // A kernel launch that waits in '_launches' for the next submission
+    struct Launch {
+        CUfunction function;
+        unsigned int grid[3];
+        unsigned int block[3];
+        // The values of the kernel arguments, which are all 64-bit
+        std::vector<uint64_t> args;
+    };
+    std::vector<Launch> _launches;
+
+    // The graph of a launch sequence, which is instantiated when the sequence has been seen 'graph_min_repeats' times
+    struct Graph {
+        int seen = 0;
+#ifdef BH_CUDA_GRAPHS
+        CUgraph graph = NULL;
+        CUgraphExec exec = NULL;
+        std::vector<CUgraphNode> nodes;
+#endif
+    };
+    // The graphs keyed on the functions and dimensions of the launches
+    std::map<std::vector<uint64_t>, Graph> _graphs;
+
+    // Submit the launches in '_launches' to the default stream, as a CUDA graph when the sequence repeats.
+    // NB: this must happen before anything that the launches are ordered before, e.g. copies and frees.
+    void submitLaunches();
+
+    // Return the CUDA function of 'source', which is compiled if it doesn't exist
+    CUfunction getFunction(const std::string &source);
+
+    // Returns the path of the cubin in the persistent cache (empty when the cache is disabled)
+    boost::filesystem::path cachePath(size_t hash) const;
+
+    // Link 'ptx' into a cubin for the device of the current context
+    std::string ptx2cubin(const std::string &ptx);
+
+    // Write 'cubin' to the persistent cache file 'cached'
+    void writeCache(const std::string &cubin, const boost::filesystem::path &cached) const;
+
+    // Returns the configured thread sizes of kernels with 'ndim' threaded dimensions
+    jitk::WorkGroupTuner::Local configuredLocal(size_t ndim) const;
+
+    // Returns the block and thread sizes based on the 'threaded_blocks' and the thread sizes 'local'
     std::pair<std::tuple<uint32_t, uint32_t, uint32_t>, std::tuple<uint32_t, uint32_t, uint32_t> >
-        NDRanges(const std::vector<const jitk::LoopB*> &threaded_blocks) const;
+        NDRanges(const std::vector<const jitk::LoopB*> &threaded_blocks, const jitk::WorkGroupTuner::Local &local) const;
+
+    // The tuner of the thread sizes (NULL when disabled)
+    std::unique_ptr<jitk::WorkGroupTuner> wg_tuner;
+
+    // Upload the host data of 'base' to 'buf' in 'copy_stream'. A 'recycled' buffer might still be in use by the
+    // kernels in flight thus the upload waits for them.
+    void uploadAsync(bh_base *base, CUdeviceptr buf, bool recycled);
 
 public:
     EngineCUDA(const ConfigParser &config, jitk::Statistics &stat);
-    ~EngineCUDA() {
-        cuCtxDetach(context);
-    }
+    ~EngineCUDA();
 
     // Execute the 'source'
     void execute(const std::string &source, const jitk::Kernel &kernel,
                  const std::vector<const jitk::LoopB*> &threaded_blocks,
                  const std::vector<const bh_view*> &offset_strides,
+                 const std::vector<int64_t> &loop_sizes,
                  const std::vector<const bh_instruction*> &constants);
 
-    // Delete a buffer
+    // Delete a buffer, which goes to the pool
     template <typename T>
     void delBuffer(T &base) {
-        checkCudaErrors(cuMemFree(buffers[base]));
-        buffers.erase(base);
+        // The caller might free the host data next, which the upload might still be reading
+        waitUpload(base);
+        unpin(base);
+        if (mirrors) {
+            mirrors->release(base);
+        }
+        releaseBuffer(base);
+    }
+
+    // Whether 'base' has a buffer on the device
+    bool onDevice(bh_base *base) const {
+        return buffers.find(base) != buffers.end();
     }
 
     // Retrieve a single buffer
@@ -129,59 +296,201 @@ public:
             std::vector<T> vec = {base};
             copyToDevice(vec);
         }
+        // The caller doesn't know about 'copy_stream' or the pending launches thus they must be submitted
+        submitLaunches();
+        waitUpload(base);
+        // The caller might write the buffer thus the host data is no longer a mirror
+        if (mirrors) {
+            mirrors->release(base);
+        }
         return &buffers[base];
     }
 
-    // Copy 'bases' to the host (ignoring bases that isn't on the device)
+    // The host is about to write 'bases' thus their host data are no longer mirrors
+    template <typename T>
+    void hostWrites(T &bases) {
+        if (mirrors) {
+            for (bh_base *base: bases) {
+                mirrors->release(base);
+            }
+        }
+    }
+
+    // Wait for the kernels in flight to finish
+    void waitKernels() {
+        submitLaunches();
+        checkCudaErrors(cuCtxSynchronize());
+    }
+
+    // Returns the device buffer of 'base' for another framework (e.g. through DLPack) once the kernels in flight are
+    // done. The other framework might write the buffer, which stays valid until the next flush frees or writes it.
+    CUdeviceptr exportBuffer(bh_base *base) {
+        const CUdeviceptr ret = *getBuffer(base);
+        waitKernels();
+        return ret;
+    }
+
+    // Use the device memory 'ptr' of another framework as the buffer of 'base' without copying it. The other
+    // framework must have finished writing the memory and must keep it alive while 'base' uses it.
+    // The host data is freed since it is stale afterwards.
+    void importBuffer(bh_base *base, CUdeviceptr ptr);
+
+    // Write the data of 'base' to 'fd' at 'offset'. The data on the device goes through the staging buffers, which
+    // overlaps the downloads and the writes and keeps the device buffer valid.
+    void storeFile(bh_base *base, int fd, uint64_t offset);
+
+    // Read the data of 'base' from 'fd' at 'offset' into its device buffer through the staging buffers, which
+    // overlaps the reads and the uploads. The host data is freed since it is stale afterwards.
+    void loadFile(bh_base *base, int fd, uint64_t offset);
+
+    // Copy the 'nbytes' bytes at 'offset' of the host data of 'base' to its existing device buffer
+    void copyRangeToDevice(bh_base *base, uint64_t offset, uint64_t nbytes) {
+        if (managed) { // The device buffer is the host data
+            return;
+        }
+        auto tcopy = std::chrono::steady_clock::now();
+        checkCudaErrors(cuMemcpyHtoD(buffers.at(base) + offset, static_cast<char*>(base->data) + offset, nbytes));
+        stat.time_copy2dev += std::chrono::steady_clock::now() - tcopy;
+    }
+
+    // Copy 'bases' to the host (ignoring bases that isn't on the device). The device buffers stay valid until
+    // the host writes the data unless 'keep_device' is false or the mirrors are disabled.
     template <typename T>
-    void copyToHost(T &bases) {
+    void copyToHost(T &bases, bool keep_device = true) {
+        trace::Scope scope("cuda", "copy2host");
+        uint64_t nbytes = 0;
         auto tcopy = std::chrono::steady_clock::now();
+        dropHostWrites();
+        submitLaunches();
+        // The host data is the device buffer thus we only migrate it back to the host
+        if (managed) {
+            std::vector<bh_base*> prefetched;
+            for(bh_base *base: bases) {
+                if (buffers.find(base) != buffers.end()) {
+                    prefetch(base, true);
+                    prefetched.push_back(base);
+                    nbytes += bh_base_size(base);
+                }
+            }
+            if (not prefetched.empty()) {
+                checkCudaErrors(cuCtxSynchronize());
+            }
+            for (bh_base *base: prefetched) {
+                releaseBuffer(base);
+            }
+            stat.time_copy2host += std::chrono::steady_clock::now() - tcopy;
+            scope.arg("bytes", nbytes);
+            return;
+        }
         // Let's copy sync'ed arrays back to the host
         for(bh_base *base: bases) {
             if (buffers.find(base) != buffers.end()) {
+                if (mirrors and mirrors->valid(base)) { // The host already has the data
+                    if (not keep_device) {
+                        delBuffer(base);
+                    }
+                    continue;
+                }
                 bh_data_malloc(base);
                 if (verbose) {
                     std::cout << "Copy to host: " << *base << std::endl;
                 }
+                waitUpload(base);
                 checkCudaErrors(cuMemcpyDtoH(base->data, buffers.at(base), bh_base_size(base)));
-                // When syncing we assume that the host writes to the data and invalidate the device data thus
-                // we have to remove its data buffer
-                delBuffer(base);
+                nbytes += bh_base_size(base);
+                if (mirrors and keep_device) {
+                    mirrors->protect(base);
+                    if (mirrors->valid(base)) {
+                        continue;
+                    }
+                }
+                // Without the mirrors, we assume that the host writes to the data and invalidate the device data
+                // thus we have to remove its data buffer
+                releaseBuffer(base);
             }
         }
         stat.time_copy2host += std::chrono::steady_clock::now() - tcopy;
+        scope.arg("bytes", nbytes);
     }
 
     // Copy 'base_list' to the device (ignoring bases that is already on the device)
     template <typename T>
     void copyToDevice(T &base_list) {
-
-        // Let's update the maximum memory usage on the device
-        if (prof) {
-            uint64_t sum = 0;
-            for (const auto &b: buffers) {
-                sum += bh_base_size(b.first);
-            }
-            stat.max_memory_usage = sum > stat.max_memory_usage?sum:stat.max_memory_usage;
-        }
-
+        trace::Scope scope("cuda", "copy2dev");
+        uint64_t nbytes = 0;
         auto tcopy = std::chrono::steady_clock::now();
+        dropHostWrites();
         for(bh_base *base: base_list) {
-            if (buffers.find(base) == buffers.end()) { // We shouldn't overwrite existing buffers
+            if (managed and buffers.find(base) == buffers.end()) {
+                makeManaged(base);
+                prefetch(base, false);
+                buffers[base] = reinterpret_cast<CUdeviceptr>(base->data);
+            } else if (buffers.find(base) == buffers.end()) { // We shouldn't overwrite existing buffers
+                const uint64_t size_class = pool.sizeClass(bh_base_size(base));
                 CUdeviceptr new_buf;
-                checkCudaErrors(cuMemAlloc(&new_buf, bh_base_size(base)));
+                const bool recycled = pool.get(size_class, new_buf);
+                if (not recycled) {
+                    CUresult err = cuMemAlloc(&new_buf, size_class);
+                    // Under memory pressure, we give the cached buffers back to the device and try again
+                    if (err == CUDA_ERROR_OUT_OF_MEMORY and pool.cachedBytes() > 0) {
+                        submitLaunches();
+                        pool.clear();
+                        err = cuMemAlloc(&new_buf, size_class);
+                    }
+                    checkCudaErrors(err);
+                }
+                _buffer_bytes += size_class;
                 buffers[base] = new_buf;
+                bh_memory_track_alloc(BH_MEMORY_CUDA, base, size_class);
 
                 // If the host data is non-null we should copy it to the device
                 if (base->data != NULL) {
                     if (verbose) {
                         std::cout << "Copy to device: " << *base << std::endl;
                     }
-                    checkCudaErrors(cuMemcpyHtoD(new_buf, base->data, bh_base_size(base)));
+                    // A recycled buffer might be in use by the pending launches
+                    if (recycled) {
+                        submitLaunches();
+                    }
+                    if (copy_stream != NULL) {
+                        uploadAsync(base, new_buf, recycled);
+                    } else {
+                        checkCudaErrors(cuMemcpyHtoD(new_buf, base->data, bh_base_size(base)));
+                    }
+                    nbytes += bh_base_size(base);
                 }
             }
         }
         stat.time_copy2dev += std::chrono::steady_clock::now() - tcopy;
+        scope.arg("bytes", nbytes);
+
+        // Let's update the maximum memory usage on the device, which includes the pool
+        const uint64_t sum = _buffer_bytes + pool.cachedBytes();
+        stat.max_memory_usage = sum > stat.max_memory_usage?sum:stat.max_memory_usage;
+    }
+
+    // Start the uploads of the arrays in 'base_list' that the next kernels access while the buffers stay below half
+    // of the device memory, which leaves room for the arrays the kernels create. Only the asynchronous uploads
+    // overlap the kernels thus nothing is prefetched without 'copy_stream' (or unified memory).
+    template <typename T>
+    void prefetchToDevice(T &base_list) {
+        if (copy_stream == NULL and not managed) {
+            return;
+        }
+        uint64_t bytes = _buffer_bytes + pool.cachedBytes();
+        std::vector<bh_base*> vec;
+        for (bh_base *base: base_list) {
+            if (base->data == NULL or onDevice(base)) {
+                continue;
+            }
+            const uint64_t size_class = pool.sizeClass(bh_base_size(base));
+            if (bytes + size_class > device_bytes / 2) {
+                break;
+            }
+            bytes += size_class;
+            vec.push_back(base);
+        }
+        copyToDevice(vec);
     }
 
     // Copy all bases to the host (ignoring bases that isn't on the device)
@@ -190,11 +499,29 @@ public:
         for(auto &buf_pair: buffers) {
             bases_on_device.push_back(buf_pair.first);
         }
-        copyToHost(bases_on_device);
+        copyToHost(bases_on_device, false);
     }
 
     // Sets the constructor flag of each instruction in 'instr_list'
     void set_constructor_flag(std::vector<bh_instruction*> &instr_list);
+    // Batch compilation isn't supported thus the kernels are compiled on demand by execute()
+    void compileAll(const std::vector<std::string> &sources) {}
+    // The kernels are executed in order on a single stream thus concurrent kernels run one after the other
+    void beginConcurrent() {}
+    void endConcurrent() {}
+    // The kernels are never tiled across the iterations of a BH_REPEAT body (no temporal blocking)
+    int64_t timeBlockIterations() const { return 0; }
+    void beginTimeBlock() {}
+    void endTimeBlock() {}
+    // The launches of a flush are submitted together, which makes repeated flushes a single graph launch
+    void endFlush() {
+        submitLaunches();
+    }
+    // Compile the kernels of 'sources' ahead of time, e.g. from a kernel trace
+    void warmup(const std::vector<std::string> &sources);
+
+    // Re-read the work group sizes and the compiler options of 'config' and drop the kernels built with the old ones
+    void reconfigure(const ConfigParser &config);
 };
 
 } // bohrium
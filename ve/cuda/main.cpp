@@ -29,6 +29,7 @@ If not, see <http://www.gnu.org/licenses/>.
 #include <bh_util.hpp>
 #include <bh_opcode.h>
 #include <jitk/statistics.hpp>
+#include <jitk/stat_exporter.hpp>
 #include <jitk/kernel.hpp>
 #include <jitk/block.hpp>
 #include <jitk/instruction.hpp>
@@ -39,6 +40,7 @@ If not, see <http://www.gnu.org/licenses/>.
 #include <jitk/codegen_util.hpp>
 #include <jitk/dtype.hpp>
 #include <jitk/apply_fusion.hpp>
+#include <jitk/context_scheduler.hpp>
 
 #include "engine_cuda.hpp"
 
@@ -50,20 +52,53 @@ using namespace std;
 namespace {
 class Impl : public ComponentImplWithChild {
   private:
-    // Some statistics
+    // Some statistics and their periodic export (NULL when disabled)
     Statistics stat;
+    unique_ptr<StatExporter> exporter;
     // Fuse cache
     FuseCache fcache;
+    // Code generation cache
+    CodegenCache ccache;
+    // Replay cache
+    ReplayCache rcache;
     // Known extension methods
     map<bh_opcode, extmethod::ExtmethodFace> extmethods;
     set<bh_opcode> child_extmethods;
-    // The CUDA engine
-    EngineCUDA engine;
+    // The CUDA engine, which sets up the device on first use (see engine())
+    unique_ptr<EngineCUDA> _engine;
+    // The placement of the extension methods that both I and my child know
+    ExtmethodPlacement placement;
+    // The splitting of large kernels between the device and the CPU (NULL when disabled)
+    unique_ptr<CoExecution> coexec;
+    // The dispatching of the kernels to the device or the CPU (NULL when disabled)
+    unique_ptr<KernelDispatch> dispatch;
+    // The turns of this context at the device, which has 'streams' units and a kernel holds 'stream_quota' of them
+    ContextScheduler::Context context;
 public:
-    Impl(int stack_level) : ComponentImplWithChild(stack_level), stat(config.defaultGet("prof", false)),
-                            fcache(stat), engine(config, stat) {}
+    Impl(int stack_level) : ComponentImplWithChild(stack_level),
+                            stat(config.defaultGet("prof", false) or StatExporter::enabled(config),
+                                 config.defaultGet("prof", false)),
+                            exporter(StatExporter::create(config, "cuda")),
+                            fcache(config, stat), ccache(stat), rcache(config, stat),
+                            placement(config),
+                            context("cuda", config.defaultGet<uint64_t>("streams", 1), config, "stream_quota") {
+        configureScheduling();
+    }
     ~Impl();
+    // Create the co-execution and the dispatching of the kernels from the config
+    void configureScheduling() {
+        coexec.reset(config.defaultGet<bool>("co_execution", false) ? new CoExecution(config) : nullptr);
+        dispatch.reset(config.defaultGet<bool>("dispatch", false) ? new KernelDispatch(config) : nullptr);
+    }
     void execute(bh_ir *bhir);
+    // Returns the CUDA engine, which is created by the first flush that computes anything, thus programs that
+    // never compute don't pay for the device setup
+    EngineCUDA &engine() {
+        if (not _engine) {
+            _engine.reset(new EngineCUDA(config, stat));
+        }
+        return *_engine;
+    }
     void extmethod(const string &name, bh_opcode opcode) {
         // ExtmethodFace does not have a default or copy constructor thus
         // we have to use its move constructor.
@@ -73,7 +108,13 @@ public:
             // I don't know this function, lets try my child
             child.extmethod(name, opcode);
             child_extmethods.insert(opcode);
+            return;
         }
+        // My child might also know the function, which then executes the instructions that I shouldn't
+        try {
+            child.extmethod(name, opcode);
+            child_extmethods.insert(opcode);
+        } catch(const extmethod::ExtmethodNotFound &e) {}
     }
 
     // Write an CUDA kernel
@@ -83,7 +124,7 @@ public:
 
     // Implement the handle of extension methods
     void handle_extmethod(bh_ir *bhir) {
-        util_handle_extmethod(this, bhir, extmethods, child_extmethods, child, &engine);
+        util_handle_extmethod(this, bhir, extmethods, child_extmethods, child, &engine(), &placement);
     }
 
     // Returns the blocks that can be parallelized in 'kernel' (incl. sub-blocks)
@@ -91,6 +132,7 @@ public:
         vector<const LoopB*> threaded_blocks;
         uint64_t total_threading;
         tie(threaded_blocks, total_threading) = util_find_threaded_blocks(kernel.block);
+        unthread_unrolled_loop(threaded_blocks, config);
         if (total_threading < config.defaultGet<uint64_t>("parallel_threshold", 1000)) {
             for (const InstrPtr instr: kernel.getAllInstr()) {
                 if (not bh_opcode_is_system(instr->opcode)) {
@@ -104,15 +146,38 @@ public:
     // Handle messages from parent
     string message(const string &msg) {
         stringstream ss;
+        // The report covers every device, which is why the child doesn't add its own
+        if (msg == "memory") {
+            return util_memory_report();
+        }
         if (msg == "statistic_enable_and_reset") {
             stat = Statistics(true, config.defaultGet("prof", false));
         } else if (msg == "statistic") {
             stat.write("CUDA", "", ss);
         } else if (msg == "GPU: disable") {
-            engine.allBasesToHost();
+            if (_engine) {
+                _engine->allBasesToHost();
+            }
             disabled = true;
         } else if (msg == "GPU: enable") {
             disabled = false;
+        } else if (msg.compare(0, 7, "warmup:") == 0) {
+            const vector<string> sources = read_kernel_trace(msg.substr(7), "CUDA");
+            engine().warmup(sources);
+            ss << "[CUDA] warmup: " << sources.size() << " kernels\n";
+        } else if (util_fast_math_message(config, msg)) {
+            // The codegen cache keeps the two variants apart but the replays have the sources of the old one
+            rcache.clear();
+        } else if (msg.compare(0, 7, "config:") == 0) {
+            // The option is set by ComponentFace thus we drop everything that depends on the old value
+            fcache.clear();
+            ccache.clear();
+            rcache.clear();
+            if (_engine) {
+                _engine->reconfigure(config);
+            }
+            configureScheduling();
+            context.reconfigure(config);
         }
         return ss.str() + child.message(msg);
     }
@@ -127,6 +192,9 @@ extern "C" void destroy(ComponentImpl* self) {
 }
 
 Impl::~Impl() {
+    if (exporter) {
+        exporter->render(stat);
+    }
     if (stat.print_on_exit) {
         stat.write("CUDA", config.defaultGet<std::string>("prof_filename", ""), cout);
     }
@@ -147,7 +215,9 @@ void loop_head_writer(const SymbolTable &symbols, Scope &scope, const LoopB &blo
             out << " = 1; ";
         else
             out << " = 0; ";
-        out << itername << " < " << block.size << "; ++" << itername << ") {\n";
+        out << itername << " < ";
+        write_loop_size(symbols, block, out);
+        out << "; ++" << itername << ") {\n";
     } else {
         assert(block._sweeps.size() == 0);
         out << "{ // Threaded block (ID " << itername << ")\n";
@@ -171,16 +241,40 @@ void Impl::write_kernel(const Kernel &kernel, const SymbolTable &symbols, const
                         const vector<const LoopB *> &threaded_blocks,
                         const vector<const bh_view*> &offset_strides, stringstream &ss) {
 
+    // The engine compiles the relaxed kernels using "--use_fast_math"
+    if (util_fast_math(config)) {
+        ss << "#define BH_FAST_MATH\n";
+    }
+
     // Write the need includes
     ss << "#include <kernel_dependencies/complex_cuda.h>\n";
     ss << "#include <kernel_dependencies/integer_operations.h>\n";
+    if (kernel.useFloat16()) {
+        ss << "#include <cuda_fp16.h>\n";
+    }
+    if (kernel.useBFloat16()) {
+        ss << "#include <cuda_bf16.h>\n";
+    }
     if (kernel.useRandom()) { // Write the random function
         ss << "#include <kernel_dependencies/random123_cuda.h>\n";
     }
     ss << "\n";
 
+    // Let's find the shifted views to stage through shared memory, which bounds the number of threads per block
+    const uint64_t group_size = config.defaultGet<uint64_t>("work_group_size_1dx", 128);
+    vector<LocalTile> tiles;
+    if (config.defaultGet<bool>("local_tiles", false)) {
+        tiles = find_local_tiles(kernel, symbols, threaded_blocks, group_size,
+                                 config.defaultGet<int64_t>("local_tiles_max_halo", 16),
+                                 config.defaultGet<uint64_t>("local_tiles_max_bytes", 16384));
+    }
+
     // Write the header of the execute function
-    ss << "extern \"C\" __global__ void execute";
+    ss << "extern \"C\" __global__ void ";
+    if (not tiles.empty()) {
+        ss << "__launch_bounds__(" << group_size << ") ";
+    }
+    ss << "execute";
     write_kernel_function_arguments(kernel, symbols, offset_strides, write_cuda_type, ss, NULL, false);
     ss << "{\n";
 
@@ -191,28 +285,52 @@ void Impl::write_kernel(const Kernel &kernel, const SymbolTable &symbols, const
         for (unsigned int i=0; i < threaded_blocks.size(); ++i) {
             const LoopB *b = threaded_blocks[i];
             spaces(ss, 4);
-            ss << "const " << write_cuda_type(bh_type::INT64) << " i" << b->rank << " = " << write_thread_id(i) << "; " \
-               << "if (i" << b->rank << " >= " << b->size << ") { return; } // Prevent overflow\n";
+            ss << "const " << write_cuda_type(bh_type::INT64) << " i" << b->rank << " = " << write_thread_id(i) << "; ";
+            if (not tiles.empty()) { // The overflow check goes after the loads of the tiles
+                ss << "\n";
+                continue;
+            }
+            ss << "if (i" << b->rank << " >= ";
+            write_loop_size(symbols, *b, ss);
+            ss << ") { return; } // Prevent overflow\n";
         }
         ss << "\n";
     }
 
+    // Write the loads of the tiles, which the scope of the body reads the tiled views from
+    Scope tile_scope(symbols, NULL, set<bh_base*>(), vector<const bh_view*>(), vector<const bh_view*>(), config);
+    if (not tiles.empty()) {
+        const LoopB &b = *threaded_blocks[0];
+        write_local_tiles(symbols, tiles, b, group_size, write_cuda_type, "__shared__", "threadIdx.x", "blockDim.x",
+                          "__syncthreads()", tile_scope, ss);
+        spaces(ss, 4);
+        ss << "if (i" << b.rank << " >= ";
+        write_loop_size(symbols, b, ss);
+        ss << ") { return; } // Prevent overflow\n\n";
+    }
+
     // Write the block that makes up the body of 'execute()'
-    write_loop_block(symbols, NULL, kernel.block, config, threaded_blocks, true, write_cuda_type, loop_head_writer, ss);
+    write_loop_block(symbols, tiles.empty() ? NULL : &tile_scope, kernel.block, config, threaded_blocks, true,
+                     write_cuda_type, loop_head_writer, ss);
 
     ss << "}\n\n";
 }
 
 
 void Impl::execute(bh_ir *bhir) {
-    if (disabled) {
+    // Until a flush computes anything, no array is on the device thus the child handles the frees and syncs
+    if (disabled or (not _engine and util_is_system_only(bhir->instr_list))) {
         child.execute(bhir);
         return;
     }
 
     // Let's handle extension methods
-    util_handle_extmethod(this, bhir, extmethods, child_extmethods, child, &engine);
+    util_handle_extmethod(this, bhir, extmethods, child_extmethods, child, &engine(), &placement);
 
     // And then the regular instructions
-    handle_execution(*this, bhir, engine, config, stat, fcache, &child);
+    handle_execution(*this, bhir, engine(), config, stat, fcache, ccache, rcache, &child, coexec.get(), dispatch.get(),
+                     &context);
+    if (exporter) {
+        exporter->update(stat);
+    }
 }
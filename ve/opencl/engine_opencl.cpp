@@ -19,7 +19,11 @@ If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include <vector>
+#include <algorithm>
+#include <limits>
 #include <iostream>
+#include <fstream>
+#include <iterator>
 #include <boost/functional/hash.hpp>
 #include <boost/filesystem.hpp>
 
@@ -79,6 +83,17 @@ cl::Device getDevice(const cl::Platform &platform, const string &default_device_
 
     throw runtime_error("No OpenCL device of usable type found");
 }
+
+// Returns the number of elements that each work-item of the kernel 'source' processes unless 'BH_VECTOR_WIDTH' is
+// defined at build time, or zero when the work-items don't process vectors (see jitk::opencl_vector_width())
+uint32_t source_vector_width(const string &source) {
+    const string define = "#define BH_VECTOR_WIDTH ";
+    const size_t pos = source.find(define);
+    if (pos == string::npos) {
+        return 0;
+    }
+    return static_cast<uint32_t>(strtoul(source.c_str() + pos + define.size(), NULL, 10));
+}
 }
 
 namespace bohrium {
@@ -86,6 +101,7 @@ namespace bohrium {
 static boost::hash<string> hasher;
 
 EngineOpenCL::EngineOpenCL(const ConfigParser &config, jitk::Statistics &stat) :
+                                    overlap_copies(config.defaultGet<bool>("overlap_copies", true)),
                                     work_group_size_1dx(config.defaultGet<int>("work_group_size_1dx", 128)),
                                     work_group_size_2dx(config.defaultGet<int>("work_group_size_2dx", 32)),
                                     work_group_size_2dy(config.defaultGet<int>("work_group_size_2dy", 4)),
@@ -97,8 +113,14 @@ EngineOpenCL::EngineOpenCL(const ConfigParser &config, jitk::Statistics &stat) :
                                     platform_no(config.defaultGet<int>("platform_no", -1)),
                                     verbose(config.defaultGet<bool>("verbose", false)),
                                     stat(stat),
+                                    pool(config.defaultGet<uint64_t>("device_pool_max_bytes", 268435456),
+                                         [](cl::Buffer &) {}, stat),
+                                    storage_chunk_bytes(std::max<uint64_t>(1, config.defaultGet<uint64_t>(
+                                            "storage_chunk_bytes", 8388608))),
                                     prof(config.defaultGet<bool>("prof", false)),
-                                    source_dir(fs::temp_directory_path() / fs::unique_path("bohrium_%%%%") / "src")
+                                    source_dir(fs::temp_directory_path() / fs::unique_path("bohrium_%%%%") / "src"),
+                                    kernel_trace(config.defaultGet<string>("kernel_trace", "")),
+                                    cache_dir(jitk::expand_user(config.defaultGet<string>("cache_dir", "")))
 {
     vector<cl::Platform> platforms;
     cl::Platform::get(&platforms);
@@ -146,30 +168,108 @@ EngineOpenCL::EngineOpenCL(const ConfigParser &config, jitk::Statistics &stat) :
              << " ("<< device.getInfo<CL_DEVICE_OPENCL_C_VERSION>() << ")" << endl;
     }
 
-    context = cl::Context(device);
-    queue = cl::CommandQueue(context, device);
+    // The multi-device mode adds the other devices of the same type on the platform ('devices' <= 0 means all)
+    const int num_devices = config.defaultGet<int>("devices", 1);
+    devices.push_back(device);
+    if (num_devices != 1) {
+        vector<cl::Device> others;
+        platform.getDevices(device.getInfo<CL_DEVICE_TYPE>() & ~CL_DEVICE_TYPE_DEFAULT, &others);
+        for (const cl::Device &other: others) {
+            if ((num_devices <= 0 or devices.size() < (size_t) num_devices) and other() != device()) {
+                devices.push_back(other);
+                homogeneous = homogeneous and other.getInfo<CL_DEVICE_NAME>() == device.getInfo<CL_DEVICE_NAME>() and
+                              other.getInfo<CL_DRIVER_VERSION>() == device.getInfo<CL_DRIVER_VERSION>();
+                if (verbose) {
+                    cout << "Using device: " << other.getInfo<CL_DEVICE_NAME>() << endl;
+                }
+            }
+        }
+    }
+
+    context = cl::Context(devices);
+    device_bytes = device.getInfo<CL_DEVICE_GLOBAL_MEM_SIZE>();
+    if (config.defaultGet<bool>("autotune_work_groups", false)) {
+        wg_tuner.reset(new jitk::WorkGroupTuner(config.defaultGet<int>("autotune_runs", 2),
+                                                cache_dir.empty() ? fs::path() : cache_dir / "opencl_work_groups.txt"));
+    }
+    // The kernel events tell the device time of the kernels, which runs asynchronously
+    const cl_command_queue_properties properties = (prof or wg_tuner) ? CL_QUEUE_PROFILING_ENABLE : 0;
+    queue = cl::CommandQueue(context, device, properties);
+    queues.push_back(queue);
+    for (size_t i = 1; i < devices.size(); ++i) {
+        queues.push_back(cl::CommandQueue(context, devices[i], properties));
+    }
+    if (overlap_copies) {
+        copy_queue = cl::CommandQueue(context, device);
+    }
+
+    if (config.defaultGet<bool>("host_mirrors", true)) {
+        mirrors.reset(new jitk::HostMirrors());
+    }
 
     // Let's make sure that the directories exist
     fs::create_directories(source_dir);
+    if (not cache_dir.empty()) {
+        fs::create_directories(cache_dir);
+    }
+
+    // A program binary is only valid for the device and driver that build it using the same flags
+    cache_hash = hasher(device.getInfo<CL_DEVICE_NAME>());
+    boost::hash_combine(cache_hash, device.getInfo<CL_DRIVER_VERSION>());
+    boost::hash_combine(cache_hash, compile_flg);
+}
+
+void EngineOpenCL::reconfigure(const ConfigParser &config) {
+    finish();
+    _kernels.clear();
+    _programs.clear();
+    work_group_size_1dx = config.defaultGet<int>("work_group_size_1dx", 128);
+    work_group_size_2dx = config.defaultGet<int>("work_group_size_2dx", 32);
+    work_group_size_2dy = config.defaultGet<int>("work_group_size_2dy", 4);
+    work_group_size_3dx = config.defaultGet<int>("work_group_size_3dx", 32);
+    work_group_size_3dy = config.defaultGet<int>("work_group_size_3dy", 2);
+    work_group_size_3dz = config.defaultGet<int>("work_group_size_3dz", 2);
+    compile_flg = config.defaultGet<string>("compiler_flg", "");
+    cache_hash = hasher(device.getInfo<CL_DEVICE_NAME>());
+    boost::hash_combine(cache_hash, device.getInfo<CL_DRIVER_VERSION>());
+    boost::hash_combine(cache_hash, compile_flg);
+    if (verbose) {
+        cout << "[OpenCL] reconfigured: " << compile_flg << endl;
+    }
 }
 
-pair<cl::NDRange, cl::NDRange> EngineOpenCL::NDRanges(const vector<const jitk::LoopB*> &threaded_blocks) const {
+jitk::WorkGroupTuner::Local EngineOpenCL::configuredLocal(size_t ndim) const {
+    switch (ndim) {
+        case 1:
+            return {{static_cast<uint32_t>(work_group_size_1dx), 1, 1}};
+        case 2:
+            return {{static_cast<uint32_t>(work_group_size_2dx), static_cast<uint32_t>(work_group_size_2dy), 1}};
+        default:
+            return {{static_cast<uint32_t>(work_group_size_3dx), static_cast<uint32_t>(work_group_size_3dy),
+                     static_cast<uint32_t>(work_group_size_3dz)}};
+    }
+}
+
+pair<cl::NDRange, cl::NDRange> EngineOpenCL::NDRanges(const vector<const jitk::LoopB*> &threaded_blocks,
+                                                       const jitk::WorkGroupTuner::Local &local,
+                                                       uint32_t vector_width) const {
     const auto &b = threaded_blocks;
     switch (b.size()) {
         case 1: {
-            const auto gsize_and_lsize = jitk::work_ranges(work_group_size_1dx, b[0]->size);
+            const int64_t work_items = vector_width > 1 ? (b[0]->size + vector_width - 1) / vector_width : b[0]->size;
+            const auto gsize_and_lsize = jitk::work_ranges(local[0], work_items);
             return make_pair(cl::NDRange(gsize_and_lsize.first), cl::NDRange(gsize_and_lsize.second));
         }
         case 2: {
-            const auto gsize_and_lsize_x = jitk::work_ranges(work_group_size_2dx, b[0]->size);
-            const auto gsize_and_lsize_y = jitk::work_ranges(work_group_size_2dy, b[1]->size);
+            const auto gsize_and_lsize_x = jitk::work_ranges(local[0], b[0]->size);
+            const auto gsize_and_lsize_y = jitk::work_ranges(local[1], b[1]->size);
             return make_pair(cl::NDRange(gsize_and_lsize_x.first, gsize_and_lsize_y.first),
                              cl::NDRange(gsize_and_lsize_x.second, gsize_and_lsize_y.second));
         }
         case 3: {
-            const auto gsize_and_lsize_x = jitk::work_ranges(work_group_size_3dx, b[0]->size);
-            const auto gsize_and_lsize_y = jitk::work_ranges(work_group_size_3dy, b[1]->size);
-            const auto gsize_and_lsize_z = jitk::work_ranges(work_group_size_3dz, b[2]->size);
+            const auto gsize_and_lsize_x = jitk::work_ranges(local[0], b[0]->size);
+            const auto gsize_and_lsize_y = jitk::work_ranges(local[1], b[1]->size);
+            const auto gsize_and_lsize_z = jitk::work_ranges(local[2], b[2]->size);
             return make_pair(cl::NDRange(gsize_and_lsize_x.first, gsize_and_lsize_y.first, gsize_and_lsize_z.first),
                              cl::NDRange(gsize_and_lsize_x.second, gsize_and_lsize_y.second, gsize_and_lsize_z.second));
         }
@@ -178,96 +278,294 @@ pair<cl::NDRange, cl::NDRange> EngineOpenCL::NDRanges(const vector<const jitk::L
     }
 }
 
+EngineOpenCL::~EngineOpenCL() {
+    for (int i = 0; i < 2; ++i) {
+        if (_staging[i] != NULL) {
+            queue.enqueueUnmapMemObject(_staging_buffers[i], _staging[i]);
+        }
+    }
+    finish();
+
+    // Let's write the kernel trace, which the "warmup:<file>" message can pre-compile later
+    if (not kernel_trace.empty()) {
+        vector<string> sources;
+        for (const auto &hash_and_source: _trace) {
+            sources.push_back(hash_and_source.second);
+        }
+        try {
+            jitk::write_kernel_trace(kernel_trace, "OpenCL", sources);
+        } catch (const std::exception &e) {
+            cerr << e.what() << endl;
+        }
+    }
+}
+
+void EngineOpenCL::warmup(const vector<string> &sources) {
+    auto tcompile = chrono::steady_clock::now();
+    for (const string &source: sources) {
+        getProgram(source);
+    }
+    stat.time_compile += chrono::steady_clock::now() - tcompile;
+}
+
+cl::Program EngineOpenCL::getProgram(const string &source, uint32_t vector_width) {
+    size_t hash = hasher(source);
+    string flags = compile_flg;
+    if (source.find("#define BH_FAST_MATH\n") != string::npos) {
+        flags += " -cl-fast-relaxed-math";
+    }
+    if (vector_width > 0) {
+        boost::hash_combine(hash, vector_width);
+        flags += " -DBH_VECTOR_WIDTH=" + std::to_string(vector_width);
+    }
+
+    // Do we have the program already?
+    if (_programs.find(hash) != _programs.end()) {
+        return _programs.at(hash);
+    }
+    ++stat.kernel_cache_misses;
+
+    // Do we have the program binary in the persistent cache?
+    const fs::path binfile = cachePath(hash);
+    if (not binfile.empty() and fs::exists(binfile)) {
+        cl::Program program = loadBinary(binfile);
+        if (program() != NULL) {
+            if (verbose) {
+                cout << "Load cached program " << binfile << endl;
+            }
+            _programs[hash] = program;
+            return program;
+        }
+    }
+
+    // Or do we have to compile it
+    cl::Program program = cl::Program(context, source);
+    try {
+        if (verbose) {
+            cout << "************ Build Log ************" << endl \
+             << program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(device) \
+             << "^^^^^^^^^^^^^ Log END ^^^^^^^^^^^^^" << endl << endl;
+            jitk::write_source2file(source, source_dir, hash, ".cl", true);
+        }
+        program.build(devices, flags.c_str());
+    } catch (cl::Error e) {
+        cerr << "Error building: " << endl << program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(device) << endl;
+        throw;
+    }
+    _programs[hash] = program;
+    if (not binfile.empty()) {
+        saveBinary(program, binfile);
+    }
+    return program;
+}
+
+fs::path EngineOpenCL::cachePath(size_t hash) const {
+    // NB: the binary of the first device is loaded on all devices thus they must be equal
+    if (cache_dir.empty() or not homogeneous) {
+        return fs::path();
+    }
+    size_t key = hash;
+    boost::hash_combine(key, cache_hash);
+    return cache_dir / jitk::hash_filename(key, ".clbin");
+}
+
+cl::Program EngineOpenCL::loadBinary(const fs::path &binfile) {
+    ifstream ifs(binfile.string(), ios::binary);
+    const vector<char> binary((istreambuf_iterator<char>(ifs)), istreambuf_iterator<char>());
+    if (binary.empty()) {
+        return cl::Program();
+    }
+    cl::Program::Binaries binaries(devices.size(), make_pair((const void *) &binary[0], binary.size()));
+    try {
+        cl::Program ret(context, devices, binaries);
+        ret.build(devices, compile_flg.c_str());
+        return ret;
+    } catch (cl::Error e) {
+        // The binary is incompatible (e.g. a driver update that kept the version string) thus we rebuild it
+        boost::system::error_code ec;
+        fs::remove(binfile, ec);
+        return cl::Program();
+    }
+}
+
+void EngineOpenCL::saveBinary(const cl::Program &program, const fs::path &binfile) const {
+    // NB: the program has a binary for each device, which are equal, and we save the first one
+    vector<size_t> sizes(devices.size(), 0);
+    if (clGetProgramInfo(program(), CL_PROGRAM_BINARY_SIZES, sizeof(size_t) * sizes.size(), &sizes[0],
+                         NULL) != CL_SUCCESS or sizes[0] == 0) {
+        return;
+    }
+    vector<vector<char> > binaries(sizes.size());
+    vector<char *> ptrs(sizes.size());
+    for (size_t i = 0; i < sizes.size(); ++i) {
+        binaries[i].resize(std::max<size_t>(1, sizes[i]));
+        ptrs[i] = &binaries[i][0];
+    }
+    if (clGetProgramInfo(program(), CL_PROGRAM_BINARIES, sizeof(char *) * ptrs.size(), &ptrs[0],
+                         NULL) != CL_SUCCESS) {
+        return;
+    }
+    const vector<char> &binary = binaries[0];
+
+    // We write into a unique file, which we then rename into place. Since rename is atomic,
+    // concurrent processes sharing 'cache_dir' will never load a partially written binary.
+    const fs::path tmpfile = binfile.parent_path() / fs::unique_path(binfile.stem().string() + "-%%%%%%%%.tmp");
+    {
+        ofstream ofs(tmpfile.string(), ios::binary);
+        ofs.write(&binary[0], binary.size());
+    }
+    boost::system::error_code ec;
+    fs::rename(tmpfile, binfile, ec);
+    if (ec) {
+        fs::remove(tmpfile, ec);
+    }
+}
+
+EngineOpenCL::CachedKernel &EngineOpenCL::getKernel(const cl::Program &program) {
+    auto it = _kernels.find(program());
+    if (it == _kernels.end()) {
+        it = _kernels.insert(make_pair(program(), CachedKernel{cl::Kernel(program, "execute"), {}})).first;
+    }
+    return it->second;
+}
+
+void EngineOpenCL::setKernelArg(CachedKernel &kernel, cl_uint index, size_t size, const void *value) {
+    if (kernel.args.size() <= index) {
+        kernel.args.resize(index + 1);
+    }
+    vector<char> &last = kernel.args[index];
+    const char *bytes = static_cast<const char *>(value);
+    if (last.size() == size and std::equal(last.begin(), last.end(), bytes)) {
+        return;
+    }
+    kernel.kernel.setArg(index, size, value);
+    last.assign(bytes, bytes + size);
+}
+
 void EngineOpenCL::execute(const std::string &source, const jitk::Kernel &kernel,
                            const vector<const jitk::LoopB*> &threaded_blocks,
                            const vector<const bh_view*> &offset_strides,
+                           const vector<int64_t> &loop_sizes,
                            const vector<const bh_instruction*> &constants) {
-    size_t hash = hasher(source);
     ++stat.kernel_cache_lookups;
-    cl::Program program;
+    if (not kernel_trace.empty()) {
+        _trace.insert(make_pair(hasher(source), source));
+    }
 
+    // The profile and the trace of the kernel
+    const size_t hash = stat.enabled or trace::enabled() ? hasher(source) : 0;
+    if (stat.enabled) {
+        jitk::util_record_source(stat, hash, source, source_dir, ".cl");
+        stat.record_launch(hash, kernel.getTraffic());
+    }
+
+    trace::Scope compile_scope("opencl", "compile");
+    compile_scope.arg("hash", hash);
     auto tcompile = chrono::steady_clock::now();
+    cl::Program program = getProgram(source);
+    const chrono::duration<double> compile_time = chrono::steady_clock::now() - tcompile;
+    stat.time_compile += compile_time;
+    stat.record_compile(hash, compile_time);
+    compile_scope.end();
 
-    // Do we have the program already?
-    if (_programs.find(hash) != _programs.end()) {
-        program = _programs.at(hash);
-    } else {
-        // Or do we have to compile it
-        ++stat.kernel_cache_misses;
-        program = cl::Program(context, source);
-        try {
-            if (verbose) {
-                cout << "************ Build Log ************" << endl \
-                 << program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(device) \
-                 << "^^^^^^^^^^^^^ Log END ^^^^^^^^^^^^^" << endl << endl;
-                jitk::write_source2file(source, source_dir, hash, ".cl", true);
+    // The kernels run asynchronously thus the trace records the time that the host spends on the launch
+    trace::Scope launch_scope("opencl", "launch");
+    launch_scope.arg("hash", hash);
+
+    // Let's execute the OpenCL kernel
+    CachedKernel *cached = &getKernel(program);
+
+    // The commands of the extension methods in 'queue' might access the bases they got from getBuffer()
+    if (not _handed_out.empty()) {
+        cl::Event marker;
+        queue.enqueueMarkerWithWaitList(NULL, &marker);
+        for (bh_base *base: _handed_out) {
+            _last_access[base] = make_pair(marker, 0);
+        }
+        _handed_out.clear();
+    }
+    const size_t dev = placeKernel(kernel);
+    cl::CommandQueue &kernel_queue = queues[dev];
+
+    // NB: the kernel writes its outputs thus their host data are no longer mirrors
+    copyToDevice(kernel.getNonTemps());
+    if (mirrors) {
+        for (const jitk::InstrPtr &instr: kernel.getAllInstr()) {
+            if (not bh_opcode_is_system(instr->opcode) and not instr->operand.empty()) {
+                mirrors->release(instr->operand[0].base);
             }
-            program.build({device}, compile_flg.c_str());
-        } catch (cl::Error e) {
-            cerr << "Error building: " << endl << program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(device) << endl;
-            throw;
         }
-        _programs[hash] = program;
     }
-    stat.time_compile += chrono::steady_clock::now() - tcompile;
 
-    // Let's execute the OpenCL kernel
-    cl::Kernel opencl_kernel = cl::Kernel(program, "execute");
+    // The tuner picks the local work size, and the vector width of the vector kernels, of the first launches of
+    // each kernel
+    const uint32_t default_width = source_vector_width(source);
+    uint32_t vector_width = default_width;
+    jitk::WorkGroupTuner::Local local = configuredLocal(threaded_blocks.size());
+    size_t candidate = jitk::WorkGroupTuner::NOT_TIMED;
+    size_t tuning_key = hasher(source);
+    // NB: kernels that require a work-group size, e.g. because of local memory tiles, aren't tuned
+    if (wg_tuner and cached->kernel.getWorkGroupInfo<CL_KERNEL_COMPILE_WORK_GROUP_SIZE>(devices[dev])[0] == 0) {
+        boost::hash_combine(tuning_key, cache_hash);
+        const vector<size_t> max_items = devices[dev].getInfo<CL_DEVICE_MAX_WORK_ITEM_SIZES>();
+        jitk::WorkGroupTuner::Local max_local = {{1, 1, 1}};
+        for (size_t i = 0; i < std::min<size_t>(3, max_items.size()); ++i) {
+            max_local[i] = static_cast<uint32_t>(std::min<size_t>(max_items[i], numeric_limits<uint32_t>::max()));
+        }
+        const size_t max_size = cached->kernel.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(devices[dev]);
+        candidate = wg_tuner->begin(tuning_key, threaded_blocks.size(), max_size, max_local, local,
+                                    default_width > 0 ? &vector_width : NULL);
+    }
+    // Another vector width is another build of the program, whose maximum work-group size might be smaller
+    if (vector_width != default_width) {
+        auto twidth = chrono::steady_clock::now();
+        cached = &getKernel(getProgram(source, vector_width));
+        stat.time_compile += chrono::steady_clock::now() - twidth;
+        const size_t max_size = cached->kernel.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(devices[dev]);
+        while (local[0] > 1 and static_cast<size_t>(local[0]) * local[1] * local[2] > max_size) {
+            local[0] /= 2;
+        }
+    }
 
+    // NB: the kernel object is shared by the launches of the program thus only the changed arguments are set
     cl_uint i = 0;
     for (bh_base *base: kernel.getNonTemps()) { // NB: the iteration order matters!
-        opencl_kernel.setArg(i++, *getBuffer(base));
+        const cl_mem mem = (*buffers.at(base))();
+        setKernelArg(*cached, i++, sizeof(mem), &mem);
     }
 
     for (const bh_view *view: offset_strides) {
-        uint64_t t1 = (uint64_t) view->start;
-        opencl_kernel.setArg(i++, t1);
+        const uint64_t t1 = (uint64_t) view->start;
+        setKernelArg(*cached, i++, sizeof(t1), &t1);
         for (int j=0; j<view->ndim; ++j) {
-            uint64_t t2 = (uint64_t) view->stride[j];
-            opencl_kernel.setArg(i++, t2);
+            const uint64_t t2 = (uint64_t) view->stride[j];
+            setKernelArg(*cached, i++, sizeof(t2), &t2);
         }
     }
 
+    for (int64_t size: loop_sizes) {
+        const uint64_t t = (uint64_t) size;
+        setKernelArg(*cached, i++, sizeof(t), &t);
+    }
+
     for (const bh_instruction *instr: constants) {
         switch (instr->constant.type) {
             case bh_type::BOOL:
-                opencl_kernel.setArg(i++, instr->constant.value.bool8);
-                break;
             case bh_type::INT8:
-                opencl_kernel.setArg(i++, instr->constant.value.int8);
-                break;
             case bh_type::INT16:
-                opencl_kernel.setArg(i++, instr->constant.value.int16);
-                break;
             case bh_type::INT32:
-                opencl_kernel.setArg(i++, instr->constant.value.int32);
-                break;
             case bh_type::INT64:
-                opencl_kernel.setArg(i++, instr->constant.value.int64);
-                break;
             case bh_type::UINT8:
-                opencl_kernel.setArg(i++, instr->constant.value.uint8);
-                break;
             case bh_type::UINT16:
-                opencl_kernel.setArg(i++, instr->constant.value.uint16);
-                break;
             case bh_type::UINT32:
-                opencl_kernel.setArg(i++, instr->constant.value.uint32);
-                break;
             case bh_type::UINT64:
-                opencl_kernel.setArg(i++, instr->constant.value.uint64);
-                break;
             case bh_type::FLOAT32:
-                opencl_kernel.setArg(i++, instr->constant.value.float32);
-                break;
             case bh_type::FLOAT64:
-                opencl_kernel.setArg(i++, instr->constant.value.float64);
-                break;
             case bh_type::COMPLEX64:
-                opencl_kernel.setArg(i++, instr->constant.value.complex64);
-                break;
             case bh_type::COMPLEX128:
-                opencl_kernel.setArg(i++, instr->constant.value.complex128);
+                // NB: the constant is the first bytes of the value union
+                setKernelArg(*cached, i++, static_cast<size_t>(bh_type_size(instr->constant.type)),
+                             &instr->constant.value);
                 break;
             default:
                 std::cerr << "Unknown OpenCL type: " << bh_type_text(instr->constant.type) << std::endl;
@@ -275,11 +573,198 @@ void EngineOpenCL::execute(const std::string &source, const jitk::Kernel &kernel
         }
     }
 
-    const auto ranges = NDRanges(threaded_blocks);
-    auto texec = chrono::steady_clock::now();
-    queue.enqueueNDRangeKernel(opencl_kernel, cl::NullRange, ranges.first, ranges.second);
-    queue.finish();
-    stat.time_exec += chrono::steady_clock::now() - texec;
+    const auto ranges = NDRanges(threaded_blocks, local, vector_width);
+    // NB: we don't wait for the kernel, which is synchronized by the copies to the host
+    // The kernel waits for the uploads of its arrays in 'copy_queue' and for the kernels on other devices
+    vector<cl::Event> uploads;
+    takeUploadEvents(kernel.getNonTemps(), uploads);
+    const bool multi_device = queues.size() > 1;
+    if (multi_device) {
+        for (bh_base *base: kernel.getNonTemps()) {
+            waitOtherDevice(base, dev, uploads);
+        }
+    }
+    const vector<cl::Event> *wait = uploads.empty() ? NULL : &uploads;
+    if (prof or multi_device or candidate != jitk::WorkGroupTuner::NOT_TIMED) {
+        cl::Event event;
+        kernel_queue.enqueueNDRangeKernel(cached->kernel, cl::NullRange, ranges.first, ranges.second, wait, &event);
+        if (multi_device) {
+            for (bh_base *base: kernel.getNonTemps()) {
+                _last_access[base] = make_pair(event, dev);
+            }
+            kernel_queue.flush();
+        }
+        // The timed launches of the tuner are waited for
+        if (candidate != jitk::WorkGroupTuner::NOT_TIMED) {
+            event.wait();
+            const cl_ulong start = event.getProfilingInfo<CL_PROFILING_COMMAND_START>();
+            const cl_ulong end = event.getProfilingInfo<CL_PROFILING_COMMAND_END>();
+            wg_tuner->end(tuning_key, candidate, (end - start) / 1e9);
+        }
+        if (prof) {
+            _kernel_events.push_back(make_pair(event, hash));
+            collectEvents(false);
+        }
+    } else {
+        kernel_queue.enqueueNDRangeKernel(cached->kernel, cl::NullRange, ranges.first, ranges.second, wait);
+    }
+}
+
+size_t EngineOpenCL::placeKernel(const jitk::Kernel &kernel) {
+    if (devices.size() == 1) {
+        return 0;
+    }
+    // We prefer the device that holds the most bytes of the arrays of 'kernel'
+    vector<uint64_t> bytes(devices.size(), 0);
+    for (bh_base *base: kernel.getNonTemps()) {
+        auto it = _last_access.find(base);
+        if (it != _last_access.end()) {
+            bytes[it->second.second] += bh_base_size(base);
+        }
+    }
+    const auto most = std::max_element(bytes.begin(), bytes.end());
+    if (*most > 0) {
+        return most - bytes.begin();
+    }
+    // Kernels that only access new or uploaded arrays, e.g. the independent kernels of a flush, are spread out
+    const size_t ret = _next_device;
+    _next_device = (_next_device + 1) % devices.size();
+    return ret;
+}
+
+cl::Buffer *EngineOpenCL::allocateBuffer(uint64_t size_class, bool &recycled) {
+    cl::Buffer *ret = new cl::Buffer();
+    recycled = pool.get(size_class, *ret);
+    if (not recycled) {
+        // Under memory pressure, we give the cached buffers back to the device
+        if (_buffer_bytes + pool.cachedBytes() + size_class > device_bytes) {
+            pool.clear();
+        }
+        try {
+            *ret = cl::Buffer(context, CL_MEM_READ_WRITE, (cl_ulong) size_class);
+        } catch (const cl::Error &e) {
+            if (pool.cachedBytes() == 0) {
+                delete ret;
+                throw;
+            }
+            pool.clear();
+            *ret = cl::Buffer(context, CL_MEM_READ_WRITE, (cl_ulong) size_class);
+        }
+    }
+    _buffer_bytes += size_class;
+    return ret;
+}
+
+void EngineOpenCL::collectEvents(bool wait) {
+    while (not _kernel_events.empty()) {
+        cl::Event &event = _kernel_events.front().first;
+        if (wait) {
+            event.wait();
+        } else if (event.getInfo<CL_EVENT_COMMAND_EXECUTION_STATUS>() != CL_COMPLETE) {
+            break; // The kernels finish in order
+        }
+        const cl_ulong start = event.getProfilingInfo<CL_PROFILING_COMMAND_START>();
+        const cl_ulong end = event.getProfilingInfo<CL_PROFILING_COMMAND_END>();
+        const chrono::duration<double> elapsed((end - start) / 1e9);
+        stat.time_exec += elapsed;
+        stat.record_exec(_kernel_events.front().second, elapsed);
+        _kernel_events.pop_front();
+    }
+}
+
+void EngineOpenCL::finish() {
+    if (overlap_copies) {
+        copy_queue.finish();
+        _upload_events.clear();
+    }
+    for (cl::CommandQueue &q: queues) {
+        q.finish();
+    }
+    collectEvents(true);
+    _uploading.clear();
+}
+
+jitk::StagedIO EngineOpenCL::stagedIO() {
+    for (int i = 0; i < 2; ++i) {
+        if (_staging[i] == NULL) {
+            _staging_buffers[i] = cl::Buffer(context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR,
+                                             (cl_ulong) storage_chunk_bytes);
+            _staging[i] = static_cast<char*>(queue.enqueueMapBuffer(_staging_buffers[i], CL_TRUE,
+                                                                    CL_MAP_READ | CL_MAP_WRITE, 0,
+                                                                    (cl_ulong) storage_chunk_bytes));
+        }
+    }
+    return jitk::StagedIO(storage_chunk_bytes, _staging[0], _staging[1]);
+}
+
+void EngineOpenCL::storeFile(bh_base *base, int fd, uint64_t offset) {
+    trace::Scope scope("opencl", "store_file");
+    const uint64_t nbytes = static_cast<uint64_t>(bh_base_size(base));
+    dropHostWrites();
+    auto it = buffers.find(base);
+    if (it == buffers.end() or (mirrors and mirrors->valid(base))) { // The host data is up to date
+        if (base->data == NULL) {
+            throw runtime_error("VE-OpenCL: cannot store an array that has no data");
+        }
+        jitk::write_file(fd, base->data, nbytes, offset);
+        scope.arg("bytes", nbytes);
+        return;
+    }
+    auto tcopy = chrono::steady_clock::now();
+    vector<cl::Event> uploads;
+    takeUploadEvents(vector<bh_base*>{base}, uploads);
+    // We read on the device of the last access, which orders the reads after the kernel
+    auto access = _last_access.find(base);
+    cl::CommandQueue &q = access == _last_access.end() ? queue : queues[access->second.second];
+    const cl::Buffer &buf = *it->second;
+    stagedIO().store(fd, offset, nbytes, [&](int slot, uint64_t off, uint64_t size) {
+        q.enqueueReadBuffer(buf, CL_FALSE, (cl_ulong) off, (cl_ulong) size, _staging[slot],
+                            uploads.empty() ? NULL : &uploads, &_staging_events[slot]);
+        q.flush();
+    }, [&](int slot) {
+        _staging_events[slot].wait();
+    });
+    stat.time_copy2host += chrono::steady_clock::now() - tcopy;
+    scope.arg("bytes", nbytes);
+}
+
+void EngineOpenCL::loadFile(bh_base *base, int fd, uint64_t offset) {
+    trace::Scope scope("opencl", "load_file");
+    const uint64_t nbytes = static_cast<uint64_t>(bh_base_size(base));
+    dropHostWrites();
+    auto tcopy = chrono::steady_clock::now();
+    // The kernels in flight on any device might still read the old data or a recycled buffer
+    finish();
+    if (base->data != NULL) {
+        if (mirrors) {
+            mirrors->release(base);
+        }
+        bh_data_free(base);
+    }
+    // Without host data, copyToDevice() only allocates the buffer
+    vector<bh_base*> vec = {base};
+    copyToDevice(vec);
+    const cl::Buffer &buf = *buffers.at(base);
+    stagedIO().load(fd, offset, nbytes, [&](int slot, uint64_t off, uint64_t size) {
+        queue.enqueueWriteBuffer(buf, CL_FALSE, (cl_ulong) off, (cl_ulong) size, _staging[slot], NULL,
+                                 &_staging_events[slot]);
+        queue.flush();
+    }, [&](int slot) {
+        _staging_events[slot].wait();
+    });
+    stat.time_copy2dev += chrono::steady_clock::now() - tcopy;
+    scope.arg("bytes", nbytes);
+}
+
+void EngineOpenCL::importBuffer(bh_base *base, cl_mem mem) {
+    delBuffer(base);
+    if (base->data != NULL) {
+        bh_data_free(base);
+    }
+    // The buffer holds its own reference to the memory object
+    clRetainMemObject(mem);
+    buffers[base].reset(new cl::Buffer(mem));
+    _foreign.insert(base);
 }
 
 void EngineOpenCL::set_constructor_flag(std::vector<bh_instruction*> &instr_list) {
@@ -291,9 +776,13 @@ std::string EngineOpenCL::info() const {
     ss << "----"                                                                        << "\n";
     ss << "OpenCL:"                                                                     << "\n";
     ss << "  Platform: \"" << platform.getInfo<CL_PLATFORM_NAME>()                      << "\"\n";
-    ss << "  Device:   \"" << device.getInfo<CL_DEVICE_NAME>() << " (" \
-                           << device.getInfo<CL_DEVICE_OPENCL_C_VERSION>()              << ")\"\n";
+    for (const cl::Device &d: devices) {
+        ss << "  Device:   \"" << d.getInfo<CL_DEVICE_NAME>() << " (" \
+                               << d.getInfo<CL_DEVICE_OPENCL_C_VERSION>()               << ")\"\n";
+    }
     ss << "  Memory:   \"" << device.getInfo<CL_DEVICE_GLOBAL_MEM_SIZE>() / 1024 / 1024 << " MB\"\n";
+    ss << "  Hardware threads: " << device.getInfo<CL_DEVICE_MAX_COMPUTE_UNITS>() * \
+                                    device.getInfo<CL_DEVICE_MAX_WORK_GROUP_SIZE>()    << "\n";
     return ss.str();
 }
 
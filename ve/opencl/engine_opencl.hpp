@@ -22,15 +22,22 @@ If not, see <http://www.gnu.org/licenses/>.
 #define __BH_VE_OPENCL_ENGINE_OPENCL_HPP
 
 #include <map>
+#include <set>
+#include <deque>
 #include <memory>
 #include <vector>
 #include <chrono>
 
 #include <bh_config_parser.hpp>
 #include <bh_view.hpp>
+#include <bh_memory.h>
 #include <jitk/statistics.hpp>
 #include <jitk/kernel.hpp>
 #include <jitk/codegen_util.hpp>
+#include <jitk/device_pool.hpp>
+#include <jitk/host_mirrors.hpp>
+#include <jitk/staged_io.hpp>
+#include <jitk/work_group_tuner.hpp>
 
 #include "cl.hpp"
 
@@ -40,39 +47,161 @@ class EngineOpenCL {
 private:
     // Map of all compiled OpenCL programs
     std::map<uint64_t, cl::Program> _programs;
+    // The kernel object of each program and the bytes of each argument of its last launch, thus a launch only
+    // sets the arguments that changed (NB: OpenCL copies the arguments at the enqueue of a launch)
+    struct CachedKernel {
+        cl::Kernel kernel;
+        std::vector<std::vector<char> > args;
+    };
+    std::map<cl_program, CachedKernel> _kernels;
     // The OpenCL context, device, and queue used throughout the execution
     cl::Context context;
     cl::Device device;
     cl::CommandQueue queue;
+    // All devices in 'context' and their queues starting with 'device' and 'queue'. Each kernel runs on the device
+    // of the last accesses of most of its arrays or else on the next device in round-robin order (see placeKernel())
+    std::vector<cl::Device> devices;
+    std::vector<cl::CommandQueue> queues;
+    size_t _next_device = 0;
+    // The event of the last kernel that accessed each base and the index of its device in 'devices'
+    // NB: the kernels that access a base on different devices run one after the other through these events
+    std::map<bh_base*, std::pair<cl::Event, size_t> > _last_access;
+    // The bases that the extension methods got from getBuffer(), which they access in 'queue'
+    std::vector<bh_base*> _handed_out;
+    // Returns the index of the device in 'devices' that executes 'kernel'
+    size_t placeKernel(const jitk::Kernel &kernel);
+    // Adds the event of the last access of 'base' to 'wait' when it is on another device than 'dev'
+    void waitOtherDevice(bh_base *base, size_t dev, std::vector<cl::Event> &wait) const {
+        auto it = _last_access.find(base);
+        if (it != _last_access.end() and it->second.second != dev) {
+            wait.push_back(it->second.first);
+        }
+    }
+    // Whether all devices have the same name and driver thus they share program binaries
+    bool homogeneous = true;
+    // The queue of the uploads, which overlap the kernels in 'queue' (NULL when disabled)
+    cl::CommandQueue copy_queue;
+    const bool overlap_copies;
+    // The events of the uploads in 'copy_queue' that no kernel has waited for yet
+    std::map<bh_base*, cl::Event> _upload_events;
+    // Moves the upload events of 'bases' to 'out'
+    template <typename T>
+    void takeUploadEvents(const T &bases, std::vector<cl::Event> &out) {
+        for (bh_base *base: bases) {
+            auto it = _upload_events.find(base);
+            if (it != _upload_events.end()) {
+                out.push_back(it->second);
+                _upload_events.erase(it);
+            }
+        }
+    }
     // We save the OpenCL platform object for later information retrieval
     cl::Platform platform;
     // OpenCL work group sizes
-    const cl_ulong work_group_size_1dx;
-    const cl_ulong work_group_size_2dx;
-    const cl_ulong work_group_size_2dy;
-    const cl_ulong work_group_size_3dx;
-    const cl_ulong work_group_size_3dy;
-    const cl_ulong work_group_size_3dz;
+    cl_ulong work_group_size_1dx;
+    cl_ulong work_group_size_2dx;
+    cl_ulong work_group_size_2dy;
+    cl_ulong work_group_size_3dx;
+    cl_ulong work_group_size_3dy;
+    cl_ulong work_group_size_3dz;
     // OpenCL compile flags
-    const std::string compile_flg;
+    std::string compile_flg;
     // Default device type
     const std::string default_device_type;
     // Default platform number
     const int platform_no;
-    // Returns the global and local work OpenCL ranges based on the 'threaded_blocks'
-    std::pair<cl::NDRange, cl::NDRange> NDRanges(const std::vector<const jitk::LoopB*> &threaded_blocks) const;
+    // Returns the configured local work size of kernels with 'ndim' threaded dimensions
+    jitk::WorkGroupTuner::Local configuredLocal(size_t ndim) const;
+    // Returns the global and local work OpenCL ranges based on the 'threaded_blocks' and the local work size 'local'
+    // where each work-item processes 'vector_width' elements of the threaded block
+    std::pair<cl::NDRange, cl::NDRange> NDRanges(const std::vector<const jitk::LoopB*> &threaded_blocks,
+                                                 const jitk::WorkGroupTuner::Local &local,
+                                                 uint32_t vector_width = 1) const;
+    // The tuner of the local work sizes (NULL when disabled)
+    std::unique_ptr<jitk::WorkGroupTuner> wg_tuner;
     // A map of allocated buffers on the device
     std::map<bh_base*, std::unique_ptr<cl::Buffer> > buffers;
     // Verbose flag
     const bool verbose;
     // Some statistics
     jitk::Statistics &stat;
+    // The freed buffers, which new arrays reuse
+    jitk::DevicePool<cl::Buffer> pool;
+    // The total size of the buffers in 'buffers' and the size of the device memory
+    uint64_t _buffer_bytes = 0;
+    uint64_t device_bytes = 0;
+    // The buffers that another framework owns (see importBuffer()), which never go to the pool
+    std::set<bh_base*> _foreign;
+    // Moves the buffer of 'base' to the pool
+    void releaseBuffer(bh_base *base) {
+        auto it = buffers.find(base);
+        if (_foreign.erase(base) > 0) { // The buffer only releases our reference to the memory object
+            buffers.erase(it);
+            _last_access.erase(base);
+        } else if (it != buffers.end()) {
+            const uint64_t size_class = pool.sizeClass(bh_base_size(base));
+            pool.put(size_class, std::move(*it->second));
+            _buffer_bytes -= size_class;
+            buffers.erase(it);
+            _last_access.erase(base);
+            bh_memory_track_free(BH_MEMORY_OPENCL, base);
+        }
+    }
+    // Returns a buffer of 'size_class' bytes from the pool, which sets 'recycled', or else a new buffer
+    cl::Buffer *allocateBuffer(uint64_t size_class, bool &recycled);
+    // The host-allocated staging buffers of storeFile() and loadFile() of 'storage_chunk_bytes' bytes each, which
+    // are mapped into '_staging', and the events of their last copies. They are allocated on first use.
+    const uint64_t storage_chunk_bytes;
+    cl::Buffer _staging_buffers[2];
+    char *_staging[2] = {NULL, NULL};
+    cl::Event _staging_events[2];
+    // Returns the file I/O through the staging buffers
+    jitk::StagedIO stagedIO();
     // Record profiling statistics
     const bool prof;
     // Path to the directory of the source files (only used in verbose mode)
     const boost::filesystem::path source_dir;
+    // File to write the trace of executed kernels to at shutdown (empty means disabled)
+    const std::string kernel_trace;
+    std::map<uint64_t, std::string> _trace;
+    // Path to the persistent cache of program binaries (empty means disabled)
+    const boost::filesystem::path cache_dir;
+    // Hash of the device, driver, and compile flags, which is part of the persistent cache key
+    size_t cache_hash;
+    // Return the OpenCL program of 'source', which is build if it doesn't exist.
+    // A non-zero 'vector_width' overrides the number of elements of the work-items of a vector kernel.
+    cl::Program getProgram(const std::string &source, uint32_t vector_width = 0);
+    // Returns the cached kernel object of 'program', which is created on first use
+    CachedKernel &getKernel(const cl::Program &program);
+    // Sets argument 'index' of 'kernel' to the 'size' bytes at 'value' unless the previous launch had that value
+    void setKernelArg(CachedKernel &kernel, cl_uint index, size_t size, const void *value);
+    // Returns the path of the program binary in the persistent cache (empty when the cache is disabled)
+    boost::filesystem::path cachePath(size_t hash) const;
+    // Build a program from the binary 'binfile' or returns a NULL program if the binary is incompatible
+    cl::Program loadBinary(const boost::filesystem::path &binfile);
+    // Write the binary of the build 'program' to 'binfile'
+    void saveBinary(const cl::Program &program, const boost::filesystem::path &binfile) const;
+    // The events of the kernels in flight and their hashes, which are only recorded when profiling
+    std::deque<std::pair<cl::Event, size_t> > _kernel_events;
+    // The bases whose host data the device might still be reading
+    std::set<bh_base*> _uploading;
+    // Adds the device time of the finished kernels to 'time_exec' ('wait' waits for all of them)
+    void collectEvents(bool wait);
+    // Wait for all commands in the queue to finish
+    void finish();
+    // The synced arrays that keep their device buffer until the host writes them (NULL when disabled)
+    std::unique_ptr<jitk::HostMirrors> mirrors;
+    // Drop the device buffers of the mirrors that the host has written
+    void dropHostWrites() {
+        if (mirrors) {
+            for (bh_base *base: mirrors->takeWritten()) {
+                releaseBuffer(base);
+            }
+        }
+    }
 public:
     EngineOpenCL(const ConfigParser &config, jitk::Statistics &stat);
+    ~EngineOpenCL();
 
 
 
@@ -80,59 +209,135 @@ public:
     void execute(const std::string &source, const jitk::Kernel &kernel,
                  const std::vector<const jitk::LoopB*> &threaded_blocks,
                  const std::vector<const bh_view*> &offset_strides,
+                 const std::vector<int64_t> &loop_sizes,
                  const std::vector<const bh_instruction*> &constants);
 
-    // Copy 'bases' to the host (ignoring bases that isn't on the device)
+    // Copy 'bases' to the host (ignoring bases that isn't on the device). The device buffers stay valid until
+    // the host writes the data unless 'keep_device' is false or the mirrors are disabled.
     template <typename T>
-    void copyToHost(T &bases) {
+    void copyToHost(T &bases, bool keep_device = true) {
+        trace::Scope scope("opencl", "copy2host");
+        uint64_t nbytes = 0;
         auto tcopy = std::chrono::steady_clock::now();
+        dropHostWrites();
+        std::vector<bh_base*> copied;
         // Let's copy sync'ed arrays back to the host
         for(bh_base *base: bases) {
             if (buffers.find(base) != buffers.end()) {
+                if (mirrors and mirrors->valid(base)) { // The host already has the data
+                    if (not keep_device) {
+                        mirrors->release(base);
+                        releaseBuffer(base);
+                    }
+                    continue;
+                }
                 bh_data_malloc(base);
                 if (verbose) {
                     std::cout << "Copy to host: " << *base << std::endl;
                 }
-                queue.enqueueReadBuffer(*buffers.at(base), CL_FALSE, 0, (cl_ulong) bh_base_size(base), base->data);
-                // When syncing we assume that the host writes to the data and invalidate the device data thus
-                // we have to remove its data buffer
-                buffers.erase(base);
+                std::vector<cl::Event> uploads;
+                takeUploadEvents(std::vector<bh_base*>{base}, uploads);
+                // We read on the device of the last access, which orders the read after the kernel
+                auto access = _last_access.find(base);
+                cl::CommandQueue &q = access == _last_access.end() ? queue : queues[access->second.second];
+                q.enqueueReadBuffer(*buffers.at(base), CL_FALSE, 0, (cl_ulong) bh_base_size(base), base->data,
+                                    uploads.empty() ? NULL : &uploads);
+                copied.push_back(base);
+                nbytes += bh_base_size(base);
             }
         }
-        queue.finish();
+        // The kernels run asynchronously thus we only wait when the host is about to touch the data
+        if (not copied.empty()) {
+            finish();
+        }
+        // Without the mirrors, we assume that the host writes to the data and invalidate the device data thus
+        // we have to remove its data buffer
+        for (bh_base *base: copied) {
+            if (mirrors and keep_device) {
+                mirrors->protect(base);
+                if (mirrors->valid(base)) {
+                    continue;
+                }
+            }
+            releaseBuffer(base);
+        }
         stat.time_copy2host += std::chrono::steady_clock::now() - tcopy;
+        scope.arg("bytes", nbytes);
     }
 
     // Copy 'base_list' to the device (ignoring bases that is already on the device)
     template <typename T>
     void copyToDevice(T &base_list) {
-
-        // Let's update the maximum memory usage on the device
-        if (prof) {
-            uint64_t sum = 0;
-            for (const auto &b: buffers) {
-                sum += bh_base_size(b.first);
-            }
-            stat.max_memory_usage = sum > stat.max_memory_usage?sum:stat.max_memory_usage;
-        }
-
+        trace::Scope scope("opencl", "copy2dev");
+        uint64_t nbytes = 0;
         auto tcopy = std::chrono::steady_clock::now();
+        dropHostWrites();
         for(bh_base *base: base_list) {
             if (buffers.find(base) == buffers.end()) { // We shouldn't overwrite existing buffers
-                cl::Buffer *buf = new cl::Buffer(context, CL_MEM_READ_WRITE, (cl_ulong) bh_base_size(base));
+                bool recycled;
+                cl::Buffer *buf = allocateBuffer(pool.sizeClass(bh_base_size(base)), recycled);
                 buffers[base].reset(buf);
+                bh_memory_track_alloc(BH_MEMORY_OPENCL, base, pool.sizeClass(bh_base_size(base)));
 
                 // If the host data is non-null we should copy it to the device
                 if (base->data != NULL) {
                     if (verbose) {
                         std::cout << "Copy to device: " << *base << std::endl;
                     }
-                    queue.enqueueWriteBuffer(*buf, CL_FALSE, 0, (cl_ulong) bh_base_size(base), base->data);
+                    // A recycled buffer might still be in use by the kernels in flight on any device
+                    std::vector<cl::Event> wait;
+                    if (recycled and (overlap_copies or queues.size() > 1)) {
+                        wait.resize(queues.size());
+                        for (size_t i = 0; i < wait.size(); ++i) {
+                            queues[i].enqueueMarkerWithWaitList(NULL, &wait[i]);
+                        }
+                    }
+                    if (overlap_copies) {
+                        cl::Event event;
+                        copy_queue.enqueueWriteBuffer(*buf, CL_FALSE, 0, (cl_ulong) bh_base_size(base), base->data,
+                                                      wait.empty() ? NULL : &wait, &event);
+                        _upload_events[base] = event;
+                    } else {
+                        queue.enqueueWriteBuffer(*buf, CL_FALSE, 0, (cl_ulong) bh_base_size(base), base->data,
+                                                 wait.empty() ? NULL : &wait);
+                    }
+                    _uploading.insert(base);
+                    nbytes += bh_base_size(base);
                 }
             }
         }
-        queue.finish();
+        // Let's start the uploads while the kernels in flight run
+        if (overlap_copies) {
+            copy_queue.flush();
+        }
+        // NB: the kernels wait for the uploads of their arrays, which means that we only have to
+        //     wait before the host frees the data (see delBuffer())
         stat.time_copy2dev += std::chrono::steady_clock::now() - tcopy;
+        scope.arg("bytes", nbytes);
+
+        // Let's update the maximum memory usage on the device, which includes the pool
+        const uint64_t sum = _buffer_bytes + pool.cachedBytes();
+        stat.max_memory_usage = sum > stat.max_memory_usage?sum:stat.max_memory_usage;
+    }
+
+    // Start the uploads of the arrays in 'base_list' that the next kernels access while the buffers stay below half
+    // of the device memory, which leaves room for the arrays the kernels create
+    template <typename T>
+    void prefetchToDevice(T &base_list) {
+        uint64_t bytes = _buffer_bytes + pool.cachedBytes();
+        std::vector<bh_base*> vec;
+        for (bh_base *base: base_list) {
+            if (base->data == NULL or buffers.find(base) != buffers.end()) {
+                continue;
+            }
+            const uint64_t size_class = pool.sizeClass(bh_base_size(base));
+            if (bytes + size_class > device_bytes / 2) {
+                break;
+            }
+            bytes += size_class;
+            vec.push_back(base);
+        }
+        copyToDevice(vec);
     }
 
     // Copy all bases to the host (ignoring bases that isn't on the device)
@@ -141,15 +346,41 @@ public:
         for(auto &buf_pair: buffers) {
             bases_on_device.push_back(buf_pair.first);
         }
-        copyToHost(bases_on_device);
+        copyToHost(bases_on_device, false);
     }
 
     // Sets the constructor flag of each instruction in 'instr_list'
     void set_constructor_flag(std::vector<bh_instruction*> &instr_list);
+    // Batch compilation isn't supported thus the kernels are compiled on demand by execute()
+    void compileAll(const std::vector<std::string> &sources) {}
+    // The kernels are executed in order on the command queue of their device thus concurrent kernels on the same
+    // device run one after the other
+    void beginConcurrent() {}
+    void endConcurrent() {}
+    // The kernels are never tiled across the iterations of a BH_REPEAT body (no temporal blocking)
+    int64_t timeBlockIterations() const { return 0; }
+    void beginTimeBlock() {}
+    void endTimeBlock() {}
+    // Make sure that the devices start on the kernels of a flush
+    void endFlush() {
+        for (cl::CommandQueue &q: queues) {
+            q.flush();
+        }
+    }
+    // Build the programs of 'sources' ahead of time, e.g. from a kernel trace
+    void warmup(const std::vector<std::string> &sources);
+
+    // Re-read the work group sizes and the compile flags of 'config' and drop the programs built with the old ones
+    void reconfigure(const ConfigParser &config);
 
     // Return a YAML string describing this component
     std::string info() const;
 
+    // Whether 'base' has a buffer on the device
+    bool onDevice(bh_base *base) const {
+        return buffers.find(base) != buffers.end();
+    }
+
     // Retrieve a single buffer
     template <typename T>
     cl::Buffer* getBuffer(T &base) {
@@ -157,13 +388,80 @@ public:
             std::vector<T> vec = {base};
             copyToDevice(vec);
         }
+        // The caller enqueues its commands in 'queue' thus the upload and the kernels on other devices must be done
+        std::vector<cl::Event> uploads;
+        takeUploadEvents(std::vector<bh_base*>{base}, uploads);
+        if (queues.size() > 1) {
+            waitOtherDevice(base, 0, uploads);
+            _handed_out.push_back(base);
+        }
+        if (not uploads.empty()) {
+            cl::Event::waitForEvents(uploads);
+        }
+        // The caller might write the buffer thus the host data is no longer a mirror
+        if (mirrors) {
+            mirrors->release(base);
+        }
         return &(*buffers[base]);
     }
 
     // Delete a buffer
+    // NB: the device keeps the memory of a released buffer until the kernels in flight are done with it
     template <typename T>
     void delBuffer(T &base) {
-        buffers.erase(base);
+        // The caller might free the host data next, which the device might still be copying
+        if (_uploading.find(base) != _uploading.end()) {
+            finish();
+        }
+        if (mirrors) {
+            mirrors->release(base);
+        }
+        releaseBuffer(base);
+    }
+
+    // The host is about to write 'bases' thus their host data are no longer mirrors
+    template <typename T>
+    void hostWrites(T &bases) {
+        if (mirrors) {
+            for (bh_base *base: bases) {
+                mirrors->release(base);
+            }
+        }
+    }
+
+    // Wait for the kernels in flight to finish
+    void waitKernels() {
+        finish();
+    }
+
+    // Returns the memory object of 'base' for another framework (e.g. through DLPack) once the commands in flight are
+    // done. The other framework might write the buffer, which stays valid until the next flush frees or writes it.
+    cl_mem exportBuffer(bh_base *base) {
+        const cl_mem ret = (*getBuffer(base))();
+        finish();
+        return ret;
+    }
+
+    // Use the memory object 'mem' of another framework in 'context' as the buffer of 'base' without copying it.
+    // The other framework must have finished writing the memory. The host data is freed since it is stale afterwards.
+    void importBuffer(bh_base *base, cl_mem mem);
+
+    // Write the data of 'base' to 'fd' at 'offset'. The data on the device goes through the staging buffers, which
+    // overlaps the downloads and the writes and keeps the device buffer valid.
+    void storeFile(bh_base *base, int fd, uint64_t offset);
+
+    // Read the data of 'base' from 'fd' at 'offset' into its device buffer through the staging buffers, which
+    // overlaps the reads and the uploads. The host data is freed since it is stale afterwards.
+    void loadFile(bh_base *base, int fd, uint64_t offset);
+
+    // Copy the 'nbytes' bytes at 'offset' of the host data of 'base' to its existing device buffer
+    void copyRangeToDevice(bh_base *base, uint64_t offset, uint64_t nbytes) {
+        auto tcopy = std::chrono::steady_clock::now();
+        auto access = _last_access.find(base);
+        cl::CommandQueue &q = access == _last_access.end() ? queue : queues[access->second.second];
+        q.enqueueWriteBuffer(*buffers.at(base), CL_TRUE, (cl_ulong) offset, (cl_ulong) nbytes,
+                             static_cast<char*>(base->data) + offset);
+        stat.time_copy2dev += std::chrono::steady_clock::now() - tcopy;
     }
 
     // Get C buffer from wrapped C++ object
@@ -0,0 +1,223 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <limits>
+#include <fstream>
+#include <sstream>
+#include <dlfcn.h>
+
+#include "autotuner.hpp"
+
+using namespace std;
+namespace fs = boost::filesystem;
+
+namespace bohrium {
+
+namespace {
+// The values of omp_sched_t
+constexpr int OMP_SCHED_STATIC = 1;
+constexpr int OMP_SCHED_DYNAMIC = 2;
+constexpr int OMP_SCHED_GUIDED = 3;
+
+// Index of the variant when no launch is timed
+constexpr size_t NOT_TIMED = numeric_limits<size_t>::max();
+
+// Index of the winner when it was loaded from the file
+constexpr int LOADED = -2;
+
+// Reads the tuning file 'file' into 'out', which maps kernel keys to the winning variants
+void read_tunings(const fs::path &file, map<uint64_t, AutoTuner::Variant> &out) {
+    ifstream in(file.string());
+    string line;
+    while (getline(in, line)) {
+        istringstream ss(line);
+        uint64_t key;
+        AutoTuner::Variant v;
+        if (ss >> key >> v.kind >> v.chunk >> v.threads and v.threads >= 0) {
+            // NB: the prefetch distance is missing in old files
+            if (not (ss >> v.prefetch)) {
+                v.prefetch = 0;
+            }
+            out[key] = v;
+        }
+    }
+}
+} // Anon namespace
+
+// Returns the handle of the loaded OpenMP runtime or NULL
+void *openmp_runtime() {
+    for (const char *name: {"libgomp.so.1", "libomp.so", "libomp.so.5", "libiomp5.so"}) {
+        void *handle = dlopen(name, RTLD_NOW | RTLD_NOLOAD);
+        if (handle != NULL) {
+            return handle;
+        }
+    }
+    return NULL;
+}
+
+AutoTuner::AutoTuner(const ConfigParser &config, const fs::path &file) :
+        runs(std::max(1, config.defaultGet<int>("autotune_runs", 2))),
+        prefetch_default(config.defaultGet<bool>("compiler_prefetch", false) ?
+                         std::max(1, config.defaultGet<int>("compiler_prefetch_distance", 16)) : 0),
+        file(file) {
+    if (not file.empty()) {
+        map<uint64_t, Variant> loaded;
+        read_tunings(file, loaded);
+        for (const auto &kv: loaded) {
+            Tuning &t = _tunings[kv.first];
+            t.winner = LOADED;
+            t.loaded = kv.second;
+        }
+    }
+}
+
+AutoTuner::~AutoTuner() {
+    if (not _dirty or file.empty()) {
+        return;
+    }
+    // We merge with the tunings other processes might have written meanwhile
+    map<uint64_t, Variant> winners;
+    read_tunings(file, winners);
+    for (const auto &kv: _tunings) {
+        if (kv.second.winner == LOADED) {
+            winners[kv.first] = kv.second.loaded;
+        } else if (kv.second.winner >= 0) {
+            winners[kv.first] = _variants[kv.second.winner];
+        }
+    }
+    // We write to a unique file and rename it thus concurrent processes never see a partial file
+    const fs::path tmpfile = fs::path(file.string() + fs::unique_path("-%%%%%%%%.tmp").string());
+    {
+        ofstream out(tmpfile.string());
+        for (const auto &kv: winners) {
+            out << kv.first << " " << kv.second.kind << " " << kv.second.chunk << " " << kv.second.threads << " "
+                << kv.second.prefetch << "\n";
+        }
+    }
+    boost::system::error_code ec;
+    fs::rename(tmpfile, file, ec);
+    if (ec) {
+        fs::remove(tmpfile, ec);
+    }
+}
+
+void AutoTuner::apply(const Variant &variant, uint64_t *prefetch_distance) {
+    if (variant.threads > 0) {
+        _set_schedule(variant.kind, variant.chunk);
+        _set_num_threads(variant.threads);
+    }
+    if (prefetch_distance != NULL) {
+        *prefetch_distance = static_cast<uint64_t>(variant.prefetch > 0 ? variant.prefetch : prefetch_default);
+    }
+}
+
+size_t AutoTuner::next_variant(const Tuning &t) const {
+    for (size_t i = 0; i < _variants.size(); ++i) {
+        if (t.launches[i] < runs and (t.prefetch or _variants[i].prefetch == 0)) {
+            return i;
+        }
+    }
+    return NOT_TIMED;
+}
+
+size_t AutoTuner::begin(uint64_t key, uint64_t *prefetch_distance) {
+    // The OpenMP runtime is loaded together with the first kernel, which is why we look it up here
+    if (not _resolved) {
+        _resolved = true;
+        void *handle = openmp_runtime();
+        int (*get_max_threads)() = NULL;
+        if (handle != NULL) {
+            *(void **) (&_set_schedule) = dlsym(handle, "omp_set_schedule");
+            *(void **) (&_set_num_threads) = dlsym(handle, "omp_set_num_threads");
+            *(void **) (&get_max_threads) = dlsym(handle, "omp_get_max_threads");
+        }
+        int threads = 0;
+        if (_set_schedule != NULL and _set_num_threads != NULL and get_max_threads != NULL) {
+            threads = get_max_threads();
+            _variants.push_back({OMP_SCHED_STATIC, 0, threads, 0});
+            _variants.push_back({OMP_SCHED_STATIC, 0, 1, 0});
+            _variants.push_back({OMP_SCHED_DYNAMIC, 16, threads, 0});
+            _variants.push_back({OMP_SCHED_GUIDED, 0, threads, 0});
+            if (threads >= 4) {
+                _variants.push_back({OMP_SCHED_STATIC, 0, threads / 2, 0});
+            }
+        } else {
+            _variants.push_back({0, 0, 0, 0});
+        }
+        // The prefetch distances are only timed for the kernels that have them
+        if (prefetch_default > 0) {
+            _variants.push_back({OMP_SCHED_STATIC, 0, threads, std::max(1, prefetch_default / 4)});
+            _variants.push_back({OMP_SCHED_STATIC, 0, threads, prefetch_default * 4});
+        }
+        if (_variants.size() == 1) { // Without an OpenMP runtime or prefetches, there is nothing to tune
+            _variants.clear();
+        }
+    }
+    if (_variants.empty()) {
+        return NOT_TIMED;
+    }
+
+    Tuning &t = _tunings[key];
+    if (t.winner == LOADED) {
+        // NB: the OpenMP runtime isn't touched by variants without threads, e.g. from a process without it
+        if (t.loaded.threads == 0 or _set_schedule != NULL) {
+            apply(t.loaded, prefetch_distance);
+        }
+        return NOT_TIMED;
+    } else if (t.winner >= 0) {
+        apply(_variants[t.winner], prefetch_distance);
+        return NOT_TIMED;
+    }
+    // The first launch warms up the caches thus we don't time it
+    if (t.seconds.empty()) {
+        t.seconds.assign(_variants.size(), 0);
+        t.launches.assign(_variants.size(), 0);
+        t.prefetch = prefetch_distance != NULL;
+        apply(_variants[0], prefetch_distance);
+        return NOT_TIMED;
+    }
+    const size_t next = next_variant(t);
+    if (next != NOT_TIMED) {
+        apply(_variants[next], prefetch_distance);
+    }
+    return next;
+}
+
+void AutoTuner::end(uint64_t key, size_t variant, double seconds) {
+    if (variant == NOT_TIMED) {
+        return;
+    }
+    Tuning &t = _tunings[key];
+    t.seconds[variant] += seconds;
+    ++t.launches[variant];
+    if (next_variant(t) == NOT_TIMED) {
+        t.winner = 0;
+        for (size_t i = 1; i < _variants.size(); ++i) {
+            if (t.launches[i] > 0 and t.seconds[i] < t.seconds[t.winner]) {
+                t.winner = static_cast<int>(i);
+            }
+        }
+        t.seconds.clear();
+        t.launches.clear();
+        _dirty = true;
+    }
+}
+
+} // bohrium
@@ -0,0 +1,101 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __BH_VE_OPENMP_AUTOTUNER_HPP
+#define __BH_VE_OPENMP_AUTOTUNER_HPP
+
+#include <map>
+#include <vector>
+#include <cstdint>
+#include <boost/filesystem.hpp>
+
+#include <bh_config_parser.hpp>
+
+namespace bohrium {
+
+// Returns the handle of the loaded OpenMP runtime or NULL
+void *openmp_runtime();
+
+/* The auto-tuner times the first launches of each kernel under a few OpenMP scheduling variants and
+ * sticks to the fastest one. The kernels must use "schedule(runtime)" since the variants are applied
+ * through the OpenMP runtime before each launch, which also means that the kernels are never recompiled.
+ * Likewise, the distance of the software prefetches is tuned through the 'bh_prefetch_distance' variable
+ * of the kernels that have one.
+ */
+class AutoTuner {
+public:
+    // A scheduling variant: the OpenMP schedule kind (omp_sched_t), its chunk size, the number of threads
+    // (zero leaves the OpenMP runtime alone), and the prefetch distance (zero means 'compiler_prefetch_distance')
+    struct Variant {
+        int kind;
+        int chunk;
+        int threads;
+        int prefetch;
+    };
+
+    // The tuning is stored in 'file' when it isn't empty
+    AutoTuner(const ConfigParser &config, const boost::filesystem::path &file);
+    ~AutoTuner();
+
+    // Applies the variant to use for the next launch of the kernel 'key' and returns its index,
+    // which must be passed to end() after the launch. 'prefetch_distance' is the 'bh_prefetch_distance'
+    // variable of the kernel or NULL when it has none.
+    size_t begin(uint64_t key, uint64_t *prefetch_distance);
+
+    // Records that the launch of the kernel 'key' using 'variant' took 'seconds'
+    void end(uint64_t key, size_t variant, double seconds);
+
+private:
+    // The tuning state of a kernel
+    struct Tuning {
+        // The accumulated seconds and number of launches of each variant
+        std::vector<double> seconds;
+        std::vector<int> launches;
+        // The index of the winner in 'variants' (or the variant itself when loaded from 'file')
+        int winner = -1;
+        Variant loaded;
+        // Whether the kernel has a prefetch distance to tune
+        bool prefetch = false;
+    };
+    std::map<uint64_t, Tuning> _tunings;
+    std::vector<Variant> _variants;
+
+    // Number of launches to time of each variant
+    const int runs;
+    // The default prefetch distance (zero when the kernels have no software prefetches)
+    const int prefetch_default;
+    const boost::filesystem::path file;
+    bool _dirty = false;
+
+    // The OpenMP runtime functions, which are looked up on the first launch
+    void (*_set_schedule)(int kind, int chunk) = NULL;
+    void (*_set_num_threads)(int threads) = NULL;
+    bool _resolved = false;
+
+    // Applies 'variant' to the OpenMP runtime and the 'prefetch_distance' of the kernel
+    void apply(const Variant &variant, uint64_t *prefetch_distance);
+
+    // Returns the next variant to time of 't' or NOT_TIMED when all of them are timed
+    size_t next_variant(const Tuning &t) const;
+};
+
+} // bohrium
+
+#endif
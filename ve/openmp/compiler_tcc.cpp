@@ -0,0 +1,125 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <sstream>
+#include <iostream>
+#include <stdexcept>
+
+#ifdef VE_OPENMP_LIBTCC
+#include <libtcc.h>
+#endif
+
+#include "compiler_tcc.hpp"
+
+using namespace std;
+
+namespace bohrium {
+
+CompilerTCC::CompilerTCC(string inc, string flg, bool verbose) : inc_(inc), flg_(flg), verbose_(verbose) {
+    if (not available()) {
+        throw runtime_error("CompilerTCC: Bohrium was build without libtcc");
+    }
+}
+
+string CompilerTCC::text() const {
+    stringstream ss;
+    ss << "CompilerTCC {" << endl;
+    ss << "  inc = '" << inc_ << "'," << endl;
+    ss << "  flg = '" << flg_ << "'," << endl;
+    ss << "}";
+    return ss.str();
+}
+
+#ifdef VE_OPENMP_LIBTCC
+
+namespace {
+// Error handler that silences libtcc, we fall back to the regular compiler anyway
+void silent_error(void *opaque, const char *msg) {}
+}
+
+CompilerTCC::~CompilerTCC() {
+    for (auto &addr_and_state: states_) {
+        tcc_delete(static_cast<TCCState*>(addr_and_state.second));
+    }
+}
+
+bool CompilerTCC::available() {
+    return true;
+}
+
+void* CompilerTCC::compile(const string &sourcecode, const string &symbol) {
+    TCCState *state = tcc_new();
+    if (state == NULL) {
+        throw runtime_error("CompilerTCC: tcc_new() failed");
+    }
+    if (not verbose_) {
+        tcc_set_error_func(state, NULL, silent_error);
+    }
+    tcc_set_options(state, (inc_ + " " + flg_).c_str());
+    tcc_set_output_type(state, TCC_OUTPUT_MEMORY);
+    tcc_add_library(state, "m");
+
+    void *ret = NULL;
+    if (tcc_compile_string(state, sourcecode.c_str()) == 0) {
+#ifdef TCC_RELOCATE_AUTO
+        const int err = tcc_relocate(state, TCC_RELOCATE_AUTO);
+#else
+        const int err = tcc_relocate(state);
+#endif
+        if (err == 0) {
+            ret = tcc_get_symbol(state, symbol.c_str());
+        }
+    }
+    if (ret == NULL) {
+        if (verbose_) {
+            cout << "CompilerTCC: failed compiling kernel, falling back to the regular compiler" << endl;
+        }
+        tcc_delete(state);
+        return NULL;
+    }
+    states_[ret] = state;
+    return ret;
+}
+
+void CompilerTCC::release(void *symbol_addr) {
+    auto it = states_.find(symbol_addr);
+    if (it != states_.end()) {
+        tcc_delete(static_cast<TCCState*>(it->second));
+        states_.erase(it);
+    }
+}
+
+#else
+
+CompilerTCC::~CompilerTCC() {}
+
+bool CompilerTCC::available() {
+    return false;
+}
+
+void* CompilerTCC::compile(const string &sourcecode, const string &symbol) {
+    return NULL;
+}
+
+void CompilerTCC::release(void *symbol_addr) {}
+
+#endif
+
+}
@@ -0,0 +1,66 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __BH_VE_UNI_COMPILER_TCC_HPP
+#define __BH_VE_UNI_COMPILER_TCC_HPP
+
+#include <string>
+#include <map>
+
+namespace bohrium {
+
+class CompilerTCC {
+public:
+    /**
+     * An in-process compiler based on libtcc, which compiles sourcecode directly
+     * into memory thus no process is spawned and no file is written.
+     *
+     * 'inc' and 'flg' are command line options such as "-I/path" and "-DNDEBUG".
+     * NB: libtcc ignores the OpenMP pragmas thus the kernels runs sequentially.
+     */
+    CompilerTCC(std::string inc, std::string flg, bool verbose);
+    ~CompilerTCC();
+
+    // Returns whether Bohrium was build with libtcc
+    static bool available();
+
+    std::string text() const;
+
+    /**
+     *  Compile the given sourcecode and return the address of 'symbol'.
+     *
+     *  Returns NULL on compilation failure, in which case the caller should fall back to
+     *  the regular compiler. The compiled code lives as long as this object.
+     */
+    void* compile(const std::string &sourcecode, const std::string &symbol);
+
+    // Free the compiled code of 'symbol_addr', which must have been returned by compile()
+    void release(void *symbol_addr);
+
+private:
+    std::string inc_, flg_;
+    bool verbose_;
+    // The TCCState of each compiled kernel indexed by the address of its symbol
+    std::map<void*, void*> states_;
+};
+
+}
+
+#endif
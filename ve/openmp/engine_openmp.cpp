@@ -23,13 +23,22 @@ If not, see <http://www.gnu.org/licenses/>.
 #include <fstream>
 #include <string>
 #include <map>
+#include <set>
+#include <tuple>
+#include <algorithm>
+#include <ctime>
 #include <boost/functional/hash.hpp>
 #include <iomanip>
 #include <dlfcn.h>
+#include <sys/mman.h>
+#include <unistd.h>
 #include <jitk/codegen_util.hpp>
+#include <bh_memory.h>
 #include <thread>
 
 #include "engine_openmp.hpp"
+#include "interpreter.hpp"
+#include "numa.hpp"
 
 using namespace std;
 namespace fs = boost::filesystem;
@@ -38,24 +47,231 @@ namespace bohrium {
 
 static boost::hash<string> hasher;
 
+namespace {
+// Pin the OpenMP runtime once a kernel has loaded it thus dlclose() of the kernels never unloads it.
+// NB: unloading the runtime while its thread pool is alive makes the application segfault
+void pin_openmp_runtime() {
+    static bool pinned = false;
+    if (pinned) {
+        return;
+    }
+    for (const char *name: {"libgomp.so.1", "libomp.so", "libomp.so.5", "libiomp5.so"}) {
+        if (dlopen(name, RTLD_NOW | RTLD_NOLOAD | RTLD_NODELETE) != NULL) {
+            pinned = true;
+            return;
+        }
+    }
+}
+
+// Returns the width in bytes of the widest vector registers of the host ISA
+int host_simd_bytes() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        return 64;
+    } else if (__builtin_cpu_supports("avx")) {
+        return 32;
+    }
+#endif
+    return 16;
+}
+
+// Returns the x86-64 micro-architecture level of the host, e.g. "x86-64-v3", or "generic" when it isn't x86-64
+string host_isa() {
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") and __builtin_cpu_supports("avx512bw") and
+        __builtin_cpu_supports("avx512cd") and __builtin_cpu_supports("avx512dq") and
+        __builtin_cpu_supports("avx512vl")) {
+        return "x86-64-v4";
+    } else if (__builtin_cpu_supports("avx2") and __builtin_cpu_supports("fma") and
+               __builtin_cpu_supports("bmi") and __builtin_cpu_supports("bmi2")) {
+        return "x86-64-v3";
+    } else if (__builtin_cpu_supports("sse4.2") and __builtin_cpu_supports("popcnt")) {
+        return "x86-64-v2";
+    }
+    return "x86-64";
+#else
+    return "generic";
+#endif
+}
+
+// Returns the '-march' of the 'isa' of host_isa() as the oldest CPU of the level, which older compilers know
+// unlike "-march=x86-64-vN" (empty when the ISA is unknown)
+string isa_march(const string &isa) {
+    if (isa == "x86-64-v4") {
+        return "-march=skylake-avx512";
+    } else if (isa == "x86-64-v3") {
+        return "-march=haswell";
+    } else if (isa == "x86-64-v2") {
+        return "-march=nehalem";
+    } else if (isa == "x86-64") {
+        return "-march=x86-64";
+    }
+    return "";
+}
+
+// Returns the features of the host CPU as listed by the kernel (empty when unavailable)
+string host_cpu_features() {
+    ifstream cpuinfo("/proc/cpuinfo");
+    string line;
+    while (getline(cpuinfo, line)) {
+        if (line.compare(0, 5, "flags") == 0) {
+            return line;
+        }
+    }
+    return "";
+}
+
+// Returns 'compiler_flg' of 'config' with the '-march' of the host ISA when 'compiler_isa' is "auto" and the flags
+// have no '-march' of their own
+string compiler_flags(const ConfigParser &config) {
+    string flg = config.defaultGet<string>("compiler_flg", "");
+    const string isa = config.defaultGet<string>("compiler_isa", "auto");
+    if (isa != "auto" and isa != "none") {
+        throw runtime_error("VE-OPENMP: 'compiler_isa' must be 'auto' or 'none'");
+    }
+    if (isa == "auto" and flg.find("-march=") == string::npos) {
+        const string march = isa_march(host_isa());
+        if (not march.empty()) {
+            flg += " " + march;
+        }
+    }
+    return flg;
+}
+
+// Returns the sub-directory of 'cache_dir' of 'config' of the host ISA, thus the hosts of different ISAs that share
+// 'cache_dir' never load the kernels of each other (empty when the cache is disabled). The kernels of '-march=native'
+// depend on every feature of the host CPU thus the features are part of the name.
+fs::path isa_cache_dir(const ConfigParser &config) {
+    const fs::path dir = jitk::expand_user(config.defaultGet<string>("cache_dir", ""));
+    if (dir.empty()) {
+        return dir;
+    }
+    string name = host_isa();
+    if (compiler_flags(config).find("-march=native") != string::npos) {
+        name += "-native-" + jitk::hash_filename(hasher(host_cpu_features()), "");
+    }
+    return dir / name;
+}
+}
+
 EngineOpenMP::EngineOpenMP(const ConfigParser &config, jitk::Statistics &stat) :
                                            tmp_dir(fs::temp_directory_path() / fs::unique_path("bohrium_%%%%")),
                                            source_dir(tmp_dir / "src"),
                                            object_dir(tmp_dir / "obj"),
+                                           cache_dir(isa_cache_dir(config)),
                                            compiler(config.defaultGet<string>("compiler_cmd", "/usr/bin/cc"),
                                                     config.defaultGet<string>("compiler_inc", ""),
                                                     config.defaultGet<string>("compiler_lib", "-lm"),
-                                                    config.defaultGet<string>("compiler_flg", ""),
+                                                    compiler_flags(config),
                                                     config.defaultGet<string>("compiler_ext", "")),
+                                           compiler_hash(hasher(compiler.process_str("OBJ", "SRC"))),
+                                           cache_max_kernels(config.defaultGet<uint64_t>("cache_max_kernels", 0)),
+                                           cache_max_bytes(config.defaultGet<uint64_t>("cache_max_bytes", 0)),
                                            verbose(config.defaultGet<bool>("verbose", false)),
-                                           stat(stat)
+                                           async_compile(config.defaultGet<bool>("async_compile", false)),
+                                           compile_workers(config.defaultGet<int>("compile_workers", 0)),
+                                           kernel_trace(config.defaultGet<string>("kernel_trace", "")),
+                                           stat(stat),
+                                           chunks_per_thread(config.defaultGet<uint64_t>("thread_pool_chunks_per_thread", 4)),
+                                           thread_quota(config.defaultGet<uint64_t>("thread_quota", 0)),
+                                           numa(config.defaultGet<bool>("numa", false)),
+                                           numa_interleave_bytes(config.defaultGet<uint64_t>("numa_interleave_bytes", 0)),
+                                           prefault_min_bytes(config.defaultGet<uint64_t>("prefault_min_bytes", 0)),
+                                           batch_max_bytes(config.defaultGet<uint64_t>("batch_max_bytes", 0)),
+                                           batch_max_kernels(config.defaultGet<uint64_t>("batch_max_kernels", 64)),
+                                           simd_bytes(not config.defaultGet<bool>("compiler_explicit_simd", false) ? 0 :
+                                                      config.defaultGet<int>("compiler_explicit_simd_bytes", 0) > 0 ?
+                                                      config.defaultGet<int>("compiler_explicit_simd_bytes", 0) :
+                                                      host_simd_bytes()),
+                                           pool_executor(config.defaultGet<string>("executor", "openmp") == "pool"),
+                                           stream_chunk_bytes(config.defaultGet<uint64_t>("stream_chunk_bytes", 0)),
+                                           temporal_blocking(config.defaultGet<int64_t>("temporal_blocking", 0)),
+                                           temporal_blocking_tile_bytes(
+                                                   config.defaultGet<uint64_t>("temporal_blocking_tile_bytes", 1048576))
 {
     // Let's make sure that the directories exist
     fs::create_directories(source_dir);
     fs::create_directories(object_dir);
+    if (not cache_dir.empty()) {
+        fs::create_directories(cache_dir);
+    }
+
+    // Let's create the in-process compiler
+    const string compiler_backend = config.defaultGet<string>("compiler_backend", "process");
+    if (compiler_backend == "libtcc") {
+        compiler_tcc.reset(new CompilerTCC(config.defaultGet<string>("compiler_inc", ""),
+                                           config.defaultGet<string>("compiler_tcc_flg", ""), verbose));
+    } else if (compiler_backend != "process") {
+        throw runtime_error("VE-OPENMP: 'compiler_backend' must be 'process' or 'libtcc'");
+    }
+
+    const string executor = config.defaultGet<string>("executor", "openmp");
+    if (executor == "pool" or config.defaultGet<bool>("concurrent_kernels", false) or numa or prefault_min_bytes > 0) {
+        pool.reset(new ThreadPool(config.defaultGet<int>("thread_pool_threads", 0),
+                                  config.defaultGet<bool>("thread_pool_pin", true)));
+    }
+    if (executor != "openmp" and executor != "pool") {
+        throw runtime_error("VE-OPENMP: 'executor' must be 'openmp' or 'pool'");
+    }
+
+    // The OpenMP threads are bound to the hardware threads in order like the threads of the pool, which
+    // first-touch the arrays. NB: the OpenMP runtime reads the environment when the first kernel loads it.
+    if (numa) {
+        setenv("OMP_PROC_BIND", "close", 0);
+        setenv("OMP_PLACES", "threads", 0);
+    }
+
+    if (config.defaultGet<bool>("autotune", false)) {
+        autotuner.reset(new AutoTuner(config, cache_dir.empty() ? fs::path() : cache_dir / "autotune.txt"));
+    }
+
+    if (stat.enabled and config.defaultGet<bool>("perf_counters", false)) {
+        counters.reset(new PerfCounters());
+        if (not counters->available()) {
+            cerr << "[OpenMP] Warning: perf_event_open() failed thus the hardware counters are disabled" << endl;
+            counters.reset();
+        }
+    }
+
+    if (config.defaultGet<bool>("speculate", false)) {
+        speculation.reset(new jitk::FlushPredictor(
+                std::max<uint64_t>(1, config.defaultGet<uint64_t>("speculate_max_flushes", 256)),
+                config.defaultGet<uint64_t>("speculate_depth", 2),
+                config.defaultGet<uint64_t>("speculate_min_count", 2)));
+    }
+
+    // Let's start the compile workers
+    if (async_compile or speculation or batch_max_bytes > 0 or config.defaultGet<bool>("batch_compile", false)) {
+        startWorkers();
+    }
 }
 
 EngineOpenMP::~EngineOpenMP() {
+    // Let's write the kernel trace, which the "warmup:<file>" message can pre-compile later
+    if (not kernel_trace.empty()) {
+        vector<string> sources;
+        for (const auto &hash_and_source: _trace) {
+            sources.push_back(hash_and_source.second);
+        }
+        try {
+            jitk::write_kernel_trace(kernel_trace, "OpenMP", sources);
+        } catch (const std::exception &e) {
+            cerr << e.what() << endl;
+        }
+    }
+
+    // Let's stop the compile workers, kernels still in the queue are simply dropped
+    {
+        std::lock_guard<std::mutex> lock(_jobs_mutex);
+        _shutdown = true;
+    }
+    _jobs_cond.notify_all();
+    for (std::thread &worker: _workers) {
+        worker.join();
+    }
+
     // If this cleanup is enabled, the application segfaults
     // on destruction of the EngineOpenMP class.
     //
@@ -65,94 +281,501 @@ EngineOpenMP::~EngineOpenMP() {
     // See https://stackoverflow.com/questions/5200418/destroying-threads-in-openmp-c
     // for details.
     //
-    // TODO A more sensible way to get around this issue
-    //      would be to also dlopen the openmp library
-    //      itself and therefore increase our reference count
-    //      to it. This enables the kernel so files to be unlinked
-    //      and cleaned up, but prevents the problematic code on
-    //      openmp cleanup to be triggered at bohrium runtime.
-
-    // for(void *handle: _lib_handles) {
+    // NB: evict() is able to dlclose() kernels at runtime since
+    //     load() pins the OpenMP runtime. At exit, we simply leave
+    //     the remaining libraries to the OS.
+
+    // for(auto &kernel: _functions) {
     //     dlerror(); // Reset errors
-    //     if (dlclose(handle)) {
+    //     if (kernel.second.lib_handle != NULL and dlclose(kernel.second.lib_handle)) {
     //         cerr << dlerror() << endl;
     //     }
     // }
 }
 
+KernelFunction EngineOpenMP::lookup(size_t hash) {
+    auto it = _functions.find(hash);
+    if (it == _functions.end()) {
+        return NULL;
+    }
+    _lru.splice(_lru.begin(), _lru, it->second.lru);
+    return it->second.func;
+}
+
+vector<bh_base*> EngineOpenMP::allocate(const jitk::Kernel &kernel) {
+    vector<bh_base*> ret;
+    for (bh_base *base: kernel.getNonTemps()) {
+        if (base->data != NULL) {
+            continue;
+        }
+        bh_data_malloc(base);
+        if (base->data == NULL) {
+            continue;
+        }
+        const uint64_t bytes = static_cast<uint64_t>(bh_base_size(base));
+        if (numa and numa_interleave_bytes > 0 and bytes >= numa_interleave_bytes) {
+            numa::interleave(base->data, bytes);
+        }
+        if (numa or (prefault_min_bytes > 0 and bytes >= prefault_min_bytes)) {
+            ret.push_back(base);
+        }
+    }
+    return ret;
+}
+
+void EngineOpenMP::prefault(vector<bh_base*> &bases) {
+    if (bases.empty()) {
+        return;
+    }
+    trace::Scope scope("openmp", "prefault");
+    for (bh_base *base: bases) {
+        const uint64_t bytes = static_cast<uint64_t>(bh_base_size(base));
+        numa::first_touch(*pool, base->data, bytes);
+        if (numa and stat.enabled) {
+            numa::count_node_bytes(base->data, bytes, stat.numa_node_bytes);
+        }
+    }
+    bases.clear();
+}
+
+const EngineOpenMP::LoadedKernel *EngineOpenMP::findLoaded(size_t hash) const {
+    auto it = _functions.find(hash);
+    return it == _functions.end() ? NULL : &it->second;
+}
+
+KernelFunction EngineOpenMP::insert(size_t hash, KernelFunction func, void *lib_handle, const fs::path &objfile,
+                                    RangeFunction range_func, uint64_t *prefetch_distance) {
+    _lru.push_front(hash);
+    LoadedKernel kernel = {func, range_func, prefetch_distance, lib_handle, objfile, _lru.begin()};
+    _functions[hash] = kernel;
+    // NB: the new kernel is the most recently used thus it is never evicted here
+    while (cache_max_kernels > 0 and _functions.size() > cache_max_kernels) {
+        evict(_lru.back());
+    }
+    return func;
+}
+
+void EngineOpenMP::evict(size_t hash) {
+    auto it = _functions.find(hash);
+    assert(it != _functions.end());
+    const LoadedKernel &kernel = it->second;
+    if (kernel.lib_handle != NULL) {
+        dlerror(); // Reset errors
+        if (dlclose(kernel.lib_handle)) {
+            cerr << dlerror() << endl;
+        }
+    } else if (compiler_tcc) {
+        compiler_tcc->release(*(void **) (&kernel.func));
+    }
+    if (not kernel.objfile.empty()) {
+        boost::system::error_code ec;
+        fs::remove(kernel.objfile, ec);
+    }
+    _lru.erase(kernel.lru);
+    _functions.erase(it);
+}
+
+void EngineOpenMP::trimDirectory(const fs::path &dir) {
+    // The object files of the pending kernels, which are about to be loaded
+    std::set<fs::path> pending;
+    for (const auto &p: _pending) {
+        const fs::path cached = cachePath(p.first);
+        pending.insert(cached.empty() ? object_dir / jitk::hash_filename(p.first, ".so") : cached);
+    }
+
+    // Let's find the total size of the object files sorted by their last write time
+    boost::system::error_code ec;
+    vector<tuple<time_t, uint64_t, fs::path> > files;
+    uint64_t total = 0;
+    for (fs::directory_iterator it(dir, ec), end; not ec and it != end; it.increment(ec)) {
+        const fs::path &path = it->path();
+        if (path.extension() != ".so" or pending.find(path) != pending.end()) {
+            continue;
+        }
+        const uint64_t size = fs::file_size(path, ec);
+        const time_t mtime = fs::last_write_time(path, ec);
+        if (not ec) {
+            files.push_back(make_tuple(mtime, size, path));
+            total += size;
+        }
+        ec.clear();
+    }
+
+    // And delete the least recently used until we are within the limit
+    sort(files.begin(), files.end());
+    for (const auto &file: files) {
+        if (total <= cache_max_bytes) {
+            break;
+        }
+        if (fs::remove(get<2>(file), ec)) {
+            total -= get<1>(file);
+        }
+    }
+    _disk_bytes = total;
+    _disk_scanned = true;
+}
+
 KernelFunction EngineOpenMP::getFunction(const string &source) {
     size_t hash = hasher(source);
-    ++stat.kernel_cache_lookups;
 
     // Do we have the function compiled and ready already?
-    if (_functions.find(hash) != _functions.end()) {
-        return _functions.at(hash);
+    KernelFunction func = lookup(hash);
+    if (func != NULL) {
+        return func;
+    }
+
+    // Is the function being compiled in the background?
+    auto pending = _pending.find(hash);
+    if (pending != _pending.end()) {
+        const fs::path objfile = pending->second.get();
+        _pending.erase(pending);
+        return load(objfile, hash, true);
     }
     ++stat.kernel_cache_misses;
+    func = getCheapFunction(source, hash);
+    if (func != NULL) {
+        return func;
+    }
+    return load(build(source, hash), hash, true);
+}
 
-    // The object file path
-    fs::path objfile = object_dir / jitk::hash_filename(hash, ".so");
+KernelFunction EngineOpenMP::tryGetFunction(const string &source) {
+    size_t hash = hasher(source);
 
-    // Write the source file and compile it (reading from disk)
-    // NB: this is a nice debug option, but will hurt performance
+    KernelFunction func = lookup(hash);
+    if (func != NULL) {
+        return func;
+    }
+
+    auto pending = _pending.find(hash);
+    if (pending != _pending.end()) {
+        if (pending->second.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            return NULL;
+        }
+        // NB: get() re-throws any compile errors
+        const fs::path objfile = pending->second.get();
+        _pending.erase(pending);
+        return load(objfile, hash, true);
+    }
+    ++stat.kernel_cache_misses;
+    func = getCheapFunction(source, hash);
+    if (func != NULL) {
+        return func;
+    }
+
+    schedule(source, hash);
+    return NULL;
+}
+
+void EngineOpenMP::schedule(const string &source, size_t hash) {
+    std::packaged_task<fs::path()> job(std::bind(&EngineOpenMP::build, this, source, hash));
+    _pending[hash] = job.get_future();
+    {
+        std::lock_guard<std::mutex> lock(_jobs_mutex);
+        _jobs.push_back(std::move(job));
+    }
+    _jobs_cond.notify_one();
+}
+
+void EngineOpenMP::compileAll(const vector<string> &sources) {
+    for (const string &source: sources) {
+        const size_t hash = hasher(source);
+        if (_functions.find(hash) != _functions.end() or _pending.find(hash) != _pending.end()) {
+            continue;
+        }
+        ++stat.kernel_cache_misses;
+        if (getCheapFunction(source, hash) == NULL) {
+            schedule(source, hash);
+        }
+    }
+}
+
+KernelFunction EngineOpenMP::getCheapFunction(const string &source, size_t hash) {
+    // Loading from the persistent cache is cheap thus we do it right away
+    const fs::path cached = cachePath(hash);
+    if (not cached.empty() and fs::exists(cached)) {
+        // We touch the file since the least recently used files are the first to go, see trimDirectory()
+        boost::system::error_code ec;
+        fs::last_write_time(cached, time(NULL), ec);
+        return load(cached, hash, false);
+    }
+
+    // So is compiling in-process
+    if (compiler_tcc) {
+        void *launcher = compiler_tcc->compile(source, "launcher");
+        if (launcher != NULL) {
+            // The (clumsy) cast conforms with the ISO C standard, see load()
+            KernelFunction func;
+            *(void **) (&func) = launcher;
+            return insert(hash, func, NULL, fs::path());
+        }
+    }
+    return NULL;
+}
+
+void EngineOpenMP::endFlush() {
+    flushBatch();
+    if (speculation) {
+        const vector<string> sources = speculation->endFlush();
+        if (not sources.empty()) {
+            // NB: compileAll() counts the kernels that it schedules as misses, which we count as speculative
+            //     compiles instead thus the launches they make ready count as hits
+            const uint64_t misses = stat.kernel_cache_misses;
+            compileAll(sources);
+            stat.num_speculative_compiles += stat.kernel_cache_misses - misses;
+            stat.kernel_cache_misses = misses;
+        }
+    }
+}
+
+void EngineOpenMP::warmup(const vector<string> &sources) {
+    if (_workers.empty()) {
+        startWorkers();
+    }
+    compileAll(sources);
+    // Let's wait for the compilation and load the kernels
+    for (const string &source: sources) {
+        getFunction(source);
+    }
+}
+
+void EngineOpenMP::reconfigure(const ConfigParser &config) {
+    // The background compiles use the old compiler thus we wait for them before replacing it
+    for (auto &pending: _pending) {
+        try {
+            pending.second.get();
+        } catch (...) {
+            // The kernel is simply compiled again
+        }
+    }
+    _pending.clear();
+    while (not _lru.empty()) {
+        evict(_lru.back());
+    }
+    compiler = Compiler(config.defaultGet<string>("compiler_cmd", "/usr/bin/cc"),
+                        config.defaultGet<string>("compiler_inc", ""),
+                        config.defaultGet<string>("compiler_lib", "-lm"),
+                        compiler_flags(config),
+                        config.defaultGet<string>("compiler_ext", ""));
+    compiler_hash = hasher(compiler.process_str("OBJ", "SRC"));
+    thread_quota = config.defaultGet<uint64_t>("thread_quota", 0);
     if (verbose) {
-        fs::path srcfile = jitk::write_source2file(source, source_dir, hash, ".c", true);
-        compiler.compile(objfile.string(), srcfile.string());
-    } else {
-        // Pipe the source directly into the compiler thus no source file is written
-        compiler.compile(objfile.string(), source.c_str(), source.size());
+        cout << "Reconfigured compiler: " << compiler.text() << endl;
     }
+}
+
+void EngineOpenMP::startWorkers() {
+    int num_workers = compile_workers;
+    if (num_workers <= 0) {
+        num_workers = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (int i = 0; i < num_workers; ++i) {
+        _workers.push_back(std::thread(&EngineOpenMP::compileWorker, this));
+    }
+}
+
+void EngineOpenMP::compileWorker() {
+    while (true) {
+        std::packaged_task<fs::path()> job;
+        {
+            std::unique_lock<std::mutex> lock(_jobs_mutex);
+            _jobs_cond.wait(lock, [this] { return _shutdown or not _jobs.empty(); });
+            if (_shutdown) {
+                return;
+            }
+            job = std::move(_jobs.front());
+            _jobs.pop_front();
+        }
+        job();
+    }
+}
 
+fs::path EngineOpenMP::cachePath(size_t hash) const {
+    if (cache_dir.empty()) {
+        return fs::path();
+    }
+    size_t key = hash;
+    boost::hash_combine(key, compiler_hash);
+    return cache_dir / jitk::hash_filename(key, ".so");
+}
+
+fs::path EngineOpenMP::build(const string &source, size_t hash) const {
+    // When the persistent cache is enabled, the object file is content-addressed by the source
+    // and the compiler command thus a changed compiler or changed flags will never pick up a stale kernel.
+    const fs::path objfile = cachePath(hash);
+    if (objfile.empty()) {
+        const fs::path ret = object_dir / jitk::hash_filename(hash, ".so");
+        compile(source, hash, ret);
+        return ret;
+    }
+    if (not fs::exists(objfile)) {
+        // We compile into a unique file, which we then rename into place. Since rename is atomic,
+        // concurrent processes sharing 'cache_dir' will never load a partially written library.
+        const fs::path tmpfile = objfile.parent_path() / fs::unique_path(objfile.stem().string() + "-%%%%%%%%.tmp");
+        try {
+            compile(source, hash, tmpfile);
+            fs::rename(tmpfile, objfile);
+        } catch (...) {
+            fs::remove(tmpfile);
+            throw;
+        }
+    } else if (verbose) {
+        cout << "Load cached kernel " << objfile << endl;
+    }
+    return objfile;
+}
+
+KernelFunction EngineOpenMP::load(const fs::path &objfile, size_t hash, bool new_file) {
     // Load the shared library
     void *lib_handle = dlopen(objfile.string().c_str(), RTLD_NOW);
     if (lib_handle == NULL) {
         cerr << "Cannot load library: " << dlerror() << endl;
         throw runtime_error("VE-OPENMP: Cannot load library");
     }
-    _lib_handles.push_back(lib_handle);
+    pin_openmp_runtime();
 
     // Load the launcher function
     // The (clumsy) cast conforms with the ISO C standard and will
     // avoid any compiler warnings.
+    KernelFunction func;
     dlerror(); // Reset errors
-    *(void **) (&_functions[hash]) = dlsym(lib_handle, "launcher");
+    *(void **) (&func) = dlsym(lib_handle, "launcher");
     const char* dlsym_error = dlerror();
     if (dlsym_error) {
         cerr << "Cannot load function launcher(): " << dlsym_error << endl;
         throw runtime_error("VE-OPENMP: Cannot load function launcher()");
     }
+    // Only the kernels that can be split have a range function
+    RangeFunction range_func = NULL;
+    if (rangeKernels()) {
+        *(void **) (&range_func) = dlsym(lib_handle, "launcher_range");
+        dlerror(); // Reset errors
+    }
+    // Only the kernels with software prefetches have a prefetch distance
+    uint64_t *prefetch_distance = static_cast<uint64_t *>(dlsym(lib_handle, "bh_prefetch_distance"));
+    dlerror(); // Reset errors
 
-    return _functions.at(hash);
+    // Let's keep the object files on disk within 'cache_max_bytes'
+    if (new_file and cache_max_bytes > 0) {
+        boost::system::error_code ec;
+        _disk_bytes += fs::file_size(objfile, ec);
+        if (not _disk_scanned or _disk_bytes > cache_max_bytes) {
+            trimDirectory(objfile.parent_path());
+        }
+    }
+
+    // The temporary object files are only needed while the kernel is loaded
+    const bool temporary = objfile.parent_path() == object_dir;
+    return insert(hash, func, lib_handle, temporary ? objfile : fs::path(), range_func, prefetch_distance);
+}
+
+void EngineOpenMP::compile(const string &source, size_t hash, const fs::path &objfile) const {
+    // Write the source file and compile it (reading from disk)
+    // NB: this is a nice debug option, but will hurt performance
+    if (verbose) {
+        fs::path srcfile = jitk::write_source2file(source, source_dir, hash, ".c", true);
+        compiler.compile(objfile.string(), srcfile.string());
+    } else {
+        // Pipe the source directly into the compiler thus no source file is written
+        compiler.compile(objfile.string(), source.c_str(), source.size());
+    }
 }
 
 
 void EngineOpenMP::execute(const std::string &source, const jitk::Kernel &kernel,
                            const std::vector<const jitk::LoopB*> &threaded_blocks,
                            const std::vector<const bh_view*> &offset_strides,
+                           const std::vector<int64_t> &loop_sizes,
                            const std::vector<const bh_instruction*> &constants) {
 
+    // The kernels that aren't batched must wait for the batch
+    const bool batched = batch_max_bytes > 0 and not _concurrent and not _time_blocking and [&kernel, this]() {
+        const jitk::KernelTraffic traffic = kernel.getTraffic();
+        return traffic.bytes_read + traffic.bytes_written <= batch_max_bytes;
+    }();
+    if (not batched) {
+        flushBatch();
+    }
+
     // Make sure all arrays are allocated
-    for (bh_base *base: kernel.getNonTemps()) {
-        bh_data_malloc(base);
+    vector<bh_base*> fresh = allocate(kernel);
+
+    if (not kernel_trace.empty()) {
+        _trace.insert(make_pair(hasher(source), source));
+    }
+    if (speculation) {
+        speculation->record(hasher(source), source);
+    }
+
+    // The profile and the trace of the kernel
+    const size_t hash = stat.enabled or trace::enabled() ? hasher(source) : 0;
+    if (stat.enabled) {
+        jitk::util_record_source(stat, hash, source, source_dir, ".c");
+        stat.record_launch(hash, kernel.getTraffic());
     }
 
     // Compile the kernel
+    trace::Scope compile_scope("openmp", "compile");
+    compile_scope.arg("hash", hash);
     auto tbuild = chrono::steady_clock::now();
-    KernelFunction func = getFunction(source);
+    ++stat.kernel_cache_lookups;
+    KernelFunction func = NULL;
+    if (async_compile) {
+        func = tryGetFunction(source);
+        // While the kernel is being compiled, we interpret it (if possible)
+        if (func == NULL and interpretable(kernel)) {
+            const chrono::duration<double> tcompile = chrono::steady_clock::now() - tbuild;
+            stat.time_compile += tcompile;
+            stat.record_compile(hash, tcompile);
+            compile_scope.end();
+            ++stat.num_interpreted_kernels;
+            flushBatch();
+            flushTimeBlock();
+            prefault(fresh);
+            trace::Scope exec_scope("openmp", "interpret");
+            exec_scope.arg("hash", hash);
+            auto texec = chrono::steady_clock::now();
+            interpret(kernel);
+            const chrono::duration<double> elapsed = chrono::steady_clock::now() - texec;
+            stat.time_exec += elapsed;
+            stat.record_exec(hash, elapsed);
+            return;
+        }
+    }
+    if (func == NULL and not fresh.empty() and lookup(hasher(source)) == NULL) {
+        // The new arrays are pre-faulted while the kernel compiles, or its background compilation finishes
+        // NB: the compilation only touches the engine, which the pre-faulting leaves alone
+        std::future<KernelFunction> compiled = std::async(std::launch::async, [this, &source]() {
+            return getFunction(source);
+        });
+        prefault(fresh);
+        func = compiled.get();
+    } else if (func == NULL) {
+        func = getFunction(source);
+    }
+    prefault(fresh);
     assert(func != NULL);
-    stat.time_compile += chrono::steady_clock::now() - tbuild;
+    const chrono::duration<double> tcompile = chrono::steady_clock::now() - tbuild;
+    stat.time_compile += tcompile;
+    stat.record_compile(hash, tcompile);
+    compile_scope.end();
 
     // Create a 'data_list' of data pointers
-    vector<void*> data_list;
-    data_list.reserve(kernel.getNonTemps().size());
+    // NB: a batched kernel appends its arguments to the arguments of the batch
+    vector<void*> kernel_data_list;
+    vector<void*> &data_list = batched ? _batch.data : kernel_data_list;
+    const size_t data_begin = data_list.size();
+    data_list.reserve(data_begin + kernel.getNonTemps().size());
     for(bh_base *base: kernel.getNonTemps()) {
         assert(base->data != NULL);
         data_list.push_back(base->data);
     }
 
-    // And the offset-and-strides
-    vector<uint64_t> offset_and_strides;
-    offset_and_strides.reserve(offset_strides.size());
+    // And the offset-and-strides followed by the loop sizes
+    vector<uint64_t> kernel_offset_and_strides;
+    vector<uint64_t> &offset_and_strides = batched ? _batch.args : kernel_offset_and_strides;
+    const size_t args_begin = offset_and_strides.size();
+    offset_and_strides.reserve(args_begin + offset_strides.size() + loop_sizes.size());
     for (const bh_view *view: offset_strides) {
         const uint64_t t = (uint64_t) view->start;
         offset_and_strides.push_back(t);
@@ -161,19 +784,426 @@ void EngineOpenMP::execute(const std::string &source, const jitk::Kernel &kernel
             offset_and_strides.push_back(s);
         }
     }
+    for (int64_t size: loop_sizes) {
+        offset_and_strides.push_back((uint64_t) size);
+    }
 
     // And the constants
-    vector<bh_constant_value> constant_arg;
-    constant_arg.reserve(constants.size());
+    vector<bh_constant_value> kernel_constant_arg;
+    vector<bh_constant_value> &constant_arg = batched ? _batch.consts : kernel_constant_arg;
+    const size_t consts_begin = constant_arg.size();
+    constant_arg.reserve(consts_begin + constants.size());
     for (const bh_instruction* instr: constants) {
         constant_arg.push_back(instr->constant.value);
     }
 
+    if (batched) {
+        const size_t source_hash = hasher(source);
+        if (_batched_sources.find(source_hash) == _batched_sources.end()) {
+            _batched_sources.insert(make_pair(source_hash, source));
+        }
+        _batch.kernels.push_back(BatchedKernel{func, source_hash, data_begin, args_begin, consts_begin});
+        boost::hash_combine(_batch.key, source_hash);
+        _batch.bases.insert(kernel.getNonTemps().begin(), kernel.getNonTemps().end());
+        if (_batch.kernels.size() >= batch_max_kernels) {
+            flushBatch();
+        }
+        return;
+    }
+
+    // Kernels of a concurrent wave are launched by endConcurrent()
+    if (_concurrent) {
+        _launches.push_back(Launch{func, std::move(data_list), std::move(offset_and_strides), std::move(constant_arg)});
+        return;
+    }
+
+    // Kernels of a time block are launched by endTimeBlock()
+    if (_time_blocking) {
+        const LoadedKernel *loaded = findLoaded(hasher(source));
+        RangeFunction range_func = loaded != NULL and splittable(kernel.block) ? loaded->range_func : NULL;
+        _time_block.push_back(TimeBlockLaunch{func, range_func, kernel.block.size, std::move(data_list),
+                                              std::move(offset_and_strides), std::move(constant_arg),
+                                              rowAccesses(kernel)});
+        return;
+    }
+
+    const LoadedKernel *loaded = findLoaded(hasher(source));
+
+    // The kernel is tuned for each set of loop sizes since they might be kernel arguments
+    uint64_t tuning_key = 0;
+    size_t variant = 0;
+    if (autotuner) {
+        tuning_key = hasher(source);
+        for (int64_t size: loop_sizes) {
+            boost::hash_combine(tuning_key, size);
+        }
+        variant = autotuner->begin(tuning_key, loaded == NULL ? NULL : loaded->prefetch_distance);
+    }
+
+    // The thread pool executes chunks of the outermost loop of kernels that has a range function
+    RangeFunction range_func = NULL;
+    if (rangeKernels() and splittable(kernel.block) and loaded != NULL) {
+        range_func = loaded->range_func;
+    }
+
+    // The kernels that read enough of the file-backed arrays are streamed
+    vector<bh_base*> streamed;
+    uint64_t streamed_bytes = 0;
+    if (range_func != NULL and stream_chunk_bytes > 0) {
+        for (bh_base *base: kernel.getNonTemps()) {
+            if (bh_memory_is_adopted(base->data)) {
+                streamed.push_back(base);
+                streamed_bytes += static_cast<uint64_t>(bh_base_size(base));
+            }
+        }
+    }
+
+    // The thread quota caps the threads of the kernel, which the auto-tuner might have raised
+    if (thread_quota > 0) {
+        if (not _omp_resolved) {
+            _omp_resolved = true;
+            void *handle = openmp_runtime();
+            if (handle != NULL) {
+                *(void **) (&_set_num_threads) = dlsym(handle, "omp_set_num_threads");
+                *(void **) (&_get_max_threads) = dlsym(handle, "omp_get_max_threads");
+            }
+        }
+        if (_set_num_threads != NULL and _get_max_threads != NULL and
+            static_cast<uint64_t>(_get_max_threads()) > thread_quota) {
+            _set_num_threads(static_cast<int>(thread_quota));
+        }
+    }
+
+    trace::Scope exec_scope("openmp", "exec");
+    exec_scope.arg("hash", hash);
+    const jitk::HardwareCounters counters_before = counters ? counters->read() : jitk::HardwareCounters();
     auto texec = chrono::steady_clock::now();
-    // Call the launcher function, which will execute the kernel
-    func(&data_list[0], &offset_and_strides[0], &constant_arg[0]);
+    if (streamed_bytes > stream_chunk_bytes) {
+        stream(range_func, static_cast<uint64_t>(kernel.block.size), streamed, streamed_bytes, &data_list[0],
+               &offset_and_strides[0], &constant_arg[0]);
+    } else if (range_func != NULL and pool_executor) {
+        const uint64_t size = static_cast<uint64_t>(kernel.block.size);
+        const uint64_t num_chunks = static_cast<uint64_t>(pool->size()) * chunks_per_thread;
+        void **data = &data_list[0];
+        uint64_t *args = &offset_and_strides[0];
+        bh_constant_value *consts = &constant_arg[0];
+        pool->parallel_for(size, (size + num_chunks - 1) / std::max<uint64_t>(1, num_chunks),
+                           [range_func, data, args, consts](uint64_t begin, uint64_t end) {
+                               range_func(begin, end, data, args, consts);
+                           });
+    } else {
+        // Call the launcher function, which will execute the kernel
+        func(&data_list[0], &offset_and_strides[0], &constant_arg[0]);
+    }
+    const auto elapsed = chrono::steady_clock::now() - texec;
+    stat.time_exec += elapsed;
+    stat.record_exec(hash, elapsed);
+    if (counters) {
+        stat.record_counters(hash, counters->read().since(counters_before));
+    }
+    if (autotuner) {
+        autotuner->end(tuning_key, variant, chrono::duration<double>(elapsed).count());
+    }
+
+}
+
+void EngineOpenMP::flushBatch() {
+    if (_batch.kernels.empty()) {
+        return;
+    }
+    trace::Scope exec_scope("openmp", "exec_batch");
+    exec_scope.arg("kernels", _batch.kernels.size());
+    auto texec = chrono::steady_clock::now();
+    KernelFunction func = _batch.kernels.size() > 1 ? batchFunction() : NULL;
+    if (func != NULL) {
+        func(_batch.data.data(), _batch.args.data(), _batch.consts.data());
+        stat.num_batched_kernels += _batch.kernels.size();
+    } else {
+        for (const BatchedKernel &k: _batch.kernels) {
+            k.func(_batch.data.data() + k.data, _batch.args.data() + k.args, _batch.consts.data() + k.consts);
+        }
+    }
+    stat.time_exec += chrono::steady_clock::now() - texec;
+    // NB: the argument arrays keep their capacity for the next batch
+    _batch.kernels.clear();
+    _batch.data.clear();
+    _batch.args.clear();
+    _batch.consts.clear();
+    _batch.bases.clear();
+    _batch.key = 0;
+}
+
+KernelFunction EngineOpenMP::batchFunction() {
+    auto program = _batch_programs.find(_batch.key);
+    if (program == _batch_programs.end()) {
+        // The program includes the kernels, whose functions get unique names, and a launcher that calls their
+        // launchers with their share of the arguments. NB: the includes and the union of the constants come
+        // before the union in each kernel thus we write them once.
+        static const string union_begin = "union dtype {";
+        static const string union_end = "};\n";
+        stringstream prologue, body, launcher;
+        set<string> prologues;
+        launcher << "void launcher(void* data_list[], uint64_t offset_strides[], union dtype constants[]) {\n";
+        for (size_t i = 0; i < _batch.kernels.size(); ++i) {
+            const BatchedKernel &k = _batch.kernels[i];
+            const string &source = _batched_sources.at(k.hash);
+            const size_t begin = source.find(union_begin);
+            const size_t end = begin == string::npos ? string::npos : source.find(union_end, begin);
+            if (end == string::npos) {
+                return NULL;
+            }
+            if (prologues.insert(source.substr(0, begin)).second) {
+                prologue << source.substr(0, begin);
+            }
+            if (i == 0) {
+                prologue << source.substr(begin, end + union_end.size() - begin);
+            }
+            body << "#define execute bh_execute_" << i << "\n";
+            body << "#define execute_unit bh_execute_unit_" << i << "\n";
+            body << "#define launcher bh_launcher_" << i << "\n";
+            body << "#define launcher_range bh_launcher_range_" << i << "\n";
+            body << "#define bh_prefetch_distance bh_prefetch_distance_" << i << "\n";
+            body << source.substr(end + union_end.size()) << "\n";
+            body << "#undef execute\n#undef execute_unit\n#undef launcher\n#undef launcher_range\n#undef bh_prefetch_distance\n";
+            launcher << "    bh_launcher_" << i << "(data_list + " << k.data << ", offset_strides + " << k.args
+                     << ", constants + " << k.consts << ");\n";
+        }
+        launcher << "}\n";
+        const string batch_source = prologue.str() + "\n" + body.str() + launcher.str();
+        program = _batch_programs.insert(make_pair(_batch.key, make_pair(batch_source, hasher(batch_source)))).first;
+    }
+    KernelFunction func = lookup(program->second.second);
+    if (func == NULL) {
+        ++stat.kernel_cache_lookups;
+        func = tryGetFunction(program->second.first);
+    }
+    return func;
+}
+
+void EngineOpenMP::stream(RangeFunction range_func, uint64_t size, const vector<bh_base*> &streamed,
+                          uint64_t streamed_bytes, void **data, uint64_t *args, bh_constant_value *consts) {
+    static const uint64_t page_size = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+    const uint64_t num_chunks = std::min(size, (streamed_bytes + stream_chunk_bytes - 1) / stream_chunk_bytes);
+    const uint64_t rows = (size + num_chunks - 1) / num_chunks;
+
+    // Asks the kernel to read the pages of the iterations [begin, end) ahead, which are the same fraction of each
+    // array when the outermost loop walks the arrays in order. NB: the advice is only a hint.
+    auto read_ahead = [&](uint64_t begin, uint64_t end) {
+        for (bh_base *base: streamed) {
+            const double bytes = static_cast<double>(bh_base_size(base));
+            const uintptr_t data_begin = reinterpret_cast<uintptr_t>(base->data);
+            const uintptr_t first = (data_begin + static_cast<uintptr_t>(bytes * begin / size)) / page_size * page_size;
+            const uintptr_t last = data_begin + static_cast<uintptr_t>(bytes * end / size);
+            if (last > first) {
+                madvise(reinterpret_cast<void *>(first), last - first, MADV_WILLNEED);
+            }
+        }
+    };
+
+    read_ahead(0, rows);
+    for (uint64_t begin = 0; begin < size; begin += rows) {
+        const uint64_t end = std::min(size, begin + rows);
+        if (end < size) {
+            read_ahead(end, std::min(size, end + rows));
+        }
+        if (pool_executor) {
+            const uint64_t num_pool_chunks = static_cast<uint64_t>(pool->size()) * chunks_per_thread;
+            pool->parallel_for(end - begin, (end - begin + num_pool_chunks - 1) / std::max<uint64_t>(1, num_pool_chunks),
+                               [range_func, begin, data, args, consts](uint64_t b, uint64_t e) {
+                                   range_func(begin + b, begin + e, data, args, consts);
+                               });
+        } else {
+            range_func(begin, end, data, args, consts); // The range function forks the OpenMP threads
+        }
+    }
+}
+
+void EngineOpenMP::beginConcurrent() {
+    _concurrent = true;
+}
+
+void EngineOpenMP::endConcurrent() {
+    _concurrent = false;
+    trace::Scope exec_scope("openmp", "exec_concurrent");
+    exec_scope.arg("kernels", _launches.size());
+    auto texec = chrono::steady_clock::now();
+    // NB: the kernels are launched whole since the pool is busy with the kernels themselves
+    pool->parallel_for(_launches.size(), 1, [this](uint64_t begin, uint64_t end) {
+        for (uint64_t i = begin; i < end; ++i) {
+            Launch &launch = _launches[i];
+            launch.func(&launch.data_list[0], &launch.offset_and_strides[0], &launch.constants[0]);
+        }
+    });
+    stat.time_exec += chrono::steady_clock::now() - texec;
+    _launches.clear();
+}
+
+void EngineOpenMP::beginTimeBlock() {
+    flushBatch();
+    _time_blocking = true;
+}
+
+void EngineOpenMP::endTimeBlock() {
+    _time_blocking = false;
+    flushTimeBlock();
+}
+
+vector<EngineOpenMP::RowAccess> EngineOpenMP::rowAccesses(const jitk::Kernel &kernel) {
+    vector<RowAccess> ret;
+    const set<bh_base*> temps = kernel.getAllTemps();
+    const int64_t size = kernel.block.size;
+    for (const jitk::InstrPtr &instr: kernel.block.getAllInstr()) {
+        if (bh_opcode_is_system(instr->opcode)) {
+            continue;
+        }
+        // The indexes of these access any row
+        const bool indexed = instr->opcode == BH_GATHER or instr->opcode == BH_SCATTER or
+                             instr->opcode == BH_COND_SCATTER or instr->opcode == BH_ADD_SCATTER;
+        for (size_t i = 0; i < instr->operand.size(); ++i) {
+            const bh_view &view = instr->operand[i];
+            if (bh_is_constant(&view) or temps.find(view.base) != temps.end()) {
+                continue;
+            }
+            RowAccess access{view.base, 0, 0, i == 0};
+            if (not indexed and view.ndim >= 1 and view.shape[0] == size and view.stride[0] > 0) {
+                // The elements of a row of the view must be within one row of the array
+                int64_t row_span = 1;
+                bool ascending = true;
+                for (int64_t d = 1; d < view.ndim; ++d) {
+                    ascending = ascending and view.stride[d] >= 0;
+                    row_span += (view.shape[d] - 1) * view.stride[d];
+                }
+                if (ascending and view.start % view.stride[0] + row_span <= view.stride[0]) {
+                    access.row = view.start / view.stride[0];
+                    access.stride = view.stride[0];
+                }
+            }
+            ret.push_back(access);
+        }
+    }
+    return ret;
+}
+
+/* The launches of a time block are tiled as a skewed wavefront: tile t of launch j executes the iterations
+ * [t*T - j*skew, (t+1)*T - j*skew) of its outermost loop, and the tiles are executed in order with the launches
+ * of a tile in their original order. Thus the rows that a tile reads were written by the launches before it in
+ * the same or an earlier tile, and when 'skew' keeps up with the rows that the dependencies shift, the tiles
+ * compute exactly what the launches would in order. While a tile executes its 'temporal_blocking' iterations,
+ * its rows stay in the cache.
+ *
+ * Every array that is written must be accessed through aligned views of the same row size, where a launch
+ * accesses the rows it writes through views of the same first row only. Launch j accessing row r in iteration
+ * r - row_j executes it in tile (r - row_j + j*skew) / T thus the launch h < j before it that accesses (and
+ * either writes) the same row stays before it when row_j - row_h <= (j - h) * skew.
+ */
+void EngineOpenMP::flushTimeBlock() {
+    if (_time_block.empty()) {
+        return;
+    }
+    trace::Scope exec_scope("openmp", "exec_time_block");
+    exec_scope.arg("kernels", _time_block.size());
+    auto texec = chrono::steady_clock::now();
+
+    // The row size and bytes of the written arrays, where a zero row size means that the array is never written
+    const int64_t nlaunches = static_cast<int64_t>(_time_block.size());
+    map<const bh_base*, int64_t> row_size;
+    bool tiled = nlaunches > 1;
+    for (const TimeBlockLaunch &launch: _time_block) {
+        tiled = tiled and launch.range_func != NULL;
+        for (const RowAccess &access: launch.accesses) {
+            if (access.write) {
+                row_size[access.base] = access.stride;
+            }
+        }
+    }
+    uint64_t row_bytes = 0;
+    for (const auto &written: row_size) {
+        row_bytes += static_cast<uint64_t>(written.second) * bh_type_size(written.first->type);
+    }
+    for (int64_t j = 0; tiled and j < nlaunches; ++j) {
+        for (const RowAccess &access: _time_block[j].accesses) {
+            auto it = row_size.find(access.base);
+            if (it != row_size.end() and (access.stride == 0 or access.stride != it->second)) {
+                tiled = false;
+            }
+        }
+        for (const RowAccess &write: _time_block[j].accesses) {
+            for (const RowAccess &access: _time_block[j].accesses) {
+                if (write.write and access.base == write.base and access.row != write.row) {
+                    tiled = false;
+                }
+            }
+        }
+    }
+
+    // The smallest skew that keeps the order of the launches that access the same rows
+    int64_t skew = 0;
+    for (int64_t j = 1; tiled and j < nlaunches; ++j) {
+        for (int64_t h = 0; h < j; ++h) {
+            for (const RowAccess &a: _time_block[h].accesses) {
+                for (const RowAccess &b: _time_block[j].accesses) {
+                    if (a.base != b.base or not (a.write or b.write) or b.row <= a.row or
+                        b.row >= a.row + _time_block[h].size or a.row >= b.row + _time_block[j].size) {
+                        continue;
+                    }
+                    skew = std::max(skew, (b.row - a.row + j - h - 1) / (j - h));
+                }
+            }
+        }
+    }
+
+    if (tiled and row_bytes > 0) {
+        const int64_t tile = std::max<int64_t>(1, static_cast<int64_t>(temporal_blocking_tile_bytes / row_bytes));
+        int64_t last_tile = 0;
+        for (int64_t j = 0; j < nlaunches; ++j) {
+            last_tile = std::max(last_tile, (_time_block[j].size - 1 + j * skew) / tile);
+        }
+        for (int64_t t = 0; t <= last_tile; ++t) {
+            for (int64_t j = 0; j < nlaunches; ++j) {
+                TimeBlockLaunch &launch = _time_block[j];
+                const int64_t begin = std::max<int64_t>(0, t * tile - j * skew);
+                const int64_t end = std::min(launch.size, (t + 1) * tile - j * skew);
+                if (begin >= end) {
+                    continue;
+                }
+                void **data = launch.data_list.data();
+                uint64_t *args = launch.offset_and_strides.data();
+                bh_constant_value *consts = launch.constants.data();
+                RangeFunction range_func = launch.range_func;
+                if (pool_executor) {
+                    const uint64_t num_chunks = static_cast<uint64_t>(pool->size()) * chunks_per_thread;
+                    const uint64_t rows = static_cast<uint64_t>(end - begin);
+                    pool->parallel_for(rows, (rows + num_chunks - 1) / std::max<uint64_t>(1, num_chunks),
+                                       [range_func, begin, data, args, consts](uint64_t b, uint64_t e) {
+                                           range_func(begin + b, begin + e, data, args, consts);
+                                       });
+                } else {
+                    range_func(static_cast<uint64_t>(begin), static_cast<uint64_t>(end), data, args, consts);
+                }
+            }
+        }
+        stat.num_time_blocked_kernels += _time_block.size();
+    } else {
+        for (TimeBlockLaunch &launch: _time_block) {
+            launch.func(launch.data_list.data(), launch.offset_and_strides.data(), launch.constants.data());
+        }
+    }
     stat.time_exec += chrono::steady_clock::now() - texec;
+    _time_block.clear();
+}
 
+bool EngineOpenMP::splittable(const jitk::LoopB &kernel_block) {
+    if (kernel_block.rank != 0 or not kernel_block._sweeps.empty() or kernel_block.tile_size != 0 or
+        kernel_block.size <= 1) {
+        return false;
+    }
+    // The ranges of an add-scatter might accumulate into the same elements
+    for (const jitk::InstrPtr &instr: kernel_block.getAllInstr()) {
+        if (instr->opcode == BH_ADD_SCATTER) {
+            return false;
+        }
+    }
+    return true;
 }
 
 void EngineOpenMP::set_constructor_flag(std::vector<bh_instruction*> &instr_list) {
@@ -187,7 +1217,23 @@ std::string EngineOpenMP::info() const {
     ss << "----"                                                           << "\n";
     ss << "OpenMP:"                                                        << "\n";
     ss << "  Hardware threads: " << std::thread::hardware_concurrency()    << "\n";
+    ss << "  Host ISA: " << host_isa()                                    << "\n";
     ss << "  JIT Command: \"" << compiler.process_str("${OBJ}", "${SRC}")  << "\"\n";
+    ss << "  In-process JIT: " << (compiler_tcc ? "libtcc" : "disabled") << "\n";
+    ss << "  Kernel cache: " << (cache_dir.empty() ? "disabled" : cache_dir.string()) << "\n";
+    ss << "  Explicit SIMD: ";
+    if (simd_bytes > 0) {
+        ss << simd_bytes << " bytes\n";
+    } else {
+        ss << "disabled\n";
+    }
+    ss << "  NUMA nodes: " << numa::num_nodes() << (numa ? "" : " (placement disabled)") << "\n";
+    ss << "  Executor: ";
+    if (pool_executor) {
+        ss << "thread pool of " << pool->size() << " threads\n";
+    } else {
+        ss << "OpenMP\n";
+    }
     return ss.str();
 }
 
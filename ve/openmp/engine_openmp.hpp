@@ -25,23 +25,54 @@ If not, see <http://www.gnu.org/licenses/>.
 #include <iostream>
 #include <string>
 #include <map>
+#include <set>
+#include <list>
+#include <memory>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <future>
+#include <condition_variable>
 #include <boost/filesystem.hpp>
 
 #include <bh_config_parser.hpp>
 #include <jitk/statistics.hpp>
 #include <jitk/kernel.hpp>
 #include <jitk/block.hpp>
+#include <jitk/flush_predictor.hpp>
 
 #include "compiler.hpp"
+#include "compiler_tcc.hpp"
+#include "autotuner.hpp"
+#include "perf_counters.hpp"
+#include "thread_pool.hpp"
 
 namespace bohrium {
 
 typedef void (*KernelFunction)(void* data_list[], uint64_t offset_strides[], bh_constant_value constants[]);
+// A kernel function that only executes the iterations [begin, end) of the outermost loop
+typedef void (*RangeFunction)(uint64_t begin, uint64_t end, void* data_list[], uint64_t offset_strides[],
+                              bh_constant_value constants[]);
 
 class EngineOpenMP {
   private:
-    std::map<uint64_t, KernelFunction> _functions;
-    std::vector<void*> _lib_handles;
+    // A loaded kernel function
+    struct LoadedKernel {
+        KernelFunction func;
+        // The range function of the kernel (NULL when the kernel cannot be split)
+        RangeFunction range_func;
+        // The 'bh_prefetch_distance' variable of the kernel (NULL when the kernel has no software prefetches)
+        uint64_t *prefetch_distance;
+        // The shared library of the function (NULL when compiled in-process)
+        void *lib_handle;
+        // The object file to delete when the kernel is evicted (empty when it should be kept)
+        boost::filesystem::path objfile;
+        // The position of the kernel in '_lru'
+        std::list<uint64_t>::iterator lru;
+    };
+    std::map<uint64_t, LoadedKernel> _functions;
+    // The hashes of the loaded kernels ordered by their last use (most recent first)
+    std::list<uint64_t> _lru;
 
     // Path to a temporary directory for the source and object files
     const boost::filesystem::path tmp_dir;
@@ -52,19 +83,233 @@ class EngineOpenMP {
     // Path to the directory of the object files
     const boost::filesystem::path object_dir;
 
-    // The compiler to use when function doesn't exist
-    const Compiler compiler;
+    // Path to the persistent kernel cache shared between processes (empty means disabled)
+    const boost::filesystem::path cache_dir;
+
+    // The compiler to use when function doesn't exist, which reconfigure() replaces
+    Compiler compiler;
+
+    // The in-process compiler, which is tried before 'compiler' (NULL when disabled)
+    std::unique_ptr<CompilerTCC> compiler_tcc;
+
+    // Hash of the compiler command and flags, which is part of the persistent cache key
+    size_t compiler_hash;
+
+    // Maximum number of loaded kernels and maximum size of the object files on disk (zero means unlimited)
+    const uint64_t cache_max_kernels;
+    const uint64_t cache_max_bytes;
 
     // Verbose flag
     const bool verbose;
 
+    // Compile kernels in the background and interpret the kernels meanwhile
+    const bool async_compile;
+
+    // Number of compile workers (zero means one per hardware thread)
+    const int compile_workers;
+
+    // The background compile workers, their job queue, and the kernels currently being compiled
+    std::vector<std::thread> _workers;
+    std::deque<std::packaged_task<boost::filesystem::path()> > _jobs;
+    std::mutex _jobs_mutex;
+    std::condition_variable _jobs_cond;
+    bool _shutdown = false;
+    std::map<uint64_t, std::future<boost::filesystem::path> > _pending;
+
+    // The prediction of the next flushes, whose missing kernels endFlush() compiles ahead of time on the
+    // compile workers (NULL when 'speculate' is disabled)
+    std::unique_ptr<jitk::FlushPredictor> speculation;
+
+    // File to write the trace of executed kernels to at shutdown (empty means disabled)
+    const std::string kernel_trace;
+    std::map<uint64_t, std::string> _trace;
+
     // Some statistics
     jitk::Statistics &stat;
 
-    // Return a kernel function based on the given 'source'
-    KernelFunction getFunction(const std::string &source);
+    // The auto-tuner of the OpenMP scheduling (NULL when disabled)
+    std::unique_ptr<AutoTuner> autotuner;
+
+    // The hardware counters that are read around each launch when profiling (NULL when disabled)
+    std::unique_ptr<PerfCounters> counters;
+
+    // The thread pool that executes the range functions and the concurrent kernels (NULL when the executor
+    // is OpenMP and 'concurrent_kernels' is disabled)
+    std::unique_ptr<ThreadPool> pool;
+    // Number of chunks each pool thread gets of the outermost loop
+    const uint64_t chunks_per_thread;
+
+    // The maximum number of OpenMP threads of a kernel, which is the thread quota of the context scheduling
+    // (zero means no limit). NB: omp_set_num_threads() and omp_get_max_threads() are looked up at the first kernel
+    uint64_t thread_quota;
+    bool _omp_resolved = false;
+    void (*_set_num_threads)(int threads) = NULL;
+    int (*_get_max_threads)() = NULL;
+
+    // Place the arrays allocated by execute() on the NUMA nodes of the threads that compute them, where
+    // arrays of at least 'numa_interleave_bytes' bytes are interleaved over all nodes (zero disables interleaving)
+    const bool numa;
+    const uint64_t numa_interleave_bytes;
+
+    // The new arrays of at least 'prefault_min_bytes' bytes are pre-faulted in parallel on the thread pool before
+    // the kernel, overlapped with its compilation, instead of page faulting in the kernel (zero disables it)
+    const uint64_t prefault_min_bytes;
+
+    // Allocate the non-temporary arrays of 'kernel' that aren't allocated yet and returns the ones to pre-fault
+    std::vector<bh_base*> allocate(const jitk::Kernel &kernel);
+
+    // Touch the pages of the new arrays 'bases' in parallel (see numa::first_touch()) and clears 'bases'
+    void prefault(std::vector<bh_base*> &bases);
+
+    // Execute the range function 'range_func' of a kernel, whose outermost loop has 'size' iterations, in chunks
+    // that read about 'stream_chunk_bytes' of the 'streamed_bytes' bytes of the file-backed arrays 'streamed'
+    void stream(RangeFunction range_func, uint64_t size, const std::vector<bh_base*> &streamed,
+                uint64_t streamed_bytes, void **data, uint64_t *args, bh_constant_value *consts);
+
+    // The launches deferred by execute() between beginConcurrent() and endConcurrent()
+    struct Launch {
+        KernelFunction func;
+        std::vector<void*> data_list;
+        std::vector<uint64_t> offset_and_strides;
+        std::vector<bh_constant_value> constants;
+    };
+    std::vector<Launch> _launches;
+    bool _concurrent = false;
+
+    // The launches deferred by execute() between beginTimeBlock() and endTimeBlock(), which are consecutive
+    // iterations of a BH_REPEAT body. 'accesses' are the views of the non-temporary arrays of the kernel where a
+    // view is "aligned" (a non-zero 'stride') when iteration i of the outermost loop accesses row 'row + i' of
+    // the array only, and a row is 'stride' elements.
+    struct RowAccess {
+        const bh_base *base;
+        int64_t row;
+        int64_t stride;
+        bool write;
+    };
+    struct TimeBlockLaunch {
+        KernelFunction func;
+        RangeFunction range_func;
+        int64_t size;
+        std::vector<void*> data_list;
+        std::vector<uint64_t> offset_and_strides;
+        std::vector<bh_constant_value> constants;
+        std::vector<RowAccess> accesses;
+    };
+    std::vector<TimeBlockLaunch> _time_block;
+    bool _time_blocking = false;
+
+    // Returns the row accesses of the non-temporary arrays of 'kernel'
+    static std::vector<RowAccess> rowAccesses(const jitk::Kernel &kernel);
+
+    // Launches the deferred kernels of the time block (if any), see endTimeBlock()
+    void flushTimeBlock();
+
+    // The tiny kernels of at most 'batch_max_bytes' bytes of traffic (zero disables batching) are deferred by
+    // execute() into a batch of at most 'batch_max_kernels' kernels, whose arguments are marshalled into one set
+    // of argument arrays. flushBatch() launches a batch through one call of a program that runs all of its kernels,
+    // which is compiled in the background the first time the sequence of kernels is batched.
+    const uint64_t batch_max_bytes;
+    const uint64_t batch_max_kernels;
+    struct BatchedKernel {
+        KernelFunction func;
+        size_t hash;
+        size_t data, args, consts;
+    };
+    struct Batch {
+        std::vector<BatchedKernel> kernels;
+        std::vector<void*> data;
+        std::vector<uint64_t> args;
+        std::vector<bh_constant_value> consts;
+        std::set<const bh_base*> bases;
+        size_t key = 0;
+    };
+    Batch _batch;
+    // The sources of the batched kernels and the programs of the batches (source and hash) by their kernel hashes
+    std::map<size_t, std::string> _batched_sources;
+    std::map<size_t, std::pair<std::string, size_t> > _batch_programs;
+
+    // Launches the kernels of the batch (if any)
+    void flushBatch();
+
+    // Returns the program that runs the kernels of the batch, or NULL while it is being compiled
+    KernelFunction batchFunction();
+
+    // Return a kernel function based on the given 'source' or NULL if it isn't compiled yet,
+    // in which case it is scheduled for background compilation
+    KernelFunction tryGetFunction(const std::string &source);
+
+    // Return the kernel function if it can be obtained without running the regular compiler
+    // i.e. from the persistent cache or the in-process compiler, otherwise NULL
+    KernelFunction getCheapFunction(const std::string &source, size_t hash);
+
+    // Compile 'source' into a shared library and return the path to it
+    // NB: this method is thread-safe since it is called by the compile workers
+    boost::filesystem::path build(const std::string &source, size_t hash) const;
+
+    // Compile 'source' into the shared library 'objfile'
+    void compile(const std::string &source, size_t hash, const boost::filesystem::path &objfile) const;
+
+    // Load the kernel function of the shared library 'objfile', which is 'new_file' when it was just compiled
+    KernelFunction load(const boost::filesystem::path &objfile, size_t hash, bool new_file);
+
+    // Return the loaded kernel function of 'hash' and mark it as the most recently used, or NULL if it isn't loaded
+    KernelFunction lookup(size_t hash);
+
+    // Return the loaded kernel of 'hash', or NULL if it isn't loaded
+    const LoadedKernel *findLoaded(size_t hash) const;
+
+    // Register a loaded kernel function and evict the least recently used kernels beyond 'cache_max_kernels'
+    KernelFunction insert(size_t hash, KernelFunction func, void *lib_handle, const boost::filesystem::path &objfile,
+                          RangeFunction range_func = NULL, uint64_t *prefetch_distance = NULL);
+
+    // Unload the kernel of 'hash'
+    void evict(size_t hash);
+
+    // Delete the least recently used object files in 'dir' until they fit within 'cache_max_bytes'
+    // NB: the object files of pending kernels are never deleted
+    void trimDirectory(const boost::filesystem::path &dir);
+
+    // The (approximated) size of the object files on disk, which is recounted by trimDirectory()
+    uint64_t _disk_bytes = 0;
+    bool _disk_scanned = false;
+
+    // Returns the path of the kernel in the persistent cache (empty when the cache is disabled)
+    boost::filesystem::path cachePath(size_t hash) const;
+
+    // Schedule 'source' for compilation by the compile workers
+    void schedule(const std::string &source, size_t hash);
+
+    // Start the compile workers
+    void startWorkers();
+
+    // The main loop of the compile workers
+    void compileWorker();
 
   public:
+    // Width in bytes of the vectors of the explicit SIMD loops (zero disables explicit SIMD)
+    const int simd_bytes;
+
+    // Execute the kernels that can be split on the thread pool instead of OpenMP
+    const bool pool_executor;
+
+    // The bytes of file-backed arrays that each chunk of a streamed kernel reads (zero disables streaming)
+    const uint64_t stream_chunk_bytes;
+
+    // The number of iterations of a BH_REPEAT body that are tiled together by the temporal blocking, where each
+    // tile of the outermost loop reads about 'temporal_blocking_tile_bytes' bytes (zero or one disables it)
+    const int64_t temporal_blocking;
+    const uint64_t temporal_blocking_tile_bytes;
+
+    // Returns true when the kernels that can be split have a range function, which the thread pool,
+    // the streaming, and the temporal blocking call
+    bool rangeKernels() const {
+        return pool_executor or stream_chunk_bytes > 0 or temporal_blocking > 1;
+    }
+
+    // Returns true when the kernel of 'kernel_block' can be split in ranges of its outermost loop, which
+    // requires that the outermost loop has no sweeps and no tiles
+    static bool splittable(const jitk::LoopB &kernel_block);
+
     EngineOpenMP(const ConfigParser &config, jitk::Statistics &stat);
     ~EngineOpenMP();
 
@@ -73,15 +318,49 @@ class EngineOpenMP {
     void execute(const std::string &source, const jitk::Kernel &kernel,
                  const std::vector<const jitk::LoopB*> &threaded_blocks,
                  const std::vector<const bh_view*> &offset_strides,
+                 const std::vector<int64_t> &loop_sizes,
                  const std::vector<const bh_instruction*> &constants);
     void set_constructor_flag(std::vector<bh_instruction*> &instr_list);
+    // The kernels executed between beginConcurrent() and endConcurrent() are independent thus
+    // they are launched concurrently on the thread pool by endConcurrent()
+    void beginConcurrent();
+    void endConcurrent();
+    // The kernels executed between beginTimeBlock() and endTimeBlock() are 'timeBlockIterations()' iterations of
+    // a BH_REPEAT body, which endTimeBlock() launches as a wavefront of tiles of their outermost loops when the
+    // dependencies between their rows allow it (see flushTimeBlock())
+    int64_t timeBlockIterations() const { return temporal_blocking; }
+    void beginTimeBlock();
+    void endTimeBlock();
+    // The end of a flush launches the batched kernels and starts the speculative compiles
+    void endFlush();
+    // Compile the kernels of 'sources' in parallel, without waiting for them to finish
+    void compileAll(const std::vector<std::string> &sources);
+    // Compile and load the kernels of 'sources' in parallel ahead of time, e.g. from a kernel trace
+    void warmup(const std::vector<std::string> &sources);
+    // Return a kernel function based on the given 'source', which bh_bench_overhead also calls to time the hits
+    KernelFunction getFunction(const std::string &source);
+    // Re-read the compiler options of 'config' and unload the kernels compiled with the old options
+    void reconfigure(const ConfigParser &config);
     // Notice, OpenMP has no device thus the device methods does nothing
     template <typename T>
     void copyToHost(T &bases) {}
     template <typename T>
     void copyToDevice(T &base_list) {}
+    // The batched kernels might use 'base', which is about to be freed
+    void delBuffer(bh_base *base) {
+        if (_batch.bases.find(base) != _batch.bases.end()) {
+            flushBatch();
+        }
+    }
+    template <typename T>
+    void hostWrites(T &bases) {}
     template <typename T>
-    void delBuffer(T &base) {}
+    void prefetchToDevice(T &base_list) {}
+    bool onDevice(bh_base *base) const { return false; }
+    void waitKernels() {
+        flushBatch();
+    }
+    void copyRangeToDevice(bh_base *base, uint64_t offset, uint64_t nbytes) {}
 
     // Return a YAML string describing this component
     std::string info() const;
@@ -0,0 +1,427 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <array>
+#include <vector>
+#include <cstring>
+#include <stdexcept>
+
+#include <bh_instruction.hpp>
+#include <bh_opcode.h>
+
+#include "interpreter.hpp"
+
+using namespace std;
+
+namespace bohrium {
+
+namespace {
+
+// Call 'visitor.visit<T>()' where 'T' is the C++ type of 'type'
+template <typename Visitor>
+void visit_type(bh_type type, const Visitor &visitor) {
+    switch (type) {
+        case bh_type::BOOL:    visitor.template visit<bh_bool>();  break;
+        case bh_type::INT8:    visitor.template visit<int8_t>();   break;
+        case bh_type::INT16:   visitor.template visit<int16_t>();  break;
+        case bh_type::INT32:   visitor.template visit<int32_t>();  break;
+        case bh_type::INT64:   visitor.template visit<int64_t>();  break;
+        case bh_type::UINT8:   visitor.template visit<uint8_t>();  break;
+        case bh_type::UINT16:  visitor.template visit<uint16_t>(); break;
+        case bh_type::UINT32:  visitor.template visit<uint32_t>(); break;
+        case bh_type::UINT64:  visitor.template visit<uint64_t>(); break;
+        case bh_type::FLOAT32: visitor.template visit<float>();    break;
+        case bh_type::FLOAT64: visitor.template visit<double>();   break;
+        default:
+            throw runtime_error("Interpreter: unsupported data type");
+    }
+}
+
+bool supported_type(bh_type type) {
+    switch (type) {
+        case bh_type::BOOL:
+        case bh_type::INT8:
+        case bh_type::INT16:
+        case bh_type::INT32:
+        case bh_type::INT64:
+        case bh_type::UINT8:
+        case bh_type::UINT16:
+        case bh_type::UINT32:
+        case bh_type::UINT64:
+        case bh_type::FLOAT32:
+        case bh_type::FLOAT64:
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool is_arithmetic(bh_opcode opcode) {
+    switch (opcode) {
+        case BH_ADD:
+        case BH_SUBTRACT:
+        case BH_MULTIPLY:
+        case BH_DIVIDE:
+        case BH_MAXIMUM:
+        case BH_MINIMUM:
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool is_comparison(bh_opcode opcode) {
+    switch (opcode) {
+        case BH_GREATER:
+        case BH_GREATER_EQUAL:
+        case BH_LESS:
+        case BH_LESS_EQUAL:
+        case BH_EQUAL:
+        case BH_NOT_EQUAL:
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool is_reduction(bh_opcode opcode) {
+    switch (opcode) {
+        case BH_ADD_REDUCE:
+        case BH_MULTIPLY_REDUCE:
+        case BH_MINIMUM_REDUCE:
+        case BH_MAXIMUM_REDUCE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool interpretable(const bh_instruction &instr) {
+    if (bh_opcode_is_system(instr.opcode)) {
+        return true;
+    }
+    for (size_t i = 0; i < instr.operand.size(); ++i) {
+        if (not supported_type(instr.operand_type(i))) {
+            return false;
+        }
+    }
+    const bh_type out_type = instr.operand_type(0);
+    if (is_arithmetic(instr.opcode)) {
+        return out_type != bh_type::BOOL and
+               instr.operand_type(1) == out_type and
+               instr.operand_type(2) == out_type;
+    } else if (is_comparison(instr.opcode)) {
+        return out_type == bh_type::BOOL and instr.operand_type(1) == instr.operand_type(2);
+    } else if (is_reduction(instr.opcode)) {
+        const int64_t in_ndim = instr.operand[1].ndim;
+        return out_type != bh_type::BOOL and instr.operand_type(1) == out_type and
+               instr.operand[0].ndim == (in_ndim > 1 ? in_ndim - 1 : 1);
+    } else if (instr.opcode == BH_IDENTITY) {
+        return true;
+    } else if (instr.opcode == BH_RANGE) {
+        return out_type != bh_type::BOOL;
+    }
+    return false;
+}
+
+// Iterate over the shape of 'views[0]' and call 'func' with the element offset into each view.
+// A NULL view (i.e. a constant) always has the offset zero.
+template <size_t N, typename Func>
+void strided_loop(const array<const bh_view*, N> &views, Func func) {
+    const bh_view &shape_view = *views[0];
+    array<int64_t, N> offset;
+    for (size_t i = 0; i < N; ++i) {
+        offset[i] = views[i] == NULL ? 0 : views[i]->start;
+    }
+    int64_t coord[BH_MAXDIM] = {0};
+    const int64_t nelem = bh_nelements(shape_view);
+    for (int64_t n = 0; n < nelem; ++n) {
+        func(offset);
+        for (int64_t d = shape_view.ndim - 1; d >= 0; --d) {
+            for (size_t i = 0; i < N; ++i) {
+                if (views[i] != NULL) {
+                    offset[i] += views[i]->stride[d];
+                }
+            }
+            if (++coord[d] < shape_view.shape[d]) {
+                break;
+            }
+            for (size_t i = 0; i < N; ++i) {
+                if (views[i] != NULL) {
+                    offset[i] -= views[i]->stride[d] * shape_view.shape[d];
+                }
+            }
+            coord[d] = 0;
+        }
+    }
+}
+
+// Returns the views of the first 'N' operands of 'instr' where constants are NULL
+template <size_t N>
+array<const bh_view*, N> views_of(const bh_instruction &instr) {
+    array<const bh_view*, N> ret;
+    for (size_t i = 0; i < N; ++i) {
+        ret[i] = bh_is_constant(&instr.operand[i]) ? NULL : &instr.operand[i];
+    }
+    return ret;
+}
+
+template <typename T>
+T* data_of(const bh_view &view) {
+    return static_cast<T*>(view.base->data);
+}
+
+// An input operand, which is either an array or a constant
+template <typename T>
+class Input {
+    const T *_data = NULL;
+    T _constant;
+  public:
+    Input(const bh_instruction &instr, size_t idx) {
+        if (bh_is_constant(&instr.operand[idx])) {
+            std::memcpy(&_constant, &instr.constant.value, sizeof(T));
+        } else {
+            _data = data_of<T>(instr.operand[idx]);
+        }
+    }
+    T operator[](int64_t offset) const {
+        return _data == NULL ? _constant : _data[offset];
+    }
+};
+
+template <typename TOut, typename TIn, typename Op>
+void binary_loop(const bh_instruction &instr, Op op) {
+    TOut *out = data_of<TOut>(instr.operand[0]);
+    const Input<TIn> in1(instr, 1), in2(instr, 2);
+    strided_loop<3>(views_of<3>(instr), [&](const array<int64_t, 3> &o) {
+        out[o[0]] = op(in1[o[1]], in2[o[2]]);
+    });
+}
+
+template <typename T, typename Op>
+void reduce_loop(const bh_instruction &instr, Op op) {
+    const bh_view &out_view = instr.operand[0];
+    const bh_view &in_view = instr.operand[1];
+    const int axis = instr.sweep_axis();
+    T *out = data_of<T>(out_view);
+    const T *in = data_of<T>(in_view);
+
+    // The first element along the sweep axis initiates the output
+    bh_view first = in_view;
+    if (in_view.ndim == 1) {
+        first.shape[0] = 1;
+    } else {
+        first.remove_axis(axis);
+    }
+    strided_loop<2>({{&first, &out_view}}, [&](const array<int64_t, 2> &o) {
+        out[o[1]] = in[o[0]];
+    });
+
+    // And the rest is accumulated into the output, which we broadcast along the sweep axis
+    bh_view rest = in_view;
+    rest.start += in_view.stride[axis];
+    rest.shape[axis] -= 1;
+    if (rest.shape[axis] == 0) {
+        return;
+    }
+    bh_view acc = out_view;
+    if (in_view.ndim == 1) {
+        acc.shape[0] = rest.shape[0];
+        acc.stride[0] = 0;
+    } else {
+        acc.insert_axis(axis, rest.shape[axis], 0);
+    }
+    strided_loop<2>({{&rest, &acc}}, [&](const array<int64_t, 2> &o) {
+        out[o[1]] = op(out[o[1]], in[o[0]]);
+    });
+}
+
+struct Arithmetic {
+    const bh_instruction &instr;
+    template <typename T>
+    void visit() const {
+        switch (instr.opcode) {
+            case BH_ADD:
+                binary_loop<T, T>(instr, [](T a, T b) -> T { return a + b; });
+                break;
+            case BH_SUBTRACT:
+                binary_loop<T, T>(instr, [](T a, T b) -> T { return a - b; });
+                break;
+            case BH_MULTIPLY:
+                binary_loop<T, T>(instr, [](T a, T b) -> T { return a * b; });
+                break;
+            case BH_DIVIDE:
+                binary_loop<T, T>(instr, [](T a, T b) -> T { return a / b; });
+                break;
+            case BH_MAXIMUM:
+                binary_loop<T, T>(instr, [](T a, T b) -> T { return a > b ? a : b; });
+                break;
+            case BH_MINIMUM:
+                binary_loop<T, T>(instr, [](T a, T b) -> T { return a < b ? a : b; });
+                break;
+            default:
+                throw runtime_error("Interpreter: unsupported arithmetic opcode");
+        }
+    }
+};
+
+struct Comparison {
+    const bh_instruction &instr;
+    template <typename T>
+    void visit() const {
+        switch (instr.opcode) {
+            case BH_GREATER:
+                binary_loop<bh_bool, T>(instr, [](T a, T b) -> bh_bool { return a > b; });
+                break;
+            case BH_GREATER_EQUAL:
+                binary_loop<bh_bool, T>(instr, [](T a, T b) -> bh_bool { return a >= b; });
+                break;
+            case BH_LESS:
+                binary_loop<bh_bool, T>(instr, [](T a, T b) -> bh_bool { return a < b; });
+                break;
+            case BH_LESS_EQUAL:
+                binary_loop<bh_bool, T>(instr, [](T a, T b) -> bh_bool { return a <= b; });
+                break;
+            case BH_EQUAL:
+                binary_loop<bh_bool, T>(instr, [](T a, T b) -> bh_bool { return a == b; });
+                break;
+            case BH_NOT_EQUAL:
+                binary_loop<bh_bool, T>(instr, [](T a, T b) -> bh_bool { return a != b; });
+                break;
+            default:
+                throw runtime_error("Interpreter: unsupported comparison opcode");
+        }
+    }
+};
+
+struct Reduction {
+    const bh_instruction &instr;
+    template <typename T>
+    void visit() const {
+        switch (instr.opcode) {
+            case BH_ADD_REDUCE:
+                reduce_loop<T>(instr, [](T a, T b) -> T { return a + b; });
+                break;
+            case BH_MULTIPLY_REDUCE:
+                reduce_loop<T>(instr, [](T a, T b) -> T { return a * b; });
+                break;
+            case BH_MAXIMUM_REDUCE:
+                reduce_loop<T>(instr, [](T a, T b) -> T { return a > b ? a : b; });
+                break;
+            case BH_MINIMUM_REDUCE:
+                reduce_loop<T>(instr, [](T a, T b) -> T { return a < b ? a : b; });
+                break;
+            default:
+                throw runtime_error("Interpreter: unsupported reduction opcode");
+        }
+    }
+};
+
+// NB: since 'bh_bool' and 'uint8_t' are the same C++ type, 'to_bool' selects the C99 bool conversion
+template <typename TOut, bool to_bool>
+struct IdentityInput {
+    const bh_instruction &instr;
+    template <typename TIn>
+    void visit() const {
+        TOut *out = data_of<TOut>(instr.operand[0]);
+        const Input<TIn> in(instr, 1);
+        strided_loop<2>(views_of<2>(instr), [&](const array<int64_t, 2> &o) {
+            out[o[0]] = to_bool ? static_cast<TOut>(in[o[1]] != 0) : static_cast<TOut>(in[o[1]]);
+        });
+    }
+};
+
+struct Identity {
+    const bh_instruction &instr;
+    template <typename TOut>
+    void visit() const {
+        if (instr.operand_type(0) == bh_type::BOOL) {
+            visit_type(instr.operand_type(1), IdentityInput<bh_bool, true>{instr});
+        } else {
+            visit_type(instr.operand_type(1), IdentityInput<TOut, false>{instr});
+        }
+    }
+};
+
+struct Range {
+    const bh_instruction &instr;
+    template <typename T>
+    void visit() const {
+        T *out = data_of<T>(instr.operand[0]);
+        uint64_t i = 0;
+        strided_loop<1>(views_of<1>(instr), [&](const array<int64_t, 1> &o) {
+            out[o[0]] = static_cast<T>(i++);
+        });
+    }
+};
+
+void interpret(const bh_instruction &instr) {
+    const bh_opcode opcode = instr.opcode;
+    if (bh_opcode_is_system(opcode)) {
+        return; // System instructions are handled by handle_execution()
+    } else if (is_arithmetic(opcode)) {
+        visit_type(instr.operand_type(0), Arithmetic{instr});
+    } else if (is_comparison(opcode)) {
+        visit_type(instr.operand_type(1), Comparison{instr});
+    } else if (is_reduction(opcode)) {
+        visit_type(instr.operand_type(0), Reduction{instr});
+    } else if (opcode == BH_IDENTITY) {
+        visit_type(instr.operand_type(0), Identity{instr});
+    } else if (opcode == BH_RANGE) {
+        visit_type(instr.operand_type(0), Range{instr});
+    } else {
+        throw runtime_error("Interpreter: unsupported opcode");
+    }
+}
+} // Anonymous name space
+
+bool interpretable(const jitk::Kernel &kernel) {
+    for (const jitk::InstrPtr &instr: kernel.getAllInstr()) {
+        if (not interpretable(*instr)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void interpret(const jitk::Kernel &kernel) {
+    const vector<jitk::InstrPtr> instr_list = kernel.getAllInstr();
+
+    // The temporary arrays of the kernel has been contracted away thus we have to allocate them here
+    vector<bh_base*> temps;
+    for (const jitk::InstrPtr &instr: instr_list) {
+        for (const bh_view &view: instr->operand) {
+            if (not bh_is_constant(&view) and view.base->data == NULL) {
+                bh_data_malloc(view.base);
+                temps.push_back(view.base);
+            }
+        }
+    }
+
+    for (const jitk::InstrPtr &instr: instr_list) {
+        interpret(*instr);
+    }
+
+    for (bh_base *base: temps) {
+        bh_data_free(base);
+    }
+}
+
+} // bohrium
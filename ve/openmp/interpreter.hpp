@@ -0,0 +1,41 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __BH_VE_OPENMP_INTERPRETER_HPP
+#define __BH_VE_OPENMP_INTERPRETER_HPP
+
+#include <jitk/kernel.hpp>
+
+namespace bohrium {
+
+/* The interpreter is a slow but compile-free fallback, which executes the instructions of a kernel
+ * one by one using generic strided loops. It is used while the optimized kernel is being compiled.
+ */
+
+// Returns true when all the instructions in 'kernel' are supported by the interpreter
+bool interpretable(const jitk::Kernel &kernel);
+
+// Execute the instruction in 'kernel'. The non-temporary arrays must be allocated already.
+// NB: 'kernel' must be interpretable()
+void interpret(const jitk::Kernel &kernel);
+
+} // bohrium
+
+#endif
@@ -19,8 +19,10 @@ If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include <cassert>
+#include <algorithm>
 #include <numeric>
 #include <chrono>
+#include <thread>
 
 #include <bh_component.hpp>
 #include <bh_extmethod.hpp>
@@ -35,11 +37,14 @@ If not, see <http://www.gnu.org/licenses/>.
 #include <jitk/fuser_cache.hpp>
 #include <jitk/codegen_util.hpp>
 #include <jitk/statistics.hpp>
+#include <jitk/stat_exporter.hpp>
 #include <jitk/dtype.hpp>
 #include <jitk/apply_fusion.hpp>
+#include <jitk/context_scheduler.hpp>
 
 #include "engine_openmp.hpp"
 #include "openmp_util.hpp"
+#include "roofline.hpp"
 
 using namespace bohrium;
 using namespace jitk;
@@ -49,21 +54,33 @@ using namespace std;
 namespace {
 class Impl : public ComponentImpl {
   private:
-    // Some statistics
+    // Some statistics and their periodic export (NULL when disabled)
     Statistics stat;
+    unique_ptr<StatExporter> exporter;
     // Fuse cache
     FuseCache fcache;
+    // Code generation cache
+    CodegenCache ccache;
+    // Replay cache
+    ReplayCache rcache;
     // Teh OpenMP engine
     EngineOpenMP engine;
+    // The turns of this context at the threads of the process, where a kernel holds 'thread_quota' threads
+    ContextScheduler::Context context;
     // Known extension methods
     map<bh_opcode, extmethod::ExtmethodFace> extmethods;
     //Allocated base arrays
     set<bh_base*> _allocated_bases;
+    // The machine peaks of the roofline, which are measured at the first "roofline" message
+    unique_ptr<MachinePeaks> peaks;
 
   public:
     Impl(int stack_level) : ComponentImpl(stack_level),
-                            stat(config.defaultGet("prof", false)),
-                            fcache(stat), engine(config, stat) {}
+                            stat(config.defaultGet("prof", false) or StatExporter::enabled(config),
+                                 config.defaultGet("prof", false)),
+                            exporter(StatExporter::create(config, "openmp")),
+                            fcache(config, stat), ccache(stat), rcache(config, stat), engine(config, stat),
+                            context("openmp", thread::hardware_concurrency(), config, "thread_quota") {}
     ~Impl();
     void execute(bh_ir *bhir);
     void extmethod(const string &name, bh_opcode opcode) {
@@ -100,6 +117,27 @@ class Impl : public ComponentImpl {
             return ss.str();
         } else if (msg == "info") {
             ss << engine.info();
+        } else if (msg == "roofline") {
+            if (not peaks) {
+                peaks.reset(new MachinePeaks(measure_peaks(config)));
+            }
+            ss << roofline_report(stat, *peaks, stat.num_top_kernels);
+        } else if (msg == "memory") {
+            ss << util_memory_report();
+        } else if (msg.compare(0, 7, "warmup:") == 0) {
+            const vector<string> sources = read_kernel_trace(msg.substr(7), "OpenMP");
+            engine.warmup(sources);
+            ss << "[OpenMP] warmup: " << sources.size() << " kernels\n";
+        } else if (util_fast_math_message(config, msg)) {
+            // The codegen cache keeps the two variants apart but the replays have the sources of the old one
+            rcache.clear();
+        } else if (msg.compare(0, 7, "config:") == 0) {
+            // The option is set by ComponentFace thus we drop everything that depends on the old value
+            fcache.clear();
+            ccache.clear();
+            rcache.clear();
+            engine.reconfigure(config);
+            context.reconfigure(config);
         }
         return ss.str();
     }
@@ -114,13 +152,116 @@ extern "C" void destroy(ComponentImpl* self) {
 }
 
 Impl::~Impl() {
+    if (exporter) {
+        exporter->render(stat);
+    }
     if (stat.print_on_exit) {
         stat.write("OpenMP", config.defaultGet<std::string>("prof_filename", ""), cout);
     }
 }
 
-// Writing the OpenMP header, which include "parallel for" and "simd"
-void write_openmp_header(const SymbolTable &symbols, Scope &scope, const LoopB &block, const ConfigParser &config, stringstream &out) {
+// Returns the first element and the number of elements of the smallest array section that contains 'view'
+pair<int64_t, int64_t> array_section(const bh_view &view) {
+    int64_t first = view.start;
+    int64_t last = view.start;
+    for (int64_t i = 0; i < view.ndim; ++i) {
+        const int64_t extent = (view.shape[i] - 1) * view.stride[i];
+        if (extent < 0) {
+            first += extent;
+        } else {
+            last += extent;
+        }
+    }
+    return make_pair(first, last - first + 1);
+}
+
+// Returns true when the output of 'sweep' (a reduction or an add-scatter) can be an OpenMP array reduction such as
+// reduction(+:a0[0:100]), which reduces into a private copy of the array section for each thread and combines the
+// copies at the end.
+// NB: the output may not be accessed by other instructions in 'block'
+bool openmp_array_reduce_compatible(const Scope &scope, const LoopB &block, const InstrPtr &sweep,
+                                    uint64_t max_bytes) {
+    const bh_view &view = sweep->operand[0];
+    if (not openmp_reduce_compatible(sweep->opcode) or not scope.isArray(view) or
+        bh_type_is_complex(view.base->type)) {
+        return false;
+    }
+    if (static_cast<uint64_t>(array_section(view).second) * bh_type_size(view.base->type) > max_bytes) {
+        return false;
+    }
+    for (const InstrPtr &instr: block.getAllInstr()) {
+        if (instr != sweep and not bh_opcode_is_system(instr->opcode)) {
+            for (const bh_view *v: instr->get_views()) {
+                if (v->base == view.base) {
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+// Writes the number of instructions 'block' executes, e.g. "vsz0*(2+100*(3))"
+void write_loop_work(const SymbolTable &symbols, const LoopB &block, stringstream &out) {
+    write_loop_size(symbols, block, out);
+    int64_t num_instr = 0;
+    for (const Block &b: block._block_list) {
+        if (b.isInstr() and not bh_opcode_is_system(b.getInstr()->opcode)) {
+            ++num_instr;
+        }
+    }
+    out << "*(" << num_instr;
+    for (const Block &b: block._block_list) {
+        if (not b.isInstr()) {
+            out << "+";
+            write_loop_work(symbols, b.getLoop(), out);
+        }
+    }
+    out << ")";
+}
+
+/* Returns the rank-1 loop of the kernel 'root', which is "parallel for" instead of the outermost loop when the
+ * outermost loop has fewer iterations than there are threads (e.g. a kernel over shape (4, 50000000)), or NULL
+ * when the kernel has no data-parallel rank-1 loop that gets a loop header of its own.
+ * NB: the choice is made at runtime since the loop sizes might be variables ('shape_as_var') */
+const LoopB *inner_threaded_block(const SymbolTable &symbols, const LoopB &root, const ConfigParser &config) {
+    if (not config.defaultGet<bool>("compiler_openmp_inner_parallel", false) or root.rank != 0 or
+        root.tile_size > 0) {
+        return NULL;
+    }
+    for (const LoopB *b: util_find_threaded_blocks(root).first) {
+        if (b->rank == 1) {
+            if (b->size > 1 and b->tile_size == 0 and openmp_compatible(*b) and
+                not unrolled_loop(symbols, *b, {}, config)) {
+                return b;
+            }
+            break;
+        }
+    }
+    return NULL;
+}
+
+// Does 'block' combine floating-point values in an order that depends on the threads when it is "parallel for",
+// i.e. the reductions of its sweeps and its add-scatters
+bool thread_dependent_combine(const LoopB &block) {
+    for (const InstrPtr instr: block._sweeps) {
+        if (bh_type_is_float(instr->operand_type(0))) {
+            return true;
+        }
+    }
+    for (const InstrPtr &instr: block.getAllInstr()) {
+        if (instr->opcode == BH_ADD_SCATTER and bh_type_is_float(instr->operand_type(0))) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Writing the OpenMP header of 'block' of the kernel 'root', which include "parallel for" and "simd"
+// NB: the outermost loop is never "parallel for" when it is 'split' by the thread pool
+void write_openmp_header(const SymbolTable &symbols, Scope &scope, const LoopB &block, const LoopB &root,
+                         const ConfigParser &config, const vector<const LoopB *> &threaded_blocks, bool split,
+                         stringstream &out) {
     if (not config.defaultGet<bool>("compiler_openmp", false)) {
         return;
     }
@@ -128,27 +269,80 @@ void write_openmp_header(const SymbolTable &symbols, Scope &scope, const LoopB &
 
     // All reductions that can be handle directly be the OpenMP header e.g. reduction(+:var)
     vector<InstrPtr> openmp_reductions;
+    // And the reductions into arrays that OpenMP handles as array sections e.g. reduction(+:a0[0:100])
+    vector<InstrPtr> openmp_array_reductions;
+    const uint64_t max_array_reduction_bytes = config.defaultGet<uint64_t>("compiler_openmp_reduction_max_bytes", 0);
+
+    // The rank-1 loop, which is "parallel for" when the outermost loop is too short
+    const LoopB *inner = split ? NULL : inner_threaded_block(symbols, root, config);
 
     stringstream ss;
-    // "OpenMP for" goes to the outermost loop
-    if (block.rank == 0 and openmp_compatible(block)) {
+    // The clauses of "parallel for", which go after "simd" of a combined "parallel for simd"
+    stringstream clauses;
+    // "OpenMP for" goes to the outermost loop or to the rank-1 loop
+    const bool inner_parallel = inner != NULL and *inner == block;
+    // NB: the reproducible reductions run serially unless they are partials of the same size (see bcexp)
+    const bool deterministic = config.defaultGet<bool>("deterministic_reductions", false);
+    if ((block.rank == 0 and not split and openmp_compatible(block) and
+         not (deterministic and thread_dependent_combine(block))) or inner_parallel) {
         ss << " parallel for";
+        // The auto-tuner picks the schedule at runtime
+        if (config.defaultGet<bool>("autotune", false)) {
+            clauses << " schedule(runtime)";
+        }
+        // Small kernels run serially since forking threads costs more than it saves
+        vector<string> conditions;
+        const uint64_t threshold = config.defaultGet<uint64_t>("compiler_openmp_threshold", 0);
+        if (threshold > 0) {
+            stringstream cond;
+            write_loop_work(symbols, block, cond);
+            cond << " > " << threshold;
+            conditions.push_back(cond.str());
+        }
+        if (inner != NULL) {
+            stringstream cond;
+            write_loop_size(symbols, root, cond);
+            cond << (inner_parallel ? " < " : " >= ") << "omp_get_max_threads()";
+            conditions.push_back(cond.str());
+        }
+        if (not conditions.empty()) {
+            clauses << " if(";
+            for (size_t i = 0; i < conditions.size(); ++i) {
+                clauses << (i > 0 ? " && " : "") << conditions[i];
+            }
+            clauses << ")";
+        }
         // Since we are doing parallel for, we should either do OpenMP reductions or protect the sweep instructions
         for (const InstrPtr instr: block._sweeps) {
             assert(instr->operand.size() == 3);
             const bh_view &view = instr->operand[0];
             if (openmp_reduce_compatible(instr->opcode) and (scope.isScalarReplaced(view) or scope.isTmp(view.base))) {
                 openmp_reductions.push_back(instr);
+            } else if (openmp_array_reduce_compatible(scope, block, instr, max_array_reduction_bytes)) {
+                openmp_array_reductions.push_back(instr);
             } else if (openmp_atomic_compatible(instr->opcode)) {
                 scope.insertOpenmpAtomic(view);
             } else {
                 scope.insertOpenmpCritical(view);
             }
         }
+        // An add-scatter accumulates into arbitrary elements thus every thread needs its own copy of the output,
+        // e.g. the bins of a histogram, or else the updates must be atomic
+        for (const InstrPtr &instr: block.getAllInstr()) {
+            if (instr->opcode == BH_ADD_SCATTER) {
+                if (openmp_array_reduce_compatible(scope, block, instr, max_array_reduction_bytes)) {
+                    openmp_array_reductions.push_back(instr);
+                } else {
+                    scope.insertOpenmpAtomic(instr->operand[0]);
+                }
+            }
+        }
     }
 
-    // "OpenMP SIMD" goes to the innermost loop (which might also be the outermost loop)
-    if (enable_simd and block.isInnermost() and simd_compatible(block, scope)) {
+    // "OpenMP SIMD" goes to the innermost loop (which might also be the outermost loop) where unrolled loops
+    // are part of the body of their enclosing loop
+    if (enable_simd and innermost_after_unrolling(symbols, block, threaded_blocks, config) and
+        simd_compatible(block, scope)) {
         ss << " simd";
         if (block.rank > 0) { //NB: avoid multiple reduction declarations
             for (const InstrPtr instr: block._sweeps) {
@@ -157,6 +351,8 @@ void write_openmp_header(const SymbolTable &symbols, Scope &scope, const LoopB &
         }
     }
 
+    ss << clauses.str();
+
     //Let's write the OpenMP reductions
     for (const InstrPtr instr: openmp_reductions) {
         assert(instr->operand.size() == 3);
@@ -164,6 +360,11 @@ void write_openmp_header(const SymbolTable &symbols, Scope &scope, const LoopB &
         scope.getName(instr->operand[0], ss);
         ss << ")";
     }
+    for (const InstrPtr instr: openmp_array_reductions) {
+        const pair<int64_t, int64_t> section = array_section(instr->operand[0]);
+        ss << " reduction(" << openmp_reduce_symbol(instr->opcode) << ":a";
+        ss << scope.symbols.baseID(instr->operand[0].base) << "[" << section.first << ":" << section.second << "])";
+    }
     const string ss_str = ss.str();
     if(not ss_str.empty()) {
         out << "#pragma omp" << ss_str << "\n";
@@ -171,9 +372,12 @@ void write_openmp_header(const SymbolTable &symbols, Scope &scope, const LoopB &
     }
 }
 
-// Writes the OpenMP specific for-loop header
-void loop_head_writer(const SymbolTable &symbols, Scope &scope, const LoopB &block, const ConfigParser &config, bool loop_is_peeled,
-                      const vector<const LoopB *> &threaded_blocks, stringstream &out) {
+// Writes the OpenMP specific for-loop header of 'block' of the kernel 'root'
+// When 'ranged' is true, the outermost loop only iterates the range [bh_begin, bh_end) given by the thread pool or
+// the streaming, and when 'split' is true, the thread pool executes the range thus the loop isn't "parallel for"
+void loop_head_writer(const SymbolTable &symbols, Scope &scope, const LoopB &block, const LoopB &root,
+                      const ConfigParser &config, bool loop_is_peeled,
+                      const vector<const LoopB *> &threaded_blocks, bool split, bool ranged, stringstream &out) {
 
     // Let's write the OpenMP loop header
     {
@@ -182,25 +386,52 @@ void loop_head_writer(const SymbolTable &symbols, Scope &scope, const LoopB &blo
             --for_loop_size;
         // No need to parallel one-sized loops
         if (for_loop_size > 1) {
-            write_openmp_header(symbols, scope, block, config, out);
+            write_openmp_header(symbols, scope, block, root, config, threaded_blocks, split, out);
         }
     }
 
     // Write the for-loop header
     string itername;
     {stringstream t; t << "i" << block.rank; itername = t.str();}
+    if (block.tile_size > 0) { // The outer loop of a tiled nest also writes the tile loops
+        if (not block.isInnermost()) {
+            write_tile_loops(symbols, block, out);
+        }
+        out << "for(uint64_t ";
+        write_tiled_loop_range(symbols, block, out);
+        out << "; ++" << itername << ") {\n";
+        return;
+    }
+    if (ranged and block.rank == 0) {
+        out << "for(uint64_t " << itername << "=bh_begin; " << itername << " < (bh_end < ";
+        write_loop_size(symbols, block, out);
+        out << " ? bh_end : ";
+        write_loop_size(symbols, block, out);
+        out << "); ++" << itername << ") {\n";
+        return;
+    }
     out << "for(uint64_t " << itername;
     if (block._sweeps.size() > 0 and loop_is_peeled) // If the for-loop has been peeled, we should start at 1
         out << "=1; ";
     else
         out << "=0; ";
-    out << itername << " < " << block.size << "; ++" << itername << ") {\n";
+    out << itername << " < ";
+    write_loop_size(symbols, block, out);
+    out << "; ++" << itername << ") {\n";
 }
 
+// The alignment in bytes of the arrays of the unit-stride variant of a kernel (a cache line)
+constexpr int UNIT_STRIDE_ALIGNMENT = 64;
+
 void Impl::write_kernel(Kernel &kernel, const SymbolTable &symbols, const ConfigParser &config,
                         const vector<const LoopB *> &threaded_blocks,
                         const vector<const bh_view*> &offset_strides, stringstream &ss) {
 
+    // The thread pool and the streaming execute kernels that they can split in ranges of the outermost loop,
+    // which is 'ranged'. The outermost loop of a kernel that the thread pool splits is never "parallel for".
+    const bool ranged = engine.rangeKernels() and EngineOpenMP::splittable(kernel.block);
+    const bool split = engine.pool_executor and ranged;
+
     // Write the need includes
     ss << "#include <stdint.h>\n";
     ss << "#include <stdlib.h>\n";
@@ -208,62 +439,220 @@ void Impl::write_kernel(Kernel &kernel, const SymbolTable &symbols, const Config
     ss << "#include <complex.h>\n";
     ss << "#include <tgmath.h>\n";
     ss << "#include <math.h>\n";
+    if (engine.simd_bytes > 0 and config.defaultGet<bool>("compiler_streaming_stores", false)) {
+        ss << "#if defined(__SSE2__)\n";
+        ss << "#include <immintrin.h>\n"; // The non-temporal store intrinsics
+        ss << "#endif\n";
+    }
+    if (config.defaultGet<bool>("compiler_openmp", false) and not split and
+        inner_threaded_block(symbols, kernel.block, config) != NULL) {
+        ss << "#ifdef _OPENMP\n";
+        ss << "#include <omp.h>\n"; // The rank-1 loop is "parallel for" when there are more threads than rows
+        ss << "#endif\n";
+    }
     if (kernel.useRandom()) { // Write the random function
         ss << "#include <kernel_dependencies/random123_openmp.h>\n";
     }
+    if (config.defaultGet<bool>("compiler_complex_inline", false)) { // Write the inline complex functions
+        for (const InstrPtr &instr: kernel.getAllInstr()) {
+            if (is_inline_complex(*instr)) {
+                ss << "#include <kernel_dependencies/complex_openmp.h>\n";
+                break;
+            }
+        }
+    }
+    const bool magic_division = config.defaultGet<bool>("compiler_magic_division", false);
+    if (magic_division) { // Write the division by magic numbers
+        for (const InstrPtr &instr: kernel.getAllInstr()) {
+            if (is_magic_division(symbols, *instr)) {
+                ss << "#include <kernel_dependencies/integer_operations.h>\n";
+                break;
+            }
+        }
+    }
+    for (const InstrPtr &instr: kernel.getAllInstr()) { // Write the power functions
+        if (instr->opcode == BH_POWER and bh_type_is_float(instr->operand_type(0))
+            and not bh_type_is_complex(instr->operand_type(0))) {
+            ss << "#include <kernel_dependencies/power_openmp.h>\n";
+            break;
+        }
+    }
     write_c99_dtype_union(ss); // We always need to declare the union of all constant data types
     ss << "\n";
+    // The relaxed floating-point semantic only applies to the functions of this kernel, which might be batched
+    // with other kernels (see EngineOpenMP::batchFunction())
+    const bool fast_math = util_fast_math(config);
+    if (fast_math) {
+        ss << "#if defined(__GNUC__) && !defined(__clang__) && !defined(__TINYC__)\n";
+        ss << "#pragma GCC push_options\n";
+        ss << "#pragma GCC optimize (\"fast-math\")\n";
+        ss << "#endif\n\n";
+    }
+    // The distance in iterations of the software prefetches, which the auto-tuner might change
+    if (config.defaultGet<bool>("compiler_prefetch", false)) {
+        ss << "uint64_t bh_prefetch_distance = " << config.defaultGet<uint64_t>("compiler_prefetch_distance", 16)
+           << ";\n\n";
+    }
 
-    // Write the header of the execute function
-    ss << "void execute";
-    write_kernel_function_arguments(kernel, symbols, offset_strides, write_c99_type, ss, NULL, false);
+    // Write the header of the execute function, which takes the range first when 'ranged'
+    string header;
+    {
+        stringstream args;
+        write_kernel_function_arguments(kernel, symbols, offset_strides, write_c99_type, args, NULL, false);
+        if (ranged) {
+            header = "(uint64_t bh_begin, uint64_t bh_end, " + args.str().substr(1);
+        } else {
+            header = args.str();
+        }
+    }
 
     // Write the block that makes up the body of 'execute()'
-    ss << "{\n";
-    write_loop_block(symbols, NULL, kernel.block, config, {}, false, write_c99_type, loop_head_writer, ss);
-    ss << "}\n\n";
+    stringstream body;
+    if (magic_division) {
+        write_magic_divisors(symbols, kernel.getAllInstr(), body);
+    }
+    const LoopB &root = kernel.block;
+    auto head_writer = [split, ranged, &root](const SymbolTable &symbols, Scope &scope, const LoopB &block,
+                                              const ConfigParser &config, bool loop_is_peeled,
+                                              const vector<const LoopB *> &threaded_blocks, stringstream &out) {
+        loop_head_writer(symbols, scope, block, root, config, loop_is_peeled, threaded_blocks, split, ranged, out);
+    };
+    write_loop_block(symbols, NULL, kernel.block, config, {}, false, write_c99_type, head_writer, body,
+                     engine.simd_bytes);
+    ss << "void execute" << header << "{\n" << body.str() << "}\n\n";
+
+    // The variant of 'execute()' where the innermost strides are one and the arrays are aligned, which the
+    // launcher calls when the offset-and-strides and the data pointers allow it
+    // NB: the views with fewer axes than the kernel doesn't have their last axis in the innermost loop
+    vector<string> unit_strides;
+    if (config.defaultGet<bool>("compiler_unit_stride_variant", false)) {
+        int ndim = 0;
+        for (const bh_view *view: offset_strides) {
+            ndim = std::max(ndim, static_cast<int>(view->ndim));
+        }
+        set<string> unique;
+        for (const bh_view *view: offset_strides) {
+            if (view->ndim == ndim) {
+                stringstream name;
+                name << "vs" << symbols.offsetStridesID(*view) << "_" << ndim - 1;
+                if (unique.insert(name.str()).second) {
+                    unit_strides.push_back(name.str());
+                }
+            }
+        }
+    }
+    if (not unit_strides.empty()) {
+        ss << "void execute_unit" << header << "{\n";
+        for (const string &name: unit_strides) {
+            ss << "#define " << name << " 1\n";
+        }
+        ss << "#if defined(__GNUC__) && !defined(__TINYC__)\n";
+        for (const bh_base *base: kernel.getNonTemps()) {
+            ss << "    a" << symbols.baseID(base) << " = __builtin_assume_aligned(a" << symbols.baseID(base)
+               << ", " << UNIT_STRIDE_ALIGNMENT << ");\n";
+        }
+        ss << "#endif\n";
+        ss << body.str() << "}\n";
+        for (const string &name: unit_strides) {
+            ss << "#undef " << name << "\n";
+        }
+        ss << "\n";
+    }
 
     // Write the launcher function, which will convert the data_list of void pointers
-    // to typed arrays and call the execute function
+    // to typed arrays and call the execute function.
+    // When 'ranged', the launcher executes the whole range of 'launcher_range()', which the thread pool calls.
     {
-        ss << "void launcher(void* data_list[], uint64_t offset_strides[], union dtype constants[]) {\n";
+        if (ranged) {
+            ss << "void launcher_range(uint64_t bh_begin, uint64_t bh_end, ";
+            ss << "void* data_list[], uint64_t offset_strides[], union dtype constants[]) {\n";
+        } else {
+            ss << "void launcher(void* data_list[], uint64_t offset_strides[], union dtype constants[]) {\n";
+        }
         for(size_t i=0; i < kernel.getNonTemps().size(); ++i) {
             spaces(ss, 4);
             bh_base *b = kernel.getNonTemps()[i];
             ss << write_c99_type(b->type) << " *a" << symbols.baseID(b);
             ss << " = data_list[" << i << "];\n";
         }
-        spaces(ss, 4);
-        ss << "execute(";
+        // The arguments of the execute function and the conditions of its unit-stride variant
+        stringstream call;
+        vector<string> conditions;
+        if (ranged) {
+            call << "bh_begin, bh_end, ";
+        }
         for(size_t i=0; i < kernel.getNonTemps().size(); ++i) {
             bh_base *b = kernel.getNonTemps()[i];
-            ss << "a" << symbols.baseID(b);
+            call << "a" << symbols.baseID(b);
             if (i+1 < kernel.getNonTemps().size()) {
-                ss << ", ";
+                call << ", ";
             }
         }
         uint64_t count=0;
         for (const bh_view *view: offset_strides) {
-            ss << ", offset_strides[" << count++ << "]";
+            call << ", offset_strides[" << count++ << "]";
             for (int i=0; i<view->ndim; ++i) {
-                ss << ", offset_strides[" << count++ << "]";
+                stringstream name;
+                name << "vs" << symbols.offsetStridesID(*view) << "_" << i;
+                if (std::find(unit_strides.begin(), unit_strides.end(), name.str()) != unit_strides.end()) {
+                    stringstream condition;
+                    condition << "offset_strides[" << count << "] == 1";
+                    conditions.push_back(condition.str());
+                }
+                call << ", offset_strides[" << count++ << "]";
             }
         }
+        for (size_t i=0; i < symbols.loopSizes().size(); ++i) {
+            call << ", offset_strides[" << count++ << "]";
+        }
         if (symbols.constIDs().size() > 0) {
             if (kernel.getNonTemps().size() > 0) {
-                ss << ", "; // If any args were written before us, we need a comma
+                call << ", "; // If any args were written before us, we need a comma
             }
             uint64_t i=0;
             for (auto it = symbols.constIDs().begin(); it != symbols.constIDs().end();) {
                 const InstrPtr &instr = *it;
-                ss << "constants[" << i++ << "]." << bh_type_text(instr->constant.type);
+                call << "constants[" << i++ << "]." << bh_type_text(instr->constant.type);
                 if (++it != symbols.constIDs().end()) { // Not the last iteration
-                    ss << ", ";
+                    call << ", ";
                 }
             }
         }
-        ss << ");\n";
+        if (unit_strides.empty()) {
+            spaces(ss, 4);
+            ss << "execute(" << call.str() << ");\n";
+        } else {
+            for (const bh_base *base: kernel.getNonTemps()) {
+                stringstream condition;
+                condition << "((uintptr_t) a" << symbols.baseID(base) << ") % " << UNIT_STRIDE_ALIGNMENT << " == 0";
+                conditions.push_back(condition.str());
+            }
+            spaces(ss, 4);
+            ss << "if (";
+            for (size_t i = 0; i < conditions.size(); ++i) {
+                ss << (i > 0 ? " && " : "") << conditions[i];
+            }
+            ss << ") {\n";
+            spaces(ss, 8);
+            ss << "execute_unit(" << call.str() << ");\n";
+            spaces(ss, 4);
+            ss << "} else {\n";
+            spaces(ss, 8);
+            ss << "execute(" << call.str() << ");\n";
+            spaces(ss, 4);
+            ss << "}\n";
+        }
         ss << "}\n";
+        if (ranged) {
+            ss << "\nvoid launcher(void* data_list[], uint64_t offset_strides[], union dtype constants[]) {\n";
+            ss << "    launcher_range(0, UINT64_MAX, data_list, offset_strides, constants);\n";
+            ss << "}\n";
+        }
+    }
+    if (fast_math) {
+        ss << "\n#if defined(__GNUC__) && !defined(__clang__) && !defined(__TINYC__)\n";
+        ss << "#pragma GCC pop_options\n";
+        ss << "#endif\n";
     }
 }
 
@@ -272,5 +661,8 @@ void Impl::execute(bh_ir *bhir) {
     util_handle_extmethod(this, bhir, extmethods);
 
     // And then the regular instructions
-    handle_execution(*this, bhir, engine, config, stat, fcache, NULL);
+    handle_execution(*this, bhir, engine, config, stat, fcache, ccache, rcache, NULL, NULL, NULL, &context);
+    if (exporter) {
+        exporter->update(stat);
+    }
 }
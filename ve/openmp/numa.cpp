@@ -0,0 +1,101 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <fstream>
+#include <string>
+#include <algorithm>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+#include "numa.hpp"
+
+using namespace std;
+
+namespace bohrium {
+namespace numa {
+
+namespace {
+uint64_t page_size() {
+    static const uint64_t ret = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+    return ret;
+}
+}
+
+int num_nodes() {
+    // The online nodes are listed like "0-1" or "0,2-3" and the last one is the highest node
+    ifstream file("/sys/devices/system/node/online");
+    string online;
+    if (not (file >> online) or online.empty()) {
+        return 1;
+    }
+    const size_t last = online.find_last_of(",-");
+    return std::stoi(last == string::npos ? online : online.substr(last + 1)) + 1;
+}
+
+bool interleave(void *data, uint64_t bytes) {
+    const int nodes = std::min(num_nodes(), 64);
+    if (nodes <= 1) {
+        return false;
+    }
+    const unsigned long mask = nodes == 64 ? ~0UL : (1UL << nodes) - 1;
+    return syscall(SYS_mbind, data, bytes, MPOL_INTERLEAVE, &mask, nodes + 1, 0) == 0;
+}
+
+void first_touch(ThreadPool &pool, void *data, uint64_t bytes) {
+    const uint64_t pages = (bytes + page_size() - 1) / page_size();
+    const uint64_t threads = static_cast<uint64_t>(pool.size());
+    char *begin = static_cast<char *>(data);
+    // NB: writing zeros doesn't change the content of freshly mapped pages
+    pool.parallel_for(pages, (pages + threads - 1) / threads, [begin](uint64_t first, uint64_t last) {
+        for (uint64_t p = first; p < last; ++p) {
+            begin[p * page_size()] = 0;
+        }
+    }, false);
+}
+
+void count_node_bytes(const void *data, uint64_t bytes, vector<uint64_t> &node_bytes) {
+    const uint64_t pages = (bytes + page_size() - 1) / page_size();
+    const char *begin = static_cast<const char *>(data);
+    // NB: move_pages() without target nodes only reports the node of each page
+    const uint64_t batch = 1024;
+    vector<void *> addrs(batch);
+    vector<int> status(batch);
+    for (uint64_t first = 0; first < pages; first += batch) {
+        const uint64_t count = std::min(batch, pages - first);
+        for (uint64_t i = 0; i < count; ++i) {
+            addrs[i] = const_cast<char *>(begin + (first + i) * page_size());
+        }
+        if (syscall(SYS_move_pages, 0, count, &addrs[0], NULL, &status[0], 0) != 0) {
+            return;
+        }
+        for (uint64_t i = 0; i < count; ++i) {
+            if (status[i] >= 0) {
+                if (node_bytes.size() <= static_cast<size_t>(status[i])) {
+                    node_bytes.resize(status[i] + 1, 0);
+                }
+                node_bytes[status[i]] += std::min(page_size(), bytes - (first + i) * page_size());
+            }
+        }
+    }
+}
+
+} // numa
+} // bohrium
@@ -0,0 +1,49 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __BH_VE_OPENMP_NUMA_HPP
+#define __BH_VE_OPENMP_NUMA_HPP
+
+#include <vector>
+#include <cstdint>
+
+#include "thread_pool.hpp"
+
+namespace bohrium {
+namespace numa {
+
+// Returns the number of online NUMA nodes (one when the system isn't NUMA)
+int num_nodes();
+
+// Sets the memory policy of the pages of 'data' to interleave over all nodes, which must be done before
+// the pages are touched. Returns false on failure.
+bool interleave(void *data, uint64_t bytes);
+
+// Touches the pages of 'data' the same way the static schedule of OpenMP splits a contiguous array thus
+// each page is placed on the node of the thread that later computes it
+void first_touch(ThreadPool &pool, void *data, uint64_t bytes);
+
+// Adds the bytes of the pages of 'data' to 'node_bytes' at the index of the node they are placed on
+void count_node_bytes(const void *data, uint64_t bytes, std::vector<uint64_t> &node_bytes);
+
+} // numa
+} // bohrium
+
+#endif
@@ -29,6 +29,7 @@ If not, see <http://www.gnu.org/licenses/>.
 const char* openmp_reduce_symbol(bh_opcode opcode) {
     switch (opcode) {
         case BH_ADD_REDUCE:
+        case BH_ADD_SCATTER:
             return "+";
         case BH_MULTIPLY_REDUCE:
             return "*";
@@ -73,8 +74,11 @@ bool simd_compatible(const bohrium::jitk::LoopB &block,
             return false;
     }
 
-    // An OpenMP SIMD loop does not support ANY OpenMP pragmas
+    // An OpenMP SIMD loop does not support ANY OpenMP pragmas and the lanes of an add-scatter might conflict
     for (bohrium::jitk::InstrPtr instr: block.getAllInstr()) {
+        if (instr->opcode == BH_ADD_SCATTER) {
+            return false;
+        }
         for(const bh_view *view: instr->get_views()) {
             if (scope.isOpenmpAtomic(*view) or scope.isOpenmpCritical(*view))
                 return false;
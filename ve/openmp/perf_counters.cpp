@@ -0,0 +1,123 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cstring>
+#include <dirent.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+
+#include "perf_counters.hpp"
+
+using namespace std;
+
+namespace bohrium {
+
+namespace {
+#ifdef __linux__
+// Open the counter 'config' of the thread 'tid' in the group of 'group_fd' (-1 opens a group)
+int open_counter(uint64_t config, long tid, int group_fd) {
+    perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+    return static_cast<int>(syscall(__NR_perf_event_open, &attr, tid, -1, group_fd, 0));
+}
+#endif
+} // Unnamed namespace
+
+PerfCounters::PerfCounters() : _available(true) {
+    scan();
+    _available = not _groups.empty();
+}
+
+PerfCounters::~PerfCounters() {
+    for (auto &group: _groups) {
+        for (int fd: group.second) {
+            close(fd);
+        }
+    }
+}
+
+void PerfCounters::scan() {
+#ifdef __linux__
+    if (not _available) {
+        return;
+    }
+    DIR *dir = opendir("/proc/self/task");
+    if (dir == NULL) {
+        _available = false;
+        return;
+    }
+    while (dirent *entry = readdir(dir)) {
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+        const long tid = strtol(entry->d_name, NULL, 10);
+        if (_groups.find(tid) != _groups.end()) {
+            continue;
+        }
+        array<int, 3> group;
+        group[0] = open_counter(PERF_COUNT_HW_CPU_CYCLES, tid, -1);
+        if (group[0] < 0) {
+            continue; // The thread might have exited in the meantime
+        }
+        group[1] = open_counter(PERF_COUNT_HW_INSTRUCTIONS, tid, group[0]);
+        group[2] = open_counter(PERF_COUNT_HW_CACHE_MISSES, tid, group[0]);
+        if (group[1] < 0 or group[2] < 0) {
+            for (int fd: group) {
+                if (fd >= 0) {
+                    close(fd);
+                }
+            }
+            continue;
+        }
+        _groups[tid] = group;
+    }
+    closedir(dir);
+#else
+    _available = false;
+#endif
+}
+
+jitk::HardwareCounters PerfCounters::read() {
+    jitk::HardwareCounters ret;
+    scan();
+    for (auto &group: _groups) {
+        // The number of counters followed by their values in the order they were added to the group
+        uint64_t values[1 + 3];
+        if (::read(group.second[0], values, sizeof(values)) != static_cast<ssize_t>(sizeof(values))) {
+            continue;
+        }
+        ret.cycles += values[1];
+        ret.instructions += values[2];
+        ret.llc_misses += values[3];
+    }
+    return ret;
+}
+
+} // bohrium
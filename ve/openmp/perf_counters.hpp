@@ -0,0 +1,59 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __BH_VE_OPENMP_PERF_COUNTERS_HPP
+#define __BH_VE_OPENMP_PERF_COUNTERS_HPP
+
+#include <map>
+#include <array>
+
+#include <jitk/statistics.hpp>
+
+namespace bohrium {
+
+/* The hardware counters of all threads of the process, which are counted in user space by perf_event_open().
+ * The threads that the kernels start, e.g. the OpenMP threads, are found by scanning /proc/self/task the first
+ * time a read comes after they have started thus their first kernel isn't counted.
+ */
+class PerfCounters {
+    // The file descriptors of the cycles (the group leader), instructions, and the LLC misses of each thread
+    std::map<long, std::array<int, 3> > _groups;
+    bool _available;
+
+    // Open the counters of the threads that have none
+    void scan();
+
+  public:
+    PerfCounters();
+    ~PerfCounters();
+    PerfCounters(const PerfCounters &other) = delete;
+
+    // Whether the counters could be opened, e.g. perf_event_paranoid or the container might forbid it
+    bool available() const {
+        return _available;
+    }
+
+    // The sum of the counters of all threads since they were opened
+    jitk::HardwareCounters read();
+};
+
+} // bohrium
+
+#endif
@@ -0,0 +1,163 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iomanip>
+#include <numeric>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "roofline.hpp"
+
+using namespace std;
+
+namespace bohrium {
+
+namespace {
+// The doubles of each array of the triad, which should exceed the last-level cache
+constexpr size_t TRIAD_SIZE = size_t(1) << 22;
+// The iterations and independent accumulators of the multiply-add loop of each thread
+constexpr size_t FMA_ITERATIONS = size_t(1) << 22;
+constexpr size_t FMA_ACCUMULATORS = 8;
+constexpr int REPEATS = 5;
+
+// Run 'func(thread_id)' on 'num_threads' threads and returns the seconds until all have finished
+double run_threads(unsigned int num_threads, const function<void(unsigned int)> &func) {
+    const auto begin = chrono::steady_clock::now();
+    vector<thread> threads;
+    for (unsigned int i = 1; i < num_threads; ++i) {
+        threads.emplace_back(func, i);
+    }
+    func(0);
+    for (thread &t: threads) {
+        t.join();
+    }
+    return chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+}
+
+double measure_bandwidth(unsigned int num_threads) {
+    vector<double> a(TRIAD_SIZE), b, c;
+    b.resize(TRIAD_SIZE);
+    c.resize(TRIAD_SIZE);
+    const size_t chunk = (TRIAD_SIZE + num_threads - 1) / num_threads;
+    // The threads touch their own chunks first in order to place them on their NUMA nodes
+    auto triad = [&](unsigned int tid, double scalar) {
+        const size_t end = min(TRIAD_SIZE, (tid + 1) * chunk);
+        for (size_t i = tid * chunk; i < end; ++i) {
+            a[i] = b[i] + scalar * c[i];
+        }
+    };
+    run_threads(num_threads, [&](unsigned int tid) {
+        const size_t end = min(TRIAD_SIZE, (tid + 1) * chunk);
+        fill(b.begin() + min(TRIAD_SIZE, tid * chunk), b.begin() + end, 1.0);
+        fill(c.begin() + min(TRIAD_SIZE, tid * chunk), c.begin() + end, 2.0);
+    });
+    double best = 0;
+    for (int r = 0; r < REPEATS; ++r) {
+        const double secs = run_threads(num_threads, [&](unsigned int tid) { triad(tid, 3.0 + r); });
+        best = max(best, 3.0 * sizeof(double) * TRIAD_SIZE / secs);
+    }
+    return best;
+}
+
+double measure_flops(unsigned int num_threads) {
+    // The factors are volatile such that the compiler cannot fold the loop
+    volatile double factor = 0.999999, addend = 1e-6;
+    vector<double> sinks(num_threads);
+    double best = 0;
+    for (int r = 0; r < REPEATS; ++r) {
+        const double secs = run_threads(num_threads, [&](unsigned int tid) {
+            const double f = factor, g = addend;
+            double acc[FMA_ACCUMULATORS];
+            for (size_t j = 0; j < FMA_ACCUMULATORS; ++j) {
+                acc[j] = j + tid;
+            }
+            for (size_t i = 0; i < FMA_ITERATIONS; ++i) {
+                for (size_t j = 0; j < FMA_ACCUMULATORS; ++j) {
+                    acc[j] = acc[j] * f + g;
+                }
+            }
+            sinks[tid] = accumulate(acc, acc + FMA_ACCUMULATORS, 0.0);
+        });
+        best = max(best, 2.0 * FMA_ACCUMULATORS * FMA_ITERATIONS * num_threads / secs);
+    }
+    // Make the results observable
+    volatile double sink = accumulate(sinks.begin(), sinks.end(), 0.0);
+    (void) sink;
+    return best;
+}
+} // Unnamed namespace
+
+MachinePeaks measure_peaks(const ConfigParser &config, unsigned int num_threads) {
+    if (num_threads == 0) {
+        num_threads = max(1u, thread::hardware_concurrency());
+    }
+    MachinePeaks ret;
+    ret.bytes_per_sec = config.defaultGet<double>("roofline_gbps", 0) * 1e9;
+    ret.flops = config.defaultGet<double>("roofline_gflops", 0) * 1e9;
+    if (ret.bytes_per_sec <= 0) {
+        ret.bytes_per_sec = measure_bandwidth(num_threads);
+    }
+    if (ret.flops <= 0) {
+        ret.flops = measure_flops(num_threads);
+    }
+    return ret;
+}
+
+string roofline_report(const jitk::Statistics &stat, const MachinePeaks &peaks, size_t num_kernels) {
+    stringstream ss;
+    ss << fixed << setprecision(2);
+    ss << "[OpenMP] Roofline: peak " << peaks.bytes_per_sec / 1e9 << " GB/s, " << peaks.flops / 1e9
+       << " GFLOPS, ridge point " << peaks.ridge_point() << " FLOPs/byte\n";
+
+    vector<pair<uint64_t, const jitk::KernelProfile *> > kernels;
+    for (const auto &p: stat.kernel_profiles) {
+        if (p.second.timed_launches > 0) {
+            kernels.emplace_back(p.first, &p.second);
+        }
+    }
+    if (kernels.empty()) {
+        ss << "  No timed kernels, enable 'prof' in the [openmp] section\n";
+        return ss.str();
+    }
+    sort(kernels.begin(), kernels.end(), [](const pair<uint64_t, const jitk::KernelProfile *> &a,
+                                            const pair<uint64_t, const jitk::KernelProfile *> &b) {
+        return a.second->time_exec > b.second->time_exec;
+    });
+    if (kernels.size() > num_kernels) {
+        kernels.resize(num_kernels);
+    }
+    for (const auto &p: kernels) {
+        const jitk::KernelProfile &k = *p.second;
+        const double intensity = k.intensity();
+        const double bound = min(peaks.flops, intensity * peaks.bytes_per_sec);
+        const double achieved = k.flop_rate();
+        ss << "  " << hex << p.first << dec << ": " << intensity << " FLOPs/byte, " << achieved / 1e9
+           << " GFLOPS, " << (bound <= 0 ? 0 : 100 * achieved / bound) << "% of the "
+           << (intensity < peaks.ridge_point() ? "memory" : "compute") << " bound ("
+           << k.time_exec.count() << "s, " << k.bandwidth() << " GB/s)\n";
+    }
+    return ss.str();
+}
+
+} // bohrium
@@ -0,0 +1,55 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __BH_VE_OPENMP_ROOFLINE_HPP
+#define __BH_VE_OPENMP_ROOFLINE_HPP
+
+#include <string>
+
+#include <bh_config_parser.hpp>
+#include <jitk/statistics.hpp>
+
+namespace bohrium {
+
+// The peak memory bandwidth in bytes/s and the peak FLOP rate of the machine
+struct MachinePeaks {
+    double bytes_per_sec;
+    double flops;
+
+    // The arithmetic intensity (FLOPs per byte) where the kernels go from memory-bound to compute-bound
+    double ridge_point() const {
+        return bytes_per_sec <= 0 ? 0 : flops / bytes_per_sec;
+    }
+};
+
+/* Measure the peaks with 'num_threads' threads (zero means one per hardware thread) unless the options
+ * 'roofline_gbps' and 'roofline_gflops' of 'config' are set. The bandwidth is the best of a few STREAM triads
+ * over arrays that exceed the caches and the FLOP rate is the best of a few multiply-add loops with independent
+ * accumulators thus it is the rate that the compiler achieves, which might be below the vector peak.
+ */
+MachinePeaks measure_peaks(const ConfigParser &config, unsigned int num_threads = 0);
+
+// Returns the roofline of the kernel profiles in 'stat', i.e. the arithmetic intensity of each kernel and its
+// FLOP rate in percent of the bound min(peak FLOPs, intensity * peak bandwidth) ordered by execution time
+std::string roofline_report(const jitk::Statistics &stat, const MachinePeaks &peaks, size_t num_kernels);
+
+} // bohrium
+
+#endif
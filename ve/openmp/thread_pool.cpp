@@ -0,0 +1,144 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <pthread.h>
+
+#include "thread_pool.hpp"
+
+using namespace std;
+
+namespace bohrium {
+
+ThreadPool::ThreadPool(int num_threads, bool pin) : _remaining(0) {
+    const int hardware = std::max(1u, std::thread::hardware_concurrency());
+    if (num_threads <= 0) {
+        num_threads = hardware;
+    }
+    for (int i = 0; i < num_threads; ++i) {
+        _queues.push_back(unique_ptr<Queue>(new Queue()));
+    }
+    for (int i = 1; i < num_threads; ++i) {
+        _threads.push_back(std::thread(&ThreadPool::worker, this, static_cast<size_t>(i)));
+        if (pin) {
+            cpu_set_t cpuset;
+            CPU_ZERO(&cpuset);
+            CPU_SET(i % hardware, &cpuset);
+            pthread_setaffinity_np(_threads.back().native_handle(), sizeof(cpu_set_t), &cpuset);
+        }
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        unique_lock<mutex> lock(_mutex);
+        _shutdown = true;
+    }
+    _wake.notify_all();
+    for (std::thread &t: _threads) {
+        t.join();
+    }
+}
+
+bool ThreadPool::next_chunk(size_t id, Range &out) {
+    {
+        Queue &own = *_queues[id];
+        unique_lock<mutex> lock(own.mutex);
+        if (not own.chunks.empty()) {
+            out = own.chunks.front();
+            own.chunks.pop_front();
+            return true;
+        }
+    }
+    // We steal from the back since it is the furthest away from what the owner is working on
+    for (size_t i = 1; _steal and i < _queues.size(); ++i) {
+        Queue &victim = *_queues[(id + i) % _queues.size()];
+        unique_lock<mutex> lock(victim.mutex);
+        if (not victim.chunks.empty()) {
+            out = victim.chunks.back();
+            victim.chunks.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::run_chunks(size_t id) {
+    Range chunk;
+    while (next_chunk(id, chunk)) {
+        (*_task)(chunk.first, chunk.second);
+        if (--_remaining == 0) {
+            unique_lock<mutex> lock(_mutex);
+            _done.notify_all();
+        }
+    }
+}
+
+void ThreadPool::worker(size_t id) {
+    uint64_t seen = 0;
+    while (true) {
+        {
+            unique_lock<mutex> lock(_mutex);
+            _wake.wait(lock, [&]() { return _shutdown or _generation != seen; });
+            if (_shutdown) {
+                return;
+            }
+            seen = _generation;
+        }
+        run_chunks(id);
+    }
+}
+
+void ThreadPool::parallel_for(uint64_t n, uint64_t chunk, const function<void(uint64_t, uint64_t)> &task,
+                              bool steal) {
+    chunk = std::max<uint64_t>(1, chunk);
+    const uint64_t num_chunks = (n + chunk - 1) / chunk;
+    if (num_chunks <= 1 or _queues.size() == 1) {
+        if (n > 0) {
+            task(0, n);
+        }
+        return;
+    }
+
+    // NB: the task and the counter must be set before the chunks become visible to the threads
+    _task = &task;
+    _steal = steal;
+    _remaining = num_chunks;
+    // Each thread gets a contiguous share of the chunks
+    const uint64_t share = (num_chunks + _queues.size() - 1) / _queues.size();
+    for (size_t i = 0; i < _queues.size(); ++i) {
+        Queue &queue = *_queues[i];
+        unique_lock<mutex> lock(queue.mutex);
+        for (uint64_t c = i * share; c < std::min(num_chunks, (i + 1) * share); ++c) {
+            queue.chunks.push_back(make_pair(c * chunk, std::min(n, (c + 1) * chunk)));
+        }
+    }
+    {
+        unique_lock<mutex> lock(_mutex);
+        ++_generation;
+    }
+    _wake.notify_all();
+
+    run_chunks(0);
+    unique_lock<mutex> lock(_mutex);
+    _done.wait(lock, [&]() { return _remaining == 0; });
+}
+
+} // bohrium
@@ -0,0 +1,92 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __BH_VE_OPENMP_THREAD_POOL_HPP
+#define __BH_VE_OPENMP_THREAD_POOL_HPP
+
+#include <deque>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <condition_variable>
+#include <cstdint>
+
+namespace bohrium {
+
+/* A persistent pool of threads that executes the chunks of a range in parallel. Each thread has its own
+ * queue of chunks and steals from the back of the other queues when its own runs dry. The calling thread
+ * takes part in the work as the first thread of the pool.
+ */
+class ThreadPool {
+public:
+    // Starts 'num_threads-1' threads (zero means one per hardware thread), which are pinned
+    // to their own core when 'pin' is true
+    ThreadPool(int num_threads, bool pin);
+    ~ThreadPool();
+
+    // Returns the number of threads including the calling thread
+    int size() const {
+        return static_cast<int>(_queues.size());
+    }
+
+    // Calls 'task(begin, end)' on chunks of at most 'chunk' iterations that covers [0, 'n')
+    // and returns when all of them are done. NB: must not be called concurrently.
+    // When 'steal' is false, each thread executes exactly its own contiguous share of the chunks like the
+    // static schedule of OpenMP, e.g. when first-touching memory.
+    void parallel_for(uint64_t n, uint64_t chunk, const std::function<void(uint64_t, uint64_t)> &task,
+                      bool steal = true);
+
+private:
+    typedef std::pair<uint64_t, uint64_t> Range;
+    struct Queue {
+        std::deque<Range> chunks;
+        std::mutex mutex;
+    };
+    std::vector<std::unique_ptr<Queue> > _queues;
+    std::vector<std::thread> _threads;
+
+    // The task of the current parallel_for() and its number of unfinished chunks
+    const std::function<void(uint64_t, uint64_t)> *_task = NULL;
+    std::atomic<uint64_t> _remaining;
+    bool _steal = true;
+
+    // The threads sleep on '_wake' until '_generation' changes, and the caller sleeps on '_done'
+    std::mutex _mutex;
+    std::condition_variable _wake;
+    std::condition_variable _done;
+    uint64_t _generation = 0;
+    bool _shutdown = false;
+
+    // Returns the next chunk for thread 'id', which is stolen from the other threads when its own queue is empty
+    bool next_chunk(size_t id, Range &out);
+
+    // Executes chunks until there are none left
+    void run_chunks(size_t id);
+
+    // The main loop of the threads
+    void worker(size_t id);
+};
+
+} // bohrium
+
+#endif
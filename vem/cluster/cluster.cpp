@@ -0,0 +1,784 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <set>
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+#include <bh_bytecode.hpp>
+
+#include "cluster.hpp"
+
+using namespace std;
+
+namespace bohrium {
+namespace cluster {
+
+namespace {
+
+// MPI counts are ints thus we split larger messages
+constexpr uint64_t MAX_MESSAGE_BYTES = 1 << 30;
+
+void isend(const void *data, uint64_t nbytes, int dest, MPI_Comm comm, vector<MPI_Request> &requests) {
+    const char *ptr = static_cast<const char *>(data);
+    while (nbytes > 0) {
+        const int n = static_cast<int>(std::min(nbytes, MAX_MESSAGE_BYTES));
+        requests.emplace_back();
+        MPI_Isend(const_cast<char *>(ptr), n, MPI_BYTE, dest, 0, comm, &requests.back());
+        ptr += n;
+        nbytes -= n;
+    }
+}
+
+void irecv(void *data, uint64_t nbytes, int src, MPI_Comm comm, vector<MPI_Request> &requests) {
+    char *ptr = static_cast<char *>(data);
+    while (nbytes > 0) {
+        const int n = static_cast<int>(std::min(nbytes, MAX_MESSAGE_BYTES));
+        requests.emplace_back();
+        MPI_Irecv(ptr, n, MPI_BYTE, src, 0, comm, &requests.back());
+        ptr += n;
+        nbytes -= n;
+    }
+}
+
+void wait_all(vector<MPI_Request> &requests) {
+    MPI_Waitall(static_cast<int>(requests.size()), requests.data(), MPI_STATUSES_IGNORE);
+    requests.clear();
+}
+
+void bcast(void *data, uint64_t nbytes, MPI_Comm comm) {
+    char *ptr = static_cast<char *>(data);
+    while (nbytes > 0) {
+        const int n = static_cast<int>(std::min(nbytes, MAX_MESSAGE_BYTES));
+        MPI_Bcast(ptr, n, MPI_BYTE, 0, comm);
+        ptr += n;
+        nbytes -= n;
+    }
+}
+
+int comm_rank(MPI_Comm comm) {
+    int ret;
+    MPI_Comm_rank(comm, &ret);
+    return ret;
+}
+
+int comm_size(MPI_Comm comm) {
+    int ret;
+    MPI_Comm_size(comm, &ret);
+    return ret;
+}
+
+// FNV-1a of the data of 'base', which detects host writes between scatters and gathers
+uint64_t checksum(const bh_base *base) {
+    const char *data = static_cast<const char *>(base->data);
+    const uint64_t nbytes = static_cast<uint64_t>(bh_base_size(base));
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    uint64_t i = 0;
+    for (; i + sizeof(uint64_t) <= nbytes; i += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+        hash = (hash ^ word) * 0x100000001b3ULL;
+    }
+    for (; i < nbytes; ++i) {
+        hash = (hash ^ static_cast<uint8_t>(data[i])) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+bh_base *new_base(bh_type type, int64_t nelem) {
+    bh_base *ret = new bh_base();
+    ret->data = NULL;
+    ret->type = type;
+    ret->nelem = nelem;
+    return ret;
+}
+
+// Returns the elements [lo, hi) that 'view' touches, which is empty when the view has no elements
+pair<int64_t, int64_t> view_range(const bh_view &view) {
+    int64_t lo = view.start, hi = view.start;
+    for (int64_t i = 0; i < view.ndim; ++i) {
+        if (view.shape[i] == 0) {
+            return make_pair(0, 0);
+        }
+        const int64_t extent = (view.shape[i] - 1) * view.stride[i];
+        if (extent < 0) {
+            lo += extent;
+        } else {
+            hi += extent;
+        }
+    }
+    return make_pair(lo, hi + 1);
+}
+
+// Returns true when 'view' is row-major contiguous thus it touches all elements of its range
+bool is_dense(const bh_view &view) {
+    int64_t expected = 1;
+    for (int64_t i = view.ndim - 1; i >= 0; --i) {
+        if (view.shape[i] == 1) {
+            continue;
+        }
+        if (view.stride[i] != expected) {
+            return false;
+        }
+        expected *= view.shape[i];
+    }
+    return true;
+}
+
+// Returns a row-major contiguous view of 'base' with the 'ndim' dimensions of 'shape'
+bh_view contiguous_view(bh_base *base, int64_t start, int64_t ndim, const int64_t shape[]) {
+    bh_view ret;
+    ret.base = base;
+    ret.start = start;
+    ret.ndim = ndim;
+    int64_t stride = 1;
+    for (int64_t i = ndim - 1; i >= 0; --i) {
+        ret.shape[i] = shape[i];
+        ret.stride[i] = stride;
+        stride *= shape[i];
+    }
+    return ret;
+}
+
+bh_view flat_view(bh_base *base, int64_t start, int64_t nelem) {
+    return contiguous_view(base, start, 1, &nelem);
+}
+
+bh_instruction system_instr(bh_opcode opcode, bh_base *base) {
+    return bh_instruction(opcode, {flat_view(base, 0, base->nelem)});
+}
+
+bh_instruction copy_instr(bh_base *out, int64_t out_start, bh_base *in, int64_t in_start, int64_t nelem) {
+    return bh_instruction(BH_IDENTITY, {flat_view(out, out_start, nelem), flat_view(in, in_start, nelem)});
+}
+
+void slice_rows(bh_view &view, int64_t begin, int64_t end) {
+    view.start += begin * view.stride[0];
+    view.shape[0] = end - begin;
+}
+
+// The reductions that we can compute as a reduction of partial reductions
+bool is_associative_reduce(bh_opcode opcode) {
+    switch (opcode) {
+        case BH_ADD_REDUCE:
+        case BH_MULTIPLY_REDUCE:
+        case BH_MINIMUM_REDUCE:
+        case BH_MAXIMUM_REDUCE:
+        case BH_LOGICAL_AND_REDUCE:
+        case BH_BITWISE_AND_REDUCE:
+        case BH_LOGICAL_OR_REDUCE:
+        case BH_BITWISE_OR_REDUCE:
+        case BH_LOGICAL_XOR_REDUCE:
+        case BH_BITWISE_XOR_REDUCE:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// The opcodes whose output element only depends on the input elements at the same index
+bool is_splittable(bh_opcode opcode) {
+    return bh_opcode_is_elementwise(opcode) or opcode == BH_RANDOM or opcode == BH_RANGE;
+}
+
+} // Anon namespace
+
+void broadcast(Message type, const vector<char> &payload, MPI_Comm comm) {
+    uint64_t head[2] = {static_cast<uint64_t>(type), payload.size()};
+    MPI_Bcast(head, 2, MPI_UINT64_T, 0, comm);
+    bcast(const_cast<char *>(payload.data()), payload.size(), comm);
+}
+
+Message receive(vector<char> &payload, MPI_Comm comm) {
+    uint64_t head[2];
+    MPI_Bcast(head, 2, MPI_UINT64_T, 0, comm);
+    payload.resize(head[1]);
+    bcast(payload.data(), payload.size(), comm);
+    return static_cast<Message>(head[0]);
+}
+
+int64_t Array::lo(int rank) const {
+    return std::max<int64_t>(0, std::min<int64_t>(nelem, (rank - first_rank) * block));
+}
+
+int64_t Array::hi(int rank) const {
+    return std::max<int64_t>(0, std::min<int64_t>(nelem, (rank - first_rank + 1) * block));
+}
+
+Cluster::Cluster(component::ComponentFace &child, MPI_Comm comm) : rank(comm_rank(comm)), nranks(comm_size(comm)),
+                                                                   child(child), comm(comm) {}
+
+Array &Cluster::add_array(const bh_base *key, bh_type type, int64_t nelem, int64_t block, int first_rank) {
+    Array &ret = _arrays[key];
+    ret.type = type;
+    ret.nelem = nelem;
+    ret.block = block > 0 ? block : std::max<int64_t>(1, (nelem + nranks - 1) / nranks);
+    ret.first_rank = first_rank;
+    const int64_t size = ret.hi(rank) - ret.lo(rank);
+    ret.local = size > 0 ? new_base(type, size) : NULL;
+    return ret;
+}
+
+void Cluster::remove_array(const bh_base *key) {
+    auto it = _arrays.find(key);
+    if (it == _arrays.end()) {
+        throw runtime_error("[CLUSTER-VEM] freeing unknown base array");
+    }
+    if (it->second.local != NULL) {
+        _pending.push_back(system_instr(BH_FREE, it->second.local));
+        _dead.push_back(it->second.local);
+    }
+    _arrays.erase(it);
+}
+
+void Cluster::flush() {
+    if (not _pending.empty()) {
+        bh_ir bhir;
+        bhir.instr_list.swap(_pending);
+        child.execute(&bhir);
+    }
+    for (bh_base *base: _dead) {
+        delete base;
+    }
+    _dead.clear();
+}
+
+vector<uint64_t> Cluster::host_writes(const bh_ir &bhir) {
+    vector<uint64_t> ret;
+    set<const bh_base *> seen;
+    for (size_t i = 0; i < bhir.instr_list.size(); ++i) {
+        const bh_instruction &instr = bhir.instr_list[i];
+        if (instr.opcode == BH_FREE) {
+            continue;
+        }
+        for (size_t j = 0; j < instr.operand.size(); ++j) {
+            const bh_base *base = instr.operand[j].base;
+            if (bh_is_constant(&instr.operand[j]) or not seen.insert(base).second or base->data == NULL) {
+                continue;
+            }
+            auto it = _host_sums.find(base);
+            if (it == _host_sums.end() or it->second != checksum(base)) {
+                ret.push_back(i);
+                ret.push_back(j);
+            }
+        }
+    }
+    return ret;
+}
+
+void Cluster::scatter(const bh_base *key) {
+    Array &array = _arrays.at(key);
+    const int64_t type_size = bh_type_size(array.type);
+    vector<MPI_Request> requests;
+    if (rank == 0) {
+        for (int p = 1; p < nranks; ++p) {
+            const char *data = static_cast<const char *>(key->data) + array.lo(p) * type_size;
+            isend(data, (array.hi(p) - array.lo(p)) * type_size, p, comm, requests);
+        }
+    }
+    // The child might know the block already thus we replace it with a new one
+    if (array.local != NULL) {
+        _pending.push_back(system_instr(BH_FREE, array.local));
+        _dead.push_back(array.local);
+        array.local = new_base(array.type, array.local->nelem);
+        bh_data_malloc(array.local);
+        if (rank == 0) {
+            memcpy(array.local->data, key->data, bh_base_size(array.local));
+        } else {
+            irecv(array.local->data, bh_base_size(array.local), 0, comm, requests);
+        }
+    }
+    wait_all(requests);
+    if (rank == 0) {
+        _host_sums[key] = checksum(key);
+    }
+}
+
+void Cluster::gather(const bh_base *key) {
+    Array &array = _arrays.at(key);
+    const int64_t type_size = bh_type_size(array.type);
+    vector<MPI_Request> requests;
+    if (array.local != NULL) {
+        _pending.push_back(system_instr(BH_SYNC, array.local));
+        flush();
+        bh_data_malloc(array.local);
+        if (rank != 0) {
+            isend(array.local->data, bh_base_size(array.local), 0, comm, requests);
+        }
+    }
+    if (rank == 0) {
+        bh_base *base = const_cast<bh_base *>(key);
+        bh_data_malloc(base);
+        if (array.local != NULL) {
+            memcpy(base->data, array.local->data, bh_base_size(array.local));
+        }
+        for (int p = 1; p < nranks; ++p) {
+            char *data = static_cast<char *>(base->data) + array.lo(p) * type_size;
+            irecv(data, (array.hi(p) - array.lo(p)) * type_size, p, comm, requests);
+        }
+    }
+    wait_all(requests);
+    if (rank == 0) {
+        _host_sums[key] = checksum(key);
+    }
+}
+
+void Cluster::execute(const bh_ir &bhir, const vector<uint64_t> &scatters, const vector<bh_base> *new_bases) {
+    // The arrays are new in the order they first appear (like the bytecode)
+    size_t next_new = 0;
+    for (const bh_instruction &instr: bhir.instr_list) {
+        for (const bh_view &view: instr.operand) {
+            if (bh_is_constant(&view) or _arrays.find(view.base) != _arrays.end()) {
+                continue;
+            }
+            if (new_bases == NULL) {
+                add_array(view.base, view.base->type, view.base->nelem);
+            } else {
+                if (next_new >= new_bases->size()) {
+                    throw runtime_error("[CLUSTER-VEM] received an instruction of an unknown base array");
+                }
+                const bh_base &desc = (*new_bases)[next_new++];
+                add_array(view.base, desc.type, desc.nelem);
+            }
+        }
+    }
+    for (size_t i = 0; i + 1 < scatters.size(); i += 2) {
+        scatter(bhir.instr_list.at(scatters[i]).operand.at(scatters[i + 1]).base);
+    }
+    for (const bh_instruction &instr: bhir.instr_list) {
+        execute_instr(instr);
+    }
+    flush();
+}
+
+void Cluster::execute_instr(const bh_instruction &instr) {
+    switch (instr.opcode) {
+        case BH_NONE:
+        case BH_TALLY:
+            return;
+        case BH_FREE: {
+            const bh_base *key = instr.operand[0].base;
+            remove_array(key);
+            if (rank == 0) {
+                bh_data_free(const_cast<bh_base *>(key));
+                _host_sums.erase(key);
+            }
+            return;
+        }
+        case BH_SYNC:
+            gather(instr.operand[0].base);
+            return;
+        default:
+            break;
+    }
+    if (instr.operand.empty()) {
+        return;
+    }
+    const pair<int64_t, int64_t> out_range = view_range(instr.operand[0]);
+    if (out_range.first == out_range.second) {
+        return; // Nothing to compute
+    }
+    if (is_associative_reduce(instr.opcode) and instr.sweep_axis() == 0 and
+        view_range(instr.operand[1]).second > view_range(instr.operand[1]).first) {
+        reduce_outer(instr);
+        return;
+    }
+    vector<Task> plan = split_instr(instr);
+    if (plan.empty()) {
+        // We compute the whole instruction on the owner of the first output element
+        plan.push_back(Task{_arrays.at(instr.operand[0].base).owner(out_range.first), {instr}});
+    }
+    run(plan);
+}
+
+vector<int64_t> Cluster::split_rows(const bh_view &view) const {
+    const Array &array = _arrays.at(view.base);
+    const int64_t nrows = view.shape[0];
+    const int64_t stride = view.stride[0];
+    vector<int64_t> ret(nranks + 1);
+    for (int r = 0; r <= nranks; ++r) {
+        if (r == nranks) {
+            ret[r] = nrows;
+        } else if (stride > 0) {
+            // The first row that starts at or after the block of 'r'
+            const int64_t dist = array.lo(r) - view.start;
+            ret[r] = dist <= 0 ? 0 : std::min(nrows, (dist + stride - 1) / stride);
+        } else {
+            const int64_t rows_per_rank = (nrows + nranks - 1) / nranks;
+            ret[r] = std::min(nrows, r * rows_per_rank);
+        }
+        if (r > 0) {
+            ret[r] = std::max(ret[r], ret[r - 1]);
+        }
+    }
+    ret[0] = 0;
+    return ret;
+}
+
+vector<Cluster::Task> Cluster::split_instr(const bh_instruction &instr) const {
+    const bh_view &out = instr.operand[0];
+    if (out.ndim < 1) {
+        return {};
+    }
+    if (is_splittable(instr.opcode)) {
+        for (const bh_view &view: instr.operand) {
+            if (bh_is_constant(&view)) {
+                continue;
+            }
+            if (view.ndim != out.ndim or not std::equal(out.shape, out.shape + out.ndim, view.shape)) {
+                return {};
+            }
+        }
+    } else if (bh_opcode_is_sweep(instr.opcode) and instr.sweep_axis() != 0) {
+        // The rows of the outer dimension of the input reduces or accumulates into the same rows of the output
+        const bh_view &in = instr.operand[1];
+        if (in.ndim < 1 or in.shape[0] != out.shape[0]) {
+            return {};
+        }
+    } else {
+        return {};
+    }
+    if (instr.opcode == BH_RANGE and out.stride[0] < 0) {
+        return {};
+    }
+
+    const vector<int64_t> rows = split_rows(out);
+    vector<Task> ret;
+    vector<pair<int64_t, int64_t> > out_ranges;
+    for (int r = 0; r < nranks; ++r) {
+        const int64_t begin = rows[r], end = rows[r + 1];
+        if (begin == end) {
+            continue;
+        }
+        bh_instruction sub(instr);
+        for (bh_view &view: sub.operand) {
+            if (not bh_is_constant(&view)) {
+                slice_rows(view, begin, end);
+            }
+        }
+        // The random numbers and ranges are functions of the output index, which has moved by the rows before it
+        const int64_t offset = begin * out.stride[0];
+        if (instr.opcode == BH_RANDOM) {
+            sub.constant.value.r123.start += static_cast<uint64_t>(offset);
+        }
+        Task task{r, {sub}};
+        if (instr.opcode == BH_RANGE and offset != 0) {
+            bh_view constant;
+            constant.base = NULL;
+            bh_instruction add(BH_ADD, {sub.operand[0], sub.operand[0], constant});
+            add.constant.type = _arrays.at(out.base).type;
+            add.constant.set_double(static_cast<double>(offset));
+            task.instr_list.push_back(add);
+        }
+        ret.push_back(task);
+        out_ranges.push_back(view_range(sub.operand[0]));
+    }
+    // The tasks write back whole ranges thus their outputs must not interleave
+    std::sort(out_ranges.begin(), out_ranges.end());
+    for (size_t i = 1; i < out_ranges.size(); ++i) {
+        if (out_ranges[i].first < out_ranges[i - 1].second) {
+            return {};
+        }
+    }
+    return ret;
+}
+
+void Cluster::reduce_outer(const bh_instruction &instr) {
+    const bh_view &out = instr.operand[0];
+    const bh_view &in = instr.operand[1];
+    const vector<int64_t> rows = split_rows(in);
+    vector<int> ranks;
+    for (int r = 0; r < nranks; ++r) {
+        if (rows[r] < rows[r + 1]) {
+            ranks.push_back(r);
+        }
+    }
+    if (ranks.size() == 1) {
+        run({Task{ranks[0], {instr}}});
+        return;
+    }
+
+    // The partial results are the blocks of a temporary array, which belong to the ranks that compute them
+    int64_t out_nelem = 1;
+    for (int64_t i = 0; i < out.ndim; ++i) {
+        out_nelem *= out.shape[i];
+    }
+    bh_base *partials = new_base(_arrays.at(out.base).type, out_nelem * ranks.size());
+    add_array(partials, partials->type, partials->nelem, out_nelem, ranks[0]);
+    vector<Task> plan;
+    for (size_t i = 0; i < ranks.size(); ++i) {
+        bh_instruction sub(instr);
+        sub.operand[0] = contiguous_view(partials, i * out_nelem, out.ndim, out.shape);
+        slice_rows(sub.operand[1], rows[ranks[i]], rows[ranks[i] + 1]);
+        plan.push_back(Task{ranks[i], {sub}});
+    }
+    run(plan);
+
+    bh_instruction total(instr);
+    int64_t shape[BH_MAXDIM];
+    shape[0] = static_cast<int64_t>(ranks.size());
+    std::copy(out.shape, out.shape + out.ndim, shape + 1);
+    total.operand[1] = contiguous_view(partials, 0, out.ndim + 1, shape);
+    run({Task{_arrays.at(out.base).owner(view_range(out).first), {total}}});
+
+    remove_array(partials);
+    _dead.push_back(partials);
+}
+
+void Cluster::run(const vector<Task> &plan) {
+    // A range of an array that a task needs but its rank doesn't own (wholly)
+    struct Halo {
+        size_t task;
+        const bh_base *key;
+        int64_t lo, hi;
+        bool read, written;
+        bh_base *temp; // Only on the rank of the task
+    };
+    vector<Halo> halos;
+    // Returns true when 'r' owns all elements of 'view'
+    auto owns = [&](int r, const bh_view &view) {
+        const Array &array = _arrays.at(view.base);
+        const pair<int64_t, int64_t> range = view_range(view);
+        return array.lo(r) < array.hi(r) and array.lo(r) <= range.first and range.second <= array.hi(r);
+    };
+    auto find_halo = [&](size_t task, const bh_view &view) -> Halo & {
+        const pair<int64_t, int64_t> range = view_range(view);
+        for (Halo &h: halos) {
+            if (h.task == task and h.key == view.base and h.lo == range.first and h.hi == range.second) {
+                return h;
+            }
+        }
+        halos.push_back(Halo{task, view.base, range.first, range.second, false, false, NULL});
+        return halos.back();
+    };
+    for (size_t t = 0; t < plan.size(); ++t) {
+        const int r = plan[t].rank;
+        for (const bh_instruction &instr: plan[t].instr_list) {
+            // The inputs read the halo before the output writes it unless an earlier instruction wrote it
+            for (size_t i = 1; i < instr.operand.size(); ++i) {
+                const bh_view &view = instr.operand[i];
+                if (not bh_is_constant(&view) and not owns(r, view)) {
+                    Halo &h = find_halo(t, view);
+                    h.read = h.read or not h.written;
+                }
+            }
+            const bh_view &out = instr.operand[0];
+            if (not owns(r, out)) {
+                Halo &h = find_halo(t, out);
+                // The task writes the whole range back thus the elements it doesn't write must be current
+                h.read = h.read or (not h.written and not is_dense(out));
+                h.written = true;
+            }
+        }
+    }
+    for (Halo &h: halos) {
+        if (plan[h.task].rank == rank) {
+            h.temp = new_base(_arrays.at(h.key).type, h.hi - h.lo);
+            if (h.read) {
+                bh_data_malloc(h.temp);
+            }
+        }
+    }
+
+    // Send the parts of the halos that we own and receive the halos of our tasks
+    vector<MPI_Request> requests;
+    {
+        vector<bh_base *> to_sync;
+        for (const Halo &h: halos) {
+            const Array &array = _arrays.at(h.key);
+            if (h.read and plan[h.task].rank != rank and array.local != NULL and
+                array.lo(rank) < h.hi and h.lo < array.hi(rank)) {
+                if (std::find(to_sync.begin(), to_sync.end(), array.local) == to_sync.end()) {
+                    to_sync.push_back(array.local);
+                }
+            }
+        }
+        if (not to_sync.empty()) {
+            for (bh_base *base: to_sync) {
+                _pending.push_back(system_instr(BH_SYNC, base));
+            }
+            flush();
+            for (bh_base *base: to_sync) {
+                bh_data_malloc(base);
+            }
+        }
+    }
+    for (const Halo &h: halos) {
+        if (not h.read) {
+            continue;
+        }
+        const Array &array = _arrays.at(h.key);
+        const int64_t type_size = bh_type_size(array.type);
+        const int task_rank = plan[h.task].rank;
+        for (int p = array.owner(h.lo); p <= array.owner(h.hi - 1); ++p) {
+            const int64_t lo = std::max(h.lo, array.lo(p)), hi = std::min(h.hi, array.hi(p));
+            if (p == task_rank or lo >= hi) {
+                continue;
+            }
+            if (rank == p) {
+                const char *data = static_cast<const char *>(array.local->data) + (lo - array.lo(p)) * type_size;
+                isend(data, (hi - lo) * type_size, task_rank, comm, requests);
+            } else if (rank == task_rank) {
+                char *data = static_cast<char *>(h.temp->data) + (lo - h.lo) * type_size;
+                irecv(data, (hi - lo) * type_size, p, comm, requests);
+            }
+        }
+    }
+    wait_all(requests);
+
+    // Compute our tasks on the local blocks and the halos
+    bool remote_writes = false;
+    for (const Halo &h: halos) {
+        const Array &array = _arrays.at(h.key);
+        if (plan[h.task].rank == rank and h.read and array.local != NULL) {
+            const int64_t lo = std::max(h.lo, array.lo(rank)), hi = std::min(h.hi, array.hi(rank));
+            if (lo < hi) {
+                _pending.push_back(copy_instr(h.temp, lo - h.lo, array.local, lo - array.lo(rank), hi - lo));
+            }
+        }
+    }
+    for (size_t t = 0; t < plan.size(); ++t) {
+        if (plan[t].rank != rank) {
+            continue;
+        }
+        for (const bh_instruction &instr: plan[t].instr_list) {
+            bh_instruction local(instr);
+            for (bh_view &view: local.operand) {
+                if (bh_is_constant(&view)) {
+                    continue;
+                }
+                const Array &array = _arrays.at(view.base);
+                if (owns(rank, view)) {
+                    view.start -= array.lo(rank);
+                    view.base = array.local;
+                } else {
+                    const Halo &h = find_halo(t, view);
+                    view.start -= h.lo;
+                    view.base = h.temp;
+                }
+            }
+            _pending.push_back(local);
+        }
+    }
+    for (const Halo &h: halos) {
+        const Array &array = _arrays.at(h.key);
+        if (plan[h.task].rank != rank or not h.written) {
+            continue;
+        }
+        for (int p = array.owner(h.lo); p <= array.owner(h.hi - 1); ++p) {
+            const int64_t lo = std::max(h.lo, array.lo(p)), hi = std::min(h.hi, array.hi(p));
+            if (lo >= hi) {
+                continue;
+            }
+            if (p == rank) {
+                _pending.push_back(copy_instr(array.local, lo - array.lo(rank), h.temp, lo - h.lo, hi - lo));
+            } else {
+                remote_writes = true;
+            }
+        }
+    }
+    if (remote_writes) {
+        for (const Halo &h: halos) {
+            if (plan[h.task].rank == rank and h.written) {
+                _pending.push_back(system_instr(BH_SYNC, h.temp));
+            }
+        }
+        flush();
+    }
+
+    // Write back the parts of the halos that other ranks own
+    struct Received {
+        bh_base *base;
+        bh_base *local;
+        int64_t offset;
+    };
+    vector<Received> received;
+    for (const Halo &h: halos) {
+        if (not h.written) {
+            continue;
+        }
+        const Array &array = _arrays.at(h.key);
+        const int64_t type_size = bh_type_size(array.type);
+        const int task_rank = plan[h.task].rank;
+        for (int p = array.owner(h.lo); p <= array.owner(h.hi - 1); ++p) {
+            const int64_t lo = std::max(h.lo, array.lo(p)), hi = std::min(h.hi, array.hi(p));
+            if (p == task_rank or lo >= hi) {
+                continue;
+            }
+            if (rank == task_rank) {
+                bh_data_malloc(h.temp);
+                const char *data = static_cast<const char *>(h.temp->data) + (lo - h.lo) * type_size;
+                isend(data, (hi - lo) * type_size, p, comm, requests);
+            } else if (rank == p) {
+                bh_base *base = new_base(array.type, hi - lo);
+                bh_data_malloc(base);
+                irecv(base->data, bh_base_size(base), task_rank, comm, requests);
+                received.push_back(Received{base, array.local, lo - array.lo(p)});
+            }
+        }
+    }
+    wait_all(requests);
+    for (const Received &r: received) {
+        _pending.push_back(copy_instr(r.local, r.offset, r.base, 0, r.base->nelem));
+        _pending.push_back(system_instr(BH_FREE, r.base));
+        _dead.push_back(r.base);
+    }
+    for (const Halo &h: halos) {
+        if (h.temp != NULL) {
+            _pending.push_back(system_instr(BH_FREE, h.temp));
+            _dead.push_back(h.temp);
+        }
+    }
+}
+
+void Cluster::serve() {
+    bytecode::Decoder decoder;
+    vector<char> payload;
+    bh_ir bhir;
+    vector<bh_base> new_bases;
+    while (true) {
+        switch (receive(payload, comm)) {
+            case Message::EXEC: {
+                uint64_t count;
+                memcpy(&count, payload.data(), sizeof(count));
+                vector<uint64_t> scatters(count);
+                memcpy(scatters.data(), payload.data() + sizeof(count), count * sizeof(uint64_t));
+                const size_t offset = (count + 1) * sizeof(uint64_t);
+                decoder.decode(payload.data() + offset, payload.size() - offset, bhir, new_bases);
+                execute(bhir, scatters, &new_bases);
+                break;
+            }
+            case Message::EXTMETHOD: {
+                uint64_t opcode;
+                memcpy(&opcode, payload.data(), sizeof(opcode));
+                child.extmethod(string(payload.begin() + sizeof(opcode), payload.end()),
+                                static_cast<bh_opcode>(opcode));
+                break;
+            }
+            case Message::SHUTDOWN:
+                return;
+            default:
+                throw runtime_error("[CLUSTER-VEM] a worker received an unknown message");
+        }
+    }
+}
+
+}} //namespace bohrium::cluster
@@ -0,0 +1,139 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __BH_VEM_CLUSTER_H
+#define __BH_VEM_CLUSTER_H
+
+#include <vector>
+#include <unordered_map>
+#include <mpi.h>
+
+#include <bh_component.hpp>
+
+namespace bohrium {
+namespace cluster {
+
+// The messages that the master (rank 0) broadcasts to the workers
+enum class Message : uint64_t {
+    INIT,      // The stack level of the cluster VEM
+    EXEC,      // The references of the scattered host data followed by the bytecode of a BhIR
+    EXTMETHOD, // The opcode followed by the name of an extension method
+    SHUTDOWN
+};
+
+// Broadcast a message from the master and receive it at the workers
+void broadcast(Message type, const std::vector<char> &payload, MPI_Comm comm = MPI_COMM_WORLD);
+Message receive(std::vector<char> &payload, MPI_Comm comm = MPI_COMM_WORLD);
+
+/* A base array that is block-distributed over the ranks where the i'th block belongs to
+ * rank 'first_rank + i'. The user arrays start at rank zero and have 'block' elements per rank.
+ */
+struct Array {
+    bh_type type;
+    int64_t nelem;
+    int64_t block;
+    int first_rank;
+    // The block of this rank, which is NULL when this rank has no elements
+    bh_base *local;
+
+    // The elements [lo(rank), hi(rank)) belong to 'rank'
+    int64_t lo(int rank) const;
+    int64_t hi(int rank) const;
+    int owner(int64_t elem) const {
+        return first_rank + static_cast<int>(elem / block);
+    }
+};
+
+/* The cluster executes the instructions of the master on all ranks. Every rank computes the rows of
+ * the outer dimension of an instruction that start in its block and receives the halos of the views
+ * that reach into other blocks. Instructions that cannot be split that way are computed on one rank.
+ * The arrays are only gathered at the master on BH_SYNC.
+ *
+ * NB: the base arrays of the instructions only identify the arrays; the workers never dereference them.
+ */
+class Cluster {
+public:
+    const int rank;
+    const int nranks;
+
+    explicit Cluster(component::ComponentFace &child, MPI_Comm comm = MPI_COMM_WORLD);
+
+    /* Returns the references (pairs of instruction and operand index) of the arrays in 'bhir' whose host
+     * data is new or changed since the master last scattered or gathered it. Master only.
+     */
+    std::vector<uint64_t> host_writes(const bh_ir &bhir);
+
+    /* Execute 'bhir', which all ranks must call collectively with the same instructions
+     *
+     * @scatters   The references of host_writes(), which the master scatters before the execution
+     * @new_bases  The description of the arrays that are new to the workers (see bytecode::Decoder).
+     *             The master passes NULL since it reads the description from the arrays themselves.
+     */
+    void execute(const bh_ir &bhir, const std::vector<uint64_t> &scatters, const std::vector<bh_base> *new_bases);
+
+    // Serve the messages of the master until it shuts down. Workers only.
+    void serve();
+
+private:
+    component::ComponentFace &child;
+    MPI_Comm comm;
+    std::unordered_map<const bh_base *, Array> _arrays;
+    // The checksum of the host data of the arrays when the master last scattered or gathered them
+    std::unordered_map<const bh_base *, uint64_t> _host_sums;
+    // The local instructions that we have not given the child yet and the bases to delete afterwards
+    std::vector<bh_instruction> _pending;
+    std::vector<bh_base *> _dead;
+
+    // A part of an instruction, which 'rank' computes. The views are of the distributed arrays.
+    struct Task {
+        int rank;
+        std::vector<bh_instruction> instr_list;
+    };
+
+    // Add an array with 'block' elements per rank (zero means an even distribution over all ranks)
+    Array &add_array(const bh_base *key, bh_type type, int64_t nelem, int64_t block = 0, int first_rank = 0);
+    void remove_array(const bh_base *key);
+
+    // Give the pending instructions to the child
+    void flush();
+
+    // Send the host data of the master to the owners and gather the owners' data at the master
+    void scatter(const bh_base *key);
+    void gather(const bh_base *key);
+
+    void execute_instr(const bh_instruction &instr);
+
+    // Returns the first row of each rank (and the number of rows at the end) when splitting the outer
+    // dimension of 'view' such that every rank gets the rows that start in its block
+    std::vector<int64_t> split_rows(const bh_view &view) const;
+
+    // Split 'instr' into the rows of its output on each rank. Returns an empty plan when it cannot.
+    std::vector<Task> split_instr(const bh_instruction &instr) const;
+
+    // Reduce the first axis by reducing the rows of each rank to a partial result, which one rank reduces
+    void reduce_outer(const bh_instruction &instr);
+
+    // Exchange the halos of the tasks, let the child compute them, and write back the halos they wrote
+    void run(const std::vector<Task> &plan);
+};
+
+}} //namespace bohrium::cluster
+
+#endif
@@ -0,0 +1,109 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <iostream>
+#include <cstring>
+#include <memory>
+#include <bh_component.hpp>
+#include <bh_bytecode.hpp>
+
+#include "cluster.hpp"
+
+using namespace bohrium;
+using namespace component;
+using namespace std;
+
+namespace {
+class Impl : public ComponentImplWithChild {
+  private:
+    // Set when we initialized MPI thus must finalize it
+    bool _mpi_owner = false;
+    unique_ptr<cluster::Cluster> _cluster;
+    // The instructions are broadcasted to the workers as bytecode
+    bytecode::Encoder _encoder;
+  public:
+    Impl(int stack_level);
+    ~Impl(); // NB: a destructor implementation must exist
+    void execute(bh_ir *bhir);
+    void extmethod(const string &name, bh_opcode opcode);
+};
+} //Unnamed namespace
+
+extern "C" ComponentImpl* create(int stack_level) {
+    return new Impl(stack_level);
+}
+extern "C" void destroy(ComponentImpl* self) {
+    delete self;
+}
+
+Impl::Impl(int stack_level) : ComponentImplWithChild(stack_level) {
+    int initialized;
+    MPI_Initialized(&initialized);
+    if (not initialized) {
+        MPI_Init(NULL, NULL);
+        _mpi_owner = true;
+    }
+    _cluster.reset(new cluster::Cluster(child));
+    if (_cluster->rank != 0) {
+        // When all ranks run the program, the workers serve the master from here and never return
+        vector<char> payload;
+        if (cluster::receive(payload) != cluster::Message::INIT) {
+            throw runtime_error("[CLUSTER-VEM] a worker expected the INIT message");
+        }
+        _cluster->serve();
+        _cluster.reset();
+        if (_mpi_owner) {
+            MPI_Finalize();
+        }
+        exit(0);
+    }
+    const int64_t level = stack_level;
+    cluster::broadcast(cluster::Message::INIT, vector<char>(reinterpret_cast<const char*>(&level),
+                                                            reinterpret_cast<const char*>(&level) + sizeof(level)));
+}
+
+Impl::~Impl() {
+    cluster::broadcast(cluster::Message::SHUTDOWN, vector<char>());
+    _cluster.reset();
+    if (_mpi_owner) {
+        MPI_Finalize();
+    }
+}
+
+void Impl::execute(bh_ir *bhir) {
+    const vector<uint64_t> scatters = _cluster->host_writes(*bhir);
+    vector<char> payload;
+    const uint64_t count = scatters.size();
+    payload.insert(payload.end(), reinterpret_cast<const char*>(&count), reinterpret_cast<const char*>(&count + 1));
+    payload.insert(payload.end(), reinterpret_cast<const char*>(scatters.data()),
+                   reinterpret_cast<const char*>(scatters.data() + count));
+    _encoder.encode(*bhir, payload);
+    cluster::broadcast(cluster::Message::EXEC, payload);
+    _cluster->execute(*bhir, scatters, NULL);
+}
+
+void Impl::extmethod(const string &name, bh_opcode opcode) {
+    const uint64_t op = opcode;
+    vector<char> payload(reinterpret_cast<const char*>(&op), reinterpret_cast<const char*>(&op + 1));
+    payload.insert(payload.end(), name.begin(), name.end());
+    cluster::broadcast(cluster::Message::EXTMETHOD, payload);
+    child.extmethod(name, opcode);
+}
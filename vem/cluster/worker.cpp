@@ -0,0 +1,60 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <iostream>
+#include <cstring>
+#include <bh_component.hpp>
+
+#include "cluster.hpp"
+
+using namespace std;
+using namespace bohrium;
+using namespace component;
+
+//The worker of a cluster whose master is the program at rank 0, e.g.:
+//  mpirun -np 1 python program.py : -np 3 bh_cluster_worker
+int main(int argc, char * argv[])
+{
+    MPI_Init(&argc, &argv);
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    if (rank == 0) {
+        cerr << "[CLUSTER-VEM] the worker must not be rank 0, which is the program" << endl;
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    try {
+        vector<char> payload;
+        if (cluster::receive(payload) != cluster::Message::INIT or payload.size() != sizeof(int64_t)) {
+            throw runtime_error("[CLUSTER-VEM] a worker expected the INIT message");
+        }
+        int64_t stack_level;
+        memcpy(&stack_level, payload.data(), sizeof(stack_level));
+        //The child is the component below the cluster VEM in the stack of the program
+        ConfigParser config(static_cast<int>(stack_level));
+        ComponentFace child(config.getChildLibraryPath(), config.stack_level + 1);
+        cluster::Cluster(child).serve();
+    } catch (const std::exception &e) {
+        cerr << "[CLUSTER-VEM] worker " << rank << ": " << e.what() << endl;
+        MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    MPI_Finalize();
+    return 0;
+}
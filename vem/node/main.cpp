@@ -21,6 +21,9 @@ If not, see <http://www.gnu.org/licenses/>.
 #include <iostream>
 #include <bh_component.hpp>
 
+#include "trace_cache.hpp"
+#include "spill_cache.hpp"
+
 using namespace bohrium;
 using namespace component;
 using namespace std;
@@ -34,8 +37,17 @@ class Impl : public ComponentImplWithChild {
     void inspect(bh_instruction *instr);
     // Show memory warnings
     bool mem_warn;
+    // Mark the flushes that replay a previous trace (see bh_ir::replay_trace)
+    const bool replay_cache;
+    TraceCache traces;
+    // Spill the least recently used base arrays to disk when they exceed the soft limit (zero disables)
+    SpillCache spills;
   public:
-    Impl(int stack_level) : ComponentImplWithChild(stack_level) {
+    Impl(int stack_level) : ComponentImplWithChild(stack_level),
+                            replay_cache(config.defaultGet<bool>("replay_cache", true)),
+                            traces(config.defaultGet<uint64_t>("replay_traces", 64)),
+                            spills(config.defaultGet<uint64_t>("spill_limit", 0),
+                                   config.defaultGet<string>("spill_dir", "")) {
         mem_warn = getenv("BH_MEM_WARN") != NULL;
     }
     ~Impl(); // NB: a destructor implementation must exist
@@ -51,6 +63,14 @@ extern "C" void destroy(ComponentImpl* self) {
 }
 
 Impl::~Impl() {
+    if (replay_cache and config.defaultGet<bool>("verbose", false)) {
+        cout << "[NODE-VEM] Replayed traces: " << traces.hits << " of " << traces.lookups << " flushes ("
+             << traces.evictions << " evictions)" << endl;
+    }
+    if (spills.soft_limit > 0 and config.defaultGet<bool>("verbose", false)) {
+        cout << "[NODE-VEM] Spilled " << spills.spills << " base arrays (" << spills.spilled_bytes << " bytes) and "
+             << "fetched " << spills.fetches << endl;
+    }
     if (_allocated_bases.size() > 0)
     {
         long s = (long) _allocated_bases.size();
@@ -93,5 +113,14 @@ void Impl::execute(bh_ir *bhir) {
         for(uint64_t i=0; i < bhir->instr_list.size(); ++i)
             inspect(&bhir->instr_list[i]);
     }
-    child.execute(bhir);
+    if (replay_cache) {
+        bhir->replay_trace = traces.lookup(*bhir);
+    }
+    if (spills.soft_limit > 0) {
+        spills.fetch(*bhir);
+        child.execute(bhir);
+        spills.spill(*bhir);
+    } else {
+        child.execute(bhir);
+    }
 }
@@ -0,0 +1,179 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_set>
+#include <unistd.h>
+
+#include <bh_memory.h>
+
+#include "spill_cache.hpp"
+
+using namespace std;
+
+namespace {
+
+// Throws a runtime error with the message 'msg' followed by the reason of the current 'errno'
+void throw_errno(const string &msg) {
+    stringstream ss;
+    ss << "[NODE-VEM] " << msg << ": " << strerror(errno);
+    throw runtime_error(ss.str());
+}
+
+// Writes or reads all of the 'bytes' bytes at 'offset' of the file 'fd', which the kernel may split into parts
+template<typename IO, typename Ptr>
+void transfer_all(IO io, int fd, Ptr data, int64_t bytes, int64_t offset, const char *what) {
+    while (bytes > 0) {
+        const ssize_t n = io(fd, data, static_cast<size_t>(bytes), offset);
+        if (n <= 0) {
+            throw_errno(string("could not ") + what + " the spill file");
+        }
+        data += n;
+        bytes -= n;
+        offset += n;
+    }
+}
+}
+
+SpillCache::~SpillCache() {
+    if (_fd >= 0) {
+        close(_fd);
+    }
+}
+
+int64_t SpillCache::alloc_slot(int64_t bytes) {
+    auto it = _free_slots.find(bytes);
+    if (it != _free_slots.end() and not it->second.empty()) {
+        const int64_t ret = it->second.back();
+        it->second.pop_back();
+        return ret;
+    }
+    if (_fd < 0) {
+        const char *tmpdir = getenv("TMPDIR");
+        string path = _dir.empty() ? (tmpdir != NULL ? tmpdir : "/tmp") : _dir;
+        path += "/bohrium-spill-XXXXXX";
+        vector<char> tmpl(path.begin(), path.end());
+        tmpl.push_back('\0');
+        _fd = mkstemp(tmpl.data());
+        if (_fd < 0) {
+            throw_errno("could not create the spill file " + path);
+        }
+        unlink(tmpl.data());
+    }
+    const int64_t ret = _file_size;
+    _file_size += bytes;
+    return ret;
+}
+
+void SpillCache::forget(bh_base *base) {
+    auto it = _bases.find(base);
+    if (it == _bases.end()) {
+        return;
+    }
+    if (it->second.offset >= 0) {
+        _free_slots[it->second.bytes].push_back(it->second.offset);
+    } else {
+        _resident -= it->second.bytes;
+    }
+    _lru.erase(it->second.lru);
+    _bases.erase(it);
+}
+
+void SpillCache::fetch(const bh_ir &bhir) {
+    for (const bh_instruction &instr: bhir.instr_list) {
+        if (instr.opcode == BH_FREE) {
+            // The data of a spilled base is simply dropped
+            forget(instr.operand[0].base);
+            continue;
+        }
+        for (const bh_view &view: instr.operand) {
+            if (bh_is_constant(&view)) {
+                continue;
+            }
+            auto it = _bases.find(view.base);
+            if (it == _bases.end() or it->second.offset < 0) {
+                continue;
+            }
+            bh_base *base = view.base;
+            Entry &entry = it->second;
+            bh_data_malloc(base);
+            transfer_all(pread, _fd, static_cast<char *>(base->data), entry.bytes, entry.offset, "read");
+            _free_slots[entry.bytes].push_back(entry.offset);
+            entry.offset = -1;
+            _resident += entry.bytes;
+            ++fetches;
+        }
+    }
+}
+
+void SpillCache::spill(const bh_ir &bhir) {
+    // The bases of 'bhir' becomes the most recently used in the order of their last access
+    unordered_set<bh_base*> accessed;
+    for (const bh_instruction &instr: bhir.instr_list) {
+        for (const bh_view &view: instr.operand) {
+            if (bh_is_constant(&view)) {
+                continue;
+            }
+            bh_base *base = view.base;
+            accessed.insert(base);
+            auto it = _bases.find(base);
+            if (it == _bases.end()) {
+                _lru.push_front(base);
+                it = _bases.insert(make_pair(base, Entry{_lru.begin(), -1, 0})).first;
+            } else {
+                _lru.splice(_lru.begin(), _lru, it->second.lru);
+            }
+            // The engine allocates the data of new bases during the execution
+            if (it->second.offset < 0) {
+                const int64_t bytes = base->data == nullptr ? 0 : bh_base_size(base);
+                _resident += bytes - it->second.bytes;
+                it->second.bytes = bytes;
+            }
+        }
+    }
+    // Bases that the engine has freed, which the next flush would otherwise forget
+    for (const bh_instruction &instr: bhir.instr_list) {
+        if (instr.opcode == BH_FREE) {
+            forget(instr.operand[0].base);
+        }
+    }
+
+    // Let's spill the least recently used bases, which are at the back of the list
+    for (auto it = _lru.rbegin(); _resident > soft_limit and it != _lru.rend(); ++it) {
+        bh_base *base = *it;
+        if (accessed.find(base) != accessed.end()) {
+            break; // The rest of the list was accessed by 'bhir'
+        }
+        Entry &entry = _bases.at(base);
+        if (entry.offset >= 0 or base->data == nullptr or bh_memory_is_adopted(base->data)) {
+            continue;
+        }
+        entry.offset = alloc_slot(entry.bytes);
+        transfer_all(pwrite, _fd, static_cast<const char *>(base->data), entry.bytes, entry.offset, "write");
+        bh_data_free(base);
+        _resident -= entry.bytes;
+        spilled_bytes += entry.bytes;
+        ++spills;
+    }
+}
@@ -0,0 +1,86 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __BH_VEM_NODE_SPILL_CACHE_H
+#define __BH_VEM_NODE_SPILL_CACHE_H
+
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+
+#include <bh_ir.hpp>
+
+/* The spill cache keeps the host memory of the base arrays below a soft limit by spilling the least recently used
+ * bases to a scratch file, which is unlinked on creation thus it disappears with the process. A flush fetches the
+ * spilled bases that it accesses back into memory before the engine executes it, and the bases that the flush
+ * accessed are never spilled after it since the bridge may read their data.
+ * NB: only the host memory is managed, thus the spilling is meant for the CPU engines. The bases whose memory was
+ *     handed over by bh_memory_adopt() belong to their owner and are never spilled.
+ */
+class SpillCache
+{
+public:
+    // 'soft_limit' is the number of bytes of the resident bases and 'dir' is the directory of the scratch file
+    SpillCache(uint64_t soft_limit, std::string dir) : soft_limit(soft_limit), _dir(std::move(dir)) {}
+    ~SpillCache();
+
+    // Fetches the spilled bases that 'bhir' accesses and forgets the bases that it frees
+    void fetch(const bh_ir &bhir);
+
+    // Records the use of the bases of the executed 'bhir' and spills the least recently used bases that 'bhir'
+    // didn't access until the resident bases are within the soft limit
+    void spill(const bh_ir &bhir);
+
+    const uint64_t soft_limit;
+    // Some statistics
+    uint64_t spills = 0;
+    uint64_t fetches = 0;
+    uint64_t spilled_bytes = 0;
+
+private:
+    struct Entry {
+        std::list<bh_base*>::iterator lru;
+        // The offset of the data in the scratch file or -1 when the base is resident
+        int64_t offset;
+        // The size of the data when the base was last seen with data
+        int64_t bytes;
+    };
+    std::unordered_map<bh_base*, Entry> _bases;
+    // The bases where the most recently used is first
+    std::list<bh_base*> _lru;
+    // The bytes of the resident bases
+    uint64_t _resident = 0;
+
+    // The scratch file, its size, and its freed slots by size
+    const std::string _dir;
+    int _fd = -1;
+    int64_t _file_size = 0;
+    std::map<int64_t, std::vector<int64_t> > _free_slots;
+
+    // Returns the offset of a slot of 'bytes' bytes in the scratch file, which is created on first use
+    int64_t alloc_slot(int64_t bytes);
+    // Forgets the base 'base', whose slot is freed when it is spilled
+    void forget(bh_base *base);
+};
+
+#endif
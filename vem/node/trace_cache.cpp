@@ -0,0 +1,102 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+
+#include "trace_cache.hpp"
+
+using namespace std;
+
+namespace {
+
+constexpr uint64_t SEP_INSTR = UINT64_MAX;
+constexpr uint64_t SEP_OP = UINT64_MAX - 1;
+constexpr uint64_t SEP_CONST = UINT64_MAX - 2;
+
+/* The view key consists of the following fields:
+ * <base_id><type><nelem><start><ndim>[<shape><stride>...]<SEP_OP> or <SEP_CONST><constant type>
+ * where 'base_id' is the index of the base in the order of first appearance
+ */
+void key_view(const bh_view &view, const bh_constant &constant, unordered_map<const bh_base*, uint64_t> &base_ids,
+              vector<uint64_t> &out) {
+    if (bh_is_constant(&view)) {
+        out.push_back(SEP_CONST);
+        out.push_back(static_cast<uint64_t>(constant.type));
+    } else {
+        out.push_back(base_ids.insert(make_pair(view.base, base_ids.size())).first->second);
+        out.push_back(static_cast<uint64_t>(view.base->type));
+        out.push_back(static_cast<uint64_t>(view.base->nelem));
+        out.push_back(static_cast<uint64_t>(view.start));
+        out.push_back(static_cast<uint64_t>(view.ndim));
+        for (int64_t i = 0; i < view.ndim; ++i) {
+            out.push_back(static_cast<uint64_t>(view.shape[i]));
+            out.push_back(static_cast<uint64_t>(view.stride[i]));
+        }
+        out.push_back(SEP_OP);
+    }
+}
+
+/* The instruction key consists of the following fields:
+ * <opcode>[<key_view>...]<sweep_axis()><SEP_INSTR>
+ * NB: the sweep axis is a constant value that the structure depends on
+ */
+void key_instr(const bh_instruction &instr, unordered_map<const bh_base*, uint64_t> &base_ids,
+               vector<uint64_t> &out) {
+    out.push_back(static_cast<uint64_t>(instr.opcode));
+    for (const bh_view &view: instr.operand) {
+        key_view(view, instr.constant, base_ids, out);
+    }
+    out.push_back(static_cast<uint64_t>(instr.sweep_axis()));
+    out.push_back(SEP_INSTR);
+}
+
+} // Unnamed namespace
+
+int64_t TraceCache::lookup(const bh_ir &bhir) {
+    // A BH_REPEAT is unrolled by the backend thus the flush isn't replayed
+    if (bhir.instr_list.empty() or any_of(bhir.instr_list.begin(), bhir.instr_list.end(),
+                                          [](const bh_instruction &instr) { return instr.opcode == BH_REPEAT; })) {
+        return -1;
+    }
+    ++lookups;
+    _key.clear();
+    _base_ids.clear();
+    for (const bh_instruction &instr: bhir.instr_list) {
+        key_instr(instr, _base_ids, _key);
+    }
+
+    auto hit = _traces.find(_key);
+    if (hit != _traces.end()) {
+        ++hits;
+        _lru.splice(_lru.begin(), _lru, hit->second.lru);
+        return hit->second.id;
+    }
+
+    // A new trace, which makes room by forgetting the least recently used
+    if (max_traces > 0 and _traces.size() >= max_traces) {
+        _traces.erase(*_lru.back());
+        _lru.pop_back();
+        ++evictions;
+    }
+    auto inserted = _traces.insert(make_pair(_key, Trace{_next_id++, _lru.end()})).first;
+    _lru.push_front(&inserted->first);
+    inserted->second.lru = _lru.begin();
+    return -1;
+}
@@ -0,0 +1,68 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __BH_VEM_NODE_TRACE_CACHE_H
+#define __BH_VEM_NODE_TRACE_CACHE_H
+
+#include <list>
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+#include <boost/functional/hash.hpp>
+
+#include <bh_ir.hpp>
+
+/* The trace cache detects the flushes that are structurally equal to a previous flush, which is the case for every
+ * iteration of an iterative solver. Two flushes are equal when they only differ in the base arrays, which must map
+ * one-to-one in the order of first appearance, and in the constant values. The repeats are given the id of the
+ * first flush (the trace) thus the backend can replay its fusion and code generation of the trace.
+ */
+class TraceCache
+{
+public:
+    // 'max_traces' is the number of traces to remember where the least recently used trace is forgotten first
+    explicit TraceCache(uint64_t max_traces) : max_traces(max_traces) {}
+
+    // Returns the id of the trace that 'bhir' repeats or -1 when 'bhir' is a new trace
+    int64_t lookup(const bh_ir &bhir);
+
+    const uint64_t max_traces;
+    // Some statistics
+    uint64_t lookups = 0;
+    uint64_t hits = 0;
+    uint64_t evictions = 0;
+
+private:
+    typedef std::vector<uint64_t> Key;
+    struct Trace {
+        int64_t id;
+        std::list<const Key*>::iterator lru;
+    };
+    std::unordered_map<Key, Trace, boost::hash<Key> > _traces;
+    // The keys of the traces where the most recently used is first
+    std::list<const Key*> _lru;
+    int64_t _next_id = 0;
+
+    // Scratch space of lookup(), which is reused between calls to avoid allocations
+    Key _key;
+    std::unordered_map<const bh_base*, uint64_t> _base_ids;
+};
+
+#endif
@@ -18,6 +18,12 @@ GNU Lesser General Public License along with Bohrium.
 If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <set>
+#include <deque>
+#include <chrono>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include <bh_component.hpp>
 
 #include "comm.hpp"
@@ -26,12 +32,212 @@ using namespace std;
 using namespace bohrium;
 using namespace component;
 
-static void service(const std::string &address, int port)
+//Receive the host writes to the known arrays, the synced arrays that the frontend needs as a whole, and the
+//synced arrays that the frontend fetches later (if at all), which we return in 'deferred'
+static void recv_updates(CommBackend &comm_backend, serialize::ExecuteBackend &exec, ChunkChecksums *sums,
+                         set<bh_base*> &deferred)
+{
+    struct Update {
+        bh_base *base;
+        uint64_t page_size;
+        vector<uint64_t> pages;
+    };
+    uint64_t count;
+    comm_backend.recv_raw(&count, sizeof(count));
+    vector<Update> updates(count);
+    for(Update &update: updates)
+    {
+        uint64_t h[3]; // {remote base, page size, number of pages}
+        comm_backend.recv_raw(h, sizeof(h));
+        update.base = exec.local(reinterpret_cast<const bh_base*>(h[0]));
+        if (update.base == NULL) {
+            throw runtime_error("[VEM-PROXY] the backend received an update of an unknown array");
+        }
+        update.page_size = h[1];
+        update.pages.resize(h[2]);
+        comm_backend.recv_raw(update.pages.data(), update.pages.size() * sizeof(uint64_t));
+    }
+    for(const Update &update: updates)
+    {
+        bh_base *base = update.base;
+        bh_data_malloc(base);
+        const uint64_t nbytes = bh_base_size(base);
+        vector<char> buf(chunks_size(update.pages, update.page_size, nbytes));
+        comm_backend.recv_data(buf.data(), buf.size());
+        scatter_chunks(buf.data(), update.pages, update.page_size, static_cast<char*>(base->data), nbytes);
+        if (sums != nullptr) {
+            for(uint64_t page: update.pages)
+            {
+                sums->record(base, page * update.page_size, (page + 1) * update.page_size);
+            }
+        }
+    }
+
+    comm_backend.recv_raw(&count, sizeof(count));
+    vector<uint64_t> resets(count);
+    comm_backend.recv_raw(resets.data(), resets.size() * sizeof(uint64_t));
+    if (sums != nullptr) {
+        for(uint64_t remote: resets)
+        {
+            bh_base *base = exec.local(reinterpret_cast<const bh_base*>(remote));
+            if (base != NULL) {
+                sums->forget(base);
+            }
+        }
+    }
+
+    comm_backend.recv_raw(&count, sizeof(count));
+    vector<uint64_t> lazy(count);
+    comm_backend.recv_raw(lazy.data(), lazy.size() * sizeof(uint64_t));
+    for(uint64_t remote: lazy)
+    {
+        deferred.insert(exec.local(reinterpret_cast<const bh_base*>(remote)));
+    }
+}
+
+//Queue a sync'ed array as a whole or as the chunks that changed since the frontend got it. The chunks are
+//gathered into 'gathered', which must stay valid until they are sent.
+static void queue_synced(CommBackend &comm_backend, bh_base *base, ChunkChecksums *sums,
+                         deque<vector<char> > &gathered)
+{
+    const uint64_t nbytes = bh_base_size(base);
+    vector<uint64_t> chunks;
+    uint64_t delta[2] = {0, DELTA_WHOLE}; // {chunk size, number of chunks}
+    if (sums != nullptr and sums->changed(base, chunks) and chunks.size() * sums->chunk_bytes < nbytes / 2) {
+        delta[0] = sums->chunk_bytes;
+        delta[1] = chunks.size();
+    }
+    comm_backend.queue_raw(delta, sizeof(delta));
+    if (delta[1] == DELTA_WHOLE) {
+        comm_backend.queue_data(base->data, nbytes, bh_type_size(base->type));
+    } else {
+        comm_backend.queue_raw(chunks.data(), chunks.size() * sizeof(uint64_t));
+        gathered.emplace_back();
+        gather_chunks(static_cast<const char*>(base->data), nbytes, chunks, delta[0], gathered.back());
+        comm_backend.queue_data(gathered.back().data(), gathered.back().size(), bh_type_size(base->type));
+    }
+}
+
+//Returns a contiguous view of all of 'base'
+static bh_view flat_view(bh_base *base)
+{
+    bh_view ret;
+    ret.base = base;
+    ret.start = 0;
+    ret.ndim = 1;
+    ret.shape[0] = base->nelem;
+    ret.stride[0] = 1;
+    return ret;
+}
+
+//A component stack of a session
+struct Stack {
+    unique_ptr<ConfigParser> config;
+    unique_ptr<ComponentFace> child;
+};
+
+//Builds a component stack, which is warmed up by pre-compiling the kernel trace of the 'standby_warmup' option.
+//NB: the GPU engines set up their device at the warm-up
+static Stack build_stack(int stack_level, bool warmup)
+{
+    Stack ret;
+    ret.config.reset(new ConfigParser(stack_level));
+    ret.child.reset(new ComponentFace(ret.config->getChildLibraryPath(), stack_level+1));
+    const string trace = ret.config->defaultGet<string>("standby_warmup", "");
+    if (warmup and not trace.empty()) {
+        cout << ret.child->message("warmup:" + trace);
+    }
+    return ret;
+}
+
+//Keeps 'size' warmed up stacks ready for the sessions, which each take one and never give it back thus the
+//sessions stay isolated. A background thread builds a new stack whenever a session takes one.
+class StandbyPool {
+    const size_t size;
+    //The stack level of the ready stacks, which follows the level of the latest session
+    int stack_level = 0;
+    deque<Stack> ready;
+    bool stopping = false;
+    mutex mtx;
+    condition_variable cond;
+    thread builder;
+
+    void build_loop()
+    {
+        unique_lock<mutex> lock(mtx);
+        while(1)
+        {
+            cond.wait(lock, [this]() { return stopping or ready.size() < size; });
+            if (stopping) {
+                return;
+            }
+            const int level = stack_level;
+            lock.unlock();
+            Stack stack;
+            try {
+                stack = build_stack(level, true);
+            } catch (const std::exception &e) {
+                cerr << "[PROXY-VEM] could not build a standby stack: " << e.what() << endl;
+                return;
+            }
+            lock.lock();
+            if (level == stack_level) {
+                ready.push_back(move(stack));
+            }
+        }
+    }
+public:
+    explicit StandbyPool(size_t size) : size(size), builder(&StandbyPool::build_loop, this) {}
+    ~StandbyPool()
+    {
+        {
+            lock_guard<mutex> lock(mtx);
+            stopping = true;
+        }
+        cond.notify_all();
+        builder.join();
+    }
+    //Returns a stack of 'level', which is only built here when no ready stack has that level
+    Stack take(int level)
+    {
+        unique_lock<mutex> lock(mtx);
+        if (level != stack_level) {
+            stack_level = level;
+            ready.clear();
+        }
+        if (ready.empty()) {
+            lock.unlock();
+            cond.notify_one();
+            return build_stack(level, false);
+        }
+        Stack ret = move(ready.front());
+        ready.pop_front();
+        cond.notify_one();
+        return ret;
+    }
+};
+
+//Serve one session until the frontend shuts down. Every session has its own component stack but the
+//fuse caches (within the process) and the kernel caches (through 'cache_dir') are shared between sessions.
+static void service(CommBackend &comm_backend, StandbyPool *standby = nullptr)
 {
-    CommBackend comm_backend(address, port);
     serialize::ExecuteBackend exec;
     unique_ptr<ConfigParser> config;
     unique_ptr<ComponentFace> child;
+    //The checksums of the array data the frontend has, when delta transfers are enabled
+    unique_ptr<ChunkChecksums> sums;
+    //The time of the child since the previous reply, which heads the next reply
+    chrono::duration<double> exec_time{0};
+    auto queue_reply_head = [&]() {
+        const double secs = exec_time.count();
+        comm_backend.queue_raw(&secs, sizeof(secs));
+        exec_time = chrono::duration<double>(0);
+    };
+    auto execute = [&](bh_ir &bhir) {
+        const auto tstart = chrono::steady_clock::now();
+        child->execute(&bhir);
+        exec_time += chrono::steady_clock::now() - tstart;
+    };
 
     while(1)
     {
@@ -46,8 +252,14 @@ static void service(const std::string &address, int port)
                 if (child.get() != nullptr) {
                     throw runtime_error("[VEM-PROXY] Received INIT messages multiple times!");
                 }
-                config.reset(new ConfigParser(body.stack_level));
-                child.reset(new ComponentFace(config->getChildLibraryPath(), config->stack_level+1));
+                Stack stack = standby != nullptr ? standby->take(body.stack_level) :
+                                                   build_stack(body.stack_level, false);
+                config = move(stack.config);
+                child = move(stack.child);
+                comm_backend.set_codec(ArrayCodec(*config));
+                if (config->defaultGet<bool>("delta_transfers", false)) {
+                    sums.reset(new ChunkChecksums(config->defaultGet<uint64_t>("delta_chunk_bytes", 65536)));
+                }
                 break;
             }
             case serialize::TYPE_SHUTDOWN:
@@ -70,20 +282,96 @@ static void service(const std::string &address, int port)
                     base->data = NULL;
                     bh_data_malloc(base);
                     comm_backend.recv_array_data(base);
+                    if (sums) {
+                        sums->record(base);
+                    }
                 }
+                set<bh_base*> deferred;
+                recv_updates(comm_backend, exec, sums.get(), deferred);
 
-                child->execute(&bhir);
+                execute(bhir);
 
-                //Send sync'ed array data
+                //Send sync'ed array data in one write except the arrays that the frontend fetches later
+                deque<vector<char> > gathered;
+                bool queued = false;
                 for(size_t i=0; i<data_send.size(); ++i)
                 {
                     bh_base *base = data_send[i];
-                    bh_data_malloc(base);
-                    comm_backend.send_array_data(base);
+                    if (deferred.find(base) == deferred.end()) {
+                        if (not queued) {
+                            queue_reply_head();
+                            queued = true;
+                        }
+                        bh_data_malloc(base);
+                        queue_synced(comm_backend, base, sums.get(), gathered);
+                    }
+                }
+                if (queued) {
+                    comm_backend.send_queued();
+                }
+                if (sums) {
+                    for(const bh_instruction &instr: bhir.instr_list)
+                    {
+                        if (instr.opcode == BH_FREE) {
+                            sums->forget(instr.operand[0].base);
+                        }
+                    }
                 }
                 exec.cleanup(bhir);
                 break;
             }
+            case serialize::TYPE_FETCH:
+            {
+                //The frontend reads the host data of synced arrays that we have kept since their sync (or only
+                //the reply head when there are none)
+                vector<uint64_t> remotes(head.body_size / sizeof(uint64_t));
+                comm_backend.recv_raw(remotes.data(), remotes.size() * sizeof(uint64_t));
+                vector<bh_base*> bases;
+                vector<bh_instruction> syncs;
+                for(uint64_t remote: remotes)
+                {
+                    bh_base *base = exec.local(reinterpret_cast<const bh_base*>(remote));
+                    if (base == NULL) {
+                        throw runtime_error("[VEM-PROXY] the backend received a fetch of an unknown array");
+                    }
+                    bases.push_back(base);
+                    syncs.push_back(bh_instruction(BH_SYNC, {flat_view(base)}));
+                }
+                if (not syncs.empty()) {
+                    bh_ir bhir(syncs.size(), syncs.data());
+                    execute(bhir);
+                }
+
+                deque<vector<char> > gathered;
+                queue_reply_head();
+                for(bh_base *base: bases)
+                {
+                    bh_data_malloc(base);
+                    queue_synced(comm_backend, base, sums.get(), gathered);
+                }
+                comm_backend.send_queued();
+                break;
+            }
+            case serialize::TYPE_FETCH_RANGE:
+            {
+                //The frontend reads the bytes [begin, end) of a synced array that we have kept since its sync
+                uint64_t body[3]; // {remote base, begin, end}
+                comm_backend.recv_raw(body, sizeof(body));
+                bh_base *base = exec.local(reinterpret_cast<const bh_base*>(body[0]));
+                if (base == NULL or body[1] > body[2] or body[2] > static_cast<uint64_t>(bh_base_size(base))) {
+                    throw runtime_error("[VEM-PROXY] the backend received a fetch of an unknown array range");
+                }
+                vector<bh_instruction> syncs{bh_instruction(BH_SYNC, {flat_view(base)})};
+                bh_ir bhir(syncs.size(), syncs.data());
+                execute(bhir);
+
+                queue_reply_head();
+                bh_data_malloc(base);
+                comm_backend.queue_data(static_cast<const char*>(base->data) + body[1], body[2] - body[1],
+                                        bh_type_size(base->type));
+                comm_backend.send_queued();
+                break;
+            }
             default:
             {
                 throw runtime_error("[VEM-PROXY] the backend received a unknown message type");
@@ -92,23 +380,74 @@ static void service(const std::string &address, int port)
     }
 }
 
+//Serve the clients concurrently, each in its own thread, until the process is killed. With 'num_standby' stacks,
+//the sessions take a stack that is built ahead of time instead of building one at their INIT.
+static void serve(int port, size_t num_standby)
+{
+    unique_ptr<StandbyPool> standby;
+    if (num_standby > 0) {
+        standby.reset(new StandbyPool(num_standby));
+    }
+    boost::asio::io_service io_service;
+    boost::asio::ip::tcp::acceptor acceptor(io_service, boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), port));
+    cout << "[PROXY-VEM] Server listen on port " << port << " for multiple clients" << endl;
+    while(1)
+    {
+        shared_ptr<CommBackend> comm_backend;
+        try {
+            comm_backend.reset(new CommBackend(acceptor));
+        } catch (const std::exception &e) {
+            cerr << "[PROXY-VEM] could not accept a client: " << e.what() << endl;
+            continue;
+        }
+        StandbyPool *pool = standby.get();
+        std::thread([comm_backend, pool]() {
+            //A failing session must not take down the other sessions
+            try {
+                service(*comm_backend, pool);
+            } catch (const std::exception &e) {
+                cerr << "[PROXY-VEM] session ended with an error: " << e.what() << endl;
+            }
+        }).detach();
+    }
+}
+
 int main(int argc, char * argv[])
 {
     char *address = NULL;
     int port = 0;
+    bool multiple_clients = false;
+    long num_standby = 0;
 
-    if (argc == 5 && \
-        (strncmp(argv[1], "-a\0", 3) == 0) && \
-        (strncmp(argv[3], "-p\0", 3) == 0)) {
+    bool valid = argc >= 5 and strncmp(argv[1], "-a\0", 3) == 0 and strncmp(argv[3], "-p\0", 3) == 0;
+    for (int i = 5; valid and i < argc; ++i) {
+        if (strncmp(argv[i], "-s\0", 3) == 0) {
+            multiple_clients = true;
+        } else if (strncmp(argv[i], "-w\0", 3) == 0 and i + 1 < argc) {
+            num_standby = atol(argv[++i]);
+            multiple_clients = true;
+            valid = num_standby > 0;
+        } else {
+            valid = false;
+        }
+    }
+    if (valid) {
         address = argv[2];
         port = atoi(argv[4]);
     } else {
-        printf("Usage: %s -a ipaddress -p port\n", argv[0]);
+        printf("Usage: %s -a ipaddress -p port [-s] [-w stacks]\n", argv[0]);
+        printf("  -s  serve multiple clients concurrently until killed instead of a single session\n");
+        printf("  -w  keep 'stacks' pre-built component stacks for the sessions, which implies -s\n");
         return 0;
     }
     if (!address) {
         fprintf(stderr, "Please supply address.\n");
         return 0;
     }
-    service(address, port);
-}
\ No newline at end of file
+    if (multiple_clients) {
+        serve(port, static_cast<size_t>(num_standby));
+    } else {
+        CommBackend comm_backend(address, port);
+        service(comm_backend);
+    }
+}
@@ -0,0 +1,308 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <cstring>
+#include <algorithm>
+#include <exception>
+#include <functional>
+#include <stdexcept>
+
+#include "codec.hpp"
+
+#include "zlib.h"
+#ifdef VEM_PROXY_LZ4
+#include <lz4.h>
+#endif
+#ifdef VEM_PROXY_ZSTD
+#include <zstd.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+ArrayCodec::Type parse_codec(const string &name)
+{
+    if (name == "none") {
+        return ArrayCodec::NONE;
+    } else if (name == "zlib") {
+        return ArrayCodec::ZLIB;
+    }
+#ifdef VEM_PROXY_LZ4
+    if (name == "lz4") {
+        return ArrayCodec::LZ4;
+    }
+#endif
+#ifdef VEM_PROXY_ZSTD
+    if (name == "zstd") {
+        return ArrayCodec::ZSTD;
+    } else if (name == "shuffle_zstd") {
+        return ArrayCodec::SHUFFLE_ZSTD;
+    }
+#endif
+    throw runtime_error("[PROXY-VEM] the codec '" + name + "' is unknown or the proxy is build without it");
+}
+
+// Groups the bytes of the elements in 'src' by their significance, which makes similar floats compressible
+void shuffle(const char *src, size_t nbytes, size_t elem_size, char *dst)
+{
+    const size_t nelem = nbytes / elem_size;
+    for (size_t i = 0; i < nelem; ++i) {
+        for (size_t b = 0; b < elem_size; ++b) {
+            dst[b * nelem + i] = src[i * elem_size + b];
+        }
+    }
+    memcpy(dst + nelem * elem_size, src + nelem * elem_size, nbytes - nelem * elem_size);
+}
+
+// The inverse of shuffle()
+void unshuffle(const char *src, size_t nbytes, size_t elem_size, char *dst)
+{
+    const size_t nelem = nbytes / elem_size;
+    for (size_t i = 0; i < nelem; ++i) {
+        for (size_t b = 0; b < elem_size; ++b) {
+            dst[i * elem_size + b] = src[b * nelem + i];
+        }
+    }
+    memcpy(dst + nelem * elem_size, src + nelem * elem_size, nbytes - nelem * elem_size);
+}
+
+// Calls 'func(i, scratch)' for each 'i' in [0, n) using at most 'threads' threads, which each has its own 'scratch'
+void parallel_for(size_t n, int threads, vector<vector<char> > &scratch,
+                  const function<void(size_t, vector<char>&)> &func)
+{
+    const size_t nthreads = std::max<size_t>(1, std::min<size_t>(n, threads));
+    if (scratch.size() < nthreads) {
+        scratch.resize(nthreads);
+    }
+    if (nthreads == 1) {
+        for (size_t i = 0; i < n; ++i) {
+            func(i, scratch[0]);
+        }
+        return;
+    }
+    atomic<size_t> next(0);
+    exception_ptr error;
+    mutex error_mutex;
+    vector<thread> workers;
+    for (size_t t = 0; t < nthreads; ++t) {
+        workers.emplace_back([&, t]() {
+            try {
+                for (size_t i = next++; i < n; i = next++) {
+                    func(i, scratch[t]);
+                }
+            } catch (...) {
+                lock_guard<mutex> lock(error_mutex);
+                error = current_exception();
+            }
+        });
+    }
+    for (thread &worker: workers) {
+        worker.join();
+    }
+    if (error != nullptr) {
+        rethrow_exception(error);
+    }
+}
+
+} // Unnamed namespace
+
+ArrayCodec::ArrayCodec() : type(NONE), level(0), min_bytes(0), chunk_bytes(4194304), threads(1) {}
+
+ArrayCodec::ArrayCodec(const bohrium::ConfigParser &config) :
+        type(parse_codec(config.defaultGet<string>("codec", "zlib"))),
+        level(config.defaultGet<int>("codec_level", 0)),
+        min_bytes(config.defaultGet<size_t>("codec_min_bytes", 4096)),
+        chunk_bytes(std::max<size_t>(1, config.defaultGet<size_t>("codec_chunk_bytes", 4194304))),
+        threads(std::max(1, config.defaultGet<int>("codec_threads", 1))) {}
+
+size_t ArrayCodec::compress(Type codec, const char *src, size_t nbytes, size_t elem_size, vector<char> &shuffled,
+                            vector<char> &dst) const
+{
+    switch (codec) {
+        case ZLIB: {
+            uLongf size = compressBound(nbytes);
+            dst.resize(size);
+            if (compress2((Bytef*) dst.data(), &size, (const Bytef*) src, nbytes,
+                          level == 0 ? Z_DEFAULT_COMPRESSION : level) != Z_OK) {
+                throw runtime_error("[PROXY-VEM] zlib compression failed");
+            }
+            return size;
+        }
+#ifdef VEM_PROXY_LZ4
+        case LZ4: {
+            dst.resize(LZ4_compressBound(nbytes));
+            const int size = LZ4_compress_default(src, dst.data(), nbytes, dst.size());
+            if (size <= 0) {
+                throw runtime_error("[PROXY-VEM] lz4 compression failed");
+            }
+            return size;
+        }
+#endif
+#ifdef VEM_PROXY_ZSTD
+        case SHUFFLE_ZSTD:
+            shuffled.resize(nbytes);
+            shuffle(src, nbytes, elem_size, shuffled.data());
+            src = shuffled.data();
+            // Fall through
+        case ZSTD: {
+            dst.resize(ZSTD_compressBound(nbytes));
+            const size_t size = ZSTD_compress(dst.data(), dst.size(), src, nbytes, level);
+            if (ZSTD_isError(size)) {
+                throw runtime_error(string("[PROXY-VEM] zstd compression failed: ") + ZSTD_getErrorName(size));
+            }
+            return size;
+        }
+#endif
+        default:
+            throw runtime_error("[PROXY-VEM] cannot compress using an unknown codec");
+    }
+}
+
+void ArrayCodec::decompress(Type codec, const char *src, size_t nbytes, size_t elem_size, vector<char> &shuffled,
+                            char *dst, size_t dst_bytes) const
+{
+    switch (codec) {
+        case ZLIB: {
+            uLongf size = dst_bytes;
+            if (uncompress((Bytef*) dst, &size, (const Bytef*) src, nbytes) != Z_OK or size != dst_bytes) {
+                throw runtime_error("[PROXY-VEM] zlib decompression failed");
+            }
+            return;
+        }
+#ifdef VEM_PROXY_LZ4
+        case LZ4: {
+            if (LZ4_decompress_safe(src, dst, nbytes, dst_bytes) != static_cast<int>(dst_bytes)) {
+                throw runtime_error("[PROXY-VEM] lz4 decompression failed");
+            }
+            return;
+        }
+#endif
+#ifdef VEM_PROXY_ZSTD
+        case ZSTD: {
+            if (ZSTD_decompress(dst, dst_bytes, src, nbytes) != dst_bytes) {
+                throw runtime_error("[PROXY-VEM] zstd decompression failed");
+            }
+            return;
+        }
+        case SHUFFLE_ZSTD: {
+            shuffled.resize(dst_bytes);
+            if (ZSTD_decompress(shuffled.data(), dst_bytes, src, nbytes) != dst_bytes) {
+                throw runtime_error("[PROXY-VEM] zstd decompression failed");
+            }
+            unshuffle(shuffled.data(), dst_bytes, elem_size, dst);
+            return;
+        }
+#endif
+        default:
+            throw runtime_error("[PROXY-VEM] received data of an unknown codec");
+    }
+}
+
+vector<char> &ArrayCodec::pool_buffer()
+{
+    if (_pool_used == _pool.size()) {
+        _pool.emplace_back();
+    }
+    return _pool[_pool_used++];
+}
+
+void ArrayCodec::encode(const void *data, size_t nbytes, size_t elem_size, vector<boost::asio::const_buffer> &buffers)
+{
+    const char *src = static_cast<const char*>(data);
+    const Type codec = nbytes < min_bytes ? NONE : type;
+    // The chunks hold whole elements thus they are shuffled independently
+    const size_t chunk = std::max<size_t>(1, chunk_bytes / elem_size) * elem_size;
+    const size_t nchunks = codec == NONE ? 0 : (nbytes + chunk - 1) / chunk;
+
+    //The head and the compressed size of each chunk go in one buffer
+    vector<char> &head_buf = pool_buffer();
+    head_buf.resize((5 + nchunks) * sizeof(uint64_t));
+    uint64_t *head = reinterpret_cast<uint64_t*>(head_buf.data());
+    head[0] = static_cast<uint64_t>(codec);
+    head[1] = elem_size;
+    head[2] = nbytes;
+    head[3] = codec == NONE ? 0 : chunk;
+    head[4] = nchunks;
+    if (codec == NONE) {
+        buffers.push_back(boost::asio::buffer(head_buf));
+        buffers.push_back(boost::asio::buffer(src, nbytes));
+        return;
+    }
+
+    vector<vector<char>*> chunks(nchunks);
+    for (size_t i = 0; i < nchunks; ++i) {
+        chunks[i] = &pool_buffer();
+    }
+    uint64_t *sizes = head + 5;
+    parallel_for(nchunks, threads, _shuffled, [&](size_t i, vector<char> &shuffled) {
+        const size_t offset = i * chunk;
+        sizes[i] = compress(codec, src + offset, std::min(chunk, nbytes - offset), elem_size, shuffled, *chunks[i]);
+    });
+    buffers.push_back(boost::asio::buffer(head_buf));
+    for (size_t i = 0; i < nchunks; ++i) {
+        buffers.push_back(boost::asio::buffer(chunks[i]->data(), sizes[i]));
+    }
+}
+
+void ArrayCodec::send(Transport &transport, const void *data, size_t nbytes, size_t elem_size)
+{
+    vector<boost::asio::const_buffer> buffers;
+    reset();
+    encode(data, nbytes, elem_size, buffers);
+    transport.write(buffers);
+    reset();
+}
+
+size_t ArrayCodec::recv(Transport &transport, void *data, size_t nbytes)
+{
+    uint64_t head[5];
+    transport.read(head, sizeof(head));
+    if (head[2] != nbytes) {
+        throw runtime_error("[PROXY-VEM] received array data of the wrong size");
+    }
+    char *dst = static_cast<char*>(data);
+    const Type codec = static_cast<Type>(head[0]);
+    if (codec == NONE) {
+        transport.read(dst, nbytes);
+        return sizeof(head) + nbytes;
+    }
+
+    const size_t elem_size = head[1];
+    const size_t chunk = head[3];
+    const size_t nchunks = head[4];
+    vector<uint64_t> sizes(nchunks);
+    transport.read(sizes.data(), sizes.size() * sizeof(uint64_t));
+    vector<size_t> offsets(nchunks + 1, 0);
+    for (size_t i = 0; i < nchunks; ++i) {
+        offsets[i + 1] = offsets[i] + sizes[i];
+    }
+    _received.resize(offsets.back());
+    transport.read(_received.data(), _received.size());
+    parallel_for(nchunks, threads, _shuffled, [&](size_t i, vector<char> &shuffled) {
+        const size_t offset = i * chunk;
+        decompress(codec, _received.data() + offsets[i], sizes[i], elem_size, shuffled, dst + offset,
+                   std::min(chunk, nbytes - offset));
+    });
+    return sizeof(head) + sizes.size() * sizeof(uint64_t) + _received.size();
+}
@@ -0,0 +1,82 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __BH_VEM_PROXY_CODEC_H
+#define __BH_VEM_PROXY_CODEC_H
+
+#include <string>
+#include <deque>
+#include <vector>
+#include <cstdint>
+#include <boost/asio.hpp>
+
+#include <bh_config_parser.hpp>
+
+#include "transport.hpp"
+
+/* The codec of the array data that the proxy frontend and backend exchange. The data is split in chunks
+ * of 'codec_chunk_bytes', which 'codec_threads' threads compress in parallel. Data smaller than
+ * 'codec_min_bytes' is sent raw. Each transfer starts with a header that describes its encoding thus
+ * the two sides doesn't have to use the same codec.
+ */
+class ArrayCodec
+{
+public:
+    enum Type {NONE = 0, ZLIB = 1, LZ4 = 2, ZSTD = 3, SHUFFLE_ZSTD = 4};
+
+    // The codec that sends everything raw
+    ArrayCodec();
+    // The codec of the 'codec*' options of 'config'
+    explicit ArrayCodec(const bohrium::ConfigParser &config);
+
+    // Send the 'nbytes' bytes of 'data', which consists of elements of 'elem_size' bytes
+    void send(Transport &transport, const void *data, size_t nbytes, size_t elem_size);
+    // Appends the encoding of 'data' (like send()) to 'buffers' thus several arrays can go in one vectored write.
+    // Raw data isn't copied. The buffers stay valid until reset(), which reuses them for the next encodings.
+    void encode(const void *data, size_t nbytes, size_t elem_size, std::vector<boost::asio::const_buffer> &buffers);
+    void reset() {
+        _pool_used = 0;
+    }
+    // Receive 'nbytes' bytes into 'data' and returns the bytes it read from the transport
+    size_t recv(Transport &transport, void *data, size_t nbytes);
+
+private:
+    Type type;
+    // The compression level (zero means the default of the codec)
+    int level;
+    size_t min_bytes;
+    size_t chunk_bytes;
+    int threads;
+    // The buffers of the encodings since reset() and the shuffled elements of each thread, which are reused
+    std::deque<std::vector<char> > _pool;
+    size_t _pool_used = 0;
+    std::vector<std::vector<char> > _shuffled;
+    std::vector<char> &pool_buffer();
+    std::vector<char> _received;
+
+    // Compress the chunk 'src' of 'nbytes' bytes into 'dst' and returns the compressed size
+    size_t compress(Type codec, const char *src, size_t nbytes, size_t elem_size, std::vector<char> &shuffled,
+                    std::vector<char> &dst) const;
+    // Decompress 'src' of 'nbytes' bytes into the 'dst_bytes' bytes of 'dst'
+    void decompress(Type codec, const char *src, size_t nbytes, size_t elem_size, std::vector<char> &shuffled,
+                    char *dst, size_t dst_bytes) const;
+};
+
+#endif
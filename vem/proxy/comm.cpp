@@ -19,53 +19,41 @@ If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include <iostream>
+#include <sstream>
+#include <algorithm>
 #include <boost/asio.hpp>
 #include <thread>         // std::this_thread::sleep_for
 #include <chrono>         // std::chrono::seconds
 
 #include <bh_serialize.hpp>
+#include <bh_trace.hpp>
 #include "comm.hpp"
 
-#include "zlib.h"
-
 
 using boost::asio::ip::tcp;
 using namespace std;
 using namespace bohrium;
 
-static void comm_send_array_data(boost::asio::ip::tcp::socket &socket, const bh_base *base)
-{
-    assert(base->data != NULL);
-
-    const size_t org_size = bh_base_size(base);
-    size_t new_size = compressBound(org_size);
-    vector<Bytef> buffer(new_size);
-    compress(&buffer[0], &new_size, (Bytef*)base->data, org_size);
-
-    const size_t size[] = {new_size};
-    boost::asio::write(socket, boost::asio::buffer(size));
-    boost::asio::write(socket, boost::asio::buffer(&buffer[0], new_size));
-}
-
-static void comm_recv_array_data(boost::asio::ip::tcp::socket &socket, bh_base *base)
-{
-    assert(base->data != NULL);
-
-    size_t size[1];
-    boost::asio::read(socket, boost::asio::buffer(size));
-
-    const size_t org_size = bh_base_size(base);
-    size_t new_size = org_size;
-
-    vector<char> compressed(size[0]);
-    boost::asio::read(socket, boost::asio::buffer(compressed));
-
-    uncompress((Bytef*)base->data, &new_size, (Bytef*) (&compressed[0]), compressed.size());
-    assert(new_size == org_size);
-}
-
-CommFrontend::CommFrontend(int stack_level, const std::string &address, int port) : socket(io_service)
+CommFrontend::CommFrontend(const ConfigParser &config) :
+        socket(io_service), codec(config), max_queued(config.defaultGet<size_t>("async_queue_size", 0)),
+        stat(config.defaultGet("prof", false)), prof_filename(config.defaultGet<string>("prof_filename", ""))
 {
+    const string address = config.defaultGet<string>("address", "127.0.0.1");
+    const int port = config.defaultGet<int>("port", 4200);
+    if (config.defaultGet<bool>("delta_transfers", false)) {
+        dirty.reset(new DirtyPages());
+    }
+    if (config.defaultGet<bool>("remote_resident", false)) {
+        //The delta transfers track the host writes of a fetched array thus it is fetched as a whole
+        const uint64_t chunk_bytes = dirty ? 0 : config.defaultGet<uint64_t>("remote_resident_chunk_bytes", 1048576);
+        lazy.reset(new LazyArrays([this](bh_base *base, uint64_t begin, uint64_t end) {
+            if (begin == 0 and end == static_cast<uint64_t>(bh_base_size(base))) {
+                fetch(base);
+            } else {
+                fetch(base, begin, end);
+            }
+        }, chunk_bytes));
+    }
     constexpr unsigned int retries = 100;
     for(unsigned int i = 1; i <= retries; ++i)
     {
@@ -100,9 +88,11 @@ CommFrontend::CommFrontend(int stack_level, const std::string &address, int port
     throw runtime_error("[PROXY-VEM] No connection!");
 
 connected:
+    transport = connect_transport(socket, config);
+
     //Serialize message body
     vector<char> buf_body;
-    serialize::Init body(stack_level);
+    serialize::Init body(config.stack_level);
     body.serialize(buf_body);
 
     //Serialize message head
@@ -111,70 +101,403 @@ connected:
     head.serialize(buf_head);
 
     //Send serialized message
-    boost::asio::write(socket, boost::asio::buffer(buf_head));
-    boost::asio::write(socket, boost::asio::buffer(buf_body));
+    transport->write(buf_head.data(), buf_head.size());
+    transport->write(buf_body.data(), buf_body.size());
+
+    if (max_queued > 0) {
+        io_thread = thread(&CommFrontend::io_loop, this);
+    }
 }
 
 CommFrontend::~CommFrontend()
 {
+    //Let's send the queued messages before the shutdown
+    if (io_thread.joinable()) {
+        {
+            lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        cond.notify_all();
+        io_thread.join();
+    }
+    if (stat.print_on_exit) {
+        fetch(vector<bh_base*>());
+        stat.write(prof_filename, cout);
+    }
+
     //Serialize message head
     vector<char> buf_head;
     serialize::Header head(serialize::TYPE_SHUTDOWN, 0);
     head.serialize(buf_head);
 
     //Send serialized message
-    boost::asio::write(socket, boost::asio::buffer(buf_head));
+    transport->write(buf_head.data(), buf_head.size());
+    transport.reset();
     socket.shutdown(boost::asio::ip::tcp::socket::shutdown_both);
     socket.close();
 }
 
+void CommFrontend::Message::add(bool raw, const void *data, uint64_t nbytes, size_t elem_size, bool copy)
+{
+    Part part{raw, vector<char>(), static_cast<const char*>(data), nbytes, elem_size};
+    if (copy) {
+        part.copy.assign(part.data, part.data + nbytes);
+        part.data = part.copy.data();
+    }
+    parts.push_back(std::move(part));
+}
+
+void CommFrontend::send_message(const Message &msg)
+{
+    const auto tstart = chrono::steady_clock::now();
+    //The whole message goes in one vectored write, which points to the data of the parts
+    uint64_t raw_bytes = msg.head.size() + msg.body.size();
+    vector<boost::asio::const_buffer> buffers;
+    buffers.push_back(boost::asio::buffer(msg.head));
+    buffers.push_back(boost::asio::buffer(msg.body));
+    for(const Part &part: msg.parts)
+    {
+        if (part.raw) {
+            buffers.push_back(boost::asio::buffer(part.data, part.nbytes));
+        } else {
+            codec.encode(part.data, part.nbytes, part.elem_size, buffers);
+        }
+        raw_bytes += part.nbytes;
+    }
+    transport->write(buffers);
+    const uint64_t wire_bytes = boost::asio::buffer_size(buffers);
+    codec.reset();
+
+    lock_guard<std::mutex> lock(mutex);
+    stat.bytes_sent_raw += raw_bytes;
+    stat.bytes_sent_wire += wire_bytes;
+    stat.time_send += chrono::steady_clock::now() - tstart;
+}
+
+void CommFrontend::add_updates(const bh_ir &bhir, const vector<bh_base*> &data_recv,
+                               const vector<bh_base*> &deferred, Message &msg)
+{
+    // The updates are the dirty pages of the known arrays: their count, followed by the remote base, the page size,
+    // the number of pages, and the page indices of each update, followed by the pages of each update.
+    vector<uint64_t> updates{0};
+    vector<vector<char> > pages;
+    // The resets are the synced arrays that we don't have a copy of: their count followed by the remote bases
+    vector<uint64_t> resets{0};
+    if (dirty) {
+        // The freed arrays are gone before their writes matter
+        for(const bh_instruction &instr: bhir.instr_list)
+        {
+            if (instr.opcode == BH_FREE) {
+                dirty->release(instr.operand[0].base);
+            }
+        }
+        for(const auto &base_and_pages: dirty->takeDirty())
+        {
+            const bh_base *base = base_and_pages.first;
+            const vector<uint64_t> &indices = base_and_pages.second;
+            updates.push_back(reinterpret_cast<uint64_t>(base));
+            updates.push_back(dirty->page_size);
+            updates.push_back(indices.size());
+            updates.insert(updates.end(), indices.begin(), indices.end());
+            pages.emplace_back();
+            gather_chunks(static_cast<const char*>(base->data), bh_base_size(base), indices, dirty->page_size,
+                          pages.back());
+            ++updates[0];
+        }
+    }
+    for(const bh_base *base: data_recv)
+    {
+        if (not dirty or base->data == NULL or not dirty->tracking(base)) {
+            resets.push_back(reinterpret_cast<uint64_t>(base));
+            ++resets[0];
+        }
+    }
+    msg.add(true, updates.data(), updates.size() * sizeof(uint64_t), 1, true);
+    for(const vector<char> &p: pages)
+    {
+        msg.add(false, p.data(), p.size(), 1, true);
+    }
+    msg.add(true, resets.data(), resets.size() * sizeof(uint64_t), 1, true);
+    // The deferred are the synced arrays that the backend keeps until we fetch them: their count followed by
+    // the remote bases
+    vector<uint64_t> lazy_bases{deferred.size()};
+    for(const bh_base *base: deferred)
+    {
+        lazy_bases.push_back(reinterpret_cast<uint64_t>(base));
+    }
+    msg.add(true, lazy_bases.data(), lazy_bases.size() * sizeof(uint64_t), 1, true);
+}
+
 void CommFrontend::execute(bh_ir &bhir)
 {
+    trace::Scope scope("proxy", "send_flush");
+    scope.arg("instructions", bhir.instr_list.size());
+    const auto tstart = chrono::steady_clock::now();
+    ++stat.num_flushes;
+
     //Serialize the BhIR
-    vector<char> buf_body;
+    Message msg;
     vector<bh_base*> data_send;
     vector<bh_base*> data_recv;
-    exec_serializer.serialize(bhir, buf_body, data_send, data_recv);
+    exec_serializer.serialize(bhir, msg.body, data_send, data_recv);
 
     //Serialize message head
-    vector<char> buf_head;
-    serialize::Header head(serialize::TYPE_EXEC, buf_body.size());
-    head.serialize(buf_head);
-
-    //Send serialized message
-    boost::asio::write(socket, boost::asio::buffer(buf_head));
-    boost::asio::write(socket, boost::asio::buffer(buf_body));
+    serialize::Header head(serialize::TYPE_EXEC, msg.body.size());
+    head.serialize(msg.head);
 
-    //Send array data
-    for(size_t i=0; i< data_send.size(); ++i)
+    //The new base array data, which the backend has a copy of from now on
+    const bool async = max_queued > 0;
+    for(bh_base *base: data_send)
     {
-        bh_base *base = data_send[i];
         assert(base->data != NULL);
-        send_array_data(base);
+        msg.add(false, base->data, bh_base_size(base), bh_type_size(base->type), async);
+        if (dirty) {
+            dirty->track(base);
+        }
+    }
+    //In the remote-resident mode, we only receive the synced arrays that we cannot protect until the host reads them
+    vector<bh_base*> deferred;
+    if (lazy) {
+        for(const bh_instruction &instr: bhir.instr_list)
+        {
+            if (instr.opcode == BH_FREE) {
+                lazy->release(instr.operand[0].base);
+            }
+        }
+        for(bh_base *base: data_recv)
+        {
+            bh_data_malloc(base);
+            if (lazy->deferrable(base)) {
+                deferred.push_back(base);
+            }
+        }
+    }
+    add_updates(bhir, data_recv, deferred, msg);
+    if (not deferred.empty()) {
+        data_recv.erase(remove_if(data_recv.begin(), data_recv.end(),
+                                  [&](bh_base *base) {return lazy->deferrable(base);}), data_recv.end());
     }
+    //Protect the deferred host data, which we must do after the message has copied or sent its host data
+    auto defer_all = [&]() {
+        for(bh_base *base: deferred)
+        {
+            if (dirty) {
+                dirty->release(base);
+            }
+            lazy->defer(base);
+        }
+    };
 
-    //Cleanup discard base array etc.
-    exec_serializer.cleanup(bhir);
+    if (async) {
+        //Cleanup discard base array etc.
+        exec_serializer.cleanup(bhir);
+        stat.time_serialize += chrono::steady_clock::now() - tstart;
+
+        {
+            unique_lock<std::mutex> lock(mutex);
+            cond.wait(lock, [&]() {return queue.size() < max_queued or io_error != nullptr;});
+            if (io_error != nullptr) {
+                rethrow_exception(io_error);
+            }
+            queue.push_back(std::move(msg));
+        }
+        cond.notify_all();
+
+        //We only wait for the backend when the client needs sync'ed array data
+        if (data_recv.empty()) {
+            defer_all();
+            return;
+        }
+        drain();
+    } else {
+        stat.time_serialize += chrono::steady_clock::now() - tstart;
+        //Send serialized message, which points to the host data thus before the cleanup
+        send_message(msg);
+
+        //Cleanup discard base array etc.
+        exec_serializer.cleanup(bhir);
+    }
+    defer_all();
+    if (data_recv.empty()) {
+        return;
+    }
 
     //Receive sync'ed array data
+    const auto trecv = chrono::steady_clock::now();
+    ++stat.num_round_trips;
+    recv_reply_head();
     for(size_t i=0; i< data_recv.size(); ++i)
     {
         bh_base *base = data_recv[i];
         bh_data_malloc(base);
         recv_array_data(base);
     }
+    stat.time_recv += chrono::steady_clock::now() - trecv;
+}
+
+void CommFrontend::recv_reply_head()
+{
+    double remote_exec;
+    transport->read(&remote_exec, sizeof(remote_exec));
+    stat.time_remote_exec += chrono::duration<double>(remote_exec);
+    stat.bytes_recv_raw += sizeof(remote_exec);
+    stat.bytes_recv_wire += sizeof(remote_exec);
+}
+
+void CommFrontend::fetch(const vector<bh_base*> &bases)
+{
+    //The backend answers after the messages before the fetch
+    if (max_queued > 0) {
+        drain();
+    }
+    trace::Scope scope("proxy", "fetch");
+    scope.arg("arrays", bases.size());
+    const auto tstart = chrono::steady_clock::now();
+    vector<uint64_t> remotes;
+    for(const bh_base *base: bases)
+    {
+        remotes.push_back(reinterpret_cast<uint64_t>(base));
+    }
+    vector<char> buf_head;
+    serialize::Header head(serialize::TYPE_FETCH, remotes.size() * sizeof(uint64_t));
+    head.serialize(buf_head);
+    transport->write(vector<boost::asio::const_buffer>{boost::asio::buffer(buf_head),
+                                                       boost::asio::buffer(remotes)});
+    recv_reply_head();
+    for(bh_base *base: bases)
+    {
+        recv_array_data(base);
+    }
+    if (not bases.empty()) {
+        ++stat.num_fetches;
+        ++stat.num_round_trips;
+    }
+    stat.time_recv += chrono::steady_clock::now() - tstart;
+}
+
+void CommFrontend::fetch(bh_base *base, uint64_t begin, uint64_t end)
+{
+    //The backend answers after the messages before the fetch
+    if (max_queued > 0) {
+        drain();
+    }
+    trace::Scope scope("proxy", "fetch_range");
+    scope.arg("bytes", end - begin);
+    const auto tstart = chrono::steady_clock::now();
+    const uint64_t body[3] = {reinterpret_cast<uint64_t>(base), begin, end};
+    vector<char> buf_head;
+    serialize::Header head(serialize::TYPE_FETCH_RANGE, sizeof(body));
+    head.serialize(buf_head);
+    transport->write(vector<boost::asio::const_buffer>{boost::asio::buffer(buf_head),
+                                                       boost::asio::buffer(body, sizeof(body))});
+    recv_reply_head();
+    stat.bytes_recv_wire += codec.recv(*transport, static_cast<char*>(base->data) + begin, end - begin);
+    stat.bytes_recv_raw += end - begin;
+    ++stat.num_fetches;
+    ++stat.num_round_trips;
+    stat.time_recv += chrono::steady_clock::now() - tstart;
+}
+
+string CommFrontend::statistic()
+{
+    stringstream ss;
+    if (stat.enabled) {
+        fetch(vector<bh_base*>());
+    }
+    lock_guard<std::mutex> lock(mutex);
+    stat.pprint(ss);
+    return ss.str();
+}
+
+void CommFrontend::statistic_enable_and_reset(bool print_on_exit)
+{
+    //The backend's time so far doesn't belong to the new statistics
+    fetch(vector<bh_base*>());
+    lock_guard<std::mutex> lock(mutex);
+    stat = ProxyStatistics(true, print_on_exit);
+}
+
+void CommFrontend::io_loop()
+{
+    while(1)
+    {
+        Message msg;
+        {
+            unique_lock<std::mutex> lock(mutex);
+            cond.wait(lock, [&]() {return not queue.empty() or stopping;});
+            if (queue.empty()) {
+                return;
+            }
+            msg = std::move(queue.front());
+            queue.pop_front();
+            sending = true;
+        }
+        cond.notify_all();
+        try
+        {
+            send_message(msg);
+        }
+        catch(...)
+        {
+            lock_guard<std::mutex> lock(mutex);
+            io_error = current_exception();
+            queue.clear();
+            sending = false;
+            cond.notify_all();
+            return;
+        }
+        {
+            lock_guard<std::mutex> lock(mutex);
+            sending = false;
+        }
+        cond.notify_all();
+    }
+}
+
+void CommFrontend::drain()
+{
+    unique_lock<std::mutex> lock(mutex);
+    cond.wait(lock, [&]() {return (queue.empty() and not sending) or io_error != nullptr;});
+    if (io_error != nullptr) {
+        rethrow_exception(io_error);
+    }
 }
 
 void CommFrontend::send_array_data(const bh_base *base)
 {
     assert(base->data != NULL);
-    comm_send_array_data(socket, base);
+    codec.send(*transport, base->data, bh_base_size(base), bh_type_size(base->type));
 }
 
 void CommFrontend::recv_array_data(bh_base *base)
 {
     assert(base->data != NULL);
-    comm_recv_array_data(socket, base);
+    char *data = static_cast<char*>(base->data);
+    const uint64_t nbytes = bh_base_size(base);
+    if (dirty) {
+        dirty->release(base);
+    }
+
+    //The data is either whole or the chunks that changed since the backend last sent or received the array
+    uint64_t delta[2]; // {chunk size, number of chunks}
+    transport->read(delta, sizeof(delta));
+    stat.bytes_recv_raw += sizeof(delta);
+    stat.bytes_recv_wire += sizeof(delta);
+    if (delta[1] == DELTA_WHOLE) {
+        stat.bytes_recv_wire += codec.recv(*transport, data, nbytes);
+        stat.bytes_recv_raw += nbytes;
+    } else {
+        vector<uint64_t> chunks(delta[1]);
+        transport->read(chunks.data(), chunks.size() * sizeof(uint64_t));
+        vector<char> buf(chunks_size(chunks, delta[0], nbytes));
+        stat.bytes_recv_wire += chunks.size() * sizeof(uint64_t) + codec.recv(*transport, buf.data(), buf.size());
+        stat.bytes_recv_raw += chunks.size() * sizeof(uint64_t) + buf.size();
+        scatter_chunks(buf.data(), chunks, delta[0], data, nbytes);
+    }
+
+    if (dirty) {
+        dirty->track(base);
+    }
 }
 
 
@@ -184,10 +507,18 @@ CommBackend::CommBackend(const std::string &address, int port) : socket(io_servi
     tcp::acceptor acceptor(io_service, tcp::endpoint(tcp::v4(), port));
     acceptor.accept(socket);
     socket.set_option(boost::asio::ip::tcp::no_delay(true));
+    transport = accept_transport(socket);
+}
+
+CommBackend::CommBackend(tcp::acceptor &acceptor) : socket(io_service) {
+    acceptor.accept(socket);
+    socket.set_option(boost::asio::ip::tcp::no_delay(true));
+    transport = accept_transport(socket);
 }
 
 CommBackend::~CommBackend()
 {
+    transport.reset();
     socket.shutdown(boost::asio::ip::tcp::socket::shutdown_both);
     socket.close();
 }
@@ -196,25 +527,60 @@ serialize::Header CommBackend::next_message_head()
 {
     //Let's read the head of the message
     vector<char> buf_head(serialize::HeaderSize);
-    boost::asio::read(socket, boost::asio::buffer(buf_head));
+    transport->read(buf_head.data(), buf_head.size());
     serialize::Header head(buf_head);
     return head;
 }
 
 void CommBackend::next_message_body(std::vector<char> &buffer)
 {
-    boost::asio::read(socket, boost::asio::buffer(buffer));
+    transport->read(buffer.data(), buffer.size());
 }
 
 
+void CommBackend::set_codec(const ArrayCodec &codec)
+{
+    this->codec = codec;
+}
+
 void CommBackend::send_array_data(const bh_base *base)
 {
     assert(base->data != NULL);
-    comm_send_array_data(socket, base);
+    codec.send(*transport, base->data, bh_base_size(base), bh_type_size(base->type));
 }
 
 void CommBackend::recv_array_data(bh_base *base)
 {
     assert(base->data != NULL);
-    comm_recv_array_data(socket, base);
+    codec.recv(*transport, base->data, bh_base_size(base));
+}
+
+void CommBackend::recv_raw(void *data, size_t nbytes)
+{
+    transport->read(data, nbytes);
+}
+
+void CommBackend::queue_raw(const void *data, size_t nbytes)
+{
+    const char *src = static_cast<const char*>(data);
+    queued_raw.emplace_back(src, src + nbytes);
+    queued.push_back(boost::asio::buffer(queued_raw.back()));
+}
+
+void CommBackend::queue_data(const void *data, uint64_t nbytes, size_t elem_size)
+{
+    codec.encode(data, nbytes, elem_size, queued);
+}
+
+void CommBackend::send_queued()
+{
+    transport->write(queued);
+    queued.clear();
+    queued_raw.clear();
+    codec.reset();
+}
+
+void CommBackend::recv_data(void *data, uint64_t nbytes)
+{
+    codec.recv(*transport, data, nbytes);
 }
@@ -19,10 +19,20 @@ If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include <string>
+#include <memory>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <exception>
+#include <condition_variable>
 #include <boost/asio.hpp>
 
 #include <bh_serialize.hpp>
 
+#include "codec.hpp"
+#include "delta.hpp"
+#include "statistics.hpp"
+
 #ifndef __BH_VEM_PROXY_COMM_H
 #define __BH_VEM_PROXY_COMM_H
 
@@ -33,12 +43,73 @@ private:
 
     boost::asio::io_service io_service;
     boost::asio::ip::tcp::socket socket;
+    // The messages go through the transport, which is the socket itself unless another one is selected
+    std::unique_ptr<Transport> transport;
+    ArrayCodec codec;
+
+    // A serialized flush and the data that follows it. A part is either raw bytes or array data that goes through
+    // the codec. The parts own a copy of their data in the asynchronous mode since the client might write or free
+    // the host data as soon as execute() returns.
+    struct Part {
+        bool raw;
+        std::vector<char> copy;
+        const char *data;
+        uint64_t nbytes;
+        size_t elem_size;
+    };
+    struct Message {
+        std::vector<char> head;
+        std::vector<char> body;
+        std::vector<Part> parts;
+        void add(bool raw, const void *data, uint64_t nbytes, size_t elem_size, bool copy);
+    };
+    void send_message(const Message &msg);
+    // Tracks the host writes to the arrays the backend has, when delta transfers are enabled
+    std::unique_ptr<DirtyPages> dirty;
+    // The synced arrays that stay on the backend until the host reads them, when the remote-resident mode is enabled
+    std::unique_ptr<LazyArrays> lazy;
+    // Adds the host writes to the known arrays to 'msg', the synced arrays we need as a whole, and the synced
+    // arrays that are 'deferred'
+    void add_updates(const bh_ir &bhir, const std::vector<bh_base*> &data_recv,
+                     const std::vector<bh_base*> &deferred, Message &msg);
+    // In the asynchronous mode, 'io_thread' sends the queued messages in order while the client continues.
+    // At most 'max_queued' messages are queued (zero disables the asynchronous mode).
+    const size_t max_queued;
+    std::deque<Message> queue;
+    // Whether 'io_thread' is sending a message that it has taken from 'queue'
+    bool sending = false;
+    bool stopping = false;
+    // The error of 'io_thread', which the next execute() re-throws
+    std::exception_ptr io_error;
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::thread io_thread;
+    void io_loop();
+    // Wait until all queued messages are sent
+    void drain();
+    // The statistics, which 'mutex' guards since 'io_thread' records the sends
+    ProxyStatistics stat;
+    const std::string prof_filename;
+    // Read the head of a reply of the backend, which is the time of its child since the previous reply
+    void recv_reply_head();
+    // Receive the synced data of 'bases' that the backend has kept since the sync (none just gets the reply head)
+    void fetch(const std::vector<bh_base*> &bases);
 public:
-    CommFrontend(int stack_level, const std::string &address, int port);
+    // Connects to the backend of the 'address' and 'port' options of 'config'
+    explicit CommFrontend(const bohrium::ConfigParser &config);
     ~CommFrontend();
     void execute(bh_ir &bhir);
     void send_array_data(const bh_base *base);
     void recv_array_data(bh_base *base);
+    // Receive the synced array data that the backend has kept since the sync
+    void fetch(bh_base *base) {
+        fetch(std::vector<bh_base*>{base});
+    }
+    // Receive the bytes [begin, end) of the synced array data that the backend has kept since the sync
+    void fetch(bh_base *base, uint64_t begin, uint64_t end);
+    // Pretty print the statistics including the backend's time of the messages so far
+    std::string statistic();
+    void statistic_enable_and_reset(bool print_on_exit);
 };
 
 class CommBackend
@@ -46,14 +117,31 @@ class CommBackend
 private:
     boost::asio::io_service io_service;
     boost::asio::ip::tcp::socket socket;
+    // The messages go through the transport, which is the socket itself unless another one is selected
+    std::unique_ptr<Transport> transport;
+    ArrayCodec codec;
+    std::vector<boost::asio::const_buffer> queued;
+    std::deque<std::vector<char> > queued_raw;
 public:
     CommBackend();
     ~CommBackend();
     CommBackend(const std::string &address, int port=4200);
+    // Accept the next client of 'acceptor', which lets a server keep listening between sessions
+    explicit CommBackend(boost::asio::ip::tcp::acceptor &acceptor);
     bohrium::serialize::Header next_message_head();
     void next_message_body(std::vector<char> &buffer);
+    // The codec of the sync'ed array data (the received array data describes its own codec)
+    void set_codec(const ArrayCodec &codec);
     void send_array_data(const bh_base *base);
     void recv_array_data(bh_base *base);
+    // Receive bytes as they are and data through the codec
+    void recv_raw(void *data, size_t nbytes);
+    void recv_data(void *data, uint64_t nbytes);
+    // Queue bytes as they are (which are copied) and data through the codec (which must stay valid until
+    // send_queued()), which send_queued() then sends in one vectored write
+    void queue_raw(const void *data, size_t nbytes);
+    void queue_data(const void *data, uint64_t nbytes, size_t elem_size);
+    void send_queued();
 };
 
 #endif
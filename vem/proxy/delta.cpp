@@ -0,0 +1,280 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <cstring>
+#include <algorithm>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include <bh_mem_signal.h>
+#include "delta.hpp"
+
+using namespace std;
+
+uint64_t chunk_checksum(const char *data, uint64_t nbytes) {
+    // A multiply-xorshift over 64-bit words, which is fast enough to run at memory bandwidth
+    const uint64_t mul = 0x9E3779B97F4A7C15ULL;
+    uint64_t h = nbytes * mul;
+    uint64_t i = 0;
+    for (; i + 8 <= nbytes; i += 8) {
+        uint64_t word;
+        memcpy(&word, data + i, 8);
+        h = (h ^ word) * mul;
+        h ^= h >> 29;
+    }
+    if (i < nbytes) {
+        uint64_t word = 0;
+        memcpy(&word, data + i, nbytes - i);
+        h = (h ^ word) * mul;
+        h ^= h >> 29;
+    }
+    return h;
+}
+
+uint64_t chunks_size(const vector<uint64_t> &chunks, uint64_t chunk_bytes, uint64_t nbytes) {
+    uint64_t ret = 0;
+    for (uint64_t c: chunks) {
+        ret += std::min(chunk_bytes, nbytes - c * chunk_bytes);
+    }
+    return ret;
+}
+
+void gather_chunks(const char *data, uint64_t nbytes, const vector<uint64_t> &chunks, uint64_t chunk_bytes,
+                   vector<char> &out) {
+    out.resize(chunks_size(chunks, chunk_bytes, nbytes));
+    char *dst = out.data();
+    for (uint64_t c: chunks) {
+        const uint64_t n = std::min(chunk_bytes, nbytes - c * chunk_bytes);
+        memcpy(dst, data + c * chunk_bytes, n);
+        dst += n;
+    }
+}
+
+void scatter_chunks(const char *in, const vector<uint64_t> &chunks, uint64_t chunk_bytes, char *data,
+                    uint64_t nbytes) {
+    for (uint64_t c: chunks) {
+        if (c * chunk_bytes >= nbytes) {
+            throw runtime_error("scatter_chunks(): chunk out of range");
+        }
+        const uint64_t n = std::min(chunk_bytes, nbytes - c * chunk_bytes);
+        memcpy(data + c * chunk_bytes, in, n);
+        in += n;
+    }
+}
+
+void ChunkChecksums::record(const bh_base *base) {
+    const uint64_t nbytes = static_cast<uint64_t>(bh_base_size(base));
+    if (base->data == NULL) {
+        _sums.erase(base);
+        return;
+    }
+    const char *data = static_cast<const char *>(base->data);
+    vector<uint64_t> &sums = _sums[base];
+    sums.resize((nbytes + chunk_bytes - 1) / chunk_bytes);
+    for (uint64_t c = 0; c < sums.size(); ++c) {
+        sums[c] = chunk_checksum(data + c * chunk_bytes, std::min(chunk_bytes, nbytes - c * chunk_bytes));
+    }
+}
+
+void ChunkChecksums::record(const bh_base *base, uint64_t begin, uint64_t end) {
+    auto it = _sums.find(base);
+    if (it == _sums.end() or base->data == NULL or begin >= end) {
+        return;
+    }
+    const uint64_t nbytes = static_cast<uint64_t>(bh_base_size(base));
+    const char *data = static_cast<const char *>(base->data);
+    const uint64_t last = std::min<uint64_t>(it->second.size(), (end + chunk_bytes - 1) / chunk_bytes);
+    for (uint64_t c = begin / chunk_bytes; c < last; ++c) {
+        it->second[c] = chunk_checksum(data + c * chunk_bytes, std::min(chunk_bytes, nbytes - c * chunk_bytes));
+    }
+}
+
+bool ChunkChecksums::changed(const bh_base *base, vector<uint64_t> &out) {
+    out.clear();
+    const uint64_t nbytes = static_cast<uint64_t>(bh_base_size(base));
+    auto it = _sums.find(base);
+    if (it == _sums.end() or base->data == NULL or it->second.size() != (nbytes + chunk_bytes - 1) / chunk_bytes) {
+        record(base);
+        return false;
+    }
+    const char *data = static_cast<const char *>(base->data);
+    vector<uint64_t> &sums = it->second;
+    for (uint64_t c = 0; c < sums.size(); ++c) {
+        const uint64_t sum = chunk_checksum(data + c * chunk_bytes, std::min(chunk_bytes, nbytes - c * chunk_bytes));
+        if (sum != sums[c]) {
+            sums[c] = sum;
+            out.push_back(c);
+        }
+    }
+    return true;
+}
+
+DirtyPages::DirtyPages() : page_size(static_cast<uint64_t>(sysconf(_SC_PAGESIZE))), _fallback(page_size) {
+    bh_mem_signal_init();
+}
+
+DirtyPages::~DirtyPages() {
+    while (not _tracked.empty()) {
+        release(_tracked.begin()->first);
+    }
+}
+
+void DirtyPages::on_write(void *idx, void *addr) {
+    Tracked *t = static_cast<Tracked *>(idx);
+    const uint64_t page = (static_cast<char *>(addr) - t->addr) / t->page_size;
+    mprotect(t->addr + page * t->page_size, t->page_size, PROT_READ | PROT_WRITE);
+    t->dirty[page] = 1;
+    t->any = 1;
+}
+
+void DirtyPages::track(bh_base *base) {
+    release(base);
+    const uint64_t bytes = static_cast<uint64_t>(bh_base_size(base));
+    if (base->data == NULL or bytes == 0) {
+        return;
+    }
+    const uint64_t npages = (bytes + page_size - 1) / page_size;
+    unique_ptr<Tracked> t(new Tracked{static_cast<char *>(base->data), bytes, npages,
+                                      unique_ptr<volatile sig_atomic_t[]>(new volatile sig_atomic_t[npages]()),
+                                      0, page_size});
+    // NB: mprotect() only accepts page aligned addresses
+    if (reinterpret_cast<uintptr_t>(t->addr) % page_size != 0 or mprotect(t->addr, bytes, PROT_READ) != 0) {
+        _fallback.record(base);
+        _fallback_bases.insert(base);
+        return;
+    }
+    bh_mem_signal_attach(t.get(), t->addr, bytes, on_write);
+    _tracked[base] = std::move(t);
+}
+
+void DirtyPages::release(bh_base *base) {
+    _fallback.forget(base);
+    _fallback_bases.erase(base);
+    auto it = _tracked.find(base);
+    if (it != _tracked.end()) {
+        bh_mem_signal_detach(it->second->addr);
+        // NB: the data might have been unmapped by the host thus we ignore errors
+        mprotect(it->second->addr, it->second->bytes, PROT_READ | PROT_WRITE);
+        _tracked.erase(it);
+    }
+}
+
+map<bh_base *, vector<uint64_t> > DirtyPages::takeDirty() {
+    map<bh_base *, vector<uint64_t> > ret;
+    for (auto &base_and_tracked: _tracked) {
+        Tracked &t = *base_and_tracked.second;
+        if (not t.any) {
+            continue;
+        }
+        t.any = 0;
+        vector<uint64_t> &pages = ret[base_and_tracked.first];
+        for (uint64_t p = 0; p < t.npages; ++p) {
+            if (t.dirty[p]) {
+                t.dirty[p] = 0;
+                pages.push_back(p);
+                mprotect(t.addr + p * page_size, std::min(page_size, t.bytes - p * page_size), PROT_READ);
+            }
+        }
+    }
+    // The fallback finds the written pages of the bases that couldn't be protected by their checksums
+    vector<uint64_t> pages;
+    for (bh_base *base: _fallback_bases) {
+        if (_fallback.changed(base, pages) and not pages.empty()) {
+            ret[base] = pages;
+        }
+    }
+    return ret;
+}
+
+LazyArrays::LazyArrays(function<void(bh_base *, uint64_t, uint64_t)> fetch, uint64_t chunk_bytes) :
+        _fetch(std::move(fetch)), _page_size(static_cast<uint64_t>(sysconf(_SC_PAGESIZE))),
+        _chunk_bytes((chunk_bytes + _page_size - 1) / _page_size * _page_size) {
+    bh_mem_signal_init();
+}
+
+LazyArrays::~LazyArrays() {
+    while (not _deferred.empty()) {
+        release(_deferred.begin()->first);
+    }
+}
+
+bool LazyArrays::deferrable(const bh_base *base) const {
+    // NB: mprotect() only accepts page aligned addresses
+    return base->data != NULL and bh_base_size(base) > 0 and
+           reinterpret_cast<uintptr_t>(base->data) % _page_size == 0;
+}
+
+void LazyArrays::on_access(void *idx, void *addr) {
+    Deferred *d = static_cast<Deferred *>(idx);
+    LazyArrays *self = d->self;
+    bh_base *base = d->base;
+    const uint64_t chunk = static_cast<uint64_t>(static_cast<char *>(addr) - d->addr) / d->chunk_bytes;
+    const uint64_t begin = chunk * d->chunk_bytes;
+    const uint64_t end = std::min(begin + d->chunk_bytes, d->bytes);
+    if (d->remaining == 1) {
+        // The last chunk thus the base is no longer deferred
+        self->release(base);
+    } else {
+        mprotect(d->addr + begin, end - begin, PROT_READ | PROT_WRITE);
+        d->fetched[chunk] = true;
+        --d->remaining;
+    }
+    self->_fetch(base, begin, end);
+}
+
+void LazyArrays::defer(bh_base *base) {
+    const uint64_t bytes = static_cast<uint64_t>(bh_base_size(base));
+    auto it = _deferred.find(base);
+    if (it != _deferred.end()) {
+        Deferred &d = *it->second;
+        if (d.remaining < d.fetched.size()) {
+            if (mprotect(d.addr, d.bytes, PROT_NONE) != 0) {
+                release(base);
+                _fetch(base, 0, bytes);
+                return;
+            }
+            d.fetched.assign(d.fetched.size(), false);
+            d.remaining = d.fetched.size();
+        }
+        return;
+    }
+    const uint64_t chunk_bytes = _chunk_bytes == 0 ? bytes : std::min(_chunk_bytes, bytes);
+    const uint64_t nchunks = (bytes + chunk_bytes - 1) / chunk_bytes;
+    unique_ptr<Deferred> d(new Deferred{this, base, static_cast<char *>(base->data), bytes, chunk_bytes,
+                                        vector<bool>(nchunks, false), nchunks});
+    if (mprotect(d->addr, bytes, PROT_NONE) != 0) {
+        // The host data stays unprotected thus we fetch it now
+        _fetch(base, 0, bytes);
+        return;
+    }
+    bh_mem_signal_attach(d.get(), d->addr, bytes, on_access);
+    _deferred[base] = std::move(d);
+}
+
+void LazyArrays::release(bh_base *base) {
+    auto it = _deferred.find(base);
+    if (it != _deferred.end()) {
+        bh_mem_signal_detach(it->second->addr);
+        // NB: the data might have been unmapped by the host thus we ignore errors
+        mprotect(it->second->addr, it->second->bytes, PROT_READ | PROT_WRITE);
+        _deferred.erase(it);
+    }
+}
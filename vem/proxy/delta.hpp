@@ -0,0 +1,165 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __BH_VEM_PROXY_DELTA_H
+#define __BH_VEM_PROXY_DELTA_H
+
+#include <map>
+#include <set>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <cstdint>
+#include <csignal>
+
+#include <bh_base.hpp>
+
+// Marks a transfer of a whole array instead of a list of chunks
+constexpr uint64_t DELTA_WHOLE = ~uint64_t(0);
+
+// Returns the checksum of the 'nbytes' bytes of 'data'
+uint64_t chunk_checksum(const char *data, uint64_t nbytes);
+
+// Returns the total size of the 'chunks' of 'chunk_bytes' bytes of an array of 'nbytes' bytes
+uint64_t chunks_size(const std::vector<uint64_t> &chunks, uint64_t chunk_bytes, uint64_t nbytes);
+
+// Copies the 'chunks' of 'data' to the contiguous 'out'
+void gather_chunks(const char *data, uint64_t nbytes, const std::vector<uint64_t> &chunks, uint64_t chunk_bytes,
+                   std::vector<char> &out);
+
+// Copies the contiguous 'in' to the 'chunks' of 'data'
+void scatter_chunks(const char *in, const std::vector<uint64_t> &chunks, uint64_t chunk_bytes, char *data,
+                    uint64_t nbytes);
+
+/* The checksums of the chunks of arrays as the other side of the proxy has them, which finds the chunks
+ * that changed since.
+ */
+class ChunkChecksums
+{
+public:
+    const uint64_t chunk_bytes;
+
+    explicit ChunkChecksums(uint64_t chunk_bytes) : chunk_bytes(chunk_bytes) {}
+
+    // Records the host data of 'base' as the data of the other side
+    void record(const bh_base *base);
+    // Records the bytes [begin, end) of the host data of 'base' as the data of the other side
+    void record(const bh_base *base, uint64_t begin, uint64_t end);
+    // Writes the chunks of 'base' that changed since they were recorded to 'out' and records them. Returns false
+    // when 'base' isn't recorded, in which case it is recorded as a whole.
+    bool changed(const bh_base *base, std::vector<uint64_t> &out);
+    // Stop recording 'base'
+    void forget(const bh_base *base) {
+        _sums.erase(base);
+    }
+
+private:
+    std::map<const bh_base *, std::vector<uint64_t> > _sums;
+};
+
+/* The dirty pages are the pages of the host data that the host have written since the backend got them.
+ * The host data is write-protected (using bh_mem_signal) and the first write to a page unprotects it and
+ * marks it dirty. Host data that cannot be protected falls back on comparing the checksums of its pages.
+ * NB: the tracked host data must not be written by anything but the host program.
+ */
+class DirtyPages
+{
+public:
+    const uint64_t page_size;
+
+    DirtyPages();
+    ~DirtyPages();
+
+    // Start tracking the writes to the host data of 'base', which is now the same as the backend's
+    void track(bh_base *base);
+    // Stop tracking 'base', e.g. because its host data is about to be freed or overwritten
+    void release(bh_base *base);
+    // Returns whether 'base' is tracked thus its host data is the same as the backend's but for the dirty pages
+    bool tracking(const bh_base *base) const {
+        return _tracked.find(const_cast<bh_base *>(base)) != _tracked.end() or
+               _fallback_bases.find(const_cast<bh_base *>(base)) != _fallback_bases.end();
+    }
+    // Returns the dirty pages of each tracked base that has any, which are clean afterwards
+    std::map<bh_base *, std::vector<uint64_t> > takeDirty();
+
+private:
+    struct Tracked {
+        char *addr;
+        uint64_t bytes;
+        uint64_t npages;
+        // Set by the signal handler on the first write to a page
+        std::unique_ptr<volatile sig_atomic_t[]> dirty;
+        volatile sig_atomic_t any;
+        const uint64_t page_size;
+    };
+    std::map<bh_base *, std::unique_ptr<Tracked> > _tracked;
+    // The bases whose host data couldn't be protected and their checksums
+    std::set<bh_base *> _fallback_bases;
+    ChunkChecksums _fallback;
+
+    // The bh_mem_signal callback of a host write to the tracked 'idx'
+    static void on_write(void *idx, void *addr);
+};
+
+/* The synced arrays whose data stays on the backend until the host accesses it (the remote-resident mode).
+ * The host data is protected from all access and an access fetches the chunk of 'chunk_bytes' (rounded up to
+ * pages, zero means the whole array) around the accessed address through 'fetch(base, begin, end)'. The other
+ * chunks stay protected until they are accessed.
+ * NB: the fetch runs in the signal handler of the access thus the host must not hold the locks of the proxy.
+ */
+class LazyArrays
+{
+public:
+    explicit LazyArrays(std::function<void(bh_base *, uint64_t, uint64_t)> fetch, uint64_t chunk_bytes = 0);
+    ~LazyArrays();
+
+    // Returns whether the host data of 'base' can be protected, which must be allocated
+    bool deferrable(const bh_base *base) const;
+    // Protect the host data of 'base' until the host accesses it, which then fetches it. Deferring a base that
+    // is deferred already protects its fetched chunks again.
+    void defer(bh_base *base);
+    // Returns whether the data of 'base' is (still) on the backend only
+    bool deferred(const bh_base *base) const {
+        return _deferred.find(const_cast<bh_base *>(base)) != _deferred.end();
+    }
+    // Stop deferring 'base' without fetching it, e.g. because it is about to be freed
+    void release(bh_base *base);
+
+private:
+    struct Deferred {
+        LazyArrays *self;
+        bh_base *base;
+        char *addr;
+        uint64_t bytes;
+        uint64_t chunk_bytes;
+        // The chunks that the host has fetched and the number of chunks that it hasn't
+        std::vector<bool> fetched;
+        uint64_t remaining;
+    };
+    std::map<bh_base *, std::unique_ptr<Deferred> > _deferred;
+    std::function<void(bh_base *, uint64_t, uint64_t)> _fetch;
+    const uint64_t _page_size;
+    const uint64_t _chunk_bytes;
+
+    // The bh_mem_signal callback of a host access to the deferred 'idx'
+    static void on_access(void *idx, void *addr);
+};
+
+#endif
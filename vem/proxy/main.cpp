@@ -33,13 +33,7 @@ class Impl : public ComponentImpl {
 private:
     CommFrontend comm_front;
 public:
-    Impl(int stack_level) : ComponentImpl(stack_level),
-                            comm_front(stack_level,
-                                       config.defaultGet<string>("address", "127.0.0.1"),
-                                       config.defaultGet<int>("port", 4200)) {
-
-
-    }
+    Impl(int stack_level) : ComponentImpl(stack_level), comm_front(config) {}
 
     ~Impl() { }
 
@@ -50,6 +44,12 @@ public:
     };
 
     virtual string message(const string &msg) {
+        if (msg == "statistic_enable_and_reset") {
+            comm_front.statistic_enable_and_reset(config.defaultGet("prof", false));
+            return "";
+        } else if (msg == "statistic") {
+            return comm_front.statistic();
+        }
         throw runtime_error("[PROXY-VEM] message() not implemented!");
     }
 };
@@ -0,0 +1,134 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __BH_VEM_PROXY_STATISTICS_H
+#define __BH_VEM_PROXY_STATISTICS_H
+
+#include <chrono>
+#include <string>
+#include <ostream>
+#include <fstream>
+#include <cstdint>
+
+#include <colors.hpp>
+
+// The statistics of the proxy path between the frontend's execute() and the backend's child
+class ProxyStatistics {
+  public:
+    bool enabled;
+    bool print_on_exit; // On exist, write to file or pprint to stdout
+    uint64_t num_flushes     = 0;
+    // The flushes and fetches that waited for the backend
+    uint64_t num_round_trips = 0;
+    uint64_t num_fetches     = 0;
+    // The bytes of the messages before and after the codec
+    uint64_t bytes_sent_raw  = 0;
+    uint64_t bytes_sent_wire = 0;
+    uint64_t bytes_recv_raw  = 0;
+    uint64_t bytes_recv_wire = 0;
+    std::chrono::duration<double> time_serialize{0};
+    std::chrono::duration<double> time_send{0};
+    std::chrono::duration<double> time_recv{0};
+    // The time of the backend's child, which the backend returns in the head of its replies
+    std::chrono::duration<double> time_remote_exec{0};
+
+    std::chrono::duration<double> wallclock{0};
+    std::chrono::time_point<std::chrono::steady_clock> time_started{std::chrono::steady_clock::now()};
+
+    ProxyStatistics(bool enabled) : enabled(enabled), print_on_exit(enabled) {}
+    ProxyStatistics(bool enabled, bool print_on_exit) : enabled(enabled), print_on_exit(print_on_exit) {}
+
+    void write(std::string filename, std::ostream &out) {
+        if (filename == "") {
+            pprint(out);
+        } else {
+            export_yaml(filename);
+        }
+    }
+
+    // Pretty print the recorded statistics into 'out'
+    void pprint(std::ostream &out) {
+        using namespace std;
+
+        if (enabled) {
+            wallclock = chrono::steady_clock::now() - time_started;
+
+            out << BLU << "[Proxy] Profiling: \n" << RST;
+            out << "Flushes:                         " << GRN << num_flushes                         << "\n" << RST;
+            out << "Fetches:                         " << GRN << num_fetches                         << "\n" << RST;
+            out << "Round-trips per flush:           " << GRN << round_trips_per_flush()             << "\n" << RST;
+            out << "Sent:                            " << GRN << mb(bytes_sent_wire) << " MB of "
+                                                     << mb(bytes_sent_raw) << " MB"                  << "\n" << RST;
+            out << "Received:                        " << GRN << mb(bytes_recv_wire) << " MB of "
+                                                     << mb(bytes_recv_raw) << " MB"                  << "\n" << RST;
+            out << "\n";
+            out << "Wall clock:                      " << BLU << wallclock.count() << "s"            << "\n" << RST;
+            out << "  Serialize:                     " << YEL << time_serialize.count() << "s"       << "\n" << RST;
+            out << "  Send:                          " << YEL << time_send.count() << "s"            << "\n" << RST;
+            out << "  Receive:                       " << YEL << time_recv.count() << "s"            << "\n" << RST;
+            out << "  Remote execution:              " << YEL << time_remote_exec.count() << "s"     << "\n" << RST;
+            out << endl;
+        } else {
+            out << BLU << "[Proxy] Profiling: " << RST;
+            out << BOLD << RED << "Statistic Disabled\n" << RST;
+        }
+    }
+
+    // Export statistic using the YAML format <http://yaml.org>
+    void export_yaml(std::string filename) {
+        using namespace std;
+
+        if (enabled) {
+            wallclock = chrono::steady_clock::now() - time_started;
+
+            ofstream file;
+            file.open(filename);
+
+            file << "----"                                                  << "\n";
+            file << "Proxy:"                                                << "\n";
+            file << "  flushes: "               << num_flushes              << "\n";
+            file << "  fetches: "               << num_fetches              << "\n";
+            file << "  round_trips: "           << num_round_trips          << "\n";
+            file << "  bytes_sent_raw: "        << bytes_sent_raw           << "\n";
+            file << "  bytes_sent_wire: "       << bytes_sent_wire          << "\n";
+            file << "  bytes_recv_raw: "        << bytes_recv_raw           << "\n";
+            file << "  bytes_recv_wire: "       << bytes_recv_wire          << "\n";
+            file << "  timing:"                                             << "\n";
+            file << "    wall_clock: "          << wallclock.count()        << "\n"; // s
+            file << "    serialize: "           << time_serialize.count()   << "\n"; // s
+            file << "    send: "                << time_send.count()        << "\n"; // s
+            file << "    receive: "             << time_recv.count()        << "\n"; // s
+            file << "    remote_exec: "         << time_remote_exec.count() << "\n"; // s
+
+            file.close();
+        }
+    }
+
+  private:
+    static double mb(uint64_t bytes) {
+        return (double) bytes / 1024.0 / 1024.0;
+    }
+
+    double round_trips_per_flush() {
+        return num_flushes == 0 ? 0 : (double) num_round_trips / (double) num_flushes;
+    }
+};
+
+#endif
@@ -0,0 +1,288 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <atomic>
+#include <cstring>
+#include <stdexcept>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "transport.hpp"
+
+using namespace std;
+
+#ifdef VEM_PROXY_IBVERBS
+// Implemented in transport_rdma.cpp
+unique_ptr<Transport> rdma_transport(boost::asio::ip::tcp::socket &socket, const bohrium::ConfigParser *config);
+#endif
+
+namespace {
+
+enum Kind {TCP = 0, SHM = 1, RDMA = 2};
+
+class TcpTransport : public Transport
+{
+    boost::asio::ip::tcp::socket &_socket;
+public:
+    explicit TcpTransport(boost::asio::ip::tcp::socket &socket) : _socket(socket) {}
+    using Transport::write;
+
+    void write(const vector<boost::asio::const_buffer> &buffers) override {
+        boost::asio::write(_socket, buffers);
+    }
+
+    void read(void *data, size_t nbytes) override {
+        boost::asio::read(_socket, boost::asio::buffer(data, nbytes));
+    }
+};
+
+// A single-producer single-consumer ring buffer in shared memory, which is followed by 'capacity' bytes
+struct Ring {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    // The total number of bytes written and read
+    uint64_t head;
+    uint64_t tail;
+    uint64_t capacity;
+    // Set when either side closes the transport
+    int closed;
+
+    char *data() {
+        return reinterpret_cast<char *>(this) + offset();
+    }
+
+    static size_t offset() {
+        return (sizeof(Ring) + 63) / 64 * 64;
+    }
+
+    void init(uint64_t capacity) {
+        pthread_mutexattr_t mattr;
+        pthread_mutexattr_init(&mattr);
+        pthread_mutexattr_setpshared(&mattr, PTHREAD_PROCESS_SHARED);
+        pthread_mutex_init(&mutex, &mattr);
+        pthread_mutexattr_destroy(&mattr);
+        pthread_condattr_t cattr;
+        pthread_condattr_init(&cattr);
+        pthread_condattr_setpshared(&cattr, PTHREAD_PROCESS_SHARED);
+        pthread_cond_init(&cond, &cattr);
+        pthread_condattr_destroy(&cattr);
+        head = tail = 0;
+        this->capacity = capacity;
+        closed = 0;
+    }
+
+    void close() {
+        pthread_mutex_lock(&mutex);
+        closed = 1;
+        pthread_cond_broadcast(&cond);
+        pthread_mutex_unlock(&mutex);
+    }
+
+    // Waits until 'ready()' and returns it, or throws when the ring is closed
+    template<typename F>
+    uint64_t wait(F ready) {
+        pthread_mutex_lock(&mutex);
+        uint64_t ret;
+        while ((ret = ready()) == 0 and not closed) {
+            pthread_cond_wait(&cond, &mutex);
+        }
+        pthread_mutex_unlock(&mutex);
+        if (ret == 0) {
+            throw runtime_error("[PROXY-VEM] the shared memory transport is closed");
+        }
+        return ret;
+    }
+
+    // Advances 'counter' by 'nbytes' and wakes up the other side
+    void advance(uint64_t &counter, uint64_t nbytes) {
+        pthread_mutex_lock(&mutex);
+        counter += nbytes;
+        pthread_cond_broadcast(&cond);
+        pthread_mutex_unlock(&mutex);
+    }
+
+    // NB: the data is copied outside the lock since only one side writes and only the other side reads
+    void write(const char *src, size_t nbytes) {
+        while (nbytes > 0) {
+            const uint64_t space = wait([&]() { return capacity - (head - tail); });
+            const uint64_t pos = head % capacity;
+            const uint64_t n = std::min<uint64_t>({nbytes, space, capacity - pos});
+            memcpy(data() + pos, src, n);
+            advance(head, n);
+            src += n;
+            nbytes -= n;
+        }
+    }
+
+    void read(char *dst, size_t nbytes) {
+        while (nbytes > 0) {
+            const uint64_t avail = wait([&]() { return head - tail; });
+            const uint64_t pos = tail % capacity;
+            const uint64_t n = std::min<uint64_t>({nbytes, avail, capacity - pos});
+            memcpy(dst, data() + pos, n);
+            advance(tail, n);
+            dst += n;
+            nbytes -= n;
+        }
+    }
+};
+
+/* The shared memory transport maps a segment with a ring buffer in each direction. The frontend creates the
+ * segment and the backend unlinks it once it is mapped thus it is gone when both sides are. The array data
+ * is copied directly between the host data and the ring, which avoids the copies through the kernel.
+ */
+class ShmTransport : public Transport
+{
+    char *_segment;
+    size_t _segment_bytes;
+    Ring *_out;
+    Ring *_in;
+
+    void map(int fd, size_t ring_bytes, bool frontend) {
+        _segment_bytes = 2 * (Ring::offset() + ring_bytes);
+        void *p = mmap(NULL, _segment_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED) {
+            throw runtime_error(string("[PROXY-VEM] cannot map the shared memory: ") + strerror(errno));
+        }
+        _segment = static_cast<char *>(p);
+        Ring *to_backend = reinterpret_cast<Ring *>(_segment);
+        Ring *to_frontend = reinterpret_cast<Ring *>(_segment + Ring::offset() + ring_bytes);
+        _out = frontend ? to_backend : to_frontend;
+        _in = frontend ? to_frontend : to_backend;
+    }
+
+public:
+    // Creates the segment 'name' with rings of 'ring_bytes' as the frontend
+    ShmTransport(const string &name, size_t ring_bytes) {
+        const int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (fd < 0 or ftruncate(fd, 2 * (Ring::offset() + ring_bytes)) != 0) {
+            if (fd >= 0) {
+                ::close(fd);
+                shm_unlink(name.c_str());
+            }
+            throw runtime_error("[PROXY-VEM] cannot create the shared memory '" + name + "': " + strerror(errno));
+        }
+        map(fd, ring_bytes, true);
+        _out->init(ring_bytes);
+        _in->init(ring_bytes);
+    }
+
+    // Maps and unlinks the segment 'name' with rings of 'ring_bytes' as the backend
+    ShmTransport(const string &name, size_t ring_bytes, bool) {
+        const int fd = shm_open(name.c_str(), O_RDWR, 0600);
+        if (fd < 0) {
+            throw runtime_error("[PROXY-VEM] cannot open the shared memory '" + name + "': " + strerror(errno));
+        }
+        shm_unlink(name.c_str());
+        map(fd, ring_bytes, false);
+    }
+
+    ~ShmTransport() override {
+        _out->close();
+        _in->close();
+        munmap(_segment, _segment_bytes);
+    }
+
+    using Transport::write;
+
+    void write(const vector<boost::asio::const_buffer> &buffers) override {
+        for (const boost::asio::const_buffer &buf: buffers) {
+            _out->write(boost::asio::buffer_cast<const char *>(buf), boost::asio::buffer_size(buf));
+        }
+    }
+
+    void read(void *data, size_t nbytes) override {
+        _in->read(static_cast<char *>(data), nbytes);
+    }
+};
+
+} // Unnamed namespace
+
+unique_ptr<Transport> connect_transport(boost::asio::ip::tcp::socket &socket, const bohrium::ConfigParser &config)
+{
+    const string name = config.defaultGet<string>("transport", "tcp");
+    uint64_t kind;
+    if (name == "tcp") {
+        kind = TCP;
+    } else if (name == "shm") {
+        kind = SHM;
+    } else if (name == "rdma") {
+        kind = RDMA;
+    } else {
+        throw runtime_error("[PROXY-VEM] the transport '" + name + "' is unknown");
+    }
+    boost::asio::write(socket, boost::asio::buffer(&kind, sizeof(kind)));
+
+    switch (kind) {
+        case SHM: {
+            // Tell the backend the segment and wait until it has mapped it
+            static atomic<unsigned int> count(0);
+            const string segment = "/bh_proxy_" + to_string(getpid()) + "_" + to_string(count++);
+            const uint64_t ring_bytes = std::max<uint64_t>(4096, config.defaultGet<uint64_t>("shm_ring_bytes",
+                                                                                              67108864));
+            unique_ptr<Transport> ret(new ShmTransport(segment, ring_bytes));
+            const uint64_t head[] = {ring_bytes, segment.size()};
+            boost::asio::write(socket, boost::asio::buffer(head));
+            boost::asio::write(socket, boost::asio::buffer(segment));
+            char ack;
+            boost::asio::read(socket, boost::asio::buffer(&ack, 1));
+            return ret;
+        }
+        case RDMA:
+#ifdef VEM_PROXY_IBVERBS
+            return rdma_transport(socket, &config);
+#else
+            throw runtime_error("[PROXY-VEM] the proxy is build without the rdma transport");
+#endif
+        default:
+            return unique_ptr<Transport>(new TcpTransport(socket));
+    }
+}
+
+unique_ptr<Transport> accept_transport(boost::asio::ip::tcp::socket &socket)
+{
+    uint64_t kind;
+    boost::asio::read(socket, boost::asio::buffer(&kind, sizeof(kind)));
+    switch (kind) {
+        case TCP:
+            return unique_ptr<Transport>(new TcpTransport(socket));
+        case SHM: {
+            uint64_t head[2]; // {ring size, length of the segment name}
+            boost::asio::read(socket, boost::asio::buffer(head));
+            string segment(head[1], '\0');
+            boost::asio::read(socket, boost::asio::buffer(&segment[0], segment.size()));
+            unique_ptr<Transport> ret(new ShmTransport(segment, head[0], true));
+            const char ack = 1;
+            boost::asio::write(socket, boost::asio::buffer(&ack, 1));
+            return ret;
+        }
+        case RDMA:
+#ifdef VEM_PROXY_IBVERBS
+            return rdma_transport(socket, nullptr);
+#else
+            throw runtime_error("[PROXY-VEM] the backend is build without the rdma transport");
+#endif
+        default:
+            throw runtime_error("[PROXY-VEM] the frontend selected an unknown transport");
+    }
+}
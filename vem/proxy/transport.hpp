@@ -0,0 +1,59 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef __BH_VEM_PROXY_TRANSPORT_H
+#define __BH_VEM_PROXY_TRANSPORT_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include <boost/asio.hpp>
+
+#include <bh_config_parser.hpp>
+
+/* The byte stream between the proxy frontend and backend. The frontend always connects through TCP and
+ * the 'transport' option then selects what carries the messages:
+ *   - tcp:  the TCP connection itself
+ *   - shm:  two ring buffers in POSIX shared memory, when the frontend and backend are on the same host
+ *   - rdma: an InfiniBand/RoCE queue pair (requires the proxy to be build with ibverbs)
+ */
+class Transport
+{
+public:
+    virtual ~Transport() = default;
+
+    // Write the 'buffers' in order
+    virtual void write(const std::vector<boost::asio::const_buffer> &buffers) = 0;
+    void write(const void *data, size_t nbytes) {
+        write(std::vector<boost::asio::const_buffer>{boost::asio::buffer(data, nbytes)});
+    }
+    // Read exactly 'nbytes' bytes into 'data'
+    virtual void read(void *data, size_t nbytes) = 0;
+};
+
+// Returns the transport of the 'transport' option of 'config' as the frontend of the connected 'socket'
+std::unique_ptr<Transport> connect_transport(boost::asio::ip::tcp::socket &socket,
+                                             const bohrium::ConfigParser &config);
+
+// Returns the transport that the frontend of the connected 'socket' selected as the backend
+std::unique_ptr<Transport> accept_transport(boost::asio::ip::tcp::socket &socket);
+
+#endif
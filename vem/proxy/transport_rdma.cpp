@@ -0,0 +1,407 @@
+/*
+This file is part of Bohrium and copyright (c) 2012 the Bohrium
+team <http://www.bh107.org>.
+
+Bohrium is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as
+published by the Free Software Foundation, either version 3
+of the License, or (at your option) any later version.
+
+Bohrium is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the
+GNU Lesser General Public License along with Bohrium.
+
+If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifdef VEM_PROXY_IBVERBS
+
+#include <map>
+#include <deque>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <infiniband/verbs.h>
+
+#include "transport.hpp"
+
+using namespace std;
+
+namespace {
+
+// The queue pair and buffers of one side, which the two sides exchange through TCP
+struct Info {
+    uint32_t qpn;
+    uint32_t psn;
+    uint16_t lid;
+    uint8_t port;
+    uint8_t gid_index;
+    uint8_t gid[16];
+    // The options of the frontend, which the backend follows
+    uint32_t nbufs;
+    uint32_t buf_bytes;
+    uint64_t zero_copy_bytes;
+};
+
+// The kind of a work request, which is the upper half of its id
+enum WorkKind {RECV = 0, SEND_STAGED = 1, SEND_ZERO_COPY = 2};
+
+uint64_t work_id(WorkKind kind, uint32_t index) {
+    return (static_cast<uint64_t>(kind) << 32) | index;
+}
+
+/* The RDMA transport sends the byte stream through a reliable connected queue pair. Small buffers are
+ * coalesced in registered staging buffers while buffers of at least 'rdma_zero_copy_bytes' (i.e. array data)
+ * are registered and sent directly from their memory. Each side has 'rdma_buffers' receive buffers of
+ * 'rdma_buffer_bytes' posted and the queue pair retries indefinitely when the receiver has none posted.
+ */
+class RdmaTransport : public Transport
+{
+    ibv_context *_ctx = nullptr;
+    ibv_pd *_pd = nullptr;
+    ibv_cq *_cq = nullptr;
+    ibv_qp *_qp = nullptr;
+    ibv_mr *_send_mr = nullptr;
+    ibv_mr *_recv_mr = nullptr;
+    Info _local;
+    // The staging and receive buffers
+    vector<char> _send_pool;
+    vector<char> _recv_pool;
+    vector<uint32_t> _free_staged;
+    uint32_t _max_sends = 0;
+    uint32_t _outstanding = 0;
+    // The staging buffer being filled and its size
+    int64_t _fill = -1;
+    uint32_t _fill_bytes = 0;
+    // The zero copy registrations and their number of outstanding sends
+    map<uint32_t, pair<ibv_mr *, uint32_t> > _zero_copy;
+    uint32_t _next_zero_copy = 0;
+    // The completed receives (buffer and size) in order and the bytes read of the first one
+    deque<pair<uint32_t, uint32_t> > _received;
+    uint32_t _read_offset = 0;
+
+    void check(int err, const char *what) {
+        if (err != 0) {
+            throw runtime_error(string("[PROXY-VEM] rdma: ") + what + " failed: " + strerror(err));
+        }
+    }
+
+    void post_recv(uint32_t buf) {
+        ibv_sge sge{reinterpret_cast<uint64_t>(&_recv_pool[static_cast<size_t>(buf) * _local.buf_bytes]),
+                    _local.buf_bytes,
+                    _recv_mr->lkey};
+        ibv_recv_wr wr{}, *bad;
+        wr.wr_id = work_id(RECV, buf);
+        wr.sg_list = &sge;
+        wr.num_sge = 1;
+        check(ibv_post_recv(_qp, &wr, &bad), "ibv_post_recv()");
+    }
+
+    void post_send(uint64_t id, const char *data, uint32_t nbytes, uint32_t lkey) {
+        while (_outstanding >= _max_sends) {
+            poll();
+        }
+        ibv_sge sge{reinterpret_cast<uint64_t>(data), nbytes, lkey};
+        ibv_send_wr wr{}, *bad;
+        wr.wr_id = id;
+        wr.sg_list = &sge;
+        wr.num_sge = 1;
+        wr.opcode = IBV_WR_SEND;
+        wr.send_flags = IBV_SEND_SIGNALED;
+        check(ibv_post_send(_qp, &wr, &bad), "ibv_post_send()");
+        ++_outstanding;
+    }
+
+    // Handles the available completions
+    void poll() {
+        ibv_wc wc[16];
+        const int n = ibv_poll_cq(_cq, 16, wc);
+        if (n < 0) {
+            throw runtime_error("[PROXY-VEM] rdma: ibv_poll_cq() failed");
+        }
+        for (int i = 0; i < n; ++i) {
+            if (wc[i].status != IBV_WC_SUCCESS) {
+                throw runtime_error(string("[PROXY-VEM] rdma: ") + ibv_wc_status_str(wc[i].status));
+            }
+            const uint32_t index = static_cast<uint32_t>(wc[i].wr_id);
+            switch (static_cast<WorkKind>(wc[i].wr_id >> 32)) {
+                case RECV:
+                    _received.emplace_back(index, wc[i].byte_len);
+                    break;
+                case SEND_STAGED:
+                    --_outstanding;
+                    _free_staged.push_back(index);
+                    break;
+                case SEND_ZERO_COPY: {
+                    --_outstanding;
+                    auto it = _zero_copy.find(index);
+                    if (--it->second.second == 0) {
+                        ibv_dereg_mr(it->second.first);
+                        _zero_copy.erase(it);
+                    }
+                    break;
+                }
+            }
+        }
+    }
+
+    // Sends the staging buffer being filled
+    void flush_staged() {
+        if (_fill >= 0) {
+            post_send(work_id(SEND_STAGED, _fill), &_send_pool[_fill * _local.buf_bytes], _fill_bytes,
+                      _send_mr->lkey);
+            _fill = -1;
+        }
+    }
+
+    void write_staged(const char *src, size_t nbytes) {
+        while (nbytes > 0) {
+            if (_fill < 0) {
+                while (_free_staged.empty()) {
+                    poll();
+                }
+                _fill = _free_staged.back();
+                _free_staged.pop_back();
+                _fill_bytes = 0;
+            }
+            const uint32_t n = static_cast<uint32_t>(std::min<size_t>(nbytes, _local.buf_bytes - _fill_bytes));
+            memcpy(&_send_pool[_fill * _local.buf_bytes + _fill_bytes], src, n);
+            _fill_bytes += n;
+            src += n;
+            nbytes -= n;
+            if (_fill_bytes == _local.buf_bytes) {
+                flush_staged();
+            }
+        }
+    }
+
+    // Returns false when 'src' cannot be registered
+    bool write_zero_copy(const char *src, size_t nbytes) {
+        ibv_mr *mr = ibv_reg_mr(_pd, const_cast<char *>(src), nbytes, 0);
+        if (mr == nullptr) {
+            return false;
+        }
+        flush_staged();
+        const uint32_t id = _next_zero_copy++;
+        const uint32_t nsends = static_cast<uint32_t>((nbytes + _local.buf_bytes - 1) / _local.buf_bytes);
+        _zero_copy[id] = make_pair(mr, nsends);
+        for (size_t offset = 0; offset < nbytes; offset += _local.buf_bytes) {
+            const uint32_t n = static_cast<uint32_t>(std::min<size_t>(_local.buf_bytes, nbytes - offset));
+            post_send(work_id(SEND_ZERO_COPY, id), src + offset, n, mr->lkey);
+        }
+        return true;
+    }
+
+public:
+    RdmaTransport(boost::asio::ip::tcp::socket &socket, const bohrium::ConfigParser *config) {
+        // The frontend decides the options and sends them first
+        Info remote;
+        memset(&_local, 0, sizeof(_local));
+        string device_name;
+        if (config != nullptr) {
+            device_name = config->defaultGet<string>("rdma_device", "");
+            _local.port = static_cast<uint8_t>(config->defaultGet<int>("rdma_port", 1));
+            _local.gid_index = static_cast<uint8_t>(config->defaultGet<int>("rdma_gid_index", 0));
+            _local.nbufs = std::max<uint32_t>(2, config->defaultGet<uint32_t>("rdma_buffers", 16));
+            _local.buf_bytes = std::max<uint32_t>(4096, config->defaultGet<uint32_t>("rdma_buffer_bytes", 1048576));
+            _local.zero_copy_bytes = config->defaultGet<uint64_t>("rdma_zero_copy_bytes", 4194304);
+        } else {
+            boost::asio::read(socket, boost::asio::buffer(&remote, sizeof(remote)));
+            _local.port = remote.port;
+            _local.gid_index = remote.gid_index;
+            _local.nbufs = remote.nbufs;
+            _local.buf_bytes = remote.buf_bytes;
+            _local.zero_copy_bytes = remote.zero_copy_bytes;
+        }
+
+        int num_devices;
+        ibv_device **devices = ibv_get_device_list(&num_devices);
+        if (devices == nullptr or num_devices == 0) {
+            throw runtime_error("[PROXY-VEM] rdma: no devices");
+        }
+        ibv_device *device = nullptr;
+        for (int i = 0; i < num_devices and device == nullptr; ++i) {
+            if (device_name.empty() or device_name == ibv_get_device_name(devices[i])) {
+                device = devices[i];
+            }
+        }
+        if (device != nullptr) {
+            _ctx = ibv_open_device(device);
+        }
+        ibv_free_device_list(devices);
+        if (_ctx == nullptr) {
+            throw runtime_error("[PROXY-VEM] rdma: cannot open the device '" + device_name + "'");
+        }
+
+        ibv_port_attr port_attr;
+        check(ibv_query_port(_ctx, _local.port, &port_attr), "ibv_query_port()");
+        ibv_gid gid;
+        check(ibv_query_gid(_ctx, _local.port, _local.gid_index, &gid), "ibv_query_gid()");
+        memcpy(_local.gid, gid.raw, sizeof(_local.gid));
+        _local.lid = port_attr.lid;
+        _local.psn = static_cast<uint32_t>(lrand48()) & 0xFFFFFF;
+
+        _max_sends = 2 * _local.nbufs;
+        _pd = ibv_alloc_pd(_ctx);
+        _cq = ibv_create_cq(_ctx, _max_sends + _local.nbufs, nullptr, nullptr, 0);
+        if (_pd == nullptr or _cq == nullptr) {
+            throw runtime_error("[PROXY-VEM] rdma: cannot create the protection domain and completion queue");
+        }
+        ibv_qp_init_attr qp_attr{};
+        qp_attr.send_cq = _cq;
+        qp_attr.recv_cq = _cq;
+        qp_attr.qp_type = IBV_QPT_RC;
+        qp_attr.cap.max_send_wr = _max_sends;
+        qp_attr.cap.max_recv_wr = _local.nbufs;
+        qp_attr.cap.max_send_sge = 1;
+        qp_attr.cap.max_recv_sge = 1;
+        _qp = ibv_create_qp(_pd, &qp_attr);
+        if (_qp == nullptr) {
+            throw runtime_error("[PROXY-VEM] rdma: cannot create the queue pair");
+        }
+        _local.qpn = _qp->qp_num;
+
+        _send_pool.resize(static_cast<size_t>(_local.nbufs) * _local.buf_bytes);
+        _recv_pool.resize(static_cast<size_t>(_local.nbufs) * _local.buf_bytes);
+        _send_mr = ibv_reg_mr(_pd, _send_pool.data(), _send_pool.size(), IBV_ACCESS_LOCAL_WRITE);
+        _recv_mr = ibv_reg_mr(_pd, _recv_pool.data(), _recv_pool.size(), IBV_ACCESS_LOCAL_WRITE);
+        if (_send_mr == nullptr or _recv_mr == nullptr) {
+            throw runtime_error("[PROXY-VEM] rdma: cannot register the buffers");
+        }
+        for (uint32_t i = 0; i < _local.nbufs; ++i) {
+            _free_staged.push_back(i);
+        }
+
+        ibv_qp_attr attr{};
+        attr.qp_state = IBV_QPS_INIT;
+        attr.pkey_index = 0;
+        attr.port_num = _local.port;
+        attr.qp_access_flags = 0;
+        check(ibv_modify_qp(_qp, &attr, IBV_QP_STATE | IBV_QP_PKEY_INDEX | IBV_QP_PORT | IBV_QP_ACCESS_FLAGS),
+              "ibv_modify_qp(INIT)");
+        for (uint32_t i = 0; i < _local.nbufs; ++i) {
+            post_recv(i);
+        }
+
+        boost::asio::write(socket, boost::asio::buffer(&_local, sizeof(_local)));
+        if (config != nullptr) {
+            boost::asio::read(socket, boost::asio::buffer(&remote, sizeof(remote)));
+        }
+
+        attr = ibv_qp_attr{};
+        attr.qp_state = IBV_QPS_RTR;
+        attr.path_mtu = port_attr.active_mtu;
+        attr.dest_qp_num = remote.qpn;
+        attr.rq_psn = remote.psn;
+        attr.max_dest_rd_atomic = 1;
+        attr.min_rnr_timer = 12;
+        attr.ah_attr.dlid = remote.lid;
+        attr.ah_attr.port_num = _local.port;
+        const uint8_t zero_gid[16] = {0};
+        if (memcmp(remote.gid, zero_gid, sizeof(zero_gid)) != 0) {
+            attr.ah_attr.is_global = 1;
+            memcpy(attr.ah_attr.grh.dgid.raw, remote.gid, sizeof(remote.gid));
+            attr.ah_attr.grh.sgid_index = _local.gid_index;
+            attr.ah_attr.grh.hop_limit = 1;
+        }
+        check(ibv_modify_qp(_qp, &attr, IBV_QP_STATE | IBV_QP_AV | IBV_QP_PATH_MTU | IBV_QP_DEST_QPN |
+                                        IBV_QP_RQ_PSN | IBV_QP_MAX_DEST_RD_ATOMIC | IBV_QP_MIN_RNR_TIMER),
+              "ibv_modify_qp(RTR)");
+
+        attr = ibv_qp_attr{};
+        attr.qp_state = IBV_QPS_RTS;
+        attr.timeout = 14;
+        attr.retry_cnt = 7;
+        attr.rnr_retry = 7; // Retry indefinitely when the receiver has no buffer posted
+        attr.sq_psn = _local.psn;
+        attr.max_rd_atomic = 1;
+        check(ibv_modify_qp(_qp, &attr, IBV_QP_STATE | IBV_QP_TIMEOUT | IBV_QP_RETRY_CNT | IBV_QP_RNR_RETRY |
+                                        IBV_QP_SQ_PSN | IBV_QP_MAX_QP_RD_ATOMIC), "ibv_modify_qp(RTS)");
+
+        // Neither side sends before both are ready to receive
+        char ready = 1;
+        boost::asio::write(socket, boost::asio::buffer(&ready, 1));
+        boost::asio::read(socket, boost::asio::buffer(&ready, 1));
+    }
+
+    ~RdmaTransport() override {
+        if (_qp != nullptr) {
+            try {
+                flush_staged();
+                while (_outstanding > 0) {
+                    poll();
+                }
+            } catch (...) {}
+            ibv_destroy_qp(_qp);
+        }
+        for (auto &zc: _zero_copy) {
+            ibv_dereg_mr(zc.second.first);
+        }
+        if (_send_mr != nullptr) {
+            ibv_dereg_mr(_send_mr);
+        }
+        if (_recv_mr != nullptr) {
+            ibv_dereg_mr(_recv_mr);
+        }
+        if (_cq != nullptr) {
+            ibv_destroy_cq(_cq);
+        }
+        if (_pd != nullptr) {
+            ibv_dealloc_pd(_pd);
+        }
+        if (_ctx != nullptr) {
+            ibv_close_device(_ctx);
+        }
+    }
+
+    using Transport::write;
+
+    void write(const vector<boost::asio::const_buffer> &buffers) override {
+        for (const boost::asio::const_buffer &buf: buffers) {
+            const char *src = boost::asio::buffer_cast<const char *>(buf);
+            const size_t nbytes = boost::asio::buffer_size(buf);
+            if (nbytes < _local.zero_copy_bytes or not write_zero_copy(src, nbytes)) {
+                write_staged(src, nbytes);
+            }
+        }
+        flush_staged();
+        // The caller might reuse the memory of the zero copy sends as soon as we return
+        while (not _zero_copy.empty()) {
+            poll();
+        }
+    }
+
+    void read(void *data, size_t nbytes) override {
+        char *dst = static_cast<char *>(data);
+        while (nbytes > 0) {
+            while (_received.empty()) {
+                poll();
+            }
+            const uint32_t buf = _received.front().first;
+            const uint32_t avail = _received.front().second - _read_offset;
+            const uint32_t n = static_cast<uint32_t>(std::min<size_t>(nbytes, avail));
+            memcpy(dst, &_recv_pool[static_cast<size_t>(buf) * _local.buf_bytes + _read_offset], n);
+            _read_offset += n;
+            dst += n;
+            nbytes -= n;
+            if (_read_offset == _received.front().second) {
+                _received.pop_front();
+                _read_offset = 0;
+                post_recv(buf);
+            }
+        }
+    }
+};
+
+} // Unnamed namespace
+
+unique_ptr<Transport> rdma_transport(boost::asio::ip::tcp::socket &socket, const bohrium::ConfigParser *config)
+{
+    return unique_ptr<Transport>(new RdmaTransport(socket, config));
+}
+
+#endif